@@ -0,0 +1,294 @@
+/*
+ * AES-ECB/CBC/CTR using the RISC-V vector AES extension (Zvkned)
+ *
+ * Based on arch/arm64/crypto/aes-glue.c
+ *
+ * Copyright (C) 2013 - 2017 Linaro Ltd <ard.biesheuvel@linaro.org>
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <crypto/aes.h>
+#include <crypto/algapi.h>
+#include <crypto/internal/simd.h>
+#include <crypto/internal/skcipher.h>
+#include <linux/module.h>
+
+#include <asm/hwcap.h>
+#include <asm/vector.h>
+
+asmlinkage void aes_ecb_encrypt_zvkned(u8 *out, const u8 *in, const u32 *rk,
+				       int rounds, unsigned long blocks);
+asmlinkage void aes_ecb_decrypt_zvkned(u8 *out, const u8 *in, const u32 *rk,
+				       int rounds, unsigned long blocks);
+asmlinkage void aes_cbc_encrypt_zvkned(u8 *out, const u8 *in, const u32 *rk,
+				       int rounds, unsigned long blocks,
+				       u8 *iv);
+asmlinkage void aes_cbc_decrypt_zvkned(u8 *out, const u8 *in, const u32 *rk,
+				       int rounds, unsigned long blocks,
+				       u8 *iv);
+
+/* Counter blocks are encrypted this many at a time */
+#define CTR_BLOCKS	8
+
+static int skcipher_aes_setkey(struct crypto_skcipher *tfm, const u8 *in_key,
+			       unsigned int key_len)
+{
+	return crypto_aes_set_key(crypto_skcipher_tfm(tfm), in_key, key_len);
+}
+
+static int ecb_encrypt(struct skcipher_request *req)
+{
+	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
+	struct crypto_aes_ctx *ctx = crypto_skcipher_ctx(tfm);
+	int err, rounds = 6 + ctx->key_length / 4;
+	struct skcipher_walk walk;
+	unsigned int blocks;
+
+	err = skcipher_walk_virt(&walk, req, true);
+
+	kernel_vector_begin();
+	while ((blocks = (walk.nbytes / AES_BLOCK_SIZE))) {
+		aes_ecb_encrypt_zvkned(walk.dst.virt.addr, walk.src.virt.addr,
+				       ctx->key_enc, rounds, blocks);
+		err = skcipher_walk_done(&walk, walk.nbytes % AES_BLOCK_SIZE);
+	}
+	kernel_vector_end();
+	return err;
+}
+
+static int ecb_decrypt(struct skcipher_request *req)
+{
+	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
+	struct crypto_aes_ctx *ctx = crypto_skcipher_ctx(tfm);
+	int err, rounds = 6 + ctx->key_length / 4;
+	struct skcipher_walk walk;
+	unsigned int blocks;
+
+	err = skcipher_walk_virt(&walk, req, true);
+
+	kernel_vector_begin();
+	while ((blocks = (walk.nbytes / AES_BLOCK_SIZE))) {
+		aes_ecb_decrypt_zvkned(walk.dst.virt.addr, walk.src.virt.addr,
+				       ctx->key_enc, rounds, blocks);
+		err = skcipher_walk_done(&walk, walk.nbytes % AES_BLOCK_SIZE);
+	}
+	kernel_vector_end();
+	return err;
+}
+
+static int cbc_encrypt(struct skcipher_request *req)
+{
+	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
+	struct crypto_aes_ctx *ctx = crypto_skcipher_ctx(tfm);
+	int err, rounds = 6 + ctx->key_length / 4;
+	struct skcipher_walk walk;
+	unsigned int blocks;
+
+	err = skcipher_walk_virt(&walk, req, true);
+
+	kernel_vector_begin();
+	while ((blocks = (walk.nbytes / AES_BLOCK_SIZE))) {
+		aes_cbc_encrypt_zvkned(walk.dst.virt.addr, walk.src.virt.addr,
+				       ctx->key_enc, rounds, blocks, walk.iv);
+		err = skcipher_walk_done(&walk, walk.nbytes % AES_BLOCK_SIZE);
+	}
+	kernel_vector_end();
+	return err;
+}
+
+static int cbc_decrypt(struct skcipher_request *req)
+{
+	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
+	struct crypto_aes_ctx *ctx = crypto_skcipher_ctx(tfm);
+	int err, rounds = 6 + ctx->key_length / 4;
+	struct skcipher_walk walk;
+	unsigned int blocks;
+
+	err = skcipher_walk_virt(&walk, req, true);
+
+	kernel_vector_begin();
+	while ((blocks = (walk.nbytes / AES_BLOCK_SIZE))) {
+		aes_cbc_decrypt_zvkned(walk.dst.virt.addr, walk.src.virt.addr,
+				       ctx->key_enc, rounds, blocks, walk.iv);
+		err = skcipher_walk_done(&walk, walk.nbytes % AES_BLOCK_SIZE);
+	}
+	kernel_vector_end();
+	return err;
+}
+
+/*
+ * The counter blocks are built here and encrypted as one ECB batch, which
+ * keeps the vector unit busy without a separate CTR routine.
+ */
+static void ctr_crypt_blocks(struct crypto_aes_ctx *ctx, int rounds,
+			     u8 *dst, const u8 *src, unsigned int nbytes,
+			     u8 *iv)
+{
+	u8 ks[CTR_BLOCKS * AES_BLOCK_SIZE] __aligned(sizeof(u32));
+	unsigned int blocks = DIV_ROUND_UP(nbytes, AES_BLOCK_SIZE);
+	unsigned int i;
+
+	for (i = 0; i < blocks; i++) {
+		memcpy(&ks[i * AES_BLOCK_SIZE], iv, AES_BLOCK_SIZE);
+		crypto_inc(iv, AES_BLOCK_SIZE);
+	}
+	aes_ecb_encrypt_zvkned(ks, ks, ctx->key_enc, rounds, blocks);
+
+	if (dst != src)
+		memcpy(dst, src, nbytes);
+	crypto_xor(dst, ks, nbytes);
+}
+
+static int ctr_encrypt(struct skcipher_request *req)
+{
+	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
+	struct crypto_aes_ctx *ctx = crypto_skcipher_ctx(tfm);
+	int err, rounds = 6 + ctx->key_length / 4;
+	struct skcipher_walk walk;
+
+	err = skcipher_walk_virt(&walk, req, true);
+
+	kernel_vector_begin();
+	while (walk.nbytes >= AES_BLOCK_SIZE) {
+		unsigned int nbytes = round_down(walk.nbytes, AES_BLOCK_SIZE);
+		u8 *dst = walk.dst.virt.addr;
+		u8 *src = walk.src.virt.addr;
+		unsigned int n;
+
+		for (n = 0; n < nbytes; n += CTR_BLOCKS * AES_BLOCK_SIZE)
+			ctr_crypt_blocks(ctx, rounds, dst + n, src + n,
+					 min_t(unsigned int, nbytes - n,
+					       CTR_BLOCKS * AES_BLOCK_SIZE),
+					 walk.iv);
+		err = skcipher_walk_done(&walk, walk.nbytes - nbytes);
+	}
+	if (walk.nbytes) {
+		ctr_crypt_blocks(ctx, rounds, walk.dst.virt.addr,
+				 walk.src.virt.addr, walk.nbytes, walk.iv);
+		err = skcipher_walk_done(&walk, 0);
+	}
+	kernel_vector_end();
+
+	return err;
+}
+
+static struct skcipher_alg aes_algs[] = { {
+	.base = {
+		.cra_name		= "__ecb(aes)",
+		.cra_driver_name	= "__ecb-aes-zvkned",
+		.cra_priority		= 300,
+		.cra_flags		= CRYPTO_ALG_INTERNAL,
+		.cra_blocksize		= AES_BLOCK_SIZE,
+		.cra_ctxsize		= sizeof(struct crypto_aes_ctx),
+		.cra_alignmask		= sizeof(u32) - 1,
+		.cra_module		= THIS_MODULE,
+	},
+	.min_keysize	= AES_MIN_KEY_SIZE,
+	.max_keysize	= AES_MAX_KEY_SIZE,
+	.setkey		= skcipher_aes_setkey,
+	.encrypt	= ecb_encrypt,
+	.decrypt	= ecb_decrypt,
+}, {
+	.base = {
+		.cra_name		= "__cbc(aes)",
+		.cra_driver_name	= "__cbc-aes-zvkned",
+		.cra_priority		= 300,
+		.cra_flags		= CRYPTO_ALG_INTERNAL,
+		.cra_blocksize		= AES_BLOCK_SIZE,
+		.cra_ctxsize		= sizeof(struct crypto_aes_ctx),
+		.cra_alignmask		= sizeof(u32) - 1,
+		.cra_module		= THIS_MODULE,
+	},
+	.min_keysize	= AES_MIN_KEY_SIZE,
+	.max_keysize	= AES_MAX_KEY_SIZE,
+	.ivsize		= AES_BLOCK_SIZE,
+	.setkey		= skcipher_aes_setkey,
+	.encrypt	= cbc_encrypt,
+	.decrypt	= cbc_decrypt,
+}, {
+	.base = {
+		.cra_name		= "__ctr(aes)",
+		.cra_driver_name	= "__ctr-aes-zvkned",
+		.cra_priority		= 300,
+		.cra_flags		= CRYPTO_ALG_INTERNAL,
+		.cra_blocksize		= 1,
+		.cra_ctxsize		= sizeof(struct crypto_aes_ctx),
+		.cra_alignmask		= sizeof(u32) - 1,
+		.cra_module		= THIS_MODULE,
+	},
+	.min_keysize	= AES_MIN_KEY_SIZE,
+	.max_keysize	= AES_MAX_KEY_SIZE,
+	.ivsize		= AES_BLOCK_SIZE,
+	.chunksize	= AES_BLOCK_SIZE,
+	.setkey		= skcipher_aes_setkey,
+	.encrypt	= ctr_encrypt,
+	.decrypt	= ctr_encrypt,
+} };
+
+static struct simd_skcipher_alg *aes_simd_algs[ARRAY_SIZE(aes_algs)];
+
+static void aes_zvkned_exit(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(aes_simd_algs); i++)
+		if (aes_simd_algs[i])
+			simd_skcipher_free(aes_simd_algs[i]);
+
+	crypto_unregister_skciphers(aes_algs, ARRAY_SIZE(aes_algs));
+}
+
+static int __init aes_zvkned_init(void)
+{
+	struct simd_skcipher_alg *simd;
+	const char *basename;
+	const char *algname;
+	const char *drvname;
+	int err;
+	int i;
+
+	if (!has_vector() ||
+	    !riscv_isa_extension_available(RISCV_ISA_EXT_ZVKNED))
+		return -ENODEV;
+
+	err = crypto_register_skciphers(aes_algs, ARRAY_SIZE(aes_algs));
+	if (err)
+		return err;
+
+	/* The simd wrappers defer to cryptd where the vector unit is off limits */
+	for (i = 0; i < ARRAY_SIZE(aes_algs); i++) {
+		algname = aes_algs[i].base.cra_name + 2;
+		drvname = aes_algs[i].base.cra_driver_name + 2;
+		basename = aes_algs[i].base.cra_driver_name;
+		simd = simd_skcipher_create_compat(algname, drvname, basename);
+		err = PTR_ERR(simd);
+		if (IS_ERR(simd))
+			goto unregister_simds;
+
+		aes_simd_algs[i] = simd;
+	}
+
+	return 0;
+
+unregister_simds:
+	aes_zvkned_exit();
+	return err;
+}
+
+module_init(aes_zvkned_init);
+module_exit(aes_zvkned_exit);
+
+MODULE_DESCRIPTION("AES-ECB/CBC/CTR using the RISC-V Zvkned extension");
+MODULE_LICENSE("GPL v2");
+MODULE_ALIAS_CRYPTO("ecb(aes)");
+MODULE_ALIAS_CRYPTO("cbc(aes)");
+MODULE_ALIAS_CRYPTO("ctr(aes)");
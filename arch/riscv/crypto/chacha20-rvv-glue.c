@@ -0,0 +1,118 @@
+/*
+ * ChaCha20 256-bit cipher algorithm, RFC7539, RISC-V vector functions
+ *
+ * Based on arch/arm64/crypto/chacha20-neon-glue.c
+ *
+ * Copyright (C) 2016 - 2017 Linaro, Ltd. <ard.biesheuvel@linaro.org>
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <crypto/algapi.h>
+#include <crypto/chacha20.h>
+#include <crypto/internal/skcipher.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+#include <asm/simd.h>
+#include <asm/vector.h>
+
+asmlinkage void chacha20_xor_rvv(u32 *state, u8 *dst, const u8 *src,
+				 unsigned long blocks);
+
+static void chacha20_dorvv(u32 *state, u8 *dst, const u8 *src,
+			   unsigned int bytes)
+{
+	u32 buf[CHACHA20_BLOCK_SIZE / sizeof(u32)];
+	unsigned int blocks = bytes / CHACHA20_BLOCK_SIZE;
+
+	if (blocks) {
+		chacha20_xor_rvv(state, dst, src, blocks);
+		bytes -= blocks * CHACHA20_BLOCK_SIZE;
+		src += blocks * CHACHA20_BLOCK_SIZE;
+		dst += blocks * CHACHA20_BLOCK_SIZE;
+	}
+	if (bytes) {
+		memcpy(buf, src, bytes);
+		chacha20_xor_rvv(state, (u8 *)buf, (u8 *)buf, 1);
+		memcpy(dst, buf, bytes);
+	}
+}
+
+static int chacha20_rvv(struct skcipher_request *req)
+{
+	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
+	struct chacha20_ctx *ctx = crypto_skcipher_ctx(tfm);
+	struct skcipher_walk walk;
+	u32 state[16];
+	int err;
+
+	if (req->cryptlen <= CHACHA20_BLOCK_SIZE || !may_use_simd())
+		return crypto_chacha20_crypt(req);
+
+	err = skcipher_walk_virt(&walk, req, true);
+
+	crypto_chacha20_init(state, ctx, walk.iv);
+
+	kernel_vector_begin();
+	while (walk.nbytes > 0) {
+		unsigned int nbytes = walk.nbytes;
+
+		if (nbytes < walk.total)
+			nbytes = round_down(nbytes, walk.stride);
+
+		chacha20_dorvv(state, walk.dst.virt.addr, walk.src.virt.addr,
+			       nbytes);
+		err = skcipher_walk_done(&walk, walk.nbytes - nbytes);
+	}
+	kernel_vector_end();
+
+	return err;
+}
+
+static struct skcipher_alg alg = {
+	.base.cra_name		= "chacha20",
+	.base.cra_driver_name	= "chacha20-rvv",
+	.base.cra_priority	= 300,
+	.base.cra_blocksize	= 1,
+	.base.cra_ctxsize	= sizeof(struct chacha20_ctx),
+	.base.cra_alignmask	= sizeof(u32) - 1,
+	.base.cra_module	= THIS_MODULE,
+
+	.min_keysize		= CHACHA20_KEY_SIZE,
+	.max_keysize		= CHACHA20_KEY_SIZE,
+	.ivsize			= CHACHA20_IV_SIZE,
+	.chunksize		= CHACHA20_BLOCK_SIZE,
+	.walksize		= 4 * CHACHA20_BLOCK_SIZE,
+	.setkey			= crypto_chacha20_setkey,
+	.encrypt		= chacha20_rvv,
+	.decrypt		= chacha20_rvv,
+};
+
+static int __init chacha20_rvv_mod_init(void)
+{
+	if (!has_vector())
+		return -ENODEV;
+
+	return crypto_register_skcipher(&alg);
+}
+
+static void __exit chacha20_rvv_mod_fini(void)
+{
+	crypto_unregister_skcipher(&alg);
+}
+
+module_init(chacha20_rvv_mod_init);
+module_exit(chacha20_rvv_mod_fini);
+
+MODULE_DESCRIPTION("ChaCha20 using the RISC-V vector extension");
+MODULE_LICENSE("GPL v2");
+MODULE_ALIAS_CRYPTO("chacha20");
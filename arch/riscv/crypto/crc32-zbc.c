@@ -0,0 +1,312 @@
+/*
+ * Accelerated CRC32(C) using the RISC-V Zbc carry-less multiply instructions
+ *
+ * Based on arch/arm64/crypto/crc32-ce-glue.c
+ *
+ * Copyright (C) 2016 Linaro Ltd <ard.biesheuvel@linaro.org>
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/crc32.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/stringify.h>
+
+#include <crypto/internal/hash.h>
+
+#include <asm/hwcap.h>
+#include <asm/unaligned.h>
+
+/*
+ * The assembler doesn't know Zbc, so the instructions are spelled out with
+ * their operands in a0-a2.
+ */
+#define ZBC_INSN(funct3)	.word (0x05 << 25) | (12 << 20) | (11 << 15) | \
+				      ((funct3) << 12) | (10 << 7) | 0x33
+
+#define DEFINE_ZBC_OP(name, funct3)					\
+static __always_inline unsigned long name(unsigned long a,		\
+					  unsigned long b)		\
+{									\
+	register unsigned long rd asm("a0");				\
+	register unsigned long rs1 asm("a1") = a;			\
+	register unsigned long rs2 asm("a2") = b;			\
+									\
+	asm(__stringify(ZBC_INSN(funct3))				\
+	    : "=r" (rd) : "r" (rs1), "r" (rs2));			\
+	return rd;							\
+}
+
+DEFINE_ZBC_OP(clmul, 1)
+DEFINE_ZBC_OP(clmulr, 2)
+DEFINE_ZBC_OP(clmulh, 3)
+
+/*
+ * Both CRCs are bit-reflected, so a 64-bit little-endian load holds the
+ * coefficients of x^63 down to x^0 from bit 0 up, and a carry-less product
+ * comes out one bit short of where the reflected 128-bit result belongs.
+ * The folding constants make up for that by being x^(n-1) mod P rather
+ * than x^n mod P, stored reflected in the top half of a 64-bit word.
+ */
+struct crc32_zbc_consts {
+	unsigned long fold256[2];	/* x^319, x^255 mod P */
+	unsigned long fold128[2];	/* x^191, x^127 mod P */
+	unsigned long fold96;		/* x^95 mod P */
+	unsigned long quot;		/* floor(x^96 / P), reflected */
+	unsigned long poly;		/* P, reflected, shifted up by 32 */
+	u32 (*fallback)(u32 crc, unsigned char const *p, size_t len);
+};
+
+static const struct crc32_zbc_consts crc32_consts = {
+	.fold256	= { 0x9570d49500000000, 0x01b5fd1d00000000 },
+	.fold128	= { 0x65673b4600000000, 0x9ba54c6f00000000 },
+	.fold96		= 0xccaa009e00000000,
+	.quot		= 0x5a72d812fb808b20,
+	.poly		= 0xedb88320UL << 32,
+	.fallback	= crc32_le,
+};
+
+static const struct crc32_zbc_consts crc32c_consts = {
+	.fold256	= { 0x33ccbbbc00000000, 0xa2158b3400000000 },
+	.fold128	= { 0x3743f7bd00000000, 0x3171d43000000000 },
+	.fold96		= 0x493c7d2700000000,
+	.quot		= 0xa434f61c6f5389f8,
+	.poly		= 0x82f63b78UL << 32,
+	.fallback	= __crc32c_le,
+};
+
+/*
+ * The CRC of the 64 bits in s, starting from zero: a Barrett reduction of
+ * s * x^32.  There is no clmulrh, hence the clmul and shift.
+ */
+static inline u32 crc32_zbc_reduce(unsigned long s,
+				   const struct crc32_zbc_consts *k)
+{
+	unsigned long t;
+
+	t = clmul(s, k->quot) << 1;
+	t ^= s;
+	return clmulr(t, k->poly) >> 32;
+}
+
+/* x = x * x^n + d, where the constants are for n */
+static inline void crc32_zbc_fold(unsigned long x[2], const unsigned long *d,
+				  const unsigned long c[2])
+{
+	unsigned long lo, hi;
+
+	lo = clmul(x[0], c[0]) ^ clmul(x[1], c[1]);
+	hi = clmulh(x[0], c[0]) ^ clmulh(x[1], c[1]);
+	x[0] = lo ^ d[0];
+	x[1] = hi ^ d[1];
+}
+
+/* len >= 16, p aligned */
+static u32 crc32_zbc_fold_blocks(u32 crc, const unsigned long **pp,
+				 size_t *lenp, const struct crc32_zbc_consts *k)
+{
+	const unsigned long *p = *pp;
+	size_t len = *lenp;
+	unsigned long x[2], y[2], lo, hi;
+
+	x[0] = p[0] ^ crc;
+	x[1] = p[1];
+	p += 2;
+	len -= 16;
+
+	/* Two independent accumulators, each folded across 32 bytes */
+	if (len >= 48) {
+		y[0] = p[0];
+		y[1] = p[1];
+		p += 2;
+		len -= 16;
+
+		while (len >= 32) {
+			crc32_zbc_fold(x, p, k->fold256);
+			crc32_zbc_fold(y, p + 2, k->fold256);
+			p += 4;
+			len -= 32;
+		}
+
+		crc32_zbc_fold(x, y, k->fold128);
+	}
+
+	while (len >= 16) {
+		crc32_zbc_fold(x, p, k->fold128);
+		p += 2;
+		len -= 16;
+	}
+
+	/* Down to x * x^32 in 96 bits, then Barrett on the top 64 */
+	lo = clmul(x[0], k->fold96) ^ (x[1] << 32);
+	hi = clmulh(x[0], k->fold96) ^ (x[1] >> 32);
+
+	*pp = p;
+	*lenp = len;
+	return crc32_zbc_reduce((lo >> 32) | (hi << 32), k) ^ (hi >> 32);
+}
+
+static u32 crc32_zbc(u32 crc, const u8 *data, size_t len,
+		     const struct crc32_zbc_consts *k)
+{
+	const unsigned long *p;
+	size_t head;
+
+	head = min_t(size_t, len, -(uintptr_t)data & (sizeof(long) - 1));
+	if (head) {
+		crc = k->fallback(crc, data, head);
+		data += head;
+		len -= head;
+	}
+
+	p = (const unsigned long *)data;
+	if (len >= 16)
+		crc = crc32_zbc_fold_blocks(crc, &p, &len, k);
+
+	while (len >= sizeof(long)) {
+		crc = crc32_zbc_reduce(crc ^ *p++, k);
+		len -= sizeof(long);
+	}
+
+	if (len)
+		crc = k->fallback(crc, (const u8 *)p, len);
+
+	return crc;
+}
+
+static int crc32_zbc_cra_init(struct crypto_tfm *tfm)
+{
+	u32 *key = crypto_tfm_ctx(tfm);
+
+	*key = 0;
+	return 0;
+}
+
+static int crc32c_zbc_cra_init(struct crypto_tfm *tfm)
+{
+	u32 *key = crypto_tfm_ctx(tfm);
+
+	*key = ~0;
+	return 0;
+}
+
+static int crc32_zbc_setkey(struct crypto_shash *hash, const u8 *key,
+			    unsigned int keylen)
+{
+	u32 *mctx = crypto_shash_ctx(hash);
+
+	if (keylen != sizeof(u32)) {
+		crypto_shash_set_flags(hash, CRYPTO_TFM_RES_BAD_KEY_LEN);
+		return -EINVAL;
+	}
+	*mctx = le32_to_cpup((__le32 *)key);
+	return 0;
+}
+
+static int crc32_zbc_init(struct shash_desc *desc)
+{
+	u32 *mctx = crypto_shash_ctx(desc->tfm);
+	u32 *crc = shash_desc_ctx(desc);
+
+	*crc = *mctx;
+	return 0;
+}
+
+static int crc32_zbc_update(struct shash_desc *desc, const u8 *data,
+			    unsigned int length)
+{
+	u32 *crc = shash_desc_ctx(desc);
+
+	*crc = crc32_zbc(*crc, data, length, &crc32_consts);
+	return 0;
+}
+
+static int crc32c_zbc_update(struct shash_desc *desc, const u8 *data,
+			     unsigned int length)
+{
+	u32 *crc = shash_desc_ctx(desc);
+
+	*crc = crc32_zbc(*crc, data, length, &crc32c_consts);
+	return 0;
+}
+
+static int crc32_zbc_final(struct shash_desc *desc, u8 *out)
+{
+	u32 *crc = shash_desc_ctx(desc);
+
+	put_unaligned_le32(*crc, out);
+	return 0;
+}
+
+static int crc32c_zbc_final(struct shash_desc *desc, u8 *out)
+{
+	u32 *crc = shash_desc_ctx(desc);
+
+	put_unaligned_le32(~*crc, out);
+	return 0;
+}
+
+static struct shash_alg crc32_zbc_algs[] = { {
+	.setkey			= crc32_zbc_setkey,
+	.init			= crc32_zbc_init,
+	.update			= crc32_zbc_update,
+	.final			= crc32_zbc_final,
+	.descsize		= sizeof(u32),
+	.digestsize		= sizeof(u32),
+
+	.base.cra_ctxsize	= sizeof(u32),
+	.base.cra_init		= crc32_zbc_cra_init,
+	.base.cra_name		= "crc32",
+	.base.cra_driver_name	= "crc32-riscv-zbc",
+	.base.cra_priority	= 200,
+	.base.cra_blocksize	= 1,
+	.base.cra_module	= THIS_MODULE,
+}, {
+	.setkey			= crc32_zbc_setkey,
+	.init			= crc32_zbc_init,
+	.update			= crc32c_zbc_update,
+	.final			= crc32c_zbc_final,
+	.descsize		= sizeof(u32),
+	.digestsize		= sizeof(u32),
+
+	.base.cra_ctxsize	= sizeof(u32),
+	.base.cra_init		= crc32c_zbc_cra_init,
+	.base.cra_name		= "crc32c",
+	.base.cra_driver_name	= "crc32c-riscv-zbc",
+	.base.cra_priority	= 200,
+	.base.cra_blocksize	= 1,
+	.base.cra_module	= THIS_MODULE,
+} };
+
+static int __init crc32_zbc_mod_init(void)
+{
+	if (!riscv_isa_extension_available(RISCV_ISA_EXT_ZBC))
+		return -ENODEV;
+
+	return crypto_register_shashes(crc32_zbc_algs,
+				       ARRAY_SIZE(crc32_zbc_algs));
+}
+
+static void __exit crc32_zbc_mod_exit(void)
+{
+	crypto_unregister_shashes(crc32_zbc_algs,
+				  ARRAY_SIZE(crc32_zbc_algs));
+}
+
+module_init(crc32_zbc_mod_init);
+module_exit(crc32_zbc_mod_exit);
+
+MODULE_DESCRIPTION("CRC32 and CRC32C using RISC-V Zbc");
+MODULE_LICENSE("GPL v2");
+MODULE_ALIAS_CRYPTO("crc32");
+MODULE_ALIAS_CRYPTO("crc32c");
@@ -0,0 +1,187 @@
+/*
+ * GHASH hash function using the RISC-V vector GCM/GMAC extension (Zvkg)
+ *
+ * Based on arch/arm64/crypto/ghash-ce-glue.c
+ *
+ * Copyright (C) 2014 Linaro Ltd. <ard.biesheuvel@linaro.org>
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <crypto/algapi.h>
+#include <crypto/gf128mul.h>
+#include <crypto/ghash.h>
+#include <crypto/internal/hash.h>
+#include <linux/crypto.h>
+#include <linux/module.h>
+
+#include <asm/hwcap.h>
+#include <asm/simd.h>
+#include <asm/vector.h>
+
+struct ghash_zvkg_ctx {
+	be128 h;
+	/* For callers that can't use the vector unit */
+	struct gf128mul_4k *gf128;
+};
+
+struct ghash_zvkg_desc_ctx {
+	be128 digest;
+	u8 buf[GHASH_BLOCK_SIZE];
+	u32 count;
+};
+
+asmlinkage void ghash_update_zvkg(be128 *dg, const be128 *h, const u8 *src,
+				  unsigned long blocks);
+
+static void ghash_do_update(struct ghash_zvkg_ctx *key, be128 *dg,
+			    const u8 *src, unsigned int blocks)
+{
+	if (may_use_simd()) {
+		kernel_vector_begin();
+		ghash_update_zvkg(dg, &key->h, src, blocks);
+		kernel_vector_end();
+		return;
+	}
+
+	while (blocks--) {
+		crypto_xor((u8 *)dg, src, GHASH_BLOCK_SIZE);
+		gf128mul_4k_lle(dg, key->gf128);
+		src += GHASH_BLOCK_SIZE;
+	}
+}
+
+static int ghash_init(struct shash_desc *desc)
+{
+	struct ghash_zvkg_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	*ctx = (struct ghash_zvkg_desc_ctx){};
+	return 0;
+}
+
+static int ghash_update(struct shash_desc *desc, const u8 *src,
+			unsigned int len)
+{
+	struct ghash_zvkg_ctx *key = crypto_shash_ctx(desc->tfm);
+	struct ghash_zvkg_desc_ctx *ctx = shash_desc_ctx(desc);
+	unsigned int partial = ctx->count % GHASH_BLOCK_SIZE;
+	unsigned int blocks;
+
+	ctx->count += len;
+
+	if ((partial + len) >= GHASH_BLOCK_SIZE) {
+		if (partial) {
+			int p = GHASH_BLOCK_SIZE - partial;
+
+			memcpy(ctx->buf + partial, src, p);
+			src += p;
+			len -= p;
+			ghash_do_update(key, &ctx->digest, ctx->buf, 1);
+		}
+
+		blocks = len / GHASH_BLOCK_SIZE;
+		len %= GHASH_BLOCK_SIZE;
+
+		if (blocks)
+			ghash_do_update(key, &ctx->digest, src, blocks);
+		src += blocks * GHASH_BLOCK_SIZE;
+		partial = 0;
+	}
+	if (len)
+		memcpy(ctx->buf + partial, src, len);
+	return 0;
+}
+
+static int ghash_final(struct shash_desc *desc, u8 *dst)
+{
+	struct ghash_zvkg_ctx *key = crypto_shash_ctx(desc->tfm);
+	struct ghash_zvkg_desc_ctx *ctx = shash_desc_ctx(desc);
+	unsigned int partial = ctx->count % GHASH_BLOCK_SIZE;
+
+	if (partial) {
+		memset(ctx->buf + partial, 0, GHASH_BLOCK_SIZE - partial);
+		ghash_do_update(key, &ctx->digest, ctx->buf, 1);
+	}
+	memcpy(dst, &ctx->digest, GHASH_DIGEST_SIZE);
+
+	*ctx = (struct ghash_zvkg_desc_ctx){};
+	return 0;
+}
+
+static int ghash_setkey(struct crypto_shash *tfm,
+			const u8 *inkey, unsigned int keylen)
+{
+	struct ghash_zvkg_ctx *key = crypto_shash_ctx(tfm);
+
+	if (keylen != GHASH_BLOCK_SIZE) {
+		crypto_shash_set_flags(tfm, CRYPTO_TFM_RES_BAD_KEY_LEN);
+		return -EINVAL;
+	}
+
+	memcpy(&key->h, inkey, GHASH_BLOCK_SIZE);
+
+	if (key->gf128)
+		gf128mul_free_4k(key->gf128);
+	key->gf128 = gf128mul_init_4k_lle(&key->h);
+	if (!key->gf128)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static void ghash_exit_tfm(struct crypto_tfm *tfm)
+{
+	struct ghash_zvkg_ctx *key = crypto_tfm_ctx(tfm);
+
+	if (key->gf128)
+		gf128mul_free_4k(key->gf128);
+}
+
+static struct shash_alg ghash_alg = {
+	.digestsize	= GHASH_DIGEST_SIZE,
+	.init		= ghash_init,
+	.update		= ghash_update,
+	.final		= ghash_final,
+	.setkey		= ghash_setkey,
+	.descsize	= sizeof(struct ghash_zvkg_desc_ctx),
+	.base		= {
+		.cra_name		= "ghash",
+		.cra_driver_name	= "ghash-zvkg",
+		.cra_priority		= 300,
+		.cra_flags		= CRYPTO_ALG_TYPE_SHASH,
+		.cra_blocksize		= GHASH_BLOCK_SIZE,
+		.cra_ctxsize		= sizeof(struct ghash_zvkg_ctx),
+		.cra_alignmask		= sizeof(u32) - 1,
+		.cra_exit		= ghash_exit_tfm,
+		.cra_module		= THIS_MODULE,
+	},
+};
+
+static int __init ghash_zvkg_mod_init(void)
+{
+	if (!has_vector() ||
+	    !riscv_isa_extension_available(RISCV_ISA_EXT_ZVKG))
+		return -ENODEV;
+
+	return crypto_register_shash(&ghash_alg);
+}
+
+static void __exit ghash_zvkg_mod_exit(void)
+{
+	crypto_unregister_shash(&ghash_alg);
+}
+
+module_init(ghash_zvkg_mod_init);
+module_exit(ghash_zvkg_mod_exit);
+
+MODULE_DESCRIPTION("GHASH using the RISC-V Zvkg extension");
+MODULE_LICENSE("GPL v2");
+MODULE_ALIAS_CRYPTO("ghash");
@@ -0,0 +1,136 @@
+/*
+ * SHA-224/SHA-256 using the RISC-V vector SHA-2 extensions (Zvknha, Zvkb)
+ *
+ * Based on arch/arm64/crypto/sha2-ce-glue.c
+ *
+ * Copyright (C) 2014 Linaro Ltd <ard.biesheuvel@linaro.org>
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <crypto/internal/hash.h>
+#include <crypto/sha.h>
+#include <crypto/sha256_base.h>
+#include <linux/crypto.h>
+#include <linux/module.h>
+
+#include <asm/hwcap.h>
+#include <asm/simd.h>
+#include <asm/vector.h>
+
+asmlinkage void sha256_transform_zvknha(u32 *state, u8 const *src,
+					int blocks);
+
+/* Word i of the state the instructions want, as an index into sst->state */
+static const u8 sha256_zvknha_order[8] = { 5, 4, 1, 0, 7, 6, 3, 2 };
+
+static void sha256_zvknha_block(struct sha256_state *sst, u8 const *src,
+				int blocks)
+{
+	u32 state[8];
+	int i;
+
+	for (i = 0; i < 8; i++)
+		state[i] = sst->state[sha256_zvknha_order[i]];
+	sha256_transform_zvknha(state, src, blocks);
+	for (i = 0; i < 8; i++)
+		sst->state[sha256_zvknha_order[i]] = state[i];
+}
+
+static int sha256_zvknha_update(struct shash_desc *desc, const u8 *data,
+				unsigned int len)
+{
+	if (!may_use_simd())
+		return crypto_sha256_update(desc, data, len);
+
+	kernel_vector_begin();
+	sha256_base_do_update(desc, data, len, sha256_zvknha_block);
+	kernel_vector_end();
+
+	return 0;
+}
+
+static int sha256_zvknha_finup(struct shash_desc *desc, const u8 *data,
+			       unsigned int len, u8 *out)
+{
+	if (!may_use_simd())
+		return crypto_sha256_finup(desc, data, len, out);
+
+	kernel_vector_begin();
+	if (len)
+		sha256_base_do_update(desc, data, len, sha256_zvknha_block);
+	sha256_base_do_finalize(desc, sha256_zvknha_block);
+	kernel_vector_end();
+
+	return sha256_base_finish(desc, out);
+}
+
+static int sha256_zvknha_final(struct shash_desc *desc, u8 *out)
+{
+	return sha256_zvknha_finup(desc, NULL, 0, out);
+}
+
+static struct shash_alg algs[] = { {
+	.init			= sha224_base_init,
+	.update			= sha256_zvknha_update,
+	.final			= sha256_zvknha_final,
+	.finup			= sha256_zvknha_finup,
+	.descsize		= sizeof(struct sha256_state),
+	.digestsize		= SHA224_DIGEST_SIZE,
+	.base			= {
+		.cra_name		= "sha224",
+		.cra_driver_name	= "sha224-zvknha",
+		.cra_priority		= 300,
+		.cra_flags		= CRYPTO_ALG_TYPE_SHASH,
+		.cra_blocksize		= SHA256_BLOCK_SIZE,
+		.cra_alignmask		= sizeof(u32) - 1,
+		.cra_module		= THIS_MODULE,
+	}
+}, {
+	.init			= sha256_base_init,
+	.update			= sha256_zvknha_update,
+	.final			= sha256_zvknha_final,
+	.finup			= sha256_zvknha_finup,
+	.descsize		= sizeof(struct sha256_state),
+	.digestsize		= SHA256_DIGEST_SIZE,
+	.base			= {
+		.cra_name		= "sha256",
+		.cra_driver_name	= "sha256-zvknha",
+		.cra_priority		= 300,
+		.cra_flags		= CRYPTO_ALG_TYPE_SHASH,
+		.cra_blocksize		= SHA256_BLOCK_SIZE,
+		.cra_alignmask		= sizeof(u32) - 1,
+		.cra_module		= THIS_MODULE,
+	}
+} };
+
+static int __init sha256_zvknha_mod_init(void)
+{
+	if (!has_vector() ||
+	    !riscv_isa_extension_available(RISCV_ISA_EXT_ZVKNHA) ||
+	    !riscv_isa_extension_available(RISCV_ISA_EXT_ZVKB))
+		return -ENODEV;
+
+	return crypto_register_shashes(algs, ARRAY_SIZE(algs));
+}
+
+static void __exit sha256_zvknha_mod_fini(void)
+{
+	crypto_unregister_shashes(algs, ARRAY_SIZE(algs));
+}
+
+module_init(sha256_zvknha_mod_init);
+module_exit(sha256_zvknha_mod_fini);
+
+MODULE_DESCRIPTION("SHA-224/SHA-256 using the RISC-V Zvknha extension");
+MODULE_LICENSE("GPL v2");
+MODULE_ALIAS_CRYPTO("sha224");
+MODULE_ALIAS_CRYPTO("sha256");
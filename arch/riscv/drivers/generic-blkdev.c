@@ -3,9 +3,11 @@
 
 #include <linux/genhd.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/bio.h>
 #include <linux/fs.h>
 #include <linux/hdreg.h>
+#include <linux/scatterlist.h>
 
 #include <linux/interrupt.h>
 #include <linux/irq.h>
@@ -35,21 +37,42 @@
 #define GENERIC_BLKDEV_NSECTORS 32
 #define GENERIC_BLKDEV_MAX_REQUEST_LENGTH 36
 
+/* Upper bound on the segments of one request, sizing the PDU */
+#define GENERIC_BLKDEV_MAX_SEGMENTS 32
+
 struct generic_blkdev_port {
 	struct device *dev;
 	void __iomem *iomem;
 	struct gendisk *gd;
 	struct request_queue *queue;
-	struct list_head *reqbuf;
+	struct blk_mq_tag_set tag_set;
+	/*
+	 * The device picks the tag of each request it accepts, so the
+	 * requests in flight are looked up by that tag rather than blk-mq's.
+	 * The tag set is exactly as deep as the device, so a blk-mq tag is
+	 * only handed out when a device tag is free.
+	 */
+	struct request **inflight;
+	uint32_t ntags;
+	/* Device tags not in flight */
+	uint32_t free_tags;
+	/* Longest single device request, in sectors */
+	uint32_t max_req_len;
+	/* Serializes programming a request and reading its completion */
 	spinlock_t lock;
 	int major;
 	int irq;
-	int qrunning;
 };
 
+/*
+ * The blk-mq PDU of each request.  The device takes one physically
+ * contiguous range per request, so a block request is issued as one
+ * device request per piece of its scatterlist and ends when they all have.
+ */
 struct generic_blkdev_request {
-	struct request *req;
-	struct list_head list;
+	struct scatterlist sg[GENERIC_BLKDEV_MAX_SEGMENTS];
+	unsigned int nents;
+	unsigned int pending;
 };
 
 static struct block_device_operations generic_blkdev_fops = {
@@ -73,27 +96,26 @@ static void generic_blkdev_process_completions(struct generic_blkdev_port *port)
 {
 	uint32_t ncomplete, tag;
 	struct generic_blkdev_request *breq;
+	struct request *req;
 	int i;
 
 	ncomplete = generic_blkdev_read_reg(port, GENERIC_BLKDEV_NCOMPLETE);
 
-	printk(KERN_DEBUG "Processing %d completions\n", ncomplete);
-
 	for (i = 0; i < ncomplete; i++) {
 		tag = generic_blkdev_read_reg(port, GENERIC_BLKDEV_COMPLETE);
-		printk(KERN_DEBUG "Complete request %d\n", tag);
-		BUG_ON(list_empty(&port->reqbuf[tag]));
-		breq = list_entry(port->reqbuf[tag].prev,
-				struct generic_blkdev_request, list);
-		__blk_end_request_all(breq->req, 0);
-		list_del(&breq->list);
-		kfree(breq);
+		BUG_ON(tag >= port->ntags || !port->inflight[tag]);
+		req = port->inflight[tag];
+		port->inflight[tag] = NULL;
+		port->free_tags++;
+
+		/* Ends in generic_blkdev_complete(), from softirq */
+		breq = blk_mq_rq_to_pdu(req);
+		if (--breq->pending == 0)
+			blk_mq_complete_request(req);
 	}
 
-	if (ncomplete > 0 && !port->qrunning) {
-		port->qrunning = 1;
-		blk_start_queue_async(port->queue);
-	}
+	if (ncomplete > 0)
+		blk_mq_start_stopped_hw_queues(port->queue, true);
 }
 
 static irqreturn_t generic_blkdev_isr(int irq, void *data)
@@ -110,19 +132,24 @@ static irqreturn_t generic_blkdev_isr(int irq, void *data)
 	return IRQ_HANDLED;
 }
 
-static struct generic_blkdev_port *generic_blkdev_req_port(struct request *req)
+/* Device requests needed for the request's scatterlist */
+static unsigned int generic_blkdev_count_descs(
+		struct generic_blkdev_port *port, struct generic_blkdev_request *breq)
 {
-	return (struct generic_blkdev_port *) req->rq_disk->private_data;
+	uint32_t max_bytes = port->max_req_len << SECTOR_SHIFT;
+	unsigned int i, ndescs = 0;
+
+	for (i = 0; i < breq->nents; i++)
+		ndescs += DIV_ROUND_UP(breq->sg[i].length, max_bytes);
+
+	return ndescs;
 }
 
-static void generic_blkdev_queue_request(struct request *req, int write)
+static void generic_blkdev_post(struct generic_blkdev_port *port,
+		struct request *req, uint32_t addr, uint32_t offset,
+		uint32_t len, int write)
 {
-	struct generic_blkdev_port *port = generic_blkdev_req_port(req);
-	uint32_t addr = page_to_phys(bio_page(req->bio)) + bio_offset(req->bio);
-	uint32_t offset = blk_rq_pos(req);
-	uint32_t len = blk_rq_sectors(req);
 	uint32_t tag;
-	struct generic_blkdev_request *breq;
 
 	generic_blkdev_write_reg(port, GENERIC_BLKDEV_ADDR, addr);
 	generic_blkdev_write_reg(port, GENERIC_BLKDEV_OFFSET, offset);
@@ -131,45 +158,98 @@ static void generic_blkdev_queue_request(struct request *req, int write)
 	mb();
 
 	tag = generic_blkdev_read_reg(port, GENERIC_BLKDEV_REQUEST);
-	breq = kmalloc(sizeof(struct generic_blkdev_request), GFP_ATOMIC);
-	breq->req = req;
-	list_add_tail(&breq->list, &port->reqbuf[tag]);
-
-	printk(KERN_DEBUG
-		"generic-blkdev: %s [addr %x] [off %x] [len %d] [tag: %d]\n",
-		(write) ? "w" : "r", addr, offset, len, tag);
+	BUG_ON(tag >= port->ntags || port->inflight[tag]);
+	port->inflight[tag] = req;
+	port->free_tags--;
 }
 
-static void generic_blkdev_rq_handler(struct request_queue *rq)
+static blk_status_t generic_blkdev_queue_request(struct blk_mq_hw_ctx *hctx,
+		struct generic_blkdev_port *port, struct request *req, int write)
 {
-	struct request *req;
+	struct generic_blkdev_request *breq = blk_mq_rq_to_pdu(req);
+	uint32_t offset = blk_rq_pos(req);
+	unsigned int i, ndescs;
+	unsigned long flags;
+
+	sg_init_table(breq->sg, GENERIC_BLKDEV_MAX_SEGMENTS);
+	breq->nents = blk_rq_map_sg(req->q, req, breq->sg);
 
-	while ((req = blk_fetch_request(rq)) != NULL) {
-		struct generic_blkdev_port *port = generic_blkdev_req_port(req);
-
-		switch (req_op(req)) {
-		case REQ_OP_DISCARD:
-		case REQ_OP_FLUSH:
-			break;
-		case REQ_OP_READ:
-			generic_blkdev_queue_request(req, 0);
-			break;
-		case REQ_OP_WRITE:
-			generic_blkdev_queue_request(req, 1);
-			break;
-		default:
-			printk(KERN_ERR "unhandleable generic_blkdev request\n");
-			__blk_end_request_all(req, -EIO);
+	/* The device's address register is 32 bits wide */
+	for (i = 0; i < breq->nents; i++) {
+		phys_addr_t end = sg_phys(&breq->sg[i]) + breq->sg[i].length;
+
+		if (unlikely(end > (1ULL << 32) ||
+			     breq->sg[i].length & (SECTOR_SIZE - 1))) {
+			dev_err_ratelimited(port->dev,
+				"unreachable buffer at %pa\n", &end);
+			return BLK_STS_IOERR;
 		}
+	}
+
+	ndescs = generic_blkdev_count_descs(port, breq);
+
+	/* Only possible when the queue limits were raised to a page */
+	if (unlikely(ndescs > port->ntags))
+		return BLK_STS_IOERR;
+
+	spin_lock_irqsave(&port->lock, flags);
+
+	/* Wait for completions rather than issue part of the request */
+	if (ndescs > port->free_tags) {
+		blk_mq_stop_hw_queue(hctx);
+		spin_unlock_irqrestore(&port->lock, flags);
+		return BLK_STS_RESOURCE;
+	}
 
-		if (generic_blkdev_read_reg(port, GENERIC_BLKDEV_NREQUEST) == 0) {
-			port->qrunning = 0;
-			blk_stop_queue(port->queue);
-			break;
+	blk_mq_start_request(req);
+	breq->pending = ndescs;
+
+	for (i = 0; i < breq->nents; i++) {
+		uint32_t addr = sg_phys(&breq->sg[i]);
+		uint32_t left = breq->sg[i].length >> SECTOR_SHIFT;
+
+		while (left > 0) {
+			uint32_t len = min(left, port->max_req_len);
+
+			generic_blkdev_post(port, req, addr, offset, len, write);
+			addr += len << SECTOR_SHIFT;
+			offset += len;
+			left -= len;
 		}
 	}
+
+	spin_unlock_irqrestore(&port->lock, flags);
+
+	return BLK_STS_OK;
+}
+
+static blk_status_t generic_blkdev_queue_rq(struct blk_mq_hw_ctx *hctx,
+		const struct blk_mq_queue_data *bd)
+{
+	struct generic_blkdev_port *port = hctx->queue->queuedata;
+	struct request *req = bd->rq;
+
+	switch (req_op(req)) {
+	case REQ_OP_READ:
+		return generic_blkdev_queue_request(hctx, port, req, 0);
+	case REQ_OP_WRITE:
+		return generic_blkdev_queue_request(hctx, port, req, 1);
+	default:
+		printk(KERN_ERR "unhandleable generic_blkdev request\n");
+		return BLK_STS_IOERR;
+	}
 }
 
+static void generic_blkdev_complete(struct request *req)
+{
+	blk_mq_end_request(req, BLK_STS_OK);
+}
+
+static const struct blk_mq_ops generic_blkdev_mq_ops = {
+	.queue_rq = generic_blkdev_queue_rq,
+	.complete = generic_blkdev_complete,
+};
+
 static int generic_blkdev_parse_dt(struct generic_blkdev_port *port)
 {
 	struct device *dev = port->dev;
@@ -205,7 +285,7 @@ static int generic_blkdev_setup(struct generic_blkdev_port *port)
 {
 	uint32_t nsectors = generic_blkdev_read_reg(port, GENERIC_BLKDEV_NSECTORS);
 	struct device *dev = port->dev;
-	uint32_t i, ntags, max_req_len;
+	uint32_t ntags, max_req_len, max_segs;
 
 	if (nsectors == 0) {
 		dev_err(dev, "No disk attached.\n");
@@ -220,21 +300,49 @@ static int generic_blkdev_setup(struct generic_blkdev_port *port)
 
 	ntags = generic_blkdev_read_reg(port, GENERIC_BLKDEV_NREQUEST);
 	max_req_len = generic_blkdev_read_reg(port, GENERIC_BLKDEV_MAX_REQUEST_LENGTH);
-	port->qrunning = 1;
-	port->reqbuf = devm_kzalloc(
-			port->dev, ntags * sizeof(struct list_head), GFP_KERNEL);
-	for (i = 0; i < ntags; i++)
-		INIT_LIST_HEAD(&port->reqbuf[i]);
+	/* Keep a whole device request addressable in bytes */
+	max_req_len = min_t(uint32_t, max_req_len, UINT_MAX >> SECTOR_SHIFT);
+	port->ntags = ntags;
+	port->free_tags = ntags;
+	port->max_req_len = max_req_len;
+	port->inflight = devm_kcalloc(
+			port->dev, ntags, sizeof(struct request *), GFP_KERNEL);
+	if (!port->inflight)
+		goto exit_tags;
 
 	spin_lock_init(&port->lock);
-	port->queue = blk_init_queue(generic_blkdev_rq_handler, &port->lock);
-	if (!port->queue) {
+
+	port->tag_set.ops = &generic_blkdev_mq_ops;
+	port->tag_set.nr_hw_queues = 1;
+	port->tag_set.queue_depth = ntags;
+	port->tag_set.numa_node = NUMA_NO_NODE;
+	port->tag_set.cmd_size = sizeof(struct generic_blkdev_request);
+	port->tag_set.flags = BLK_MQ_F_SHOULD_MERGE;
+	port->tag_set.driver_data = port;
+	if (blk_mq_alloc_tag_set(&port->tag_set)) {
+		dev_err(dev, "Could not allocate blk-mq tag set\n");
+		goto exit_tags;
+	}
+
+	port->queue = blk_mq_init_queue(&port->tag_set);
+	if (IS_ERR(port->queue)) {
 		dev_err(dev, "Could not initialize blk_queue\n");
 		goto exit_queue;
 	}
+	port->queue->queuedata = port;
 	blk_queue_logical_block_size(port->queue, SECTOR_SIZE);
-	blk_queue_max_segments(port->queue, 1);
-	blk_queue_max_hw_sectors(port->queue, max_req_len);
+
+	/*
+	 * A request of n segments and s sectors takes at most
+	 * n + s / max_req_len device requests.  Allowing half the tags for
+	 * each term lets any request the block layer builds fit the device.
+	 */
+	max_segs = min_t(uint32_t, max(ntags / 2, 1U),
+			 GENERIC_BLKDEV_MAX_SEGMENTS);
+	blk_queue_max_segments(port->queue, max_segs);
+	blk_queue_max_segment_size(port->queue, max_req_len << SECTOR_SHIFT);
+	blk_queue_max_hw_sectors(port->queue,
+			ntags > 1 ? max_segs * max_req_len : max_req_len);
 
 	port->gd = alloc_disk(GENERIC_BLKDEV_MINORS);
 	if (!port->gd)
@@ -257,6 +365,9 @@ static int generic_blkdev_setup(struct generic_blkdev_port *port)
 exit_gendisk:
 	blk_cleanup_queue(port->queue);
 exit_queue:
+	blk_mq_free_tag_set(&port->tag_set);
+exit_tags:
+	unregister_blkdev(port->major, GENERIC_BLKDEV_NAME);
 	return -ENOMEM;
 }
 
@@ -293,6 +404,7 @@ static int generic_blkdev_teardown(struct generic_blkdev_port *port)
 	del_gendisk(port->gd);
 	put_disk(port->gd);
 	blk_cleanup_queue(port->queue);
+	blk_mq_free_tag_set(&port->tag_set);
 	unregister_blkdev(port->major, GENERIC_BLKDEV_NAME);
 	return 0;
 }
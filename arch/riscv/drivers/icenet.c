@@ -1,6 +1,10 @@
 #include <linux/errno.h>
 #include <linux/types.h>
 #include <linux/circ_buf.h>
+#include <linux/log2.h>
+#include <linux/moduleparam.h>
+#include <linux/mm.h>
+#include <linux/prefetch.h>
 
 #include <linux/interrupt.h>
 #include <linux/irq.h>
@@ -13,6 +17,10 @@
 
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
+#include <linux/ethtool.h>
+
+#define CREATE_TRACE_POINTS
+#include "icenet_trace.h"
 
 #define ICENET_NAME "icenet"
 #define ICENET_SEND_REQ 0
@@ -21,66 +29,188 @@
 #define ICENET_RECV_COMP 18
 #define ICENET_COUNTS 20
 #define ICENET_MACADDR 24
+#define ICENET_INTMASK 32
+
+#define ICENET_INTMASK_TX 1
+#define ICENET_INTMASK_RX 2
+#define ICENET_INTMASK_BOTH 3
+
+/* Set in every send request of a packet but its last */
+#define ICENET_SEND_PARTIAL (1ULL << 63)
 
-#define CIRC_BUF_LEN 16
+#define ICENET_RING_DEPTH 64
 #define ALIGN_BYTES 8
 #define ALIGN_MASK 0x7
 #define ALIGN_SHIFT 3
 #define MAX_FRAME_SIZE (190 * ALIGN_BYTES)
-#define DMA_PTR_ALIGN(p) ((typeof(p)) (__ALIGN_KERNEL((uintptr_t) (p), ALIGN_BYTES)))
 #define DMA_LEN_ALIGN(n) (((((n) - 1) >> ALIGN_SHIFT) + 1) << ALIGN_SHIFT)
 #define MACADDR_BYTES 6
 
+/* One per TX ring slot, for packets the NIC can't fetch in place */
+#define BOUNCE_SIZE ALIGN(MAX_FRAME_SIZE + NET_IP_ALIGN, SMP_CACHE_BYTES)
+
+/*
+ * RX buffers are half pages, handed to the NIC bare and wrapped in an skb
+ * with build_skb() once filled.  The NIC writes the frame, NET_IP_ALIGN
+ * bytes of padding first, after ICENET_RX_HEADROOM bytes of headroom.
+ */
+#define ICENET_RX_BUF_SIZE (PAGE_SIZE / 2)
+#define ICENET_RX_HEADROOM NET_SKB_PAD
+
+/* Pages waiting for the stack to free the skbs built on them */
+#define ICENET_RX_POOL_SIZE 64
+
 struct sk_buff_cq_entry {
-	struct sk_buff *skb;
-	void *data;
+	union {
+		struct sk_buff *skb;	/* TX */
+		struct page *page;	/* RX */
+	};
+	union {
+		/* The NIC completes each send request separately */
+		int nsegs;
+		/* Where in the page the RX buffer starts */
+		unsigned int offset;
+	};
 };
 
 struct sk_buff_cq {
-	struct sk_buff_cq_entry entries[CIRC_BUF_LEN];
+	struct sk_buff_cq_entry *entries;
+	int size;
 	int head;
 	int tail;
 };
 
-#define SK_BUFF_CQ_COUNT(cq) CIRC_CNT(cq.head, cq.tail, CIRC_BUF_LEN)
-#define SK_BUFF_CQ_SPACE(cq) CIRC_SPACE(cq.head, cq.tail, CIRC_BUF_LEN)
-
-static inline void sk_buff_cq_init(struct sk_buff_cq *cq)
+/* Entries are pushed at the tail and popped at the head */
+#define SK_BUFF_CQ_COUNT(cq) CIRC_CNT(cq.tail, cq.head, cq.size)
+#define SK_BUFF_CQ_SPACE(cq) CIRC_SPACE(cq.tail, cq.head, cq.size)
+
+/*
+ * The software rings track every buffer handed to the NIC until its
+ * completion is read back, so they have to cover both the request and the
+ * completion queues of the hardware, not just one of them.
+ */
+static unsigned int tx_ring_depth = ICENET_RING_DEPTH;
+module_param(tx_ring_depth, uint, 0444);
+MODULE_PARM_DESC(tx_ring_depth, "Number of outstanding TX packets");
+
+static unsigned int rx_ring_depth = ICENET_RING_DEPTH;
+module_param(rx_ring_depth, uint, 0444);
+MODULE_PARM_DESC(rx_ring_depth, "Number of posted RX buffers");
+
+static inline int sk_buff_cq_init(
+		struct device *dev, struct sk_buff_cq *cq, unsigned int size)
 {
+	/* CIRC_CNT() needs a power of two, and one slot is always empty */
+	size = roundup_pow_of_two(max(size, 2U));
+
+	cq->entries = devm_kcalloc(dev, size, sizeof(*cq->entries),
+				   GFP_KERNEL);
+	if (!cq->entries)
+		return -ENOMEM;
+
+	cq->size = size;
 	cq->head = 0;
 	cq->tail = 0;
+	return 0;
 }
 
 static inline void sk_buff_cq_push(
-		struct sk_buff_cq *cq, struct sk_buff *skb, void *data)
+		struct sk_buff_cq *cq, struct sk_buff *skb, int nsegs)
 {
 	cq->entries[cq->tail].skb = skb;
-	cq->entries[cq->tail].data = data;
-	cq->tail = (cq->tail + 1) & (CIRC_BUF_LEN - 1);
+	cq->entries[cq->tail].nsegs = nsegs;
+	cq->tail = (cq->tail + 1) & (cq->size - 1);
+}
+
+/* For readers outside the ring's own lock or context: may be stale */
+static inline int sk_buff_cq_count(struct sk_buff_cq *cq)
+{
+	return CIRC_CNT(READ_ONCE(cq->tail), READ_ONCE(cq->head), cq->size);
+}
+
+static inline int sk_buff_cq_head_nsegs(struct sk_buff_cq *cq)
+{
+	return cq->entries[cq->head].nsegs;
 }
 
 static inline struct sk_buff *sk_buff_cq_pop(struct sk_buff_cq *cq)
 {
 	struct sk_buff *skb;
-	void *data;
 
 	skb = cq->entries[cq->head].skb;
-	data = cq->entries[cq->head].data;
-	cq->head = (cq->head + 1) & (CIRC_BUF_LEN - 1);
-
-	if (data)
-		kfree(data);
+	cq->head = (cq->head + 1) & (cq->size - 1);
 
 	return skb;
 }
 
+static inline void sk_buff_cq_push_page(
+		struct sk_buff_cq *cq, struct page *page, unsigned int offset)
+{
+	cq->entries[cq->tail].page = page;
+	cq->entries[cq->tail].offset = offset;
+	cq->tail = (cq->tail + 1) & (cq->size - 1);
+}
+
+static inline struct page *sk_buff_cq_pop_page(
+		struct sk_buff_cq *cq, unsigned int *offset)
+{
+	struct page *page;
+
+	page = cq->entries[cq->head].page;
+	*offset = cq->entries[cq->head].offset;
+	cq->head = (cq->head + 1) & (cq->size - 1);
+
+	return page;
+}
+
+/*
+ * The pool keeps one reference to each of its pages and every buffer cut
+ * from a page holds another.  A page whose halves have both been handed
+ * out waits in the FIFO until the skbs built on it are freed, which
+ * leaves only the pool's reference, and is then reused without going
+ * back to the page allocator.  Only the NAPI poll (or open, before NAPI
+ * is enabled) touches the pool.
+ */
+struct icenet_rx_pool {
+	struct page *cur;
+	unsigned int cur_offset;
+	struct page *fifo[ICENET_RX_POOL_SIZE];
+	unsigned int head;
+	unsigned int tail;
+};
+/* Driver counters, reported with the ring state through ethtool -S */
+struct icenet_stats {
+	unsigned long tx_doorbells;	/* send requests written */
+	unsigned long tx_bounced;	/* packets sent from a bounce buffer */
+	unsigned long rx_doorbells;	/* receive buffers posted */
+	unsigned long rx_alloc_failed;
+	unsigned long rx_page_alloc;	/* pages from the page allocator */
+	unsigned long rx_page_reused;	/* pages recycled from the pool */
+	unsigned long irqs;
+	unsigned long polls;		/* over irqs: polls per interrupt */
+	unsigned long polls_exhausted;	/* polls that used their budget */
+};
+
 struct icenet_device {
 	struct device *dev;
 	void __iomem *iomem;
+	struct napi_struct napi;
 	struct sk_buff_cq send_cq;
 	struct sk_buff_cq recv_cq;
+	struct icenet_rx_pool rx_pool;
+	/* BOUNCE_SIZE bytes for each send_cq slot */
+	void *send_bounce;
+	/*
+	 * Send request slots known to be free.  The NIC only ever frees
+	 * more, so this is refreshed from ICENET_COUNTS when it runs out
+	 * rather than read back for every packet.
+	 */
+	int send_avail;
+	/* Protects send_cq and send_avail between start_xmit and the poll */
 	spinlock_t lock;
 	int irq;
+	/* tx_* under lock, rx_* and polls from the poll, irqs from the ISR */
+	struct icenet_stats stats;
 };
 
 static inline int send_req_avail(struct icenet_device *nic)
@@ -103,95 +233,277 @@ static inline int recv_comp_avail(struct icenet_device *nic)
 	return (ioread16(nic->iomem + ICENET_COUNTS) >> 12) & 0xf;
 }
 
+static inline int comp_avail(struct icenet_device *nic)
+{
+	return (ioread16(nic->iomem + ICENET_COUNTS) >> 8) & 0xff;
+}
+
+static inline void set_intmask(struct icenet_device *nic, uint32_t mask)
+{
+	iowrite32(mask, nic->iomem + ICENET_INTMASK);
+}
+
+
+static inline void post_send_req(
+		struct icenet_device *nic, uintptr_t addr, uint64_t len,
+		bool partial)
+{
+	uint64_t packet = (len << 48) | (addr & 0xffffffffffffL);
+
+	if (partial)
+		packet |= ICENET_SEND_PARTIAL;
+
+	iowrite64(packet, nic->iomem + ICENET_SEND_REQ);
+	nic->stats.tx_doorbells++;
+}
+
+/*
+ * The NIC fetches whole 8-byte words.  A packet can go out straight from
+ * the skb only if its head starts NET_IP_ALIGN bytes into a word, every
+ * fragment starts on one, and every piece but the last ends on one.
+ */
+static bool can_send_in_place(struct sk_buff *skb)
+{
+	struct skb_shared_info *shinfo = skb_shinfo(skb);
+	uintptr_t addr = virt_to_phys(skb->data);
+	int i;
+
+	if ((addr & ALIGN_MASK) != NET_IP_ALIGN)
+		return false;
+
+	if (shinfo->nr_frags == 0)
+		return true;
+
+	if ((addr + skb_headlen(skb)) & ALIGN_MASK)
+		return false;
+
+	for (i = 0; i < shinfo->nr_frags; i++) {
+		const skb_frag_t *frag = &shinfo->frags[i];
+
+		addr = page_to_phys(skb_frag_page(frag)) + frag->page_offset;
+		if (addr & ALIGN_MASK)
+			return false;
+		if (i < shinfo->nr_frags - 1 &&
+		    (skb_frag_size(frag) & ALIGN_MASK))
+			return false;
+	}
+
+	return true;
+}
+
+static void post_send_sg(struct icenet_device *nic, struct sk_buff *skb)
+{
+	struct skb_shared_info *shinfo = skb_shinfo(skb);
+	int i, nfrags = shinfo->nr_frags;
+	uintptr_t addr = virt_to_phys(skb->data) - NET_IP_ALIGN;
+	uint64_t len = skb_headlen(skb) + NET_IP_ALIGN;
+
+	post_send_req(nic, addr, nfrags ? len : DMA_LEN_ALIGN(len),
+		      nfrags > 0);
+
+	for (i = 0; i < nfrags; i++) {
+		const skb_frag_t *frag = &shinfo->frags[i];
+		bool last = (i == nfrags - 1);
+
+		addr = page_to_phys(skb_frag_page(frag)) + frag->page_offset;
+		len = skb_frag_size(frag);
+		post_send_req(nic, addr, last ? DMA_LEN_ALIGN(len) : len,
+			      !last);
+	}
+}
+
+/* Copy into this ring slot's bounce buffer and send it in one piece */
+static void post_send_bounce(struct icenet_device *nic, struct sk_buff *skb)
+{
+	void *data = nic->send_bounce + nic->send_cq.tail * BOUNCE_SIZE;
+
+	skb_copy_bits(skb, 0, data + NET_IP_ALIGN, skb->len);
+	post_send_req(nic, virt_to_phys(data),
+		      DMA_LEN_ALIGN(skb->len + NET_IP_ALIGN), false);
+	nic->stats.tx_bounced++;
+}
 
 static inline void post_send(
 		struct icenet_device *nic, struct sk_buff *skb)
 {
-	uintptr_t addr = virt_to_phys(skb->data), align;
-	uint64_t len = skb->len, packet;
-	void *data = NULL;
-
-	if (unlikely((addr & ALIGN_MASK) != NET_IP_ALIGN)) {
-		// This is really annoying, but if the skb data buffer is
-		// not aligned the way we need it to be, we have to copy it
-		// to a different buffer.
-		len = DMA_LEN_ALIGN(len + NET_IP_ALIGN);
-		data = kmalloc(len + ALIGN_BYTES, GFP_ATOMIC);
-		align = DMA_PTR_ALIGN(data) - data;
-		addr = virt_to_phys(data + align);
-		skb_copy_bits(skb, 0, data + align + NET_IP_ALIGN, skb->len);
+	int nsegs = skb_shinfo(skb)->nr_frags + 1;
+
+	if (nsegs > nic->send_avail)
+		nic->send_avail = send_req_avail(nic);
+
+	/* More pieces than the NIC will take right now go out as one */
+	if (likely(nsegs <= nic->send_avail && can_send_in_place(skb))) {
+		post_send_sg(nic, skb);
+		trace_icenet_tx(skb, nsegs, false);
 	} else {
-		addr = addr - NET_IP_ALIGN;
-		len = DMA_LEN_ALIGN(len + NET_IP_ALIGN);
+		post_send_bounce(nic, skb);
+		nsegs = 1;
+		trace_icenet_tx(skb, nsegs, true);
 	}
 
-	packet = (len << 48) | (addr & 0xffffffffffffL);
+	nic->send_avail -= nsegs;
+	sk_buff_cq_push(&nic->send_cq, skb, nsegs);
+}
 
-	iowrite64(packet, nic->iomem + ICENET_SEND_REQ);
-	sk_buff_cq_push(&nic->send_cq, skb, data);
+static struct page *rx_pool_get_page(struct icenet_device *nic)
+{
+	struct icenet_rx_pool *pool = &nic->rx_pool;
+	struct page *page;
+
+	if (pool->head != pool->tail) {
+		page = pool->fifo[pool->head & (ICENET_RX_POOL_SIZE - 1)];
+		if (page_ref_count(page) == 1) {
+			pool->head++;
+			nic->stats.rx_page_reused++;
+			return page;
+		}
+
+		/* Full of pages still in use: stop waiting on the oldest */
+		if (pool->tail - pool->head == ICENET_RX_POOL_SIZE) {
+			pool->head++;
+			put_page(page);
+		}
+	}
+
+	page = dev_alloc_page();
+	if (page)
+		nic->stats.rx_page_alloc++;
 
-	printk(KERN_DEBUG "IceNet: tx addr=%lx len=%llu\n", addr, len);
+	return page;
 }
 
-static inline void post_recv(
-		struct icenet_device *nic, struct sk_buff *skb)
+static void rx_pool_retire_page(struct icenet_device *nic, struct page *page)
 {
-	int align = DMA_PTR_ALIGN(skb->data) - skb->data;
-	uintptr_t addr;
+	struct icenet_rx_pool *pool = &nic->rx_pool;
+
+	/* Pages from the emergency reserves go back as soon as they can */
+	if (page_is_pfmemalloc(page) ||
+	    pool->tail - pool->head == ICENET_RX_POOL_SIZE) {
+		put_page(page);
+		return;
+	}
+
+	pool->fifo[pool->tail++ & (ICENET_RX_POOL_SIZE - 1)] = page;
+}
+
+/* The next free half page, with a reference held for the buffer */
+static struct page *rx_pool_get_buf(
+		struct icenet_device *nic, unsigned int *offset)
+{
+	struct icenet_rx_pool *pool = &nic->rx_pool;
+	struct page *page;
+
+	if (!pool->cur) {
+		pool->cur = rx_pool_get_page(nic);
+		if (!pool->cur)
+			return NULL;
+		pool->cur_offset = 0;
+	}
+
+	page = pool->cur;
+	*offset = pool->cur_offset;
+	get_page(page);
+
+	pool->cur_offset += ICENET_RX_BUF_SIZE;
+	if (pool->cur_offset >= PAGE_SIZE) {
+		rx_pool_retire_page(nic, page);
+		pool->cur = NULL;
+	}
 
-	skb_reserve(skb, align);
-	addr = virt_to_phys(skb->data);
+	return page;
+}
 
-	iowrite64(addr, nic->iomem + ICENET_RECV_REQ);
-	sk_buff_cq_push(&nic->recv_cq, skb, NULL);
+static inline void post_recv(
+		struct icenet_device *nic, struct page *page, unsigned int offset)
+{
+	void *buf = page_address(page) + offset + ICENET_RX_HEADROOM;
+
+	iowrite64(virt_to_phys(buf), nic->iomem + ICENET_RECV_REQ);
+	sk_buff_cq_push_page(&nic->recv_cq, page, offset);
+	nic->stats.rx_doorbells++;
 }
 
 static inline int can_send(struct icenet_device *nic)
 {
-	int avail = send_req_avail(nic);
-	int space = SK_BUFF_CQ_SPACE(nic->send_cq);
+	if (SK_BUFF_CQ_SPACE(nic->send_cq) == 0)
+		return 0;
+
+	if (nic->send_avail == 0)
+		nic->send_avail = send_req_avail(nic);
 
-	return avail > 0 && space > 0;
+	return nic->send_avail > 0;
 }
 
-static void complete_send(struct net_device *ndev)
+static void complete_send(struct net_device *ndev, int budget)
 {
 	struct icenet_device *nic = netdev_priv(ndev);
 	struct sk_buff *skb;
+	int i, nsegs, avail, done = 0;
 
-	while (send_comp_avail(nic) > 0) {
-		ioread16(nic->iomem + ICENET_SEND_COMP);
-		BUG_ON(SK_BUFF_CQ_COUNT(nic->send_cq) == 0);
+	spin_lock(&nic->lock);
+
+	avail = send_comp_avail(nic);
+	while (SK_BUFF_CQ_COUNT(nic->send_cq) > 0) {
+		/* A packet is done once all its send requests are */
+		nsegs = sk_buff_cq_head_nsegs(&nic->send_cq);
+		if (nsegs > avail)
+			avail = send_comp_avail(nic);
+		if (nsegs > avail)
+			break;
+
+		for (i = 0; i < nsegs; i++)
+			ioread16(nic->iomem + ICENET_SEND_COMP);
+		avail -= nsegs;
 		skb = sk_buff_cq_pop(&nic->send_cq);
 
 		ndev->stats.tx_packets++;
 		ndev->stats.tx_bytes += skb->len;
-		dev_consume_skb_irq(skb);
-		netif_wake_queue(ndev);
+		napi_consume_skb(skb, budget);
+		done++;
 	}
+
+	if (done && netif_queue_stopped(ndev) && can_send(nic))
+		netif_wake_queue(ndev);
+
+	spin_unlock(&nic->lock);
 }
 
-static void complete_recv(struct net_device *ndev)
+static int complete_recv(struct net_device *ndev, int budget)
 {
 	struct icenet_device *nic = netdev_priv(ndev);
 	struct sk_buff *skb;
-	int len;
+	struct page *page;
+	unsigned int offset;
+	void *buf;
+	int len, done = 0;
 
-	while (recv_comp_avail(nic) > 0) {
+	while (done < budget && recv_comp_avail(nic) > 0) {
 		len = ioread16(nic->iomem + ICENET_RECV_COMP);
-		skb = sk_buff_cq_pop(&nic->recv_cq);
-		skb_put(skb, len);
-		skb_pull(skb, NET_IP_ALIGN);
+		BUG_ON(SK_BUFF_CQ_COUNT(nic->recv_cq) == 0);
+		page = sk_buff_cq_pop_page(&nic->recv_cq, &offset);
+		buf = page_address(page) + offset;
+		prefetch(buf + ICENET_RX_HEADROOM + NET_IP_ALIGN);
+		done++;
+
+		/* The buffer's page reference becomes the skb's */
+		skb = build_skb(buf, ICENET_RX_BUF_SIZE);
+		if (unlikely(!skb)) {
+			put_page(page);
+			nic->stats.rx_alloc_failed++;
+			ndev->stats.rx_dropped++;
+			continue;
+		}
+		skb_reserve(skb, ICENET_RX_HEADROOM + NET_IP_ALIGN);
+		skb_put(skb, len - NET_IP_ALIGN);
 
-		skb->dev = ndev;
 		skb->protocol = eth_type_trans(skb, ndev);
 		ndev->stats.rx_packets++;
 		ndev->stats.rx_bytes += len;
-		netif_rx(skb);
-
-		printk(KERN_DEBUG "IceNet: rx addr=%p, len=%d\n",
-				skb->data, len);
+		trace_icenet_rx(skb, len);
+		napi_gro_receive(&nic->napi, skb);
 	}
+
+	return done;
 }
 
 static void alloc_recv(struct net_device *ndev)
@@ -202,12 +514,45 @@ static void alloc_recv(struct net_device *ndev)
 	int recv_cnt = (hw_recv_cnt < sw_recv_cnt) ? hw_recv_cnt : sw_recv_cnt;
 
 	for ( ; recv_cnt > 0; recv_cnt--) {
-		struct sk_buff *skb;
-		skb = netdev_alloc_skb(ndev, MAX_FRAME_SIZE);
-		post_recv(nic, skb);
+		struct page *page;
+		unsigned int offset;
+
+		page = rx_pool_get_buf(nic, &offset);
+		/* Try again on the next poll */
+		if (unlikely(!page)) {
+			nic->stats.rx_alloc_failed++;
+			break;
+		}
+		post_recv(nic, page, offset);
 	}
 }
 
+/*
+ * TX completions are not charged to the budget, RX ones are.  The NIC's
+ * interrupts stay masked until a poll finds nothing left to do.
+ */
+static int icenet_poll(struct napi_struct *napi, int budget)
+{
+	struct icenet_device *nic =
+		container_of(napi, struct icenet_device, napi);
+	struct net_device *ndev = napi->dev;
+	int work_done;
+
+	complete_send(ndev, budget);
+	work_done = complete_recv(ndev, budget);
+	alloc_recv(ndev);
+
+	nic->stats.polls++;
+	if (work_done == budget)
+		nic->stats.polls_exhausted++;
+	trace_icenet_poll(work_done, budget);
+
+	if (work_done < budget && napi_complete_done(napi, work_done))
+		set_intmask(nic, ICENET_INTMASK_BOTH);
+
+	return work_done;
+}
+
 static irqreturn_t icenet_isr(int irq, void *data)
 {
 	struct net_device *ndev = data;
@@ -216,13 +561,13 @@ static irqreturn_t icenet_isr(int irq, void *data)
 	if (irq != nic->irq)
 		return IRQ_NONE;
 
-	spin_lock(&nic->lock);
-
-	complete_send(ndev);
-	complete_recv(ndev);
-	alloc_recv(ndev);
+	/* The line is shared: nothing completed means it wasn't us */
+	if (!comp_avail(nic))
+		return IRQ_NONE;
 
-	spin_unlock(&nic->lock);
+	nic->stats.irqs++;
+	set_intmask(nic, 0);
+	napi_schedule(&nic->napi);
 
 	return IRQ_HANDLED;
 }
@@ -272,15 +617,20 @@ static int icenet_parse_irq(struct net_device *ndev)
 static int icenet_open(struct net_device *ndev)
 {
 	struct icenet_device *nic = netdev_priv(ndev);
-	unsigned long flags;
-
-	spin_lock_irqsave(&nic->lock, flags);
+	int err;
 
-	icenet_parse_irq(ndev);
+	/* Interrupts stay masked until NAPI is ready to take them */
 	alloc_recv(ndev);
-	netif_start_queue(ndev);
+	napi_enable(&nic->napi);
 
-	spin_unlock_irqrestore(&nic->lock, flags);
+	err = icenet_parse_irq(ndev);
+	if (err) {
+		napi_disable(&nic->napi);
+		return err;
+	}
+
+	set_intmask(nic, ICENET_INTMASK_BOTH);
+	netif_start_queue(ndev);
 
 	printk(KERN_DEBUG "IceNet: opened device\n");
 
@@ -290,14 +640,11 @@ static int icenet_open(struct net_device *ndev)
 static int icenet_stop(struct net_device *ndev)
 {
 	struct icenet_device *nic = netdev_priv(ndev);
-	unsigned long flags;
-
-	spin_lock_irqsave(&nic->lock, flags);
 
 	netif_stop_queue(ndev);
-	devm_free_irq(nic->dev, nic->irq, ICENET_NAME);
-
-	spin_unlock_irqrestore(&nic->lock, flags);
+	set_intmask(nic, 0);
+	napi_disable(&nic->napi);
+	devm_free_irq(nic->dev, nic->irq, ndev);
 
 	printk(KERN_DEBUG "IceNet: stopped device\n");
 	return 0;
@@ -306,9 +653,15 @@ static int icenet_stop(struct net_device *ndev)
 static int icenet_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 {
 	struct icenet_device *nic = netdev_priv(ndev);
-	unsigned long flags;
 
-	spin_lock_irqsave(&nic->lock, flags);
+	/* Nothing bigger fits in a bounce buffer or the NIC's length field */
+	if (unlikely(skb->len > MAX_FRAME_SIZE - NET_IP_ALIGN)) {
+		ndev->stats.tx_dropped++;
+		dev_kfree_skb_any(skb);
+		return NETDEV_TX_OK;
+	}
+
+	spin_lock(&nic->lock);
 
 	skb_tx_timestamp(skb);
 	post_send(nic, skb);
@@ -316,7 +669,7 @@ static int icenet_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 	if (unlikely(!can_send(nic)))
 		netif_stop_queue(ndev);
 
-	spin_unlock_irqrestore(&nic->lock, flags);
+	spin_unlock(&nic->lock);
 
 	return NETDEV_TX_OK;
 }
@@ -333,6 +686,98 @@ static void icenet_init_mac_address(struct net_device *ndev)
 		printk(KERN_WARNING "Invalid MAC address\n");
 }
 
+#define ICENET_STAT(m) { #m, offsetof(struct icenet_stats, m) }
+
+static const struct {
+	char name[ETH_GSTRING_LEN];
+	size_t offset;
+} icenet_gstrings_stats[] = {
+	ICENET_STAT(tx_doorbells),
+	ICENET_STAT(tx_bounced),
+	ICENET_STAT(rx_doorbells),
+	ICENET_STAT(rx_alloc_failed),
+	ICENET_STAT(rx_page_alloc),
+	ICENET_STAT(rx_page_reused),
+	ICENET_STAT(irqs),
+	ICENET_STAT(polls),
+	ICENET_STAT(polls_exhausted),
+};
+
+/* Sampled when the stats are read, after the counters above */
+static const char icenet_gstrings_ring[][ETH_GSTRING_LEN] = {
+	"tx_ring_used",
+	"rx_ring_used",
+};
+
+#define ICENET_STATS_LEN \
+	(ARRAY_SIZE(icenet_gstrings_stats) + ARRAY_SIZE(icenet_gstrings_ring))
+
+static void icenet_get_drvinfo(struct net_device *ndev,
+			       struct ethtool_drvinfo *info)
+{
+	struct icenet_device *nic = netdev_priv(ndev);
+
+	strlcpy(info->driver, ICENET_NAME, sizeof(info->driver));
+	strlcpy(info->bus_info, dev_name(nic->dev), sizeof(info->bus_info));
+}
+
+static void icenet_get_ringparam(struct net_device *ndev,
+				 struct ethtool_ringparam *ring)
+{
+	struct icenet_device *nic = netdev_priv(ndev);
+
+	/* One slot of each ring always stays empty */
+	ring->tx_max_pending = nic->send_cq.size - 1;
+	ring->rx_max_pending = nic->recv_cq.size - 1;
+	ring->tx_pending = ring->tx_max_pending;
+	ring->rx_pending = ring->rx_max_pending;
+}
+
+static int icenet_get_sset_count(struct net_device *ndev, int sset)
+{
+	if (sset != ETH_SS_STATS)
+		return -EOPNOTSUPP;
+
+	return ICENET_STATS_LEN;
+}
+
+static void icenet_get_strings(struct net_device *ndev, u32 sset, u8 *data)
+{
+	int i;
+
+	if (sset != ETH_SS_STATS)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(icenet_gstrings_stats); i++) {
+		memcpy(data, icenet_gstrings_stats[i].name, ETH_GSTRING_LEN);
+		data += ETH_GSTRING_LEN;
+	}
+	memcpy(data, icenet_gstrings_ring, sizeof(icenet_gstrings_ring));
+}
+
+static void icenet_get_ethtool_stats(struct net_device *ndev,
+				     struct ethtool_stats *stats, u64 *data)
+{
+	struct icenet_device *nic = netdev_priv(ndev);
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(icenet_gstrings_stats); i++)
+		*data++ = *(unsigned long *)((void *)&nic->stats +
+					     icenet_gstrings_stats[i].offset);
+
+	*data++ = sk_buff_cq_count(&nic->send_cq);
+	*data++ = sk_buff_cq_count(&nic->recv_cq);
+}
+
+static const struct ethtool_ops icenet_ethtool_ops = {
+	.get_drvinfo = icenet_get_drvinfo,
+	.get_link = ethtool_op_get_link,
+	.get_ringparam = icenet_get_ringparam,
+	.get_sset_count = icenet_get_sset_count,
+	.get_strings = icenet_get_strings,
+	.get_ethtool_stats = icenet_get_ethtool_stats,
+};
+
 static const struct net_device_ops icenet_ops = {
 	.ndo_open = icenet_open,
 	.ndo_stop = icenet_stop,
@@ -346,6 +791,11 @@ static int icenet_probe(struct platform_device *pdev)
 	struct icenet_device *nic;
 	int ret;
 
+	/* A full frame, and the skb_shared_info behind it, fit a buffer */
+	BUILD_BUG_ON(SKB_DATA_ALIGN(ICENET_RX_HEADROOM + MAX_FRAME_SIZE) +
+		     SKB_DATA_ALIGN(sizeof(struct skb_shared_info)) >
+		     ICENET_RX_BUF_SIZE);
+
 	if (!dev->of_node)
 		return -ENODEV;
 
@@ -360,13 +810,25 @@ static int icenet_probe(struct platform_device *pdev)
 	ether_setup(ndev);
 	ndev->flags &= ~IFF_MULTICAST;
 	ndev->netdev_ops = &icenet_ops;
+	ndev->ethtool_ops = &icenet_ethtool_ops;
+	ndev->hw_features = NETIF_F_SG;
+	ndev->features = ndev->hw_features;
 
 	spin_lock_init(&nic->lock);
-	sk_buff_cq_init(&nic->send_cq);
-	sk_buff_cq_init(&nic->recv_cq);
+	if ((ret = sk_buff_cq_init(dev, &nic->send_cq, tx_ring_depth)) < 0)
+		return ret;
+	nic->send_bounce = devm_kcalloc(dev, nic->send_cq.size, BOUNCE_SIZE,
+					GFP_KERNEL);
+	if (!nic->send_bounce)
+		return -ENOMEM;
+	if ((ret = sk_buff_cq_init(dev, &nic->recv_cq, rx_ring_depth)) < 0)
+		return ret;
 	if ((ret = icenet_parse_addr(ndev)) < 0)
 		return ret;
 
+	set_intmask(nic, 0);
+	netif_napi_add(ndev, &nic->napi, icenet_poll, NAPI_POLL_WEIGHT);
+
 	icenet_init_mac_address(ndev);
 	if ((ret = register_netdev(ndev)) < 0) {
 		dev_err(dev, "Failed to register netdev\n");
@@ -0,0 +1,78 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM icenet
+
+#if !defined(_ICENET_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _ICENET_TRACE_H
+
+#include <linux/tracepoint.h>
+
+struct sk_buff;
+
+TRACE_EVENT(icenet_tx,
+	TP_PROTO(struct sk_buff *skb, int nsegs, bool bounced),
+
+	TP_ARGS(skb, nsegs, bounced),
+
+	TP_STRUCT__entry(
+		__field(const void *, skbaddr)
+		__field(unsigned int, len)
+		__field(int, nsegs)
+		__field(bool, bounced)
+	),
+
+	TP_fast_assign(
+		__entry->skbaddr = skb;
+		__entry->len = skb->len;
+		__entry->nsegs = nsegs;
+		__entry->bounced = bounced;
+	),
+
+	TP_printk("skb=%p len=%u nsegs=%d%s", __entry->skbaddr,
+		  __entry->len, __entry->nsegs,
+		  __entry->bounced ? " bounced" : "")
+);
+
+TRACE_EVENT(icenet_rx,
+	TP_PROTO(struct sk_buff *skb, int len),
+
+	TP_ARGS(skb, len),
+
+	TP_STRUCT__entry(
+		__field(const void *, skbaddr)
+		__field(int, len)
+	),
+
+	TP_fast_assign(
+		__entry->skbaddr = skb;
+		__entry->len = len;
+	),
+
+	TP_printk("skb=%p len=%d", __entry->skbaddr, __entry->len)
+);
+
+TRACE_EVENT(icenet_poll,
+	TP_PROTO(int work_done, int budget),
+
+	TP_ARGS(work_done, budget),
+
+	TP_STRUCT__entry(
+		__field(int, work_done)
+		__field(int, budget)
+	),
+
+	TP_fast_assign(
+		__entry->work_done = work_done;
+		__entry->budget = budget;
+	),
+
+	TP_printk("work_done=%d budget=%d", __entry->work_done,
+		  __entry->budget)
+);
+
+#endif /* _ICENET_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE icenet_trace
+#include <trace/define_trace.h>
@@ -20,18 +20,85 @@
 #include <linux/tty_driver.h>
 #include <linux/module.h>
 #include <linux/interrupt.h>
+#include <linux/percpu.h>
 
 #include <asm/sbi.h>
 
+/*
+ * The SBI console has no receive interrupt, so input is polled while the
+ * tty is open.  The period doubles with every empty poll, from one jiffy
+ * up to SBI_POLL_MAX, and drops back as soon as a character arrives.
+ */
 #define SBI_POLL_PERIOD 1
+#define SBI_POLL_MAX (HZ / 20 ? : 1)
 #define SBI_MAX_GETCHARS 10
 
+/* Bytes handed to the firmware per SBI_CONSOLE_WRITE */
+#define SBI_WRITE_BUF_SIZE 256
+
 static struct tty_driver *sbi_tty_driver;
 
+/*
+ * Output is copied into a per-hart buffer with interrupts off, which is
+ * in the linear map whatever the caller passed and needs no lock that an
+ * oops could leave held.
+ */
+static DEFINE_PER_CPU(char [SBI_WRITE_BUF_SIZE], sbi_write_buf);
+static bool sbi_write_unsupported;
+
+static void sbi_console_flush(const char *buf, unsigned int n)
+{
+	long ret;
+
+	while (n > 0 && !sbi_write_unsupported) {
+		ret = sbi_console_write_buf(buf, n);
+		if (ret <= 0) {
+			sbi_write_unsupported = true;
+			break;
+		}
+		buf += ret;
+		n -= ret;
+	}
+
+	for ( ; n > 0; n--, buf++)
+		sbi_console_putchar(*buf);
+}
+
+/* Write n bytes, adding a '\r' before each '\n' if crlf is set */
+static void sbi_console_puts(const char *buf, unsigned int n, bool crlf)
+{
+	unsigned long flags;
+	unsigned int len = 0;
+	char *out;
+
+	if (sbi_write_unsupported) {
+		for ( ; n > 0; n--, buf++) {
+			if (crlf && *buf == '\n')
+				sbi_console_putchar('\r');
+			sbi_console_putchar(*buf);
+		}
+		return;
+	}
+
+	local_irq_save(flags);
+	out = this_cpu_ptr(sbi_write_buf);
+	for ( ; n > 0; n--, buf++) {
+		if (len >= SBI_WRITE_BUF_SIZE - 1) {
+			sbi_console_flush(out, len);
+			len = 0;
+		}
+		if (crlf && *buf == '\n')
+			out[len++] = '\r';
+		out[len++] = *buf;
+	}
+	sbi_console_flush(out, len);
+	local_irq_restore(flags);
+}
+
 struct sbi_console_private {
 	struct tty_port port;
 	struct timer_list timer;
-
+	unsigned long period;
 } sbi_console_singleton;
 
 static void sbi_console_getchars(uintptr_t data)
@@ -39,28 +106,38 @@ static void sbi_console_getchars(uintptr_t data)
 	struct sbi_console_private *priv = (struct sbi_console_private *)data;
 	struct tty_port *port = &priv->port;
 	unsigned long flags;
-	int ch;
+	int ch, i;
 
 	spin_lock_irqsave(&port->lock, flags);
 
-	if ((ch = sbi_console_getchar()) >= 0) {
+	/* Closed since the timer fired */
+	if (!port->tty)
+		goto out;
+
+	for (i = 0; i < SBI_MAX_GETCHARS; i++) {
+		if ((ch = sbi_console_getchar()) < 0)
+			break;
 		tty_insert_flip_char(port, ch, TTY_NORMAL);
+	}
+
+	if (i > 0) {
 		tty_flip_buffer_push(port);
+		priv->period = SBI_POLL_PERIOD;
+	} else {
+		priv->period = min_t(unsigned long, priv->period * 2,
+				     SBI_POLL_MAX);
 	}
 
-	mod_timer(&priv->timer, jiffies + SBI_POLL_PERIOD);
+	mod_timer(&priv->timer, jiffies + priv->period);
 
+out:
 	spin_unlock_irqrestore(&port->lock, flags);
 }
 
 static int sbi_tty_write(struct tty_struct *tty,
 	const unsigned char *buf, int count)
 {
-	const unsigned char *end;
-
-	for (end = buf + count; buf < end; buf++) {
-		sbi_console_putchar(*buf);
-	}
+	sbi_console_puts(buf, count, false);
 	return count;
 }
 
@@ -81,6 +158,7 @@ static int sbi_tty_open(struct tty_struct *tty, struct file *filp)
 		tty->driver_data = priv;
 		tty->port = port;
 		port->tty = tty;
+		priv->period = SBI_POLL_PERIOD;
 		mod_timer(&priv->timer, jiffies);
 	}
 
@@ -115,11 +193,7 @@ static const struct tty_operations sbi_tty_ops = {
 
 static void sbi_console_write(struct console *co, const char *buf, unsigned n)
 {
-	for ( ; n > 0; n--, buf++) {
-		if (*buf == '\n')
-			sbi_console_putchar('\r');
-		sbi_console_putchar(*buf);
-	}
+	sbi_console_puts(buf, n, true);
 }
 
 static struct tty_driver *sbi_console_device(struct console *co, int *index)
@@ -4,9 +4,13 @@
 #include <linux/types.h>
 #include <linux/genhd.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/bio.h>
 #include <linux/fs.h>
 #include <linux/hdreg.h>
+#include <linux/hrtimer.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
 
 #include <asm/io.h>
 #include <asm/sbi.h>
@@ -20,12 +24,51 @@ MODULE_LICENSE("Dual BSD/GPL");
 #define SECTOR_SIZE 512
 #define SECTOR_SHIFT 9
 
+#define SBI_DISK_QUEUE_DEPTH 64
+/* Descriptors gathered on a hardware queue before they are submitted */
+#define SBI_DISK_BATCH 64
+/* Segments of one request; a whole request must fit an empty batch */
+#define SBI_DISK_MAX_SEGMENTS 16
+
+static unsigned int poll_us = 20;
+module_param(poll_us, uint, 0444);
+MODULE_PARM_DESC(poll_us, "Completion polling interval in microseconds");
+
 static int sbi_disk_major = 0;
 
+struct sbi_disk_dev;
+
+/* One firmware submission queue, backing one blk-mq hardware queue */
+struct sbi_disk_queue {
+	struct sbi_disk_dev *dev;
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int index;
+	/* Protects the rest; taken from the poll timer, in hardirq context */
+	spinlock_t lock;
+	/* Built but not yet accepted by the firmware */
+	struct sbi_disk_desc descs[SBI_DISK_BATCH];
+	unsigned int ndescs;
+	/* Accepted and not completed yet */
+	unsigned int inflight;
+	struct sbi_disk_cmpl cmpls[SBI_DISK_BATCH];
+	struct hrtimer timer;
+};
+
 struct sbi_disk_dev {
 	struct gendisk *gd;
 	struct request_queue *queue;
-	spinlock_t lock;
+	struct blk_mq_tag_set tag_set;
+	/* Zero when the firmware only has the synchronous calls */
+	unsigned int nqueues;
+	struct sbi_disk_queue *queues;
+};
+
+/* The blk-mq PDU of each request */
+struct sbi_disk_request {
+	struct scatterlist sg[SBI_DISK_MAX_SEGMENTS];
+	/* Descriptors of this request the firmware hasn't completed */
+	unsigned int pending;
+	blk_status_t status;
 };
 
 static struct sbi_disk_dev sbi_disk_dev;
@@ -55,11 +98,17 @@ static void sbi_disk_transfer(struct request *req, int write)
 	}
 }
 
-static unsigned long sbi_disk_request(struct request *req)
+/* Firmware without the queued interface: serve the request in the ecalls */
+static blk_status_t sbi_disk_queue_rq_sync(struct blk_mq_hw_ctx *hctx,
+		const struct blk_mq_queue_data *bd)
 {
+	struct request *req = bd->rq;
+
+	blk_mq_start_request(req);
+
 	switch (req_op(req)) {
-	case REQ_OP_DISCARD:
 	case REQ_OP_FLUSH:
+		/* Nothing is cached once the ecalls return */
 		break;
 	case REQ_OP_READ:
 		sbi_disk_transfer(req, 0);
@@ -69,34 +118,277 @@ static unsigned long sbi_disk_request(struct request *req)
 		break;
 	default:
 		printk(KERN_ERR "unhandleable sbi_disk request\n");
-		return -EIO;
+		return BLK_STS_IOERR;
 	}
 
-	return 0;
+	blk_mq_end_request(req, BLK_STS_OK);
+	return BLK_STS_OK;
 }
 
-static void sbi_disk_rq_handler(struct request_queue *rq)
+static void sbi_disk_add_desc(struct sbi_disk_queue *sq, u32 op, u64 addr,
+		u64 offset, u32 len, u64 cookie)
 {
-	struct request *req;
-	while ((req = blk_fetch_request(rq)) != NULL) {
-		while (__blk_end_request_cur(req, sbi_disk_request(req)));
+	struct sbi_disk_desc *desc = &sq->descs[sq->ndescs++];
+
+	desc->addr = addr;
+	desc->offset = offset;
+	desc->len = len;
+	desc->op = op;
+	desc->cookie = cookie;
+}
+
+static void sbi_disk_submit_batch(struct sbi_disk_queue *sq)
+{
+	long accepted;
+
+	if (sq->ndescs == 0)
+		return;
+
+	/* Whatever the firmware has no room for is retried by the timer */
+	accepted = sbi_disk_submit(sq->index, sq->descs, sq->ndescs);
+	if (accepted <= 0)
+		return;
+
+	sq->inflight += accepted;
+	sq->ndescs -= accepted;
+	memmove(sq->descs, sq->descs + accepted,
+		sq->ndescs * sizeof(*sq->descs));
+}
+
+static unsigned int sbi_disk_reap(struct sbi_disk_queue *sq)
+{
+	unsigned int reaped = 0;
+	long i, n;
+
+	do {
+		n = sbi_disk_complete(sq->index, sq->cmpls, SBI_DISK_BATCH);
+		for (i = 0; i < n; i++) {
+			u16 tag = blk_mq_unique_tag_to_tag(sq->cmpls[i].cookie);
+			struct request *req = blk_mq_tag_to_rq(sq->hctx->tags, tag);
+			struct sbi_disk_request *breq = blk_mq_rq_to_pdu(req);
+
+			if (sq->cmpls[i].status)
+				breq->status = BLK_STS_IOERR;
+			/* Ends in sbi_disk_complete_rq(), from softirq */
+			if (--breq->pending == 0)
+				blk_mq_complete_request(req);
+		}
+		if (n > 0) {
+			sq->inflight -= n;
+			reaped += n;
+		}
+	} while (n == SBI_DISK_BATCH);
+
+	if (reaped)
+		blk_mq_start_stopped_hw_queue(sq->hctx, true);
+
+	return reaped;
+}
+
+/* Keep polling while the firmware holds, or is yet to take, descriptors */
+static void sbi_disk_arm(struct sbi_disk_queue *sq)
+{
+	if ((sq->inflight || sq->ndescs) && !hrtimer_is_queued(&sq->timer))
+		hrtimer_start(&sq->timer, ns_to_ktime(poll_us * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+}
+
+static enum hrtimer_restart sbi_disk_timer(struct hrtimer *timer)
+{
+	struct sbi_disk_queue *sq =
+		container_of(timer, struct sbi_disk_queue, timer);
+	unsigned long flags;
+
+	spin_lock_irqsave(&sq->lock, flags);
+	sbi_disk_submit_batch(sq);
+	sbi_disk_reap(sq);
+	sbi_disk_arm(sq);
+	spin_unlock_irqrestore(&sq->lock, flags);
+
+	return HRTIMER_NORESTART;
+}
+
+static blk_status_t sbi_disk_queue_rq(struct blk_mq_hw_ctx *hctx,
+		const struct blk_mq_queue_data *bd)
+{
+	struct sbi_disk_queue *sq = hctx->driver_data;
+	struct request *req = bd->rq;
+	struct sbi_disk_request *breq = blk_mq_rq_to_pdu(req);
+	u64 cookie = blk_mq_unique_tag(req);
+	u64 offset = (u64)blk_rq_pos(req) << SECTOR_SHIFT;
+	unsigned int i, nents = 1;
+	unsigned long flags;
+	u32 op;
+
+	switch (req_op(req)) {
+	case REQ_OP_FLUSH:
+		op = SBI_DISK_OP_FLUSH;
+		break;
+	case REQ_OP_DISCARD:
+		op = SBI_DISK_OP_DISCARD;
+		break;
+	case REQ_OP_READ:
+		op = SBI_DISK_OP_READ;
+		break;
+	case REQ_OP_WRITE:
+		op = SBI_DISK_OP_WRITE;
+		break;
+	default:
+		printk(KERN_ERR "unhandleable sbi_disk request\n");
+		return BLK_STS_IOERR;
 	}
+
+	if (op == SBI_DISK_OP_READ || op == SBI_DISK_OP_WRITE) {
+		sg_init_table(breq->sg, SBI_DISK_MAX_SEGMENTS);
+		nents = blk_rq_map_sg(req->q, req, breq->sg);
+	}
+
+	spin_lock_irqsave(&sq->lock, flags);
+
+	if (sq->ndescs + nents > SBI_DISK_BATCH) {
+		sbi_disk_submit_batch(sq);
+		if (sq->ndescs + nents > SBI_DISK_BATCH) {
+			/* Restarted once completions make room */
+			blk_mq_stop_hw_queue(hctx);
+			sbi_disk_arm(sq);
+			spin_unlock_irqrestore(&sq->lock, flags);
+			return BLK_STS_RESOURCE;
+		}
+	}
+
+	blk_mq_start_request(req);
+	breq->pending = nents;
+	breq->status = BLK_STS_OK;
+
+	switch (op) {
+	case SBI_DISK_OP_FLUSH:
+		sbi_disk_add_desc(sq, op, 0, 0, 0, cookie);
+		break;
+	case SBI_DISK_OP_DISCARD:
+		sbi_disk_add_desc(sq, op, 0, offset, blk_rq_bytes(req), cookie);
+		break;
+	default:
+		for (i = 0; i < nents; i++) {
+			sbi_disk_add_desc(sq, op, sg_phys(&breq->sg[i]), offset,
+					  breq->sg[i].length, cookie);
+			offset += breq->sg[i].length;
+		}
+	}
+
+	/* One ecall for everything blk-mq dispatched in this run */
+	if (bd->last) {
+		sbi_disk_submit_batch(sq);
+		sbi_disk_reap(sq);
+	}
+	sbi_disk_arm(sq);
+
+	spin_unlock_irqrestore(&sq->lock, flags);
+
+	return BLK_STS_OK;
+}
+
+static int sbi_disk_poll(struct blk_mq_hw_ctx *hctx, unsigned int tag)
+{
+	struct sbi_disk_queue *sq = hctx->driver_data;
+	unsigned long flags;
+	unsigned int reaped;
+
+	spin_lock_irqsave(&sq->lock, flags);
+	sbi_disk_submit_batch(sq);
+	reaped = sbi_disk_reap(sq);
+	spin_unlock_irqrestore(&sq->lock, flags);
+
+	return reaped;
 }
 
+static void sbi_disk_complete_rq(struct request *req)
+{
+	struct sbi_disk_request *breq = blk_mq_rq_to_pdu(req);
+
+	blk_mq_end_request(req, breq->status);
+}
+
+static int sbi_disk_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
+		unsigned int index)
+{
+	struct sbi_disk_dev *dev = data;
+	struct sbi_disk_queue *sq = &dev->queues[index];
+
+	sq->hctx = hctx;
+	hctx->driver_data = sq;
+	return 0;
+}
+
+static const struct blk_mq_ops sbi_disk_mq_ops = {
+	.queue_rq = sbi_disk_queue_rq,
+	.complete = sbi_disk_complete_rq,
+	.poll = sbi_disk_poll,
+	.init_hctx = sbi_disk_init_hctx,
+};
+
+static const struct blk_mq_ops sbi_disk_sync_mq_ops = {
+	.queue_rq = sbi_disk_queue_rq_sync,
+};
+
 static int sbi_disk_setup(struct sbi_disk_dev *dev)
 {
 	unsigned long size = sbi_disk_size();
+	long nqueues;
+	unsigned int i;
 
 	if (size == 0)
 		return 0;
 
-	spin_lock_init(&dev->lock);
+	nqueues = sbi_disk_nqueues();
+	dev->nqueues = nqueues > 0 ? min_t(long, nqueues, nr_cpu_ids) : 0;
+
+	if (dev->nqueues) {
+		dev->queues = kcalloc(dev->nqueues, sizeof(*dev->queues),
+				      GFP_KERNEL);
+		if (!dev->queues)
+			return -ENOMEM;
+
+		for (i = 0; i < dev->nqueues; i++) {
+			struct sbi_disk_queue *sq = &dev->queues[i];
+
+			sq->dev = dev;
+			sq->index = i;
+			spin_lock_init(&sq->lock);
+			hrtimer_init(&sq->timer, CLOCK_MONOTONIC,
+				     HRTIMER_MODE_REL);
+			sq->timer.function = sbi_disk_timer;
+		}
+
+		dev->tag_set.ops = &sbi_disk_mq_ops;
+		dev->tag_set.nr_hw_queues = dev->nqueues;
+		dev->tag_set.cmd_size = sizeof(struct sbi_disk_request);
+	} else {
+		dev->tag_set.ops = &sbi_disk_sync_mq_ops;
+		dev->tag_set.nr_hw_queues = 1;
+	}
+	dev->tag_set.queue_depth = SBI_DISK_QUEUE_DEPTH;
+	dev->tag_set.numa_node = NUMA_NO_NODE;
+	dev->tag_set.flags = BLK_MQ_F_SHOULD_MERGE;
+	dev->tag_set.driver_data = dev;
+	if (blk_mq_alloc_tag_set(&dev->tag_set))
+		goto exit_queues;
 
-	dev->queue = blk_init_queue(sbi_disk_rq_handler, &dev->lock);
-	if (!dev->queue)
-		goto exit_queue;
+	dev->queue = blk_mq_init_queue(&dev->tag_set);
+	if (IS_ERR(dev->queue))
+		goto exit_tag_set;
+	dev->queue->queuedata = dev;
 	blk_queue_logical_block_size(dev->queue, SECTOR_SIZE);
 
+	if (dev->nqueues) {
+		blk_queue_max_segments(dev->queue, SBI_DISK_MAX_SEGMENTS);
+		/* Writes may sit in the host's cache until a FLUSH */
+		blk_queue_write_cache(dev->queue, true, false);
+		queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, dev->queue);
+		dev->queue->limits.discard_granularity = SECTOR_SIZE;
+		blk_queue_max_discard_sectors(dev->queue,
+					      UINT_MAX >> SECTOR_SHIFT);
+	}
+
 	dev->gd = alloc_disk(SBI_DISK_MINORS);
 	if (!dev->gd)
 		goto exit_gendisk;
@@ -108,22 +400,34 @@ static int sbi_disk_setup(struct sbi_disk_dev *dev)
 	snprintf(dev->gd->disk_name, 32, SBI_DISK_NAME);
 	set_capacity(dev->gd, size >> SECTOR_SHIFT);
 	add_disk(dev->gd);
-	printk(KERN_INFO "disk [%s] of %lu bytes loaded\n",
-			dev->gd->disk_name, size);
+	printk(KERN_INFO "disk [%s] of %lu bytes loaded, %u queues\n",
+			dev->gd->disk_name, size, dev->nqueues);
 
 	return 0;
 
 exit_gendisk:
 	blk_cleanup_queue(dev->queue);
-exit_queue:
+exit_tag_set:
+	blk_mq_free_tag_set(&dev->tag_set);
+exit_queues:
+	kfree(dev->queues);
 	return -ENOMEM;
 }
 
 static void sbi_disk_teardown(struct sbi_disk_dev *dev)
 {
+	unsigned int i;
+
+	if (!dev->gd)
+		return;
+
 	del_gendisk(dev->gd);
 	put_disk(dev->gd);
 	blk_cleanup_queue(dev->queue);
+	for (i = 0; i < dev->nqueues; i++)
+		hrtimer_cancel(&dev->queues[i].timer);
+	blk_mq_free_tag_set(&dev->tag_set);
+	kfree(dev->queues);
 }
 
 static int __init sbi_disk_init(void)
@@ -0,0 +1,121 @@
+/*
+ * Based on arch/arm64/include/asm/alternative.h
+ *
+ * Copyright (C) 2014 ARM Ltd.
+ * Copyright (C) 2017 SiFive
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ASM_RISCV_ALTERNATIVE_H
+#define _ASM_RISCV_ALTERNATIVE_H
+
+#include <asm/asm.h>
+
+/*
+ * ALTERNATIVE(oldinstr, newinstr, feature)
+ *
+ * oldinstr is assembled in place and runs unless every hart implements
+ * the ISA extension "feature" (a RISCV_ISA_EXT_* number), in which case
+ * apply_boot_alternatives() copies newinstr over it before the other
+ * harts are started.  oldinstr must therefore be correct everywhere.
+ *
+ * Both sequences are assembled without compressed instructions or linker
+ * relaxation and must be the same length; the .org pair below fails the
+ * build otherwise.  newinstr lives in subsection 1 of the current section
+ * so that it stays within jal range of the code it replaces.  A jal in
+ * newinstr that leaves the sequence is fixed up when it is copied; no
+ * other PC-relative instruction (auipc, branches out of the sequence) is.
+ *
+ * The same macro works in C, with quoted instruction strings for inline
+ * asm, and in assembly files.
+ */
+
+#ifdef __ASSEMBLY__
+
+.macro ALT_ENTRY orig, alt, feature, len
+	.pushsection .altinstructions, "a"
+	.balign	RISCV_SZPTR
+	RISCV_PTR \orig
+	RISCV_PTR \alt
+	.word	\feature
+	.word	\len
+	.popsection
+.endm
+
+.macro __ALTERNATIVE oldinstr, newinstr, feature
+	.option push
+	.option norvc
+	.option norelax
+	.balign	4
+661:	\oldinstr
+662:	ALT_ENTRY 661b, 663f, \feature, 662b-661b
+	.subsection 1
+	.balign	4
+663:	\newinstr
+664:	.org	. - (664b - 663b) + (662b - 661b)
+	.org	. - (662b - 661b) + (664b - 663b)
+	.previous
+	.option pop
+.endm
+
+#define ALTERNATIVE(oldinstr, newinstr, feature)	\
+	__ALTERNATIVE oldinstr, newinstr, feature
+
+#else /* !__ASSEMBLY__ */
+
+#include <linux/init.h>
+#include <linux/stringify.h>
+#include <linux/types.h>
+
+struct alt_instr {
+	void *orig_ptr;		/* code patched when feature is present */
+	void *alt_ptr;		/* its replacement */
+	u32 feature;		/* RISCV_ISA_EXT_* the replacement needs */
+	u32 len;		/* bytes in each of the two sequences */
+};
+
+#define ALT_ENTRY(orig, alt, feature, len)				\
+	".pushsection .altinstructions, \"a\"\n"			\
+	".balign " RISCV_SZPTR "\n"					\
+	RISCV_PTR " " orig "\n"						\
+	RISCV_PTR " " alt "\n"						\
+	".word " feature "\n"						\
+	".word " len "\n"						\
+	".popsection\n"
+
+#define ALTERNATIVE(oldinstr, newinstr, feature)			\
+	".option push\n"						\
+	".option norvc\n"						\
+	".option norelax\n"						\
+	".balign 4\n"							\
+	"661:\n\t"							\
+	oldinstr "\n"							\
+	"662:\n"							\
+	ALT_ENTRY("661b", "663f", __stringify(feature), "662b - 661b")	\
+	".subsection 1\n"						\
+	".balign 4\n"							\
+	"663:\n\t"							\
+	newinstr "\n"							\
+	"664:\n"							\
+	".org	. - (664b - 663b) + (662b - 661b)\n"			\
+	".org	. - (662b - 661b) + (664b - 663b)\n"			\
+	".previous\n"							\
+	".option pop\n"
+
+void __init apply_boot_alternatives(void);
+void apply_alternatives(struct alt_instr *begin, struct alt_instr *end);
+
+#endif /* __ASSEMBLY__ */
+
+#endif /* _ASM_RISCV_ALTERNATIVE_H */
@@ -0,0 +1,16 @@
+#ifndef _ASM_RISCV_PROTOTYPES_H
+#define _ASM_RISCV_PROTOTYPES_H
+
+#include <linux/raid/xor.h>
+#include <asm/xor.h>
+#include <asm-generic/asm-prototypes.h>
+
+#ifdef CONFIG_32BIT
+/* libgcc-compatible 64-bit division, from arch/riscv/lib/div64.c */
+u64 __udivdi3(u64 a, u64 b);
+u64 __umoddi3(u64 a, u64 b);
+s64 __divdi3(s64 a, s64 b);
+s64 __moddi3(s64 a, s64 b);
+#endif
+
+#endif /* _ASM_RISCV_PROTOTYPES_H */
@@ -154,6 +154,69 @@ ATOMIC_OPS(xor, xor, ^,  i, .aqrl,         )
 #undef ATOMIC_FETCH_OP
 #undef ATOMIC_OP_RETURN
 
+/*
+ * Tell linux/atomic.h about the ordered variants, which it would otherwise
+ * build from the fully ordered ops (or from the relaxed ones and fences).
+ */
+#define atomic_add_return		atomic_add_return
+#define atomic_add_return_relaxed	atomic_add_return_relaxed
+#define atomic_add_return_acquire	atomic_add_return_acquire
+#define atomic_add_return_release	atomic_add_return_release
+#define atomic_sub_return		atomic_sub_return
+#define atomic_sub_return_relaxed	atomic_sub_return_relaxed
+#define atomic_sub_return_acquire	atomic_sub_return_acquire
+#define atomic_sub_return_release	atomic_sub_return_release
+#define atomic_fetch_add		atomic_fetch_add
+#define atomic_fetch_add_relaxed	atomic_fetch_add_relaxed
+#define atomic_fetch_add_acquire	atomic_fetch_add_acquire
+#define atomic_fetch_add_release	atomic_fetch_add_release
+#define atomic_fetch_sub		atomic_fetch_sub
+#define atomic_fetch_sub_relaxed	atomic_fetch_sub_relaxed
+#define atomic_fetch_sub_acquire	atomic_fetch_sub_acquire
+#define atomic_fetch_sub_release	atomic_fetch_sub_release
+#define atomic_fetch_and		atomic_fetch_and
+#define atomic_fetch_and_relaxed	atomic_fetch_and_relaxed
+#define atomic_fetch_and_acquire	atomic_fetch_and_acquire
+#define atomic_fetch_and_release	atomic_fetch_and_release
+#define atomic_fetch_or			atomic_fetch_or
+#define atomic_fetch_or_relaxed		atomic_fetch_or_relaxed
+#define atomic_fetch_or_acquire		atomic_fetch_or_acquire
+#define atomic_fetch_or_release		atomic_fetch_or_release
+#define atomic_fetch_xor		atomic_fetch_xor
+#define atomic_fetch_xor_relaxed	atomic_fetch_xor_relaxed
+#define atomic_fetch_xor_acquire	atomic_fetch_xor_acquire
+#define atomic_fetch_xor_release	atomic_fetch_xor_release
+#ifndef CONFIG_GENERIC_ATOMIC64
+#define atomic64_add_return		atomic64_add_return
+#define atomic64_add_return_relaxed	atomic64_add_return_relaxed
+#define atomic64_add_return_acquire	atomic64_add_return_acquire
+#define atomic64_add_return_release	atomic64_add_return_release
+#define atomic64_sub_return		atomic64_sub_return
+#define atomic64_sub_return_relaxed	atomic64_sub_return_relaxed
+#define atomic64_sub_return_acquire	atomic64_sub_return_acquire
+#define atomic64_sub_return_release	atomic64_sub_return_release
+#define atomic64_fetch_add		atomic64_fetch_add
+#define atomic64_fetch_add_relaxed	atomic64_fetch_add_relaxed
+#define atomic64_fetch_add_acquire	atomic64_fetch_add_acquire
+#define atomic64_fetch_add_release	atomic64_fetch_add_release
+#define atomic64_fetch_sub		atomic64_fetch_sub
+#define atomic64_fetch_sub_relaxed	atomic64_fetch_sub_relaxed
+#define atomic64_fetch_sub_acquire	atomic64_fetch_sub_acquire
+#define atomic64_fetch_sub_release	atomic64_fetch_sub_release
+#define atomic64_fetch_and		atomic64_fetch_and
+#define atomic64_fetch_and_relaxed	atomic64_fetch_and_relaxed
+#define atomic64_fetch_and_acquire	atomic64_fetch_and_acquire
+#define atomic64_fetch_and_release	atomic64_fetch_and_release
+#define atomic64_fetch_or		atomic64_fetch_or
+#define atomic64_fetch_or_relaxed	atomic64_fetch_or_relaxed
+#define atomic64_fetch_or_acquire	atomic64_fetch_or_acquire
+#define atomic64_fetch_or_release	atomic64_fetch_or_release
+#define atomic64_fetch_xor		atomic64_fetch_xor
+#define atomic64_fetch_xor_relaxed	atomic64_fetch_xor_relaxed
+#define atomic64_fetch_xor_acquire	atomic64_fetch_xor_acquire
+#define atomic64_fetch_xor_release	atomic64_fetch_xor_release
+#endif
+
 /*
  * The extra atomic operations that are constructed from one of the core
  * AMO-based operations above (aside from sub, which is easier to fit above).
@@ -188,35 +251,83 @@ static __always_inline void atomic##prefix##_##op(atomic##prefix##_t *v)	\
 	atomic##prefix##_##func_op(I, v);					\
 }
 
-#define ATOMIC_FETCH_OP(op, func_op, c_op, I, c_type, prefix)				\
-static __always_inline c_type atomic##prefix##_fetch_##op(atomic##prefix##_t *v)	\
-{											\
-	return atomic##prefix##_fetch_##func_op(I, v);					\
+#define ATOMIC_FETCH_OP(op, func_op, c_op, I, c_or, c_type, prefix)			\
+static __always_inline c_type atomic##prefix##_fetch_##op##c_or(atomic##prefix##_t *v)	\
+{												\
+	return atomic##prefix##_fetch_##func_op##c_or(I, v);					\
 }
 
-#define ATOMIC_OP_RETURN(op, asm_op, c_op, I, c_type, prefix)				\
-static __always_inline c_type atomic##prefix##_##op##_return(atomic##prefix##_t *v)	\
-{											\
-        return atomic##prefix##_fetch_##op(v) c_op I;					\
+#define ATOMIC_OP_RETURN(op, asm_op, c_op, I, c_or, c_type, prefix)			\
+static __always_inline c_type atomic##prefix##_##op##_return##c_or(atomic##prefix##_t *v)	\
+{												\
+        return atomic##prefix##_fetch_##op##c_or(v) c_op I;					\
 }
 
 #ifdef CONFIG_GENERIC_ATOMIC64
+#define ATOMIC_ORDERED_OPS(op, asm_op, c_op, I, c_or)				\
+        ATOMIC_FETCH_OP (op, asm_op, c_op, I, c_or,  int,   )			\
+        ATOMIC_OP_RETURN(op, asm_op, c_op, I, c_or,  int,   )
 #define ATOMIC_OPS(op, asm_op, c_op, I)						\
-        ATOMIC_OP       (op, asm_op, c_op, I,  int,   )				\
-        ATOMIC_FETCH_OP (op, asm_op, c_op, I,  int,   )				\
-        ATOMIC_OP_RETURN(op, asm_op, c_op, I,  int,   )
+        ATOMIC_OP       (op, asm_op, c_op, I,  int,   )
 #else
+#define ATOMIC_ORDERED_OPS(op, asm_op, c_op, I, c_or)				\
+        ATOMIC_FETCH_OP (op, asm_op, c_op, I, c_or,  int,   )			\
+        ATOMIC_OP_RETURN(op, asm_op, c_op, I, c_or,  int,   )			\
+        ATOMIC_FETCH_OP (op, asm_op, c_op, I, c_or, long, 64)			\
+        ATOMIC_OP_RETURN(op, asm_op, c_op, I, c_or, long, 64)
 #define ATOMIC_OPS(op, asm_op, c_op, I)						\
         ATOMIC_OP       (op, asm_op, c_op, I,  int,   )				\
-        ATOMIC_FETCH_OP (op, asm_op, c_op, I,  int,   )				\
-        ATOMIC_OP_RETURN(op, asm_op, c_op, I,  int,   )				\
-        ATOMIC_OP       (op, asm_op, c_op, I, long, 64)				\
-        ATOMIC_FETCH_OP (op, asm_op, c_op, I, long, 64)				\
-        ATOMIC_OP_RETURN(op, asm_op, c_op, I, long, 64)
+        ATOMIC_OP       (op, asm_op, c_op, I, long, 64)
 #endif
 
 ATOMIC_OPS(inc, add, +,  1)
+ATOMIC_ORDERED_OPS(inc, add, +,  1,         )
+ATOMIC_ORDERED_OPS(inc, add, +,  1, _relaxed)
+ATOMIC_ORDERED_OPS(inc, add, +,  1, _acquire)
+ATOMIC_ORDERED_OPS(inc, add, +,  1, _release)
+
 ATOMIC_OPS(dec, add, +, -1)
+ATOMIC_ORDERED_OPS(dec, add, +, -1,         )
+ATOMIC_ORDERED_OPS(dec, add, +, -1, _relaxed)
+ATOMIC_ORDERED_OPS(dec, add, +, -1, _acquire)
+ATOMIC_ORDERED_OPS(dec, add, +, -1, _release)
+
+#define atomic_inc_return		atomic_inc_return
+#define atomic_inc_return_relaxed	atomic_inc_return_relaxed
+#define atomic_inc_return_acquire	atomic_inc_return_acquire
+#define atomic_inc_return_release	atomic_inc_return_release
+#define atomic_dec_return		atomic_dec_return
+#define atomic_dec_return_relaxed	atomic_dec_return_relaxed
+#define atomic_dec_return_acquire	atomic_dec_return_acquire
+#define atomic_dec_return_release	atomic_dec_return_release
+#define atomic_fetch_inc		atomic_fetch_inc
+#define atomic_fetch_inc_relaxed	atomic_fetch_inc_relaxed
+#define atomic_fetch_inc_acquire	atomic_fetch_inc_acquire
+#define atomic_fetch_inc_release	atomic_fetch_inc_release
+#define atomic_fetch_dec		atomic_fetch_dec
+#define atomic_fetch_dec_relaxed	atomic_fetch_dec_relaxed
+#define atomic_fetch_dec_acquire	atomic_fetch_dec_acquire
+#define atomic_fetch_dec_release	atomic_fetch_dec_release
+#ifndef CONFIG_GENERIC_ATOMIC64
+#define atomic64_inc_return		atomic64_inc_return
+#define atomic64_inc_return_relaxed	atomic64_inc_return_relaxed
+#define atomic64_inc_return_acquire	atomic64_inc_return_acquire
+#define atomic64_inc_return_release	atomic64_inc_return_release
+#define atomic64_dec_return		atomic64_dec_return
+#define atomic64_dec_return_relaxed	atomic64_dec_return_relaxed
+#define atomic64_dec_return_acquire	atomic64_dec_return_acquire
+#define atomic64_dec_return_release	atomic64_dec_return_release
+#define atomic64_fetch_inc		atomic64_fetch_inc
+#define atomic64_fetch_inc_relaxed	atomic64_fetch_inc_relaxed
+#define atomic64_fetch_inc_acquire	atomic64_fetch_inc_acquire
+#define atomic64_fetch_inc_release	atomic64_fetch_inc_release
+#define atomic64_fetch_dec		atomic64_fetch_dec
+#define atomic64_fetch_dec_relaxed	atomic64_fetch_dec_relaxed
+#define atomic64_fetch_dec_acquire	atomic64_fetch_dec_acquire
+#define atomic64_fetch_dec_release	atomic64_fetch_dec_release
+#endif
+
+#undef ATOMIC_ORDERED_OPS
 
 #undef ATOMIC_OPS
 #undef ATOMIC_OP
@@ -303,33 +414,52 @@ static __always_inline long atomic64_inc_not_zero(atomic64_t *v)
  * {cmp,}xchg and the operations that return, so they need a barrier.  We just
  * use the other implementations directly.
  */
-#define ATOMIC_OP(c_t, prefix, c_or, size, asm_or)						\
+#define ATOMIC_OP(c_t, prefix, c_or)								\
 static __always_inline c_t atomic##prefix##_cmpxchg##c_or(atomic##prefix##_t *v, c_t o, c_t n) 	\
 {												\
-	return __cmpxchg(&(v->counter), o, n, size, asm_or, asm_or);				\
+	return cmpxchg##c_or(&(v->counter), o, n);						\
 }												\
 static __always_inline c_t atomic##prefix##_xchg##c_or(atomic##prefix##_t *v, c_t n) 		\
 {												\
-	return __xchg(n, &(v->counter), size, asm_or);						\
+	return xchg##c_or(&(v->counter), n);							\
 }
 
 #ifdef CONFIG_GENERIC_ATOMIC64
-#define ATOMIC_OPS(c_or, asm_or)			\
-	ATOMIC_OP( int,   , c_or, 4, asm_or)
+#define ATOMIC_OPS(c_or)			\
+	ATOMIC_OP( int,   , c_or)
 #else
-#define ATOMIC_OPS(c_or, asm_or)			\
-	ATOMIC_OP( int,   , c_or, 4, asm_or)		\
-	ATOMIC_OP(long, 64, c_or, 8, asm_or)
+#define ATOMIC_OPS(c_or)			\
+	ATOMIC_OP( int,   , c_or)		\
+	ATOMIC_OP(long, 64, c_or)
 #endif
 
-ATOMIC_OPS(        , .aqrl)
-ATOMIC_OPS(_acquire,   .aq)
-ATOMIC_OPS(_release,   .rl)
-ATOMIC_OPS(_relaxed,      )
+ATOMIC_OPS(        )
+ATOMIC_OPS(_acquire)
+ATOMIC_OPS(_release)
+ATOMIC_OPS(_relaxed)
 
 #undef ATOMIC_OPS
 #undef ATOMIC_OP
 
+#define atomic_cmpxchg			atomic_cmpxchg
+#define atomic_cmpxchg_relaxed		atomic_cmpxchg_relaxed
+#define atomic_cmpxchg_acquire		atomic_cmpxchg_acquire
+#define atomic_cmpxchg_release		atomic_cmpxchg_release
+#define atomic_xchg			atomic_xchg
+#define atomic_xchg_relaxed		atomic_xchg_relaxed
+#define atomic_xchg_acquire		atomic_xchg_acquire
+#define atomic_xchg_release		atomic_xchg_release
+#ifndef CONFIG_GENERIC_ATOMIC64
+#define atomic64_cmpxchg		atomic64_cmpxchg
+#define atomic64_cmpxchg_relaxed	atomic64_cmpxchg_relaxed
+#define atomic64_cmpxchg_acquire	atomic64_cmpxchg_acquire
+#define atomic64_cmpxchg_release	atomic64_cmpxchg_release
+#define atomic64_xchg			atomic64_xchg
+#define atomic64_xchg_relaxed		atomic64_xchg_relaxed
+#define atomic64_xchg_acquire		atomic64_xchg_acquire
+#define atomic64_xchg_release		atomic64_xchg_release
+#endif
+
 static __always_inline int atomic_sub_if_positive(atomic_t *v, int offset)
 {
        int prev, rc;
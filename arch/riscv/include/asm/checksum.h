@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#ifndef _ASM_RISCV_CHECKSUM_H
+#define _ASM_RISCV_CHECKSUM_H
+
+#include <linux/bitops.h>
+#include <linux/types.h>
+
+/*
+ * lib/checksum.c builds csum_partial() and friends around do_csum(); ours
+ * sums a long at a time, and with the V extension a vector at a time.
+ */
+unsigned int do_csum(const unsigned char *buff, int len);
+#define do_csum do_csum
+
+/* Copies and sums in a single pass over the data */
+__wsum csum_partial_copy_nocheck(const void *src, void *dst, int len,
+				 __wsum sum);
+#define csum_partial_copy_nocheck csum_partial_copy_nocheck
+
+/*
+ * The upper half of sum + ror32(sum, 16) is the sum of both halves, with
+ * the carry out of the lower half already added back in.
+ */
+static inline __sum16 csum_fold(__wsum sum)
+{
+	u32 s = (__force u32)sum;
+
+	return (__force __sum16)(~(s + ror32(s, 16)) >> 16);
+}
+#define csum_fold csum_fold
+
+#ifdef CONFIG_64BIT
+
+/* The same trick, one size up, to fold a 64-bit sum to 32 bits */
+static inline u32 __csum_fold64(unsigned long sum)
+{
+	return (sum + ror64(sum, 32)) >> 32;
+}
+
+/*
+ * An IP header is at most 15 words, whose sum can't overflow 64 bits, so
+ * there are no carries to chase until the end.
+ */
+static inline __sum16 ip_fast_csum(const void *iph, unsigned int ihl)
+{
+	const u32 *p = iph;
+	unsigned long sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < ihl; i++)
+		sum += p[i];
+
+	return csum_fold((__force __wsum)__csum_fold64(sum));
+}
+#define ip_fast_csum ip_fast_csum
+
+static inline __wsum csum_tcpudp_nofold(__be32 saddr, __be32 daddr,
+					__u32 len, __u8 proto, __wsum sum)
+{
+	unsigned long s = (__force u32)sum;
+
+	s += (__force u32)saddr;
+	s += (__force u32)daddr;
+	s += (unsigned long)(len + proto) << 8;
+
+	return (__force __wsum)__csum_fold64(s);
+}
+#define csum_tcpudp_nofold csum_tcpudp_nofold
+
+#endif /* CONFIG_64BIT */
+
+#include <asm-generic/checksum.h>
+
+#endif /* _ASM_RISCV_CHECKSUM_H */
@@ -46,6 +46,10 @@
 
 #define xchg(ptr, x)    (__xchg((x), (ptr), sizeof(*(ptr)), .aqrl))
 
+#define xchg_relaxed(ptr, x)	(__xchg((x), (ptr), sizeof(*(ptr)), ))
+#define xchg_acquire(ptr, x)	(__xchg((x), (ptr), sizeof(*(ptr)), .aq))
+#define xchg_release(ptr, x)	(__xchg((x), (ptr), sizeof(*(ptr)), .rl))
+
 #define xchg32(ptr, x)				\
 ({						\
 	BUILD_BUG_ON(sizeof(*(ptr)) != 4);	\
@@ -62,8 +66,12 @@
  * Atomic compare and exchange.  Compare OLD with MEM, if identical,
  * store NEW in MEM.  Return the initial value in MEM.  Success is
  * indicated by comparing RETURN with OLD.
+ *
+ * lr_or and sc_or are the ordering bits for the LR and the SC: acquire
+ * only needs them on the LR, release only on the SC.  A failed compare
+ * never reaches the SC, so it is only ordered by the LR's bits.
  */
-#define __cmpxchg(ptr, old, new, size, lrb, scb)			\
+#define __cmpxchg(ptr, old, new, size, lr_or, sc_or)			\
 ({									\
 	__typeof__(ptr) __ptr = (ptr);					\
 	__typeof__(*(ptr)) __old = (old);				\
@@ -74,9 +82,9 @@
 	case 4:								\
 		__asm__ __volatile__ (					\
 		"0:"							\
-			"lr.w" #scb " %0, %2\n"				\
+			"lr.w" #lr_or " %0, %2\n"			\
 			"bne         %0, %z3, 1f\n"			\
-			"sc.w" #lrb " %1, %z4, %2\n"			\
+			"sc.w" #sc_or " %1, %z4, %2\n"			\
 			"bnez        %1, 0b\n"				\
 		"1:"							\
 			: "=&r" (__ret), "=&r" (__rc), "+A" (*__ptr)	\
@@ -86,9 +94,9 @@
 	case 8:								\
 		__asm__ __volatile__ (					\
 		"0:"							\
-			"lr.d" #scb " %0, %2\n"				\
+			"lr.d" #lr_or " %0, %2\n"			\
 			"bne         %0, %z3, 1f\n"			\
-			"sc.d" #lrb " %1, %z4, %2\n"			\
+			"sc.d" #sc_or " %1, %z4, %2\n"			\
 			"bnez        %1, 0b\n"				\
 		"1:"							\
 			: "=&r" (__ret), "=&r" (__rc), "+A" (*__ptr)	\
@@ -104,9 +112,17 @@
 #define cmpxchg(ptr, o, n) \
 	(__cmpxchg((ptr), (o), (n), sizeof(*(ptr)), .aqrl, .aqrl))
 
-#define cmpxchg_local(ptr, o, n) \
+#define cmpxchg_relaxed(ptr, o, n) \
 	(__cmpxchg((ptr), (o), (n), sizeof(*(ptr)), , ))
 
+#define cmpxchg_acquire(ptr, o, n) \
+	(__cmpxchg((ptr), (o), (n), sizeof(*(ptr)), .aq, ))
+
+#define cmpxchg_release(ptr, o, n) \
+	(__cmpxchg((ptr), (o), (n), sizeof(*(ptr)), , .rl))
+
+#define cmpxchg_local(ptr, o, n) cmpxchg_relaxed((ptr), (o), (n))
+
 #define cmpxchg32(ptr, o, n)			\
 ({						\
 	BUILD_BUG_ON(sizeof(*(ptr)) != 4);	\
@@ -131,4 +147,22 @@
 	cmpxchg_local((ptr), (o), (n));		\
 })
 
+#define cmpxchg64_relaxed(ptr, o, n)		\
+({						\
+	BUILD_BUG_ON(sizeof(*(ptr)) != 8);	\
+	cmpxchg_relaxed((ptr), (o), (n));	\
+})
+
+#define cmpxchg64_acquire(ptr, o, n)		\
+({						\
+	BUILD_BUG_ON(sizeof(*(ptr)) != 8);	\
+	cmpxchg_acquire((ptr), (o), (n));	\
+})
+
+#define cmpxchg64_release(ptr, o, n)		\
+({						\
+	BUILD_BUG_ON(sizeof(*(ptr)) != 8);	\
+	cmpxchg_release((ptr), (o), (n));	\
+})
+
 #endif /* _ASM_RISCV_CMPXCHG_H */
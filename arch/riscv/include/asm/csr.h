@@ -15,6 +15,7 @@
 #define _ASM_RISCV_CSR_H
 
 #include <linux/const.h>
+#include <linux/stringify.h>
 
 /* Status register flags */
 #define SR_IE   _AC(0x00000002, UL) /* Interrupt Enable */
@@ -28,6 +29,12 @@
 #define SR_FS_CLEAN     _AC(0x00004000, UL)
 #define SR_FS_DIRTY     _AC(0x00006000, UL)
 
+#define SR_VS           _AC(0x00000600, UL) /* Vector Status */
+#define SR_VS_OFF       _AC(0x00000000, UL)
+#define SR_VS_INITIAL   _AC(0x00000200, UL)
+#define SR_VS_CLEAN     _AC(0x00000400, UL)
+#define SR_VS_DIRTY     _AC(0x00000600, UL)
+
 #define SR_XS           _AC(0x00018000, UL) /* Extension Status */
 #define SR_XS_OFF       _AC(0x00000000, UL)
 #define SR_XS_INITIAL   _AC(0x00008000, UL)
@@ -35,9 +42,9 @@
 #define SR_XS_DIRTY     _AC(0x00018000, UL)
 
 #ifndef CONFIG_64BIT
-#define SR_SD   _AC(0x80000000, UL) /* FS/XS dirty */
+#define SR_SD   _AC(0x80000000, UL) /* FS/VS/XS dirty */
 #else
-#define SR_SD   _AC(0x8000000000000000, UL) /* FS/XS dirty */
+#define SR_SD   _AC(0x8000000000000000, UL) /* FS/VS/XS dirty */
 #endif
 
 /* SPTBR flags */
@@ -45,32 +52,142 @@
 #define SPTBR_PPN     _AC(0x003FFFFF, UL)
 #define SPTBR_MODE_32 _AC(0x80000000, UL)
 #define SPTBR_MODE    SPTBR_MODE_32
+#define SPTBR_ASID_BITS  9
+#define SPTBR_ASID_SHIFT 22
 #else
 #define SPTBR_PPN     _AC(0x00000FFFFFFFFFFF, UL)
 #define SPTBR_MODE_39 _AC(0x8000000000000000, UL)
 #define SPTBR_MODE    SPTBR_MODE_39
+#define SPTBR_ASID_BITS  16
+#define SPTBR_ASID_SHIFT 44
 #endif
+#define SPTBR_ASID_MASK  ((_AC(1, UL) << SPTBR_ASID_BITS) - 1)
+
+/* Trap vector modes, in the low bits of stvec */
+#define STVEC_MODE_DIRECT   _AC(0x0, UL)
+#define STVEC_MODE_VECTORED _AC(0x1, UL) /* Interrupts go to BASE + 4 * cause */
+#define STVEC_MODE_MASK     _AC(0x3, UL)
 
 /* Interrupt Enable and Interrupt Pending flags */
 #define SIE_SSIE _AC(0x00000002, UL) /* Software Interrupt Enable */
 #define SIE_STIE _AC(0x00000020, UL) /* Timer Interrupt Enable */
+#define SIE_SEIE _AC(0x00000200, UL) /* External Interrupt Enable */
+
+/* User-readable counters; hpmcounterN is CSR_CYCLE + N, 3 <= N <= 31 */
+#define CSR_CYCLE		0xc00
+#define CSR_TIME		0xc01
+#define CSR_INSTRET		0xc02
+#define CSR_HPMCOUNTER3		0xc03
+#define CSR_CYCLEH		0xc80
+#define CSR_TIMEH		0xc81
+#define CSR_INSTRETH		0xc82
+#define CSR_HPMCOUNTER3H	0xc83
+
+/* Vector extension */
+#define CSR_VSTART		0x008
+#define CSR_VXSAT		0x009
+#define CSR_VXRM		0x00a
+#define CSR_VCSR		0x00f
+#define CSR_VL			0xc20
+#define CSR_VTYPE		0xc21
+#define CSR_VLENB		0xc22
+
+/* Supervisor timer compare (Sstc) */
+#define CSR_STIMECMP		0x14d
+#define CSR_STIMECMPH		0x15d
+
+/* Advanced interrupt architecture: indirect access and the IMSIC */
+#define CSR_SISELECT		0x150
+#define CSR_SIREG		0x151
+#define CSR_STOPEI		0x15c
+
+#define IMSIC_EIDELIVERY	0x70
+#define IMSIC_EITHRESHOLD	0x72
+#define IMSIC_EIP0		0x80
+#define IMSIC_EIE0		0xc0
+#define IMSIC_TOPEI_ID_SHIFT	16
+
+/* Supervisor counter enable, swapped with the guest's on world switch */
+#define CSR_SCOUNTEREN		0x106
+
+/* Hypervisor extension */
+#define CSR_VSSTATUS		0x200
+#define CSR_VSIE		0x204
+#define CSR_VSTVEC		0x205
+#define CSR_VSSCRATCH		0x240
+#define CSR_VSEPC		0x241
+#define CSR_VSCAUSE		0x242
+#define CSR_VSTVAL		0x243
+#define CSR_VSIP		0x244
+#define CSR_VSATP		0x280
+#define CSR_HSTATUS		0x600
+#define CSR_HEDELEG		0x602
+#define CSR_HIDELEG		0x603
+#define CSR_HIE			0x604
+#define CSR_HTIMEDELTA		0x605
+#define CSR_HCOUNTEREN		0x606
+#define CSR_HTIMEDELTAH		0x615
+#define CSR_HTVAL		0x643
+#define CSR_HIP			0x644
+#define CSR_HVIP		0x645
+#define CSR_HTINST		0x64a
+#define CSR_HGATP		0x680
+
+#define HSTATUS_GVA	_AC(0x00000040, UL) /* stval holds a guest VA */
+#define HSTATUS_SPV	_AC(0x00000080, UL) /* Previously Virtualized */
+#define HSTATUS_SPVP	_AC(0x00000100, UL) /* Previously VS (for HLV/HSV) */
+#define HSTATUS_HU	_AC(0x00000200, UL)
+#define HSTATUS_VTVM	_AC(0x00100000, UL)
+#define HSTATUS_VTW	_AC(0x00200000, UL) /* Trap WFI in VS-mode */
+#define HSTATUS_VTSR	_AC(0x00400000, UL)
+#define HSTATUS_VSXL_SHIFT	32
+#define HSTATUS_VSXL	(_AC(3, UL) << HSTATUS_VSXL_SHIFT)
+
+#if __riscv_xlen == 32
+#define HGATP_PPN		_AC(0x003FFFFF, UL)
+#define HGATP_MODE_SV32X4	_AC(0x80000000, UL)
+#define HGATP_MODE		HGATP_MODE_SV32X4
+#define HGATP_VMID_SHIFT	22
+#define HGATP_VMID_MASK		_AC(0x1FC00000, UL)
+#else
+#define HGATP_PPN		_AC(0x00000FFFFFFFFFFF, UL)
+#define HGATP_MODE_SV39X4	_AC(0x8000000000000000, UL)
+#define HGATP_MODE		HGATP_MODE_SV39X4
+#define HGATP_VMID_SHIFT	44
+#define HGATP_VMID_MASK		_AC(0x03FFF00000000000, UL)
+#endif
+
+/* VS-level interrupts, as seen in hideleg, hvip and hip */
+#define IRQ_VS_SOFT		2
+#define IRQ_VS_TIMER		6
+#define IRQ_VS_EXT		10
+#define HVIP_VSSIP		(_AC(1, UL) << IRQ_VS_SOFT)
+#define HVIP_VSTIP		(_AC(1, UL) << IRQ_VS_TIMER)
+#define HVIP_VSEIP		(_AC(1, UL) << IRQ_VS_EXT)
 
 #define EXC_INST_MISALIGNED     0
 #define EXC_INST_ACCESS         1
+#define EXC_INST_ILLEGAL        2
 #define EXC_BREAKPOINT          3
 #define EXC_LOAD_ACCESS         5
 #define EXC_STORE_ACCESS        7
 #define EXC_SYSCALL             8
+#define EXC_HYPERVISOR_SYSCALL  9
+#define EXC_SUPERVISOR_SYSCALL  10
 #define EXC_INST_PAGE_FAULT     12
 #define EXC_LOAD_PAGE_FAULT     13
 #define EXC_STORE_PAGE_FAULT    15
+#define EXC_INST_GUEST_PAGE_FAULT	20
+#define EXC_LOAD_GUEST_PAGE_FAULT	21
+#define EXC_VIRTUAL_INST_FAULT		22
+#define EXC_STORE_GUEST_PAGE_FAULT	23
 
 #ifndef __ASSEMBLY__
 
 #define csr_swap(csr, val)					\
 ({								\
 	unsigned long __v = (unsigned long)(val);		\
-	__asm__ __volatile__ ("csrrw %0, " #csr ", %1"		\
+	__asm__ __volatile__ ("csrrw %0, " __stringify(csr) ", %1"		\
 			      : "=r" (__v) : "rK" (__v)		\
 			      : "memory");			\
 	__v;							\
@@ -79,7 +196,7 @@
 #define csr_read(csr)						\
 ({								\
 	register unsigned long __v;				\
-	__asm__ __volatile__ ("csrr %0, " #csr			\
+	__asm__ __volatile__ ("csrr %0, " __stringify(csr)			\
 			      : "=r" (__v) :			\
 			      : "memory");			\
 	__v;							\
@@ -88,7 +205,7 @@
 #define csr_write(csr, val)					\
 ({								\
 	unsigned long __v = (unsigned long)(val);		\
-	__asm__ __volatile__ ("csrw " #csr ", %0"		\
+	__asm__ __volatile__ ("csrw " __stringify(csr) ", %0"		\
 			      : : "rK" (__v)			\
 			      : "memory");			\
 })
@@ -96,7 +213,7 @@
 #define csr_read_set(csr, val)					\
 ({								\
 	unsigned long __v = (unsigned long)(val);		\
-	__asm__ __volatile__ ("csrrs %0, " #csr ", %1"		\
+	__asm__ __volatile__ ("csrrs %0, " __stringify(csr) ", %1"		\
 			      : "=r" (__v) : "rK" (__v)		\
 			      : "memory");			\
 	__v;							\
@@ -105,7 +222,7 @@
 #define csr_set(csr, val)					\
 ({								\
 	unsigned long __v = (unsigned long)(val);		\
-	__asm__ __volatile__ ("csrs " #csr ", %0"		\
+	__asm__ __volatile__ ("csrs " __stringify(csr) ", %0"		\
 			      : : "rK" (__v)			\
 			      : "memory");			\
 })
@@ -113,7 +230,7 @@
 #define csr_read_clear(csr, val)				\
 ({								\
 	unsigned long __v = (unsigned long)(val);		\
-	__asm__ __volatile__ ("csrrc %0, " #csr ", %1"		\
+	__asm__ __volatile__ ("csrrc %0, " __stringify(csr) ", %1"		\
 			      : "=r" (__v) : "rK" (__v)		\
 			      : "memory");			\
 	__v;							\
@@ -122,7 +239,7 @@
 #define csr_clear(csr, val)					\
 ({								\
 	unsigned long __v = (unsigned long)(val);		\
-	__asm__ __volatile__ ("csrc " #csr ", %0"		\
+	__asm__ __volatile__ ("csrc " __stringify(csr) ", %0"		\
 			      : : "rK" (__v)			\
 			      : "memory");			\
 })
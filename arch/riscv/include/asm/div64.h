@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#ifndef _ASM_RISCV_DIV64_H
+#define _ASM_RISCV_DIV64_H
+
+#include <linux/types.h>
+
+#ifdef CONFIG_32BIT
+/* Provided by arch/riscv/lib/div64.c in place of the generic shift loop */
+#define __div64_32 __div64_32
+extern uint32_t __div64_32(uint64_t *dividend, uint32_t divisor);
+#endif
+
+#include <asm-generic/div64.h>
+
+#endif /* _ASM_RISCV_DIV64_H */
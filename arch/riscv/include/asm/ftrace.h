@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#ifndef _ASM_RISCV_FTRACE_H
+#define _ASM_RISCV_FTRACE_H
+
+/*
+ * With -pg, GCC emits "call _mcount" right after the prologue of every
+ * function.  That pseudo-instruction is an auipc/jalr pair through ra, so
+ * each mcount site is two instructions long.  The frame pointer is needed
+ * to find the traced function's own return address.
+ */
+#define MCOUNT_ADDR		((unsigned long)_mcount)
+#define MCOUNT_INSN_SIZE	8
+
+#ifdef CONFIG_FRAME_POINTER
+#define HAVE_FUNCTION_GRAPH_FP_TEST
+#endif
+#define HAVE_FUNCTION_GRAPH_RET_ADDR_PTR
+
+#ifndef __ASSEMBLY__
+void _mcount(void);
+
+static inline unsigned long ftrace_call_adjust(unsigned long addr)
+{
+	/* recordmcount already points at the auipc of the pair */
+	return addr;
+}
+
+struct dyn_arch_ftrace {
+};
+
+#ifdef CONFIG_DYNAMIC_FTRACE
+/*
+ * "auipc ra, hi20" followed by "jalr ra, lo12(ra)": a call to any target
+ * within +/-2GiB of the site.  hi20 is rounded so that the sign-extended
+ * lo12 lands on the target.
+ */
+#define AUIPC_RA		0x00000097
+#define JALR_RA			0x000080e7
+#define NOP4			0x00000013
+
+#define to_auipc_insn(offset)	\
+	((((offset) + 0x800) & 0xfffff000) | AUIPC_RA)
+#define to_jalr_insn(offset)	\
+	((((offset) & 0xfff) << 20) | JALR_RA)
+
+#define make_call(caller, callee, call)					\
+do {									\
+	unsigned int __offset =						\
+		(unsigned long)(callee) - (unsigned long)(caller);	\
+	call[0] = to_auipc_insn(__offset);				\
+	call[1] = to_jalr_insn(__offset);				\
+} while (0)
+#endif /* CONFIG_DYNAMIC_FTRACE */
+#endif /* __ASSEMBLY__ */
+
+#endif /* _ASM_RISCV_FTRACE_H */
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#ifndef _ASM_RISCV_FUTEX_H
+#define _ASM_RISCV_FUTEX_H
+
+#ifdef __KERNEL__
+
+#include <linux/futex.h>
+#include <linux/uaccess.h>
+#include <linux/errno.h>
+#include <asm/asm.h>
+
+/*
+ * Every futex op maps onto a single AMO, which either completes or faults
+ * without side effects, so one fixup entry per op is enough.
+ */
+#define __futex_atomic_op(insn, ret, oldval, uaddr, oparg)	\
+do {								\
+	uintptr_t __tmp;					\
+	__enable_user_access();					\
+	__asm__ __volatile__ (					\
+		"1:\n"						\
+		"	" insn "\n"				\
+		"2:\n"						\
+		"	.section .fixup,\"ax\"\n"		\
+		"	.balign 4\n"				\
+		"3:\n"						\
+		"	li %[r], %[e]\n"			\
+		"	jump 2b, %[t]\n"			\
+		"	.previous\n"				\
+		"	.section __ex_table,\"a\"\n"		\
+		"	.balign " RISCV_SZPTR "\n"		\
+		"	" RISCV_PTR " 1b, 3b\n"			\
+		"	.previous"				\
+		: [r] "+r" (ret), [ov] "=&r" (oldval),		\
+		  [u] "+A" (*(uaddr)), [t] "=&r" (__tmp)	\
+		: [op] "rJ" (oparg), [e] "i" (-EFAULT)		\
+		: "memory");					\
+	__disable_user_access();				\
+} while (0)
+
+static inline int
+futex_atomic_op_inuser(unsigned int encoded_op, u32 __user *uaddr)
+{
+	int op = (encoded_op >> 28) & 7;
+	int cmp = (encoded_op >> 24) & 15;
+	int oparg = (int)(encoded_op << 8) >> 20;
+	int cmparg = (int)(encoded_op << 20) >> 20;
+	int oldval = 0, ret = 0;
+
+	if (encoded_op & (FUTEX_OP_OPARG_SHIFT << 28))
+		oparg = 1U << (oparg & 0x1f);
+
+	if (!access_ok(VERIFY_WRITE, uaddr, sizeof(u32)))
+		return -EFAULT;
+
+	pagefault_disable();
+
+	switch (op) {
+	case FUTEX_OP_SET:
+		__futex_atomic_op("amoswap.w.aqrl %[ov], %z[op], %[u]",
+				  ret, oldval, uaddr, oparg);
+		break;
+	case FUTEX_OP_ADD:
+		__futex_atomic_op("amoadd.w.aqrl %[ov], %z[op], %[u]",
+				  ret, oldval, uaddr, oparg);
+		break;
+	case FUTEX_OP_OR:
+		__futex_atomic_op("amoor.w.aqrl %[ov], %z[op], %[u]",
+				  ret, oldval, uaddr, oparg);
+		break;
+	case FUTEX_OP_ANDN:
+		__futex_atomic_op("amoand.w.aqrl %[ov], %z[op], %[u]",
+				  ret, oldval, uaddr, ~oparg);
+		break;
+	case FUTEX_OP_XOR:
+		__futex_atomic_op("amoxor.w.aqrl %[ov], %z[op], %[u]",
+				  ret, oldval, uaddr, oparg);
+		break;
+	default:
+		ret = -ENOSYS;
+	}
+
+	pagefault_enable();
+
+	if (!ret) {
+		switch (cmp) {
+		case FUTEX_OP_CMP_EQ: ret = (oldval == cmparg); break;
+		case FUTEX_OP_CMP_NE: ret = (oldval != cmparg); break;
+		case FUTEX_OP_CMP_LT: ret = (oldval < cmparg); break;
+		case FUTEX_OP_CMP_GE: ret = (oldval >= cmparg); break;
+		case FUTEX_OP_CMP_LE: ret = (oldval <= cmparg); break;
+		case FUTEX_OP_CMP_GT: ret = (oldval > cmparg); break;
+		default: ret = -ENOSYS;
+		}
+	}
+	return ret;
+}
+
+/*
+ * Either the lr.w or the sc.w may fault; both resume after the loop with
+ * -EFAULT in ret.
+ */
+static inline int
+futex_atomic_cmpxchg_inatomic(u32 *uval, u32 __user *uaddr,
+			      u32 oldval, u32 newval)
+{
+	int ret = 0;
+	u32 val;
+	uintptr_t tmp;
+
+	if (!access_ok(VERIFY_WRITE, uaddr, sizeof(u32)))
+		return -EFAULT;
+
+	__enable_user_access();
+	__asm__ __volatile__ (
+		"1:\n"
+		"	lr.w.aqrl %[v], %[u]\n"
+		"	bne %[v], %z[ov], 3f\n"
+		"2:\n"
+		"	sc.w.aqrl %[t], %z[nv], %[u]\n"
+		"	bnez %[t], 1b\n"
+		"3:\n"
+		"	.section .fixup,\"ax\"\n"
+		"	.balign 4\n"
+		"4:\n"
+		"	li %[r], %[e]\n"
+		"	jump 3b, %[t]\n"
+		"	.previous\n"
+		"	.section __ex_table,\"a\"\n"
+		"	.balign " RISCV_SZPTR "\n"
+		"	" RISCV_PTR " 1b, 4b\n"
+		"	" RISCV_PTR " 2b, 4b\n"
+		"	.previous"
+		: [r] "+r" (ret), [v] "=&r" (val),
+		  [u] "+A" (*uaddr), [t] "=&r" (tmp)
+		: [ov] "rJ" (oldval), [nv] "rJ" (newval), [e] "i" (-EFAULT)
+		: "memory");
+	__disable_user_access();
+
+	*uval = val;
+	return ret;
+}
+
+#endif /* __KERNEL__ */
+#endif /* _ASM_RISCV_FUTEX_H */
@@ -21,7 +21,42 @@
 
 #include <uapi/asm/hwcap.h>
 
+/*
+ * ISA extension numbers.  A single-letter extension takes the bit of its
+ * letter, so these line up with COMPAT_HWCAP_ISA_*; the multi-letter ones,
+ * parsed from the "_"-separated tail of riscv,isa, come after.  The same
+ * numbers name the features ALTERNATIVE() patches on, which is why they
+ * are plain defines usable from assembly.
+ */
+#define RISCV_ISA_EXT_a		('a' - 'a')
+#define RISCV_ISA_EXT_c		('c' - 'a')
+#define RISCV_ISA_EXT_d		('d' - 'a')
+#define RISCV_ISA_EXT_f		('f' - 'a')
+#define RISCV_ISA_EXT_h		('h' - 'a')
+#define RISCV_ISA_EXT_i		('i' - 'a')
+#define RISCV_ISA_EXT_m		('m' - 'a')
+#define RISCV_ISA_EXT_v		('v' - 'a')
+
+#define RISCV_ISA_EXT_BASE	26
+
+#define RISCV_ISA_EXT_SSTC	26
+#define RISCV_ISA_EXT_SVADU	27
+#define RISCV_ISA_EXT_ZBC	28
+#define RISCV_ISA_EXT_ZVKB	29
+#define RISCV_ISA_EXT_ZVKG	30
+#define RISCV_ISA_EXT_ZVKNED	31
+#define RISCV_ISA_EXT_ZVKNHA	32
+
+#define RISCV_ISA_EXT_MAX	64
+
 #ifndef __ASSEMBLY__
+
+#include <linux/bitmap.h>
+#include <linux/bug.h>
+#include <linux/cache.h>
+#include <linux/threads.h>
+#include <asm/alternative.h>
+
 /*
  * This yields a mask that user programs can use to figure out what
  * instruction set this cpu supports.
@@ -33,5 +68,64 @@ enum {
 };
 
 extern unsigned long elf_hwcap;
+
+struct riscv_isainfo {
+	DECLARE_BITMAP(isa, RISCV_ISA_EXT_MAX);
+};
+
+/* What each hart's riscv,isa lists, indexed by hart ID */
+extern struct riscv_isainfo riscv_hart_isa[NR_CPUS];
+
+/* The extensions every hart has: what the kernel and userspace may use */
+extern struct riscv_isainfo riscv_isa;
+
+static inline bool __riscv_isa_extension_available(const unsigned long *isa,
+						   unsigned int ext)
+{
+	if (WARN_ON_ONCE(ext >= RISCV_ISA_EXT_MAX))
+		return false;
+
+	return test_bit(ext, isa ? isa : riscv_isa.isa);
+}
+
+#define riscv_isa_extension_available(ext)				\
+	__riscv_isa_extension_available(NULL, ext)
+
+#define riscv_hart_isa_extension_available(hart, ext)			\
+	__riscv_isa_extension_available(riscv_hart_isa[hart].isa, ext)
+
+/*
+ * Hot-path feature tests: a single nop, or an unconditional jump, that is
+ * patched once at boot.  Until apply_boot_alternatives() has run they
+ * report every extension as missing, so code that runs that early must
+ * use riscv_isa_extension_available() instead.
+ */
+static __always_inline bool riscv_has_extension_likely(const unsigned int ext)
+{
+	asm_volatile_goto(
+		ALTERNATIVE("j	%l[l_no]", "nop", %[ext])
+		:
+		: [ext] "i" (ext)
+		:
+		: l_no);
+
+	return true;
+l_no:
+	return false;
+}
+
+static __always_inline bool riscv_has_extension_unlikely(const unsigned int ext)
+{
+	asm_volatile_goto(
+		ALTERNATIVE("nop", "j	%l[l_yes]", %[ext])
+		:
+		: [ext] "i" (ext)
+		:
+		: l_yes);
+
+	return false;
+l_yes:
+	return true;
+}
 #endif
 #endif
@@ -0,0 +1,66 @@
+/*
+ * Based on arch/arm64/include/asm/kasan.h
+ *
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#ifndef _ASM_RISCV_KASAN_H
+#define _ASM_RISCV_KASAN_H
+
+#ifndef __ASSEMBLY__
+
+#ifdef CONFIG_KASAN
+
+#include <linux/const.h>
+#include <linux/linkage.h>
+
+/*
+ * The shadow covers the whole kernel half of the address space and sits at
+ * its very bottom, below vmalloc.  With Sv39 and the usual PAGE_OFFSET of
+ * 0xffffffe000000000 the kernel half looks like:
+ *
+ *   0xffffffc000000000 - 0xffffffc800000000   KASAN shadow (32GiB)
+ *   0xffffffc800000000 - 0xffffffcf80000000   unused
+ *   0xffffffcf80000000 - 0xffffffd000000000   vmemmap (SPARSEMEM_VMEMMAP)
+ *   0xffffffd000000000 - 0xffffffdff8000000   vmalloc
+ *   0xffffffdff8000000 - 0xffffffe000000000   modules
+ *   0xffffffe000000000 - 0xffffffffffffffff   linear map
+ */
+
+/* Sv39 sign-extends bit 38, so the kernel half is the top 256GiB */
+#define KASAN_KERNEL_START	(-(_AC(1, UL) << 38))
+#define KASAN_SHADOW_SIZE	(-KASAN_KERNEL_START >> KASAN_SHADOW_SCALE_SHIFT)
+#define KASAN_SHADOW_START	KASAN_KERNEL_START
+#define KASAN_SHADOW_END	(KASAN_SHADOW_START + KASAN_SHADOW_SIZE)
+
+/*
+ * shadow_addr = (address >> 3) + KASAN_SHADOW_OFFSET, with the offset
+ * chosen so that the shadow of KASAN_KERNEL_START is KASAN_SHADOW_START.
+ * This has to agree with the -fasan-shadow-offset that arch/riscv/Makefile
+ * passes to the compiler.
+ */
+#define KASAN_SHADOW_OFFSET	\
+	(KASAN_SHADOW_END - (_AC(1, UL) << (64 - KASAN_SHADOW_SCALE_SHIFT)))
+
+asmlinkage void kasan_early_init(void);
+void kasan_init(void);
+
+#else /* !CONFIG_KASAN */
+
+static inline void kasan_early_init(void) { }
+static inline void kasan_init(void) { }
+
+#endif /* CONFIG_KASAN */
+
+#endif /* __ASSEMBLY__ */
+
+#endif /* _ASM_RISCV_KASAN_H */
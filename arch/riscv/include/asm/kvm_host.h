@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#ifndef _ASM_RISCV_KVM_HOST_H
+#define _ASM_RISCV_KVM_HOST_H
+
+#include <linux/types.h>
+#include <linux/kvm.h>
+#include <linux/kvm_types.h>
+#include <linux/hrtimer.h>
+#include <asm/csr.h>
+#include <asm/sbi.h>
+
+#define KVM_MAX_VCPUS			128
+#define KVM_USER_MEM_SLOTS		512
+#define KVM_HALT_POLL_NS_DEFAULT	500000
+
+#define KVM_REQ_SLEEP \
+	KVM_ARCH_REQ_FLAGS(0, KVM_REQUEST_WAIT | KVM_REQUEST_NO_WAKEUP)
+#define KVM_REQ_UPDATE_HGATP		KVM_ARCH_REQ(1)
+/* Remote fences from SBI wait until every target has left the guest */
+#define KVM_REQ_FENCE_I \
+	KVM_ARCH_REQ_FLAGS(2, KVM_REQUEST_WAIT | KVM_REQUEST_NO_WAKEUP)
+#define KVM_REQ_HFENCE_VVMA_ALL \
+	KVM_ARCH_REQ_FLAGS(3, KVM_REQUEST_WAIT | KVM_REQUEST_NO_WAKEUP)
+#define KVM_REQ_STEAL_UPDATE		KVM_ARCH_REQ(4)
+
+struct kvm_vm_stat {
+	ulong remote_tlb_flush;
+};
+
+struct kvm_vcpu_stat {
+	u64 halt_successful_poll;
+	u64 halt_attempted_poll;
+	u64 halt_poll_invalid;
+	u64 halt_wakeup;
+	u64 ecall_exit_stat;
+	u64 wfi_exit_stat;
+	u64 mmio_exit_user;
+	u64 mmio_exit_kernel;
+	u64 exits;
+};
+
+struct kvm_arch_memory_slot {
+};
+
+struct kvm_vmid {
+	/*
+	 * Writes to vmid_version and vmid happen with vmid_lock held
+	 * whereas reads happen without any lock held.
+	 */
+	unsigned long vmid_version;
+	unsigned long vmid;
+};
+
+struct kvm_arch {
+	/* G-stage VMID */
+	struct kvm_vmid vmid;
+
+	/* G-stage page table */
+	pgd_t *pgd;
+	phys_addr_t pgd_phys;
+
+	/* Guest time is host time plus this, programmed into htimedelta */
+	u64 time_delta;
+};
+
+struct kvm_mmio_decode {
+	/* Destination GPR of a load, and how far to sign-extend into it */
+	int reg;
+	int insn_len;
+	int len;
+	int shift;
+	int return_handled;
+};
+
+#define KVM_NR_MEM_OBJS     40
+
+/*
+ * Pages for G-stage page tables are allocated ahead of taking mmu_lock,
+ * so that faults never have to allocate with it held.
+ */
+struct kvm_mmu_memory_cache {
+	int nobjs;
+	void *objects[KVM_NR_MEM_OBJS];
+};
+
+/* Laid out like struct pt_regs, with zero standing in for the pc */
+struct kvm_cpu_context {
+	unsigned long zero;
+	unsigned long ra;
+	unsigned long sp;
+	unsigned long gp;
+	unsigned long tp;
+	unsigned long t0;
+	unsigned long t1;
+	unsigned long t2;
+	unsigned long s0;
+	unsigned long s1;
+	unsigned long a0;
+	unsigned long a1;
+	unsigned long a2;
+	unsigned long a3;
+	unsigned long a4;
+	unsigned long a5;
+	unsigned long a6;
+	unsigned long a7;
+	unsigned long s2;
+	unsigned long s3;
+	unsigned long s4;
+	unsigned long s5;
+	unsigned long s6;
+	unsigned long s7;
+	unsigned long s8;
+	unsigned long s9;
+	unsigned long s10;
+	unsigned long s11;
+	unsigned long t3;
+	unsigned long t4;
+	unsigned long t5;
+	unsigned long t6;
+	unsigned long sepc;
+	unsigned long sstatus;
+	unsigned long hstatus;
+	struct __riscv_d_ext_state fp;
+};
+
+/*
+ * Same order as struct kvm_riscv_csr, with hvip standing in for sip.
+ * scounteren isn't banked for VS-mode, so the world switch swaps it.
+ */
+struct kvm_vcpu_csr {
+	unsigned long vsstatus;
+	unsigned long vsie;
+	unsigned long vstvec;
+	unsigned long vsscratch;
+	unsigned long vsepc;
+	unsigned long vscause;
+	unsigned long vstval;
+	unsigned long hvip;
+	unsigned long vsatp;
+	unsigned long scounteren;
+};
+
+struct kvm_cpu_trap {
+	unsigned long sepc;
+	unsigned long scause;
+	unsigned long stval;
+	unsigned long htval;
+	unsigned long htinst;
+};
+
+/* The SBI timer of one vCPU, in guest time base cycles */
+struct kvm_vcpu_timer {
+	bool next_set;
+	u64 next_cycles;
+	struct hrtimer hrt;
+};
+
+/* The steal time record the guest registered through SBI, if any */
+struct kvm_vcpu_steal_time {
+	gpa_t gpa;
+	struct gfn_to_hva_cache cache;
+	struct sbi_steal_time st;
+	/* run_delay of the vCPU thread as of the last update */
+	u64 last_steal;
+};
+
+struct kvm_vcpu_arch {
+	/* Don't run the vCPU before userspace has had a chance to set it up */
+	bool ran_atleast_once;
+
+	/* Last host CPU on which the vCPU exited */
+	int last_exit_cpu;
+
+	/* Single-letter ISA extensions the guest sees */
+	unsigned long isa;
+
+	/* Host CSRs the world switch clobbers */
+	unsigned long host_sscratch;
+	unsigned long host_stvec;
+	unsigned long host_scounteren;
+
+	struct kvm_cpu_context host_context;
+	struct kvm_cpu_context guest_context;
+	struct kvm_vcpu_csr guest_csr;
+
+	/*
+	 * VS-level interrupts to deliver: bits in irqs_pending_mask say
+	 * which bits of irqs_pending changed since they were last folded
+	 * into hvip.  Both are updated atomically, from any context.
+	 */
+	unsigned long irqs_pending;
+	unsigned long irqs_pending_mask;
+
+	struct kvm_vcpu_timer timer;
+
+	struct kvm_vcpu_steal_time steal_time;
+
+	/* MMIO access the guest is waiting on userspace for */
+	struct kvm_mmio_decode mmio_decode;
+
+	/* SBI call forwarded to userspace */
+	bool sbi_pending;
+
+	struct kvm_mmu_memory_cache mmu_page_cache;
+
+	/* Stopped through KVM_SET_MP_STATE */
+	bool power_off;
+};
+
+static inline void kvm_arch_hardware_unsetup(void) {}
+static inline void kvm_arch_sync_events(struct kvm *kvm) {}
+static inline void kvm_arch_vcpu_uninit(struct kvm_vcpu *vcpu) {}
+static inline void kvm_arch_sched_in(struct kvm_vcpu *vcpu, int cpu) {}
+static inline void kvm_arch_vcpu_block_finish(struct kvm_vcpu *vcpu) {}
+
+#define KVM_ARCH_WANT_MMU_NOTIFIER
+int kvm_unmap_hva(struct kvm *kvm, unsigned long hva);
+int kvm_unmap_hva_range(struct kvm *kvm,
+			unsigned long start, unsigned long end);
+void kvm_set_spte_hva(struct kvm *kvm, unsigned long hva, pte_t pte);
+int kvm_age_hva(struct kvm *kvm, unsigned long start, unsigned long end);
+int kvm_test_age_hva(struct kvm *kvm, unsigned long hva);
+
+static inline void kvm_arch_mmu_notifier_invalidate_page(struct kvm *kvm,
+							 unsigned long address)
+{
+}
+
+void __kvm_riscv_hfence_gvma_vmid_gpa(unsigned long gpa, unsigned long vmid);
+void __kvm_riscv_hfence_gvma_vmid(unsigned long vmid);
+void __kvm_riscv_hfence_gvma_all(void);
+void __kvm_riscv_hfence_vvma_all(void);
+
+int kvm_riscv_stage2_map(struct kvm_vcpu *vcpu,
+			 struct kvm_memory_slot *memslot,
+			 gpa_t gpa, unsigned long hva, bool is_write);
+int kvm_riscv_stage2_alloc_pgd(struct kvm *kvm);
+void kvm_riscv_stage2_free_pgd(struct kvm *kvm);
+void kvm_riscv_stage2_update_hgatp(struct kvm_vcpu *vcpu);
+int kvm_riscv_stage2_mode_detect(void);
+void kvm_mmu_free_memory_caches(struct kvm_vcpu *vcpu);
+
+void kvm_riscv_stage2_vmid_detect(void);
+unsigned long kvm_riscv_stage2_vmid_bits(void);
+int kvm_riscv_stage2_vmid_init(struct kvm *kvm);
+bool kvm_riscv_stage2_vmid_ver_changed(struct kvm_vmid *vmid);
+void kvm_riscv_stage2_vmid_update(struct kvm_vcpu *vcpu);
+
+void __kvm_riscv_unpriv_trap(void);
+unsigned long kvm_riscv_vcpu_unpriv_read(struct kvm_vcpu *vcpu,
+					 bool read_insn,
+					 unsigned long guest_addr,
+					 struct kvm_cpu_trap *trap);
+void kvm_riscv_vcpu_trap_redirect(struct kvm_vcpu *vcpu,
+				  struct kvm_cpu_trap *trap);
+int kvm_riscv_vcpu_mmio_return(struct kvm_vcpu *vcpu, struct kvm_run *run);
+int kvm_riscv_vcpu_exit(struct kvm_vcpu *vcpu, struct kvm_run *run,
+			struct kvm_cpu_trap *trap);
+
+void __kvm_riscv_switch_to(struct kvm_vcpu_arch *vcpu_arch);
+void __kvm_riscv_fp_save(struct kvm_cpu_context *context);
+void __kvm_riscv_fp_restore(struct kvm_cpu_context *context);
+
+int kvm_riscv_vcpu_set_interrupt(struct kvm_vcpu *vcpu, unsigned int irq);
+int kvm_riscv_vcpu_unset_interrupt(struct kvm_vcpu *vcpu, unsigned int irq);
+void kvm_riscv_vcpu_flush_interrupts(struct kvm_vcpu *vcpu);
+void kvm_riscv_vcpu_sync_interrupts(struct kvm_vcpu *vcpu);
+bool kvm_riscv_vcpu_has_interrupts(struct kvm_vcpu *vcpu, unsigned long mask);
+
+void kvm_riscv_guest_timer_init(void);
+int kvm_riscv_vcpu_timer_init(struct kvm_vcpu *vcpu);
+void kvm_riscv_vcpu_timer_deinit(struct kvm_vcpu *vcpu);
+int kvm_riscv_vcpu_timer_next_event(struct kvm_vcpu *vcpu, u64 ncycles);
+void kvm_riscv_vcpu_timer_restore(struct kvm_vcpu *vcpu);
+int kvm_riscv_vcpu_get_reg_timer(struct kvm_vcpu *vcpu,
+				 const struct kvm_one_reg *reg);
+int kvm_riscv_vcpu_set_reg_timer(struct kvm_vcpu *vcpu,
+				 const struct kvm_one_reg *reg);
+
+int kvm_riscv_vcpu_sbi_return(struct kvm_vcpu *vcpu, struct kvm_run *run);
+int kvm_riscv_vcpu_sbi_ecall(struct kvm_vcpu *vcpu, struct kvm_run *run);
+void kvm_riscv_vcpu_record_steal_time(struct kvm_vcpu *vcpu);
+void kvm_riscv_vcpu_set_preempted(struct kvm_vcpu *vcpu);
+
+#endif /* _ASM_RISCV_KVM_HOST_H */
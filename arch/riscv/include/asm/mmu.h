@@ -17,8 +17,17 @@
 
 #ifndef __ASSEMBLY__
 
+#include <linux/atomic.h>
+#include <linux/cpumask.h>
+
 typedef struct {
+	/* ASID in the low SPTBR_ASID_BITS, allocator generation above */
+	atomic_long_t id;
 	void *vdso;
+#ifdef CONFIG_SMP
+	/* A local icache flush is needed before scheduling this MM */
+	cpumask_t icache_stale_mask;
+#endif
 } mm_context_t;
 
 #endif /* __ASSEMBLY__ */
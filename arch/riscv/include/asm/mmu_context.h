@@ -19,6 +19,7 @@
 #include <linux/mm.h>
 #include <linux/sched.h>
 #include <asm/tlbflush.h>
+#include <asm/cacheflush.h>
 
 static inline void enter_lazy_tlb(struct mm_struct *mm,
 	struct task_struct *task)
@@ -29,6 +30,7 @@ static inline void enter_lazy_tlb(struct mm_struct *mm,
 static inline int init_new_context(struct task_struct *task,
 	struct mm_struct *mm)
 {
+	atomic_long_set(&mm->context.id, 0);
 	return 0;
 }
 
@@ -41,20 +43,102 @@ static inline pgd_t *current_pgdir(void)
 	return pfn_to_virt(csr_read(sptbr) & SPTBR_PPN);
 }
 
-static inline void set_pgdir(pgd_t *pgd)
+static inline void set_pgdir(pgd_t *pgd, unsigned long asid)
 {
-	csr_write(sptbr, virt_to_pfn(pgd) | SPTBR_MODE);
+	csr_write(sptbr, virt_to_pfn(pgd) | SPTBR_MODE |
+		  ((asid & SPTBR_ASID_MASK) << SPTBR_ASID_SHIFT));
+}
+
+/* True once the ASID allocator has been set up on this system */
+extern bool use_asid_allocator;
+/* Mask to extract the hardware ASID from mm->context.id */
+extern unsigned long asid_mask;
+
+static inline unsigned long mm_context_asid(struct mm_struct *mm)
+{
+	return atomic_long_read(&mm->context.id) & asid_mask;
+}
+
+/*
+ * Load next's page table with an ASID from the current generation,
+ * allocating a new one (and rolling the generation over if needed) when
+ * the mm's ASID is stale.  Defined in arch/riscv/mm/context.c.
+ */
+void check_and_switch_context(struct mm_struct *mm, unsigned int cpu);
+
+#ifdef CONFIG_SMP
+/* The mm most recently loaded into each hart's sptbr */
+DECLARE_PER_CPU(struct mm_struct *, riscv_loaded_mm);
+#endif
+
+/*
+ * flush_icache_mm() only fences the harts that are running mm right now;
+ * everyone else is marked stale and catches up here, the next time it
+ * switches to mm.
+ */
+static inline void flush_icache_deferred(struct mm_struct *mm,
+	unsigned int cpu)
+{
+#ifdef CONFIG_SMP
+	cpumask_t *mask = &mm->context.icache_stale_mask;
+
+	/*
+	 * Publish that this hart runs mm before looking at the stale mask.
+	 * Pairs with the smp_mb() in flush_icache_mm(): either it sees us
+	 * in riscv_loaded_mm and fences us, or we see our stale bit here.
+	 */
+	per_cpu(riscv_loaded_mm, cpu) = mm;
+	smp_mb();
+
+	if (cpumask_test_cpu(cpu, mask)) {
+		cpumask_clear_cpu(cpu, mask);
+		local_flush_icache_all();
+	}
+#endif
 }
 
 static inline void switch_mm(struct mm_struct *prev,
 	struct mm_struct *next, struct task_struct *task)
 {
+	unsigned int cpu = smp_processor_id();
+
 	if (likely(prev != next)) {
-		set_pgdir(next->pgd);
-		local_flush_tlb_all();
+		/*
+		 * Record that this hart may now hold TLB entries for next.
+		 * The bit is never cleared: with ASIDs the entries survive
+		 * switching away, so remote flushes must keep targeting us.
+		 */
+		cpumask_set_cpu(cpu, mm_cpumask(next));
+		check_and_switch_context(next, cpu);
+		/*
+		 * The smp_mb() in here is also the full barrier after the
+		 * rq->curr update that membarrier needs on SMP, since our
+		 * spin_unlock() is only a release.  Switching in from a lazy
+		 * kernel thread without an mm change gets it from mmdrop().
+		 */
+		flush_icache_deferred(next, cpu);
+		return;
 	}
+
+#ifdef CONFIG_SMP
+	/*
+	 * A thread of mm may have flushed only for itself on another hart
+	 * and moved here since.  The rq locks order its marking of the stale
+	 * mask before this.
+	 */
+	if (cpumask_test_cpu(cpu, &next->context.icache_stale_mask)) {
+		cpumask_clear_cpu(cpu, &next->context.icache_stale_mask);
+		local_flush_icache_all();
+	}
+#endif
 }
 
+/*
+ * A hart's bit is set above before it first runs a task of the mm and is
+ * never cleared, so membarrier only needs to look at those harts.
+ */
+#define membarrier_mm_cpumask(mm)	mm_cpumask(mm)
+
 static inline void activate_mm(struct mm_struct *prev,
 			       struct mm_struct *next)
 {
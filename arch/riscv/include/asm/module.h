@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#ifndef _ASM_RISCV_MODULE_H
+#define _ASM_RISCV_MODULE_H
+
+#include <asm-generic/module.h>
+
+/* A section the loader grows to hold PLT or GOT entries */
+struct mod_section {
+	Elf_Shdr	*shdr;
+	int		num_entries;
+	int		max_entries;
+};
+
+struct mod_arch_specific {
+	struct mod_section	plt;
+	struct mod_section	got;
+};
+
+unsigned long module_emit_plt_entry(struct module *mod, unsigned long val);
+unsigned long module_emit_got_entry(struct module *mod, unsigned long val);
+
+#endif /* _ASM_RISCV_MODULE_H */
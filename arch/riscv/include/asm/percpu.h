@@ -0,0 +1,178 @@
+/*
+ * Based on arch/arm64/include/asm/percpu.h
+ *
+ * Copyright (C) 2013 ARM Ltd.
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#ifndef _ASM_RISCV_PERCPU_H
+#define _ASM_RISCV_PERCPU_H
+
+#include <linux/types.h>
+
+/*
+ * The generic this_cpu ops disable interrupts around a load and a store.
+ * A single AMO (or an LR/SC pair, whose reservation an interrupt breaks)
+ * can't be torn by an interrupt, so all they need is to stay on one hart
+ * between computing the address and touching it.  There's no spare
+ * register to hold the per-cpu offset: tp is current, and the offset is
+ * found through its thread_info->cpu as in the generic code.
+ *
+ * The AMOs have no ordering bits since this_cpu ops are unordered.  Only
+ * the 4- and 8-byte sizes have AMOs, so the others stay generic.  LR.W
+ * sign-extends, hence the signed comparison value in cmpxchg.
+ */
+#define PERCPU_OP(op, asm_op, sz, asm_type)				\
+static inline void __percpu_##op##_##sz(void *ptr, unsigned long val)	\
+{									\
+	__asm__ __volatile__ (						\
+		"amo" #asm_op "." #asm_type " zero, %1, %0"		\
+		: "+A" (*(u##sz *)ptr)					\
+		: "r" (val)						\
+		: "memory");						\
+}
+
+#define PERCPU_RET_OP(op, asm_op, c_op, sz, asm_type)			\
+static inline u##sz __percpu_##op##_return_##sz(void *ptr,		\
+						unsigned long val)	\
+{									\
+	u##sz ret;							\
+									\
+	__asm__ __volatile__ (						\
+		"amo" #asm_op "." #asm_type " %1, %2, %0"		\
+		: "+A" (*(u##sz *)ptr), "=r" (ret)			\
+		: "r" (val)						\
+		: "memory");						\
+	return ret c_op val;						\
+}
+
+#define PERCPU_XCHG_OP(sz, asm_type)					\
+static inline u##sz __percpu_xchg_##sz(void *ptr, unsigned long val)	\
+{									\
+	u##sz ret;							\
+									\
+	__asm__ __volatile__ (						\
+		"amoswap." #asm_type " %1, %2, %0"			\
+		: "+A" (*(u##sz *)ptr), "=r" (ret)			\
+		: "r" (val)						\
+		: "memory");						\
+	return ret;							\
+}
+
+#define PERCPU_CMPXCHG_OP(sz, asm_type)					\
+static inline u##sz __percpu_cmpxchg_##sz(void *ptr, unsigned long old,	\
+					  unsigned long new)		\
+{									\
+	u##sz ret;							\
+	unsigned int rc;						\
+									\
+	__asm__ __volatile__ (						\
+	"0:"								\
+		"lr." #asm_type " %0, %2\n"				\
+		"bne         %0, %z3, 1f\n"				\
+		"sc." #asm_type " %1, %z4, %2\n"			\
+		"bnez        %1, 0b\n"					\
+	"1:"								\
+		: "=&r" (ret), "=&r" (rc), "+A" (*(u##sz *)ptr)		\
+		: "rJ" ((s##sz)old), "rJ" (new)				\
+		: "memory");						\
+	return ret;							\
+}
+
+#define PERCPU_OPS(sz, asm_type)					\
+	PERCPU_OP(add, add, sz, asm_type)				\
+	PERCPU_OP(and, and, sz, asm_type)				\
+	PERCPU_OP(or,  or,  sz, asm_type)				\
+	PERCPU_RET_OP(add, add, +, sz, asm_type)			\
+	PERCPU_XCHG_OP(sz, asm_type)					\
+	PERCPU_CMPXCHG_OP(sz, asm_type)
+
+PERCPU_OPS(32, w)
+#ifdef CONFIG_64BIT
+PERCPU_OPS(64, d)
+#endif
+
+#undef PERCPU_OPS
+#undef PERCPU_CMPXCHG_OP
+#undef PERCPU_XCHG_OP
+#undef PERCPU_RET_OP
+#undef PERCPU_OP
+
+#define _pcp_protect(op, pcp, args...)					\
+do {									\
+	preempt_disable_notrace();					\
+	op(raw_cpu_ptr(&(pcp)), ##args);				\
+	preempt_enable_notrace();					\
+} while (0)
+
+#define _pcp_protect_return(op, pcp, args...)				\
+({									\
+	typeof(pcp) __retval;						\
+	preempt_disable_notrace();					\
+	__retval = (typeof(pcp))op(raw_cpu_ptr(&(pcp)), ##args);	\
+	preempt_enable_notrace();					\
+	__retval;							\
+})
+
+#define _percpu_read(pcp)						\
+({									\
+	typeof(pcp) __retval;						\
+	preempt_disable_notrace();					\
+	__retval = READ_ONCE(*raw_cpu_ptr(&(pcp)));			\
+	preempt_enable_notrace();					\
+	__retval;							\
+})
+
+#define _percpu_write(pcp, val)						\
+do {									\
+	preempt_disable_notrace();					\
+	WRITE_ONCE(*raw_cpu_ptr(&(pcp)), (val));			\
+	preempt_enable_notrace();					\
+} while (0)
+
+#define this_cpu_read_4(pcp)		_percpu_read(pcp)
+#define this_cpu_write_4(pcp, val)	_percpu_write(pcp, val)
+#define this_cpu_add_4(pcp, val)					\
+	_pcp_protect(__percpu_add_32, pcp, (unsigned long)(val))
+#define this_cpu_and_4(pcp, val)					\
+	_pcp_protect(__percpu_and_32, pcp, (unsigned long)(val))
+#define this_cpu_or_4(pcp, val)						\
+	_pcp_protect(__percpu_or_32, pcp, (unsigned long)(val))
+#define this_cpu_add_return_4(pcp, val)					\
+	_pcp_protect_return(__percpu_add_return_32, pcp, (unsigned long)(val))
+#define this_cpu_xchg_4(pcp, val)					\
+	_pcp_protect_return(__percpu_xchg_32, pcp, (unsigned long)(val))
+#define this_cpu_cmpxchg_4(pcp, o, n)					\
+	_pcp_protect_return(__percpu_cmpxchg_32, pcp,			\
+			    (unsigned long)(o), (unsigned long)(n))
+
+#ifdef CONFIG_64BIT
+#define this_cpu_read_8(pcp)		_percpu_read(pcp)
+#define this_cpu_write_8(pcp, val)	_percpu_write(pcp, val)
+#define this_cpu_add_8(pcp, val)					\
+	_pcp_protect(__percpu_add_64, pcp, (unsigned long)(val))
+#define this_cpu_and_8(pcp, val)					\
+	_pcp_protect(__percpu_and_64, pcp, (unsigned long)(val))
+#define this_cpu_or_8(pcp, val)						\
+	_pcp_protect(__percpu_or_64, pcp, (unsigned long)(val))
+#define this_cpu_add_return_8(pcp, val)					\
+	_pcp_protect_return(__percpu_add_return_64, pcp, (unsigned long)(val))
+#define this_cpu_xchg_8(pcp, val)					\
+	_pcp_protect_return(__percpu_xchg_64, pcp, (unsigned long)(val))
+#define this_cpu_cmpxchg_8(pcp, o, n)					\
+	_pcp_protect_return(__percpu_cmpxchg_64, pcp,			\
+			    (unsigned long)(o), (unsigned long)(n))
+#endif
+
+#include <asm-generic/percpu.h>
+
+#endif /* _ASM_RISCV_PERCPU_H */
@@ -28,13 +28,25 @@
 #define _PAGE_EXEC      (1 << 3)    /* Executable */
 #define _PAGE_USER      (1 << 4)    /* User */
 #define _PAGE_GLOBAL    (1 << 5)    /* Global */
-#define _PAGE_ACCESSED  (1 << 6)    /* Set by hardware on any access */
-#define _PAGE_DIRTY     (1 << 7)    /* Set by hardware on any write */
+/*
+ * Hardware that implements Svadu sets A and D itself; elsewhere an access
+ * with A clear, or a store with D clear, takes a page fault and the
+ * kernel sets them.  See riscv_setup_ad_mode().
+ */
+#define _PAGE_ACCESSED  (1 << 6)    /* Set on any access */
+#define _PAGE_DIRTY     (1 << 7)    /* Set on any write */
 #define _PAGE_SOFT      (1 << 8)    /* Reserved for software */
 
 #define _PAGE_SPECIAL   _PAGE_SOFT
 #define _PAGE_TABLE     _PAGE_PRESENT
 
+/*
+ * An entry with any of R, W or X set is a leaf; at the PMD/PGD level that
+ * makes it a megapage/gigapage mapping rather than a pointer to the next
+ * level of the table.
+ */
+#define _PAGE_LEAF      (_PAGE_READ | _PAGE_WRITE | _PAGE_EXEC)
+
 #define _PAGE_PFN_SHIFT 10
 
 /* Set of bits to preserve across pte_modify() */
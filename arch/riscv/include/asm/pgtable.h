@@ -15,6 +15,7 @@
 #define _ASM_RISCV_PGTABLE_H
 
 #include <linux/mmzone.h>
+#include <linux/sizes.h>
 
 #include <asm/pgtable-bits.h>
 
@@ -100,7 +101,12 @@ extern unsigned long empty_zero_page[PAGE_SIZE / sizeof(unsigned long)];
 
 static inline int pmd_present(pmd_t pmd)
 {
-	return (pmd_val(pmd) & _PAGE_PRESENT);
+	/*
+	 * A huge PMD that pmdp_invalidate() has made invalid for the
+	 * hardware still has its R/W/X bits and must keep looking present
+	 * to the THP code while it is being split.
+	 */
+	return (pmd_val(pmd) & (_PAGE_PRESENT | _PAGE_LEAF));
 }
 
 static inline int pmd_none(pmd_t pmd)
@@ -108,9 +114,14 @@ static inline int pmd_none(pmd_t pmd)
 	return (pmd_val(pmd) == 0);
 }
 
+static inline int pmd_leaf(pmd_t pmd)
+{
+	return pmd_present(pmd) && (pmd_val(pmd) & _PAGE_LEAF);
+}
+
 static inline int pmd_bad(pmd_t pmd)
 {
-	return !pmd_present(pmd);
+	return !pmd_present(pmd) || pmd_leaf(pmd);
 }
 
 static inline void set_pmd(pmd_t *pmdp, pmd_t pmd)
@@ -188,18 +199,6 @@ static inline void set_pte(pte_t *ptep, pte_t pteval)
 	*ptep = pteval;
 }
 
-static inline void set_pte_at(struct mm_struct *mm,
-	unsigned long addr, pte_t *ptep, pte_t pteval)
-{
-	set_pte(ptep, pteval);
-}
-
-static inline void pte_clear(struct mm_struct *mm,
-	unsigned long addr, pte_t *ptep)
-{
-	set_pte_at(mm, addr, ptep, __pte(0));
-}
-
 static inline int pte_present(pte_t pte)
 {
 	return (pte_val(pte) & _PAGE_PRESENT);
@@ -223,7 +222,10 @@ static inline int pte_huge(pte_t pte)
 		&& (pte_val(pte) & (_PAGE_READ | _PAGE_WRITE | _PAGE_EXEC));
 }
 
-/* static inline int pte_exec(pte_t pte) */
+static inline int pte_exec(pte_t pte)
+{
+	return pte_val(pte) & _PAGE_EXEC;
+}
 
 static inline int pte_dirty(pte_t pte)
 {
@@ -240,6 +242,29 @@ static inline int pte_special(pte_t pte)
 	return pte_val(pte) & _PAGE_SPECIAL;
 }
 
+void flush_icache_pte(pte_t pte);
+
+static inline void set_pte_at(struct mm_struct *mm,
+	unsigned long addr, pte_t *ptep, pte_t pteval)
+{
+	/*
+	 * Make sure instruction fetches see what was written through the
+	 * data side before the page was mapped executable.  This only
+	 * costs a fence.i the first time the page is mapped exec after it
+	 * was last written, see flush_icache_pte().
+	 */
+	if (pte_present(pteval) && pte_exec(pteval))
+		flush_icache_pte(pteval);
+
+	set_pte(ptep, pteval);
+}
+
+static inline void pte_clear(struct mm_struct *mm,
+	unsigned long addr, pte_t *ptep)
+{
+	set_pte_at(mm, addr, ptep, __pte(0));
+}
+
 /* static inline pte_t pte_rdprotect(pte_t pte) */
 
 static inline pte_t pte_wrprotect(pte_t pte)
@@ -342,6 +367,31 @@ static inline int ptep_test_and_clear_young(struct vm_area_struct *vma,
 	return test_and_clear_bit(_PAGE_ACCESSED_OFFSET, &pte_val(*ptep));
 }
 
+/*
+ * Harvest and clear the accessed bits of nr consecutive PTEs of one page
+ * table, for reclaim scans that would otherwise go through
+ * ptep_clear_flush_young() one entry at a time.  Entries that are already
+ * old, the common case under memory pressure, cost no AMO.  Bit i of young,
+ * which the caller clears, is set if entry i was young; returns how many
+ * were.  As for a single entry, the TLB is not flushed.
+ */
+static inline unsigned int ptep_test_and_clear_young_batch(
+	struct vm_area_struct *vma, unsigned long address, pte_t *ptep,
+	unsigned int nr, unsigned long *young)
+{
+	unsigned int i, count = 0;
+
+	for (i = 0; i < nr; i++, address += PAGE_SIZE) {
+		if (ptep_test_and_clear_young(vma, address, ptep + i)) {
+			__set_bit(i, young);
+			count++;
+		}
+	}
+	return count;
+}
+
+extern void riscv_setup_ad_mode(void);
+
 #define __HAVE_ARCH_PTEP_SET_WRPROTECT
 static inline void ptep_set_wrprotect(struct mm_struct *mm,
 				      unsigned long address, pte_t *ptep)
@@ -371,6 +421,113 @@ static inline int ptep_clear_flush_young(struct vm_area_struct *vma,
 	return ptep_test_and_clear_young(vma, address, ptep);
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * A huge PMD has exactly the layout of a leaf PTE, so the PMD accessors
+ * are thin wrappers around the PTE ones.
+ */
+static inline pte_t pmd_pte(pmd_t pmd)
+{
+	return __pte(pmd_val(pmd));
+}
+
+static inline pmd_t pte_pmd(pte_t pte)
+{
+	return __pmd(pte_val(pte));
+}
+
+static inline int pmd_trans_huge(pmd_t pmd)
+{
+	return pmd_leaf(pmd);
+}
+
+#define pmd_write(pmd)		pte_write(pmd_pte(pmd))
+#define pmd_dirty(pmd)		pte_dirty(pmd_pte(pmd))
+#define pmd_young(pmd)		pte_young(pmd_pte(pmd))
+#define pmd_pfn(pmd)		pte_pfn(pmd_pte(pmd))
+
+#define pmd_wrprotect(pmd)	pte_pmd(pte_wrprotect(pmd_pte(pmd)))
+#define pmd_mkwrite(pmd)	pte_pmd(pte_mkwrite(pmd_pte(pmd)))
+#define pmd_mkdirty(pmd)	pte_pmd(pte_mkdirty(pmd_pte(pmd)))
+#define pmd_mkclean(pmd)	pte_pmd(pte_mkclean(pmd_pte(pmd)))
+#define pmd_mkyoung(pmd)	pte_pmd(pte_mkyoung(pmd_pte(pmd)))
+#define pmd_mkold(pmd)		pte_pmd(pte_mkold(pmd_pte(pmd)))
+
+/* The protection bits passed in already make the entry a leaf. */
+static inline pmd_t pmd_mkhuge(pmd_t pmd)
+{
+	return pmd;
+}
+
+static inline pmd_t pmd_mknotpresent(pmd_t pmd)
+{
+	return __pmd(pmd_val(pmd) & ~_PAGE_PRESENT);
+}
+
+static inline pmd_t pmd_modify(pmd_t pmd, pgprot_t newprot)
+{
+	return pte_pmd(pte_modify(pmd_pte(pmd), newprot));
+}
+
+#define mk_pmd(page, prot)	pfn_pmd(page_to_pfn(page), (prot))
+
+static inline void set_pmd_at(struct mm_struct *mm, unsigned long addr,
+			      pmd_t *pmdp, pmd_t pmd)
+{
+	set_pte_at(mm, addr, (pte_t *)pmdp, pmd_pte(pmd));
+}
+
+static inline int has_transparent_hugepage(void)
+{
+	return 1;
+}
+
+static inline void update_mmu_cache_pmd(struct vm_area_struct *vma,
+	unsigned long address, pmd_t *pmdp)
+{
+	update_mmu_cache(vma, address, (pte_t *)pmdp);
+}
+
+/*
+ * One sfence.vma on any address inside a megapage drops its leaf entry, so
+ * there is no reason to walk (or give up on) the whole 2MiB range.
+ */
+#define __HAVE_ARCH_FLUSH_PMD_TLB_RANGE
+#define flush_pmd_tlb_range(vma, addr, end)	flush_tlb_page((vma), (addr))
+
+#define __HAVE_ARCH_PMDP_SET_ACCESS_FLAGS
+static inline int pmdp_set_access_flags(struct vm_area_struct *vma,
+					unsigned long address, pmd_t *pmdp,
+					pmd_t entry, int dirty)
+{
+	return ptep_set_access_flags(vma, address, (pte_t *)pmdp,
+				     pmd_pte(entry), dirty);
+}
+
+#define __HAVE_ARCH_PMDP_TEST_AND_CLEAR_YOUNG
+static inline int pmdp_test_and_clear_young(struct vm_area_struct *vma,
+					    unsigned long address,
+					    pmd_t *pmdp)
+{
+	return ptep_test_and_clear_young(vma, address, (pte_t *)pmdp);
+}
+
+#define __HAVE_ARCH_PMDP_HUGE_GET_AND_CLEAR
+static inline pmd_t pmdp_huge_get_and_clear(struct mm_struct *mm,
+					    unsigned long address,
+					    pmd_t *pmdp)
+{
+	return pte_pmd(ptep_get_and_clear(mm, address, (pte_t *)pmdp));
+}
+
+#define __HAVE_ARCH_PMDP_SET_WRPROTECT
+static inline void pmdp_set_wrprotect(struct mm_struct *mm,
+				      unsigned long address, pmd_t *pmdp)
+{
+	ptep_set_wrprotect(mm, address, (pte_t *)pmdp);
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 /*
  * Encode and decode a swap entry
  *
@@ -396,9 +553,7 @@ static inline int ptep_clear_flush_young(struct vm_area_struct *vma,
 #define __pte_to_swp_entry(pte)	((swp_entry_t) { pte_val(pte) })
 #define __swp_entry_to_pte(x)	((pte_t) { (x).val })
 
-#ifdef CONFIG_FLATMEM
 #define kern_addr_valid(addr)   (1) /* FIXME */
-#endif
 
 extern void paging_init(void);
 
@@ -410,9 +565,34 @@ static inline void pgtable_cache_init(void)
 #endif /* CONFIG_MMU */
 
 #define VMALLOC_SIZE     (KERN_VIRT_SIZE >> 1)
-#define VMALLOC_END      (PAGE_OFFSET - 1)
 #define VMALLOC_START    (PAGE_OFFSET - VMALLOC_SIZE)
 
+#ifdef CONFIG_KASAN
+/*
+ * KASAN must back module allocations with real shadow, which it maps with
+ * kasan_module_alloc().  Give modules a window of their own just below the
+ * linear map so that the rest of the vmalloc shadow can stay zero-mapped.
+ */
+#define MODULES_END      PAGE_OFFSET
+#define MODULES_VADDR    (MODULES_END - SZ_128M)
+#define VMALLOC_END      (MODULES_VADDR - 1)
+#else
+#define VMALLOC_END      (PAGE_OFFSET - 1)
+#endif
+
+#ifdef CONFIG_SPARSEMEM_VMEMMAP
+/*
+ * The struct page array sits right below vmalloc and is sized for the
+ * whole linear map.  It is indexed from pfn_base, the first page of DRAM,
+ * the same way ARCH_PFN_OFFSET is for FLATMEM.
+ */
+#define STRUCT_PAGE_MAX_SHIFT	6
+#define VMEMMAP_SIZE	((KERN_VIRT_SIZE >> PAGE_SHIFT) << STRUCT_PAGE_MAX_SHIFT)
+#define VMEMMAP_END	VMALLOC_START
+#define VMEMMAP_START	(VMEMMAP_END - VMEMMAP_SIZE)
+#define vmemmap		((struct page *)VMEMMAP_START - pfn_base)
+#endif /* CONFIG_SPARSEMEM_VMEMMAP */
+
 /*
  * Task size is 0x40000000000 for RV64 or 0xb800000 for RV32.
  * Note that PGDIR_SIZE must evenly divide TASK_SIZE.
@@ -0,0 +1,50 @@
+/*
+ * Based on arch/arm64/include/asm/probes.h
+ *
+ * Copyright (C) 2013 Linaro Limited
+ * Copyright (C) 2017 SiFive
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef _ASM_RISCV_PROBES_H
+#define _ASM_RISCV_PROBES_H
+
+#include <linux/types.h>
+
+/* Breakpoints used by kprobes and uprobes, also what BUG() expands to */
+#define RISCV_INSN_EBREAK	0x00100073U
+#define RISCV_INSN_C_EBREAK	0x9002U
+
+/* The two low bits of an instruction tell 16-bit ones from 32-bit ones */
+#define RISCV_INSN_LEN(insn)	((((insn) & 0x3) == 0x3) ? 4 : 2)
+
+struct pt_regs;
+
+typedef u32 probe_opcode_t;
+typedef void (probes_handler_t) (u32 opcode, unsigned long addr,
+				 struct pt_regs *);
+
+/* architecture specific copy of original instruction */
+struct arch_probe_insn {
+	probe_opcode_t *insn;
+	probes_handler_t *handler;
+	/* restore address after step xol */
+	unsigned long restore;
+};
+
+#ifdef CONFIG_KPROBES
+typedef u32 kprobe_opcode_t;
+struct arch_specific_insn {
+	struct arch_probe_insn api;
+};
+#endif
+
+#endif /* _ASM_RISCV_PROBES_H */
@@ -46,6 +46,10 @@ struct thread_struct {
 	unsigned long sp;	/* Kernel mode stack */
 	unsigned long s[12];	/* s[0]: frame pointer */
 	struct __riscv_d_ext_state fstate;
+	struct __riscv_v_ext_state vstate;
+	unsigned long bad_cause;	/* scause of the last user trap */
+	u8 fpu_counter;		/* consecutive time slices using the FPU */
+	u8 fstate_used;		/* fstate is no longer the all-zero reset state */
 };
 
 #define INIT_THREAD {					\
@@ -15,6 +15,7 @@
 #define _ASM_RISCV_SBI_H
 
 #include <linux/types.h>
+#include <asm/page.h>
 
 #define SBI_SET_TIMER 0
 #define SBI_CONSOLE_PUTCHAR 1
@@ -28,29 +29,52 @@
 #define SBI_DISK_READ 9
 #define SBI_DISK_WRITE 10
 #define SBI_DISK_SIZE 11
-
-#define SBI_CALL(which, arg0, arg1, arg2) ({			\
+#define SBI_DISK_NQUEUES 12
+#define SBI_DISK_SUBMIT 13
+#define SBI_DISK_COMPLETE 14
+#define SBI_CONSOLE_WRITE 15
+#define SBI_HART_SUSPEND 16
+#define SBI_STEAL_TIME 17
+#define SBI_CPUFREQ_SET 18
+#define SBI_CPUFREQ_GET 19
+
+#define SBI_CALL(which, arg0, arg1, arg2, arg3) ({		\
 	register uintptr_t a0 asm ("a0") = (uintptr_t)(arg0);	\
 	register uintptr_t a1 asm ("a1") = (uintptr_t)(arg1);	\
 	register uintptr_t a2 asm ("a2") = (uintptr_t)(arg2);	\
+	register uintptr_t a3 asm ("a3") = (uintptr_t)(arg3);	\
 	register uintptr_t a7 asm ("a7") = (uintptr_t)(which);	\
 	asm volatile ("ecall"					\
 		      : "+r" (a0)				\
-		      : "r" (a1), "r" (a2), "r" (a7)		\
+		      : "r" (a1), "r" (a2), "r" (a3), "r" (a7)	\
 		      : "memory");				\
 	a0;							\
 })
 
 /* Lazy implementations until SBI is finalized */
-#define SBI_CALL_0(which) SBI_CALL(which, 0, 0, 0)
-#define SBI_CALL_1(which, arg0) SBI_CALL(which, arg0, 0, 0)
-#define SBI_CALL_2(which, arg0, arg1) SBI_CALL(which, arg0, arg1, 0)
+#define SBI_CALL_0(which) SBI_CALL(which, 0, 0, 0, 0)
+#define SBI_CALL_1(which, arg0) SBI_CALL(which, arg0, 0, 0, 0)
+#define SBI_CALL_2(which, arg0, arg1) SBI_CALL(which, arg0, arg1, 0, 0)
+#define SBI_CALL_3(which, arg0, arg1, arg2) \
+		SBI_CALL(which, arg0, arg1, arg2, 0)
+#define SBI_CALL_4(which, arg0, arg1, arg2, arg3) \
+		SBI_CALL(which, arg0, arg1, arg2, arg3)
 
 static inline void sbi_console_putchar(int ch)
 {
 	SBI_CALL_1(SBI_CONSOLE_PUTCHAR, ch);
 }
 
+/*
+ * Write len bytes from a physically contiguous buffer in one call.
+ * Returns how many were written, or a negative value if the firmware
+ * only has putchar.
+ */
+static inline long sbi_console_write_buf(const char *buf, unsigned long len)
+{
+	return SBI_CALL_2(SBI_CONSOLE_WRITE, __pa(buf), len);
+}
+
 static inline int sbi_console_getchar(void)
 {
 	return SBI_CALL_0(SBI_CONSOLE_GETCHAR);
@@ -70,6 +94,63 @@ static inline void sbi_shutdown(void)
 	SBI_CALL_0(SBI_SHUTDOWN);
 }
 
+/*
+ * Hart suspend.  A retentive suspend returns like a WFI once the hart
+ * wakes, with every register intact.  A non-retentive one loses the hart's
+ * state, and the firmware instead resumes it in supervisor mode with the MMU
+ * off at the physical address resume_addr, the hart ID in a0 and opaque in
+ * a1.  The low bits of the type select among the platform's states of each
+ * kind.  Returns a negative value if the firmware refused the request.
+ */
+#define SBI_SUSPEND_TYPE_RETENTIVE	0x00000000UL
+#define SBI_SUSPEND_TYPE_NON_RETENTIVE	0x80000000UL
+
+static inline long sbi_hart_suspend(unsigned long type,
+				    unsigned long resume_addr,
+				    unsigned long opaque)
+{
+	return SBI_CALL_3(SBI_HART_SUSPEND, type, resume_addr, opaque);
+}
+
+/*
+ * Steal time.  The supervisor names a record, by physical address, that
+ * the hypervisor keeps up to date for the calling hart: steal is the time
+ * in ns the hart was runnable but not running, and version is odd while
+ * the record is being written.  preempted is set while the hart isn't
+ * running at all.  Passing 0 stops the updates.  Returns 0, or a negative
+ * value if the firmware has no such record.
+ */
+struct sbi_steal_time {
+	u64 steal;
+	u32 version;
+	u32 flags;
+	u8 preempted;
+	u8 pad[47];
+} __aligned(64);
+
+static inline long sbi_steal_time_set(unsigned long addr)
+{
+	return SBI_CALL_1(SBI_STEAL_TIME, addr);
+}
+
+/*
+ * Frequency scaling, for harts whose clocks the firmware owns.  Both calls
+ * act on the clock domain the given hart is in, and the firmware takes
+ * care of any voltage change the frequency needs.  They never sleep, so
+ * they may be made from scheduler context.  sbi_cpufreq_set() returns 0
+ * and sbi_cpufreq_get() the current frequency, in kHz; both return a
+ * negative value on error, or if the firmware can't scale frequencies.
+ */
+static inline long sbi_cpufreq_set(unsigned long hart, unsigned long khz)
+{
+	return SBI_CALL_2(SBI_CPUFREQ_SET, hart, khz);
+}
+
+static inline long sbi_cpufreq_get(unsigned long hart)
+{
+	return SBI_CALL_1(SBI_CPUFREQ_GET, hart);
+}
+
 static inline void sbi_clear_ipi(void)
 {
 	SBI_CALL_0(SBI_CLEAR_IPI);
@@ -89,7 +170,7 @@ static inline void sbi_remote_sfence_vma(const unsigned long *hart_mask,
 					 unsigned long start,
 					 unsigned long size)
 {
-	SBI_CALL_1(SBI_REMOTE_SFENCE_VMA, hart_mask);
+	SBI_CALL_3(SBI_REMOTE_SFENCE_VMA, hart_mask, start, size);
 }
 
 static inline void sbi_remote_sfence_vma_asid(const unsigned long *hart_mask,
@@ -97,7 +178,7 @@ static inline void sbi_remote_sfence_vma_asid(const unsigned long *hart_mask,
 					      unsigned long size,
 					      unsigned long asid)
 {
-	SBI_CALL_1(SBI_REMOTE_SFENCE_VMA_ASID, hart_mask);
+	SBI_CALL_4(SBI_REMOTE_SFENCE_VMA_ASID, hart_mask, start, size, asid);
 }
 
 static inline void sbi_disk_read(
@@ -105,7 +186,7 @@ static inline void sbi_disk_read(
 		unsigned long offset,
 		unsigned long size)
 {
-	SBI_CALL(SBI_DISK_READ, addr, offset, size);
+	SBI_CALL_3(SBI_DISK_READ, addr, offset, size);
 }
 
 static inline void sbi_disk_write(
@@ -113,7 +194,7 @@ static inline void sbi_disk_write(
 		unsigned long offset,
 		unsigned long size)
 {
-	SBI_CALL(SBI_DISK_WRITE, addr, offset, size);
+	SBI_CALL_3(SBI_DISK_WRITE, addr, offset, size);
 }
 
 static inline unsigned long sbi_disk_size(void)
@@ -121,4 +202,50 @@ static inline unsigned long sbi_disk_size(void)
 	return SBI_CALL_0(SBI_DISK_SIZE);
 }
 
+/*
+ * Queued disk interface.  The supervisor hands the firmware an array of
+ * descriptors and later collects a completion for each of them.  Both
+ * arrays are passed by physical address and must stay put until the
+ * call returns; the firmware copies what it needs.
+ */
+#define SBI_DISK_OP_READ	0
+#define SBI_DISK_OP_WRITE	1
+#define SBI_DISK_OP_FLUSH	2
+#define SBI_DISK_OP_DISCARD	3
+
+struct sbi_disk_desc {
+	u64 addr;		/* physical buffer address, unused by FLUSH */
+	u64 offset;		/* byte offset on the disk */
+	u32 len;		/* bytes, 0 for FLUSH */
+	u32 op;			/* SBI_DISK_OP_* */
+	u64 cookie;		/* returned in the completion */
+};
+
+struct sbi_disk_cmpl {
+	u64 cookie;
+	s64 status;		/* 0 or a negative errno */
+};
+
+/* Number of submission queues, or a negative value for none */
+static inline long sbi_disk_nqueues(void)
+{
+	return SBI_CALL_0(SBI_DISK_NQUEUES);
+}
+
+/* Returns how many descriptors, from the first, were accepted */
+static inline long sbi_disk_submit(unsigned long queue,
+				   struct sbi_disk_desc *descs,
+				   unsigned long count)
+{
+	return SBI_CALL_3(SBI_DISK_SUBMIT, queue, __pa(descs), count);
+}
+
+/* Returns how many completions were written, at most max */
+static inline long sbi_disk_complete(unsigned long queue,
+				     struct sbi_disk_cmpl *cmpls,
+				     unsigned long max)
+{
+	return SBI_CALL_3(SBI_DISK_COMPLETE, queue, __pa(cmpls), max);
+}
+
 #endif
@@ -36,6 +36,10 @@ void arch_send_call_function_ipi_mask(struct cpumask *mask);
 /* Hook for the generic smp_call_function_single() routine. */
 void arch_send_call_function_single_ipi(int cpu);
 
+/* Ask the harts in mask to do a local sfence.vma / fence.i. */
+void riscv_send_ipi_sfence_vma(const struct cpumask *mask);
+void riscv_send_ipi_fence_i(const struct cpumask *mask);
+
 /*
  * This is particularly ugly: it appears we can't actually get the definition
  * of task_struct here, but we need access to the CPU this task is running on.
@@ -17,59 +17,98 @@
 
 #include <linux/kernel.h>
 #include <asm/current.h>
+#include <asm/barrier.h>
+#include <asm/cmpxchg.h>
+#include <asm/processor.h>
 
 /*
- * Simple spin lock operations.  These provide no fairness guarantees.
+ * Ticket spin lock operations.  Lockers take a ticket with a single
+ * amoadd on the "next" half of the word and then wait for "owner" to
+ * reach it, so the lock is handed out in FIFO order and waiters only spin
+ * on a load rather than hammering the line with AMOs.
  */
 
-/* FIXME: Replace this with a ticket lock, like MIPS. */
-
 #define arch_spin_lock_flags(lock, flags) arch_spin_lock(lock)
-#define arch_spin_is_locked(x)	((x)->lock != 0)
+
+#ifdef CONFIG_PARAVIRT
+/* Whether the hypervisor has descheduled the hart backing a CPU */
+bool __vcpu_is_preempted(int cpu);
+#define vcpu_is_preempted __vcpu_is_preempted
+#endif
+
+static inline int arch_spin_value_unlocked(arch_spinlock_t lock)
+{
+	return lock.tickets.owner == lock.tickets.next;
+}
+
+static inline int arch_spin_is_locked(arch_spinlock_t *lock)
+{
+	return !arch_spin_value_unlocked(READ_ONCE(*lock));
+}
+
+static inline int arch_spin_is_contended(arch_spinlock_t *lock)
+{
+	struct __raw_tickets tickets = READ_ONCE(lock->tickets);
+
+	return (u16)(tickets.next - tickets.owner) > 1;
+}
+#define arch_spin_is_contended	arch_spin_is_contended
 
 static inline void arch_spin_unlock(arch_spinlock_t *lock)
 {
-	__asm__ __volatile__ (
-		"amoswap.w.rl x0, x0, %0"
-		: "=A" (lock->lock)
-		:: "memory");
+	smp_store_release(&lock->tickets.owner, lock->tickets.owner + 1);
 }
 
 static inline int arch_spin_trylock(arch_spinlock_t *lock)
 {
-	int tmp = 1, busy;
+	u32 old = READ_ONCE(lock->lock);
 
-	__asm__ __volatile__ (
-		"amoswap.w.aq %0, %2, %1"
-		: "=r" (busy), "+A" (lock->lock)
-		: "r" (tmp)
-		: "memory");
+	if ((old >> TICKET_SHIFT) != (old & 0xffff))
+		return 0;
 
-	return !busy;
+	return cmpxchg(&lock->lock, old, old + (1 << TICKET_SHIFT)) == old;
 }
 
 static inline void arch_spin_lock(arch_spinlock_t *lock)
 {
-	while (1) {
-		if (arch_spin_is_locked(lock))
-			continue;
+	u32 old;
+	u16 ticket;
 
-		if (arch_spin_trylock(lock))
-			break;
-	}
+	__asm__ __volatile__ (
+		"amoadd.w.aq %0, %2, %1"
+		: "=&r" (old), "+A" (lock->lock)
+		: "r" (1 << TICKET_SHIFT)
+		: "memory");
+
+	ticket = old >> TICKET_SHIFT;
+	if (likely((u16)old == ticket))
+		return;
+
+	smp_cond_load_acquire(&lock->tickets.owner, VAL == ticket);
 }
 
 static inline void arch_spin_unlock_wait(arch_spinlock_t *lock)
 {
+	u16 owner = READ_ONCE(lock->tickets.owner);
+
 	smp_rmb();
-	do {
+	for (;;) {
+		arch_spinlock_t tmp = READ_ONCE(*lock);
+
+		if (tmp.tickets.owner == tmp.tickets.next ||
+		    tmp.tickets.owner != owner)
+			break;
+
 		cpu_relax();
-	} while (arch_spin_is_locked(lock));
+	}
 	smp_acquire__after_ctrl_dep();
 }
 
 /***********************************************************/
 
+#ifdef CONFIG_QUEUED_RWLOCKS
+#include <asm/qrwlock.h>
+#else
 static inline int arch_read_can_lock(arch_rwlock_t *lock)
 {
 	return lock->lock >= 0;
@@ -159,7 +198,13 @@ static inline void arch_write_unlock(arch_rwlock_t *lock)
 		:: "memory");
 }
 
+#endif /* CONFIG_QUEUED_RWLOCKS */
+
 #define arch_read_lock_flags(lock, flags) arch_read_lock(lock)
 #define arch_write_lock_flags(lock, flags) arch_write_lock(lock)
 
+#define arch_spin_relax(lock)	cpu_relax()
+#define arch_read_relax(lock)	cpu_relax()
+#define arch_write_relax(lock)	cpu_relax()
+
 #endif /* _ASM_RISCV_SPINLOCK_H */
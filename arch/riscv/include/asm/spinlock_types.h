@@ -18,16 +18,34 @@
 # error "please don't include this file directly"
 #endif
 
+#include <linux/types.h>
+
+#define TICKET_SHIFT	16
+
+/*
+ * A ticket lock: "next" is the ticket handed to the next locker, "owner"
+ * the ticket currently being served.  The lock is free when they match.
+ */
 typedef struct {
-	volatile unsigned int lock;
+	union {
+		u32 lock;
+		struct __raw_tickets {
+			u16 owner;
+			u16 next;
+		} tickets;
+	};
 } arch_spinlock_t;
 
-#define __ARCH_SPIN_LOCK_UNLOCKED	{ 0 }
+#define __ARCH_SPIN_LOCK_UNLOCKED	{ { 0 } }
 
+#ifdef CONFIG_QUEUED_RWLOCKS
+#include <asm-generic/qrwlock_types.h>
+#else
 typedef struct {
 	volatile unsigned int lock;
 } arch_rwlock_t;
 
 #define __ARCH_RW_LOCK_UNLOCKED		{ 0 }
+#endif /* CONFIG_QUEUED_RWLOCKS */
 
 #endif
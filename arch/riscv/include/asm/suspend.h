@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#ifndef _ASM_RISCV_SUSPEND_H
+#define _ASM_RISCV_SUSPEND_H
+
+#include <asm/ptrace.h>
+
+/*
+ * Everything a hart loses in a non-retentive suspend.  Only the callee-saved
+ * registers, ra, sp, gp, tp and sstatus of regs are used; the supervisor CSRs
+ * below are handled in C.
+ */
+struct suspend_context {
+	struct pt_regs regs;
+	unsigned long scratch;
+	unsigned long tvec;
+	unsigned long ie;
+	unsigned long sptbr;
+};
+
+/*
+ * Save the hart's state and call finish(arg, entry, context), which is
+ * expected to ask the firmware to suspend the hart and have it resume at
+ * the physical address entry with the opaque value context in a1.  Returns
+ * 0 once the hart has come back through __cpu_resume_enter(), or the error
+ * from finish() if the hart never went down.
+ */
+int cpu_suspend(unsigned long arg,
+		int (*finish)(unsigned long arg, unsigned long entry,
+			      unsigned long context));
+
+/* Low-level halves, in suspend_entry.S */
+asmlinkage int __cpu_suspend_enter(struct suspend_context *context);
+asmlinkage void __cpu_resume_enter(unsigned long hartid,
+				   unsigned long context);
+
+#endif /* _ASM_RISCV_SUSPEND_H */
@@ -14,16 +14,18 @@
 #ifndef _ASM_RISCV_SWITCH_TO_H
 #define _ASM_RISCV_SWITCH_TO_H
 
+#include <linux/preempt.h>
 #include <asm/processor.h>
 #include <asm/ptrace.h>
 #include <asm/csr.h>
+#include <asm/vector.h>
 
 extern void __fstate_save(struct task_struct *save_to);
 extern void __fstate_restore(struct task_struct *restore_from);
 
 static inline void __fstate_clean(struct pt_regs *regs)
 {
-	regs->sstatus |= (regs->sstatus & ~(SR_FS)) | SR_FS_CLEAN;
+	regs->sstatus = (regs->sstatus & ~SR_FS) | SR_FS_CLEAN;
 }
 
 static inline void fstate_save(struct task_struct *task,
@@ -44,15 +46,78 @@ static inline void fstate_restore(struct task_struct *task,
 	}
 }
 
+/*
+ * FPU context switching: in eager mode the incoming task's FP registers
+ * are always restored.  In lazy mode its FPU is left off instead, and the
+ * registers are only loaded when its first FP instruction traps; tasks
+ * that kept using the FPU over more than FPU_EAGER_THRESHOLD consecutive
+ * time slices are switched eagerly until their u8 counter wraps.
+ */
+enum fpu_switch_mode {
+	FPU_SWITCH_AUTO,
+	FPU_SWITCH_EAGER,
+	FPU_SWITCH_LAZY,
+};
+
+#define FPU_EAGER_THRESHOLD	5
+
+extern enum fpu_switch_mode fpu_switch_mode;
+
+static inline bool fstate_switch_eager(struct task_struct *task)
+{
+	switch (fpu_switch_mode) {
+	case FPU_SWITCH_EAGER:
+		return true;
+	case FPU_SWITCH_LAZY:
+		return false;
+	default:
+		return task->thread.fpu_counter > FPU_EAGER_THRESHOLD;
+	}
+}
+
+/*
+ * Called for an illegal instruction trap from user mode.  A user task only
+ * ever runs with FS=OFF because __switch_to_aux() or start_thread() left
+ * it off, so load its FP registers and let it retry the instruction.
+ */
+static inline bool fstate_lazy_restore(struct pt_regs *regs)
+{
+	if ((regs->sstatus & SR_FS) != SR_FS_OFF)
+		return false;
+
+	/* A switch in between would leave someone else's registers live. */
+	preempt_disable();
+	__fstate_restore(current);
+	__fstate_clean(regs);
+	preempt_enable();
+	current->thread.fstate_used = 1;
+	return true;
+}
+
 static inline void __switch_to_aux(struct task_struct *prev,
 				   struct task_struct *next)
 {
 	struct pt_regs *regs;
 
 	regs = task_pt_regs(prev);
-	if (unlikely(regs->sstatus & SR_SD))
+	if (unlikely(regs->sstatus & SR_SD)) {
 		fstate_save(prev, regs);
-	fstate_restore(next, task_pt_regs(next));
+		if (has_vector())
+			riscv_v_vstate_save(prev, regs);
+	}
+	if ((regs->sstatus & SR_FS) != SR_FS_OFF)
+		prev->thread.fpu_counter++;
+	else
+		prev->thread.fpu_counter = 0;
+
+	regs = task_pt_regs(next);
+	if (fstate_switch_eager(next))
+		fstate_restore(next, regs);
+	else
+		regs->sstatus &= ~SR_FS;
+	/* A patched-out jump on harts without the V extension */
+	if (has_vector())
+		riscv_v_vstate_restore(next, regs);
 }
 
 extern struct task_struct *__switch_to(struct task_struct *,
@@ -40,7 +40,17 @@ typedef unsigned long mm_segment_t;
  */
 struct thread_info {
 	unsigned long		flags;		/* low level flags */
+#ifdef CONFIG_64BIT
+	union {
+		u64		preempt_count;	/* 0=>preemptible, <0=>BUG */
+		struct {
+			u32	count;
+			u32	need_resched;
+		} preempt;
+	};
+#else
 	int                     preempt_count;  /* 0=>preemptible, <0=>BUG */
+#endif
 	mm_segment_t		addr_limit;
 	/*
 	 * These stack pointers are overwritten on every system call or
@@ -66,6 +76,8 @@ struct thread_info {
 
 #define init_stack		(init_thread_union.stack)
 
+void arch_release_task_struct(struct task_struct *tsk);
+
 #endif /* !__ASSEMBLY__ */
 
 /*
@@ -82,13 +94,22 @@ struct thread_info {
 #define TIF_RESTORE_SIGMASK	4	/* restore signal mask in do_signal() */
 #define TIF_MEMDIE		5	/* is terminating due to OOM killer */
 #define TIF_SYSCALL_TRACEPOINT  6       /* syscall tracepoint instrumentation */
+#define TIF_UPROBE		7	/* uprobe breakpoint or singlestep */
+#define TIF_NOHZ		8	/* in adaptive nohz mode */
 
 #define _TIF_SYSCALL_TRACE	(1 << TIF_SYSCALL_TRACE)
 #define _TIF_NOTIFY_RESUME	(1 << TIF_NOTIFY_RESUME)
 #define _TIF_SIGPENDING		(1 << TIF_SIGPENDING)
 #define _TIF_NEED_RESCHED	(1 << TIF_NEED_RESCHED)
+#define _TIF_SYSCALL_TRACEPOINT	(1 << TIF_SYSCALL_TRACEPOINT)
+#define _TIF_UPROBE		(1 << TIF_UPROBE)
+#define _TIF_NOHZ		(1 << TIF_NOHZ)
 
 #define _TIF_WORK_MASK \
-	(_TIF_NOTIFY_RESUME | _TIF_SIGPENDING | _TIF_NEED_RESCHED)
+	(_TIF_NOTIFY_RESUME | _TIF_SIGPENDING | _TIF_NEED_RESCHED | \
+	 _TIF_UPROBE)
+
+#define _TIF_SYSCALL_WORK \
+	(_TIF_SYSCALL_TRACE | _TIF_SYSCALL_TRACEPOINT | _TIF_NOHZ)
 
 #endif /* _ASM_RISCV_THREAD_INFO_H */
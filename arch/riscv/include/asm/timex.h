@@ -48,6 +48,14 @@ static inline uint64_t get_cycles64(void)
 }
 #endif
 
+#define ARCH_HAS_CLOCKSOURCE_COUNTER
+
+/* The time CSR backs riscv_clocksource, see CLOCK_SOURCE_ARCH_COUNTER */
+static inline u64 arch_clocksource_counter_read(void)
+{
+	return get_cycles64();
+}
+
 #define ARCH_HAS_READ_CURRENT_TIMER
 
 static inline int read_current_timer(unsigned long *timer_val)
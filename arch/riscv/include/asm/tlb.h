@@ -14,11 +14,21 @@
 #ifndef _ASM_RISCV_TLB_H
 #define _ASM_RISCV_TLB_H
 
+/*
+ * Don't flush at the end of every VMA: let the gather accumulate the
+ * range across the whole unmap and flush it once from tlb_flush_mmu(),
+ * so tearing down many VMAs costs a single round of remote fences.
+ */
+#define tlb_end_vma(tlb, vma) do { } while (0)
+
 #include <asm-generic/tlb.h>
 
 static inline void tlb_flush(struct mmu_gather *tlb)
 {
-	flush_tlb_mm(tlb->mm);
+	if (tlb->fullmm || tlb->need_flush_all || tlb->end <= tlb->start)
+		flush_tlb_mm(tlb->mm);
+	else
+		flush_tlb_mm_range(tlb->mm, tlb->start, tlb->end);
 }
 
 #endif /* _ASM_RISCV_TLB_H */
@@ -29,29 +29,60 @@ static inline void local_flush_tlb_page(unsigned long addr)
 	__asm__ __volatile__ ("sfence.vma %0" : : "r" (addr) : "memory");
 }
 
-#ifndef CONFIG_SMP
+/* Flush all local TLB entries tagged with one ASID */
+static inline void local_flush_tlb_all_asid(unsigned long asid)
+{
+	__asm__ __volatile__ ("sfence.vma x0, %0"
+			      : : "r" (asid) : "memory");
+}
 
-#define flush_tlb_all() local_flush_tlb_all()
-#define flush_tlb_page(vma, addr) local_flush_tlb_page(addr)
-#define flush_tlb_range(vma, start, end) local_flush_tlb_all()
+/* Flush one page of one ASID from local TLB */
+static inline void local_flush_tlb_page_asid(unsigned long addr,
+	unsigned long asid)
+{
+	__asm__ __volatile__ ("sfence.vma %0, %1"
+			      : : "r" (addr), "r" (asid) : "memory");
+}
 
-#else /* CONFIG_SMP */
+struct mm_struct;
+struct vm_area_struct;
 
-#include <asm/sbi.h>
+/*
+ * Flush [start, end) of mm, one page at a time up to
+ * tlb_flush_page_ceiling pages and with a single full flush of the mm
+ * beyond that.  On SMP all harts in mm_cpumask() are covered by a single
+ * SBI call.
+ */
+void flush_tlb_mm_range(struct mm_struct *mm, unsigned long start,
+			unsigned long end);
 
-#define flush_tlb_all() sbi_remote_sfence_vma(0, 0, -1)
-#define flush_tlb_page(vma, addr) flush_tlb_range(vma, addr, 0)
-#define flush_tlb_range(vma, start, end) \
-	sbi_remote_sfence_vma(0, start, (end) - (start))
+#ifndef CONFIG_SMP
 
-#endif /* CONFIG_SMP */
+#define flush_tlb_all() local_flush_tlb_all()
+#define flush_tlb_page(vma, addr) local_flush_tlb_page(addr)
+#define flush_tlb_range(vma, start, end) \
+	flush_tlb_mm_range((vma)->vm_mm, start, end)
 
 /* Flush the TLB entries of the specified mm context */
 static inline void flush_tlb_mm(struct mm_struct *mm)
 {
-	flush_tlb_all();
+	local_flush_tlb_all();
 }
 
+#else /* CONFIG_SMP */
+
+/*
+ * Remote flushes only go to the harts in mm_cpumask(), i.e. those that
+ * have run the mm since it was created and may still cache its entries.
+ */
+void flush_tlb_all(void);
+void flush_tlb_mm(struct mm_struct *mm);
+void flush_tlb_page(struct vm_area_struct *vma, unsigned long addr);
+void flush_tlb_range(struct vm_area_struct *vma, unsigned long start,
+		     unsigned long end);
+
+#endif /* CONFIG_SMP */
+
 /* Flush a range of kernel pages */
 static inline void flush_tlb_kernel_range(unsigned long start,
 	unsigned long end)
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#ifndef _ASM_RISCV_UNWIND_H
+#define _ASM_RISCV_UNWIND_H
+
+#include <linux/sched.h>
+
+/*
+ * Register state for one frame.  ra is only known for the frame that was
+ * interrupted (where a leaf may not have saved it yet) and is zero
+ * everywhere else.
+ */
+struct unwind_frame_info {
+	unsigned long pc;
+	unsigned long sp;
+	unsigned long fp;
+	unsigned long ra;
+	int graph;		/* ftrace_graph_ret_addr() cursor */
+};
+
+/*
+ * Step to the caller of @frame using the .eh_frame call frame information
+ * of the kernel image.  Returns 0 on success; on failure @frame is left
+ * untouched.
+ */
+extern int unwind_frame(struct task_struct *task,
+			struct unwind_frame_info *frame);
+
+#endif /* _ASM_RISCV_UNWIND_H */
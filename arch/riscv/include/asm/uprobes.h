@@ -0,0 +1,55 @@
+/*
+ * Based on arch/arm64/include/asm/uprobes.h
+ *
+ * Copyright (C) 2014-2016 Pratyush Anand <panand@redhat.com>
+ * Copyright (C) 2017 SiFive
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _ASM_RISCV_UPROBES_H
+#define _ASM_RISCV_UPROBES_H
+
+#include <asm/probes.h>
+
+#define MAX_UINSN_BYTES		4
+
+/*
+ * With compressed instructions around, a 2-byte c.ebreak is the only
+ * breakpoint that fits over every instruction without clobbering the
+ * next one.
+ */
+#ifdef CONFIG_RISCV_ISA_C
+typedef u16 uprobe_opcode_t;
+#define UPROBE_SWBP_INSN	RISCV_INSN_C_EBREAK
+#define UPROBE_SWBP_INSN_SIZE	2
+#else
+typedef u32 uprobe_opcode_t;
+#define UPROBE_SWBP_INSN	RISCV_INSN_EBREAK
+#define UPROBE_SWBP_INSN_SIZE	4
+#endif
+
+/* the stepped instruction followed by an ebreak to trap back */
+#define UPROBE_XOL_SLOT_BYTES	(MAX_UINSN_BYTES + 4)
+
+struct arch_uprobe_task {
+	unsigned long saved_cause;
+};
+
+struct arch_uprobe {
+	u8 insn[MAX_UINSN_BYTES];
+	u8 ixol[UPROBE_XOL_SLOT_BYTES];
+	unsigned long insn_size;
+	struct arch_probe_insn api;
+	bool simulate;
+	/* a stack store, done with put_user() unless that faults */
+	bool store;
+};
+
+struct pt_regs;
+bool uprobe_breakpoint_handler(struct pt_regs *regs);
+bool uprobe_single_step_handler(struct pt_regs *regs);
+
+#endif /* _ASM_RISCV_UPROBES_H */
@@ -20,7 +20,27 @@
 
 #include <linux/types.h>
 
+/*
+ * The vDSO data page, shared read-only with userspace and updated by
+ * update_vsyscall().  Readers retry while seq is odd or changes under them.
+ */
 struct vdso_data {
+	u32 seq;		/* Timebase sequence counter */
+	u32 use_syscall;	/* Current clocksource isn't rdtime */
+	u64 cs_cycle_last;	/* rdtime value at the last update */
+	u64 cs_mask;		/* Clocksource mask */
+	u32 cs_mult;		/* NTP-adjusted clocksource multiplier */
+	u32 cs_shift;		/* Clocksource shift */
+	u64 xtime_sec;		/* Kernel time */
+	u64 xtime_nsec;		/* ... in ns << cs_shift */
+	u64 xtime_coarse_sec;	/* Coarse time */
+	u64 xtime_coarse_nsec;
+	u64 wtm_sec;		/* Wall to monotonic time */
+	u64 wtm_nsec;
+	u32 hrtimer_res;	/* clock_getres() of the high-res clocks */
+	u32 coarse_res;		/* clock_getres() of the coarse clocks */
+	u32 tz_minuteswest;	/* Whacky timezone stuff */
+	u32 tz_dsttime;
 };
 
 /*
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#ifndef _ASM_RISCV_VECTOR_H
+#define _ASM_RISCV_VECTOR_H
+
+#ifdef __ASSEMBLY__
+
+/*
+ * The assembler doesn't know the V extension, so the few vector
+ * instructions the kernel needs are spelled out.  The operands are
+ * register numbers.
+ */
+
+/* vsetvli rd, x0, e8, m8, ta, ma: vl = VLMAX over groups of 8 registers */
+#define VSETVLI_E8M8(rd)	.word (0xc3 << 20) | (7 << 12) | ((rd) << 7) | 0x57
+/* vsetvl x0, rs1, rs2 */
+#define VSETVL(rs1, rs2)	.word (0x40 << 25) | ((rs2) << 20) | ((rs1) << 15) | \
+				      (7 << 12) | 0x57
+/* vse8.v vs3, (rs1) */
+#define VSE8(vs3, rs1)		.word (1 << 25) | ((rs1) << 15) | ((vs3) << 7) | 0x27
+/* vle8.v vd, (rs1) */
+#define VLE8(vd, rs1)		.word (1 << 25) | ((rs1) << 15) | ((vd) << 7) | 0x07
+/* vsetvli rd, rs1, e8, m8, ta, ma */
+#define VSETVLI_E8M8_AVL(rd, rs1)	.word (0xc3 << 20) | ((rs1) << 15) | \
+					      (7 << 12) | ((rd) << 7) | 0x57
+/* vxor.vv vd, vs2, vs1 */
+#define VXOR_VV(vd, vs2, vs1)	.word (0x0b << 26) | (1 << 25) | ((vs2) << 20) | \
+				      ((vs1) << 15) | ((vd) << 7) | 0x57
+
+/* vsetvli rd, rs1, e32, m1, tu, ma */
+#define VSETVLI_E32M1_TU(rd, rs1)	.word (0x90 << 20) | ((rs1) << 15) | \
+					      (7 << 12) | ((rd) << 7) | 0x57
+/* vsetvli rd, x0, e64, m2, ta, ma */
+#define VSETVLI_E64M2(rd)	.word (0xd9 << 20) | (7 << 12) | ((rd) << 7) | 0x57
+/* vle32.v vd, (rs1) */
+#define VLE32(vd, rs1)		.word (1 << 25) | ((rs1) << 15) | (6 << 12) | \
+				      ((vd) << 7) | 0x07
+/* vwaddu.wv vd, vs2, vs1 */
+#define VWADDU_WV(vd, vs2, vs1)	.word (0x34 << 26) | (1 << 25) | ((vs2) << 20) | \
+				      ((vs1) << 15) | (2 << 12) | ((vd) << 7) | 0x57
+/* vmv.v.i vd, 0 */
+#define VMV_V_0(vd)		.word (0x17 << 26) | (1 << 25) | (3 << 12) | \
+				      ((vd) << 7) | 0x57
+/* vmv.s.x vd, rs1 */
+#define VMV_S_X(vd, rs1)	.word (0x10 << 26) | (1 << 25) | ((rs1) << 15) | \
+				      (6 << 12) | ((vd) << 7) | 0x57
+/* vredsum.vs vd, vs2, vs1 */
+#define VREDSUM_VS(vd, vs2, vs1)	.word (1 << 25) | ((vs2) << 20) | ((vs1) << 15) | \
+					      (2 << 12) | ((vd) << 7) | 0x57
+/* vmv.x.s rd, vs2 */
+#define VMV_X_S(rd, vs2)	.word (0x10 << 26) | (1 << 25) | ((vs2) << 20) | \
+				      (2 << 12) | ((rd) << 7) | 0x57
+
+/* vtype immediates: tail and mask agnostic */
+#define VTYPE_E8M1		0xc0
+#define VTYPE_E32M1		0xd0
+#define VTYPE_E32M4		0xd2
+
+/* vsetvli rd, rs1, vtype */
+#define VSETVLI(rd, rs1, vtype)	.word ((vtype) << 20) | ((rs1) << 15) | \
+				      (7 << 12) | ((rd) << 7) | 0x57
+/* vsetivli rd, uimm, vtype */
+#define VSETIVLI(rd, uimm, vtype)	.word (3 << 30) | ((vtype) << 20) | \
+					      ((uimm) << 15) | (7 << 12) | \
+					      ((rd) << 7) | 0x57
+/* vse32.v vs3, (rs1) */
+#define VSE32(vs3, rs1)		.word (1 << 25) | ((rs1) << 15) | (6 << 12) | \
+				      ((vs3) << 7) | 0x27
+/* vlse32.v vd, (rs1), rs2 */
+#define VLSE32(vd, rs1, rs2)	.word (2 << 26) | (1 << 25) | ((rs2) << 20) | \
+				      ((rs1) << 15) | (6 << 12) | ((vd) << 7) | 0x07
+/* vsse32.v vs3, (rs1), rs2 */
+#define VSSE32(vs3, rs1, rs2)	.word (2 << 26) | (1 << 25) | ((rs2) << 20) | \
+				      ((rs1) << 15) | (6 << 12) | ((vs3) << 7) | 0x27
+
+#define __VOPIVV(f6, vd, vs2, vs1)	.word ((f6) << 26) | (1 << 25) | \
+					      ((vs2) << 20) | ((vs1) << 15) | \
+					      ((vd) << 7) | 0x57
+#define __VOPIVX(f6, vd, vs2, rs1)	.word ((f6) << 26) | (1 << 25) | \
+					      ((vs2) << 20) | ((rs1) << 15) | \
+					      (4 << 12) | ((vd) << 7) | 0x57
+#define __VOPIVI(f6, vd, vs2, imm)	.word ((f6) << 26) | (1 << 25) | \
+					      ((vs2) << 20) | ((imm) << 15) | \
+					      (3 << 12) | ((vd) << 7) | 0x57
+
+#define VADD_VV(vd, vs2, vs1)	__VOPIVV(0x00, vd, vs2, vs1)
+#define VADD_VX(vd, vs2, rs1)	__VOPIVX(0x00, vd, vs2, rs1)
+#define VOR_VV(vd, vs2, vs1)	__VOPIVV(0x0a, vd, vs2, vs1)
+#define VSLL_VI(vd, vs2, imm)	__VOPIVI(0x25, vd, vs2, imm)
+#define VSRL_VI(vd, vs2, imm)	__VOPIVI(0x28, vd, vs2, imm)
+#define VMV_V_V(vd, vs1)	__VOPIVV(0x17, vd, 0, vs1)
+#define VMV_V_X(vd, rs1)	__VOPIVX(0x17, vd, 0, rs1)
+#define VMV_V_I(vd, imm)	__VOPIVI(0x17, vd, 0, imm)
+/* vmerge.vvm vd, vs2, vs1, v0: vs1 where v0 is set, vs2 elsewhere */
+#define VMERGE_VVM(vd, vs2, vs1)	.word (0x17 << 26) | ((vs2) << 20) | \
+					      ((vs1) << 15) | ((vd) << 7) | 0x57
+/* vid.v vd */
+#define VID_V(vd)		.word (0x14 << 26) | (1 << 25) | (0x11 << 15) | \
+				      (2 << 12) | ((vd) << 7) | 0x57
+
+/* Zvkb: vrev8.v vd, vs2 */
+#define VREV8_V(vd, vs2)	.word (0x12 << 26) | (1 << 25) | ((vs2) << 20) | \
+				      (0x09 << 15) | (2 << 12) | ((vd) << 7) | 0x57
+
+/* The vector crypto extensions work on element groups in OP-VE */
+#define __VCRYPTO(f6, vd, vs2, vs1)	.word ((f6) << 26) | (1 << 25) | \
+					      ((vs2) << 20) | ((vs1) << 15) | \
+					      (2 << 12) | ((vd) << 7) | 0x77
+
+/* Zvkned, with the round key in element group 0 of vs2 */
+#define VAESDM_VS(vd, vs2)	__VCRYPTO(0x29, vd, vs2, 0x00)
+#define VAESDF_VS(vd, vs2)	__VCRYPTO(0x29, vd, vs2, 0x01)
+#define VAESEM_VS(vd, vs2)	__VCRYPTO(0x29, vd, vs2, 0x02)
+#define VAESEF_VS(vd, vs2)	__VCRYPTO(0x29, vd, vs2, 0x03)
+#define VAESZ_VS(vd, vs2)	__VCRYPTO(0x29, vd, vs2, 0x07)
+/* Zvkg: vd = (vd ^ vs1) * vs2 in GF(2^128) */
+#define VGHSH_VV(vd, vs2, vs1)	__VCRYPTO(0x2c, vd, vs2, vs1)
+/* Zvknha */
+#define VSHA2MS_VV(vd, vs2, vs1)	__VCRYPTO(0x2d, vd, vs2, vs1)
+#define VSHA2CH_VV(vd, vs2, vs1)	__VCRYPTO(0x2e, vd, vs2, vs1)
+#define VSHA2CL_VV(vd, vs2, vs1)	__VCRYPTO(0x2f, vd, vs2, vs1)
+
+#else /* !__ASSEMBLY__ */
+
+#include <linux/types.h>
+#include <linux/sched.h>
+#include <asm/csr.h>
+#include <asm/hwcap.h>
+#include <asm/ptrace.h>
+
+/* Size of the vector register file, 32 * vlenb */
+extern unsigned long riscv_v_vsize;
+
+/* Patched at boot: false until apply_boot_alternatives() has run */
+static __always_inline bool has_vector(void)
+{
+	return riscv_has_extension_unlikely(RISCV_ISA_EXT_v);
+}
+
+extern void __riscv_v_vstate_save(struct __riscv_v_ext_state *save_to);
+extern void __riscv_v_vstate_restore(struct __riscv_v_ext_state *restore_from);
+
+static inline bool riscv_v_vstate_query(struct pt_regs *regs)
+{
+	return (regs->sstatus & SR_VS) != SR_VS_OFF;
+}
+
+static inline void riscv_v_vstate_off(struct pt_regs *regs)
+{
+	regs->sstatus &= ~SR_VS;
+}
+
+static inline void __riscv_v_vstate_clean(struct pt_regs *regs)
+{
+	regs->sstatus = (regs->sstatus & ~SR_VS) | SR_VS_CLEAN;
+}
+
+static inline void riscv_v_vstate_save(struct task_struct *task,
+				       struct pt_regs *regs)
+{
+	if ((regs->sstatus & SR_VS) == SR_VS_DIRTY) {
+		__riscv_v_vstate_save(&task->thread.vstate);
+		__riscv_v_vstate_clean(regs);
+	}
+}
+
+static inline void riscv_v_vstate_restore(struct task_struct *task,
+					  struct pt_regs *regs)
+{
+	if (riscv_v_vstate_query(regs)) {
+		__riscv_v_vstate_restore(&task->thread.vstate);
+		__riscv_v_vstate_clean(regs);
+	}
+}
+
+extern void riscv_v_setup_vsize(void);
+extern int riscv_v_thread_zalloc(struct task_struct *task);
+extern void riscv_v_thread_free(struct task_struct *task);
+extern bool riscv_v_first_use_handler(struct pt_regs *regs);
+
+/*
+ * Use the vector unit from kernel code.  Only allowed where
+ * may_use_simd() says so; preemption is off until kernel_vector_end().
+ */
+extern void kernel_vector_begin(void);
+extern void kernel_vector_end(void);
+
+#endif /* __ASSEMBLY__ */
+
+#endif /* _ASM_RISCV_VECTOR_H */
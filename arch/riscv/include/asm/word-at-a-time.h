@@ -15,8 +15,8 @@
 #ifndef _ASM_RISCV_WORD_AT_A_TIME_H
 #define _ASM_RISCV_WORD_AT_A_TIME_H
 
-
 #include <linux/kernel.h>
+#include <asm/asm.h>
 
 struct word_at_a_time {
 	const unsigned long one_bits, high_bits;
@@ -52,4 +52,45 @@ static inline unsigned long find_zero(unsigned long mask)
 /* The mask we created is directly usable as a bytemask */
 #define zero_bytemask(mask) (mask)
 
+#ifdef CONFIG_DCACHE_WORD_ACCESS
+
+/*
+ * Load an unaligned word from kernel space.
+ *
+ * In the (very unlikely) case of the word being a page-crosser
+ * and the next page not being mapped, take the exception and
+ * return zeroes in the non-existing part: the fixup reloads the
+ * aligned word containing @addr, which is known to be mapped, and
+ * shifts the bytes before @addr out.
+ */
+static inline unsigned long load_unaligned_zeropad(const void *addr)
+{
+	unsigned long ret, offset;
+
+	__asm__ (
+		"1:\n"
+		"	" REG_L " %0, %3\n"
+		"2:\n"
+		"	.section .fixup,\"ax\"\n"
+		"	.balign 4\n"
+		"3:\n"
+		"	andi %1, %2, -" SZREG "\n"
+		"	" REG_L " %0, 0(%1)\n"
+		"	andi %1, %2, " SZREG " - 1\n"
+		"	slli %1, %1, 3\n"
+		"	srl %0, %0, %1\n"
+		"	jump 2b, %1\n"
+		"	.previous\n"
+		"	.section __ex_table,\"a\"\n"
+		"	.balign " RISCV_SZPTR "\n"
+		"	" RISCV_PTR " 1b, 3b\n"
+		"	.previous"
+		: "=&r" (ret), "=&r" (offset)
+		: "r" (addr), "m" (*(unsigned long *)addr));
+
+	return ret;
+}
+
+#endif /* CONFIG_DCACHE_WORD_ACCESS */
+
 #endif /* _ASM_RISCV_WORD_AT_A_TIME_H */
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#ifndef _ASM_RISCV_XOR_H
+#define _ASM_RISCV_XOR_H
+
+#include <linux/linkage.h>
+#include <asm-generic/xor.h>
+#include <asm/simd.h>
+#include <asm/vector.h>
+
+asmlinkage void __xor_regs_2(unsigned long bytes, unsigned long *p1,
+			     unsigned long *p2);
+asmlinkage void __xor_regs_3(unsigned long bytes, unsigned long *p1,
+			     unsigned long *p2, unsigned long *p3);
+asmlinkage void __xor_regs_4(unsigned long bytes, unsigned long *p1,
+			     unsigned long *p2, unsigned long *p3,
+			     unsigned long *p4);
+asmlinkage void __xor_regs_5(unsigned long bytes, unsigned long *p1,
+			     unsigned long *p2, unsigned long *p3,
+			     unsigned long *p4, unsigned long *p5);
+
+asmlinkage void __xor_vector_2(unsigned long bytes, unsigned long *p1,
+			       unsigned long *p2);
+asmlinkage void __xor_vector_3(unsigned long bytes, unsigned long *p1,
+			       unsigned long *p2, unsigned long *p3);
+asmlinkage void __xor_vector_4(unsigned long bytes, unsigned long *p1,
+			       unsigned long *p2, unsigned long *p3,
+			       unsigned long *p4);
+asmlinkage void __xor_vector_5(unsigned long bytes, unsigned long *p1,
+			       unsigned long *p2, unsigned long *p3,
+			       unsigned long *p4, unsigned long *p5);
+
+static struct xor_block_template xor_block_rvregs = {
+	.name	= "rvregs",
+	.do_2	= __xor_regs_2,
+	.do_3	= __xor_regs_3,
+	.do_4	= __xor_regs_4,
+	.do_5	= __xor_regs_5,
+};
+
+/*
+ * async_tx may xor from softirq context, where the vector unit can't be
+ * used; the scalar loop does the job there.
+ */
+static void xor_rvv_2(unsigned long bytes, unsigned long *p1,
+		      unsigned long *p2)
+{
+	if (!may_use_simd()) {
+		__xor_regs_2(bytes, p1, p2);
+		return;
+	}
+
+	kernel_vector_begin();
+	__xor_vector_2(bytes, p1, p2);
+	kernel_vector_end();
+}
+
+static void xor_rvv_3(unsigned long bytes, unsigned long *p1,
+		      unsigned long *p2, unsigned long *p3)
+{
+	if (!may_use_simd()) {
+		__xor_regs_3(bytes, p1, p2, p3);
+		return;
+	}
+
+	kernel_vector_begin();
+	__xor_vector_3(bytes, p1, p2, p3);
+	kernel_vector_end();
+}
+
+static void xor_rvv_4(unsigned long bytes, unsigned long *p1,
+		      unsigned long *p2, unsigned long *p3,
+		      unsigned long *p4)
+{
+	if (!may_use_simd()) {
+		__xor_regs_4(bytes, p1, p2, p3, p4);
+		return;
+	}
+
+	kernel_vector_begin();
+	__xor_vector_4(bytes, p1, p2, p3, p4);
+	kernel_vector_end();
+}
+
+static void xor_rvv_5(unsigned long bytes, unsigned long *p1,
+		      unsigned long *p2, unsigned long *p3,
+		      unsigned long *p4, unsigned long *p5)
+{
+	if (!may_use_simd()) {
+		__xor_regs_5(bytes, p1, p2, p3, p4, p5);
+		return;
+	}
+
+	kernel_vector_begin();
+	__xor_vector_5(bytes, p1, p2, p3, p4, p5);
+	kernel_vector_end();
+}
+
+static struct xor_block_template xor_block_rvv = {
+	.name	= "rvv",
+	.do_2	= xor_rvv_2,
+	.do_3	= xor_rvv_3,
+	.do_4	= xor_rvv_4,
+	.do_5	= xor_rvv_5,
+};
+
+#undef XOR_TRY_TEMPLATES
+#define XOR_TRY_TEMPLATES				\
+	do {						\
+		xor_speed(&xor_block_8regs);		\
+		xor_speed(&xor_block_32regs);		\
+		xor_speed(&xor_block_rvregs);		\
+		if (has_vector())			\
+			xor_speed(&xor_block_rvv);	\
+	} while (0)
+
+#endif /* _ASM_RISCV_XOR_H */
@@ -85,6 +85,19 @@ union __riscv_fp_state {
 	struct __riscv_q_ext_state q;
 };
 
+/*
+ * Vector extension state.  The vector registers themselves, 32 * vlenb
+ * bytes of them, live in a separate buffer pointed to by datap.
+ */
+struct __riscv_v_ext_state {
+	unsigned long vstart;
+	unsigned long vl;
+	unsigned long vtype;
+	unsigned long vcsr;
+	unsigned long vlenb;
+	void *datap;
+};
+
 #endif /* __ASSEMBLY__ */
 
 #endif /* _UAPI_ASM_RISCV_PTRACE_H */
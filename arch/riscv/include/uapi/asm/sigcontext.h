@@ -16,6 +16,47 @@
 
 #include <asm/ptrace.h>
 
+/* The extension context records that can follow struct sigcontext */
+#define RISCV_V_MAGIC	0x53465457
+#define END_MAGIC	0x0
+#define END_HDR_SIZE	0x0
+
+/*
+ * Set in uc_flags when the interrupted context had never used the FPU.
+ * sc_fpregs is not written then, and rt_sigreturn puts the FPU back into
+ * its reset state unless the handler cleared the flag.
+ */
+#define UC_RISCV_FP_NONE	0x1
+
+struct __riscv_ctx_hdr {
+	__u32 magic;
+	__u32 size;
+};
+
+/*
+ * The last two reserved words of the Q-extension FP state hold the header
+ * of the first extension record.  Each record's header is followed by its
+ * payload, the first payload starting right after struct sigcontext, and
+ * the list ends with a header whose magic is END_MAGIC.
+ */
+struct __riscv_extra_ext_header {
+	__u32 __padding[129] __attribute__((aligned(16)));
+	/*
+	 * Reserved for expansion of sigcontext structure.  Currently zeroed
+	 * upon signal, and must be zero upon sigreturn.
+	 */
+	__u32 reserved;
+	struct __riscv_ctx_hdr hdr;
+};
+
+/*
+ * RISCV_V_MAGIC payload: v_state.datap points at the 32 * vlenb bytes of
+ * vector registers, which follow this structure in the frame.
+ */
+struct __sc_riscv_v_state {
+	struct __riscv_v_ext_state v_state;
+} __attribute__((aligned(16)));
+
 /*
  * Signal context structure
  *
@@ -24,7 +65,10 @@
  */
 struct sigcontext {
 	struct user_regs_struct sc_regs;
-	union __riscv_fp_state sc_fpregs;
+	union {
+		union __riscv_fp_state sc_fpregs;
+		struct __riscv_extra_ext_header sc_extdesc;
+	};
 };
 
 #endif /* _UAPI_ASM_RISCV_SIGCONTEXT_H */
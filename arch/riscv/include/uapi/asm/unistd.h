@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <asm-generic/unistd.h>
+
+/*
+ * Allows the instruction cache to be flushed from userspace.  Userspace
+ * can execute fence.i itself, but that only covers the hart it happens to
+ * be on: the kernel may move the thread to another hart at any time, and
+ * only the kernel knows which harts are running the other threads of the
+ * process.
+ *
+ * __NR_riscv_flush_icache makes stores to [start, end) visible to the
+ * instruction fetches of every thread of the process or, with
+ * SYS_RISCV_FLUSH_ICACHE_LOCAL, of just the caller.  There is no ranged
+ * fence.i, so the range is only there for forwards compatibility.
+ */
+#ifndef __NR_riscv_flush_icache
+#define __NR_riscv_flush_icache (__NR_arch_specific_syscall + 15)
+#endif
+__SYSCALL(__NR_riscv_flush_icache, sys_riscv_flush_icache)
+
+#ifndef SYS_RISCV_FLUSH_ICACHE_LOCAL
+#define SYS_RISCV_FLUSH_ICACHE_LOCAL	1UL
+#define SYS_RISCV_FLUSH_ICACHE_ALL	(SYS_RISCV_FLUSH_ICACHE_LOCAL)
+#endif
@@ -0,0 +1,123 @@
+/*
+ * Boot-time patching of ALTERNATIVE() sequences
+ *
+ * Based on arch/arm64/kernel/alternative.c
+ *
+ * Copyright (C) 2014 ARM Ltd.
+ * Copyright (C) 2017 SiFive
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define pr_fmt(fmt) "alternatives: " fmt
+
+#include <linux/bitops.h>
+#include <linux/bug.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sizes.h>
+
+#include <asm/alternative.h>
+#include <asm/cacheflush.h>
+#include <asm/hwcap.h>
+
+#define RISCV_INSN_OPCODE_MASK	0x7fU
+#define RISCV_INSN_JAL		0x6fU
+
+extern struct alt_instr __alt_instructions[], __alt_instructions_end[];
+
+static long jal_get_offset(u32 insn)
+{
+	unsigned long imm;
+
+	imm = ((insn >> 31) & 0x1) << 20 |
+	      (insn & 0xff000) |
+	      ((insn >> 20) & 0x1) << 11 |
+	      ((insn >> 21) & 0x3ff) << 1;
+
+	return sign_extend64(imm, 20);
+}
+
+static u32 jal_set_offset(u32 insn, long offset)
+{
+	/* Keep rd and the opcode */
+	insn &= 0xfff;
+
+	return insn | (offset & 0x100000) << (31 - 20) |
+		      (offset & 0xff000) |
+		      (offset & 0x800) << (20 - 11) |
+		      (offset & 0x7fe) << (30 - 10);
+}
+
+/*
+ * A jal that leaves the replacement was assembled relative to where the
+ * replacement sits, so retarget it for where it is going to run.  Jumps
+ * within the sequence move along with it and are left alone.
+ */
+static u32 __init_or_module alt_fixup_insn(struct alt_instr *alt,
+					   u32 *orig, u32 *repl)
+{
+	unsigned long start = (unsigned long)alt->alt_ptr;
+	unsigned long target;
+	u32 insn = *repl;
+	long offset;
+
+	if ((insn & RISCV_INSN_OPCODE_MASK) != RISCV_INSN_JAL)
+		return insn;
+
+	target = (unsigned long)repl + jal_get_offset(insn);
+	if (target >= start && target <= start + alt->len)
+		return insn;
+
+	offset = target - (unsigned long)orig;
+	BUG_ON(offset < -SZ_1M || offset >= SZ_1M);
+
+	return jal_set_offset(insn, offset);
+}
+
+void __init_or_module apply_alternatives(struct alt_instr *begin,
+					 struct alt_instr *end)
+{
+	struct alt_instr *alt;
+	unsigned int patched = 0;
+
+	for (alt = begin; alt < end; alt++) {
+		u32 *orig = alt->orig_ptr, *repl = alt->alt_ptr;
+		unsigned int i;
+
+		if (!riscv_isa_extension_available(alt->feature))
+			continue;
+
+		/* Both sequences are whole, 4-byte aligned instructions */
+		BUG_ON(alt->len & 3);
+
+		for (i = 0; i < alt->len / sizeof(u32); i++)
+			orig[i] = alt_fixup_insn(alt, &orig[i], &repl[i]);
+
+		patched++;
+	}
+
+	if (patched)
+		flush_icache_all();
+}
+
+/*
+ * Called from setup_arch() once riscv_fill_hwcap() knows what every hart
+ * implements, while the boot hart is still the only one running kernel
+ * text, so the sequences can simply be overwritten.
+ */
+void __init apply_boot_alternatives(void)
+{
+	apply_alternatives(__alt_instructions, __alt_instructions_end);
+}
@@ -17,45 +17,122 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <linux/bitmap.h>
+#include <linux/ctype.h>
 #include <linux/of.h>
 #include <asm/processor.h>
 #include <asm/hwcap.h>
+#include <asm/vector.h>
 
 unsigned long elf_hwcap __read_mostly;
+struct riscv_isainfo riscv_hart_isa[NR_CPUS] __read_mostly;
+struct riscv_isainfo riscv_isa __read_mostly;
 
-void riscv_fill_hwcap(void)
+/* Indexed by RISCV_ISA_EXT_* - RISCV_ISA_EXT_BASE */
+static const char * const riscv_isa_ext_names[] = {
+	[RISCV_ISA_EXT_SSTC - RISCV_ISA_EXT_BASE] = "sstc",
+	[RISCV_ISA_EXT_SVADU - RISCV_ISA_EXT_BASE] = "svadu",
+	[RISCV_ISA_EXT_ZBC - RISCV_ISA_EXT_BASE] = "zbc",
+	[RISCV_ISA_EXT_ZVKB - RISCV_ISA_EXT_BASE] = "zvkb",
+	[RISCV_ISA_EXT_ZVKG - RISCV_ISA_EXT_BASE] = "zvkg",
+	[RISCV_ISA_EXT_ZVKNED - RISCV_ISA_EXT_BASE] = "zvkned",
+	[RISCV_ISA_EXT_ZVKNHA - RISCV_ISA_EXT_BASE] = "zvknha",
+};
+
+/* Match one "_"-terminated multi-letter extension name */
+static void riscv_parse_isa_ext(unsigned long *isa, const char *ext,
+				size_t len)
 {
-	struct device_node *node;
-	const char *isa;
 	size_t i;
-	static unsigned long isa2hwcap[256] = {0};
 
-	isa2hwcap['i'] = isa2hwcap['I'] = COMPAT_HWCAP_ISA_I;
-	isa2hwcap['m'] = isa2hwcap['M'] = COMPAT_HWCAP_ISA_M;
-	isa2hwcap['a'] = isa2hwcap['A'] = COMPAT_HWCAP_ISA_A;
-	isa2hwcap['f'] = isa2hwcap['F'] = COMPAT_HWCAP_ISA_F;
-	isa2hwcap['d'] = isa2hwcap['D'] = COMPAT_HWCAP_ISA_D;
-	isa2hwcap['c'] = isa2hwcap['C'] = COMPAT_HWCAP_ISA_C;
+	for (i = 0; i < ARRAY_SIZE(riscv_isa_ext_names); ++i) {
+		if (strlen(riscv_isa_ext_names[i]) == len &&
+		    !strncasecmp(ext, riscv_isa_ext_names[i], len))
+			set_bit(RISCV_ISA_EXT_BASE + i, isa);
+	}
+}
+
+static void riscv_parse_isa(unsigned long *isa, const char *str)
+{
+	size_t i;
+
+	/* riscv_of_processor_hart() has checked for the "rv" prefix */
+	str += 2;
+	while (isdigit(*str))
+		str++;
+
+	/* Single-letter extensions stop at the first '_' */
+	for (i = 0; str[i] && str[i] != '_'; ++i) {
+		char c = tolower(str[i]);
+
+		if (c >= 'a' && c <= 'z')
+			set_bit(c - 'a', isa);
+	}
+
+	while (str[i] == '_') {
+		const char *ext = &str[++i];
+		size_t len = strcspn(ext, "_");
+
+		riscv_parse_isa_ext(isa, ext, len);
+		i += len;
+	}
+}
+
+void riscv_fill_hwcap(void)
+{
+	struct device_node *node = NULL;
+	const unsigned long hwcap_mask = COMPAT_HWCAP_ISA_I |
+		COMPAT_HWCAP_ISA_M | COMPAT_HWCAP_ISA_A | COMPAT_HWCAP_ISA_F |
+		COMPAT_HWCAP_ISA_D | COMPAT_HWCAP_ISA_C | COMPAT_HWCAP_ISA_V;
+	bool first = true;
+	const char *isa;
+	int hart;
 
 	elf_hwcap = 0;
+	bitmap_zero(riscv_isa.isa, RISCV_ISA_EXT_MAX);
 
 	/*
-	 * We don't support running Linux on hertergenous ISA systems.  For
-	 * now, we just check the ISA of the first processor.
+	 * Parse every hart's ISA, but only let the kernel and userspace use
+	 * what they all implement: tasks migrate, and patched kernel text
+	 * is shared.
 	 */
-	node = of_find_node_by_type(NULL, "cpu");
-	if (!node) {
-		pr_warning("Unable to find \"cpu\" devicetree entry");
-		return;
+	while ((node = of_find_node_by_type(node, "cpu"))) {
+		unsigned long *hart_isa;
+
+		hart = riscv_of_processor_hart(node);
+		if (hart < 0)
+			continue;
+
+		if (of_property_read_string(node, "riscv,isa", &isa))
+			continue;
+
+		hart_isa = riscv_hart_isa[hart].isa;
+		bitmap_zero(hart_isa, RISCV_ISA_EXT_MAX);
+		riscv_parse_isa(hart_isa, isa);
+
+		if (first) {
+			bitmap_copy(riscv_isa.isa, hart_isa, RISCV_ISA_EXT_MAX);
+			first = false;
+		} else if (!bitmap_equal(riscv_isa.isa, hart_isa,
+					 RISCV_ISA_EXT_MAX)) {
+			pr_info("hart %d has ISA \"%s\", using the common subset\n",
+				hart, isa);
+			bitmap_and(riscv_isa.isa, riscv_isa.isa, hart_isa,
+				   RISCV_ISA_EXT_MAX);
+		}
 	}
 
-	if (of_property_read_string(node, "riscv,isa", &isa)) {
-		pr_warning("Unable to find \"riscv,isa\" devicetree entry");
+	if (first) {
+		pr_warning("Unable to find a usable \"cpu\" devicetree entry");
 		return;
 	}
 
-	for (i = 0; i < strlen(isa); ++i)
-		elf_hwcap |= isa2hwcap[(unsigned char)(isa[i])];
+	/* The letter bits are the COMPAT_HWCAP_ISA_* bits */
+	elf_hwcap = riscv_isa.isa[0] & hwcap_mask;
 
 	pr_info("elf_hwcap is 0x%lx", elf_hwcap);
+	pr_info("riscv_isa is %*pb", RISCV_ISA_EXT_MAX, riscv_isa.isa);
+
+	if (riscv_isa_extension_available(RISCV_ISA_EXT_v))
+		riscv_v_setup_vsize();
 }
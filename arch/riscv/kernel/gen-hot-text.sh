@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# Turn a list of hot kernel functions into the input section list that
+# vmlinux.lds.S pulls to the start of .text when CONFIG_RISCV_HOT_TEXT
+# is set, so that the hot paths share as few icache lines and TLB
+# entries as possible.
+#
+# The list is read in order, hottest first.  It may be either one symbol
+# per line, or the output of
+#
+#	perf report --no-children --sort symbol --stdio -q
+#
+# from which only kernel ("[k]") samples are used.  Lines starting with
+# '*' are copied as they are, for assembly that has no per-function
+# section (e.g. "*:entry.o(.text)").  Blank lines and '#' comments are
+# skipped.  Without a list only .text.hot is ordered.
+#
+# Copyright (C) 2017 SiFive
+
+echo "/* Generated by $0, do not edit */"
+
+test -n "$1" || exit 0
+
+if ! test -r "$1"; then
+	echo "Could not read hot function list $1" >&2
+	exit 1
+fi
+
+awk '
+/^[ \t]*(#|$)/	{ next }
+/^[ \t]*\*/	{ sub(/^[ \t]+/, ""); print "\t\t" $0; next }
+/\[k\]/		{ sym = $NF }
+!/\[[.a-z]\]/	{ sym = $1 }
+sym != "" && !(sym in seen) {
+	seen[sym] = 1
+	print "\t\t*(.text." sym ")"
+}
+		{ sym = "" }
+' "$1"
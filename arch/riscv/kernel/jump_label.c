@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/bug.h>
+#include <linux/jump_label.h>
+#include <linux/kernel.h>
+#include <linux/sizes.h>
+#include <linux/uaccess.h>
+
+#include <asm/cacheflush.h>
+
+#define RISCV_INSN_NOP	0x00000013U
+#define RISCV_INSN_JAL	0x0000006fU	/* jal zero, 0 */
+
+static u32 jump_label_insn(struct jump_entry *entry,
+			   enum jump_label_type type)
+{
+	long offset = entry->target - entry->code;
+	u32 imm20, imm19_12, imm11, imm10_1;
+
+	if (type == JUMP_LABEL_NOP)
+		return RISCV_INSN_NOP;
+
+	/* both ends of a static branch live in the same function */
+	if (WARN_ON(offset & 1 || offset < -SZ_1M || offset >= SZ_1M))
+		return RISCV_INSN_NOP;
+
+	imm20 = (offset & 0x100000) << (31 - 20);
+	imm19_12 = (offset & 0xff000);
+	imm11 = (offset & 0x800) << (20 - 11);
+	imm10_1 = (offset & 0x7fe) << (30 - 10);
+
+	return RISCV_INSN_JAL | imm20 | imm19_12 | imm11 | imm10_1;
+}
+
+/*
+ * A naturally aligned 32-bit store replaces the whole instruction at once,
+ * so other harts execute either the old or the new one and there is no
+ * need to stop them; a single fence.i broadcast makes the change visible.
+ */
+void arch_jump_label_transform(struct jump_entry *entry,
+			       enum jump_label_type type)
+{
+	u32 *addr = (u32 *)entry->code;
+	u32 insn = jump_label_insn(entry, type);
+
+	if (READ_ONCE(*addr) == insn)
+		return;
+
+	if (probe_kernel_write(addr, &insn, sizeof(insn)))
+		return;
+
+	flush_icache_range((unsigned long)addr,
+			   (unsigned long)addr + JUMP_LABEL_NOP_SIZE);
+}
+
+void arch_jump_label_transform_static(struct jump_entry *entry,
+				      enum jump_label_type type)
+{
+	/*
+	 * Every site is assembled as a nop by arch_static_branch(), so
+	 * there is nothing to write at boot or module load: the core calls
+	 * arch_jump_label_transform() later for the keys that are enabled.
+	 * This keeps the thousands of default-off tracepoints from costing
+	 * a fence.i broadcast each.
+	 */
+}
@@ -0,0 +1,200 @@
+/*
+ * Module PLT and GOT entries
+ *
+ * Based on arch/arm64/kernel/module-plts.c
+ *
+ * Copyright (C) 2014-2017 Linaro Ltd. <ard.biesheuvel@linaro.org>
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/elf.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleloader.h>
+#include <linux/sort.h>
+
+struct got_entry {
+	unsigned long	symbol_addr;
+};
+
+/*
+ * t0 and t1 are caller-saved and not used to pass arguments, so a call
+ * can always go through them.  The target sits in the entry itself.
+ */
+struct plt_entry {
+	u32		auipc;	/* auipc t0, 0		*/
+	u32		load;	/* REG_L t1, 16(t0)	*/
+	u32		jr;	/* jr t1		*/
+	u32		nop;
+	unsigned long	target;
+};
+
+#define PLT_AUIPC_T0		0x00000297
+#ifdef CONFIG_64BIT
+#define PLT_LOAD_T1		0x0102b303
+#else
+#define PLT_LOAD_T1		0x0102a303
+#endif
+#define PLT_JR_T1		0x00030067
+#define PLT_NOP			0x00000013
+
+/*
+ * Entries are few enough that a linear search for an existing one beats
+ * keeping an index; the counts below are only an upper bound.
+ */
+unsigned long module_emit_got_entry(struct module *mod, unsigned long val)
+{
+	struct mod_section *got_sec = &mod->arch.got;
+	struct got_entry *got = (struct got_entry *)got_sec->shdr->sh_addr;
+	int i;
+
+	for (i = 0; i < got_sec->num_entries; i++)
+		if (got[i].symbol_addr == val)
+			return (unsigned long)&got[i];
+
+	BUG_ON(got_sec->num_entries >= got_sec->max_entries);
+	got[i].symbol_addr = val;
+	got_sec->num_entries++;
+
+	return (unsigned long)&got[i];
+}
+
+unsigned long module_emit_plt_entry(struct module *mod, unsigned long val)
+{
+	struct mod_section *plt_sec = &mod->arch.plt;
+	struct plt_entry *plt = (struct plt_entry *)plt_sec->shdr->sh_addr;
+	int i;
+
+	for (i = 0; i < plt_sec->num_entries; i++)
+		if (plt[i].target == val)
+			return (unsigned long)&plt[i];
+
+	BUG_ON(plt_sec->num_entries >= plt_sec->max_entries);
+	plt[i] = (struct plt_entry){
+		PLT_AUIPC_T0, PLT_LOAD_T1, PLT_JR_T1, PLT_NOP, val
+	};
+	plt_sec->num_entries++;
+
+	return (unsigned long)&plt[i];
+}
+
+#define cmp_3way(a,b)	((a) < (b) ? -1 : (a) > (b))
+
+static int cmp_rela(const void *a, const void *b)
+{
+	const Elf_Rela *x = a, *y = b;
+	int i;
+
+	/* sort by type, symbol index and addend */
+	i = cmp_3way(ELF_R_TYPE(x->r_info), ELF_R_TYPE(y->r_info));
+	if (i == 0)
+		i = cmp_3way(ELF_R_SYM(x->r_info), ELF_R_SYM(y->r_info));
+	if (i == 0)
+		i = cmp_3way(x->r_addend, y->r_addend);
+	return i;
+}
+
+static bool duplicate_rela(const Elf_Rela *rela, int idx)
+{
+	/* Sorted, so a duplicate must be in the preceding slot */
+	return idx > 0 && cmp_rela(rela + idx, rela + idx - 1) == 0;
+}
+
+static void count_max_entries(Elf_Sym *syms, Elf_Rela *relas, int num,
+			      unsigned int dstidx, unsigned int *plts,
+			      unsigned int *gots)
+{
+	Elf_Sym *s;
+	int i;
+
+	for (i = 0; i < num; i++) {
+		if (duplicate_rela(relas, i))
+			continue;
+
+		switch (ELF_R_TYPE(relas[i].r_info)) {
+		case R_RISCV_CALL:
+		case R_RISCV_CALL_PLT:
+			/* Calls within a section never need a PLT */
+			s = syms + ELF_R_SYM(relas[i].r_info);
+			if (s->st_shndx != dstidx)
+				(*plts)++;
+			break;
+		case R_RISCV_GOT_HI20:
+			(*gots)++;
+			break;
+		}
+	}
+}
+
+int module_frob_arch_sections(Elf_Ehdr *ehdr, Elf_Shdr *sechdrs,
+			      char *secstrings, struct module *mod)
+{
+	unsigned int num_plts = 0;
+	unsigned int num_gots = 0;
+	Elf_Sym *syms = NULL;
+	int i;
+
+	/*
+	 * Find the empty .plt and .got sections from module.lds so we can
+	 * expand them.  Record the symtab address as well.
+	 */
+	for (i = 0; i < ehdr->e_shnum; i++) {
+		if (!strcmp(secstrings + sechdrs[i].sh_name, ".plt"))
+			mod->arch.plt.shdr = sechdrs + i;
+		else if (!strcmp(secstrings + sechdrs[i].sh_name, ".got"))
+			mod->arch.got.shdr = sechdrs + i;
+		else if (sechdrs[i].sh_type == SHT_SYMTAB)
+			syms = (Elf_Sym *)sechdrs[i].sh_addr;
+	}
+
+	if (!mod->arch.plt.shdr || !mod->arch.got.shdr) {
+		pr_err("%s: module PLT/GOT section(s) missing\n", mod->name);
+		return -ENOEXEC;
+	}
+	if (!syms) {
+		pr_err("%s: module symtab section missing\n", mod->name);
+		return -ENOEXEC;
+	}
+
+	for (i = 0; i < ehdr->e_shnum; i++) {
+		Elf_Rela *relas = (void *)ehdr + sechdrs[i].sh_offset;
+		int num_rela = sechdrs[i].sh_size / sizeof(Elf_Rela);
+		Elf_Shdr *dst_sec = sechdrs + sechdrs[i].sh_info;
+
+		if (sechdrs[i].sh_type != SHT_RELA)
+			continue;
+
+		/* ignore relocations that operate on non-exec sections */
+		if (!(dst_sec->sh_flags & SHF_EXECINSTR))
+			continue;
+
+		sort(relas, num_rela, sizeof(Elf_Rela), cmp_rela, NULL);
+		count_max_entries(syms, relas, num_rela, sechdrs[i].sh_info,
+				  &num_plts, &num_gots);
+	}
+
+	mod->arch.plt.shdr->sh_type = SHT_NOBITS;
+	mod->arch.plt.shdr->sh_flags = SHF_EXECINSTR | SHF_ALLOC;
+	mod->arch.plt.shdr->sh_addralign = L1_CACHE_BYTES;
+	mod->arch.plt.shdr->sh_size = (num_plts + 1) * sizeof(struct plt_entry);
+	mod->arch.plt.num_entries = 0;
+	mod->arch.plt.max_entries = num_plts;
+
+	mod->arch.got.shdr->sh_type = SHT_NOBITS;
+	mod->arch.got.shdr->sh_flags = SHF_ALLOC;
+	mod->arch.got.shdr->sh_addralign = L1_CACHE_BYTES;
+	mod->arch.got.shdr->sh_size = (num_gots + 1) * sizeof(struct got_entry);
+	mod->arch.got.num_entries = 0;
+	mod->arch.got.max_entries = num_gots;
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#define pr_fmt(fmt) "pv_time: " fmt
+
+#include <linux/cpuhotplug.h>
+#include <linux/export.h>
+#include <linux/init.h>
+#include <linux/jump_label.h>
+#include <linux/percpu.h>
+#include <linux/printk.h>
+#include <linux/types.h>
+#include <asm/barrier.h>
+#include <asm/paravirt.h>
+#include <asm/sbi.h>
+
+struct static_key paravirt_steal_enabled;
+struct static_key paravirt_steal_rq_enabled;
+
+struct pv_time_ops pv_time_ops;
+EXPORT_SYMBOL_GPL(pv_time_ops);
+
+/* Written by the hypervisor; all zeroes, so never preempted, until then */
+static DEFINE_PER_CPU(struct sbi_steal_time, pv_steal_time);
+
+static bool steal_acc = true;
+
+static int __init parse_no_stealacc(char *arg)
+{
+	steal_acc = false;
+	return 0;
+}
+early_param("no-steal-acc", parse_no_stealacc);
+
+static u64 pv_steal_clock(int cpu)
+{
+	struct sbi_steal_time *st = &per_cpu(pv_steal_time, cpu);
+	u32 version;
+	u64 steal;
+
+	do {
+		version = READ_ONCE(st->version);
+		virt_rmb();
+		steal = READ_ONCE(st->steal);
+		virt_rmb();
+	} while ((version & 1) || version != READ_ONCE(st->version));
+
+	return steal;
+}
+
+bool __vcpu_is_preempted(int cpu)
+{
+	return READ_ONCE(per_cpu(pv_steal_time, cpu).preempted);
+}
+EXPORT_SYMBOL(__vcpu_is_preempted);
+
+/* The record is per hart, so these run on the CPU coming or going */
+static int pv_time_cpu_online(unsigned int cpu)
+{
+	struct sbi_steal_time *st = &per_cpu(pv_steal_time, cpu);
+	long ret;
+
+	ret = sbi_steal_time_set(per_cpu_ptr_to_phys(st));
+	if (ret)
+		pr_warn("CPU%u: failed to register steal time record: %ld\n",
+			cpu, ret);
+
+	return 0;
+}
+
+static int pv_time_cpu_down_prepare(unsigned int cpu)
+{
+	sbi_steal_time_set(0);
+	return 0;
+}
+
+static int __init pv_time_init(void)
+{
+	int ret;
+
+	/* Stopping updates that never started is harmless, so use it to probe */
+	if (sbi_steal_time_set(0))
+		return 0;
+
+	ret = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "riscv/pv_time:online",
+				pv_time_cpu_online, pv_time_cpu_down_prepare);
+	if (ret < 0)
+		return ret;
+
+	pv_time_ops.steal_clock = pv_steal_clock;
+	static_key_slow_inc(&paravirt_steal_enabled);
+	if (steal_acc)
+		static_key_slow_inc(&paravirt_steal_rq_enabled);
+
+	pr_info("using paravirtualized steal time\n");
+
+	return 0;
+}
+early_initcall(pv_time_init);
@@ -0,0 +1,88 @@
+/*
+ * RISC-V callchain support
+ *
+ * Based on arch/arm64/kernel/perf_callchain.c
+ *
+ * Copyright (C) 2015 ARM Limited
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/perf_event.h>
+#include <linux/uaccess.h>
+
+#include <asm/stacktrace.h>
+
+/*
+ * The frame record user space code built with frame pointers keeps just
+ * below the address in s0.
+ */
+struct frame_tail {
+	struct frame_tail	__user *fp;
+	unsigned long		ra;
+};
+
+/*
+ * Get the return address for a single stackframe and return a pointer to
+ * the next frame tail.
+ */
+static struct frame_tail __user *
+user_backtrace(struct frame_tail __user *tail,
+	       struct perf_callchain_entry_ctx *entry)
+{
+	struct frame_tail buftail;
+	unsigned long err;
+
+	if ((unsigned long)tail & (sizeof(unsigned long) - 1))
+		return NULL;
+	if (!access_ok(VERIFY_READ, tail, sizeof(buftail)))
+		return NULL;
+
+	pagefault_disable();
+	err = __copy_from_user_inatomic(&buftail, tail, sizeof(buftail));
+	pagefault_enable();
+
+	if (err || !buftail.ra)
+		return NULL;
+
+	perf_callchain_store(entry, buftail.ra);
+
+	/* Frames strictly progress back up the stack */
+	if (tail + 1 >= buftail.fp)
+		return NULL;
+
+	return buftail.fp - 1;
+}
+
+void perf_callchain_user(struct perf_callchain_entry_ctx *entry,
+			 struct pt_regs *regs)
+{
+	struct frame_tail __user *tail;
+
+	perf_callchain_store(entry, GET_IP(regs));
+
+	tail = (struct frame_tail __user *)GET_FP(regs) - 1;
+	while (entry->nr < entry->max_stack && tail)
+		tail = user_backtrace(tail, entry);
+}
+
+static bool callchain_trace(unsigned long pc, void *data)
+{
+	struct perf_callchain_entry_ctx *entry = data;
+
+	return perf_callchain_store(entry, pc) != 0;
+}
+
+void perf_callchain_kernel(struct perf_callchain_entry_ctx *entry,
+			   struct pt_regs *regs)
+{
+	walk_stackframe(NULL, regs, callchain_trace, entry);
+}
@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+/*
+ * cycle and instret are always there.  The hpmcounters count whatever
+ * event machine mode has programmed into the matching mhpmevent, which
+ * supervisor mode cannot change, so they are exposed as raw events named
+ * by their counter number ("cpu/event=N/").
+ *
+ * The counters are free running and shared by everything on the hart,
+ * so an event is just a snapshot taken when it is scheduled in, and no
+ * counter is ever "allocated".  The privileged spec has no counter
+ * overflow interrupt, so only counting is supported: the perf core
+ * refuses sampling events on a PERF_PMU_CAP_NO_INTERRUPT PMU.
+ */
+
+#include <linux/errno.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/perf_event.h>
+#include <linux/stringify.h>
+
+#include <asm/asm.h>
+#include <asm/csr.h>
+#include <asm/perf_event.h>
+
+/* Counters that were readable when probed at boot */
+static unsigned long riscv_pmu_counters __read_mostly;
+
+/*
+ * CSR numbers are immediates, so every counter needs its own csrr.  The
+ * read carries an exception table entry: a counter that isn't
+ * implemented, or that M-mode hasn't opened up through mcounteren,
+ * raises an illegal instruction exception, and the fixup turns that into
+ * an error instead of an oops.
+ */
+#define __read_counter_csr(csr, val, err)			\
+do {								\
+	uintptr_t __tmp;					\
+	__asm__ __volatile__ (					\
+		"1:\n"						\
+		"	csrr %0, " __stringify(csr) "\n"	\
+		"2:\n"						\
+		"	.section .fixup,\"ax\"\n"		\
+		"	.balign 4\n"				\
+		"3:\n"						\
+		"	li %1, %3\n"				\
+		"	li %0, 0\n"				\
+		"	jump 2b, %2\n"				\
+		"	.previous\n"				\
+		"	.section __ex_table,\"a\"\n"		\
+		"	.balign " RISCV_SZPTR "\n"		\
+		"	" RISCV_PTR " 1b, 3b\n"			\
+		"	.previous"				\
+		: "=&r" (val), "+r" (err), "=r" (__tmp)	\
+		: "i" (-EINVAL));				\
+} while (0)
+
+#ifdef CONFIG_64BIT
+#define __read_counter(n, val, err)				\
+	__read_counter_csr(CSR_CYCLE + n, val, err)
+#else
+/* Re-read the high half until it is stable around the low half */
+#define __read_counter(n, val, err)				\
+do {								\
+	unsigned long __hi, __lo, __hi2;			\
+	do {							\
+		__read_counter_csr(CSR_CYCLEH + n, __hi, err);	\
+		__read_counter_csr(CSR_CYCLE + n, __lo, err);	\
+		__read_counter_csr(CSR_CYCLEH + n, __hi2, err);	\
+	} while (!err && __hi != __hi2);			\
+	val = ((u64)__hi << 32) | __lo;				\
+} while (0)
+#endif
+
+#define READ_COUNTER_CASE(n)					\
+	case n:							\
+		__read_counter(n, val, err);			\
+		break
+
+static int riscv_read_counter(int idx, u64 *value)
+{
+	u64 val = 0;
+	int err = 0;
+
+	switch (idx) {
+	READ_COUNTER_CASE(0);
+	READ_COUNTER_CASE(2);
+	READ_COUNTER_CASE(3);
+	READ_COUNTER_CASE(4);
+	READ_COUNTER_CASE(5);
+	READ_COUNTER_CASE(6);
+	READ_COUNTER_CASE(7);
+	READ_COUNTER_CASE(8);
+	READ_COUNTER_CASE(9);
+	READ_COUNTER_CASE(10);
+	READ_COUNTER_CASE(11);
+	READ_COUNTER_CASE(12);
+	READ_COUNTER_CASE(13);
+	READ_COUNTER_CASE(14);
+	READ_COUNTER_CASE(15);
+	READ_COUNTER_CASE(16);
+	READ_COUNTER_CASE(17);
+	READ_COUNTER_CASE(18);
+	READ_COUNTER_CASE(19);
+	READ_COUNTER_CASE(20);
+	READ_COUNTER_CASE(21);
+	READ_COUNTER_CASE(22);
+	READ_COUNTER_CASE(23);
+	READ_COUNTER_CASE(24);
+	READ_COUNTER_CASE(25);
+	READ_COUNTER_CASE(26);
+	READ_COUNTER_CASE(27);
+	READ_COUNTER_CASE(28);
+	READ_COUNTER_CASE(29);
+	READ_COUNTER_CASE(30);
+	READ_COUNTER_CASE(31);
+	default:
+		return -EINVAL;
+	}
+
+	*value = val;
+	return err;
+}
+
+static u64 riscv_pmu_read_counter(struct perf_event *event)
+{
+	u64 val;
+
+	/* Only counters that probed fine at boot get this far */
+	riscv_read_counter(event->hw.idx, &val);
+	return val;
+}
+
+static void riscv_pmu_event_update(struct perf_event *event)
+{
+	struct hw_perf_event *hwc = &event->hw;
+	u64 prev, now;
+
+	do {
+		prev = local64_read(&hwc->prev_count);
+		now = riscv_pmu_read_counter(event);
+	} while (local64_cmpxchg(&hwc->prev_count, prev, now) != prev);
+
+	local64_add(now - prev, &event->count);
+}
+
+static void riscv_pmu_start(struct perf_event *event, int flags)
+{
+	struct hw_perf_event *hwc = &event->hw;
+
+	if (WARN_ON_ONCE(!(hwc->state & PERF_HES_STOPPED)))
+		return;
+
+	hwc->state = 0;
+	local64_set(&hwc->prev_count, riscv_pmu_read_counter(event));
+	perf_event_update_userpage(event);
+}
+
+static void riscv_pmu_stop(struct perf_event *event, int flags)
+{
+	struct hw_perf_event *hwc = &event->hw;
+
+	if (hwc->state & PERF_HES_STOPPED)
+		return;
+
+	riscv_pmu_event_update(event);
+	hwc->state |= PERF_HES_STOPPED | PERF_HES_UPTODATE;
+}
+
+static int riscv_pmu_add(struct perf_event *event, int flags)
+{
+	event->hw.state = PERF_HES_STOPPED | PERF_HES_UPTODATE;
+
+	if (flags & PERF_EF_START)
+		riscv_pmu_start(event, PERF_EF_RELOAD);
+
+	return 0;
+}
+
+static void riscv_pmu_del(struct perf_event *event, int flags)
+{
+	riscv_pmu_stop(event, PERF_EF_UPDATE);
+	perf_event_update_userpage(event);
+}
+
+static void riscv_pmu_read(struct perf_event *event)
+{
+	riscv_pmu_event_update(event);
+}
+
+static int riscv_pmu_event_init(struct perf_event *event)
+{
+	struct perf_event_attr *attr = &event->attr;
+	int idx;
+
+	switch (attr->type) {
+	case PERF_TYPE_HARDWARE:
+		if (attr->config == PERF_COUNT_HW_CPU_CYCLES)
+			idx = RISCV_PMU_CYCLE;
+		else if (attr->config == PERF_COUNT_HW_INSTRUCTIONS)
+			idx = RISCV_PMU_INSTRET;
+		else
+			return -ENOENT;
+		break;
+	case PERF_TYPE_RAW:
+		if (attr->config >= RISCV_MAX_COUNTERS)
+			return -ENOENT;
+		idx = attr->config;
+		break;
+	default:
+		return -ENOENT;
+	}
+
+	if (!test_bit(idx, &riscv_pmu_counters))
+		return -ENOENT;
+
+	/* The counters tick in every privilege mode and can't be filtered */
+	if (attr->exclude_user || attr->exclude_kernel ||
+	    attr->exclude_hv || attr->exclude_idle)
+		return -EOPNOTSUPP;
+
+	event->hw.idx = idx;
+	return 0;
+}
+
+PMU_FORMAT_ATTR(event, "config:0-4");
+
+static struct attribute *riscv_pmu_format_attrs[] = {
+	&format_attr_event.attr,
+	NULL,
+};
+
+static struct attribute_group riscv_pmu_format_group = {
+	.name = "format",
+	.attrs = riscv_pmu_format_attrs,
+};
+
+static const struct attribute_group *riscv_pmu_attr_groups[] = {
+	&riscv_pmu_format_group,
+	NULL,
+};
+
+static struct pmu riscv_pmu = {
+	.task_ctx_nr	= perf_hw_context,
+	.event_init	= riscv_pmu_event_init,
+	.add		= riscv_pmu_add,
+	.del		= riscv_pmu_del,
+	.start		= riscv_pmu_start,
+	.stop		= riscv_pmu_stop,
+	.read		= riscv_pmu_read,
+	.attr_groups	= riscv_pmu_attr_groups,
+	.capabilities	= PERF_PMU_CAP_NO_INTERRUPT,
+};
+
+static int __init riscv_pmu_init(void)
+{
+	int idx;
+	u64 val;
+
+	for (idx = 0; idx < RISCV_MAX_COUNTERS; idx++) {
+		if (idx == RISCV_PMU_TIME)
+			continue;
+		if (riscv_read_counter(idx, &val) == 0)
+			__set_bit(idx, &riscv_pmu_counters);
+	}
+
+	if (!riscv_pmu_counters) {
+		pr_info("perf: no readable hardware counters\n");
+		return 0;
+	}
+
+	pr_info("perf: %d hardware counters (mask %#lx)\n",
+		hweight_long(riscv_pmu_counters), riscv_pmu_counters);
+	return perf_pmu_register(&riscv_pmu, "cpu", PERF_TYPE_RAW);
+}
+arch_initcall(riscv_pmu_init);
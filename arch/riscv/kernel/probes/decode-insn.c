@@ -0,0 +1,260 @@
+/*
+ * Based on arch/arm64/kernel/probes/decode-insn.c
+ *
+ * Copyright (C) 2013 Linaro Limited.
+ * Copyright (C) 2017 SiFive
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include <linux/kernel.h>
+#include <linux/kprobes.h>
+#include <linux/module.h>
+#include <linux/kallsyms.h>
+#include <linux/uaccess.h>
+#include <asm/sections.h>
+
+#include "decode-insn.h"
+#include "simulate-insn.h"
+
+#define RV_OPCODE(insn)		((insn) & 0x7f)
+#define RV_FUNCT3(insn)		(((insn) >> 12) & 0x7)
+#define RV_OPC_OP_IMM		0x13
+#define RV_OPC_AUIPC		0x17
+#define RV_OPC_STORE		0x23
+#define RV_OPC_AMO		0x2f
+#define RV_OPC_BRANCH		0x63
+#define RV_OPC_JALR		0x67
+#define RV_OPC_JAL		0x6f
+#define RV_OPC_SYSTEM		0x73
+
+#define RV_AMO_FUNCT5(insn)	((insn) >> 27)
+#define RV_AMO_LR		0x02
+#define RV_AMO_SC		0x03
+
+#define RVC_OP(insn)		((insn) & 0x3)
+#define RVC_FUNCT3(insn)	(((insn) >> 13) & 0x7)
+#define RVC_RS1(insn)		(((insn) >> 7) & 0x1f)
+#define RVC_RS2(insn)		(((insn) >> 2) & 0x1f)
+#define RVC_RD(insn)		RVC_RS1(insn)
+
+static inline bool rv_insn_is_lr(u32 insn)
+{
+	return RV_OPCODE(insn) == RV_OPC_AMO &&
+	       RV_AMO_FUNCT5(insn) == RV_AMO_LR;
+}
+
+static inline bool rv_insn_is_sc(u32 insn)
+{
+	return RV_OPCODE(insn) == RV_OPC_AMO &&
+	       RV_AMO_FUNCT5(insn) == RV_AMO_SC;
+}
+
+static enum probe_insn __kprobes
+riscv_probe_decode_compressed(probe_opcode_t insn, struct arch_probe_insn *api)
+{
+	/* the all-zero halfword is defined to be illegal */
+	if (insn == 0)
+		return INSN_REJECTED;
+
+	/* c.addi4spn, sets up the frame pointer */
+	if (RVC_OP(insn) == 0x0 && RVC_FUNCT3(insn) == 0x0) {
+		api->handler = simulate_c_addi4spn;
+		return INSN_GOOD_NO_SLOT;
+	}
+
+	if (RVC_OP(insn) == 0x1) {
+		switch (RVC_FUNCT3(insn)) {
+		case 0x0:
+			/* c.addi and c.nop */
+			api->handler = simulate_c_addi;
+			return INSN_GOOD_NO_SLOT;
+		case 0x1:
+			/* c.jal on RV32, c.addiw on RV64 */
+			if (IS_ENABLED(CONFIG_64BIT))
+				return INSN_GOOD;
+			api->handler = simulate_c_jal;
+			return INSN_GOOD_NO_SLOT;
+		case 0x2:
+			api->handler = simulate_c_li;
+			return INSN_GOOD_NO_SLOT;
+		case 0x3:
+			/* c.addi16sp; the rest is c.lui */
+			if (RVC_RD(insn) != 2)
+				break;
+			api->handler = simulate_c_addi16sp;
+			return INSN_GOOD_NO_SLOT;
+		case 0x5:
+			api->handler = simulate_c_j;
+			return INSN_GOOD_NO_SLOT;
+		case 0x6:
+			api->handler = simulate_c_beqz;
+			return INSN_GOOD_NO_SLOT;
+		case 0x7:
+			api->handler = simulate_c_bnez;
+			return INSN_GOOD_NO_SLOT;
+		}
+	}
+
+	/* c.jr, c.jalr and c.ebreak: funct4 100x with rs2 == 0 */
+	if (RVC_OP(insn) == 0x2 && RVC_FUNCT3(insn) == 0x4 &&
+	    RVC_RS2(insn) == 0) {
+		if (RVC_RS1(insn) == 0)
+			return INSN_REJECTED;
+		api->handler = (insn & (1 << 12)) ? simulate_c_jalr
+						  : simulate_c_jr;
+		return INSN_GOOD_NO_SLOT;
+	}
+
+	/* c.mv: funct4 1000 with rs2 != 0 */
+	if (RVC_OP(insn) == 0x2 && RVC_FUNCT3(insn) == 0x4 &&
+	    !(insn & (1 << 12))) {
+		api->handler = simulate_c_mv;
+		return INSN_GOOD_NO_SLOT;
+	}
+
+	return INSN_GOOD;
+}
+
+/*
+ * Decide how a probed instruction gets executed: out of line in a slot
+ * (INSN_GOOD), simulated because it depends on the pc (INSN_GOOD_NO_SLOT),
+ * or not at all.  Anything in the SYSTEM opcode traps or touches CSRs,
+ * and an LR/SC pair never succeeds if a breakpoint sits between the two.
+ */
+enum probe_insn __kprobes
+riscv_probe_decode_insn(probe_opcode_t insn, struct arch_probe_insn *api)
+{
+	api->handler = NULL;
+
+	if (RISCV_INSN_LEN(insn) == 2)
+		return riscv_probe_decode_compressed(insn & 0xffff, api);
+
+	/* 48-bit and longer encodings */
+	if ((insn & 0x1c) == 0x1c)
+		return INSN_REJECTED;
+
+	switch (RV_OPCODE(insn)) {
+	case RV_OPC_OP_IMM:
+		/* addi, which also covers mv, li and nop */
+		if (RV_FUNCT3(insn) != 0)
+			break;
+		api->handler = simulate_addi;
+		return INSN_GOOD_NO_SLOT;
+	case RV_OPC_AUIPC:
+		api->handler = simulate_auipc;
+		return INSN_GOOD_NO_SLOT;
+	case RV_OPC_JAL:
+		api->handler = simulate_jal;
+		return INSN_GOOD_NO_SLOT;
+	case RV_OPC_JALR:
+		api->handler = simulate_jalr;
+		return INSN_GOOD_NO_SLOT;
+	case RV_OPC_BRANCH:
+		/* funct3 2 and 3 are reserved */
+		if ((insn & 0x6000) == 0x2000)
+			return INSN_REJECTED;
+		api->handler = simulate_branch;
+		return INSN_GOOD_NO_SLOT;
+	case RV_OPC_SYSTEM:
+		return INSN_REJECTED;
+	case RV_OPC_AMO:
+		if (rv_insn_is_lr(insn) || rv_insn_is_sc(insn))
+			return INSN_REJECTED;
+		break;
+	}
+
+	return INSN_GOOD;
+}
+
+/*
+ * Integer stores, compressed or not, that simulate_store_user() knows.
+ * They are what a function prologue spills its registers with.
+ */
+bool riscv_probe_insn_is_store(probe_opcode_t insn)
+{
+	if (RISCV_INSN_LEN(insn) == 4)
+		return RV_OPCODE(insn) == RV_OPC_STORE &&
+		       (RV_FUNCT3(insn) == 2 ||
+			(IS_ENABLED(CONFIG_64BIT) && RV_FUNCT3(insn) == 3));
+
+	/* c.swsp, and c.sdsp which is c.fswsp on RV32 */
+	return RVC_OP(insn) == 0x2 &&
+	       (RVC_FUNCT3(insn) == 0x6 ||
+		(IS_ENABLED(CONFIG_64BIT) && RVC_FUNCT3(insn) == 0x7));
+}
+
+#ifdef CONFIG_KPROBES
+/*
+ * Instructions are 2 or 4 bytes long, so there is no decoding backwards:
+ * look at every halfword boundary instead.  A misparsed halfword can only
+ * make us reject a probe that would have been safe.
+ */
+static bool __kprobes
+is_probed_address_atomic(unsigned long scan_start, unsigned long scan_end)
+{
+	u32 insn;
+
+	for (; scan_start >= scan_end; scan_start -= 2) {
+		if (probe_kernel_read(&insn, (void *)scan_start, sizeof(insn)))
+			return false;
+		/*
+		 * atomic region starts from a load-reserved and ends with a
+		 * store-conditional.
+		 */
+		if (rv_insn_is_sc(insn))
+			return false;
+		else if (rv_insn_is_lr(insn))
+			return true;
+	}
+
+	return false;
+}
+
+enum probe_insn __kprobes
+riscv_kprobe_decode_insn(kprobe_opcode_t *addr, struct arch_specific_insn *asi)
+{
+	enum probe_insn decoded;
+	probe_opcode_t insn = 0;
+	unsigned long probe_addr = (unsigned long)addr;
+	unsigned long scan_end = 0;
+	unsigned long size = 0, offset = 0;
+
+	if (probe_kernel_read(&insn, addr, 2))
+		return INSN_REJECTED;
+	if (RISCV_INSN_LEN(insn) == 4 &&
+	    probe_kernel_read((u16 *)&insn + 1, (u16 *)addr + 1, 2))
+		return INSN_REJECTED;
+
+	/*
+	 * If there's a symbol defined in front of and near enough to
+	 * the probe address assume it is the entry point to this
+	 * code and use it to further limit how far back we search
+	 * when determining if we're in an atomic sequence. If we could
+	 * not find any symbol skip the atomic test altogether as we
+	 * could otherwise end up searching irrelevant text/literals.
+	 * KPROBES depends on KALLSYMS so this last case should never
+	 * happen.
+	 */
+	if (kallsyms_lookup_size_offset(probe_addr, &size, &offset)) {
+		if (offset < MAX_ATOMIC_CONTEXT_SIZE)
+			scan_end = probe_addr - offset;
+		else
+			scan_end = probe_addr - MAX_ATOMIC_CONTEXT_SIZE;
+	}
+	decoded = riscv_probe_decode_insn(insn, &asi->api);
+
+	if (decoded != INSN_REJECTED && scan_end)
+		if (is_probed_address_atomic(probe_addr - 2, scan_end))
+			return INSN_REJECTED;
+
+	return decoded;
+}
+#endif
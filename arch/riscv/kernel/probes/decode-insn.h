@@ -0,0 +1,43 @@
+/*
+ * Based on arch/arm64/kernel/probes/decode-insn.h
+ *
+ * Copyright (C) 2013 Linaro Limited.
+ * Copyright (C) 2017 SiFive
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef _RISCV_KERNEL_PROBES_DECODE_INSN_H
+#define _RISCV_KERNEL_PROBES_DECODE_INSN_H
+
+#include <asm/probes.h>
+
+/*
+ * An LR/SC sequence may be at most 16 instructions long; the ISA only
+ * guarantees forward progress for those, and a trap in the middle of one
+ * throws the reservation away.
+ */
+#define MAX_ATOMIC_CONTEXT_SIZE	(16 * 4)
+
+enum probe_insn {
+	INSN_REJECTED,
+	INSN_GOOD_NO_SLOT,
+	INSN_GOOD,
+};
+
+#ifdef CONFIG_KPROBES
+enum probe_insn __kprobes
+riscv_kprobe_decode_insn(kprobe_opcode_t *addr, struct arch_specific_insn *asi);
+#endif
+enum probe_insn __kprobes
+riscv_probe_decode_insn(probe_opcode_t insn, struct arch_probe_insn *asi);
+bool riscv_probe_insn_is_store(probe_opcode_t insn);
+
+#endif /* _RISCV_KERNEL_PROBES_DECODE_INSN_H */
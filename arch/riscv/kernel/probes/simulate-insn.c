@@ -0,0 +1,326 @@
+/*
+ * Based on arch/arm64/kernel/probes/simulate-insn.c
+ *
+ * Copyright (C) 2013 Linaro Limited.
+ * Copyright (C) 2017 SiFive
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include <linux/bitops.h>
+#include <linux/kernel.h>
+#include <linux/kprobes.h>
+#include <linux/uaccess.h>
+
+#include "simulate-insn.h"
+
+/*
+ * struct pt_regs lays x1..x31 out in register-number order right after
+ * sepc, so x<n> is simply the n-th word.  x0 reads as zero and ignores
+ * writes.
+ */
+static inline unsigned long rv_reg_get(struct pt_regs *regs, u32 index)
+{
+	return index ? ((unsigned long *)regs)[index] : 0;
+}
+
+static inline void rv_reg_set(struct pt_regs *regs, u32 index,
+			      unsigned long val)
+{
+	if (index)
+		((unsigned long *)regs)[index] = val;
+}
+
+#define RV_RD(insn)		(((insn) >> 7) & 0x1f)
+#define RV_RS1(insn)		(((insn) >> 15) & 0x1f)
+#define RV_RS2(insn)		(((insn) >> 20) & 0x1f)
+#define RV_FUNCT3(insn)		(((insn) >> 12) & 0x7)
+
+/* rs1 of the CR format; rs1' of CB is one of x8..x15 */
+#define RVC_RS1(insn)		(((insn) >> 7) & 0x1f)
+#define RVC_RS1S(insn)		(8 + (((insn) >> 7) & 0x7))
+#define RVC_RS2(insn)		(((insn) >> 2) & 0x1f)
+#define RVC_RDS(insn)		(8 + (((insn) >> 2) & 0x7))
+#define RVC_FUNCT3(insn)	(((insn) >> 13) & 0x7)
+
+static inline long rv_imm_u(u32 insn)
+{
+	return (s32)(insn & 0xfffff000);
+}
+
+static inline long rv_imm_i(u32 insn)
+{
+	return (s32)insn >> 20;
+}
+
+static inline long rv_imm_s(u32 insn)
+{
+	return ((s32)insn >> 25) << 5 | ((insn >> 7) & 0x1f);
+}
+
+static inline long rv_imm_j(u32 insn)
+{
+	u32 imm = ((insn >> 31) & 0x1) << 20 |
+		  ((insn >> 21) & 0x3ff) << 1 |
+		  ((insn >> 20) & 0x1) << 11 |
+		  ((insn >> 12) & 0xff) << 12;
+
+	return sign_extend32(imm, 20);
+}
+
+static inline long rv_imm_b(u32 insn)
+{
+	u32 imm = ((insn >> 31) & 0x1) << 12 |
+		  ((insn >> 25) & 0x3f) << 5 |
+		  ((insn >> 8) & 0xf) << 1 |
+		  ((insn >> 7) & 0x1) << 11;
+
+	return sign_extend32(imm, 12);
+}
+
+static inline long rvc_imm_cj(u32 insn)
+{
+	u32 imm = ((insn >> 12) & 0x1) << 11 |
+		  ((insn >> 11) & 0x1) << 4 |
+		  ((insn >> 9) & 0x3) << 8 |
+		  ((insn >> 8) & 0x1) << 10 |
+		  ((insn >> 7) & 0x1) << 6 |
+		  ((insn >> 6) & 0x1) << 7 |
+		  ((insn >> 3) & 0x7) << 1 |
+		  ((insn >> 2) & 0x1) << 5;
+
+	return sign_extend32(imm, 11);
+}
+
+/* the 6-bit signed immediate of c.addi and c.li */
+static inline long rvc_imm_ci(u32 insn)
+{
+	u32 imm = ((insn >> 12) & 0x1) << 5 |
+		  ((insn >> 2) & 0x1f);
+
+	return sign_extend32(imm, 5);
+}
+
+static inline long rvc_imm_addi16sp(u32 insn)
+{
+	u32 imm = ((insn >> 12) & 0x1) << 9 |
+		  ((insn >> 6) & 0x1) << 4 |
+		  ((insn >> 5) & 0x1) << 6 |
+		  ((insn >> 3) & 0x3) << 7 |
+		  ((insn >> 2) & 0x1) << 5;
+
+	return sign_extend32(imm, 9);
+}
+
+static inline unsigned long rvc_imm_addi4spn(u32 insn)
+{
+	return ((insn >> 7) & 0xf) << 6 |
+	       ((insn >> 11) & 0x3) << 4 |
+	       ((insn >> 5) & 0x1) << 3 |
+	       ((insn >> 6) & 0x1) << 2;
+}
+
+static inline long rvc_imm_cb(u32 insn)
+{
+	u32 imm = ((insn >> 12) & 0x1) << 8 |
+		  ((insn >> 10) & 0x3) << 3 |
+		  ((insn >> 5) & 0x3) << 6 |
+		  ((insn >> 3) & 0x3) << 1 |
+		  ((insn >> 2) & 0x1) << 5;
+
+	return sign_extend32(imm, 8);
+}
+
+void __kprobes
+simulate_auipc(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	rv_reg_set(regs, RV_RD(opcode), addr + rv_imm_u(opcode));
+	instruction_pointer_set(regs, addr + 4);
+}
+
+void __kprobes
+simulate_jal(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	rv_reg_set(regs, RV_RD(opcode), addr + 4);
+	instruction_pointer_set(regs, addr + rv_imm_j(opcode));
+}
+
+void __kprobes
+simulate_jalr(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	/* rs1 may be rd too, so compute the target before linking */
+	unsigned long target = rv_reg_get(regs, RV_RS1(opcode)) +
+			       rv_imm_i(opcode);
+
+	rv_reg_set(regs, RV_RD(opcode), addr + 4);
+	instruction_pointer_set(regs, target & ~1UL);
+}
+
+void __kprobes
+simulate_branch(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	unsigned long rs1 = rv_reg_get(regs, RV_RS1(opcode));
+	unsigned long rs2 = rv_reg_get(regs, RV_RS2(opcode));
+	bool taken;
+
+	switch (RV_FUNCT3(opcode)) {
+	case 0:		/* beq */
+		taken = rs1 == rs2;
+		break;
+	case 1:		/* bne */
+		taken = rs1 != rs2;
+		break;
+	case 4:		/* blt */
+		taken = (long)rs1 < (long)rs2;
+		break;
+	case 5:		/* bge */
+		taken = (long)rs1 >= (long)rs2;
+		break;
+	case 6:		/* bltu */
+		taken = rs1 < rs2;
+		break;
+	case 7:		/* bgeu */
+		taken = rs1 >= rs2;
+		break;
+	default:	/* rejected by the decoder */
+		taken = false;
+		break;
+	}
+
+	instruction_pointer_set(regs, taken ? addr + rv_imm_b(opcode)
+					    : addr + 4);
+}
+
+void __kprobes
+simulate_c_j(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	instruction_pointer_set(regs, addr + rvc_imm_cj(opcode));
+}
+
+void __kprobes
+simulate_c_jal(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	regs->ra = addr + 2;
+	instruction_pointer_set(regs, addr + rvc_imm_cj(opcode));
+}
+
+void __kprobes
+simulate_c_jr(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	instruction_pointer_set(regs,
+				rv_reg_get(regs, RVC_RS1(opcode)) & ~1UL);
+}
+
+void __kprobes
+simulate_c_jalr(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	unsigned long target = rv_reg_get(regs, RVC_RS1(opcode));
+
+	regs->ra = addr + 2;
+	instruction_pointer_set(regs, target & ~1UL);
+}
+
+void __kprobes
+simulate_c_beqz(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	if (!rv_reg_get(regs, RVC_RS1S(opcode)))
+		instruction_pointer_set(regs, addr + rvc_imm_cb(opcode));
+	else
+		instruction_pointer_set(regs, addr + 2);
+}
+
+void __kprobes
+simulate_c_bnez(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	if (rv_reg_get(regs, RVC_RS1S(opcode)))
+		instruction_pointer_set(regs, addr + rvc_imm_cb(opcode));
+	else
+		instruction_pointer_set(regs, addr + 2);
+}
+
+void __kprobes
+simulate_addi(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	rv_reg_set(regs, RV_RD(opcode),
+		   rv_reg_get(regs, RV_RS1(opcode)) + rv_imm_i(opcode));
+	instruction_pointer_set(regs, addr + 4);
+}
+
+void __kprobes
+simulate_c_addi(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	rv_reg_set(regs, RVC_RS1(opcode),
+		   rv_reg_get(regs, RVC_RS1(opcode)) + rvc_imm_ci(opcode));
+	instruction_pointer_set(regs, addr + 2);
+}
+
+void __kprobes
+simulate_c_addi16sp(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	regs->sp += rvc_imm_addi16sp(opcode);
+	instruction_pointer_set(regs, addr + 2);
+}
+
+void __kprobes
+simulate_c_addi4spn(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	rv_reg_set(regs, RVC_RDS(opcode), regs->sp + rvc_imm_addi4spn(opcode));
+	instruction_pointer_set(regs, addr + 2);
+}
+
+void __kprobes
+simulate_c_li(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	rv_reg_set(regs, RVC_RS1(opcode), rvc_imm_ci(opcode));
+	instruction_pointer_set(regs, addr + 2);
+}
+
+void __kprobes
+simulate_c_mv(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	rv_reg_set(regs, RVC_RS1(opcode), rv_reg_get(regs, RVC_RS2(opcode)));
+	instruction_pointer_set(regs, addr + 2);
+}
+
+/*
+ * sw, sd, c.swsp and c.sdsp, as picked by riscv_probe_insn_is_store().
+ * Little endian, so the low bytes of the register come first either way.
+ */
+bool simulate_store_user(u32 opcode, unsigned long addr, struct pt_regs *regs)
+{
+	unsigned long base, val;
+	unsigned int len;
+	long off;
+
+	if (RISCV_INSN_LEN(opcode) == 4) {
+		base = rv_reg_get(regs, RV_RS1(opcode));
+		val = rv_reg_get(regs, RV_RS2(opcode));
+		off = rv_imm_s(opcode);
+		len = RV_FUNCT3(opcode) == 3 ? 8 : 4;
+	} else {
+		base = regs->sp;
+		val = rv_reg_get(regs, RVC_RS2(opcode));
+		if (RVC_FUNCT3(opcode) == 0x7) {
+			off = ((opcode >> 10) & 0x7) << 3 |
+			      ((opcode >> 7) & 0x7) << 6;
+			len = 8;
+		} else {
+			off = ((opcode >> 9) & 0xf) << 2 |
+			      ((opcode >> 7) & 0x3) << 6;
+			len = 4;
+		}
+	}
+
+	if (copy_to_user((void __user *)(base + off), &val, len))
+		return false;
+
+	instruction_pointer_set(regs, addr + RISCV_INSN_LEN(opcode));
+	return true;
+}
@@ -0,0 +1,49 @@
+/*
+ * Based on arch/arm64/kernel/probes/simulate-insn.h
+ *
+ * Copyright (C) 2013 Linaro Limited
+ * Copyright (C) 2017 SiFive
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef _RISCV_KERNEL_PROBES_SIMULATE_INSN_H
+#define _RISCV_KERNEL_PROBES_SIMULATE_INSN_H
+
+/*
+ * Everything that reads or writes the pc has to be simulated: stepped
+ * out of line it would act relative to the slot instead of the probe.
+ */
+void simulate_auipc(u32 opcode, unsigned long addr, struct pt_regs *regs);
+void simulate_jal(u32 opcode, unsigned long addr, struct pt_regs *regs);
+void simulate_jalr(u32 opcode, unsigned long addr, struct pt_regs *regs);
+void simulate_branch(u32 opcode, unsigned long addr, struct pt_regs *regs);
+void simulate_c_j(u32 opcode, unsigned long addr, struct pt_regs *regs);
+void simulate_c_jal(u32 opcode, unsigned long addr, struct pt_regs *regs);
+void simulate_c_jr(u32 opcode, unsigned long addr, struct pt_regs *regs);
+void simulate_c_jalr(u32 opcode, unsigned long addr, struct pt_regs *regs);
+void simulate_c_beqz(u32 opcode, unsigned long addr, struct pt_regs *regs);
+void simulate_c_bnez(u32 opcode, unsigned long addr, struct pt_regs *regs);
+
+/*
+ * The usual function prologue only adjusts sp and s0 and moves registers
+ * around; doing that here spares the single-step.
+ */
+void simulate_addi(u32 opcode, unsigned long addr, struct pt_regs *regs);
+void simulate_c_addi(u32 opcode, unsigned long addr, struct pt_regs *regs);
+void simulate_c_addi16sp(u32 opcode, unsigned long addr, struct pt_regs *regs);
+void simulate_c_addi4spn(u32 opcode, unsigned long addr, struct pt_regs *regs);
+void simulate_c_li(u32 opcode, unsigned long addr, struct pt_regs *regs);
+void simulate_c_mv(u32 opcode, unsigned long addr, struct pt_regs *regs);
+
+/* For uprobes only: stores through put_user, false if that faults */
+bool simulate_store_user(u32 opcode, unsigned long addr, struct pt_regs *regs);
+
+#endif /* _RISCV_KERNEL_PROBES_SIMULATE_INSN_H */
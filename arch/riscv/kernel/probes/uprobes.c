@@ -0,0 +1,199 @@
+/*
+ * Based on arch/arm64/kernel/probes/uprobes.c
+ *
+ * Copyright (C) 2014-2016 Pratyush Anand <panand@redhat.com>
+ * Copyright (C) 2017 SiFive
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/highmem.h>
+#include <linux/ptrace.h>
+#include <linux/uprobes.h>
+#include <asm/cacheflush.h>
+
+#include "decode-insn.h"
+#include "simulate-insn.h"
+
+#define UPROBE_TRAP_NR	UINT_MAX
+
+void arch_uprobe_copy_ixol(struct page *page, unsigned long vaddr,
+		void *src, unsigned long len)
+{
+	void *xol_page_kaddr = kmap_atomic(page);
+	void *dst = xol_page_kaddr + (vaddr & ~PAGE_MASK);
+
+	/* Initialize the slot */
+	memcpy(dst, src, len);
+
+	kunmap_atomic(xol_page_kaddr);
+
+	/* only this thread is about to step through the slot */
+	flush_icache_mm(current->mm, false);
+}
+
+unsigned long uprobe_get_swbp_addr(struct pt_regs *regs)
+{
+	return instruction_pointer(regs);
+}
+
+int arch_uprobe_analyze_insn(struct arch_uprobe *auprobe, struct mm_struct *mm,
+		unsigned long addr)
+{
+	probe_opcode_t insn;
+	u32 ebreak = RISCV_INSN_EBREAK;
+
+	if (!IS_ALIGNED(addr, 2))
+		return -EINVAL;
+
+	memcpy(&insn, auprobe->insn, sizeof(insn));
+	auprobe->insn_size = RISCV_INSN_LEN(insn);
+	if (auprobe->insn_size == 2)
+		insn &= 0xffff;
+
+	/* without C the breakpoint would clobber the next instruction */
+	if (auprobe->insn_size < UPROBE_SWBP_INSN_SIZE)
+		return -ENOTSUPP;
+
+	switch (riscv_probe_decode_insn(insn, &auprobe->api)) {
+	case INSN_REJECTED:
+		return -EINVAL;
+
+	case INSN_GOOD_NO_SLOT:
+		auprobe->simulate = true;
+		break;
+
+	default:
+		auprobe->store = riscv_probe_insn_is_store(insn);
+		break;
+	}
+
+	/* the slot steps the instruction, then traps back on the ebreak */
+	memcpy(auprobe->ixol, &insn, auprobe->insn_size);
+	memcpy(auprobe->ixol + auprobe->insn_size, &ebreak, sizeof(ebreak));
+
+	return 0;
+}
+
+int arch_uprobe_pre_xol(struct arch_uprobe *auprobe, struct pt_regs *regs)
+{
+	struct uprobe_task *utask = current->utask;
+
+	/* Initialize with an invalid cause to detect if ol insn trapped */
+	utask->autask.saved_cause = current->thread.bad_cause;
+	current->thread.bad_cause = UPROBE_TRAP_NR;
+
+	/* Instruction points to execute ol */
+	instruction_pointer_set(regs, utask->xol_vaddr);
+
+	return 0;
+}
+
+int arch_uprobe_post_xol(struct arch_uprobe *auprobe, struct pt_regs *regs)
+{
+	struct uprobe_task *utask = current->utask;
+
+	WARN_ON_ONCE(current->thread.bad_cause != UPROBE_TRAP_NR);
+	current->thread.bad_cause = utask->autask.saved_cause;
+
+	/* Instruction points to execute next to breakpoint address */
+	instruction_pointer_set(regs, utask->vaddr + auprobe->insn_size);
+
+	return 0;
+}
+
+bool arch_uprobe_xol_was_trapped(struct task_struct *t)
+{
+	/*
+	 * Between arch_uprobe_pre_xol and arch_uprobe_post_xol, if an xol
+	 * insn itself is trapped, then detect the case with the help of
+	 * invalid cause which is being set in arch_uprobe_pre_xol
+	 */
+	if (t->thread.bad_cause != UPROBE_TRAP_NR)
+		return true;
+
+	return false;
+}
+
+bool arch_uprobe_skip_sstep(struct arch_uprobe *auprobe, struct pt_regs *regs)
+{
+	probe_opcode_t insn = 0;
+	unsigned long addr;
+
+	if (!auprobe->simulate && !auprobe->store)
+		return false;
+
+	memcpy(&insn, auprobe->insn, auprobe->insn_size);
+	addr = instruction_pointer(regs);
+
+	/* a faulting store is stepped for real to get the right signal */
+	if (auprobe->store)
+		return simulate_store_user(insn, addr, regs);
+
+	if (auprobe->api.handler)
+		auprobe->api.handler(insn, addr, regs);
+
+	return true;
+}
+
+void arch_uprobe_abort_xol(struct arch_uprobe *auprobe, struct pt_regs *regs)
+{
+	struct uprobe_task *utask = current->utask;
+
+	current->thread.bad_cause = utask->autask.saved_cause;
+
+	/*
+	 * Task has received a fatal signal, so reset back to probbed
+	 * address.
+	 */
+	instruction_pointer_set(regs, utask->vaddr);
+}
+
+bool arch_uretprobe_is_alive(struct return_instance *ret, enum rp_check ctx,
+		struct pt_regs *regs)
+{
+	if (ctx == RP_CHECK_CHAIN_CALL)
+		return regs->sp <= ret->stack;
+	else
+		return regs->sp < ret->stack;
+}
+
+unsigned long
+arch_uretprobe_hijack_return_addr(unsigned long trampoline_vaddr,
+				  struct pt_regs *regs)
+{
+	unsigned long orig_ret_vaddr;
+
+	orig_ret_vaddr = regs->ra;
+	/* Replace the return addr with trampoline addr */
+	regs->ra = trampoline_vaddr;
+
+	return orig_ret_vaddr;
+}
+
+int arch_uprobe_exception_notify(struct notifier_block *self,
+				 unsigned long val, void *data)
+{
+	return NOTIFY_DONE;
+}
+
+bool uprobe_breakpoint_handler(struct pt_regs *regs)
+{
+	return uprobe_pre_sstep_notifier(regs);
+}
+
+bool uprobe_single_step_handler(struct pt_regs *regs)
+{
+	struct uprobe_task *utask = current->utask;
+
+	if (!utask || utask->state != UTASK_SSTEP)
+		return false;
+
+	/* the ebreak sits right behind the stepped 2- or 4-byte insn */
+	if (instruction_pointer(regs) != utask->xol_vaddr + 2 &&
+	    instruction_pointer(regs) != utask->xol_vaddr + 4)
+		return false;
+
+	return uprobe_post_sstep_notifier(regs);
+}
@@ -21,6 +21,7 @@
  */
 
 #include <linux/kernel.h>
+#include <linux/init.h>
 #include <linux/sched.h>
 #include <linux/sched/task_stack.h>
 #include <linux/tick.h>
@@ -32,10 +33,31 @@
 #include <asm/csr.h>
 #include <asm/string.h>
 #include <asm/switch_to.h>
+#include <asm/vector.h>
 
 extern asmlinkage void ret_from_fork(void);
 extern asmlinkage void ret_from_kernel_thread(void);
 
+enum fpu_switch_mode fpu_switch_mode __read_mostly = FPU_SWITCH_AUTO;
+
+/* eagerfpu=on|off|auto, with the same meaning as on x86 */
+static int __init eager_fpu_setup(char *s)
+{
+	if (!s)
+		return -EINVAL;
+
+	if (!strcmp(s, "on"))
+		fpu_switch_mode = FPU_SWITCH_EAGER;
+	else if (!strcmp(s, "off"))
+		fpu_switch_mode = FPU_SWITCH_LAZY;
+	else if (!strcmp(s, "auto"))
+		fpu_switch_mode = FPU_SWITCH_AUTO;
+	else
+		return -EINVAL;
+	return 0;
+}
+early_param("eagerfpu", eager_fpu_setup);
+
 void arch_cpu_idle(void)
 {
 	wait_for_interrupt();
@@ -76,7 +98,12 @@ void show_regs(struct pt_regs *regs)
 void start_thread(struct pt_regs *regs, unsigned long pc,
 	unsigned long sp)
 {
-	regs->sstatus = SR_PIE /* User mode, irqs on */ | SR_FS_INITIAL;
+	/*
+	 * The FPU starts off, so that the first FP instruction loads the
+	 * context cleared by flush_thread() rather than whatever is left in
+	 * the registers.
+	 */
+	regs->sstatus = SR_PIE /* User mode, irqs on */ | SR_FS_OFF;
 	regs->sepc = pc;
 	regs->sp = sp;
 	set_fs(USER_DS);
@@ -90,15 +117,31 @@ void flush_thread(void)
 	 *	fflags: accrued exceptions cleared
 	 */
 	memset(&current->thread.fstate, 0, sizeof(current->thread.fstate));
+	current->thread.fpu_counter = 0;
+	current->thread.fstate_used = 0;
+
+	/* The new program gets its vector state on first use. */
+	riscv_v_vstate_off(task_pt_regs(current));
+	riscv_v_thread_free(current);
 }
 
 int arch_dup_task_struct(struct task_struct *dst, struct task_struct *src)
 {
 	fstate_save(src, task_pt_regs(src));
 	*dst = *src;
+	/*
+	 * Vector registers are clobbered across system calls, so the child
+	 * starts without vector state of its own rather than sharing datap.
+	 */
+	memset(&dst->thread.vstate, 0, sizeof(dst->thread.vstate));
 	return 0;
 }
 
+void arch_release_task_struct(struct task_struct *tsk)
+{
+	riscv_v_thread_free(tsk);
+}
+
 int copy_thread(unsigned long clone_flags, unsigned long usp,
 	unsigned long arg, struct task_struct *p)
 {
@@ -117,6 +160,7 @@ int copy_thread(unsigned long clone_flags, unsigned long usp,
 		p->thread.s[1] = arg;
 	} else {
 		*childregs = *(current_pt_regs());
+		riscv_v_vstate_off(childregs);
 		if (usp) /* User fork */
 			childregs->sp = usp;
 		if (clone_flags & CLONE_SETTLS)
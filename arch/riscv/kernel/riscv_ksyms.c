@@ -8,8 +8,24 @@
 
 #include <linux/export.h>
 #include <linux/uaccess.h>
+#include <asm/asm-prototypes.h>
+#include <asm/div64.h>
 
 /*
  * Assembly functions that may be used (directly or indirectly) by modules
  */
 EXPORT_SYMBOL(__copy_user);
+EXPORT_SYMBOL(memmove);
+EXPORT_SYMBOL(__memset);
+EXPORT_SYMBOL(__memcpy);
+EXPORT_SYMBOL(__memmove);
+EXPORT_SYMBOL(memcmp);
+EXPORT_SYMBOL(strlen);
+
+#ifdef CONFIG_32BIT
+EXPORT_SYMBOL(__div64_32);
+EXPORT_SYMBOL(__udivdi3);
+EXPORT_SYMBOL(__umoddi3);
+EXPORT_SYMBOL(__divdi3);
+EXPORT_SYMBOL(__moddi3);
+#endif
@@ -29,7 +29,11 @@
 #include <linux/of_fdt.h>
 #include <linux/of_platform.h>
 #include <linux/sched/task.h>
+#include <linux/dma-mapping.h>
+#include <linux/dma-contiguous.h>
 
+#include <asm/alternative.h>
+#include <asm/kasan.h>
 #include <asm/setup.h>
 #include <asm/sections.h>
 #include <asm/pgtable.h>
@@ -131,14 +135,25 @@ asmlinkage void __init setup_vm(void)
 			__pgprot(_PAGE_TABLE));
 	trampoline_pmd[0] = pfn_pmd(PFN_DOWN(pa), prot);
 
+	/*
+	 * Map the linear region with gigapages when the kernel was loaded at
+	 * a suitably aligned address, so that covering it takes one TLB
+	 * entry per GiB rather than 512 of them.
+	 */
 	for (i = 0; i < (-PAGE_OFFSET)/PGDIR_SIZE; ++i) {
 		size_t o = (PAGE_OFFSET >> PGDIR_SHIFT) % PTRS_PER_PGD + i;
-		swapper_pg_dir[o] =
-			pfn_pgd(PFN_DOWN((uintptr_t)swapper_pmd) + i,
-				__pgprot(_PAGE_TABLE));
+		if ((pa % PGDIR_SIZE) == 0)
+			swapper_pg_dir[o] =
+				pfn_pgd(PFN_DOWN(pa + i * PGDIR_SIZE), prot);
+		else
+			swapper_pg_dir[o] =
+				pfn_pgd(PFN_DOWN((uintptr_t)swapper_pmd) + i,
+					__pgprot(_PAGE_TABLE));
 	}
-	for (i = 0; i < ARRAY_SIZE(swapper_pmd); i++)
-		swapper_pmd[i] = pfn_pmd(PFN_DOWN(pa + i * PMD_SIZE), prot);
+	if ((pa % PGDIR_SIZE) != 0)
+		for (i = 0; i < ARRAY_SIZE(swapper_pmd); i++)
+			swapper_pmd[i] = pfn_pmd(PFN_DOWN(pa + i * PMD_SIZE),
+						 prot);
 #else
 	trampoline_pg_dir[(PAGE_OFFSET >> PGDIR_SHIFT) % PTRS_PER_PGD] =
 		pfn_pgd(PFN_DOWN(pa), prot);
@@ -149,6 +164,8 @@ asmlinkage void __init setup_vm(void)
 			pfn_pgd(PFN_DOWN(pa + i * PGDIR_SIZE), prot);
 	}
 #endif
+
+	kasan_early_init();
 }
 
 void __init sbi_save(unsigned int hartid, void *dtb)
@@ -205,6 +222,8 @@ static void __init setup_bootmem(void)
 
 	early_init_fdt_reserve_self();
 	early_init_fdt_scan_reserved_mem();
+	/* Keep the CMA area where 32-bit masters can reach it */
+	dma_contiguous_reserve(DMA_BIT_MASK(32) + 1ULL);
 	memblock_allow_resize();
 	memblock_dump_all();
 }
@@ -240,8 +259,10 @@ void __init setup_arch(char **cmdline_p)
 	init_mm.brk        = (unsigned long) _end;
 
 	setup_bootmem();
-	paging_init();
+	/* NUMA setup in paging_init() reads numa-node-id from the tree */
 	unflatten_device_tree();
+	paging_init();
+	kasan_init();
 
 #ifdef CONFIG_SMP
 	setup_smp();
@@ -252,6 +273,8 @@ void __init setup_arch(char **cmdline_p)
 #endif
 
 	riscv_fill_hwcap();
+	riscv_setup_ad_mode();
+	apply_boot_alternatives();
 }
 
 static int __init riscv_device_init(void)
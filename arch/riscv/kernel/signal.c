@@ -23,12 +23,14 @@
 #include <linux/uaccess.h>
 #include <linux/syscalls.h>
 #include <linux/tracehook.h>
+#include <linux/uprobes.h>
 #include <linux/linkage.h>
 
 #include <asm/ucontext.h>
 #include <asm/vdso.h>
 #include <asm/switch_to.h>
 #include <asm/csr.h>
+#include <asm/vector.h>
 
 #define DEBUG_SIG 0
 
@@ -37,14 +39,37 @@ struct rt_sigframe {
 	struct ucontext uc;
 };
 
+/*
+ * The registers are only reloaded by the first FP instruction after
+ * sigreturn, unless the task is switched eagerly anyway.  Turning the FPU
+ * off first also keeps a context switch during the copy from saving the
+ * handler's registers over it.
+ */
 static long restore_d_state(struct pt_regs *regs,
 	struct __riscv_d_ext_state __user *state)
 {
 	long err;
+
+	regs->sstatus = (regs->sstatus & ~SR_FS) | SR_FS_OFF;
 	err = __copy_from_user(&current->thread.fstate, state, sizeof(*state));
-	if (likely(!err))
-		fstate_restore(current, regs);
-	return err;
+	if (unlikely(err))
+		return err;
+
+	current->thread.fstate_used = 1;
+	if (fstate_switch_eager(current))
+		fstate_lazy_restore(regs);
+	return 0;
+}
+
+/* The interrupted context had no FP state: drop what the handler made. */
+static void reset_d_state(struct pt_regs *regs)
+{
+	regs->sstatus = (regs->sstatus & ~SR_FS) | SR_FS_OFF;
+	if (current->thread.fstate_used) {
+		memset(&current->thread.fstate, 0,
+		       sizeof(current->thread.fstate));
+		current->thread.fstate_used = 0;
+	}
 }
 
 static long save_d_state(struct pt_regs *regs,
@@ -54,29 +79,142 @@ static long save_d_state(struct pt_regs *regs,
 	return __copy_to_user(state, &current->thread.fstate, sizeof(*state));
 }
 
+/* Bytes of extension records that follow struct sigcontext */
+static size_t get_ext_context_size(struct pt_regs *regs)
+{
+	size_t size = 0;
+
+	/*
+	 * The first header lives in sigcontext itself, so each record
+	 * grows the frame by its payload plus the header that follows it.
+	 */
+	if (has_vector() && riscv_v_vstate_query(regs))
+		size += sizeof(struct __sc_riscv_v_state) + riscv_v_vsize +
+			sizeof(struct __riscv_ctx_hdr);
+
+	return size;
+}
+
+static long save_v_state(struct pt_regs *regs, void __user **sc_vec)
+{
+	struct __riscv_ctx_hdr __user *hdr;
+	struct __sc_riscv_v_state __user *state;
+	void __user *datap;
+	long err;
+
+	hdr = *sc_vec;
+	state = (struct __sc_riscv_v_state __user *)(hdr + 1);
+	datap = state + 1;
+
+	riscv_v_vstate_save(current, regs);
+
+	/* Everything but datap, which is rewritten to point into the frame */
+	err = __copy_to_user(&state->v_state, &current->thread.vstate,
+			     offsetof(struct __riscv_v_ext_state, datap));
+	err |= __put_user(datap, &state->v_state.datap);
+	err |= __copy_to_user(datap, current->thread.vstate.datap,
+			      riscv_v_vsize);
+	err |= __put_user(RISCV_V_MAGIC, &hdr->magic);
+	err |= __put_user(sizeof(*hdr) + sizeof(*state) + riscv_v_vsize,
+			  &hdr->size);
+	if (unlikely(err))
+		return err;
+
+	*sc_vec = datap + riscv_v_vsize;
+	return 0;
+}
+
+static long restore_v_state(struct pt_regs *regs, void __user *sc_vec)
+{
+	struct __sc_riscv_v_state __user *state = sc_vec;
+	void __user *datap;
+	long err;
+
+	/*
+	 * Drop whatever is live first: the registers are about to be
+	 * overwritten, and a failed restore leaves the unit off.
+	 */
+	riscv_v_vstate_off(regs);
+
+	if (!current->thread.vstate.datap &&
+	    riscv_v_thread_zalloc(current))
+		return -ENOMEM;
+
+	err = __copy_from_user(&current->thread.vstate, &state->v_state,
+			       offsetof(struct __riscv_v_ext_state, datap));
+	err |= __get_user(datap, &state->v_state.datap);
+	if (unlikely(err))
+		return err;
+
+	err = __copy_from_user(current->thread.vstate.datap, datap,
+			       riscv_v_vsize);
+	if (unlikely(err))
+		return err;
+
+	preempt_disable();
+	__riscv_v_vstate_restore(&current->thread.vstate);
+	__riscv_v_vstate_clean(regs);
+	preempt_enable();
+
+	return 0;
+}
+
 static long restore_sigcontext(struct pt_regs *regs,
-	struct sigcontext __user *sc)
+	struct sigcontext __user *sc, unsigned long uc_flags)
 {
+	struct __riscv_ctx_hdr __user *hdr;
+	u32 value, magic, size;
 	long err;
-	size_t i;
 	/* sc_regs is structured the same as the start of pt_regs */
 	err = __copy_from_user(regs, &sc->sc_regs, sizeof(sc->sc_regs));
 	if (unlikely(err))
 		return err;
 	/* Restore the floating-point state. */
-	err = restore_d_state(regs, &sc->sc_fpregs.d);
+	if (uc_flags & UC_RISCV_FP_NONE) {
+		reset_d_state(regs);
+	} else {
+		err = restore_d_state(regs, &sc->sc_fpregs.d);
+		if (unlikely(err))
+			return err;
+	}
+
+	err = __get_user(value, &sc->sc_extdesc.reserved);
 	if (unlikely(err))
 		return err;
-	/* We support no other extension state at this time. */
-	for (i = 0; i < ARRAY_SIZE(sc->sc_fpregs.q.reserved); i++) {
-		u32 value;
-		err = __get_user(value, &sc->sc_fpregs.q.reserved[i]);
+	if (value != 0)
+		return -EINVAL;
+
+	/* Walk the extension records up to the END header. */
+	hdr = &sc->sc_extdesc.hdr;
+	for (;;) {
+		/* Only the first header is covered by the frame's access_ok() */
+		err = get_user(magic, &hdr->magic);
+		err |= get_user(size, &hdr->size);
 		if (unlikely(err))
+			return err;
+
+		if (magic == END_MAGIC)
+			break;
+
+		switch (magic) {
+		case RISCV_V_MAGIC:
+			if (!has_vector() || size != sizeof(*hdr) +
+			    sizeof(struct __sc_riscv_v_state) + riscv_v_vsize)
+				return -EINVAL;
+			if (!access_ok(VERIFY_READ, hdr, size))
+				return -EFAULT;
+			err = restore_v_state(regs, hdr + 1);
 			break;
-		if (value != 0)
+		default:
 			return -EINVAL;
+		}
+		if (unlikely(err))
+			return err;
+
+		hdr = (void __user *)hdr + size;
 	}
-	return err;
+
+	return 0;
 }
 
 SYSCALL_DEFINE0(rt_sigreturn)
@@ -84,6 +222,7 @@ SYSCALL_DEFINE0(rt_sigreturn)
 	struct pt_regs *regs = current_pt_regs();
 	struct rt_sigframe __user *frame;
 	struct task_struct *task;
+	unsigned long uc_flags;
 	sigset_t set;
 
 	/* Always make any pending restarted system calls return -EINTR */
@@ -99,7 +238,10 @@ SYSCALL_DEFINE0(rt_sigreturn)
 
 	set_current_blocked(&set);
 
-	if (restore_sigcontext(regs, &frame->uc.uc_mcontext))
+	if (__get_user(uc_flags, &frame->uc.uc_flags))
+		goto badframe;
+
+	if (restore_sigcontext(regs, &frame->uc.uc_mcontext, uc_flags))
 		goto badframe;
 
 	if (restore_altstack(&frame->uc.uc_stack))
@@ -123,15 +265,24 @@ static long setup_sigcontext(struct rt_sigframe __user *frame,
 	struct pt_regs *regs)
 {
 	struct sigcontext __user *sc = &frame->uc.uc_mcontext;
+	void __user *sc_ext_ptr = &sc->sc_extdesc.hdr;
+	struct __riscv_ctx_hdr __user *end;
 	long err;
-	size_t i;
 	/* sc_regs is structured the same as the start of pt_regs */
 	err = __copy_to_user(&sc->sc_regs, regs, sizeof(sc->sc_regs));
-	/* Save the floating-point state. */
-	err |= save_d_state(regs, &sc->sc_fpregs.d);
-	/* We support no other extension state at this time. */
-	for (i = 0; i < ARRAY_SIZE(sc->sc_fpregs.q.reserved); i++)
-		err |= __put_user(0, &sc->sc_fpregs.q.reserved[i]);
+	/* Save the floating-point state, if the task has any. */
+	if (current->thread.fstate_used)
+		err |= save_d_state(regs, &sc->sc_fpregs.d);
+	err |= __put_user(0, &sc->sc_extdesc.reserved);
+	if (unlikely(err))
+		return err;
+	/* Then the extension records, each advancing sc_ext_ptr. */
+	if (has_vector() && riscv_v_vstate_query(regs))
+		err = save_v_state(regs, &sc_ext_ptr);
+	/* And the END header terminating the list. */
+	end = sc_ext_ptr;
+	err |= __put_user(END_MAGIC, &end->magic);
+	err |= __put_user(END_HDR_SIZE, &end->size);
 	return err;
 }
 
@@ -163,16 +314,19 @@ static int setup_rt_frame(struct ksignal *ksig, sigset_t *set,
 	struct pt_regs *regs)
 {
 	struct rt_sigframe __user *frame;
+	size_t frame_size;
 	long err = 0;
 
-	frame = get_sigframe(ksig, regs, sizeof(*frame));
-	if (!access_ok(VERIFY_WRITE, frame, sizeof(*frame)))
+	frame_size = sizeof(*frame) + get_ext_context_size(regs);
+	frame = get_sigframe(ksig, regs, frame_size);
+	if (!access_ok(VERIFY_WRITE, frame, frame_size))
 		return -EFAULT;
 
 	err |= copy_siginfo_to_user(&frame->info, &ksig->info);
 
 	/* Create the ucontext. */
-	err |= __put_user(0, &frame->uc.uc_flags);
+	err |= __put_user(current->thread.fstate_used ? 0 : UC_RISCV_FP_NONE,
+			  &frame->uc.uc_flags);
 	err |= __put_user(NULL, &frame->uc.uc_link);
 	err |= __save_altstack(&frame->uc.uc_stack, regs->sp);
 	err |= setup_sigcontext(frame, regs);
@@ -281,6 +435,9 @@ static void do_signal(struct pt_regs *regs)
 asmlinkage void do_notify_resume(struct pt_regs *regs,
 	unsigned long thread_info_flags)
 {
+	if (thread_info_flags & _TIF_UPROBE)
+		uprobe_notify_resume(regs);
+
 	/* Handle pending signal delivery */
 	if (thread_info_flags & _TIF_SIGPENDING)
 		do_signal(regs);
@@ -22,25 +22,47 @@
 #include <linux/interrupt.h>
 #include <linux/smp.h>
 #include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/irq_work.h>
+#include <linux/tick.h>
 
 #include <asm/sbi.h>
 #include <asm/tlbflush.h>
 #include <asm/cacheflush.h>
 
-/* A collection of single bit ipi messages.  */
-static struct {
-	unsigned long bits ____cacheline_aligned;
-} ipi_data[NR_CPUS] __cacheline_aligned;
-
 enum ipi_message_type {
 	IPI_RESCHEDULE,
 	IPI_CALL_FUNC,
+	IPI_SFENCE_VMA,
+	IPI_FENCE_I,
+	IPI_IRQ_WORK,
+	IPI_TIMER,
 	IPI_MAX
 };
 
+/*
+ * A collection of single bit ipi messages, plus per-message receive counts
+ * for /proc/interrupts.
+ */
+static struct {
+	atomic_long_t bits ____cacheline_aligned;
+	unsigned int stats[IPI_MAX] ____cacheline_aligned;
+} ipi_data[NR_CPUS] __cacheline_aligned;
+
+static const char * const ipi_names[IPI_MAX] = {
+	[IPI_RESCHEDULE]	= "Rescheduling interrupts",
+	[IPI_CALL_FUNC]		= "Function call interrupts",
+	[IPI_SFENCE_VMA]	= "TLB shootdown interrupts",
+	[IPI_FENCE_I]		= "Instruction cache flush interrupts",
+	[IPI_IRQ_WORK]		= "IRQ work interrupts",
+	[IPI_TIMER]		= "Timer broadcast interrupts",
+};
+
 irqreturn_t handle_ipi(void)
 {
-	unsigned long *pending_ipis = &ipi_data[smp_processor_id()].bits;
+	unsigned int cpu = smp_processor_id();
+	atomic_long_t *pending_ipis = &ipi_data[cpu].bits;
+	unsigned int *stats = ipi_data[cpu].stats;
 
 	/* Clear pending IPI */
 	csr_clear(sip, SIE_SSIE);
@@ -48,39 +70,74 @@ irqreturn_t handle_ipi(void)
 	while (true) {
 		unsigned long ops;
 
-		/* Order bit clearing and data access. */
-		mb();
-
-		ops = xchg(pending_ipis, 0);
+		/*
+		 * Take every message queued so far in one go.  The xchg is
+		 * fully ordered, so it also orders the bit clearing against
+		 * the data the senders published before setting their bits.
+		 */
+		ops = atomic_long_xchg(pending_ipis, 0);
 		if (ops == 0)
 			return IRQ_HANDLED;
 
-		if (ops & (1 << IPI_RESCHEDULE))
+		if (ops & (1 << IPI_RESCHEDULE)) {
+			stats[IPI_RESCHEDULE]++;
 			scheduler_ipi();
+		}
 
-		if (ops & (1 << IPI_CALL_FUNC))
+		if (ops & (1 << IPI_CALL_FUNC)) {
+			stats[IPI_CALL_FUNC]++;
 			generic_smp_call_function_interrupt();
+		}
+
+		if (ops & (1 << IPI_SFENCE_VMA)) {
+			stats[IPI_SFENCE_VMA]++;
+			local_flush_tlb_all();
+		}
+
+		if (ops & (1 << IPI_FENCE_I)) {
+			stats[IPI_FENCE_I]++;
+			local_flush_icache_all();
+		}
+
+		if (ops & (1 << IPI_IRQ_WORK)) {
+			stats[IPI_IRQ_WORK]++;
+			irq_work_run();
+		}
+
+#ifdef CONFIG_GENERIC_CLOCKEVENTS_BROADCAST
+		if (ops & (1 << IPI_TIMER)) {
+			stats[IPI_TIMER]++;
+			tick_receive_broadcast();
+		}
+#endif
 
 		BUG_ON((ops >> IPI_MAX) != 0);
-
-		/* Order data access and bit testing. */
-		mb();
 	}
 
 	return IRQ_HANDLED;
 }
 
+/*
+ * Queue a message for each target and only trap into the SBI for the harts
+ * that had nothing pending: a hart with pending bits already has a software
+ * interrupt on the way and will pick the new message up when it drains its
+ * queue.  The fetch_or is fully ordered, which publishes the caller's data
+ * before the message bit becomes visible.
+ */
 static void
 send_ipi_message(const struct cpumask *to_whom, enum ipi_message_type operation)
 {
+	struct cpumask targets;
 	int i;
 
-	mb();
-	for_each_cpu(i, to_whom)
-		set_bit(operation, &ipi_data[i].bits);
+	cpumask_clear(&targets);
+	for_each_cpu(i, to_whom) {
+		if (!atomic_long_fetch_or(1UL << operation, &ipi_data[i].bits))
+			cpumask_set_cpu(i, &targets);
+	}
 
-	mb();
-	sbi_send_ipi(cpumask_bits(to_whom));
+	if (!cpumask_empty(&targets))
+		sbi_send_ipi(cpumask_bits(&targets));
 }
 
 void arch_send_call_function_ipi_mask(struct cpumask *mask)
@@ -93,6 +150,45 @@ void arch_send_call_function_single_ipi(int cpu)
 	send_ipi_message(cpumask_of(cpu), IPI_CALL_FUNC);
 }
 
+void riscv_send_ipi_sfence_vma(const struct cpumask *mask)
+{
+	send_ipi_message(mask, IPI_SFENCE_VMA);
+}
+
+void riscv_send_ipi_fence_i(const struct cpumask *mask)
+{
+	send_ipi_message(mask, IPI_FENCE_I);
+}
+
+#ifdef CONFIG_IRQ_WORK
+void arch_irq_work_raise(void)
+{
+	send_ipi_message(cpumask_of(smp_processor_id()), IPI_IRQ_WORK);
+}
+#endif
+
+#ifdef CONFIG_GENERIC_CLOCKEVENTS_BROADCAST
+void tick_broadcast(const struct cpumask *mask)
+{
+	send_ipi_message(mask, IPI_TIMER);
+}
+#endif
+
+int arch_show_interrupts(struct seq_file *p, int prec)
+{
+	unsigned int cpu, i;
+
+	for (i = 0; i < IPI_MAX; i++) {
+		seq_printf(p, "%*s%u:%s", prec - 1, "IPI", i,
+			   prec >= 4 ? " " : "");
+		for_each_online_cpu(cpu)
+			seq_printf(p, "%10u ", ipi_data[cpu].stats[i]);
+		seq_printf(p, "      %s\n", ipi_names[i]);
+	}
+
+	return 0;
+}
+
 static void ipi_stop(void *unused)
 {
 	while (1)
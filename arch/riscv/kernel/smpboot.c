@@ -23,6 +23,7 @@
 #include <linux/sched.h>
 #include <linux/kernel_stat.h>
 #include <linux/notifier.h>
+#include <linux/completion.h>
 #include <linux/cpu.h>
 #include <linux/percpu.h>
 #include <linux/delay.h>
@@ -32,12 +33,18 @@
 #include <linux/sched/task_stack.h>
 #include <asm/irq.h>
 #include <asm/mmu_context.h>
+#include <asm/numa.h>
 #include <asm/tlbflush.h>
 #include <asm/sections.h>
 #include <asm/sbi.h>
+#include <asm/topology.h>
 
 void *__cpu_up_stack_pointer[NR_CPUS];
 void *__cpu_up_task_pointer[NR_CPUS];
+/* Set by the boot hart once the secondaries may enable virtual memory */
+int __cpu_vm_ready;
+
+static DECLARE_COMPLETION(cpu_running);
 
 void __init smp_prepare_boot_cpu(void)
 {
@@ -45,6 +52,13 @@ void __init smp_prepare_boot_cpu(void)
 
 void __init smp_prepare_cpus(unsigned int max_cpus)
 {
+	unsigned int cpu;
+
+	init_cpu_topology();
+	store_cpu_topology(smp_processor_id());
+
+	for_each_present_cpu(cpu)
+		numa_store_cpu_info(cpu);
 }
 
 void __init setup_smp(void)
@@ -57,6 +71,7 @@ void __init setup_smp(void)
 		if (hart >= 0) {
 			set_cpu_possible(hart, true);
 			set_cpu_present(hart, true);
+			early_map_cpu_to_node(hart, of_node_to_nid(dn));
 			if (hart == smp_processor_id()) {
 				BUG_ON(im_okay_therefore_i_am);
 				im_okay_therefore_i_am = 1;
@@ -74,16 +89,21 @@ int __cpu_up(unsigned int cpu, struct task_struct *tidle)
 	/*
 	 * On RISC-V systems, all harts boot on their own accord.  Our _start
 	 * selects the first hart to boot the kernel and causes the remainder
-	 * of the harts to spin in a loop waiting for their stack pointer to be
-	 * setup by that main hart.  Writing __cpu_up_stack_pointer signals to
-	 * the spinning harts that they can continue the boot process.
+	 * of the harts to relocate to virtual addresses together and then
+	 * spin in a loop waiting for their stack pointer to be setup by that
+	 * main hart.  Writing __cpu_up_stack_pointer signals to the spinning
+	 * harts that they can continue the boot process.
 	 */
 	smp_mb();
 	__cpu_up_stack_pointer[cpu] = task_stack_page(tidle) + THREAD_SIZE;
 	__cpu_up_task_pointer[cpu] = tidle;
 
-	while (!cpu_online(cpu))
-		cpu_relax();
+	wait_for_completion_timeout(&cpu_running, msecs_to_jiffies(1000));
+
+	if (!cpu_online(cpu)) {
+		pr_crit("CPU%u: failed to come online\n", cpu);
+		return -EIO;
+	}
 
 	return 0;
 }
@@ -105,8 +125,10 @@ asmlinkage void __init smp_callin(void)
 
 	trap_init();
 	init_clockevent();
+	store_cpu_topology(smp_processor_id());
 	notify_cpu_starting(smp_processor_id());
 	set_cpu_online(smp_processor_id(), 1);
+	complete(&cpu_running);
 	local_flush_tlb_all();
 	local_irq_enable();
 	preempt_disable();
@@ -13,11 +13,14 @@
  */
 
 #include <linux/export.h>
+#include <linux/ftrace.h>
 #include <linux/kallsyms.h>
 #include <linux/sched.h>
 #include <linux/sched/debug.h>
 #include <linux/sched/task_stack.h>
 #include <linux/stacktrace.h>
+#include <asm/stacktrace.h>
+#include <asm/unwind.h>
 
 #ifdef CONFIG_FRAME_POINTER
 
@@ -26,10 +29,11 @@ struct stackframe {
 	unsigned long ra;
 };
 
-static void notrace walk_stackframe(struct task_struct *task,
+void notrace walk_stackframe(struct task_struct *task,
 	struct pt_regs *regs, bool (*fn)(unsigned long, void *), void *arg)
 {
 	unsigned long fp, sp, pc;
+	int graph_idx = 0;
 
 	if (regs) {
 		fp = GET_FP(regs);
@@ -63,39 +67,51 @@ static void notrace walk_stackframe(struct task_struct *task,
 		frame = (struct stackframe *)fp - 1;
 		sp = fp;
 		fp = frame->fp;
-		pc = frame->ra - 0x4;
+		/* see through return_to_handler when the graph tracer is on */
+		pc = ftrace_graph_ret_addr(task ? task : current, &graph_idx,
+					   frame->ra, &frame->ra);
+		pc -= 0x4;
 	}
 }
 
 #else /* !CONFIG_FRAME_POINTER */
 
-static void notrace walk_stackframe(struct task_struct *task,
+/* Noinline and without dynamic stack use, so its own CFI describes sp */
+noinline void notrace walk_stackframe(struct task_struct *task,
 	struct pt_regs *regs, bool (*fn)(unsigned long, void *), void *arg)
 {
-	unsigned long sp, pc;
-	unsigned long *ksp;
+	struct unwind_frame_info frame = { .graph = 0 };
+
+	if (task == NULL)
+		task = current;
 
 	if (regs) {
-		sp = GET_USP(regs);
-		pc = GET_IP(regs);
-	} else if (task == NULL || task == current) {
+		frame.fp = GET_FP(regs);
+		frame.sp = GET_USP(regs);
+		frame.pc = GET_IP(regs);
+		frame.ra = regs->ra;
+	} else if (task == current) {
 		const register unsigned long current_sp __asm__ ("sp");
-		sp = current_sp;
-		pc = (unsigned long)walk_stackframe;
+		const register unsigned long current_fp __asm__ ("s0");
+		unsigned long pc;
+
+		__asm__ __volatile__ ("auipc %0, 0" : "=r" (pc));
+		frame.fp = current_fp;
+		frame.sp = current_sp;
+		frame.pc = pc;
 	} else {
 		/* task blocked in __switch_to */
-		sp = task->thread.sp;
-		pc = task->thread.ra;
+		frame.fp = task->thread.s[0];
+		frame.sp = task->thread.sp;
+		frame.pc = task->thread.ra - 0x4;
 	}
 
-	if (unlikely(sp & 0x7))
-		return;
-
-	ksp = (unsigned long *)sp;
-	while (!kstack_end(ksp)) {
-		if (__kernel_text_address(pc) && unlikely(fn(pc, arg)))
+	for (;;) {
+		if (unlikely(!__kernel_text_address(frame.pc) ||
+			     fn(frame.pc, arg)))
+			break;
+		if (unwind_frame(task, &frame))
 			break;
-		pc = (*ksp++) - 0x4;
 	}
 }
 
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/ftrace.h>
+#include <linux/kernel.h>
+
+#include <asm/csr.h>
+#include <asm/page.h>
+#include <asm/suspend.h>
+
+static void suspend_save_csrs(struct suspend_context *context)
+{
+	context->scratch = csr_read(sscratch);
+	context->tvec = csr_read(stvec);
+	context->ie = csr_read(sie);
+	context->sptbr = csr_read(sptbr);
+}
+
+static void suspend_restore_csrs(struct suspend_context *context)
+{
+	csr_write(sscratch, context->scratch);
+	csr_write(stvec, context->tvec);
+	csr_write(sie, context->ie);
+}
+
+int cpu_suspend(unsigned long arg,
+		int (*finish)(unsigned long arg, unsigned long entry,
+			      unsigned long context))
+{
+	struct suspend_context context = { 0 };
+	unsigned long entry;
+	int rc = 0;
+
+	if (!finish)
+		return -EINVAL;
+
+	entry = __pa(__cpu_resume_enter);
+
+	/*
+	 * The graph tracer's return stack can't follow the second return
+	 * from __cpu_suspend_enter(), so keep it out of the way.
+	 */
+	pause_graph_tracing();
+
+	suspend_save_csrs(&context);
+
+	if (__cpu_suspend_enter(&context)) {
+		rc = finish(arg, entry, __pa(&context));
+
+		/*
+		 * A finisher only returns when the hart didn't go down, which
+		 * for a non-retentive state means the firmware refused it.
+		 */
+		if (!rc)
+			rc = -EOPNOTSUPP;
+	} else {
+		suspend_restore_csrs(&context);
+	}
+
+	unpause_graph_tracing();
+
+	return rc;
+}
@@ -14,6 +14,7 @@
  */
 
 #include <linux/syscalls.h>
+#include <asm/cacheflush.h>
 #include <asm/cmpxchg.h>
 #include <asm/unistd.h>
 
@@ -47,3 +48,20 @@ SYSCALL_DEFINE6(mmap2, unsigned long, addr, unsigned long, len,
 	return riscv_sys_mmap(addr, len, prot, flags, fd, offset, 12);
 }
 #endif /* !CONFIG_64BIT */
+
+/*
+ * See the comment above __NR_riscv_flush_icache.  With the local flag only
+ * this hart is fenced; the others are left marked stale and fence when
+ * they next switch to a thread of this mm, which is also what happens on
+ * the hart the caller migrates to.
+ */
+SYSCALL_DEFINE3(riscv_flush_icache, uintptr_t, start, uintptr_t, end,
+	uintptr_t, flags)
+{
+	if (unlikely(flags & ~SYS_RISCV_FLUSH_ICACHE_ALL))
+		return -EINVAL;
+
+	flush_icache_mm(current->mm, flags & SYS_RISCV_FLUSH_ICACHE_LOCAL);
+
+	return 0;
+}
@@ -14,7 +14,25 @@
 
 #include <linux/linkage.h>
 #include <linux/syscalls.h>
-#include <asm-generic/syscalls.h>
+#include <asm/syscalls.h>
+
+/*
+ * Stubs in entry.S that save the rest of the user registers, which the
+ * system call path otherwise leaves live, before calling the handler.
+ */
+asmlinkage long __riscv_sys_clone(void);
+asmlinkage long __riscv_sys_execve(void);
+asmlinkage long __riscv_sys_execveat(void);
+asmlinkage long __riscv_sys_rt_sigreturn(void);
+asmlinkage long __riscv_sys_exit(void);
+asmlinkage long __riscv_sys_exit_group(void);
+
+#define sys_clone		__riscv_sys_clone
+#define sys_execve		__riscv_sys_execve
+#define sys_execveat		__riscv_sys_execveat
+#define sys_rt_sigreturn	__riscv_sys_rt_sigreturn
+#define sys_exit		__riscv_sys_exit
+#define sys_exit_group		__riscv_sys_exit_group
 
 #undef __SYSCALL
 #define __SYSCALL(nr, call)	[nr] = (call),
@@ -15,24 +15,30 @@
 #include <linux/clocksource.h>
 #include <linux/clockchips.h>
 #include <linux/delay.h>
+#include <linux/sched_clock.h>
 #include <linux/timer_riscv.h>
 
 #include <asm/sbi.h>
 
 unsigned long riscv_timebase;
 
+/*
+ * time_init() allocates a timer for each CPU, and each one's cpumask keeps
+ * the clockevents core from programming it from any other hart, so these
+ * write the comparator of the hart they run on.
+ */
 static int next_event(unsigned long delta, struct clock_event_device *ce)
 {
-	/*
-	 * time_init() allocates a timer for each CPU.  Since we're writing the
-	 * timer comparison register here we can't allow the timers to cross
-	 * harts.
-	 */
-	BUG_ON(ce != timer_riscv_device(smp_processor_id()));
 	sbi_set_timer(get_cycles64() + delta);
 	return 0;
 }
 
+static int stop_event(struct clock_event_device *ce)
+{
+	sbi_set_timer(ULLONG_MAX);
+	return 0;
+}
+
 static unsigned long long rdtime(struct clocksource *cs)
 {
 	/*
@@ -44,6 +50,16 @@ static unsigned long long rdtime(struct clocksource *cs)
 	return get_cycles64();
 }
 
+/*
+ * The time CSR counts at the timebase frequency on every hart and never
+ * wraps in practice, so it serves as sched_clock directly.  This is called
+ * from the scheduler and from ftrace, so it must not be traced.
+ */
+static u64 notrace riscv_sched_clock(void)
+{
+	return get_cycles64();
+}
+
 void riscv_timer_interrupt(void)
 {
 	int cpu = smp_processor_id();
@@ -56,7 +72,8 @@ void __init init_clockevent(void)
 {
 	int cpu_id = smp_processor_id();
 
-	timer_riscv_init(cpu_id, riscv_timebase, &rdtime, &next_event);
+	timer_riscv_init(cpu_id, riscv_timebase, &rdtime, &next_event,
+			 &stop_event);
 	csr_set(sie, SIE_STIE);
 }
 
@@ -72,5 +89,6 @@ void __init time_init(void)
 
 	lpj_fine = riscv_timebase / HZ;
 
+	sched_clock_register(riscv_sched_clock, 64, riscv_timebase);
 	init_clockevent();
 }
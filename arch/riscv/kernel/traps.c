@@ -22,14 +22,19 @@
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/irq.h>
+#include <linux/kprobes.h>
+#include <linux/uprobes.h>
 
 #include <asm/processor.h>
 #include <asm/ptrace.h>
 #include <asm/csr.h>
+#include <asm/switch_to.h>
+#include <asm/vector.h>
 
 int show_unhandled_signals = 1;
 
 extern asmlinkage void handle_exception(void);
+extern asmlinkage void handle_trap_vectored(void);
 
 static DEFINE_SPINLOCK(die_lock);
 
@@ -78,6 +83,9 @@ static inline void do_trap_siginfo(int signo, int code,
 void do_trap(struct pt_regs *regs, int signo, int code,
 	unsigned long addr, struct task_struct *tsk)
 {
+	/* lets uprobes tell a trapping out-of-line step from a clean one */
+	tsk->thread.bad_cause = regs->scause;
+
 	if (show_unhandled_signals && unhandled_signal(tsk, signo)
 	    && printk_ratelimit()) {
 		pr_info("%s[%d]: unhandled signal %d code 0x%x at 0x" REG_FMT,
@@ -113,8 +121,6 @@ DO_ERROR_INFO(do_trap_insn_misaligned,
 	SIGBUS, BUS_ADRALN, "instruction address misaligned");
 DO_ERROR_INFO(do_trap_insn_fault,
 	SIGSEGV, SEGV_ACCERR, "instruction access fault");
-DO_ERROR_INFO(do_trap_insn_illegal,
-	SIGILL, ILL_ILLOPC, "illegal instruction");
 DO_ERROR_INFO(do_trap_load_misaligned,
 	SIGBUS, BUS_ADRALN, "load address misaligned");
 DO_ERROR_INFO(do_trap_load_fault,
@@ -130,8 +136,41 @@ DO_ERROR_INFO(do_trap_ecall_s,
 DO_ERROR_INFO(do_trap_ecall_m,
 	SIGILL, ILL_ILLTRP, "environment call from M-mode");
 
+asmlinkage void do_trap_insn_illegal(struct pt_regs *regs)
+{
+	/*
+	 * The first FP instruction after a lazy FPU switch lands here, as
+	 * does a task's first vector instruction.
+	 */
+	if (user_mode(regs)) {
+		if (fstate_lazy_restore(regs))
+			return;
+		if (riscv_v_first_use_handler(regs))
+			return;
+	}
+
+	do_trap_error(regs, SIGILL, ILL_ILLOPC, regs->sepc,
+		      "Oops - illegal instruction");
+}
+
 asmlinkage void do_trap_break(struct pt_regs *regs)
 {
+#ifdef CONFIG_KPROBES
+	if (!user_mode(regs)) {
+		if (kprobe_single_step_handler(regs))
+			return;
+		if (kprobe_breakpoint_handler(regs))
+			return;
+	}
+#endif
+#ifdef CONFIG_UPROBES
+	if (user_mode(regs)) {
+		if (uprobe_single_step_handler(regs))
+			return;
+		if (uprobe_breakpoint_handler(regs))
+			return;
+	}
+#endif
 #ifdef CONFIG_GENERIC_BUG
 	if (!user_mode(regs)) {
 		enum bug_trap_type type;
@@ -173,8 +212,14 @@ void __init trap_init(void)
 	 * that we are presently executing in the kernel
 	 */
 	csr_write(sscratch, 0);
-	/* Set the exception vector address */
-	csr_write(stvec, &handle_exception);
+	/*
+	 * Set the exception vector address.  Vectored mode lets the common
+	 * interrupts skip decoding scause, but harts needn't implement it.
+	 */
+	csr_write(stvec, (unsigned long)&handle_trap_vectored |
+			 STVEC_MODE_VECTORED);
+	if ((csr_read(stvec) & STVEC_MODE_MASK) != STVEC_MODE_VECTORED)
+		csr_write(stvec, &handle_exception);
 	/* Enable all interrupts */
 	csr_write(sie, -1);
 }
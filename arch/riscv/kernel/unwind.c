@@ -0,0 +1,563 @@
+/*
+ * Stack unwinding from the DWARF call frame information in .eh_frame
+ *
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+/*
+ * Without frame pointers the only record of a frame's layout is the CFI
+ * GCC emits with -fasynchronous-unwind-tables.  ld --eh-frame-hdr sorts an
+ * index of the FDEs by start address into .eh_frame_hdr, so finding the
+ * FDE for a pc is a binary search; its instructions are then run up to
+ * the pc to get the CFA and where ra and s0 were saved.  Only the subset
+ * of CFI that the compiler produces for this architecture is understood:
+ * anything else (expressions, register-to-register rules) ends the walk.
+ *
+ * Code without CFI -- the assembly entry paths and string routines -- and
+ * modules, which are built without tables, have no FDE; the walk stops
+ * there, except that an interrupted leaf is stepped over using ra.
+ */
+
+#include <linux/ftrace.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/sched/task_stack.h>
+#include <asm/unaligned.h>
+#include <asm/unwind.h>
+
+extern const u8 __eh_frame_hdr_start[], __eh_frame_hdr_end[];
+
+/* DWARF register numbers */
+#define DWARF_REG_RA		1
+#define DWARF_REG_SP		2
+#define DWARF_REG_FP		8
+
+/* Pointer encodings */
+#define DW_EH_PE_absptr		0x00
+#define DW_EH_PE_udata4		0x03
+#define DW_EH_PE_udata8		0x04
+#define DW_EH_PE_sdata4		0x0b
+#define DW_EH_PE_sdata8		0x0c
+#define DW_EH_PE_pcrel		0x10
+#define DW_EH_PE_datarel	0x30
+#define DW_EH_PE_indirect	0x80
+#define DW_EH_PE_omit		0xff
+
+/* Call frame instructions */
+#define DW_CFA_advance_loc	0x40
+#define DW_CFA_offset		0x80
+#define DW_CFA_restore		0xc0
+#define DW_CFA_nop		0x00
+#define DW_CFA_advance_loc1	0x02
+#define DW_CFA_advance_loc2	0x03
+#define DW_CFA_advance_loc4	0x04
+#define DW_CFA_offset_extended	0x05
+#define DW_CFA_restore_extended	0x06
+#define DW_CFA_undefined	0x07
+#define DW_CFA_same_value	0x08
+#define DW_CFA_remember_state	0x0a
+#define DW_CFA_restore_state	0x0b
+#define DW_CFA_def_cfa		0x0c
+#define DW_CFA_def_cfa_register	0x0d
+#define DW_CFA_def_cfa_offset	0x0e
+#define DW_CFA_offset_extended_sf	0x11
+#define DW_CFA_def_cfa_sf	0x12
+#define DW_CFA_def_cfa_offset_sf	0x13
+#define DW_CFA_GNU_args_size	0x2e
+#define DW_CFA_GNU_negative_offset_extended	0x2f
+
+enum cfi_rule {
+	CFI_SAME,		/* the register still holds the caller's value */
+	CFI_OFFSET,		/* saved at CFA + offset */
+	CFI_UNDEFINED,		/* outermost frame */
+};
+
+struct cfi_reg {
+	enum cfi_rule rule;
+	long offset;
+};
+
+struct cfi_row {
+	unsigned long cfa_reg;
+	long cfa_offset;
+	struct cfi_reg ra;
+	struct cfi_reg fp;
+};
+
+/* GCC nests remember_state at most once or twice */
+#define CFI_STATE_DEPTH		4
+
+struct cie_info {
+	const u8 *insns;
+	const u8 *end;
+	unsigned long code_align;
+	long data_align;
+	unsigned long ra_reg;
+	u8 fde_enc;
+};
+
+static unsigned long read_uleb128(const u8 **p, const u8 *end)
+{
+	unsigned long val = 0;
+	unsigned int shift = 0;
+	u8 byte;
+
+	do {
+		if (*p >= end)
+			return 0;
+		byte = *(*p)++;
+		if (shift < BITS_PER_LONG)
+			val |= (unsigned long)(byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	return val;
+}
+
+static long read_sleb128(const u8 **p, const u8 *end)
+{
+	unsigned long val = 0;
+	unsigned int shift = 0;
+	u8 byte;
+
+	do {
+		if (*p >= end)
+			return 0;
+		byte = *(*p)++;
+		if (shift < BITS_PER_LONG)
+			val |= (unsigned long)(byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	if (shift < BITS_PER_LONG && (byte & 0x40))
+		val |= -1UL << shift;
+
+	return val;
+}
+
+/* Returns false for encodings the compiler doesn't use here */
+static bool read_pointer(const u8 **p, const u8 *end, u8 enc,
+			 unsigned long *val)
+{
+	const u8 *start = *p;
+	unsigned long v;
+
+	switch (enc & 0x0f) {
+	case DW_EH_PE_absptr:
+		if (end - start < sizeof(unsigned long))
+			return false;
+		v = get_unaligned((const unsigned long *)start);
+		*p += sizeof(unsigned long);
+		break;
+	case DW_EH_PE_udata4:
+	case DW_EH_PE_sdata4:
+		if (end - start < 4)
+			return false;
+		v = get_unaligned((const u32 *)start);
+		if ((enc & 0x0f) == DW_EH_PE_sdata4)
+			v = (long)(s32)v;
+		*p += 4;
+		break;
+	case DW_EH_PE_udata8:
+	case DW_EH_PE_sdata8:
+		if (end - start < 8)
+			return false;
+		v = get_unaligned((const u64 *)start);
+		*p += 8;
+		break;
+	default:
+		return false;
+	}
+
+	switch (enc & 0x70) {
+	case DW_EH_PE_absptr:
+		break;
+	case DW_EH_PE_pcrel:
+		v += (unsigned long)start;
+		break;
+	default:
+		return false;
+	}
+
+	if (enc & DW_EH_PE_indirect)
+		return false;
+
+	*val = v;
+	return true;
+}
+
+static bool parse_cie(const u8 *cie, struct cie_info *info)
+{
+	const u8 *p, *end, *aug, *aug_end;
+	u32 len = get_unaligned((const u32 *)cie);
+	u8 version;
+
+	if (len == 0 || len == 0xffffffff)
+		return false;
+	p = cie + 4;
+	end = p + len;
+	if (get_unaligned((const u32 *)p) != 0)
+		return false;
+	p += 4;
+	version = *p++;
+	if (version != 1 && version != 3)
+		return false;
+
+	aug = p;
+	while (p < end && *p)
+		p++;
+	if (p++ >= end)
+		return false;
+
+	info->code_align = read_uleb128(&p, end);
+	info->data_align = read_sleb128(&p, end);
+	if (version == 1)
+		info->ra_reg = *p++;
+	else
+		info->ra_reg = read_uleb128(&p, end);
+	info->fde_enc = DW_EH_PE_absptr;
+
+	if (*aug == 'z') {
+		unsigned long aug_len = read_uleb128(&p, end);
+
+		aug_end = p + aug_len;
+		for (aug++; *aug; aug++) {
+			switch (*aug) {
+			case 'R':
+				info->fde_enc = *p++;
+				break;
+			case 'S':
+				break;
+			case 'L':
+				p++;
+				break;
+			case 'P': {
+				unsigned long personality;
+				u8 enc = *p++;
+
+				if (!read_pointer(&p, end, enc, &personality))
+					p = aug_end;
+				break;
+			}
+			default:
+				p = aug_end;
+				break;
+			}
+		}
+		p = aug_end;
+	} else if (*aug) {
+		return false;
+	}
+
+	if (p > end || info->ra_reg != DWARF_REG_RA)
+		return false;
+
+	info->insns = p;
+	info->end = end;
+	return true;
+}
+
+static struct cfi_reg *cfi_reg(struct cfi_row *row, unsigned long reg)
+{
+	if (reg == DWARF_REG_RA)
+		return &row->ra;
+	if (reg == DWARF_REG_FP)
+		return &row->fp;
+	return NULL;
+}
+
+static void set_offset(struct cfi_row *row, unsigned long reg, long offset)
+{
+	struct cfi_reg *r = cfi_reg(row, reg);
+
+	if (r) {
+		r->rule = CFI_OFFSET;
+		r->offset = offset;
+	}
+}
+
+static void set_rule(struct cfi_row *row, unsigned long reg,
+		     enum cfi_rule rule)
+{
+	struct cfi_reg *r = cfi_reg(row, reg);
+
+	if (r)
+		r->rule = rule;
+}
+
+static void restore_reg(struct cfi_row *row, const struct cfi_row *init,
+			unsigned long reg)
+{
+	struct cfi_reg *r = cfi_reg(row, reg);
+
+	if (r)
+		*r = *cfi_reg((struct cfi_row *)init, reg);
+}
+
+/*
+ * Run CFI instructions starting at address @loc until the row covering
+ * @pc is built.  @init is the row at the end of the CIE, for
+ * DW_CFA_restore.
+ */
+static bool run_cfi(const u8 *p, const u8 *end, unsigned long loc,
+		    unsigned long pc, const struct cie_info *cie,
+		    struct cfi_row *row, const struct cfi_row *init)
+{
+	struct cfi_row stack[CFI_STATE_DEPTH];
+	unsigned int depth = 0;
+	unsigned long reg, delta;
+
+	while (p < end) {
+		u8 insn = *p++;
+
+		delta = 0;
+		switch (insn & 0xc0) {
+		case DW_CFA_advance_loc:
+			delta = insn & 0x3f;
+			goto advance;
+		case DW_CFA_offset:
+			set_offset(row, insn & 0x3f,
+				   read_uleb128(&p, end) * cie->data_align);
+			continue;
+		case DW_CFA_restore:
+			if (!init)
+				return false;
+			restore_reg(row, init, insn & 0x3f);
+			continue;
+		}
+
+		switch (insn) {
+		case DW_CFA_nop:
+			break;
+		case DW_CFA_advance_loc1:
+			delta = *p++;
+			goto advance;
+		case DW_CFA_advance_loc2:
+			delta = get_unaligned((const u16 *)p);
+			p += 2;
+			goto advance;
+		case DW_CFA_advance_loc4:
+			delta = get_unaligned((const u32 *)p);
+			p += 4;
+			goto advance;
+		case DW_CFA_offset_extended:
+			reg = read_uleb128(&p, end);
+			set_offset(row, reg,
+				   read_uleb128(&p, end) * cie->data_align);
+			break;
+		case DW_CFA_offset_extended_sf:
+			reg = read_uleb128(&p, end);
+			set_offset(row, reg,
+				   read_sleb128(&p, end) * cie->data_align);
+			break;
+		case DW_CFA_GNU_negative_offset_extended:
+			reg = read_uleb128(&p, end);
+			set_offset(row, reg,
+				   -(long)read_uleb128(&p, end) * cie->data_align);
+			break;
+		case DW_CFA_restore_extended:
+			if (!init)
+				return false;
+			restore_reg(row, init, read_uleb128(&p, end));
+			break;
+		case DW_CFA_undefined:
+			set_rule(row, read_uleb128(&p, end), CFI_UNDEFINED);
+			break;
+		case DW_CFA_same_value:
+			set_rule(row, read_uleb128(&p, end), CFI_SAME);
+			break;
+		case DW_CFA_remember_state:
+			if (depth == CFI_STATE_DEPTH)
+				return false;
+			stack[depth++] = *row;
+			break;
+		case DW_CFA_restore_state:
+			if (depth == 0)
+				return false;
+			*row = stack[--depth];
+			break;
+		case DW_CFA_def_cfa:
+			row->cfa_reg = read_uleb128(&p, end);
+			row->cfa_offset = read_uleb128(&p, end);
+			break;
+		case DW_CFA_def_cfa_sf:
+			row->cfa_reg = read_uleb128(&p, end);
+			row->cfa_offset = read_sleb128(&p, end) * cie->data_align;
+			break;
+		case DW_CFA_def_cfa_register:
+			row->cfa_reg = read_uleb128(&p, end);
+			break;
+		case DW_CFA_def_cfa_offset:
+			row->cfa_offset = read_uleb128(&p, end);
+			break;
+		case DW_CFA_def_cfa_offset_sf:
+			row->cfa_offset = read_sleb128(&p, end) * cie->data_align;
+			break;
+		case DW_CFA_GNU_args_size:
+			read_uleb128(&p, end);
+			break;
+		default:
+			return false;
+		}
+		continue;
+
+advance:
+		loc += delta * cie->code_align;
+		if (loc > pc)
+			break;
+	}
+
+	return true;
+}
+
+/* The FDE whose range covers @pc, from the sorted .eh_frame_hdr table */
+static const u8 *find_fde(unsigned long pc)
+{
+	const u8 *hdr = __eh_frame_hdr_start;
+	const u8 *p = hdr + 4;
+	const s32 *table;
+	unsigned long eh_frame, count, lo, hi;
+
+	if (__eh_frame_hdr_end - hdr < 4 || hdr[0] != 1 ||
+	    hdr[2] != DW_EH_PE_udata4 ||
+	    hdr[3] != (DW_EH_PE_datarel | DW_EH_PE_sdata4))
+		return NULL;
+	if (!read_pointer(&p, __eh_frame_hdr_end, hdr[1], &eh_frame) ||
+	    !read_pointer(&p, __eh_frame_hdr_end, hdr[2], &count))
+		return NULL;
+
+	/* Pairs of (start address, FDE), both relative to the header */
+	table = (const s32 *)p;
+	if (count == 0 || (const u8 *)(table + 2 * count) > __eh_frame_hdr_end)
+		return NULL;
+
+	lo = 0;
+	hi = count;
+	while (hi - lo > 1) {
+		unsigned long mid = lo + (hi - lo) / 2;
+
+		if ((unsigned long)hdr + table[2 * mid] <= pc)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	if ((unsigned long)hdr + table[2 * lo] > pc)
+		return NULL;
+	return hdr + table[2 * lo + 1];
+}
+
+static bool find_cfi(unsigned long pc, struct cfi_row *row)
+{
+	const u8 *fde, *p, *end;
+	struct cie_info cie;
+	struct cfi_row init;
+	unsigned long start, range;
+	u32 len;
+
+	fde = find_fde(pc);
+	if (!fde)
+		return false;
+
+	len = get_unaligned((const u32 *)fde);
+	if (len == 0 || len == 0xffffffff)
+		return false;
+	p = fde + 4;
+	end = p + len;
+	if (!parse_cie(p - get_unaligned((const u32 *)p), &cie))
+		return false;
+	p += 4;
+
+	if (!read_pointer(&p, end, cie.fde_enc, &start) ||
+	    !read_pointer(&p, end, cie.fde_enc & 0x0f, &range))
+		return false;
+	if (pc < start || pc >= start + range)
+		return false;
+	read_uleb128(&p, end);		/* the 'z' augmentation length */
+
+	/* Before any instruction: CFA = sp, ra and s0 live */
+	row->cfa_reg = DWARF_REG_SP;
+	row->cfa_offset = 0;
+	row->ra.rule = CFI_SAME;
+	row->fp.rule = CFI_SAME;
+	if (!run_cfi(cie.insns, cie.end, start, ULONG_MAX, &cie, row, NULL))
+		return false;
+	init = *row;
+
+	return run_cfi(p, end, start, pc, &cie, row, &init);
+}
+
+static bool read_slot(unsigned long low, unsigned long high,
+		      unsigned long addr, unsigned long *val)
+{
+	if (addr < low || addr > high - sizeof(unsigned long) ||
+	    addr & (sizeof(unsigned long) - 1))
+		return false;
+	*val = READ_ONCE_NOCHECK(*(unsigned long *)addr);
+	return true;
+}
+
+int notrace unwind_frame(struct task_struct *task,
+			 struct unwind_frame_info *frame)
+{
+	unsigned long low, high, cfa, ra, fp;
+	struct cfi_row row;
+
+	low = frame->sp;
+	high = (unsigned long)task_stack_page(task) + THREAD_SIZE;
+
+	if (!find_cfi(frame->pc, &row)) {
+		/* An interrupted leaf without CFI: sp and s0 are untouched */
+		if (!frame->ra)
+			return -ENOENT;
+		frame->pc = frame->ra - 0x4;
+		frame->ra = 0;
+		return 0;
+	}
+
+	if (row.cfa_reg == DWARF_REG_SP)
+		cfa = frame->sp + row.cfa_offset;
+	else if (row.cfa_reg == DWARF_REG_FP)
+		cfa = frame->fp + row.cfa_offset;
+	else
+		return -EINVAL;
+	if (cfa < low || cfa > high || cfa & 0x7)
+		return -EINVAL;
+
+	switch (row.ra.rule) {
+	case CFI_OFFSET:
+		if (!read_slot(low, cfa, cfa + row.ra.offset, &ra))
+			return -EINVAL;
+		/* see through return_to_handler when the graph tracer is on */
+		ra = ftrace_graph_ret_addr(task, &frame->graph, ra,
+					   (unsigned long *)(cfa + row.ra.offset));
+		break;
+	case CFI_SAME:
+		if (!frame->ra)
+			return -EINVAL;
+		ra = frame->ra;
+		break;
+	default:
+		return -ENOENT;
+	}
+
+	fp = frame->fp;
+	if (row.fp.rule == CFI_OFFSET &&
+	    !read_slot(low, cfa, cfa + row.fp.offset, &fp))
+		return -EINVAL;
+
+	frame->pc = ra - 0x4;
+	frame->sp = cfa;
+	frame->fp = fp;
+	frame->ra = 0;
+	return 0;
+}
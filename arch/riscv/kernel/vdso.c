@@ -21,6 +21,9 @@
 #include <linux/slab.h>
 #include <linux/binfmts.h>
 #include <linux/err.h>
+#include <linux/hrtimer.h>
+#include <linux/timekeeper_internal.h>
+#include <linux/timer_riscv.h>
 
 #include <asm/vdso.h>
 
@@ -50,14 +53,18 @@ static int __init vdso_init(void)
 		return -ENOMEM;
 	}
 
+	/* The data page sits right below the code, see vdso.lds.S */
+	vdso_pagelist[0] = virt_to_page(vdso_data);
 	for (i = 0; i < vdso_pages; i++) {
 		struct page *pg;
 
 		pg = virt_to_page(vdso_start + (i << PAGE_SHIFT));
 		ClearPageReserved(pg);
-		vdso_pagelist[i] = pg;
+		vdso_pagelist[i + 1] = pg;
 	}
-	vdso_pagelist[i] = virt_to_page(vdso_data);
+
+	vdso_data->hrtimer_res = hrtimer_resolution;
+	vdso_data->coarse_res = LOW_RES_NSEC;
 
 	return 0;
 }
@@ -79,6 +86,13 @@ int arch_setup_additional_pages(struct linux_binprm *bprm,
 		goto end;
 	}
 
+	/* Map the data page read-only below the code. */
+	ret = install_special_mapping(mm, vdso_base, PAGE_SIZE,
+		(VM_READ | VM_MAYREAD), vdso_pagelist);
+	if (unlikely(ret))
+		goto end;
+	vdso_base += PAGE_SIZE;
+
 	/*
 	 * Put vDSO base into mm struct. We need to do this before calling
 	 * install_special_mapping or the perf counter mmap tracking code
@@ -86,9 +100,9 @@ int arch_setup_additional_pages(struct linux_binprm *bprm,
 	 */
 	mm->context.vdso = (void *)vdso_base;
 
-	ret = install_special_mapping(mm, vdso_base, vdso_len,
+	ret = install_special_mapping(mm, vdso_base, vdso_len - PAGE_SIZE,
 		(VM_READ | VM_EXEC | VM_MAYREAD | VM_MAYWRITE | VM_MAYEXEC),
-		vdso_pagelist);
+		vdso_pagelist + 1);
 
 	if (unlikely(ret))
 		mm->context.vdso = NULL;
@@ -102,9 +116,50 @@ const char *arch_vma_name(struct vm_area_struct *vma)
 {
 	if (vma->vm_mm && (vma->vm_start == (long)vma->vm_mm->context.vdso))
 		return "[vdso]";
+	if (vma->vm_mm && (vma->vm_end == (long)vma->vm_mm->context.vdso))
+		return "[vvar]";
 	return NULL;
 }
 
+#ifdef CONFIG_GENERIC_TIME_VSYSCALL
+/*
+ * Update the vDSO data page to keep in sync with kernel timekeeping.
+ */
+void update_vsyscall(struct timekeeper *tk)
+{
+	struct clocksource *clock = tk->tkr_mono.clock;
+	u32 use_syscall = clock->read != timer_riscv_source(0)->read;
+
+	++vdso_data->seq;
+	smp_wmb();
+
+	vdso_data->use_syscall		= use_syscall;
+	vdso_data->xtime_coarse_sec	= tk->xtime_sec;
+	vdso_data->xtime_coarse_nsec	= tk->tkr_mono.xtime_nsec >>
+						tk->tkr_mono.shift;
+	vdso_data->wtm_sec		= tk->wall_to_monotonic.tv_sec;
+	vdso_data->wtm_nsec		= tk->wall_to_monotonic.tv_nsec;
+
+	if (!use_syscall) {
+		vdso_data->cs_cycle_last	= tk->tkr_mono.cycle_last;
+		vdso_data->cs_mask		= tk->tkr_mono.mask;
+		vdso_data->cs_mult		= tk->tkr_mono.mult;
+		vdso_data->cs_shift		= tk->tkr_mono.shift;
+		vdso_data->xtime_sec		= tk->xtime_sec;
+		vdso_data->xtime_nsec		= tk->tkr_mono.xtime_nsec;
+	}
+
+	smp_wmb();
+	++vdso_data->seq;
+}
+
+void update_vsyscall_tz(void)
+{
+	vdso_data->tz_minuteswest	= sys_tz.tz_minuteswest;
+	vdso_data->tz_dsttime		= sys_tz.tz_dsttime;
+}
+#endif /* CONFIG_GENERIC_TIME_VSYSCALL */
+
 /*
  * Function stubs to prevent linker errors when AT_SYSINFO_EHDR is defined
  */
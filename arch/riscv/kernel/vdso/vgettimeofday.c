@@ -0,0 +1,260 @@
+/*
+ * Userspace implementations of gettimeofday() and friends.
+ * Based on arch/mips/vdso/gettimeofday.c
+ *
+ * Copyright (C) 2015 Imagination Technologies
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/compiler.h>
+#include <linux/time.h>
+
+#include <asm/barrier.h>
+#include <asm/timex.h>
+#include <asm/unistd.h>
+#include <asm/vdso.h>
+
+/* Provided by vdso.lds.S, one page below the start of the vDSO text */
+extern const struct vdso_data _vdso_data __attribute__((visibility("hidden")));
+
+static __always_inline const struct vdso_data *get_vdso_data(void)
+{
+	return &_vdso_data;
+}
+
+static __always_inline u32 vdso_data_read_begin(const struct vdso_data *data)
+{
+	u32 seq;
+
+	while ((seq = READ_ONCE(data->seq)) & 1)
+		cpu_relax();
+
+	smp_rmb();
+	return seq;
+}
+
+static __always_inline int vdso_data_read_retry(const struct vdso_data *data,
+						u32 start_seq)
+{
+	smp_rmb();
+	return READ_ONCE(data->seq) != start_seq;
+}
+
+static __always_inline long syscall_fallback(long nr, long arg0, long arg1)
+{
+	register long a0 asm("a0") = arg0;
+	register long a1 asm("a1") = arg1;
+	register long a7 asm("a7") = nr;
+
+	asm volatile ("ecall"
+		      : "+r" (a0)
+		      : "r" (a1), "r" (a7)
+		      : "memory");
+
+	return a0;
+}
+
+static __always_inline int do_realtime_coarse(struct timespec *ts,
+					      const struct vdso_data *data)
+{
+	u32 start_seq;
+
+	do {
+		start_seq = vdso_data_read_begin(data);
+
+		ts->tv_sec = data->xtime_coarse_sec;
+		ts->tv_nsec = data->xtime_coarse_nsec;
+	} while (vdso_data_read_retry(data, start_seq));
+
+	return 0;
+}
+
+static __always_inline int do_monotonic_coarse(struct timespec *ts,
+					       const struct vdso_data *data)
+{
+	u32 start_seq;
+	u64 to_mono_sec;
+	u64 to_mono_nsec;
+
+	do {
+		start_seq = vdso_data_read_begin(data);
+
+		ts->tv_sec = data->xtime_coarse_sec;
+		ts->tv_nsec = data->xtime_coarse_nsec;
+
+		to_mono_sec = data->wtm_sec;
+		to_mono_nsec = data->wtm_nsec;
+	} while (vdso_data_read_retry(data, start_seq));
+
+	ts->tv_sec += to_mono_sec;
+	timespec_add_ns(ts, to_mono_nsec);
+
+	return 0;
+}
+
+static __always_inline u64 get_ns(const struct vdso_data *data)
+{
+	u64 delta, nsec;
+
+	delta = (get_cycles64() - data->cs_cycle_last) & data->cs_mask;
+
+	nsec = (delta * data->cs_mult) + data->xtime_nsec;
+	nsec >>= data->cs_shift;
+
+	return nsec;
+}
+
+static __always_inline int do_realtime(struct timespec *ts,
+				       const struct vdso_data *data)
+{
+	u32 start_seq;
+	u64 ns;
+
+	do {
+		start_seq = vdso_data_read_begin(data);
+
+		if (data->use_syscall)
+			return -ENOSYS;
+
+		ts->tv_sec = data->xtime_sec;
+		ns = get_ns(data);
+	} while (vdso_data_read_retry(data, start_seq));
+
+	ts->tv_nsec = 0;
+	timespec_add_ns(ts, ns);
+
+	return 0;
+}
+
+static __always_inline int do_monotonic(struct timespec *ts,
+					const struct vdso_data *data)
+{
+	u32 start_seq;
+	u64 ns;
+	u64 to_mono_sec;
+	u64 to_mono_nsec;
+
+	do {
+		start_seq = vdso_data_read_begin(data);
+
+		if (data->use_syscall)
+			return -ENOSYS;
+
+		ts->tv_sec = data->xtime_sec;
+		ns = get_ns(data);
+
+		to_mono_sec = data->wtm_sec;
+		to_mono_nsec = data->wtm_nsec;
+	} while (vdso_data_read_retry(data, start_seq));
+
+	ts->tv_sec += to_mono_sec;
+	ts->tv_nsec = 0;
+	timespec_add_ns(ts, ns + to_mono_nsec);
+
+	return 0;
+}
+
+int __vdso_clock_gettime(clockid_t clkid, struct timespec *ts)
+{
+	const struct vdso_data *data = get_vdso_data();
+	int ret = -1;
+
+	switch (clkid) {
+	case CLOCK_REALTIME_COARSE:
+		ret = do_realtime_coarse(ts, data);
+		break;
+	case CLOCK_MONOTONIC_COARSE:
+		ret = do_monotonic_coarse(ts, data);
+		break;
+	case CLOCK_REALTIME:
+		ret = do_realtime(ts, data);
+		break;
+	case CLOCK_MONOTONIC:
+		ret = do_monotonic(ts, data);
+		break;
+	default:
+		break;
+	}
+
+	if (ret)
+		ret = syscall_fallback(__NR_clock_gettime, clkid, (long)ts);
+
+	return ret;
+}
+
+int __vdso_gettimeofday(struct timeval *tv, struct timezone *tz)
+{
+	const struct vdso_data *data = get_vdso_data();
+
+	if (tv) {
+		struct timespec ts;
+
+		if (do_realtime(&ts, data))
+			return syscall_fallback(__NR_gettimeofday,
+						(long)tv, (long)tz);
+
+		tv->tv_sec = ts.tv_sec;
+		tv->tv_usec = ts.tv_nsec / 1000;
+	}
+
+	if (tz) {
+		tz->tz_minuteswest = data->tz_minuteswest;
+		tz->tz_dsttime = data->tz_dsttime;
+	}
+
+	return 0;
+}
+
+int __vdso_clock_getres(clockid_t clkid, struct timespec *res)
+{
+	const struct vdso_data *data = get_vdso_data();
+	long nsec;
+
+	switch (clkid) {
+	case CLOCK_REALTIME:
+	case CLOCK_MONOTONIC:
+		nsec = data->hrtimer_res;
+		break;
+	case CLOCK_REALTIME_COARSE:
+	case CLOCK_MONOTONIC_COARSE:
+		nsec = data->coarse_res;
+		break;
+	default:
+		return syscall_fallback(__NR_clock_getres, clkid, (long)res);
+	}
+
+	if (res) {
+		res->tv_sec = 0;
+		res->tv_nsec = nsec;
+	}
+
+	return 0;
+}
+
+/*
+ * There is no user-readable hart ID on RISC-V, so the vDSO can't answer
+ * this on its own; exporting it still lets libc bind to one entry point.
+ */
+int __vdso_getcpu(unsigned int *cpu, unsigned int *node, void *unused)
+{
+	register long a0 asm("a0") = (long)cpu;
+	register long a1 asm("a1") = (long)node;
+	register long a2 asm("a2") = (long)unused;
+	register long a7 asm("a7") = __NR_getcpu;
+
+	asm volatile ("ecall"
+		      : "+r" (a0)
+		      : "r" (a1), "r" (a2), "r" (a7)
+		      : "memory");
+
+	return a0;
+}
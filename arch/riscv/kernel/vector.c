@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/export.h>
+#include <linux/preempt.h>
+#include <linux/sched.h>
+#include <linux/sched/signal.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+
+#include <asm/csr.h>
+#include <asm/simd.h>
+#include <asm/vector.h>
+
+unsigned long riscv_v_vsize __read_mostly;
+EXPORT_SYMBOL_GPL(riscv_v_vsize);
+
+static DEFINE_PER_CPU(bool, kernel_vector_busy);
+
+#define OPCODE_LOAD_FP	0x07
+#define OPCODE_STORE_FP	0x27
+#define OPCODE_SYSTEM	0x73
+#define OPCODE_OP_V	0x57
+
+/* vlenb only reads with the vector unit on; it is the same on every hart. */
+void riscv_v_setup_vsize(void)
+{
+	unsigned long vlenb;
+
+	csr_set(sstatus, SR_VS);
+	vlenb = csr_read(CSR_VLENB);
+	csr_clear(sstatus, SR_VS);
+
+	riscv_v_vsize = 32 * vlenb;
+	pr_info("vector extension: vlenb %lu bytes\n", vlenb);
+}
+
+int riscv_v_thread_zalloc(struct task_struct *task)
+{
+	void *datap;
+
+	datap = kzalloc(riscv_v_vsize, GFP_KERNEL);
+	if (!datap)
+		return -ENOMEM;
+
+	memset(&task->thread.vstate, 0, sizeof(task->thread.vstate));
+	task->thread.vstate.vlenb = riscv_v_vsize / 32;
+	task->thread.vstate.datap = datap;
+	return 0;
+}
+
+void riscv_v_thread_free(struct task_struct *task)
+{
+	kfree(task->thread.vstate.datap);
+	memset(&task->thread.vstate, 0, sizeof(task->thread.vstate));
+}
+
+/* Does this instruction need sstatus.VS on? */
+static bool insn_is_vector(u32 insn)
+{
+	u32 width, csr;
+
+	switch (insn & 0x7f) {
+	case OPCODE_OP_V:
+		/* Vector arithmetic and vsetvl{i} */
+		return true;
+	case OPCODE_LOAD_FP:
+	case OPCODE_STORE_FP:
+		/* Scalar FP loads and stores use widths 1 to 4 */
+		width = (insn >> 12) & 0x7;
+		return width == 0 || width > 4;
+	case OPCODE_SYSTEM:
+		/* A CSR access; funct3 0 and 4 aren't */
+		if (!((insn >> 12) & 0x3))
+			return false;
+		csr = insn >> 20;
+		return (csr >= CSR_VSTART && csr <= CSR_VCSR) ||
+		       (csr >= CSR_VL && csr <= CSR_VLENB);
+	}
+
+	return false;
+}
+
+/*
+ * User tasks start with the vector unit off and no buffer for the state.
+ * The first vector instruction traps here, as an illegal instruction,
+ * which allocates the buffer and turns the unit on for the task.
+ */
+bool riscv_v_first_use_handler(struct pt_regs *regs)
+{
+	u16 __user *epc = (u16 __user *)regs->sepc;
+	u16 parcel;
+	u32 insn;
+
+	if (!has_vector() || riscv_v_vstate_query(regs))
+		return false;
+
+	/* Instructions may only be 16-bit aligned. */
+	if (__get_user(parcel, epc))
+		return false;
+	insn = parcel;
+	if ((insn & 0x3) != 0x3)
+		return false;
+	if (__get_user(parcel, epc + 1))
+		return false;
+	insn |= (u32)parcel << 16;
+
+	if (!insn_is_vector(insn))
+		return false;
+
+	/* Came from user mode, where interrupts were on. */
+	local_irq_enable();
+
+	WARN_ON(current->thread.vstate.datap);
+	if (riscv_v_thread_zalloc(current)) {
+		force_sig(SIGBUS, current);
+		return true;
+	}
+
+	/* Load the zeroed state, so nothing leaks from the previous user. */
+	preempt_disable();
+	__riscv_v_vstate_restore(&current->thread.vstate);
+	__riscv_v_vstate_clean(regs);
+	preempt_enable();
+
+	return true;
+}
+
+void kernel_vector_begin(void)
+{
+	struct pt_regs *regs = task_pt_regs(current);
+
+	if (WARN_ON(!has_vector()))
+		return;
+
+	BUG_ON(!may_use_simd());
+
+	preempt_disable();
+	WARN_ON(this_cpu_read(kernel_vector_busy));
+	this_cpu_write(kernel_vector_busy, true);
+
+	/* Stash the user's registers if they are live and changed. */
+	riscv_v_vstate_save(current, regs);
+
+	csr_set(sstatus, SR_VS);
+}
+EXPORT_SYMBOL_GPL(kernel_vector_begin);
+
+void kernel_vector_end(void)
+{
+	struct pt_regs *regs = task_pt_regs(current);
+
+	if (WARN_ON(!has_vector()))
+		return;
+
+	/* Put back whatever the user task had before. */
+	riscv_v_vstate_restore(current, regs);
+
+	csr_clear(sstatus, SR_VS);
+
+	this_cpu_write(kernel_vector_busy, false);
+	preempt_enable();
+}
+EXPORT_SYMBOL_GPL(kernel_vector_end);
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/errno.h>
+#include <linux/err.h>
+#include <linux/module.h>
+#include <linux/kvm_host.h>
+#include <asm/csr.h>
+#include <asm/hwcap.h>
+
+/* Traps the guest handles itself without the host seeing them */
+#define KVM_HEDELEG	((1UL << EXC_INST_MISALIGNED) | \
+			 (1UL << EXC_BREAKPOINT) | \
+			 (1UL << EXC_SYSCALL) | \
+			 (1UL << EXC_INST_PAGE_FAULT) | \
+			 (1UL << EXC_LOAD_PAGE_FAULT) | \
+			 (1UL << EXC_STORE_PAGE_FAULT))
+
+#define KVM_HIDELEG	(HVIP_VSSIP | HVIP_VSTIP | HVIP_VSEIP)
+
+long kvm_arch_dev_ioctl(struct file *filp,
+			unsigned int ioctl, unsigned long arg)
+{
+	return -EINVAL;
+}
+
+void kvm_arch_check_processor_compat(void *rtn)
+{
+	*(int *)rtn = 0;
+}
+
+int kvm_arch_hardware_setup(void)
+{
+	return 0;
+}
+
+int kvm_arch_hardware_enable(void)
+{
+	csr_write(CSR_HEDELEG, KVM_HEDELEG);
+	csr_write(CSR_HIDELEG, KVM_HIDELEG);
+
+	/* VS-mode gets every counter, scounteren still gates VU-mode */
+	csr_write(CSR_HCOUNTEREN, -1UL);
+
+	csr_write(CSR_HVIP, 0);
+
+	return 0;
+}
+
+void kvm_arch_hardware_disable(void)
+{
+	csr_write(CSR_HEDELEG, 0);
+	csr_write(CSR_HIDELEG, 0);
+}
+
+int kvm_arch_init(void *opaque)
+{
+	int ret;
+
+	if (!riscv_isa_extension_available(RISCV_ISA_EXT_h)) {
+		kvm_info("hypervisor extension not available\n");
+		return -ENODEV;
+	}
+
+	ret = kvm_riscv_stage2_mode_detect();
+	if (ret) {
+		kvm_info("G-stage translation mode not supported\n");
+		return ret;
+	}
+
+	kvm_riscv_stage2_vmid_detect();
+
+	kvm_riscv_guest_timer_init();
+
+	kvm_info("hypervisor extension available\n");
+	kvm_info("VMID %ld bits available\n", kvm_riscv_stage2_vmid_bits());
+
+	return 0;
+}
+
+void kvm_arch_exit(void)
+{
+}
+
+static int riscv_kvm_init(void)
+{
+	return kvm_init(NULL, sizeof(struct kvm_vcpu), 0, THIS_MODULE);
+}
+module_init(riscv_kvm_init);
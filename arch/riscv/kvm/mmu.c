@@ -0,0 +1,695 @@
+/*
+ * G-stage (guest physical to host physical) translation
+ *
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/err.h>
+#include <linux/hugetlb.h>
+#include <linux/module.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/kvm_host.h>
+#include <linux/sched/signal.h>
+#include <asm/page.h>
+#include <asm/pgtable.h>
+
+/*
+ * The G-stage formats are the host's with two more bits of index at the
+ * root level, which is therefore four pages long and 16KiB aligned.
+ */
+#ifdef CONFIG_64BIT
+#define stage2_mode		HGATP_MODE_SV39X4
+#define stage2_pgd_levels	3
+#define stage2_index_bits	9
+#else
+#define stage2_mode		HGATP_MODE_SV32X4
+#define stage2_pgd_levels	2
+#define stage2_index_bits	10
+#endif
+
+#define stage2_pgd_xbits	2
+#define stage2_pgd_size		(PAGE_SIZE << stage2_pgd_xbits)
+#define stage2_gpa_bits		(PAGE_SHIFT + \
+				 (stage2_pgd_levels * stage2_index_bits) + \
+				 stage2_pgd_xbits)
+#define stage2_gpa_size		((gpa_t)(1ULL << stage2_gpa_bits))
+
+#define stage2_pte_leaf(__ptep)	\
+	(pte_val(*(__ptep)) & (_PAGE_READ | _PAGE_WRITE | _PAGE_EXEC))
+
+static inline unsigned long stage2_pte_index(gpa_t addr, u32 level)
+{
+	unsigned long mask;
+	unsigned long shift = PAGE_SHIFT + (stage2_index_bits * level);
+
+	if (level == (stage2_pgd_levels - 1))
+		mask = (PTRS_PER_PTE << stage2_pgd_xbits) - 1;
+	else
+		mask = PTRS_PER_PTE - 1;
+
+	return (addr >> shift) & mask;
+}
+
+static inline pte_t *stage2_pte_next(pte_t pte)
+{
+	return (pte_t *)pfn_to_virt(pte_val(pte) >> _PAGE_PFN_SHIFT);
+}
+
+static inline unsigned long stage2_level_to_page_size(u32 level)
+{
+	return PAGE_SIZE << (level * stage2_index_bits);
+}
+
+static int stage2_page_size_to_level(unsigned long page_size, u32 *level)
+{
+	u32 i;
+
+	for (i = 0; i < stage2_pgd_levels; i++) {
+		if (page_size == stage2_level_to_page_size(i)) {
+			*level = i;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static int stage2_cache_topup(struct kvm_mmu_memory_cache *pcache,
+			      int min, int max)
+{
+	void *page;
+
+	BUG_ON(max > KVM_NR_MEM_OBJS);
+	if (pcache->nobjs >= min)
+		return 0;
+	while (pcache->nobjs < max) {
+		page = (void *)__get_free_page(GFP_KERNEL | __GFP_ZERO);
+		if (!page)
+			return -ENOMEM;
+		pcache->objects[pcache->nobjs++] = page;
+	}
+
+	return 0;
+}
+
+static void stage2_cache_flush(struct kvm_mmu_memory_cache *pcache)
+{
+	while (pcache->nobjs)
+		free_page((unsigned long)pcache->objects[--pcache->nobjs]);
+}
+
+static void *stage2_cache_alloc(struct kvm_mmu_memory_cache *pcache)
+{
+	if (!pcache || !pcache->nobjs)
+		return NULL;
+
+	return pcache->objects[--pcache->nobjs];
+}
+
+/*
+ * Find the leaf mapping addr.  Without one, *level is where the walk hit
+ * an empty entry, so nothing is mapped in the whole block of that size.
+ */
+static bool stage2_get_leaf_entry(struct kvm *kvm, gpa_t addr,
+				  pte_t **ptepp, u32 *level)
+{
+	u32 current_level = stage2_pgd_levels - 1;
+	pte_t *ptep = (pte_t *)kvm->arch.pgd;
+
+	ptep = &ptep[stage2_pte_index(addr, current_level)];
+	for (;;) {
+		*level = current_level;
+		if (!pte_val(*ptep))
+			return false;
+		if (stage2_pte_leaf(ptep)) {
+			*ptepp = ptep;
+			return true;
+		}
+		if (!current_level)
+			return false;
+
+		current_level--;
+		ptep = stage2_pte_next(*ptep);
+		ptep = &ptep[stage2_pte_index(addr, current_level)];
+	}
+}
+
+static int stage2_set_pte(struct kvm *kvm, u32 level,
+			  struct kvm_mmu_memory_cache *pcache,
+			  gpa_t addr, pte_t new_pte)
+{
+	u32 current_level = stage2_pgd_levels - 1;
+	pte_t *next_ptep = (pte_t *)kvm->arch.pgd;
+	pte_t *ptep = &next_ptep[stage2_pte_index(addr, current_level)];
+	pte_t old_pte;
+
+	if (current_level < level)
+		return -EINVAL;
+
+	while (current_level != level) {
+		/*
+		 * A block mapped before dirty logging was turned on covers
+		 * addr.  Drop it and let the rest of it fault back in a page
+		 * at a time, but not before a table is at hand to replace it.
+		 */
+		if (stage2_pte_leaf(ptep)) {
+			if (!pcache || !pcache->nobjs)
+				return -ENOMEM;
+			set_pte(ptep, __pte(0));
+			kvm_flush_remote_tlbs(kvm);
+		}
+
+		if (!pte_val(*ptep)) {
+			next_ptep = stage2_cache_alloc(pcache);
+			if (!next_ptep)
+				return -ENOMEM;
+			set_pte(ptep, pfn_pte(PFN_DOWN(__pa(next_ptep)),
+					      __pgprot(_PAGE_TABLE)));
+		} else {
+			next_ptep = stage2_pte_next(*ptep);
+		}
+
+		current_level--;
+		ptep = &next_ptep[stage2_pte_index(addr, current_level)];
+	}
+
+	/*
+	 * Tables stay linked in until the VM goes away, see
+	 * stage2_range_op(), so a block can't take the place of one.
+	 */
+	if (level && pte_val(*ptep) && !stage2_pte_leaf(ptep))
+		return -EEXIST;
+
+	old_pte = *ptep;
+	set_pte(ptep, new_pte);
+
+	/*
+	 * Callers taking permissions away flush every hart themselves.  What
+	 * is left is a fault that found the mapping too weak, and only this
+	 * hart can be faulting on a stale copy of it; the others will come
+	 * through here again if they hit one.
+	 */
+	if (pte_val(old_pte))
+		__kvm_riscv_hfence_gvma_vmid_gpa(addr >> 2,
+						 READ_ONCE(kvm->arch.vmid.vmid));
+
+	return 0;
+}
+
+static int stage2_map_page(struct kvm *kvm,
+			   struct kvm_mmu_memory_cache *pcache,
+			   gpa_t gpa, phys_addr_t hpa,
+			   unsigned long page_size, bool writable)
+{
+	unsigned long prot;
+	u32 level;
+	int ret;
+
+	ret = stage2_page_size_to_level(page_size, &level);
+	if (ret)
+		return ret;
+
+	/*
+	 * G-stage accesses are all checked as user accesses.  A and D are
+	 * set up front so that harts which update them in software don't
+	 * take a second fault; clearing A for aging makes such harts fault
+	 * again, which maps the page back in.
+	 */
+	prot = _PAGE_PRESENT | _PAGE_READ | _PAGE_EXEC | _PAGE_USER |
+	       _PAGE_ACCESSED;
+	if (writable)
+		prot |= _PAGE_WRITE | _PAGE_DIRTY;
+
+	return stage2_set_pte(kvm, level, pcache, gpa,
+			      pfn_pte(PFN_DOWN(hpa), __pgprot(prot)));
+}
+
+enum stage2_op {
+	STAGE2_OP_CLEAR,	/* drop leaves */
+	STAGE2_OP_WP,		/* write-protect leaves */
+};
+
+/*
+ * Apply op to every leaf in [start, end).  A leaf that only partly
+ * overlaps is treated as a whole, which is never wrong for either op.
+ * Page table pages stay linked in until the VM goes away, so a hart
+ * walking them speculatively before the flush never sees freed memory.
+ * Returns whether anything changed and the TLBs need flushing.
+ */
+static bool stage2_range_op(struct kvm *kvm, gpa_t start, gpa_t end,
+			    enum stage2_op op)
+{
+	unsigned long page_size;
+	bool changed = false;
+	gpa_t addr = start;
+	pte_t *ptep;
+	u32 level;
+
+	while (addr < end) {
+		bool found = stage2_get_leaf_entry(kvm, addr, &ptep, &level);
+
+		page_size = stage2_level_to_page_size(level);
+		if (found) {
+			if (op == STAGE2_OP_CLEAR) {
+				set_pte(ptep, __pte(0));
+				changed = true;
+			} else if (pte_val(*ptep) & _PAGE_WRITE) {
+				set_pte(ptep, __pte(pte_val(*ptep) &
+						    ~(_PAGE_WRITE | _PAGE_DIRTY)));
+				changed = true;
+			}
+		}
+
+		addr = (addr & ~((gpa_t)page_size - 1)) + page_size;
+	}
+
+	return changed;
+}
+
+static void stage2_free_table(pte_t *table, u32 level, unsigned long nr)
+{
+	unsigned long i;
+
+	if (level) {
+		for (i = 0; i < nr; i++) {
+			if (pte_val(table[i]) && !stage2_pte_leaf(&table[i]))
+				stage2_free_table(stage2_pte_next(table[i]),
+						  level - 1, PTRS_PER_PTE);
+		}
+	}
+
+	if (level < stage2_pgd_levels - 1)
+		free_page((unsigned long)table);
+}
+
+static void stage2_wp_memory_region(struct kvm *kvm, int slot)
+{
+	struct kvm_memslots *slots = kvm_memslots(kvm);
+	struct kvm_memory_slot *memslot = id_to_memslot(slots, slot);
+	gpa_t start = memslot->base_gfn << PAGE_SHIFT;
+	gpa_t end = (memslot->base_gfn + memslot->npages) << PAGE_SHIFT;
+	bool flush;
+
+	spin_lock(&kvm->mmu_lock);
+	flush = stage2_range_op(kvm, start, end, STAGE2_OP_WP);
+	spin_unlock(&kvm->mmu_lock);
+
+	if (flush)
+		kvm_flush_remote_tlbs(kvm);
+}
+
+void kvm_arch_mmu_enable_log_dirty_pt_masked(struct kvm *kvm,
+					     struct kvm_memory_slot *slot,
+					     gfn_t gfn_offset,
+					     unsigned long mask)
+{
+	phys_addr_t base_gfn = slot->base_gfn + gfn_offset;
+	phys_addr_t start = (base_gfn +  __ffs(mask)) << PAGE_SHIFT;
+	phys_addr_t end = (base_gfn + __fls(mask) + 1) << PAGE_SHIFT;
+
+	/* kvm_vm_ioctl_get_dirty_log() flushes once it is done */
+	stage2_range_op(kvm, start, end, STAGE2_OP_WP);
+}
+
+void kvm_arch_free_memslot(struct kvm *kvm, struct kvm_memory_slot *free,
+			   struct kvm_memory_slot *dont)
+{
+}
+
+int kvm_arch_create_memslot(struct kvm *kvm, struct kvm_memory_slot *slot,
+			    unsigned long npages)
+{
+	return 0;
+}
+
+void kvm_arch_memslots_updated(struct kvm *kvm, struct kvm_memslots *slots)
+{
+}
+
+void kvm_arch_flush_shadow_all(struct kvm *kvm)
+{
+	spin_lock(&kvm->mmu_lock);
+	stage2_range_op(kvm, 0, stage2_gpa_size, STAGE2_OP_CLEAR);
+	spin_unlock(&kvm->mmu_lock);
+
+	kvm_flush_remote_tlbs(kvm);
+}
+
+void kvm_arch_flush_shadow_memslot(struct kvm *kvm,
+				   struct kvm_memory_slot *slot)
+{
+	gpa_t gpa = slot->base_gfn << PAGE_SHIFT;
+	gpa_t size = slot->npages << PAGE_SHIFT;
+
+	spin_lock(&kvm->mmu_lock);
+	stage2_range_op(kvm, gpa, gpa + size, STAGE2_OP_CLEAR);
+	spin_unlock(&kvm->mmu_lock);
+
+	kvm_flush_remote_tlbs(kvm);
+}
+
+void kvm_arch_commit_memory_region(struct kvm *kvm,
+				const struct kvm_userspace_memory_region *mem,
+				const struct kvm_memory_slot *old,
+				const struct kvm_memory_slot *new,
+				enum kvm_mr_change change)
+{
+	/*
+	 * At this point memslot has been committed and there is an
+	 * allocated dirty_bitmap[], dirty pages will be tracked while the
+	 * memory slot is write protected.
+	 */
+	if (change != KVM_MR_DELETE && mem->flags & KVM_MEM_LOG_DIRTY_PAGES)
+		stage2_wp_memory_region(kvm, mem->slot);
+}
+
+int kvm_arch_prepare_memory_region(struct kvm *kvm,
+				struct kvm_memory_slot *memslot,
+				const struct kvm_userspace_memory_region *mem,
+				enum kvm_mr_change change)
+{
+	if (change != KVM_MR_CREATE && change != KVM_MR_MOVE &&
+	    change != KVM_MR_FLAGS_ONLY)
+		return 0;
+
+	/* Guest memory has to fit what hgatp can translate */
+	if ((memslot->base_gfn + memslot->npages) >
+	    (stage2_gpa_size >> PAGE_SHIFT))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int handle_hva_to_gpa(struct kvm *kvm,
+			     unsigned long start,
+			     unsigned long end,
+			     int (*handler)(struct kvm *kvm,
+					    gpa_t gpa, u64 size,
+					    void *data),
+			     void *data)
+{
+	struct kvm_memslots *slots;
+	struct kvm_memory_slot *memslot;
+	int ret = 0;
+
+	slots = kvm_memslots(kvm);
+
+	/* we only care about the pages that the guest sees */
+	kvm_for_each_memslot(memslot, slots) {
+		unsigned long hva_start, hva_end;
+		gpa_t gpa;
+
+		hva_start = max(start, memslot->userspace_addr);
+		hva_end = min(end, memslot->userspace_addr +
+					(memslot->npages << PAGE_SHIFT));
+		if (hva_start >= hva_end)
+			continue;
+
+		gpa = hva_to_gfn_memslot(hva_start, memslot) << PAGE_SHIFT;
+		ret |= handler(kvm, gpa, (u64)(hva_end - hva_start), data);
+	}
+
+	return ret;
+}
+
+static int kvm_unmap_hva_handler(struct kvm *kvm, gpa_t gpa, u64 size,
+				 void *data)
+{
+	return stage2_range_op(kvm, gpa, gpa + size, STAGE2_OP_CLEAR);
+}
+
+/* The notifier in kvm_main.c flushes when these return nonzero */
+int kvm_unmap_hva(struct kvm *kvm, unsigned long hva)
+{
+	return kvm_unmap_hva_range(kvm, hva, hva + PAGE_SIZE);
+}
+
+int kvm_unmap_hva_range(struct kvm *kvm,
+			unsigned long start, unsigned long end)
+{
+	if (!kvm->arch.pgd)
+		return 0;
+
+	return handle_hva_to_gpa(kvm, start, end,
+				 &kvm_unmap_hva_handler, NULL);
+}
+
+static int kvm_set_spte_handler(struct kvm *kvm, gpa_t gpa, u64 size,
+				void *data)
+{
+	pte_t *pte = (pte_t *)data;
+
+	/*
+	 * The new page is mapped read-only, like arm does, so the next
+	 * write faults and goes through the normal path.  There is no
+	 * cache to allocate from: without a table in place the address
+	 * wasn't mapped, and stays so.
+	 */
+	stage2_map_page(kvm, NULL, gpa, pte_val(*pte) >> _PAGE_PFN_SHIFT <<
+			PAGE_SHIFT, PAGE_SIZE, false);
+	return 0;
+}
+
+void kvm_set_spte_hva(struct kvm *kvm, unsigned long hva, pte_t pte)
+{
+	unsigned long end = hva + PAGE_SIZE;
+
+	if (!kvm->arch.pgd)
+		return;
+
+	handle_hva_to_gpa(kvm, hva, end, &kvm_set_spte_handler, &pte);
+	kvm_flush_remote_tlbs(kvm);
+}
+
+static int kvm_age_hva_handler(struct kvm *kvm, gpa_t gpa, u64 size,
+			       void *data)
+{
+	pte_t *ptep;
+	u32 level;
+
+	if (!stage2_get_leaf_entry(kvm, gpa, &ptep, &level))
+		return 0;
+
+	return ptep_test_and_clear_young(NULL, 0, ptep);
+}
+
+static int kvm_test_age_hva_handler(struct kvm *kvm, gpa_t gpa, u64 size,
+				    void *data)
+{
+	pte_t *ptep;
+	u32 level;
+
+	if (!stage2_get_leaf_entry(kvm, gpa, &ptep, &level))
+		return 0;
+
+	return pte_young(*ptep);
+}
+
+int kvm_age_hva(struct kvm *kvm, unsigned long start, unsigned long end)
+{
+	if (!kvm->arch.pgd)
+		return 0;
+
+	return handle_hva_to_gpa(kvm, start, end, kvm_age_hva_handler, NULL);
+}
+
+int kvm_test_age_hva(struct kvm *kvm, unsigned long hva)
+{
+	if (!kvm->arch.pgd)
+		return 0;
+
+	return handle_hva_to_gpa(kvm, hva, hva + PAGE_SIZE,
+				 kvm_test_age_hva_handler, NULL);
+}
+
+/* Largest block the fault at gpa can be mapped with */
+static unsigned long stage2_fault_page_size(struct kvm_memory_slot *memslot,
+					    struct vm_area_struct *vma,
+					    gpa_t gpa, unsigned long hva)
+{
+	unsigned long size, gpa_start, uaddr_start;
+
+	if (!is_vm_hugetlb_page(vma))
+		return PAGE_SIZE;
+
+	size = huge_page_size(hstate_vma(vma));
+	if (size != PMD_SIZE && size != PGDIR_SIZE)
+		return PAGE_SIZE;
+
+	/* The block has to line up on both sides and sit inside the slot */
+	gpa_start = memslot->base_gfn << PAGE_SHIFT;
+	uaddr_start = memslot->userspace_addr;
+	if ((gpa_start & (size - 1)) != (uaddr_start & (size - 1)))
+		return PAGE_SIZE;
+	if ((hva & ~(size - 1)) < uaddr_start ||
+	    (hva & ~(size - 1)) + size >
+	    uaddr_start + (memslot->npages << PAGE_SHIFT))
+		return PAGE_SIZE;
+
+	return size;
+}
+
+int kvm_riscv_stage2_map(struct kvm_vcpu *vcpu,
+			 struct kvm_memory_slot *memslot,
+			 gpa_t gpa, unsigned long hva, bool is_write)
+{
+	struct kvm *kvm = vcpu->kvm;
+	struct kvm_mmu_memory_cache *pcache = &vcpu->arch.mmu_page_cache;
+	bool logging = memslot->dirty_bitmap &&
+		       !(memslot->flags & KVM_MEM_READONLY);
+	struct vm_area_struct *vma;
+	unsigned long page_size, mmu_seq, offset;
+	gpa_t fault_gpa = gpa;
+	bool writable;
+	kvm_pfn_t hfn;
+	gfn_t gfn;
+	int ret;
+
+	down_read(&current->mm->mmap_sem);
+	vma = find_vma_intersection(current->mm, hva, hva + 1);
+	if (unlikely(!vma)) {
+		kvm_err("Failed to find VMA for hva 0x%lx\n", hva);
+		up_read(&current->mm->mmap_sem);
+		return -EFAULT;
+	}
+	/* Dirty logging wants write faults at page granularity */
+	page_size = logging ? PAGE_SIZE :
+		    stage2_fault_page_size(memslot, vma, gpa, hva);
+	up_read(&current->mm->mmap_sem);
+
+	gpa &= ~((gpa_t)page_size - 1);
+	gfn = gpa >> PAGE_SHIFT;
+
+	/* Enough pages for every level below the root */
+	ret = stage2_cache_topup(pcache, stage2_pgd_levels, KVM_NR_MEM_OBJS);
+	if (ret)
+		return ret;
+
+	mmu_seq = kvm->mmu_notifier_seq;
+	smp_rmb();
+
+	hfn = gfn_to_pfn_prot(kvm, gfn, is_write, &writable);
+	if (hfn == KVM_PFN_ERR_HWPOISON) {
+		send_sig(SIGBUS, current, 0);
+		return 0;
+	}
+	if (is_error_noslot_pfn(hfn))
+		return -EFAULT;
+
+	/* While logging, only a write fault may map a page writable */
+	if (logging && !is_write)
+		writable = false;
+
+	spin_lock(&kvm->mmu_lock);
+
+	if (mmu_notifier_retry(kvm, mmu_seq))
+		goto out_unlock;
+
+	if (writable) {
+		kvm_set_pfn_dirty(hfn);
+		mark_page_dirty(kvm, gfn);
+	}
+
+	ret = stage2_map_page(kvm, pcache, gpa, (phys_addr_t)hfn << PAGE_SHIFT,
+			      page_size, writable);
+	/* Something is mapped at page granularity there already */
+	if (ret == -EEXIST && page_size != PAGE_SIZE) {
+		offset = (fault_gpa - gpa) >> PAGE_SHIFT;
+		ret = stage2_map_page(kvm, pcache, fault_gpa & PAGE_MASK,
+				      (phys_addr_t)(hfn + offset) << PAGE_SHIFT,
+				      PAGE_SIZE, writable);
+	}
+	if (ret)
+		kvm_err("Failed to map in G-stage\n");
+
+out_unlock:
+	spin_unlock(&kvm->mmu_lock);
+	kvm_set_pfn_accessed(hfn);
+	kvm_release_pfn_clean(hfn);
+
+	return ret;
+}
+
+void kvm_mmu_free_memory_caches(struct kvm_vcpu *vcpu)
+{
+	stage2_cache_flush(&vcpu->arch.mmu_page_cache);
+}
+
+int kvm_riscv_stage2_alloc_pgd(struct kvm *kvm)
+{
+	struct page *pgd_page;
+
+	if (kvm->arch.pgd != NULL) {
+		kvm_err("kvm_arch already initialized?\n");
+		return -EINVAL;
+	}
+
+	pgd_page = alloc_pages(GFP_KERNEL | __GFP_ZERO,
+				get_order(stage2_pgd_size));
+	if (!pgd_page)
+		return -ENOMEM;
+	kvm->arch.pgd = page_to_virt(pgd_page);
+	kvm->arch.pgd_phys = page_to_phys(pgd_page);
+
+	return 0;
+}
+
+void kvm_riscv_stage2_free_pgd(struct kvm *kvm)
+{
+	void *pgd;
+
+	spin_lock(&kvm->mmu_lock);
+	pgd = kvm->arch.pgd;
+	if (pgd) {
+		stage2_free_table((pte_t *)pgd, stage2_pgd_levels - 1,
+				  PTRS_PER_PTE << stage2_pgd_xbits);
+		kvm->arch.pgd = NULL;
+		kvm->arch.pgd_phys = 0;
+	}
+	spin_unlock(&kvm->mmu_lock);
+
+	if (pgd)
+		free_pages((unsigned long)pgd, get_order(stage2_pgd_size));
+}
+
+void kvm_riscv_stage2_update_hgatp(struct kvm_vcpu *vcpu)
+{
+	struct kvm_arch *k = &vcpu->kvm->arch;
+	unsigned long hgatp = stage2_mode;
+
+	hgatp |= (READ_ONCE(k->vmid.vmid) << HGATP_VMID_SHIFT) &
+		 HGATP_VMID_MASK;
+	hgatp |= (k->pgd_phys >> PAGE_SHIFT) & HGATP_PPN;
+
+	csr_write(CSR_HGATP, hgatp);
+
+	/* Without VMIDs, whatever ran here last may have left entries */
+	if (!kvm_riscv_stage2_vmid_bits()) {
+		__kvm_riscv_hfence_gvma_all();
+		__kvm_riscv_hfence_vvma_all();
+	}
+}
+
+int kvm_riscv_stage2_mode_detect(void)
+{
+	unsigned long hgatp;
+
+	csr_write(CSR_HGATP, stage2_mode);
+	hgatp = csr_read(CSR_HGATP);
+	csr_write(CSR_HGATP, 0);
+	__kvm_riscv_hfence_gvma_all();
+
+	return (hgatp & stage2_mode) == stage2_mode ? 0 : -ENODEV;
+}
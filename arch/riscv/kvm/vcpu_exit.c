@@ -0,0 +1,551 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/errno.h>
+#include <linux/err.h>
+#include <linux/kvm_host.h>
+#include <asm/csr.h>
+
+#define INSN_MATCH_LB		0x3
+#define INSN_MASK_LB		0x707f
+#define INSN_MATCH_LH		0x1003
+#define INSN_MASK_LH		0x707f
+#define INSN_MATCH_LW		0x2003
+#define INSN_MASK_LW		0x707f
+#define INSN_MATCH_LD		0x3003
+#define INSN_MASK_LD		0x707f
+#define INSN_MATCH_LBU		0x4003
+#define INSN_MASK_LBU		0x707f
+#define INSN_MATCH_LHU		0x5003
+#define INSN_MASK_LHU		0x707f
+#define INSN_MATCH_LWU		0x6003
+#define INSN_MASK_LWU		0x707f
+#define INSN_MATCH_SB		0x23
+#define INSN_MASK_SB		0x707f
+#define INSN_MATCH_SH		0x1023
+#define INSN_MASK_SH		0x707f
+#define INSN_MATCH_SW		0x2023
+#define INSN_MASK_SW		0x707f
+#define INSN_MATCH_SD		0x3023
+#define INSN_MASK_SD		0x707f
+
+#define INSN_MATCH_C_LD		0x6000
+#define INSN_MASK_C_LD		0xe003
+#define INSN_MATCH_C_SD		0xe000
+#define INSN_MASK_C_SD		0xe003
+#define INSN_MATCH_C_LW		0x4000
+#define INSN_MASK_C_LW		0xe003
+#define INSN_MATCH_C_SW		0xc000
+#define INSN_MASK_C_SW		0xe003
+#define INSN_MATCH_C_LDSP	0x6002
+#define INSN_MASK_C_LDSP	0xe003
+#define INSN_MATCH_C_SDSP	0xe002
+#define INSN_MASK_C_SDSP	0xe003
+#define INSN_MATCH_C_LWSP	0x4002
+#define INSN_MASK_C_LWSP	0xe003
+#define INSN_MATCH_C_SWSP	0xc002
+#define INSN_MASK_C_SWSP	0xe003
+
+#define INSN_MATCH_WFI		0x10500073
+#define INSN_MASK_WFI		0xffffffff
+
+#define INSN_IS_16BIT(insn)	(((insn) & 0x3) != 0x3)
+#define INSN_LEN(insn)		(INSN_IS_16BIT(insn) ? 2 : 4)
+
+/* Register fields: rd and rs2 of the base formats, then the RVC ones */
+#define INSN_RD(insn)		(((insn) >> 7) & 0x1f)
+#define INSN_RS2(insn)		(((insn) >> 20) & 0x1f)
+#define INSN_C_RD_RS2_P(insn)	((((insn) >> 2) & 0x7) + 8)
+#define INSN_C_RD(insn)		(((insn) >> 7) & 0x1f)
+#define INSN_C_RS2(insn)	(((insn) >> 2) & 0x1f)
+
+/* kvm_cpu_context starts like pt_regs, so GPR n is its nth word */
+#define GUEST_REG(vcpu, n)	(((unsigned long *)&(vcpu)->arch.guest_context)[n])
+
+/*
+ * HLVX.HU, HLV.W and HLV.D with rd = t0 and rs1 = t2, and HLVX.HU into t1
+ * for the upper half of an instruction.  The assembler doesn't know the
+ * hypervisor extension yet.
+ */
+#define HLVX_HU_T0_T2		".word 0x6433c2f3\n"
+#define HLVX_HU_T1_T2		".word 0x6433c373\n"
+#ifdef CONFIG_64BIT
+#define HLV_ULONG_T0_T2		".word 0x6c03c2f3\n"
+#else
+#define HLV_ULONG_T0_T2		".word 0x6803c2f3\n"
+#endif
+
+/**
+ * kvm_riscv_vcpu_unpriv_read -- Read machine word from Guest memory
+ *
+ * @vcpu: The VCPU pointer
+ * @read_insn: Flag representing whether we are reading instruction
+ * @guest_addr: Guest address to read
+ * @trap: Output pointer to trap details
+ *
+ * The access goes through the guest's own translation, at the privilege
+ * hstatus.SPVP says it trapped from.  Any fault it takes is returned in
+ * @trap, ready to be redirected to the guest; trap->scause is zero if
+ * there was none.
+ */
+unsigned long kvm_riscv_vcpu_unpriv_read(struct kvm_vcpu *vcpu,
+					 bool read_insn,
+					 unsigned long guest_addr,
+					 struct kvm_cpu_trap *trap)
+{
+	register unsigned long taddr asm("a0") = (unsigned long)trap;
+	register unsigned long ttmp asm("a1");
+	register unsigned long val asm("t0");
+	register unsigned long tmp asm("t1");
+	register unsigned long addr asm("t2") = guest_addr;
+	unsigned long flags;
+	unsigned long old_stvec, old_hstatus;
+
+	local_irq_save(flags);
+
+	old_hstatus = csr_swap(CSR_HSTATUS, vcpu->arch.guest_context.hstatus);
+	old_stvec = csr_swap(stvec, (unsigned long)&__kvm_riscv_unpriv_trap);
+
+	trap->scause = 0;
+
+	if (read_insn) {
+		/* Instructions are only 2-byte aligned, so read in halves */
+		asm volatile ("\n"
+			HLVX_HU_T0_T2
+			"andi	%[tmp], %[val], 3\n"
+			"addi	%[tmp], %[tmp], -3\n"
+			"bne	%[tmp], zero, 2f\n"
+			"addi	%[addr], %[addr], 2\n"
+			HLVX_HU_T1_T2
+			"sll	%[tmp], %[tmp], 16\n"
+			"add	%[val], %[val], %[tmp]\n"
+			"2:\n"
+		: [val] "=&r" (val), [tmp] "=&r" (tmp),
+		  [taddr] "+&r" (taddr), [ttmp] "=&r" (ttmp),
+		  [addr] "+&r" (addr) : : "memory");
+	} else {
+		asm volatile ("\n"
+			HLV_ULONG_T0_T2
+		: [val] "=&r" (val),
+		  [taddr] "+&r" (taddr), [ttmp] "=&r" (ttmp),
+		  [addr] "+&r" (addr) : : "memory");
+	}
+
+	csr_write(stvec, old_stvec);
+	csr_write(CSR_HSTATUS, old_hstatus);
+
+	local_irq_restore(flags);
+
+	return val;
+}
+
+/**
+ * kvm_riscv_vcpu_trap_redirect -- Redirect trap to Guest
+ *
+ * @vcpu: The VCPU pointer
+ * @trap: Trap details
+ *
+ * Does what the hart would have done had the trap been delegated: the
+ * guest enters its trap handler in VS-mode with the cause in its CSRs.
+ */
+void kvm_riscv_vcpu_trap_redirect(struct kvm_vcpu *vcpu,
+				  struct kvm_cpu_trap *trap)
+{
+	unsigned long vsstatus = csr_read(CSR_VSSTATUS);
+
+	/* SPP is the mode the guest was in */
+	vsstatus &= ~SR_PS;
+	if (vcpu->arch.guest_context.sstatus & SR_PS)
+		vsstatus |= SR_PS;
+
+	/* SPIE = SIE, then SIE = 0 */
+	vsstatus &= ~SR_PIE;
+	if (vsstatus & SR_IE)
+		vsstatus |= SR_PIE;
+	vsstatus &= ~SR_IE;
+
+	csr_write(CSR_VSSTATUS, vsstatus);
+	csr_write(CSR_VSCAUSE, trap->scause);
+	csr_write(CSR_VSTVAL, trap->stval);
+	csr_write(CSR_VSEPC, trap->sepc);
+
+	/* Resume at the guest's trap vector, in VS-mode */
+	vcpu->arch.guest_context.sepc = csr_read(CSR_VSTVEC);
+	vcpu->arch.guest_context.sstatus |= SR_PS;
+}
+
+static void redirect_illegal_insn(struct kvm_vcpu *vcpu,
+				  struct kvm_cpu_trap *trap,
+				  unsigned long insn)
+{
+	struct kvm_cpu_trap utrap = {
+		.sepc = trap->sepc,
+		.scause = EXC_INST_ILLEGAL,
+		.stval = insn,
+	};
+
+	kvm_riscv_vcpu_trap_redirect(vcpu, &utrap);
+}
+
+/*
+ * Get the instruction that trapped.  htinst has it in transformed form,
+ * with bit 1 clear if the original was a compressed one, when the hart
+ * bothers to provide it; otherwise read it from guest memory.  Returns
+ * false if that faulted, in which case the guest has been sent the fault.
+ */
+static bool get_trapped_insn(struct kvm_vcpu *vcpu, struct kvm_cpu_trap *trap,
+			     unsigned long *insn, int *insn_len)
+{
+	struct kvm_cpu_trap utrap;
+
+	if (trap->htinst & 0x1) {
+		*insn = trap->htinst | 0x3;
+		*insn_len = (trap->htinst & 0x2) ? INSN_LEN(*insn) : 2;
+		return true;
+	}
+
+	*insn = kvm_riscv_vcpu_unpriv_read(vcpu, true, trap->sepc, &utrap);
+	if (utrap.scause) {
+		utrap.sepc = trap->sepc;
+		kvm_riscv_vcpu_trap_redirect(vcpu, &utrap);
+		return false;
+	}
+	*insn_len = INSN_LEN(*insn);
+
+	return true;
+}
+
+static int emulate_load(struct kvm_vcpu *vcpu, struct kvm_run *run,
+			unsigned long fault_addr, struct kvm_cpu_trap *trap)
+{
+	struct kvm_mmio_decode *d = &vcpu->arch.mmio_decode;
+	unsigned long insn;
+	int len = 0, reg, insn_len;
+	bool sign = true;
+
+	if (!get_trapped_insn(vcpu, trap, &insn, &insn_len))
+		return 1;
+
+	if ((insn & INSN_MASK_LB) == INSN_MATCH_LB) {
+		len = 1;
+		reg = INSN_RD(insn);
+	} else if ((insn & INSN_MASK_LBU) == INSN_MATCH_LBU) {
+		len = 1;
+		sign = false;
+		reg = INSN_RD(insn);
+	} else if ((insn & INSN_MASK_LH) == INSN_MATCH_LH) {
+		len = 2;
+		reg = INSN_RD(insn);
+	} else if ((insn & INSN_MASK_LHU) == INSN_MATCH_LHU) {
+		len = 2;
+		sign = false;
+		reg = INSN_RD(insn);
+	} else if ((insn & INSN_MASK_LW) == INSN_MATCH_LW) {
+		len = 4;
+		reg = INSN_RD(insn);
+#ifdef CONFIG_64BIT
+	} else if ((insn & INSN_MASK_LWU) == INSN_MATCH_LWU) {
+		len = 4;
+		sign = false;
+		reg = INSN_RD(insn);
+	} else if ((insn & INSN_MASK_LD) == INSN_MATCH_LD) {
+		len = 8;
+		reg = INSN_RD(insn);
+	} else if ((insn & INSN_MASK_C_LD) == INSN_MATCH_C_LD) {
+		len = 8;
+		reg = INSN_C_RD_RS2_P(insn);
+	} else if ((insn & INSN_MASK_C_LDSP) == INSN_MATCH_C_LDSP &&
+		   INSN_C_RD(insn)) {
+		len = 8;
+		reg = INSN_C_RD(insn);
+#endif
+	} else if ((insn & INSN_MASK_C_LW) == INSN_MATCH_C_LW) {
+		len = 4;
+		reg = INSN_C_RD_RS2_P(insn);
+	} else if ((insn & INSN_MASK_C_LWSP) == INSN_MATCH_C_LWSP &&
+		   INSN_C_RD(insn)) {
+		len = 4;
+		reg = INSN_C_RD(insn);
+	} else {
+		return -EOPNOTSUPP;
+	}
+
+	/* Fault_addr must be aligned to the access, as for real devices */
+	if (fault_addr & (len - 1))
+		return -EIO;
+
+	d->reg = reg;
+	d->insn_len = insn_len;
+	d->len = len;
+	d->shift = sign ? 8 * (sizeof(unsigned long) - len) : 0;
+	d->return_handled = 0;
+
+	run->mmio.is_write = false;
+	run->mmio.phys_addr = fault_addr;
+	run->mmio.len = len;
+
+	/* Devices emulated in the kernel first, then userspace */
+	if (!kvm_io_bus_read(vcpu, KVM_MMIO_BUS, fault_addr, len,
+			     run->mmio.data)) {
+		kvm_riscv_vcpu_mmio_return(vcpu, run);
+		vcpu->stat.mmio_exit_kernel++;
+		return 1;
+	}
+
+	vcpu->stat.mmio_exit_user++;
+	run->exit_reason = KVM_EXIT_MMIO;
+
+	return 0;
+}
+
+static int emulate_store(struct kvm_vcpu *vcpu, struct kvm_run *run,
+			 unsigned long fault_addr, struct kvm_cpu_trap *trap)
+{
+	struct kvm_mmio_decode *d = &vcpu->arch.mmio_decode;
+	unsigned long insn, data;
+	int len = 0, insn_len;
+
+	if (!get_trapped_insn(vcpu, trap, &insn, &insn_len))
+		return 1;
+
+	if ((insn & INSN_MASK_SB) == INSN_MATCH_SB) {
+		len = 1;
+		data = GUEST_REG(vcpu, INSN_RS2(insn));
+	} else if ((insn & INSN_MASK_SH) == INSN_MATCH_SH) {
+		len = 2;
+		data = GUEST_REG(vcpu, INSN_RS2(insn));
+	} else if ((insn & INSN_MASK_SW) == INSN_MATCH_SW) {
+		len = 4;
+		data = GUEST_REG(vcpu, INSN_RS2(insn));
+#ifdef CONFIG_64BIT
+	} else if ((insn & INSN_MASK_SD) == INSN_MATCH_SD) {
+		len = 8;
+		data = GUEST_REG(vcpu, INSN_RS2(insn));
+	} else if ((insn & INSN_MASK_C_SD) == INSN_MATCH_C_SD) {
+		len = 8;
+		data = GUEST_REG(vcpu, INSN_C_RD_RS2_P(insn));
+	} else if ((insn & INSN_MASK_C_SDSP) == INSN_MATCH_C_SDSP) {
+		len = 8;
+		data = GUEST_REG(vcpu, INSN_C_RS2(insn));
+#endif
+	} else if ((insn & INSN_MASK_C_SW) == INSN_MATCH_C_SW) {
+		len = 4;
+		data = GUEST_REG(vcpu, INSN_C_RD_RS2_P(insn));
+	} else if ((insn & INSN_MASK_C_SWSP) == INSN_MATCH_C_SWSP) {
+		len = 4;
+		data = GUEST_REG(vcpu, INSN_C_RS2(insn));
+	} else {
+		return -EOPNOTSUPP;
+	}
+
+	if (fault_addr & (len - 1))
+		return -EIO;
+
+	d->reg = 0;
+	d->insn_len = insn_len;
+	d->len = len;
+	d->shift = 0;
+	d->return_handled = 0;
+
+	switch (len) {
+	case 1:
+		*((u8 *)run->mmio.data) = data;
+		break;
+	case 2:
+		*((u16 *)run->mmio.data) = data;
+		break;
+	case 4:
+		*((u32 *)run->mmio.data) = data;
+		break;
+	case 8:
+		*((u64 *)run->mmio.data) = data;
+		break;
+	}
+
+	run->mmio.is_write = true;
+	run->mmio.phys_addr = fault_addr;
+	run->mmio.len = len;
+
+	if (!kvm_io_bus_write(vcpu, KVM_MMIO_BUS, fault_addr, len,
+			      run->mmio.data)) {
+		kvm_riscv_vcpu_mmio_return(vcpu, run);
+		vcpu->stat.mmio_exit_kernel++;
+		return 1;
+	}
+
+	vcpu->stat.mmio_exit_user++;
+	run->exit_reason = KVM_EXIT_MMIO;
+
+	return 0;
+}
+
+/**
+ * kvm_riscv_vcpu_mmio_return -- Handle MMIO loads after user space emulation
+ *			     or in-kernel IO emulation
+ *
+ * @vcpu: The VCPU pointer
+ * @run:  The VCPU run struct containing the mmio data
+ */
+int kvm_riscv_vcpu_mmio_return(struct kvm_vcpu *vcpu, struct kvm_run *run)
+{
+	struct kvm_mmio_decode *d = &vcpu->arch.mmio_decode;
+	unsigned long data;
+
+	if (d->return_handled)
+		return 0;
+	d->return_handled = 1;
+
+	if (!run->mmio.is_write) {
+		switch (d->len) {
+		case 1:
+			data = *((u8 *)run->mmio.data);
+			break;
+		case 2:
+			data = *((u16 *)run->mmio.data);
+			break;
+		case 4:
+			data = *((u32 *)run->mmio.data);
+			break;
+		default:
+			data = *((u64 *)run->mmio.data);
+			break;
+		}
+
+		if (d->reg)
+			GUEST_REG(vcpu, d->reg) =
+				(unsigned long)((long)(data << d->shift) >>
+						d->shift);
+	}
+
+	/* Move to next instruction */
+	vcpu->arch.guest_context.sepc += d->insn_len;
+
+	return 0;
+}
+
+static int stage2_page_fault(struct kvm_vcpu *vcpu, struct kvm_run *run,
+			     struct kvm_cpu_trap *trap)
+{
+	struct kvm_memory_slot *memslot;
+	unsigned long hva, fault_addr;
+	bool writable;
+	gfn_t gfn;
+	int ret;
+
+	/* htval has the faulting guest physical address shifted by two */
+	fault_addr = (trap->htval << 2) | (trap->stval & 0x3);
+	gfn = fault_addr >> PAGE_SHIFT;
+	memslot = gfn_to_memslot(vcpu->kvm, gfn);
+	hva = gfn_to_hva_memslot_prot(memslot, gfn, &writable);
+
+	if (kvm_is_error_hva(hva) ||
+	    (trap->scause == EXC_STORE_GUEST_PAGE_FAULT && !writable)) {
+		switch (trap->scause) {
+		case EXC_LOAD_GUEST_PAGE_FAULT:
+			return emulate_load(vcpu, run, fault_addr, trap);
+		case EXC_STORE_GUEST_PAGE_FAULT:
+			return emulate_store(vcpu, run, fault_addr, trap);
+		default:
+			return -EOPNOTSUPP;
+		}
+	}
+
+	ret = kvm_riscv_stage2_map(vcpu, memslot, fault_addr, hva,
+				   trap->scause == EXC_STORE_GUEST_PAGE_FAULT);
+	if (ret < 0)
+		return ret;
+
+	return 1;
+}
+
+static int virtual_inst_fault(struct kvm_vcpu *vcpu, struct kvm_run *run,
+			      struct kvm_cpu_trap *trap)
+{
+	unsigned long insn = trap->stval;
+	int insn_len;
+
+	/* stval is allowed to be zero instead of the instruction */
+	if (!insn && !get_trapped_insn(vcpu, trap, &insn, &insn_len))
+		return 1;
+
+	if ((insn & INSN_MASK_WFI) == INSN_MATCH_WFI) {
+		vcpu->stat.wfi_exit_stat++;
+		if (!kvm_arch_vcpu_runnable(vcpu)) {
+			srcu_read_unlock(&vcpu->kvm->srcu, vcpu->srcu_idx);
+			kvm_vcpu_block(vcpu);
+			vcpu->srcu_idx = srcu_read_lock(&vcpu->kvm->srcu);
+			kvm_clear_request(KVM_REQ_UNHALT, vcpu);
+		}
+		vcpu->arch.guest_context.sepc += INSN_LEN(insn);
+		return 1;
+	}
+
+	/* Nothing else is emulated: the guest gets what bare metal would do */
+	redirect_illegal_insn(vcpu, trap, insn);
+
+	return 1;
+}
+
+/*
+ * Return > 0 to return to guest, < 0 on error, 0 (and set exit_reason) on
+ * proper exit to userspace.
+ */
+int kvm_riscv_vcpu_exit(struct kvm_vcpu *vcpu, struct kvm_run *run,
+			struct kvm_cpu_trap *trap)
+{
+	int ret;
+
+	/* The interrupt bit is the sign bit; the host took it already */
+	if ((long)trap->scause < 0)
+		return 1;
+
+	ret = -EFAULT;
+	run->exit_reason = KVM_EXIT_UNKNOWN;
+
+	/* Anything trapping with SPV clear didn't come from the guest */
+	if (!(vcpu->arch.guest_context.hstatus & HSTATUS_SPV))
+		goto out;
+
+	switch (trap->scause) {
+	case EXC_INST_ILLEGAL:
+		redirect_illegal_insn(vcpu, trap, trap->stval);
+		ret = 1;
+		break;
+	case EXC_VIRTUAL_INST_FAULT:
+		ret = virtual_inst_fault(vcpu, run, trap);
+		break;
+	case EXC_INST_GUEST_PAGE_FAULT:
+	case EXC_LOAD_GUEST_PAGE_FAULT:
+	case EXC_STORE_GUEST_PAGE_FAULT:
+		ret = stage2_page_fault(vcpu, run, trap);
+		break;
+	case EXC_SUPERVISOR_SYSCALL:
+		ret = kvm_riscv_vcpu_sbi_ecall(vcpu, run);
+		break;
+	default:
+		break;
+	}
+
+out:
+	if (ret < 0) {
+		kvm_err("VCPU exit error %d\n", ret);
+		kvm_err("SEPC=0x%lx SSTATUS=0x%lx HSTATUS=0x%lx\n",
+			vcpu->arch.guest_context.sepc,
+			vcpu->arch.guest_context.sstatus,
+			vcpu->arch.guest_context.hstatus);
+		kvm_err("SCAUSE=0x%lx STVAL=0x%lx HTVAL=0x%lx HTINST=0x%lx\n",
+			trap->scause, trap->stval, trap->htval, trap->htinst);
+	}
+
+	return ret;
+}
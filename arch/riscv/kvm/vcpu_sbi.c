@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/bitmap.h>
+#include <linux/errno.h>
+#include <linux/err.h>
+#include <linux/kvm_host.h>
+#include <linux/sched.h>
+#include <linux/uaccess.h>
+#include <asm/csr.h>
+#include <asm/sbi.h>
+
+/*
+ * The guest talks to its "firmware" through the same legacy SBI calls the
+ * host kernel uses.  What touches vCPU state is handled here; the rest,
+ * the console and disk calls, goes to userspace as KVM_EXIT_RISCV_SBI,
+ * and what userspace leaves in ret[0] is the guest's a0.
+ */
+
+int kvm_riscv_vcpu_sbi_return(struct kvm_vcpu *vcpu, struct kvm_run *run)
+{
+	struct kvm_cpu_context *cp = &vcpu->arch.guest_context;
+
+	if (!vcpu->arch.sbi_pending)
+		return 0;
+	vcpu->arch.sbi_pending = false;
+
+	/* Step over the ecall */
+	cp->sepc += 4;
+	cp->a0 = run->riscv_sbi.ret[0];
+
+	return 0;
+}
+
+static void kvm_sbi_forward(struct kvm_vcpu *vcpu, struct kvm_run *run)
+{
+	struct kvm_cpu_context *cp = &vcpu->arch.guest_context;
+
+	vcpu->arch.sbi_pending = true;
+	run->exit_reason = KVM_EXIT_RISCV_SBI;
+	run->riscv_sbi.function_id = cp->a7;
+	run->riscv_sbi.args[0] = cp->a0;
+	run->riscv_sbi.args[1] = cp->a1;
+	run->riscv_sbi.args[2] = cp->a2;
+	run->riscv_sbi.args[3] = cp->a3;
+	run->riscv_sbi.args[4] = cp->a4;
+	run->riscv_sbi.args[5] = cp->a5;
+	run->riscv_sbi.ret[0] = cp->a0;
+	run->riscv_sbi.ret[1] = cp->a1;
+}
+
+static void kvm_sbi_system_shutdown(struct kvm_vcpu *vcpu,
+				    struct kvm_run *run, u32 type)
+{
+	int i;
+	struct kvm_vcpu *tmp;
+
+	kvm_for_each_vcpu(i, tmp, vcpu->kvm)
+		tmp->arch.power_off = true;
+	kvm_make_all_cpus_request(vcpu->kvm, KVM_REQ_SLEEP);
+
+	memset(&run->system_event, 0, sizeof(run->system_event));
+	run->system_event.type = type;
+	run->exit_reason = KVM_EXIT_SYSTEM_EVENT;
+}
+
+/*
+ * The IPI and remote fence calls name their targets with a pointer to a
+ * hart mask in guest memory, one word long, whose bits are vCPU ids; NULL
+ * means every hart.  Turn that into a bitmap of vCPU indices.  Returns
+ * false if reading the mask faulted, which the guest has been sent.
+ */
+static bool kvm_sbi_get_targets(struct kvm_vcpu *vcpu, unsigned long *targets)
+{
+	struct kvm_cpu_context *cp = &vcpu->arch.guest_context;
+	struct kvm_cpu_trap utrap;
+	unsigned long hmask = -1UL;
+	struct kvm_vcpu *tmp;
+	int i;
+
+	if (cp->a0) {
+		hmask = kvm_riscv_vcpu_unpriv_read(vcpu, false, cp->a0, &utrap);
+		if (utrap.scause) {
+			utrap.sepc = cp->sepc;
+			kvm_riscv_vcpu_trap_redirect(vcpu, &utrap);
+			return false;
+		}
+	}
+
+	bitmap_zero(targets, KVM_MAX_VCPUS);
+	kvm_for_each_vcpu(i, tmp, vcpu->kvm) {
+		if (tmp->vcpu_id < BITS_PER_LONG && (hmask & BIT(tmp->vcpu_id)))
+			__set_bit(i, targets);
+	}
+
+	return true;
+}
+
+/* Like the flush requests in kvm_main.c, wait for the targets to exit */
+static void kvm_sbi_remote_request(struct kvm_vcpu *vcpu,
+				   unsigned long *targets, unsigned int req)
+{
+	cpumask_var_t cpus;
+
+	zalloc_cpumask_var(&cpus, GFP_KERNEL);
+	kvm_make_vcpus_request_mask(vcpu->kvm, req, targets, cpus);
+	free_cpumask_var(cpus);
+}
+
+/*
+ * Steal time is the run_delay of the vCPU thread, the time it spent
+ * runnable on a host runqueue, accumulated since the guest registered
+ * its record.  The record is rewritten on the first entry after each
+ * vCPU load, under a version count the guest retries its reads on.
+ */
+static long kvm_sbi_steal_time_set(struct kvm_vcpu *vcpu, gpa_t gpa)
+{
+	struct kvm_vcpu_steal_time *st = &vcpu->arch.steal_time;
+
+	st->gpa = 0;
+	if (!gpa)
+		return 0;
+
+	if (!IS_ALIGNED(gpa, sizeof(struct sbi_steal_time)))
+		return -EINVAL;
+	if (kvm_gfn_to_hva_cache_init(vcpu->kvm, &st->cache, gpa,
+				      sizeof(struct sbi_steal_time)))
+		return -EINVAL;
+
+	st->gpa = gpa;
+	st->last_steal = current->sched_info.run_delay;
+	kvm_make_request(KVM_REQ_STEAL_UPDATE, vcpu);
+
+	return 0;
+}
+
+void kvm_riscv_vcpu_record_steal_time(struct kvm_vcpu *vcpu)
+{
+	struct kvm_vcpu_steal_time *st = &vcpu->arch.steal_time;
+	u64 run_delay = current->sched_info.run_delay;
+
+	if (!st->gpa)
+		return;
+
+	if (unlikely(kvm_read_guest_cached(vcpu->kvm, &st->cache, &st->st,
+					   sizeof(st->st))))
+		return;
+
+	/* An odd count in a record the guest just handed us is junk */
+	if (st->st.version & 1)
+		st->st.version++;
+	st->st.version++;
+	kvm_write_guest_offset_cached(vcpu->kvm, &st->cache, &st->st.version,
+				      offsetof(struct sbi_steal_time, version),
+				      sizeof(st->st.version));
+	smp_wmb();
+
+	st->st.steal += run_delay - st->last_steal;
+	st->last_steal = run_delay;
+	st->st.preempted = 0;
+	kvm_write_guest_cached(vcpu->kvm, &st->cache, &st->st, sizeof(st->st));
+	smp_wmb();
+
+	st->st.version++;
+	kvm_write_guest_offset_cached(vcpu->kvm, &st->cache, &st->st.version,
+				      offsetof(struct sbi_steal_time, version),
+				      sizeof(st->st.version));
+}
+
+/*
+ * Called from kvm_arch_vcpu_put(), possibly from the preempt notifier, so
+ * page faults are off: if the page isn't mapped the hint is just lost.
+ */
+void kvm_riscv_vcpu_set_preempted(struct kvm_vcpu *vcpu)
+{
+	struct kvm_vcpu_steal_time *st = &vcpu->arch.steal_time;
+	int idx;
+
+	if (!st->gpa)
+		return;
+
+	st->st.preempted = 1;
+
+	pagefault_disable();
+	idx = srcu_read_lock(&vcpu->kvm->srcu);
+	kvm_write_guest_offset_cached(vcpu->kvm, &st->cache, &st->st.preempted,
+				      offsetof(struct sbi_steal_time, preempted),
+				      sizeof(st->st.preempted));
+	srcu_read_unlock(&vcpu->kvm->srcu, idx);
+	pagefault_enable();
+}
+
+int kvm_riscv_vcpu_sbi_ecall(struct kvm_vcpu *vcpu, struct kvm_run *run)
+{
+	struct kvm_cpu_context *cp = &vcpu->arch.guest_context;
+	DECLARE_BITMAP(targets, KVM_MAX_VCPUS);
+	struct kvm_vcpu *tmp;
+	u64 next_cycle;
+	int i, ret = 1;
+
+	vcpu->stat.ecall_exit_stat++;
+
+	switch (cp->a7) {
+	case SBI_SET_TIMER:
+#ifdef CONFIG_64BIT
+		next_cycle = (u64)cp->a0;
+#else
+		next_cycle = ((u64)cp->a1 << 32) | (u64)cp->a0;
+#endif
+		kvm_riscv_vcpu_timer_next_event(vcpu, next_cycle);
+		break;
+	case SBI_CLEAR_IPI:
+		kvm_riscv_vcpu_unset_interrupt(vcpu, IRQ_VS_SOFT);
+		break;
+	case SBI_SEND_IPI:
+		if (!kvm_sbi_get_targets(vcpu, targets))
+			return 1;
+		for_each_set_bit(i, targets, KVM_MAX_VCPUS) {
+			tmp = kvm_get_vcpu(vcpu->kvm, i);
+			if (tmp)
+				kvm_riscv_vcpu_set_interrupt(tmp, IRQ_VS_SOFT);
+		}
+		break;
+	case SBI_REMOTE_FENCE_I:
+		if (!kvm_sbi_get_targets(vcpu, targets))
+			return 1;
+		kvm_sbi_remote_request(vcpu, targets, KVM_REQ_FENCE_I);
+		break;
+	case SBI_REMOTE_SFENCE_VMA:
+	case SBI_REMOTE_SFENCE_VMA_ASID:
+		/* Ranges and ASIDs are only hints, so flush everything */
+		if (!kvm_sbi_get_targets(vcpu, targets))
+			return 1;
+		kvm_sbi_remote_request(vcpu, targets, KVM_REQ_HFENCE_VVMA_ALL);
+		break;
+	case SBI_STEAL_TIME:
+		cp->a0 = kvm_sbi_steal_time_set(vcpu, cp->a0);
+		break;
+	case SBI_SHUTDOWN:
+		kvm_sbi_system_shutdown(vcpu, run, KVM_SYSTEM_EVENT_SHUTDOWN);
+		ret = 0;
+		break;
+	default:
+		/* kvm_riscv_vcpu_sbi_return() steps over the ecall later */
+		kvm_sbi_forward(vcpu, run);
+		return 0;
+	}
+
+	cp->sepc += 4;
+
+	return ret;
+}
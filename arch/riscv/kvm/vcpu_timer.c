@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/errno.h>
+#include <linux/err.h>
+#include <linux/clocksource.h>
+#include <linux/hrtimer.h>
+#include <linux/kvm_host.h>
+#include <linux/math64.h>
+#include <linux/uaccess.h>
+#include <asm/delay.h>
+#include <asm/timex.h>
+
+/*
+ * The guest's time is the host's plus kvm->arch.time_delta, which the
+ * hart applies to its reads of the time CSR through htimedelta.  Its SBI
+ * timer is an hrtimer that raises VSTIP when the guest time gets there.
+ */
+
+static u32 timer_nsec_mult;
+static u32 timer_nsec_shift;
+
+static u64 kvm_riscv_guest_cycles(struct kvm_vcpu *vcpu)
+{
+	return get_cycles64() + vcpu->kvm->arch.time_delta;
+}
+
+static u64 kvm_riscv_delta_cycles2ns(u64 cycles, struct kvm_vcpu *vcpu)
+{
+	unsigned long flags;
+	u64 cycles_now, cycles_delta, delta_ns;
+
+	local_irq_save(flags);
+	cycles_now = kvm_riscv_guest_cycles(vcpu);
+	if (cycles_now < cycles)
+		cycles_delta = cycles - cycles_now;
+	else
+		cycles_delta = 0;
+	delta_ns = mul_u64_u32_shr(cycles_delta, timer_nsec_mult,
+				   timer_nsec_shift);
+	local_irq_restore(flags);
+
+	return delta_ns;
+}
+
+static enum hrtimer_restart kvm_riscv_vcpu_hrtimer_expired(struct hrtimer *h)
+{
+	u64 delta_ns;
+	struct kvm_vcpu_timer *t = container_of(h, struct kvm_vcpu_timer, hrt);
+	struct kvm_vcpu *vcpu = container_of(t, struct kvm_vcpu, arch.timer);
+
+	/* The conversion to ns may round down, so check again */
+	if (kvm_riscv_guest_cycles(vcpu) < t->next_cycles) {
+		delta_ns = kvm_riscv_delta_cycles2ns(t->next_cycles, vcpu);
+		hrtimer_forward_now(&t->hrt, ktime_set(0, delta_ns));
+		return HRTIMER_RESTART;
+	}
+
+	t->next_set = false;
+	kvm_riscv_vcpu_set_interrupt(vcpu, IRQ_VS_TIMER);
+
+	return HRTIMER_NORESTART;
+}
+
+static void kvm_riscv_vcpu_timer_cancel(struct kvm_vcpu_timer *t)
+{
+	if (!t->next_set)
+		return;
+
+	hrtimer_cancel(&t->hrt);
+	t->next_set = false;
+}
+
+int kvm_riscv_vcpu_timer_next_event(struct kvm_vcpu *vcpu, u64 ncycles)
+{
+	struct kvm_vcpu_timer *t = &vcpu->arch.timer;
+	u64 delta_ns;
+
+	kvm_riscv_vcpu_unset_interrupt(vcpu, IRQ_VS_TIMER);
+
+	delta_ns = kvm_riscv_delta_cycles2ns(ncycles, vcpu);
+	t->next_cycles = ncycles;
+	hrtimer_start(&t->hrt, ktime_set(0, delta_ns), HRTIMER_MODE_REL);
+	t->next_set = true;
+
+	return 0;
+}
+
+int kvm_riscv_vcpu_get_reg_timer(struct kvm_vcpu *vcpu,
+				 const struct kvm_one_reg *reg)
+{
+	struct kvm_vcpu_timer *t = &vcpu->arch.timer;
+	u64 __user *uaddr = (u64 __user *)(unsigned long)reg->addr;
+	unsigned long reg_num = reg->id & ~(KVM_REG_ARCH_MASK |
+					    KVM_REG_SIZE_MASK |
+					    KVM_REG_RISCV_TIMER);
+	u64 reg_val;
+
+	if (KVM_REG_SIZE(reg->id) != sizeof(u64))
+		return -EINVAL;
+
+	switch (reg_num) {
+	case KVM_REG_RISCV_TIMER_REG(frequency):
+		reg_val = riscv_timebase;
+		break;
+	case KVM_REG_RISCV_TIMER_REG(time):
+		reg_val = kvm_riscv_guest_cycles(vcpu);
+		break;
+	case KVM_REG_RISCV_TIMER_REG(compare):
+		reg_val = t->next_cycles;
+		break;
+	case KVM_REG_RISCV_TIMER_REG(state):
+		reg_val = t->next_set ? KVM_RISCV_TIMER_STATE_ON :
+					KVM_RISCV_TIMER_STATE_OFF;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (copy_to_user(uaddr, &reg_val, KVM_REG_SIZE(reg->id)))
+		return -EFAULT;
+
+	return 0;
+}
+
+int kvm_riscv_vcpu_set_reg_timer(struct kvm_vcpu *vcpu,
+				 const struct kvm_one_reg *reg)
+{
+	struct kvm_vcpu_timer *t = &vcpu->arch.timer;
+	u64 __user *uaddr = (u64 __user *)(unsigned long)reg->addr;
+	unsigned long reg_num = reg->id & ~(KVM_REG_ARCH_MASK |
+					    KVM_REG_SIZE_MASK |
+					    KVM_REG_RISCV_TIMER);
+	u64 reg_val;
+
+	if (KVM_REG_SIZE(reg->id) != sizeof(u64))
+		return -EINVAL;
+
+	if (copy_from_user(&reg_val, uaddr, KVM_REG_SIZE(reg->id)))
+		return -EFAULT;
+
+	switch (reg_num) {
+	case KVM_REG_RISCV_TIMER_REG(frequency):
+		/* The time base is the host's and can't be changed */
+		if (reg_val != riscv_timebase)
+			return -EINVAL;
+		break;
+	case KVM_REG_RISCV_TIMER_REG(time):
+		/* Shared by the whole VM, like the time CSR of real harts */
+		vcpu->kvm->arch.time_delta = reg_val - get_cycles64();
+		kvm_riscv_vcpu_timer_restore(vcpu);
+		break;
+	case KVM_REG_RISCV_TIMER_REG(compare):
+		t->next_cycles = reg_val;
+		break;
+	case KVM_REG_RISCV_TIMER_REG(state):
+		if (reg_val == KVM_RISCV_TIMER_STATE_ON)
+			kvm_riscv_vcpu_timer_next_event(vcpu, t->next_cycles);
+		else
+			kvm_riscv_vcpu_timer_cancel(t);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/* Every VM runs on the host's time base, so this is done once */
+void kvm_riscv_guest_timer_init(void)
+{
+	clocks_calc_mult_shift(&timer_nsec_mult, &timer_nsec_shift,
+			       riscv_timebase, NSEC_PER_SEC, 600);
+}
+
+int kvm_riscv_vcpu_timer_init(struct kvm_vcpu *vcpu)
+{
+	struct kvm_vcpu_timer *t = &vcpu->arch.timer;
+
+	hrtimer_init(&t->hrt, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	t->hrt.function = kvm_riscv_vcpu_hrtimer_expired;
+	t->next_set = false;
+
+	return 0;
+}
+
+void kvm_riscv_vcpu_timer_deinit(struct kvm_vcpu *vcpu)
+{
+	kvm_riscv_vcpu_timer_cancel(&vcpu->arch.timer);
+}
+
+/* Load the VM's time offset into htimedelta, on vCPU load */
+void kvm_riscv_vcpu_timer_restore(struct kvm_vcpu *vcpu)
+{
+	u64 delta = vcpu->kvm->arch.time_delta;
+
+#ifdef CONFIG_64BIT
+	csr_write(CSR_HTIMEDELTA, delta);
+#else
+	csr_write(CSR_HTIMEDELTA, (u32)delta);
+	csr_write(CSR_HTIMEDELTAH, (u32)(delta >> 32));
+#endif
+}
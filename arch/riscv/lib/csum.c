@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/compiler.h>
+#include <linux/export.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <net/checksum.h>
+
+#include <asm/simd.h>
+#include <asm/vector.h>
+
+/*
+ * Below this, saving and restoring the user's vector registers costs more
+ * than the vector loop saves.
+ */
+#define CSUM_VECTOR_MIN		2048
+
+asmlinkage unsigned long __csum_vector(const u32 *buf, unsigned long words);
+
+/*
+ * The ones' complement sum is kept as a plain sum plus a count of the
+ * carries out of it, so that consecutive adds don't depend on each other
+ * through the carry.
+ */
+#define CSUM_ADD(sum, carry, x)						\
+do {									\
+	unsigned long __x = (x);					\
+									\
+	(sum) += __x;							\
+	(carry) += (sum) < __x;						\
+} while (0)
+
+static inline unsigned int csum_fold_long(unsigned long sum,
+					  unsigned long carry)
+{
+	unsigned int s;
+
+	sum += carry;
+	if (sum < carry)
+		sum++;
+
+#ifdef CONFIG_64BIT
+	s = __csum_fold64(sum);
+#else
+	s = sum;
+#endif
+	s = (s & 0xffff) + (s >> 16);
+	return (s & 0xffff) + (s >> 16);
+}
+
+/* Sum n aligned longs from p, without the final fold */
+static inline void csum_longs(const unsigned long *p, unsigned long n,
+			      unsigned long *sum, unsigned long *carry)
+{
+	unsigned long s = *sum, c = *carry;
+
+	for (; n >= 4; n -= 4, p += 4) {
+		CSUM_ADD(s, c, p[0]);
+		CSUM_ADD(s, c, p[1]);
+		CSUM_ADD(s, c, p[2]);
+		CSUM_ADD(s, c, p[3]);
+	}
+	for (; n; n--)
+		CSUM_ADD(s, c, *p++);
+
+	*sum = s;
+	*carry = c;
+}
+
+/*
+ * Every load is an aligned long, masked down to the bytes of the buffer at
+ * either end.  An aligned load can't cross into another page, so reading
+ * the bytes around the buffer is safe even though KASAN wouldn't agree.
+ * The 16-bit lanes then line up with even addresses, so a buffer starting
+ * at an odd one ends up with its sum byte-swapped.
+ */
+__no_sanitize_address
+unsigned int do_csum(const unsigned char *buff, int len)
+{
+	unsigned long offset = (unsigned long)buff & (sizeof(long) - 1);
+	const unsigned long *p = (const unsigned long *)(buff - offset);
+	unsigned long sum, carry = 0, n;
+	unsigned int result;
+
+	if (unlikely(len <= 0))
+		return 0;
+
+	len += offset;
+	sum = *p++ & (~0UL << (offset * 8));
+	if (len <= sizeof(long)) {
+		sum &= ~0UL >> ((sizeof(long) - len) * 8);
+		goto out;
+	}
+	len -= sizeof(long);
+
+	n = len / sizeof(long);
+#ifdef CONFIG_64BIT
+	if (has_vector() && len >= CSUM_VECTOR_MIN && may_use_simd()) {
+		unsigned long vsum;
+
+		kernel_vector_begin();
+		vsum = __csum_vector((const u32 *)p, n * 2);
+		kernel_vector_end();
+
+		CSUM_ADD(sum, carry, vsum);
+	} else
+#endif
+	{
+		csum_longs(p, n, &sum, &carry);
+	}
+	p += n;
+	len -= n * sizeof(long);
+
+	if (len)
+		CSUM_ADD(sum, carry,
+			 *p & (~0UL >> ((sizeof(long) - len) * 8)));
+
+out:
+	result = csum_fold_long(sum, carry);
+	if (offset & 1)
+		result = ((result >> 8) & 0xff) | ((result & 0xff) << 8);
+	return result;
+}
+
+/*
+ * When both buffers share an alignment, the middle is copied and summed
+ * a long at a time.  Each part is summed as if it started its own buffer,
+ * and csum_block_add() then accounts for where it actually starts.
+ */
+__wsum csum_partial_copy_nocheck(const void *src, void *dst, int len,
+				 __wsum sum)
+{
+	unsigned long offset = (unsigned long)src & (sizeof(long) - 1);
+	unsigned long head, n, i, s = 0, c = 0, v;
+	const unsigned long *sp;
+	unsigned long *dp;
+
+	if (len < 4 * (int)sizeof(long) ||
+	    offset != ((unsigned long)dst & (sizeof(long) - 1))) {
+		memcpy(dst, src, len);
+		return csum_partial(dst, len, sum);
+	}
+
+	head = (sizeof(long) - offset) & (sizeof(long) - 1);
+	memcpy(dst, src, head);
+	sum = csum_partial(dst, head, sum);
+
+	sp = src + head;
+	dp = dst + head;
+	n = (len - head) / sizeof(long);
+	for (i = 0; i < n; i++) {
+		v = sp[i];
+		dp[i] = v;
+		CSUM_ADD(s, c, v);
+	}
+	sum = csum_block_add(sum, (__force __wsum)csum_fold_long(s, c), head);
+
+	head += n * sizeof(long);
+	memcpy(dst + head, src + head, len - head);
+	return csum_block_add(sum, csum_partial(dst + head, len - head, 0),
+			      head);
+}
+EXPORT_SYMBOL(csum_partial_copy_nocheck);
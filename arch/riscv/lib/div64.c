@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+/*
+ * 64-bit division on RV32, built on the 32-bit divu/remu instructions
+ * rather than a bit-at-a-time loop.  The core is the two-digit long
+ * division from Hacker's Delight (divlu): after normalizing the divisor,
+ * each 16-bit quotient digit is estimated with one divu and corrected at
+ * most twice.
+ *
+ * As with divu/remu, dividing by zero gives an all-ones quotient and
+ * leaves the dividend as the remainder.
+ */
+
+#include <linux/types.h>
+#include <linux/bitops.h>
+#include <asm/div64.h>
+#include <asm/asm-prototypes.h>
+
+/* (u1:u0) / v for u1 < v, so that the quotient fits in 32 bits */
+static u32 divlu(u32 u1, u32 u0, u32 v, u32 *r)
+{
+	const u32 b = 1 << 16;
+	u32 un1, un0, vn1, vn0, q1, q0, un32, un21, un10, rhat;
+	int s;
+
+	/* Normalize so that the top bit of the divisor is set */
+	s = __builtin_clz(v);
+	v <<= s;
+	vn1 = v >> 16;
+	vn0 = v & 0xffff;
+
+	un32 = (u1 << s) | (s ? u0 >> (32 - s) : 0);
+	un10 = u0 << s;
+	un1 = un10 >> 16;
+	un0 = un10 & 0xffff;
+
+	q1 = un32 / vn1;
+	rhat = un32 - q1 * vn1;
+	while (q1 >= b || q1 * vn0 > b * rhat + un1) {
+		q1--;
+		rhat += vn1;
+		if (rhat >= b)
+			break;
+	}
+
+	un21 = un32 * b + un1 - q1 * v;
+
+	q0 = un21 / vn1;
+	rhat = un21 - q0 * vn1;
+	while (q0 >= b || q0 * vn0 > b * rhat + un0) {
+		q0--;
+		rhat += vn1;
+		if (rhat >= b)
+			break;
+	}
+
+	*r = (un21 * b + un0 - q0 * v) >> s;
+	return q1 * b + q0;
+}
+
+uint32_t __div64_32(uint64_t *n, uint32_t base)
+{
+	u32 high = *n >> 32;
+	u32 low = *n;
+	u32 qhigh, qlow, rem;
+
+	if (unlikely(!base)) {
+		rem = low;
+		*n = ~0ULL;
+		return rem;
+	}
+
+	qhigh = high / base;
+	high %= base;
+	qlow = high ? divlu(high, low, base, &rem) : low / base;
+	if (!high)
+		rem = low % base;
+
+	*n = ((u64)qhigh << 32) | qlow;
+	return rem;
+}
+
+static u64 __udivmoddi4(u64 n, u64 d, u64 *rem)
+{
+	u32 dhigh = d >> 32;
+	u32 r32;
+	u64 q;
+	int s;
+
+	if (!dhigh) {
+		q = n;
+		r32 = __div64_32(&q, d);
+		if (rem)
+			*rem = r32;
+		return q;
+	}
+
+	/*
+	 * The divisor needs more than 32 bits, so the quotient fits in 32.
+	 * Estimate it from the top 32 bits of the normalized divisor and
+	 * half the dividend; the estimate is at most one too large.
+	 */
+	s = __builtin_clz(dhigh);
+	q = divlu((n >> 1) >> 32, n >> 1, (d << s) >> 32, &r32);
+	q = (q << s) >> 31;
+	if (q)
+		q--;
+	if (n - q * d >= d)
+		q++;
+
+	if (rem)
+		*rem = n - q * d;
+	return q;
+}
+
+u64 __udivdi3(u64 a, u64 b)
+{
+	return __udivmoddi4(a, b, NULL);
+}
+
+u64 __umoddi3(u64 a, u64 b)
+{
+	u64 rem;
+
+	__udivmoddi4(a, b, &rem);
+	return rem;
+}
+
+s64 __divdi3(s64 a, s64 b)
+{
+	u64 ua = a < 0 ? -(u64)a : a;
+	u64 ub = b < 0 ? -(u64)b : b;
+	u64 q = __udivmoddi4(ua, ub, NULL);
+
+	return (a ^ b) < 0 ? -q : q;
+}
+
+s64 __moddi3(s64 a, s64 b)
+{
+	u64 ua = a < 0 ? -(u64)a : a;
+	u64 ub = b < 0 ? -(u64)b : b;
+	u64 rem;
+
+	__udivmoddi4(ua, ub, &rem);
+	return a < 0 ? -rem : rem;
+}
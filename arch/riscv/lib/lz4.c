@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/export.h>
+#include <linux/kernel.h>
+
+#include <asm/simd.h>
+#include <asm/vector.h>
+
+/*
+ * The match is copied in chunks no longer than its distance.  Below this
+ * distance the chunks are too short for the vector loop to pay for
+ * saving and restoring the user's vector registers.
+ */
+#define LZ4_VECTOR_MIN_OFFSET	64
+
+asmlinkage void __lz4_match_copy_vector(u8 *dst, const u8 *src, size_t len);
+
+/*
+ * Copy an LZ4 match of len bytes from src to dst, which may overlap as
+ * long as src is below dst.  Returns false, without copying anything, if
+ * the vector unit can't be used for it.
+ */
+bool lz4_match_copy_vector(u8 *dst, const u8 *src, size_t len)
+{
+	if (!has_vector() || dst - src < LZ4_VECTOR_MIN_OFFSET ||
+	    !may_use_simd())
+		return false;
+
+	kernel_vector_begin();
+	__lz4_match_copy_vector(dst, src, len);
+	kernel_vector_end();
+	return true;
+}
+EXPORT_SYMBOL_GPL(lz4_match_copy_vector);
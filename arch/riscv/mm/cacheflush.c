@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+
+#include <asm/cacheflush.h>
+#include <asm/mmu_context.h>
+#include <asm/sbi.h>
+
+#ifdef CONFIG_SMP
+
+DEFINE_PER_CPU(struct mm_struct *, riscv_loaded_mm);
+
+/*
+ * All kernel text modifications (modules, kprobes, ...) end up here, and
+ * each of them costs exactly one fence.i broadcast.
+ */
+void flush_icache_all(void)
+{
+	sbi_remote_fence_i(NULL);
+}
+EXPORT_SYMBOL(flush_icache_all);
+
+/*
+ * Performs an icache flush for the given MM context.  RISC-V has no direct
+ * mechanism for instruction cache shoot downs, so instead we send an IPI
+ * only to the harts currently running mm and mark every other hart as
+ * stale, so it flushes lazily the next time it switches to mm.  If "local"
+ * is set, only the calling thread needs coherent instruction fetches right
+ * now, so no remote hart is fenced at all.
+ */
+void flush_icache_mm(struct mm_struct *mm, bool local)
+{
+	unsigned int cpu, i;
+	cpumask_t others, *mask;
+
+	preempt_disable();
+
+	/* Mark every hart's icache as needing a flush for this MM. */
+	mask = &mm->context.icache_stale_mask;
+	cpumask_setall(mask);
+
+	/* Flush this hart's I$ now, and mark it as flushed. */
+	cpu = smp_processor_id();
+	cpumask_clear_cpu(cpu, mask);
+	local_flush_icache_all();
+
+	if (local)
+		goto out;
+
+	/* Pairs with the smp_mb() in flush_icache_deferred(). */
+	smp_mb();
+
+	/*
+	 * Flush the I$ of the other harts concurrently executing mm, and
+	 * mark them as flushed.
+	 */
+	cpumask_clear(&others);
+	for_each_cpu(i, mm_cpumask(mm)) {
+		if (i != cpu && READ_ONCE(per_cpu(riscv_loaded_mm, i)) == mm)
+			cpumask_set_cpu(i, &others);
+	}
+
+	if (!cpumask_empty(&others)) {
+		cpumask_andnot(mask, mask, &others);
+		sbi_remote_fence_i(cpumask_bits(&others));
+	}
+
+out:
+	preempt_enable();
+}
+
+#endif /* CONFIG_SMP */
+
+void flush_dcache_page(struct page *page)
+{
+	if (test_bit(PG_dcache_clean, &page->flags))
+		clear_bit(PG_dcache_clean, &page->flags);
+}
+EXPORT_SYMBOL(flush_dcache_page);
+
+void flush_icache_pte(pte_t pte)
+{
+	struct page *page = pte_page(pte);
+
+	if (!test_and_set_bit(PG_dcache_clean, &page->flags))
+		flush_icache_all();
+}
@@ -0,0 +1,263 @@
+/*
+ * SWIOTLB-based DMA API implementation
+ *
+ * Based on arch/arm64/mm/dma-mapping.c
+ *
+ * Copyright (C) 2012 ARM Ltd.
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/gfp.h>
+#include <linux/export.h>
+#include <linux/mm.h>
+#include <linux/dma-mapping.h>
+#include <linux/dma-contiguous.h>
+#include <linux/swiotlb.h>
+
+static const struct riscv_dma_cache_ops *dma_cache_ops __ro_after_init;
+
+void __init riscv_set_dma_cache_ops(const struct riscv_dma_cache_ops *ops)
+{
+	dma_cache_ops = ops;
+}
+
+static void __dma_map_area(struct device *dev, dma_addr_t dev_addr,
+			   size_t size, enum dma_data_direction dir)
+{
+	phys_addr_t paddr = dma_to_phys(dev, dev_addr);
+
+	if (is_device_dma_coherent(dev))
+		return;
+
+	if (dir == DMA_FROM_DEVICE)
+		dma_cache_ops->inv(paddr, size);
+	else
+		dma_cache_ops->wback(paddr, size);
+}
+
+static void __dma_unmap_area(struct device *dev, dma_addr_t dev_addr,
+			     size_t size, enum dma_data_direction dir)
+{
+	phys_addr_t paddr = dma_to_phys(dev, dev_addr);
+
+	if (is_device_dma_coherent(dev))
+		return;
+
+	/* Drop anything speculatively fetched while the device owned it */
+	if (dir != DMA_TO_DEVICE)
+		dma_cache_ops->inv(paddr, size);
+}
+
+/*
+ * There is no uncacheable page attribute to give a non-coherent master a
+ * separate mapping of its buffer, so the linear map is handed out as is
+ * after writing back and invalidating it.  Nothing dirty is left behind
+ * to be evicted over what the device writes.
+ */
+static void *__dma_alloc(struct device *dev, size_t size,
+			 dma_addr_t *dma_handle, gfp_t flags,
+			 unsigned long attrs)
+{
+	struct page *page;
+	void *addr;
+
+	size = PAGE_ALIGN(size);
+
+	if (dev_get_cma_area(dev) && gfpflags_allow_blocking(flags)) {
+		page = dma_alloc_from_contiguous(dev, size >> PAGE_SHIFT,
+						 get_order(size), flags);
+		if (!page)
+			return NULL;
+
+		*dma_handle = phys_to_dma(dev, page_to_phys(page));
+		addr = page_address(page);
+		memset(addr, 0, size);
+	} else {
+		addr = swiotlb_alloc_coherent(dev, size, dma_handle, flags);
+		if (!addr)
+			return NULL;
+	}
+
+	if (!is_device_dma_coherent(dev))
+		dma_cache_ops->wback_inv(dma_to_phys(dev, *dma_handle), size);
+
+	return addr;
+}
+
+static void __dma_free(struct device *dev, size_t size,
+		       void *vaddr, dma_addr_t dma_handle,
+		       unsigned long attrs)
+{
+	phys_addr_t paddr = dma_to_phys(dev, dma_handle);
+
+	size = PAGE_ALIGN(size);
+
+	if (!dma_release_from_contiguous(dev, phys_to_page(paddr),
+					 size >> PAGE_SHIFT))
+		swiotlb_free_coherent(dev, size, vaddr, dma_handle);
+}
+
+static dma_addr_t __swiotlb_map_page(struct device *dev, struct page *page,
+				     unsigned long offset, size_t size,
+				     enum dma_data_direction dir,
+				     unsigned long attrs)
+{
+	dma_addr_t dev_addr;
+
+	dev_addr = swiotlb_map_page(dev, page, offset, size, dir, attrs);
+	if ((attrs & DMA_ATTR_SKIP_CPU_SYNC) == 0)
+		__dma_map_area(dev, dev_addr, size, dir);
+
+	return dev_addr;
+}
+
+static void __swiotlb_unmap_page(struct device *dev, dma_addr_t dev_addr,
+				 size_t size, enum dma_data_direction dir,
+				 unsigned long attrs)
+{
+	if ((attrs & DMA_ATTR_SKIP_CPU_SYNC) == 0)
+		__dma_unmap_area(dev, dev_addr, size, dir);
+	swiotlb_unmap_page(dev, dev_addr, size, dir, attrs);
+}
+
+static int __swiotlb_map_sg_attrs(struct device *dev, struct scatterlist *sgl,
+				  int nelems, enum dma_data_direction dir,
+				  unsigned long attrs)
+{
+	struct scatterlist *sg;
+	int i, ret;
+
+	ret = swiotlb_map_sg_attrs(dev, sgl, nelems, dir, attrs);
+	if ((attrs & DMA_ATTR_SKIP_CPU_SYNC) == 0)
+		for_each_sg(sgl, sg, ret, i)
+			__dma_map_area(dev, sg->dma_address, sg->length, dir);
+
+	return ret;
+}
+
+static void __swiotlb_unmap_sg_attrs(struct device *dev,
+				     struct scatterlist *sgl, int nelems,
+				     enum dma_data_direction dir,
+				     unsigned long attrs)
+{
+	struct scatterlist *sg;
+	int i;
+
+	if ((attrs & DMA_ATTR_SKIP_CPU_SYNC) == 0)
+		for_each_sg(sgl, sg, nelems, i)
+			__dma_unmap_area(dev, sg->dma_address, sg->length, dir);
+	swiotlb_unmap_sg_attrs(dev, sgl, nelems, dir, attrs);
+}
+
+static void __swiotlb_sync_single_for_cpu(struct device *dev,
+					  dma_addr_t dev_addr, size_t size,
+					  enum dma_data_direction dir)
+{
+	__dma_unmap_area(dev, dev_addr, size, dir);
+	swiotlb_sync_single_for_cpu(dev, dev_addr, size, dir);
+}
+
+static void __swiotlb_sync_single_for_device(struct device *dev,
+					     dma_addr_t dev_addr, size_t size,
+					     enum dma_data_direction dir)
+{
+	swiotlb_sync_single_for_device(dev, dev_addr, size, dir);
+	__dma_map_area(dev, dev_addr, size, dir);
+}
+
+static void __swiotlb_sync_sg_for_cpu(struct device *dev,
+				      struct scatterlist *sgl, int nelems,
+				      enum dma_data_direction dir)
+{
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(sgl, sg, nelems, i)
+		__dma_unmap_area(dev, sg->dma_address, sg->length, dir);
+	swiotlb_sync_sg_for_cpu(dev, sgl, nelems, dir);
+}
+
+static void __swiotlb_sync_sg_for_device(struct device *dev,
+					 struct scatterlist *sgl, int nelems,
+					 enum dma_data_direction dir)
+{
+	struct scatterlist *sg;
+	int i;
+
+	swiotlb_sync_sg_for_device(dev, sgl, nelems, dir);
+	for_each_sg(sgl, sg, nelems, i)
+		__dma_map_area(dev, sg->dma_address, sg->length, dir);
+}
+
+static int __swiotlb_mmap(struct device *dev,
+			  struct vm_area_struct *vma,
+			  void *cpu_addr, dma_addr_t dma_addr, size_t size,
+			  unsigned long attrs)
+{
+	unsigned long pfn = dma_to_phys(dev, dma_addr) >> PAGE_SHIFT;
+	unsigned long nr_vma_pages = vma_pages(vma);
+	unsigned long nr_pages = PAGE_ALIGN(size) >> PAGE_SHIFT;
+	unsigned long off = vma->vm_pgoff;
+	int ret;
+
+	if (dma_mmap_from_dev_coherent(dev, vma, cpu_addr, size, &ret))
+		return ret;
+
+	if (off >= nr_pages || nr_vma_pages > nr_pages - off)
+		return -ENXIO;
+
+	return remap_pfn_range(vma, vma->vm_start, pfn + off,
+			       vma->vm_end - vma->vm_start,
+			       vma->vm_page_prot);
+}
+
+static int __swiotlb_get_sgtable(struct device *dev, struct sg_table *sgt,
+				 void *cpu_addr, dma_addr_t handle, size_t size,
+				 unsigned long attrs)
+{
+	struct page *page = phys_to_page(dma_to_phys(dev, handle));
+	int ret = sg_alloc_table(sgt, 1, GFP_KERNEL);
+
+	if (!ret)
+		sg_set_page(sgt->sgl, page, PAGE_ALIGN(size), 0);
+
+	return ret;
+}
+
+const struct dma_map_ops riscv_swiotlb_dma_ops = {
+	.alloc = __dma_alloc,
+	.free = __dma_free,
+	.mmap = __swiotlb_mmap,
+	.get_sgtable = __swiotlb_get_sgtable,
+	.map_page = __swiotlb_map_page,
+	.unmap_page = __swiotlb_unmap_page,
+	.map_sg = __swiotlb_map_sg_attrs,
+	.unmap_sg = __swiotlb_unmap_sg_attrs,
+	.sync_single_for_cpu = __swiotlb_sync_single_for_cpu,
+	.sync_single_for_device = __swiotlb_sync_single_for_device,
+	.sync_sg_for_cpu = __swiotlb_sync_sg_for_cpu,
+	.sync_sg_for_device = __swiotlb_sync_sg_for_device,
+	.dma_supported = swiotlb_dma_supported,
+	.mapping_error = swiotlb_dma_mapping_error,
+};
+EXPORT_SYMBOL(riscv_swiotlb_dma_ops);
+
+/*
+ * Device trees for RISC-V systems rarely say "dma-coherent" because nearly
+ * all of them are, so a master is only treated as non-coherent once the
+ * platform has registered a way to maintain the caches for it.
+ */
+void arch_setup_dma_ops(struct device *dev, u64 dma_base, u64 size,
+			const struct iommu_ops *iommu, bool coherent)
+{
+	dev->archdata.dma_noncoherent = !coherent && dma_cache_ops;
+}
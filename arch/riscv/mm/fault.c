@@ -23,6 +23,8 @@
 #include <linux/mm.h>
 #include <linux/kernel.h>
 #include <linux/interrupt.h>
+#include <linux/extable.h>
+#include <linux/kprobes.h>
 #include <linux/perf_event.h>
 #include <linux/signal.h>
 #include <linux/uaccess.h>
@@ -31,6 +33,35 @@
 #include <asm/ptrace.h>
 #include <asm/uaccess.h>
 
+static inline int notify_page_fault(struct pt_regs *regs, unsigned long cause)
+{
+	int ret = 0;
+
+	/* kprobe_running() needs smp_processor_id() */
+	if (kprobes_built_in() && !user_mode(regs)) {
+		preempt_disable();
+		if (kprobe_running() && kprobe_fault_handler(regs, cause))
+			ret = 1;
+		preempt_enable();
+	}
+
+	return ret;
+}
+
+static inline bool access_error(unsigned long cause, struct vm_area_struct *vma)
+{
+	switch (cause) {
+	case EXC_INST_PAGE_FAULT:
+		return !(vma->vm_flags & VM_EXEC);
+	case EXC_LOAD_PAGE_FAULT:
+		return !(vma->vm_flags & VM_READ);
+	case EXC_STORE_PAGE_FAULT:
+		return !(vma->vm_flags & VM_WRITE);
+	default:
+		panic("%s: unhandled cause %lu", __func__, cause);
+	}
+}
+
 /*
  * This routine handles page faults.  It determines the address and the
  * problem, and then passes it off to one of the appropriate routines.
@@ -61,6 +92,13 @@ asmlinkage void do_page_fault(struct pt_regs *regs)
 	 */
 	if (unlikely((addr >= VMALLOC_START) && (addr <= VMALLOC_END)))
 		goto vmalloc_fault;
+#ifdef MODULES_VADDR
+	if (unlikely((addr >= MODULES_VADDR) && (addr < MODULES_END)))
+		goto vmalloc_fault;
+#endif
+
+	if (notify_page_fault(regs, cause))
+		return;
 
 	/* Enable interrupts if they were enabled in the parent context. */
 	if (likely(regs->sstatus & SR_PIE))
@@ -75,11 +113,31 @@ asmlinkage void do_page_fault(struct pt_regs *regs)
 
 	if (user_mode(regs))
 		flags |= FAULT_FLAG_USER;
+	if (cause == EXC_STORE_PAGE_FAULT)
+		flags |= FAULT_FLAG_WRITE;
 
 	perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS, 1, regs, addr);
 
+	/*
+	 * Only sleep for mmap_sem if the fault could have come from a
+	 * context that can't be holding it already: a kernel fault from
+	 * outside the uaccess routines may be inside a region that has it
+	 * for writing, and waiting would deadlock rather than oops.
+	 */
+	if (unlikely(!down_read_trylock(&mm->mmap_sem))) {
+		if (!user_mode(regs) && !search_exception_tables(regs->sepc))
+			goto no_context;
 retry:
-	down_read(&mm->mmap_sem);
+		down_read(&mm->mmap_sem);
+	} else {
+		/*
+		 * The above down_read_trylock() might have succeeded in
+		 * which case we'll have missed the might_sleep() from
+		 * down_read().
+		 */
+		might_sleep();
+	}
+
 	vma = find_vma(mm, addr);
 	if (unlikely(!vma))
 		goto bad_area;
@@ -97,23 +155,8 @@ retry:
 good_area:
 	code = SEGV_ACCERR;
 
-	switch (cause) {
-	case EXC_INST_PAGE_FAULT:
-		if (!(vma->vm_flags & VM_EXEC))
-			goto bad_area;
-		break;
-	case EXC_LOAD_PAGE_FAULT:
-		if (!(vma->vm_flags & VM_READ))
-			goto bad_area;
-		break;
-	case EXC_STORE_PAGE_FAULT:
-		if (!(vma->vm_flags & VM_WRITE))
-			goto bad_area;
-		flags |= FAULT_FLAG_WRITE;
-		break;
-	default:
-		panic("%s: unhandled cause %lu", __func__, cause);
-	}
+	if (unlikely(access_error(cause, vma)))
+		goto bad_area;
 
 	/*
 	 * If for any reason at all we could not handle the fault,
@@ -241,7 +284,7 @@ vmalloc_fault:
 		 * of a task switch.
 		 */
 		index = pgd_index(addr);
-		pgd = (pgd_t *)pfn_to_virt(csr_read(sptbr)) + index;
+		pgd = (pgd_t *)pfn_to_virt(csr_read(sptbr) & SPTBR_PPN) + index;
 		pgd_k = init_mm.pgd + index;
 
 		if (!pgd_present(*pgd_k))
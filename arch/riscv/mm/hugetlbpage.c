@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/hugetlb.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+
+/*
+ * Page table walking is left to the generic code (ARCH_WANT_GENERAL_HUGETLB):
+ * a megapage is a leaf PMD and a gigapage a leaf PUD (i.e. PGD, since the
+ * PUD level is folded), exactly as the hardware walker sees them.
+ */
+
+int pmd_huge(pmd_t pmd)
+{
+	return pmd_leaf(pmd);
+}
+
+int pud_huge(pud_t pud)
+{
+#ifdef CONFIG_64BIT
+	return pud_leaf(pud);
+#else
+	return 0;
+#endif
+}
+
+static __init int setup_hugepagesz(char *opt)
+{
+	unsigned long ps = memparse(opt, &opt);
+
+	if (ps == HPAGE_SIZE) {
+		hugetlb_add_hstate(HPAGE_SHIFT - PAGE_SHIFT);
+#ifdef CONFIG_64BIT
+	} else if (ps == PUD_SIZE) {
+		hugetlb_add_hstate(PUD_SHIFT - PAGE_SHIFT);
+#endif
+	} else {
+		hugetlb_bad_size();
+		pr_err("hugepagesz: Unsupported page size %lu M\n", ps >> 20);
+		return 0;
+	}
+
+	return 1;
+}
+__setup("hugepagesz=", setup_hugepagesz);
+
+#ifdef CONFIG_64BIT
+#if (defined(CONFIG_MEMORY_ISOLATION) && defined(CONFIG_COMPACTION)) || \
+	defined(CONFIG_CMA)
+static __init int gigantic_pages_init(void)
+{
+	/* With compaction or CMA we can allocate gigantic pages at runtime */
+	if (!size_to_hstate(PUD_SIZE))
+		hugetlb_add_hstate(PUD_SHIFT - PAGE_SHIFT);
+	return 0;
+}
+arch_initcall(gigantic_pages_init);
+#endif
+#endif /* CONFIG_64BIT */
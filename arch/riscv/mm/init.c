@@ -17,12 +17,25 @@
 #include <linux/initrd.h>
 #include <linux/memblock.h>
 #include <linux/swap.h>
+#include <linux/swiotlb.h>
+#include <linux/dma-mapping.h>
 
 #include <asm/tlbflush.h>
 #include <asm/sections.h>
 #include <asm/pgtable.h>
 #include <asm/io.h>
+#include <asm/hwcap.h>
+#include <asm/numa.h>
 
+#ifdef CONFIG_NUMA
+static void __init zone_sizes_init(void)
+{
+	unsigned long max_zone_pfns[MAX_NR_ZONES] = { 0, };
+
+	max_zone_pfns[ZONE_NORMAL] = max_low_pfn;
+	free_area_init_nodes(max_zone_pfns);
+}
+#else
 static void __init zone_sizes_init(void)
 {
 	unsigned long zones_size[MAX_NR_ZONES];
@@ -31,6 +44,25 @@ static void __init zone_sizes_init(void)
 	zones_size[ZONE_NORMAL] = max_mapnr;
 	free_area_init_node(0, zones_size, pfn_base, NULL);
 }
+#endif /* CONFIG_NUMA */
+
+#ifdef CONFIG_SPARSEMEM
+static void __init riscv_memory_present(void)
+{
+	struct memblock_region *reg;
+
+	for_each_memblock(memory, reg) {
+		int nid = memblock_get_region_node(reg);
+
+		memory_present(nid, memblock_region_memory_base_pfn(reg),
+			       memblock_region_memory_end_pfn(reg));
+	}
+}
+#else
+static void __init riscv_memory_present(void)
+{
+}
+#endif /* CONFIG_SPARSEMEM */
 
 void setup_zero_page(void)
 {
@@ -39,20 +71,61 @@ void setup_zero_page(void)
 
 void __init paging_init(void)
 {
-	init_mm.pgd = (pgd_t *)pfn_to_virt(csr_read(sptbr));
+	init_mm.pgd = (pgd_t *)pfn_to_virt(csr_read(sptbr) & SPTBR_PPN);
 
 	setup_zero_page();
 	local_flush_tlb_all();
+
+	riscv_numa_init();
+	riscv_memory_present();
+	sparse_init();
 	zone_sizes_init();
 }
 
+/*
+ * Without Svadu, the first store through a clean writable PTE traps only
+ * to set D.  Shared writable mappings are only given writable PTEs ahead
+ * of a write fault when nothing accounts their dirty pages, which is when
+ * vma_wants_writenotify() says no, so D carries no information there and
+ * they can start out dirty.  Private and write-notified mappings get
+ * their writable PTEs from a write fault, which sets D along with W, and
+ * every user protection already includes A through _PAGE_BASE.
+ */
+void __init riscv_setup_ad_mode(void)
+{
+	int i;
+
+	if (riscv_isa_extension_available(RISCV_ISA_EXT_SVADU)) {
+		pr_info("A/D bits are updated by hardware\n");
+		return;
+	}
+
+	for (i = VM_SHARED; i < ARRAY_SIZE(protection_map); i++)
+		if (pgprot_val(protection_map[i]) & _PAGE_WRITE)
+			protection_map[i] = __pgprot(
+				pgprot_val(protection_map[i]) | _PAGE_DIRTY);
+
+	pr_info("A/D bits are updated by software\n");
+}
+
 void __init mem_init(void)
 {
 #ifdef CONFIG_FLATMEM
 	BUG_ON(!mem_map);
 #endif /* CONFIG_FLATMEM */
+#ifdef CONFIG_SPARSEMEM_VMEMMAP
+	BUILD_BUG_ON(sizeof(struct page) > (1 << STRUCT_PAGE_MAX_SHIFT));
+#endif
 
 	high_memory = (void *)(__va(PFN_PHYS(max_low_pfn)));
+
+	/* Bounce buffers are only needed if 32-bit masters can't reach it all */
+	if (swiotlb_force == SWIOTLB_FORCE ||
+	    max_low_pfn > PFN_DOWN(DMA_BIT_MASK(32)) + 1)
+		swiotlb_init(1);
+	else
+		swiotlb_force = SWIOTLB_NO_FORCE;
+
 	free_all_bootmem();
 
 	mem_init_print_info(NULL);
@@ -63,6 +136,62 @@ void free_initmem(void)
 	free_initmem_default(0);
 }
 
+#ifdef CONFIG_SPARSEMEM_VMEMMAP
+/*
+ * Back the struct page array with megapages, falling back to base pages
+ * for a range where no PMD_SIZE block can be had on @node.
+ */
+int __meminit vmemmap_populate(unsigned long start, unsigned long end,
+			       int node)
+{
+	unsigned long addr = start;
+	unsigned long next;
+	pgd_t *pgd;
+	p4d_t *p4d;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	do {
+		next = pmd_addr_end(addr, end);
+
+		pgd = vmemmap_pgd_populate(addr, node);
+		if (!pgd)
+			return -ENOMEM;
+		p4d = vmemmap_p4d_populate(pgd, addr, node);
+		if (!p4d)
+			return -ENOMEM;
+		pud = vmemmap_pud_populate(p4d, addr, node);
+		if (!pud)
+			return -ENOMEM;
+
+		pmd = pmd_offset(pud, addr);
+		if (pmd_none(*pmd)) {
+			void *p = vmemmap_alloc_block_buf(PMD_SIZE, node);
+
+			if (p) {
+				set_pmd(pmd, pfn_pmd(PFN_DOWN(__pa(p)),
+						     PAGE_KERNEL));
+				continue;
+			}
+		} else if (pmd_leaf(*pmd)) {
+			vmemmap_verify((pte_t *)pmd, node, addr, next);
+			continue;
+		}
+
+		if (vmemmap_populate_basepages(addr, next, node))
+			return -ENOMEM;
+	} while (addr = next, addr != end);
+
+	return 0;
+}
+
+#ifdef CONFIG_MEMORY_HOTPLUG
+void vmemmap_free(unsigned long start, unsigned long end)
+{
+}
+#endif /* CONFIG_MEMORY_HOTPLUG */
+#endif /* CONFIG_SPARSEMEM_VMEMMAP */
+
 #ifdef CONFIG_BLK_DEV_INITRD
 void free_initrd_mem(unsigned long start, unsigned long end)
 {
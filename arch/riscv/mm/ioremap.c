@@ -90,3 +90,65 @@ void iounmap(void __iomem *addr)
 	vunmap((void *)((unsigned long)addr & PAGE_MASK));
 }
 EXPORT_SYMBOL(iounmap);
+
+#ifdef CONFIG_HAVE_ARCH_HUGE_VMAP
+/*
+ * Let ioremap_page_range() use megapage/gigapage leaves for suitably
+ * aligned ranges instead of building full PTE tables.  Only available on
+ * RV64, where both the PMD and PUD levels are real.
+ */
+int arch_ioremap_pud_supported(void)
+{
+	return 1;
+}
+
+int arch_ioremap_pmd_supported(void)
+{
+	return 1;
+}
+
+/*
+ * Refuse to replace a page table with a leaf: the table would be leaked
+ * and could still be cached by the page table walker.  ioremap_page_range()
+ * then falls back to mapping the range with smaller pages.
+ */
+int pud_set_huge(pud_t *pud, phys_addr_t addr, pgprot_t prot)
+{
+	pud_t old = READ_ONCE(*pud);
+
+	if (pud_present(old) && !pud_leaf(old))
+		return 0;
+
+	set_pud(pud, __pud((PFN_DOWN(addr) << _PAGE_PFN_SHIFT) |
+			   pgprot_val(prot)));
+	return 1;
+}
+
+int pmd_set_huge(pmd_t *pmd, phys_addr_t addr, pgprot_t prot)
+{
+	pmd_t old = READ_ONCE(*pmd);
+
+	if (pmd_present(old) && !pmd_leaf(old))
+		return 0;
+
+	set_pmd(pmd, __pmd((PFN_DOWN(addr) << _PAGE_PFN_SHIFT) |
+			   pgprot_val(prot)));
+	return 1;
+}
+
+int pud_clear_huge(pud_t *pud)
+{
+	if (!pud_leaf(*pud))
+		return 0;
+	pud_clear(pud);
+	return 1;
+}
+
+int pmd_clear_huge(pmd_t *pmd)
+{
+	if (!pmd_leaf(*pmd))
+		return 0;
+	pmd_clear(pmd);
+	return 1;
+}
+#endif /* CONFIG_HAVE_ARCH_HUGE_VMAP */
@@ -0,0 +1,212 @@
+/*
+ * KASAN shadow setup
+ *
+ * Based on arch/arm64/mm/kasan_init.c
+ *
+ * Copyright (c) 2015 Samsung Electronics Co., Ltd.
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#define pr_fmt(fmt) "kasan: " fmt
+
+#include <linux/init.h>
+#include <linux/kasan.h>
+#include <linux/kernel.h>
+#include <linux/memblock.h>
+#include <linux/mm.h>
+#include <linux/sched/task.h>
+
+#include <asm/mmu_context.h>
+#include <asm/page.h>
+#include <asm/pgalloc.h>
+#include <asm/pgtable.h>
+#include <asm/tlbflush.h>
+
+static pgd_t tmp_pg_dir[PTRS_PER_PGD] __initdata __aligned(PAGE_SIZE);
+
+/*
+ * Called from setup_vm(), before the MMU is on: kernel symbols are still
+ * at their physical addresses, which is what the page tables want anyway.
+ * Every shadow byte is backed by kasan_zero_page until kasan_init() runs.
+ */
+asmlinkage void __init kasan_early_init(void)
+{
+	pgd_t *pgd = swapper_pg_dir + pgd_index(KASAN_SHADOW_START);
+	uintptr_t addr, i;
+
+	BUILD_BUG_ON(KASAN_SHADOW_OFFSET != KASAN_SHADOW_END - (1UL << 61));
+	BUILD_BUG_ON(!IS_ALIGNED(KASAN_SHADOW_START, PGDIR_SIZE));
+	BUILD_BUG_ON(!IS_ALIGNED(KASAN_SHADOW_END, PGDIR_SIZE));
+	BUILD_BUG_ON(KASAN_SHADOW_END > VMALLOC_START);
+
+	for (i = 0; i < PTRS_PER_PTE; i++)
+		set_pte(kasan_zero_pte + i,
+			pfn_pte(PFN_DOWN((uintptr_t)kasan_zero_page),
+				PAGE_KERNEL));
+
+	for (i = 0; i < PTRS_PER_PMD; i++)
+		set_pmd(kasan_zero_pmd + i,
+			pfn_pmd(PFN_DOWN((uintptr_t)kasan_zero_pte),
+				__pgprot(_PAGE_TABLE)));
+
+	for (addr = KASAN_SHADOW_START; addr < KASAN_SHADOW_END;
+	     addr += PGDIR_SIZE, pgd++)
+		set_pgd(pgd, pfn_pgd(PFN_DOWN((uintptr_t)kasan_zero_pmd),
+				     __pgprot(_PAGE_TABLE)));
+}
+
+static pud_t *__init kasan_pud_offset(unsigned long addr)
+{
+	pgd_t *pgd = pgd_offset_k(addr);
+
+	return pud_offset(p4d_offset(pgd, addr), addr);
+}
+
+static void __init kasan_populate_pte(pmd_t *pmd, unsigned long addr,
+				      unsigned long end)
+{
+	pte_t *pte;
+
+	if (pmd_none(*pmd))
+		pmd_populate_kernel(&init_mm, pmd,
+				    memblock_virt_alloc(PAGE_SIZE, PAGE_SIZE));
+
+	pte = pte_offset_kernel(pmd, addr);
+	do {
+		if (pte_none(*pte)) {
+			void *p = memblock_virt_alloc(PAGE_SIZE, PAGE_SIZE);
+
+			set_pte(pte, pfn_pte(virt_to_pfn(p), PAGE_KERNEL));
+		}
+	} while (pte++, addr += PAGE_SIZE, addr != end);
+}
+
+/*
+ * Back [addr, end) of the shadow with zeroed memory, using megapages where
+ * a whole one fits since the shadow of the linear map is touched by every
+ * instrumented access.
+ */
+static void __init kasan_populate_shadow(unsigned long addr,
+					 unsigned long end)
+{
+	unsigned long next;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	addr = round_down(addr, PAGE_SIZE);
+	end = round_up(end, PAGE_SIZE);
+
+	do {
+		pud = kasan_pud_offset(addr);
+		if (pud_none(*pud))
+			pud_populate(&init_mm, pud,
+				     memblock_virt_alloc(PAGE_SIZE, PAGE_SIZE));
+
+		pmd = pmd_offset(pud, addr);
+		next = pmd_addr_end(addr, end);
+
+		if (pmd_leaf(*pmd))
+			continue;
+
+		if (pmd_none(*pmd) && IS_ALIGNED(addr, PMD_SIZE) &&
+		    next - addr == PMD_SIZE) {
+			void *p = memblock_virt_alloc_nopanic(PMD_SIZE,
+							      PMD_SIZE);
+
+			if (p) {
+				set_pmd(pmd, pfn_pmd(virt_to_pfn(p),
+						     PAGE_KERNEL));
+				continue;
+			}
+		}
+
+		kasan_populate_pte(pmd, addr, next);
+	} while (addr = next, addr != end);
+}
+
+void __init kasan_init(void)
+{
+	unsigned long mod_shadow_start, mod_shadow_end, lm_shadow_end;
+	phys_addr_t lm_start = PFN_PHYS(pfn_base);
+	phys_addr_t lm_end = PFN_PHYS(max_low_pfn);
+	struct memblock_region *reg;
+	unsigned long addr;
+	int i;
+
+	mod_shadow_start =
+		(unsigned long)kasan_mem_to_shadow((void *)MODULES_VADDR);
+	mod_shadow_end =
+		(unsigned long)kasan_mem_to_shadow((void *)MODULES_END);
+	lm_shadow_end = (unsigned long)kasan_mem_to_shadow(__va(lm_end));
+
+	/*
+	 * Instrumented code can't run with the shadow unmapped, so keep the
+	 * early shadow in a copy of the page tables while swapper_pg_dir is
+	 * rebuilt underneath.
+	 */
+	memcpy(tmp_pg_dir, swapper_pg_dir, sizeof(tmp_pg_dir));
+	set_pgdir(tmp_pg_dir, 0);
+	local_flush_tlb_all();
+
+	/* pgd_clear() is a no-op with the PUD folded */
+	for (addr = KASAN_SHADOW_START; addr < KASAN_SHADOW_END;
+	     addr += PGDIR_SIZE)
+		set_pgd(pgd_offset_k(addr), __pgd(0));
+
+	kasan_populate_zero_shadow((void *)KASAN_SHADOW_START,
+				   (void *)mod_shadow_start);
+
+	/*
+	 * kasan_module_alloc() maps module shadow with vmalloc, which never
+	 * creates top-level entries that other mms would have to fault in.
+	 */
+	for (addr = mod_shadow_start; addr < mod_shadow_end;
+	     addr = pgd_addr_end(addr, mod_shadow_end)) {
+		pud_t *pud = kasan_pud_offset(addr);
+
+		if (pud_none(*pud))
+			pud_populate(&init_mm, pud,
+				     memblock_virt_alloc(PAGE_SIZE, PAGE_SIZE));
+	}
+
+	for_each_memblock(memory, reg) {
+		phys_addr_t start = max(reg->base, lm_start);
+		phys_addr_t end = min(reg->base + reg->size, lm_end);
+
+		if (start >= end)
+			continue;
+
+		kasan_populate_shadow(
+			(unsigned long)kasan_mem_to_shadow(__va(start)),
+			(unsigned long)kasan_mem_to_shadow(__va(end)));
+	}
+
+	kasan_populate_zero_shadow((void *)round_up(lm_shadow_end, PAGE_SIZE),
+				   (void *)KASAN_SHADOW_END);
+
+	/*
+	 * KASAN may reuse the contents of kasan_zero_pte directly, so we
+	 * should make sure that it maps the zero page read-only.
+	 */
+	for (i = 0; i < PTRS_PER_PTE; i++)
+		set_pte(&kasan_zero_pte[i],
+			pte_wrprotect(pfn_pte(virt_to_pfn(kasan_zero_page),
+					      PAGE_KERNEL)));
+
+	memset(kasan_zero_page, 0, PAGE_SIZE);
+	set_pgdir(swapper_pg_dir, 0);
+	local_flush_tlb_all();
+
+	/* At this point kasan is fully initialized. Enable error messages */
+	init_task.kasan_depth = 0;
+	pr_info("KernelAddressSanitizer initialized\n");
+}
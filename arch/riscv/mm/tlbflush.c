@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/smp.h>
+#include <linux/sched.h>
+#include <linux/debugfs.h>
+#include <linux/uaccess.h>
+
+#include <asm/sbi.h>
+#include <asm/mmu_context.h>
+#include <asm/tlbflush.h>
+
+/*
+ * Ranges of up to this many pages are flushed with one sfence.vma per
+ * page; anything bigger drops every entry of the address space instead.
+ * Tunable through debugfs (riscv/tlb_flush_page_ceiling).
+ */
+static unsigned long tlb_flush_page_ceiling __read_mostly = 32;
+
+static void local_flush_tlb_mm_range(struct mm_struct *mm,
+				     unsigned long start, unsigned long size)
+{
+	unsigned long asid = mm_context_asid(mm);
+	unsigned long addr, end = start + size;
+
+	if (size == -1UL || size > (tlb_flush_page_ceiling << PAGE_SHIFT)) {
+		if (use_asid_allocator)
+			local_flush_tlb_all_asid(asid);
+		else
+			local_flush_tlb_all();
+		return;
+	}
+
+	for (addr = start & PAGE_MASK; addr < end; addr += PAGE_SIZE) {
+		if (use_asid_allocator)
+			local_flush_tlb_page_asid(addr, asid);
+		else
+			local_flush_tlb_page(addr);
+	}
+}
+
+#ifndef CONFIG_SMP
+
+void flush_tlb_mm_range(struct mm_struct *mm, unsigned long start,
+			unsigned long end)
+{
+	local_flush_tlb_mm_range(mm, start, end - start);
+}
+
+#else /* CONFIG_SMP */
+
+void flush_tlb_all(void)
+{
+	sbi_remote_sfence_vma(NULL, 0, -1);
+}
+EXPORT_SYMBOL(flush_tlb_all);
+
+/*
+ * Flush [start, start + size) of mm on every hart that has run it.  When
+ * only the local hart is in mm_cpumask() there is no need to trap into
+ * the SBI at all.  size == -1 means the whole address space.
+ */
+static void __flush_tlb_range(struct mm_struct *mm, unsigned long start,
+			      unsigned long size)
+{
+	struct cpumask *cmask = mm_cpumask(mm);
+	unsigned int cpu;
+
+	if (cpumask_empty(cmask))
+		return;
+
+	cpu = get_cpu();
+	if (cpumask_any_but(cmask, cpu) >= nr_cpu_ids) {
+		local_flush_tlb_mm_range(mm, start, size);
+		goto out;
+	}
+
+	if (size != -1UL && size > (tlb_flush_page_ceiling << PAGE_SHIFT)) {
+		start = 0;
+		size = -1UL;
+	}
+
+	if (use_asid_allocator)
+		sbi_remote_sfence_vma_asid(cpumask_bits(cmask), start, size,
+					   mm_context_asid(mm));
+	else
+		sbi_remote_sfence_vma(cpumask_bits(cmask), start, size);
+out:
+	put_cpu();
+}
+
+void flush_tlb_mm(struct mm_struct *mm)
+{
+	__flush_tlb_range(mm, 0, -1);
+}
+
+void flush_tlb_page(struct vm_area_struct *vma, unsigned long addr)
+{
+	__flush_tlb_range(vma->vm_mm, addr, PAGE_SIZE);
+}
+
+void flush_tlb_range(struct vm_area_struct *vma, unsigned long start,
+		     unsigned long end)
+{
+	__flush_tlb_range(vma->vm_mm, start, end - start);
+}
+
+void flush_tlb_mm_range(struct mm_struct *mm, unsigned long start,
+			unsigned long end)
+{
+	__flush_tlb_range(mm, start, end - start);
+}
+
+#endif /* CONFIG_SMP */
+
+#ifdef CONFIG_DEBUG_FS
+static ssize_t tlbflush_read_file(struct file *file, char __user *user_buf,
+				  size_t count, loff_t *ppos)
+{
+	char buf[32];
+	unsigned int len;
+
+	len = sprintf(buf, "%lu\n", tlb_flush_page_ceiling);
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+static ssize_t tlbflush_write_file(struct file *file,
+		 const char __user *user_buf, size_t count, loff_t *ppos)
+{
+	char buf[32];
+	ssize_t len;
+	unsigned long ceiling;
+
+	len = min(count, sizeof(buf) - 1);
+	if (copy_from_user(buf, user_buf, len))
+		return -EFAULT;
+
+	buf[len] = '\0';
+	if (kstrtoul(buf, 0, &ceiling))
+		return -EINVAL;
+
+	tlb_flush_page_ceiling = ceiling;
+	return count;
+}
+
+static const struct file_operations fops_tlbflush = {
+	.read = tlbflush_read_file,
+	.write = tlbflush_write_file,
+	.llseek = default_llseek,
+};
+
+static int __init create_tlb_flush_page_ceiling(void)
+{
+	debugfs_create_file("tlb_flush_page_ceiling", S_IRUSR | S_IWUSR,
+			    arch_debugfs_dir, NULL, &fops_tlbflush);
+	return 0;
+}
+late_initcall(create_tlb_flush_page_ceiling);
+#endif /* CONFIG_DEBUG_FS */
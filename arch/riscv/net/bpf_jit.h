@@ -0,0 +1,385 @@
+/*
+ * BPF JIT compiler for RV64G
+ *
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#ifndef _RISCV_NET_BPF_JIT_H
+#define _RISCV_NET_BPF_JIT_H
+
+#include <linux/bug.h>
+#include <linux/types.h>
+
+enum {
+	RV_REG_ZERO =	0,	/* The constant value 0 */
+	RV_REG_RA =	1,	/* Return address */
+	RV_REG_SP =	2,	/* Stack pointer */
+	RV_REG_GP =	3,	/* Global pointer */
+	RV_REG_TP =	4,	/* Thread pointer */
+	RV_REG_T0 =	5,	/* Temporaries */
+	RV_REG_T1 =	6,
+	RV_REG_T2 =	7,
+	RV_REG_FP =	8,	/* Saved register/frame pointer */
+	RV_REG_S1 =	9,	/* Saved register */
+	RV_REG_A0 =	10,	/* Function argument/return values */
+	RV_REG_A1 =	11,	/* Function arguments */
+	RV_REG_A2 =	12,
+	RV_REG_A3 =	13,
+	RV_REG_A4 =	14,
+	RV_REG_A5 =	15,
+	RV_REG_A6 =	16,
+	RV_REG_A7 =	17,
+	RV_REG_S2 =	18,	/* Saved registers */
+	RV_REG_S3 =	19,
+	RV_REG_S4 =	20,
+	RV_REG_S5 =	21,
+	RV_REG_S6 =	22,
+	RV_REG_S7 =	23,
+	RV_REG_S8 =	24,
+	RV_REG_S9 =	25,
+	RV_REG_S10 =	26,
+	RV_REG_S11 =	27,
+	RV_REG_T3 =	28,	/* Temporaries */
+	RV_REG_T4 =	29,
+	RV_REG_T5 =	30,
+	RV_REG_T6 =	31,
+};
+
+/* Major opcodes */
+#define RV_OP_LOAD	0x03
+#define RV_OP_IMM	0x13
+#define RV_OP_AUIPC	0x17
+#define RV_OP_IMM_32	0x1b
+#define RV_OP_STORE	0x23
+#define RV_OP_AMO	0x2f
+#define RV_OP_OP	0x33
+#define RV_OP_LUI	0x37
+#define RV_OP_OP_32	0x3b
+#define RV_OP_BRANCH	0x63
+#define RV_OP_JALR	0x67
+#define RV_OP_JAL	0x6f
+
+/*
+ * Branch conditions, as the funct3 field of a BRANCH instruction.  Each
+ * condition and its inverse differ only in the low bit.
+ */
+#define RV_BEQ		0
+#define RV_BNE		1
+#define RV_BLT		4
+#define RV_BGE		5
+#define RV_BLTU		6
+#define RV_BGEU		7
+
+#define RV_BRANCH_INVERT(cond)	((cond) ^ 1)
+
+/* Shown by jit_fill_hole() in the unused part of the image */
+#define RV_INSN_EBREAK	0x00100073
+
+static inline bool is_12b_int(s64 val)
+{
+	return -(1L << 11) <= val && val < (1L << 11);
+}
+
+static inline bool is_13b_int(s64 val)
+{
+	return -(1L << 12) <= val && val < (1L << 12);
+}
+
+static inline bool is_21b_int(s64 val)
+{
+	return -(1L << 20) <= val && val < (1L << 20);
+}
+
+static inline bool is_32b_int(s64 val)
+{
+	return -(1L << 31) <= val && val < (1L << 31);
+}
+
+/* Instruction formats */
+
+static inline u32 rv_r_insn(u8 funct7, u8 rs2, u8 rs1, u8 funct3, u8 rd,
+			    u8 opcode)
+{
+	return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) |
+		(rd << 7) | opcode;
+}
+
+static inline u32 rv_i_insn(s32 imm11_0, u8 rs1, u8 funct3, u8 rd, u8 opcode)
+{
+	return ((imm11_0 & 0xfff) << 20) | (rs1 << 15) | (funct3 << 12) |
+		(rd << 7) | opcode;
+}
+
+static inline u32 rv_s_insn(s32 imm11_0, u8 rs2, u8 rs1, u8 funct3, u8 opcode)
+{
+	u32 imm11_5 = (imm11_0 >> 5) & 0x7f, imm4_0 = imm11_0 & 0x1f;
+
+	return (imm11_5 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) |
+		(imm4_0 << 7) | opcode;
+}
+
+/* offset is in bytes and must be even */
+static inline u32 rv_sb_insn(s32 offset, u8 rs2, u8 rs1, u8 funct3, u8 opcode)
+{
+	u32 imm12 = (offset >> 12) & 0x1, imm11 = (offset >> 11) & 0x1;
+	u32 imm10_5 = (offset >> 5) & 0x3f, imm4_1 = (offset >> 1) & 0xf;
+
+	return (imm12 << 31) | (imm10_5 << 25) | (rs2 << 20) | (rs1 << 15) |
+		(funct3 << 12) | (imm4_1 << 8) | (imm11 << 7) | opcode;
+}
+
+static inline u32 rv_u_insn(u32 imm31_12, u8 rd, u8 opcode)
+{
+	return ((imm31_12 & 0xfffff) << 12) | (rd << 7) | opcode;
+}
+
+/* offset is in bytes and must be even */
+static inline u32 rv_uj_insn(s32 offset, u8 rd, u8 opcode)
+{
+	u32 imm20 = (offset >> 20) & 0x1, imm19_12 = (offset >> 12) & 0xff;
+	u32 imm11 = (offset >> 11) & 0x1, imm10_1 = (offset >> 1) & 0x3ff;
+
+	return (imm20 << 31) | (imm10_1 << 21) | (imm11 << 20) |
+		(imm19_12 << 12) | (rd << 7) | opcode;
+}
+
+static inline u32 rv_amo_insn(u8 funct5, u8 aq, u8 rl, u8 rs2, u8 rs1,
+			      u8 funct3, u8 rd)
+{
+	u8 funct7 = (funct5 << 2) | (aq << 1) | rl;
+
+	return rv_r_insn(funct7, rs2, rs1, funct3, rd, RV_OP_AMO);
+}
+
+/* Instructions, with operands in assembler order */
+
+static inline u32 rv_addiw(u8 rd, u8 rs1, s32 imm)
+{
+	return rv_i_insn(imm, rs1, 0, rd, RV_OP_IMM_32);
+}
+
+static inline u32 rv_addi(u8 rd, u8 rs1, s32 imm)
+{
+	return rv_i_insn(imm, rs1, 0, rd, RV_OP_IMM);
+}
+
+static inline u32 rv_andi(u8 rd, u8 rs1, s32 imm)
+{
+	return rv_i_insn(imm, rs1, 7, rd, RV_OP_IMM);
+}
+
+static inline u32 rv_ori(u8 rd, u8 rs1, s32 imm)
+{
+	return rv_i_insn(imm, rs1, 6, rd, RV_OP_IMM);
+}
+
+static inline u32 rv_xori(u8 rd, u8 rs1, s32 imm)
+{
+	return rv_i_insn(imm, rs1, 4, rd, RV_OP_IMM);
+}
+
+static inline u32 rv_slli(u8 rd, u8 rs1, u8 shamt)
+{
+	return rv_i_insn(shamt & 0x3f, rs1, 1, rd, RV_OP_IMM);
+}
+
+static inline u32 rv_srli(u8 rd, u8 rs1, u8 shamt)
+{
+	return rv_i_insn(shamt & 0x3f, rs1, 5, rd, RV_OP_IMM);
+}
+
+static inline u32 rv_srai(u8 rd, u8 rs1, u8 shamt)
+{
+	return rv_i_insn(0x400 | (shamt & 0x3f), rs1, 5, rd, RV_OP_IMM);
+}
+
+static inline u32 rv_slliw(u8 rd, u8 rs1, u8 shamt)
+{
+	return rv_i_insn(shamt & 0x1f, rs1, 1, rd, RV_OP_IMM_32);
+}
+
+static inline u32 rv_srliw(u8 rd, u8 rs1, u8 shamt)
+{
+	return rv_i_insn(shamt & 0x1f, rs1, 5, rd, RV_OP_IMM_32);
+}
+
+static inline u32 rv_sraiw(u8 rd, u8 rs1, u8 shamt)
+{
+	return rv_i_insn(0x400 | (shamt & 0x1f), rs1, 5, rd, RV_OP_IMM_32);
+}
+
+static inline u32 rv_lui(u8 rd, u32 imm31_12)
+{
+	return rv_u_insn(imm31_12, rd, RV_OP_LUI);
+}
+
+static inline u32 rv_add(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(0, rs2, rs1, 0, rd, RV_OP_OP);
+}
+
+static inline u32 rv_sub(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(0x20, rs2, rs1, 0, rd, RV_OP_OP);
+}
+
+static inline u32 rv_and(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(0, rs2, rs1, 7, rd, RV_OP_OP);
+}
+
+static inline u32 rv_or(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(0, rs2, rs1, 6, rd, RV_OP_OP);
+}
+
+static inline u32 rv_xor(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(0, rs2, rs1, 4, rd, RV_OP_OP);
+}
+
+static inline u32 rv_sll(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(0, rs2, rs1, 1, rd, RV_OP_OP);
+}
+
+static inline u32 rv_srl(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(0, rs2, rs1, 5, rd, RV_OP_OP);
+}
+
+static inline u32 rv_sra(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(0x20, rs2, rs1, 5, rd, RV_OP_OP);
+}
+
+static inline u32 rv_mul(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(1, rs2, rs1, 0, rd, RV_OP_OP);
+}
+
+static inline u32 rv_divu(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(1, rs2, rs1, 5, rd, RV_OP_OP);
+}
+
+static inline u32 rv_remu(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(1, rs2, rs1, 7, rd, RV_OP_OP);
+}
+
+static inline u32 rv_addw(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(0, rs2, rs1, 0, rd, RV_OP_OP_32);
+}
+
+static inline u32 rv_subw(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(0x20, rs2, rs1, 0, rd, RV_OP_OP_32);
+}
+
+static inline u32 rv_sllw(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(0, rs2, rs1, 1, rd, RV_OP_OP_32);
+}
+
+static inline u32 rv_srlw(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(0, rs2, rs1, 5, rd, RV_OP_OP_32);
+}
+
+static inline u32 rv_sraw(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(0x20, rs2, rs1, 5, rd, RV_OP_OP_32);
+}
+
+static inline u32 rv_mulw(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(1, rs2, rs1, 0, rd, RV_OP_OP_32);
+}
+
+static inline u32 rv_divuw(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(1, rs2, rs1, 5, rd, RV_OP_OP_32);
+}
+
+static inline u32 rv_remuw(u8 rd, u8 rs1, u8 rs2)
+{
+	return rv_r_insn(1, rs2, rs1, 7, rd, RV_OP_OP_32);
+}
+
+static inline u32 rv_jal(u8 rd, s32 offset)
+{
+	return rv_uj_insn(offset, rd, RV_OP_JAL);
+}
+
+static inline u32 rv_jalr(u8 rd, u8 rs1, s32 imm)
+{
+	return rv_i_insn(imm, rs1, 0, rd, RV_OP_JALR);
+}
+
+static inline u32 rv_branch(u8 cond, u8 rs1, u8 rs2, s32 offset)
+{
+	return rv_sb_insn(offset, rs2, rs1, cond, RV_OP_BRANCH);
+}
+
+static inline u32 rv_lbu(u8 rd, s32 imm, u8 rs1)
+{
+	return rv_i_insn(imm, rs1, 4, rd, RV_OP_LOAD);
+}
+
+static inline u32 rv_lhu(u8 rd, s32 imm, u8 rs1)
+{
+	return rv_i_insn(imm, rs1, 5, rd, RV_OP_LOAD);
+}
+
+static inline u32 rv_lwu(u8 rd, s32 imm, u8 rs1)
+{
+	return rv_i_insn(imm, rs1, 6, rd, RV_OP_LOAD);
+}
+
+static inline u32 rv_ld(u8 rd, s32 imm, u8 rs1)
+{
+	return rv_i_insn(imm, rs1, 3, rd, RV_OP_LOAD);
+}
+
+static inline u32 rv_sb(u8 rs2, s32 imm, u8 rs1)
+{
+	return rv_s_insn(imm, rs2, rs1, 0, RV_OP_STORE);
+}
+
+static inline u32 rv_sh(u8 rs2, s32 imm, u8 rs1)
+{
+	return rv_s_insn(imm, rs2, rs1, 1, RV_OP_STORE);
+}
+
+static inline u32 rv_sw(u8 rs2, s32 imm, u8 rs1)
+{
+	return rv_s_insn(imm, rs2, rs1, 2, RV_OP_STORE);
+}
+
+static inline u32 rv_sd(u8 rs2, s32 imm, u8 rs1)
+{
+	return rv_s_insn(imm, rs2, rs1, 3, RV_OP_STORE);
+}
+
+static inline u32 rv_amoadd_w(u8 rd, u8 rs2, u8 rs1, u8 aq, u8 rl)
+{
+	return rv_amo_insn(0, aq, rl, rs2, rs1, 2, rd);
+}
+
+static inline u32 rv_amoadd_d(u8 rd, u8 rs2, u8 rs1, u8 aq, u8 rl)
+{
+	return rv_amo_insn(0, aq, rl, rs2, rs1, 3, rd);
+}
+
+#endif /* _RISCV_NET_BPF_JIT_H */
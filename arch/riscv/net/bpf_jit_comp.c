@@ -0,0 +1,1061 @@
+/*
+ * BPF JIT compiler for RV64G
+ * Based on arch/arm64/net/bpf_jit_comp.c
+ *
+ * Copyright (C) 2014-2016 Zi Shen Lim <zlim.lnx@gmail.com>
+ * Copyright (C) 2017 SiFive
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#define pr_fmt(fmt) "bpf_jit: " fmt
+
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/printk.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+
+#include <asm/byteorder.h>
+#include <asm/cacheflush.h>
+
+#include "bpf_jit.h"
+
+int bpf_jit_enable __read_mostly;
+
+/*
+ * The sizing passes stop once no instruction moved; a program whose
+ * layout still oscillates after this many is left to the interpreter.
+ */
+#define NR_JIT_ITERATIONS	16
+
+/* Upper bound on RISC-V instructions emitted for one BPF instruction */
+#define RV_INSNS_PER_BPF_INSN	40
+
+#define TMP_REG_1	(MAX_BPF_JIT_REG + 0)
+#define TMP_REG_2	(MAX_BPF_JIT_REG + 1)
+#define TMP_REG_3	(MAX_BPF_JIT_REG + 2)
+#define TCALL_CNT	(MAX_BPF_JIT_REG + 3)
+
+/* Map BPF registers to RISC-V registers */
+static const u8 bpf2rv[] = {
+	/* return value from in-kernel function, and exit value from eBPF */
+	[BPF_REG_0] = RV_REG_A5,
+	/* arguments from eBPF program to in-kernel function */
+	[BPF_REG_1] = RV_REG_A0,
+	[BPF_REG_2] = RV_REG_A1,
+	[BPF_REG_3] = RV_REG_A2,
+	[BPF_REG_4] = RV_REG_A3,
+	[BPF_REG_5] = RV_REG_A4,
+	/* callee saved registers that in-kernel function will preserve */
+	[BPF_REG_6] = RV_REG_S1,
+	[BPF_REG_7] = RV_REG_S2,
+	[BPF_REG_8] = RV_REG_S3,
+	[BPF_REG_9] = RV_REG_S4,
+	/* read-only frame pointer to access stack */
+	[BPF_REG_FP] = RV_REG_S5,
+	/* temporary registers for internal BPF JIT */
+	[TMP_REG_1] = RV_REG_T1,
+	[TMP_REG_2] = RV_REG_T2,
+	[TMP_REG_3] = RV_REG_T3,
+	/* tail_call_cnt */
+	[TCALL_CNT] = RV_REG_S6,
+	/* temporary register for blinding constants */
+	[BPF_REG_AX] = RV_REG_T0,
+};
+
+/*
+ * Callee saved registers spilled by the prologue: ra, fp and s1-s6.  The
+ * tail call count is carried in a6 from the caller's epilogue into the
+ * callee's prologue, since s6 itself is restored on the way out.
+ */
+#define SAVED_REGS_SIZE		(8 * 8)
+#define SCRATCH_SIZE		16
+#define TCALL_CNT_ARG		RV_REG_A6
+
+struct jit_ctx {
+	const struct bpf_prog *prog;
+	u32 *image;		/* NULL during the sizing passes */
+	int idx;
+	int epilogue_offset;
+	int *offset;		/* RISC-V index of the first insn of each insn */
+	bool offset_changed;
+	int stack_size;
+};
+
+static inline void emit(const u32 insn, struct jit_ctx *ctx)
+{
+	if (ctx->image != NULL)
+		ctx->image[ctx->idx] = insn;
+
+	ctx->idx++;
+}
+
+/*
+ * Load a 64-bit immediate.  addi sign-extends its 12-bit immediate, so
+ * the upper part is rounded up by 2^11 to compensate before it is split
+ * off, and the value is built from the least significant end.
+ */
+static void emit_imm(const u8 rd, s64 val, struct jit_ctx *ctx)
+{
+	s64 upper = (val + (1 << 11)) >> 12, lower = val & 0xfff;
+	int shift;
+
+	if (is_32b_int(val)) {
+		if (!upper) {
+			emit(rv_addi(rd, RV_REG_ZERO, lower), ctx);
+			return;
+		}
+
+		emit(rv_lui(rd, upper), ctx);
+		if (lower)
+			emit(rv_addiw(rd, rd, lower), ctx);
+		return;
+	}
+
+	shift = __ffs(upper);
+	upper >>= shift;
+	shift += 12;
+
+	emit_imm(rd, upper, ctx);
+
+	emit(rv_slli(rd, rd, shift), ctx);
+	if (lower)
+		emit(rv_addi(rd, rd, lower), ctx);
+}
+
+static inline void emit_mv(const u8 rd, const u8 rs, struct jit_ctx *ctx)
+{
+	emit(rv_addi(rd, rs, 0), ctx);
+}
+
+/* Clear the upper 32 bits of rd, as every BPF_ALU op must */
+static inline void emit_zext_32(const u8 rd, struct jit_ctx *ctx)
+{
+	emit(rv_slli(rd, rd, 32), ctx);
+	emit(rv_srli(rd, rd, 32), ctx);
+}
+
+/* Byte-swap the low 'bits' bits of rd into rd, zero-extending the result */
+static void emit_bswap(const u8 rd, const int bits, struct jit_ctx *ctx)
+{
+	const u8 tmp = bpf2rv[TMP_REG_1];
+	const u8 acc = bpf2rv[TMP_REG_2];
+	int i;
+
+	emit(rv_andi(acc, rd, 0xff), ctx);
+	for (i = 8; i < bits; i += 8) {
+		emit(rv_srli(rd, rd, 8), ctx);
+		emit(rv_slli(acc, acc, 8), ctx);
+		emit(rv_andi(tmp, rd, 0xff), ctx);
+		emit(rv_or(acc, acc, tmp), ctx);
+	}
+	emit_mv(rd, acc, ctx);
+}
+
+/* RISC-V byte offset from the current instruction to that of BPF insn 'to' */
+static inline int bpf2rv_offset(int to, const struct jit_ctx *ctx)
+{
+	return (ctx->offset[to] - ctx->idx) * 4;
+}
+
+static inline int epilogue_offset(const struct jit_ctx *ctx)
+{
+	return (ctx->epilogue_offset - ctx->idx) * 4;
+}
+
+static int emit_jump(int rvoff, struct jit_ctx *ctx)
+{
+	if (!is_21b_int(rvoff)) {
+		pr_err_once("jump offset %d out of range\n", rvoff);
+		return -E2BIG;
+	}
+
+	emit(rv_jal(RV_REG_ZERO, rvoff), ctx);
+	return 0;
+}
+
+/*
+ * Conditional branches reach +/-4KiB.  Anything further away is done as
+ * the inverse condition skipping over a jal, which reaches +/-1MiB.
+ * rvoff is relative to the first emitted instruction.
+ */
+static int emit_branch(const u8 cond, const u8 rs1, const u8 rs2, int rvoff,
+		       struct jit_ctx *ctx)
+{
+	if (is_13b_int(rvoff)) {
+		emit(rv_branch(cond, rs1, rs2, rvoff), ctx);
+		return 0;
+	}
+
+	emit(rv_branch(RV_BRANCH_INVERT(cond), rs1, rs2, 8), ctx);
+	return emit_jump(rvoff - 4, ctx);
+}
+
+static void jit_fill_hole(void *area, unsigned int size)
+{
+	u32 *ptr;
+
+	/* We are guaranteed to have aligned memory. */
+	for (ptr = area; size >= sizeof(u32); size -= sizeof(u32))
+		*ptr++ = RV_INSN_EBREAK;
+}
+
+static void build_prologue(struct jit_ctx *ctx)
+{
+	const struct bpf_prog *prog = ctx->prog;
+	const u8 fp = bpf2rv[BPF_REG_FP];
+	const u8 tcc = bpf2rv[TCALL_CNT];
+	int stack_adjust, store_offset;
+
+	/*
+	 * BPF prog stack layout
+	 *
+	 *                         high
+	 * original sp, fp =>   0:+-----+ BPF prologue
+	 *                        | ra  |
+	 *                        | fp  |
+	 *                        | ... | callee saved registers
+	 * BPF fp register => -64:+-----+ <= (BPF_FP)
+	 *                        |     |
+	 *                        | ... | BPF prog stack
+	 *                        |     |
+	 *                        +-----+ <= (BPF_FP - prog->aux->stack_depth)
+	 *                        |RSVD | JIT scratchpad
+	 * current sp =>          +-----+ <= (BPF_FP - ctx->stack_size)
+	 *                          low
+	 */
+	ctx->stack_size = round_up(prog->aux->stack_depth, 16) + SCRATCH_SIZE;
+	stack_adjust = SAVED_REGS_SIZE + ctx->stack_size;
+
+	/* Must stay the first instruction, tail calls enter just past it. */
+	emit(rv_addi(TCALL_CNT_ARG, RV_REG_ZERO, MAX_TAIL_CALL_CNT), ctx);
+
+	emit(rv_addi(RV_REG_SP, RV_REG_SP, -stack_adjust), ctx);
+
+	store_offset = stack_adjust;
+	emit(rv_sd(RV_REG_RA, store_offset -= 8, RV_REG_SP), ctx);
+	emit(rv_sd(RV_REG_FP, store_offset -= 8, RV_REG_SP), ctx);
+	emit(rv_sd(RV_REG_S1, store_offset -= 8, RV_REG_SP), ctx);
+	emit(rv_sd(RV_REG_S2, store_offset -= 8, RV_REG_SP), ctx);
+	emit(rv_sd(RV_REG_S3, store_offset -= 8, RV_REG_SP), ctx);
+	emit(rv_sd(RV_REG_S4, store_offset -= 8, RV_REG_SP), ctx);
+	emit(rv_sd(RV_REG_S5, store_offset -= 8, RV_REG_SP), ctx);
+	emit(rv_sd(RV_REG_S6, store_offset -= 8, RV_REG_SP), ctx);
+
+	emit(rv_addi(RV_REG_FP, RV_REG_SP, stack_adjust), ctx);
+
+	/* Set up BPF prog stack base register */
+	emit(rv_addi(fp, RV_REG_SP, ctx->stack_size), ctx);
+
+	emit_mv(tcc, TCALL_CNT_ARG, ctx);
+}
+
+static void __build_epilogue(bool is_tail_call, struct jit_ctx *ctx)
+{
+	const u8 r0 = bpf2rv[BPF_REG_0];
+	const u8 tcc = bpf2rv[TCALL_CNT];
+	const u8 prg_func = bpf2rv[TMP_REG_3];
+	int stack_adjust = SAVED_REGS_SIZE + ctx->stack_size;
+	int load_offset = stack_adjust;
+
+	if (is_tail_call)
+		emit_mv(TCALL_CNT_ARG, tcc, ctx);
+	else
+		emit_mv(RV_REG_A0, r0, ctx);
+
+	emit(rv_ld(RV_REG_RA, load_offset -= 8, RV_REG_SP), ctx);
+	emit(rv_ld(RV_REG_FP, load_offset -= 8, RV_REG_SP), ctx);
+	emit(rv_ld(RV_REG_S1, load_offset -= 8, RV_REG_SP), ctx);
+	emit(rv_ld(RV_REG_S2, load_offset -= 8, RV_REG_SP), ctx);
+	emit(rv_ld(RV_REG_S3, load_offset -= 8, RV_REG_SP), ctx);
+	emit(rv_ld(RV_REG_S4, load_offset -= 8, RV_REG_SP), ctx);
+	emit(rv_ld(RV_REG_S5, load_offset -= 8, RV_REG_SP), ctx);
+	emit(rv_ld(RV_REG_S6, load_offset -= 8, RV_REG_SP), ctx);
+
+	emit(rv_addi(RV_REG_SP, RV_REG_SP, stack_adjust), ctx);
+
+	if (is_tail_call)
+		/* Skip the tail call count initialisation of the target. */
+		emit(rv_jalr(RV_REG_ZERO, prg_func, 4), ctx);
+	else
+		emit(rv_jalr(RV_REG_ZERO, RV_REG_RA, 0), ctx);
+}
+
+static void build_epilogue(struct jit_ctx *ctx)
+{
+	__build_epilogue(false, ctx);
+}
+
+/* rd = *(u32/u64 *)(base + off), for offsets too big for the load itself */
+static void emit_ld_field(const u8 rd, const u8 base, const int off,
+			  const bool is64, struct jit_ctx *ctx)
+{
+	const u8 tmp = bpf2rv[TMP_REG_1];
+	u8 addr = base;
+	int imm = off;
+
+	if (!is_12b_int(off)) {
+		emit_imm(tmp, off, ctx);
+		emit(rv_add(tmp, tmp, base), ctx);
+		addr = tmp;
+		imm = 0;
+	}
+
+	emit(is64 ? rv_ld(rd, imm, addr) : rv_lwu(rd, imm, addr), ctx);
+}
+
+static int emit_bpf_tail_call(int insn, struct jit_ctx *ctx)
+{
+	/* bpf_tail_call(void *prog_ctx, struct bpf_array *array, u64 index) */
+	const u8 r2 = bpf2rv[BPF_REG_2];
+	const u8 r3 = bpf2rv[BPF_REG_3];
+
+	const u8 tmp = bpf2rv[TMP_REG_2];
+	const u8 prg = bpf2rv[TMP_REG_3];
+	const u8 tcc = bpf2rv[TCALL_CNT];
+	/* The instruction after the tail call is the "out" label. */
+	const int out = insn + 1;
+	int ret;
+
+	/* if (index >= array->map.max_entries)
+	 *     goto out;
+	 */
+	emit_ld_field(tmp, r2, offsetof(struct bpf_array, map.max_entries),
+		      false, ctx);
+	ret = emit_branch(RV_BGEU, r3, tmp, bpf2rv_offset(out, ctx), ctx);
+	if (ret)
+		return ret;
+
+	/* if (tail_call_cnt-- == 0)
+	 *     goto out;
+	 *
+	 * The count goes down from MAX_TAIL_CALL_CNT and is checked before
+	 * the decrement, which allows as many calls as the interpreter.
+	 */
+	ret = emit_branch(RV_BLT, tcc, RV_REG_ZERO, bpf2rv_offset(out, ctx), ctx);
+	if (ret)
+		return ret;
+	emit(rv_addi(tcc, tcc, -1), ctx);
+
+	/* prog = array->ptrs[index];
+	 * if (prog == NULL)
+	 *     goto out;
+	 */
+	emit(rv_slli(prg, r3, 3), ctx);
+	emit(rv_add(prg, prg, r2), ctx);
+	emit_ld_field(prg, prg, offsetof(struct bpf_array, ptrs), true, ctx);
+	ret = emit_branch(RV_BEQ, prg, RV_REG_ZERO, bpf2rv_offset(out, ctx),
+			  ctx);
+	if (ret)
+		return ret;
+
+	/* goto *(prog->bpf_func + prologue_offset); */
+	emit_ld_field(prg, prg, offsetof(struct bpf_prog, bpf_func), true, ctx);
+	__build_epilogue(true, ctx);
+
+	/* out: */
+	return 0;
+}
+
+/*
+ * Turn dst/off into a base register and 12-bit offset for a load or
+ * store, going through TMP_REG_3 when off doesn't fit.
+ */
+static u8 emit_mem_addr(const u8 base, s16 *off, struct jit_ctx *ctx)
+{
+	const u8 tmp = bpf2rv[TMP_REG_3];
+
+	if (is_12b_int(*off))
+		return base;
+
+	emit_imm(tmp, *off, ctx);
+	emit(rv_add(tmp, tmp, base), ctx);
+	*off = 0;
+	return tmp;
+}
+
+/* JITs an eBPF instruction.
+ * Returns:
+ * 0  - successfully JITed an 8-byte eBPF instruction.
+ * >0 - successfully JITed a 16-byte eBPF instruction.
+ * <0 - failed to JIT.
+ */
+static int build_insn(const struct bpf_insn *insn, struct jit_ctx *ctx)
+{
+	const u8 code = insn->code;
+	const u8 dst = bpf2rv[insn->dst_reg];
+	const u8 src = bpf2rv[insn->src_reg];
+	const u8 tmp = bpf2rv[TMP_REG_1];
+	const u8 tmp2 = bpf2rv[TMP_REG_2];
+	const bool is64 = BPF_CLASS(code) == BPF_ALU64;
+	const int i = insn - ctx->prog->insnsi;
+	s16 off = insn->off;
+	const s32 imm = insn->imm;
+	u8 cond, rs1, rs2, base;
+	int ret;
+
+	switch (code) {
+	/* dst = src */
+	case BPF_ALU | BPF_MOV | BPF_X:
+	case BPF_ALU64 | BPF_MOV | BPF_X:
+		emit_mv(dst, src, ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	/* dst = dst OP src */
+	case BPF_ALU | BPF_ADD | BPF_X:
+	case BPF_ALU64 | BPF_ADD | BPF_X:
+		emit(is64 ? rv_add(dst, dst, src) : rv_addw(dst, dst, src), ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_SUB | BPF_X:
+	case BPF_ALU64 | BPF_SUB | BPF_X:
+		emit(is64 ? rv_sub(dst, dst, src) : rv_subw(dst, dst, src), ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_AND | BPF_X:
+	case BPF_ALU64 | BPF_AND | BPF_X:
+		emit(rv_and(dst, dst, src), ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_OR | BPF_X:
+	case BPF_ALU64 | BPF_OR | BPF_X:
+		emit(rv_or(dst, dst, src), ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_XOR | BPF_X:
+	case BPF_ALU64 | BPF_XOR | BPF_X:
+		emit(rv_xor(dst, dst, src), ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_MUL | BPF_X:
+	case BPF_ALU64 | BPF_MUL | BPF_X:
+		emit(is64 ? rv_mul(dst, dst, src) : rv_mulw(dst, dst, src), ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_DIV | BPF_X:
+	case BPF_ALU64 | BPF_DIV | BPF_X:
+	case BPF_ALU | BPF_MOD | BPF_X:
+	case BPF_ALU64 | BPF_MOD | BPF_X:
+	{
+		const u8 r0 = bpf2rv[BPF_REG_0];
+
+		/* if (src == 0) return 0 */
+		rs1 = src;
+		if (!is64) {
+			emit(rv_slli(tmp, src, 32), ctx);
+			rs1 = tmp;
+		}
+		/* skip ahead past the li and the jump to the epilogue */
+		emit(rv_branch(RV_BNE, rs1, RV_REG_ZERO, 12), ctx);
+		emit(rv_addi(r0, RV_REG_ZERO, 0), ctx);
+		ret = emit_jump(epilogue_offset(ctx), ctx);
+		if (ret)
+			return ret;
+
+		if (BPF_OP(code) == BPF_DIV)
+			emit(is64 ? rv_divu(dst, dst, src) :
+				    rv_divuw(dst, dst, src), ctx);
+		else
+			emit(is64 ? rv_remu(dst, dst, src) :
+				    rv_remuw(dst, dst, src), ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	}
+	case BPF_ALU | BPF_LSH | BPF_X:
+	case BPF_ALU64 | BPF_LSH | BPF_X:
+		emit(is64 ? rv_sll(dst, dst, src) : rv_sllw(dst, dst, src), ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_RSH | BPF_X:
+	case BPF_ALU64 | BPF_RSH | BPF_X:
+		emit(is64 ? rv_srl(dst, dst, src) : rv_srlw(dst, dst, src), ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_ARSH | BPF_X:
+	case BPF_ALU64 | BPF_ARSH | BPF_X:
+		emit(is64 ? rv_sra(dst, dst, src) : rv_sraw(dst, dst, src), ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	/* dst = -dst */
+	case BPF_ALU | BPF_NEG:
+	case BPF_ALU64 | BPF_NEG:
+		emit(is64 ? rv_sub(dst, RV_REG_ZERO, dst) :
+			    rv_subw(dst, RV_REG_ZERO, dst), ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	/* dst = BSWAP##imm(dst) */
+	case BPF_ALU | BPF_END | BPF_FROM_LE:
+		switch (imm) {
+		case 16:
+			emit(rv_slli(dst, dst, 48), ctx);
+			emit(rv_srli(dst, dst, 48), ctx);
+			break;
+		case 32:
+			emit_zext_32(dst, ctx);
+			break;
+		case 64:
+			/* nop */
+			break;
+		default:
+			return -EINVAL;
+		}
+		break;
+	case BPF_ALU | BPF_END | BPF_FROM_BE:
+		switch (imm) {
+		case 16:
+		case 32:
+		case 64:
+			emit_bswap(dst, imm, ctx);
+			break;
+		default:
+			return -EINVAL;
+		}
+		break;
+	/* dst = imm */
+	case BPF_ALU | BPF_MOV | BPF_K:
+	case BPF_ALU64 | BPF_MOV | BPF_K:
+		emit_imm(dst, imm, ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	/* dst = dst OP imm */
+	case BPF_ALU | BPF_ADD | BPF_K:
+	case BPF_ALU64 | BPF_ADD | BPF_K:
+		if (is_12b_int(imm)) {
+			emit(is64 ? rv_addi(dst, dst, imm) :
+				    rv_addiw(dst, dst, imm), ctx);
+		} else {
+			emit_imm(tmp, imm, ctx);
+			emit(is64 ? rv_add(dst, dst, tmp) :
+				    rv_addw(dst, dst, tmp), ctx);
+		}
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_SUB | BPF_K:
+	case BPF_ALU64 | BPF_SUB | BPF_K:
+		if (is_12b_int(-(s64)imm)) {
+			emit(is64 ? rv_addi(dst, dst, -imm) :
+				    rv_addiw(dst, dst, -imm), ctx);
+		} else {
+			emit_imm(tmp, imm, ctx);
+			emit(is64 ? rv_sub(dst, dst, tmp) :
+				    rv_subw(dst, dst, tmp), ctx);
+		}
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_AND | BPF_K:
+	case BPF_ALU64 | BPF_AND | BPF_K:
+		if (is_12b_int(imm)) {
+			emit(rv_andi(dst, dst, imm), ctx);
+		} else {
+			emit_imm(tmp, imm, ctx);
+			emit(rv_and(dst, dst, tmp), ctx);
+		}
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_OR | BPF_K:
+	case BPF_ALU64 | BPF_OR | BPF_K:
+		if (is_12b_int(imm)) {
+			emit(rv_ori(dst, dst, imm), ctx);
+		} else {
+			emit_imm(tmp, imm, ctx);
+			emit(rv_or(dst, dst, tmp), ctx);
+		}
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_XOR | BPF_K:
+	case BPF_ALU64 | BPF_XOR | BPF_K:
+		if (is_12b_int(imm)) {
+			emit(rv_xori(dst, dst, imm), ctx);
+		} else {
+			emit_imm(tmp, imm, ctx);
+			emit(rv_xor(dst, dst, tmp), ctx);
+		}
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_MUL | BPF_K:
+	case BPF_ALU64 | BPF_MUL | BPF_K:
+		emit_imm(tmp, imm, ctx);
+		emit(is64 ? rv_mul(dst, dst, tmp) : rv_mulw(dst, dst, tmp), ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	/* The verifier rejects division by a zero immediate. */
+	case BPF_ALU | BPF_DIV | BPF_K:
+	case BPF_ALU64 | BPF_DIV | BPF_K:
+		emit_imm(tmp, imm, ctx);
+		emit(is64 ? rv_divu(dst, dst, tmp) :
+			    rv_divuw(dst, dst, tmp), ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_MOD | BPF_K:
+	case BPF_ALU64 | BPF_MOD | BPF_K:
+		emit_imm(tmp, imm, ctx);
+		emit(is64 ? rv_remu(dst, dst, tmp) :
+			    rv_remuw(dst, dst, tmp), ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_LSH | BPF_K:
+	case BPF_ALU64 | BPF_LSH | BPF_K:
+		emit(is64 ? rv_slli(dst, dst, imm) : rv_slliw(dst, dst, imm),
+		     ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_RSH | BPF_K:
+	case BPF_ALU64 | BPF_RSH | BPF_K:
+		emit(is64 ? rv_srli(dst, dst, imm) : rv_srliw(dst, dst, imm),
+		     ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+	case BPF_ALU | BPF_ARSH | BPF_K:
+	case BPF_ALU64 | BPF_ARSH | BPF_K:
+		emit(is64 ? rv_srai(dst, dst, imm) : rv_sraiw(dst, dst, imm),
+		     ctx);
+		if (!is64)
+			emit_zext_32(dst, ctx);
+		break;
+
+	/* JUMP off */
+	case BPF_JMP | BPF_JA:
+		ret = emit_jump(bpf2rv_offset(i + off + 1, ctx), ctx);
+		if (ret)
+			return ret;
+		break;
+	/* IF (dst COND src) JUMP off */
+	case BPF_JMP | BPF_JEQ | BPF_X:
+	case BPF_JMP | BPF_JGT | BPF_X:
+	case BPF_JMP | BPF_JGE | BPF_X:
+	case BPF_JMP | BPF_JNE | BPF_X:
+	case BPF_JMP | BPF_JSGT | BPF_X:
+	case BPF_JMP | BPF_JSGE | BPF_X:
+		rs2 = src;
+		goto emit_cond_jmp;
+	/* IF (dst COND imm) JUMP off */
+	case BPF_JMP | BPF_JEQ | BPF_K:
+	case BPF_JMP | BPF_JGT | BPF_K:
+	case BPF_JMP | BPF_JGE | BPF_K:
+	case BPF_JMP | BPF_JNE | BPF_K:
+	case BPF_JMP | BPF_JSGT | BPF_K:
+	case BPF_JMP | BPF_JSGE | BPF_K:
+		rs2 = RV_REG_ZERO;
+		if (imm) {
+			emit_imm(tmp, imm, ctx);
+			rs2 = tmp;
+		}
+emit_cond_jmp:
+		rs1 = dst;
+		switch (BPF_OP(code)) {
+		case BPF_JEQ:
+			cond = RV_BEQ;
+			break;
+		case BPF_JNE:
+			cond = RV_BNE;
+			break;
+		case BPF_JGE:
+			cond = RV_BGEU;
+			break;
+		case BPF_JSGE:
+			cond = RV_BGE;
+			break;
+		/* a > b is b < a */
+		case BPF_JGT:
+			cond = RV_BLTU;
+			swap(rs1, rs2);
+			break;
+		case BPF_JSGT:
+			cond = RV_BLT;
+			swap(rs1, rs2);
+			break;
+		default:
+			return -EFAULT;
+		}
+		ret = emit_branch(cond, rs1, rs2, bpf2rv_offset(i + off + 1, ctx),
+				  ctx);
+		if (ret)
+			return ret;
+		break;
+	case BPF_JMP | BPF_JSET | BPF_X:
+	case BPF_JMP | BPF_JSET | BPF_K:
+		if (BPF_SRC(code) == BPF_K) {
+			emit_imm(tmp, imm, ctx);
+			emit(rv_and(tmp, dst, tmp), ctx);
+		} else {
+			emit(rv_and(tmp, dst, src), ctx);
+		}
+		ret = emit_branch(RV_BNE, tmp, RV_REG_ZERO,
+				  bpf2rv_offset(i + off + 1, ctx), ctx);
+		if (ret)
+			return ret;
+		break;
+	/* function call */
+	case BPF_JMP | BPF_CALL:
+	{
+		const u8 r0 = bpf2rv[BPF_REG_0];
+		const u64 func = (u64)__bpf_call_base + imm;
+
+		/* R1-R5 are already in a0-a4 */
+		emit_imm(tmp, func, ctx);
+		emit(rv_jalr(RV_REG_RA, tmp, 0), ctx);
+		emit_mv(r0, RV_REG_A0, ctx);
+		break;
+	}
+	/* tail call */
+	case BPF_JMP | BPF_TAIL_CALL:
+		ret = emit_bpf_tail_call(i, ctx);
+		if (ret)
+			return ret;
+		break;
+	/* function return */
+	case BPF_JMP | BPF_EXIT:
+		/* Optimization: when last instruction is EXIT,
+		   simply fallthrough to epilogue. */
+		if (i == ctx->prog->len - 1)
+			break;
+		ret = emit_jump(epilogue_offset(ctx), ctx);
+		if (ret)
+			return ret;
+		break;
+
+	/* dst = imm64 */
+	case BPF_LD | BPF_IMM | BPF_DW:
+	{
+		const struct bpf_insn insn1 = insn[1];
+		u64 imm64;
+
+		imm64 = (u64)insn1.imm << 32 | (u32)imm;
+		emit_imm(dst, imm64, ctx);
+
+		return 1;
+	}
+
+	/* LDX: dst = *(size *)(src + off) */
+	case BPF_LDX | BPF_MEM | BPF_W:
+	case BPF_LDX | BPF_MEM | BPF_H:
+	case BPF_LDX | BPF_MEM | BPF_B:
+	case BPF_LDX | BPF_MEM | BPF_DW:
+		base = emit_mem_addr(src, &off, ctx);
+		switch (BPF_SIZE(code)) {
+		case BPF_W:
+			emit(rv_lwu(dst, off, base), ctx);
+			break;
+		case BPF_H:
+			emit(rv_lhu(dst, off, base), ctx);
+			break;
+		case BPF_B:
+			emit(rv_lbu(dst, off, base), ctx);
+			break;
+		case BPF_DW:
+			emit(rv_ld(dst, off, base), ctx);
+			break;
+		}
+		break;
+
+	/* ST: *(size *)(dst + off) = imm */
+	case BPF_ST | BPF_MEM | BPF_W:
+	case BPF_ST | BPF_MEM | BPF_H:
+	case BPF_ST | BPF_MEM | BPF_B:
+	case BPF_ST | BPF_MEM | BPF_DW:
+	/* STX: *(size *)(dst + off) = src */
+	case BPF_STX | BPF_MEM | BPF_W:
+	case BPF_STX | BPF_MEM | BPF_H:
+	case BPF_STX | BPF_MEM | BPF_B:
+	case BPF_STX | BPF_MEM | BPF_DW:
+		rs2 = src;
+		if (BPF_CLASS(code) == BPF_ST) {
+			rs2 = RV_REG_ZERO;
+			if (imm) {
+				emit_imm(tmp, imm, ctx);
+				rs2 = tmp;
+			}
+		}
+		base = emit_mem_addr(dst, &off, ctx);
+		switch (BPF_SIZE(code)) {
+		case BPF_W:
+			emit(rv_sw(rs2, off, base), ctx);
+			break;
+		case BPF_H:
+			emit(rv_sh(rs2, off, base), ctx);
+			break;
+		case BPF_B:
+			emit(rv_sb(rs2, off, base), ctx);
+			break;
+		case BPF_DW:
+			emit(rv_sd(rs2, off, base), ctx);
+			break;
+		}
+		break;
+	/* STX XADD: lock *(u32 *)(dst + off) += src */
+	case BPF_STX | BPF_XADD | BPF_W:
+	/* STX XADD: lock *(u64 *)(dst + off) += src */
+	case BPF_STX | BPF_XADD | BPF_DW:
+		base = dst;
+		if (off) {
+			if (is_12b_int(off)) {
+				emit(rv_addi(tmp, dst, off), ctx);
+			} else {
+				emit_imm(tmp, off, ctx);
+				emit(rv_add(tmp, tmp, dst), ctx);
+			}
+			base = tmp;
+		}
+		if (BPF_SIZE(code) == BPF_W)
+			emit(rv_amoadd_w(RV_REG_ZERO, src, base, 0, 0), ctx);
+		else
+			emit(rv_amoadd_d(RV_REG_ZERO, src, base, 0, 0), ctx);
+		break;
+
+	/* R0 = ntohx(*(size *)(((struct sk_buff *)R6)->data + imm)) */
+	case BPF_LD | BPF_ABS | BPF_W:
+	case BPF_LD | BPF_ABS | BPF_H:
+	case BPF_LD | BPF_ABS | BPF_B:
+	/* R0 = ntohx(*(size *)(((struct sk_buff *)R6)->data + src + imm)) */
+	case BPF_LD | BPF_IND | BPF_W:
+	case BPF_LD | BPF_IND | BPF_H:
+	case BPF_LD | BPF_IND | BPF_B:
+	{
+		const u8 r0 = bpf2rv[BPF_REG_0]; /* r0 = return value */
+		const u8 r6 = bpf2rv[BPF_REG_6]; /* r6 = pointer to sk_buff */
+		const u8 r1 = bpf2rv[BPF_REG_1]; /* r1: struct sk_buff *skb */
+		const u8 r2 = bpf2rv[BPF_REG_2]; /* r2: int k */
+		const u8 r3 = bpf2rv[BPF_REG_3]; /* r3: unsigned int size */
+		const u8 r4 = bpf2rv[BPF_REG_4]; /* r4: void *buffer */
+		int size;
+
+		switch (BPF_SIZE(code)) {
+		case BPF_W:
+			size = 4;
+			break;
+		case BPF_H:
+			size = 2;
+			break;
+		case BPF_B:
+			size = 1;
+			break;
+		default:
+			return -EINVAL;
+		}
+
+		/* src may be one of the argument registers, so go via tmp2 */
+		emit_imm(tmp2, imm, ctx);
+		if (BPF_MODE(code) == BPF_IND)
+			emit(rv_addw(tmp2, tmp2, src), ctx);
+		emit_mv(r1, r6, ctx);
+		emit_mv(r2, tmp2, ctx);
+		emit(rv_addi(r3, RV_REG_ZERO, size), ctx);
+		/* The JIT scratchpad is at the bottom of the frame. */
+		emit_mv(r4, RV_REG_SP, ctx);
+		emit_imm(tmp, (unsigned long)bpf_load_pointer, ctx);
+		emit(rv_jalr(RV_REG_RA, tmp, 0), ctx);
+		emit_mv(r0, RV_REG_A0, ctx);
+
+		ret = emit_branch(RV_BEQ, r0, RV_REG_ZERO, epilogue_offset(ctx),
+				  ctx);
+		if (ret)
+			return ret;
+
+		switch (BPF_SIZE(code)) {
+		case BPF_W:
+			emit(rv_lwu(r0, 0, r0), ctx);
+			emit_bswap(r0, 32, ctx);
+			break;
+		case BPF_H:
+			emit(rv_lhu(r0, 0, r0), ctx);
+			emit_bswap(r0, 16, ctx);
+			break;
+		case BPF_B:
+			emit(rv_lbu(r0, 0, r0), ctx);
+			break;
+		}
+		break;
+	}
+	default:
+		pr_err_once("unknown opcode %02x\n", code);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void ctx_set_offset(int i, struct jit_ctx *ctx)
+{
+	if (ctx->offset[i] != ctx->idx)
+		ctx->offset_changed = true;
+	ctx->offset[i] = ctx->idx;
+}
+
+static int build_body(struct jit_ctx *ctx)
+{
+	const struct bpf_prog *prog = ctx->prog;
+	int i;
+
+	for (i = 0; i < prog->len; i++) {
+		const struct bpf_insn *insn = &prog->insnsi[i];
+		int ret;
+
+		ctx_set_offset(i, ctx);
+		ret = build_insn(insn, ctx);
+		if (ret > 0) {
+			i++;
+			ctx_set_offset(i, ctx);
+			continue;
+		}
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Emit the whole program once.  Branches use the instruction offsets of
+ * the previous pass, and pick the short or the long form to match.
+ */
+static int build_image(struct jit_ctx *ctx)
+{
+	int epilogue_offset;
+
+	ctx->idx = 0;
+	ctx->offset_changed = false;
+
+	build_prologue(ctx);
+
+	if (build_body(ctx))
+		return -1;
+
+	epilogue_offset = ctx->idx;
+	if (ctx->epilogue_offset != epilogue_offset)
+		ctx->offset_changed = true;
+	ctx->epilogue_offset = epilogue_offset;
+
+	build_epilogue(ctx);
+
+	return 0;
+}
+
+static inline void bpf_flush_icache(void *start, void *end)
+{
+	flush_icache_range((unsigned long)start, (unsigned long)end);
+}
+
+struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog)
+{
+	struct bpf_prog *tmp, *orig_prog = prog;
+	struct bpf_binary_header *header;
+	bool tmp_blinded = false;
+	struct jit_ctx ctx;
+	int image_size;
+	u8 *image_ptr;
+	int i, pass;
+
+	if (!bpf_jit_enable)
+		return orig_prog;
+
+	tmp = bpf_jit_blind_constants(prog);
+	/* If blinding was requested and we failed during blinding,
+	 * we must fall back to the interpreter.
+	 */
+	if (IS_ERR(tmp))
+		return orig_prog;
+	if (tmp != prog) {
+		tmp_blinded = true;
+		prog = tmp;
+	}
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.prog = prog;
+
+	ctx.offset = kcalloc(prog->len, sizeof(int), GFP_KERNEL);
+	if (ctx.offset == NULL) {
+		prog = orig_prog;
+		goto out;
+	}
+
+	/*
+	 * 1. Sizing passes.  Start from a layout where every instruction is
+	 * as big as it can get, so that the first pass uses long branches
+	 * throughout and later passes only shrink them.
+	 */
+	for (i = 0; i < prog->len; i++)
+		ctx.offset[i] = i * RV_INSNS_PER_BPF_INSN;
+	ctx.epilogue_offset = prog->len * RV_INSNS_PER_BPF_INSN;
+
+	for (pass = 0; pass < NR_JIT_ITERATIONS; pass++) {
+		if (build_image(&ctx)) {
+			prog = orig_prog;
+			goto out_off;
+		}
+		if (!ctx.offset_changed)
+			break;
+	}
+	if (ctx.offset_changed) {
+		pr_err_once("layout did not converge after %d passes\n", pass);
+		prog = orig_prog;
+		goto out_off;
+	}
+
+	/* Now we know the actual image size. */
+	image_size = sizeof(u32) * ctx.idx;
+	header = bpf_jit_binary_alloc(image_size, &image_ptr,
+				      sizeof(u32), jit_fill_hole);
+	if (header == NULL) {
+		prog = orig_prog;
+		goto out_off;
+	}
+
+	/* 2. Now, the actual pass, over the layout found above. */
+	ctx.image = (u32 *)image_ptr;
+
+	if (build_image(&ctx) || ctx.offset_changed) {
+		bpf_jit_binary_free(header);
+		prog = orig_prog;
+		goto out_off;
+	}
+
+	/* And we're done. */
+	if (bpf_jit_enable > 1)
+		bpf_jit_dump(prog->len, image_size, 2, ctx.image);
+
+	bpf_flush_icache(header, ctx.image + ctx.idx);
+
+	bpf_jit_binary_lock_ro(header);
+	prog->bpf_func = (void *)ctx.image;
+	prog->jited = 1;
+	prog->jited_len = image_size;
+
+out_off:
+	kfree(ctx.offset);
+out:
+	if (tmp_blinded)
+		bpf_jit_prog_release_other(prog, prog == orig_prog ?
+					   tmp : orig_prog);
+	return prog;
+}
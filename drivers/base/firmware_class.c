@@ -31,6 +31,7 @@
 #include <linux/reboot.h>
 #include <linux/security.h>
 #include <linux/swait.h>
+#include <linux/initrd.h>
 
 #include <generated/utsrelease.h>
 
@@ -434,6 +435,7 @@ fw_get_filesystem_firmware(struct device *device, struct firmware_buf *buf)
 	if (!path)
 		return -ENOMEM;
 
+	wait_for_initramfs();
 	for (i = 0; i < ARRAY_SIZE(fw_path); i++) {
 		/* skip the unset customized path */
 		if (!fw_path[i][0])
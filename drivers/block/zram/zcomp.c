@@ -15,6 +15,8 @@
 #include <linux/sched.h>
 #include <linux/cpu.h>
 #include <linux/crypto.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 
 #include "zcomp.h"
 
@@ -114,6 +116,90 @@ ssize_t zcomp_available_show(const char *comp, char *buf)
 	return sz;
 }
 
+/* Minimum time spent benchmarking each compressor */
+#define ZCOMP_BENCH_NS	(50 * NSEC_PER_MSEC)
+
+static int zcomp_benchmark_one(const char *name, const void *src,
+		unsigned int nr_pages, void *dst, void *out, char *buf,
+		ssize_t *sz)
+{
+	struct crypto_comp *tfm;
+	u64 comp_ns = 0, decomp_ns = 0, stored = 0, bytes;
+	unsigned int loops = 0, i, len, dlen;
+	u64 start;
+	int ret = 0;
+
+	tfm = crypto_alloc_comp(name, 0, 0);
+	if (IS_ERR(tfm))
+		return PTR_ERR(tfm);
+
+	do {
+		for (i = 0; i < nr_pages; i++) {
+			len = PAGE_SIZE * 2;
+			start = ktime_get_ns();
+			ret = crypto_comp_compress(tfm, src + i * PAGE_SIZE,
+					PAGE_SIZE, dst, &len);
+			comp_ns += ktime_get_ns() - start;
+			if (ret)
+				goto out;
+
+			dlen = PAGE_SIZE;
+			start = ktime_get_ns();
+			ret = crypto_comp_decompress(tfm, dst, len, out, &dlen);
+			decomp_ns += ktime_get_ns() - start;
+			if (ret)
+				goto out;
+
+			/* Incompressible pages are stored as they are */
+			if (!loops)
+				stored += min_t(unsigned int, len, PAGE_SIZE);
+			cond_resched();
+		}
+		loops++;
+	} while (comp_ns + decomp_ns < ZCOMP_BENCH_NS);
+
+	bytes = (u64)loops * nr_pages * PAGE_SIZE;
+	*sz += scnprintf(buf + *sz, PAGE_SIZE - *sz,
+			"%-8s %8llu %8llu %5llu.%02llu\n", name,
+			div64_u64(bytes * 1000, comp_ns ?: 1),
+			div64_u64(bytes * 1000, decomp_ns ?: 1),
+			div64_u64((u64)nr_pages * PAGE_SIZE, stored),
+			div64_u64((u64)nr_pages * PAGE_SIZE * 100, stored) % 100);
+out:
+	crypto_free_comp(tfm);
+	return ret;
+}
+
+/*
+ * Benchmark the available compressors on nr_pages pages at src: one line
+ * per compressor with the compression and decompression speeds in MB/s
+ * and the compression ratio.
+ */
+ssize_t zcomp_benchmark_show(const void *src, unsigned int nr_pages,
+		char *buf)
+{
+	void *dst, *out;
+	ssize_t sz = 0;
+	int i;
+
+	dst = (void *)__get_free_pages(GFP_KERNEL, 1);
+	out = (void *)__get_free_page(GFP_KERNEL);
+	if (!dst || !out) {
+		sz = -ENOMEM;
+		goto out;
+	}
+
+	sz += scnprintf(buf + sz, PAGE_SIZE - sz,
+			"%-8s %8s %8s %8s\n", "algo", "comp", "decomp", "ratio");
+	for (i = 0; backends[i]; i++)
+		zcomp_benchmark_one(backends[i], src, nr_pages, dst, out,
+				    buf, &sz);
+out:
+	free_page((unsigned long)out);
+	free_pages((unsigned long)dst, 1);
+	return sz;
+}
+
 struct zcomp_strm *zcomp_stream_get(struct zcomp *comp)
 {
 	return *get_cpu_ptr(comp->stream);
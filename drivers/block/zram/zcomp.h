@@ -26,6 +26,8 @@ struct zcomp {
 int zcomp_cpu_up_prepare(unsigned int cpu, struct hlist_node *node);
 int zcomp_cpu_dead(unsigned int cpu, struct hlist_node *node);
 ssize_t zcomp_available_show(const char *comp, char *buf);
+ssize_t zcomp_benchmark_show(const void *src, unsigned int nr_pages,
+		char *buf);
 bool zcomp_available_algorithm(const char *comp);
 
 struct zcomp *zcomp_create(const char *comp);
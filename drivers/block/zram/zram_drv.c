@@ -32,6 +32,10 @@
 #include <linux/idr.h>
 #include <linux/sysfs.h>
 #include <linux/cpuhotplug.h>
+#include <linux/jhash.h>
+#include <linux/hash.h>
+#include <linux/workqueue.h>
+#include <linux/random.h>
 
 #include "zram_drv.h"
 
@@ -332,6 +336,150 @@ static ssize_t comp_algorithm_store(struct device *dev,
 	return len;
 }
 
+static void zram_slot_lock(struct zram *zram, u32 index);
+static void zram_slot_unlock(struct zram *zram, u32 index);
+static int zram_decompress_page(struct zram *zram, struct page *page,
+		u32 index);
+
+/* Pages compressed by each compressor of the benchmark */
+#define ZRAM_BENCH_PAGES	32
+
+/*
+ * Sample the compressed pages spread over the device, which is the data
+ * the compressors will really see. Same-filled pages aren't compressed,
+ * so they are skipped.
+ */
+static unsigned int zram_bench_sample(struct zram *zram, void *data)
+{
+	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
+	unsigned long step = max(nr_pages / ZRAM_BENCH_PAGES, 1UL);
+	unsigned int nr = 0;
+	struct page *page;
+	unsigned long index;
+	bool stored;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return 0;
+
+	for (index = 0; index < nr_pages && nr < ZRAM_BENCH_PAGES;
+	     index += step) {
+		zram_slot_lock(zram, index);
+		stored = zram_get_handle(zram, index) &&
+			 !zram_test_flag(zram, index, ZRAM_SAME);
+		zram_slot_unlock(zram, index);
+		if (!stored || zram_decompress_page(zram, page, index))
+			continue;
+
+		copy_page(data + nr++ * PAGE_SIZE, page_address(page));
+	}
+	__free_page(page);
+
+	return nr;
+}
+
+/* Without stored pages, a mix of text, tables, sparse and random data */
+static void zram_bench_fill(void *data)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < ZRAM_BENCH_PAGES; i++) {
+		void *p = data + i * PAGE_SIZE;
+		u32 *words = p;
+		size_t len = 0;
+
+		switch (i % 4) {
+		case 0:
+			for (j = 0; len < PAGE_SIZE - 1; j++)
+				len += scnprintf(p + len, PAGE_SIZE - len,
+						 "%u %s", j, linux_banner);
+			break;
+		case 1:
+			prandom_bytes(p, PAGE_SIZE);
+			for (j = 0; j < PAGE_SIZE / sizeof(u32); j++)
+				words[j] = (i << 20) + j * 64 + (words[j] & 7);
+			break;
+		case 2:
+			memset(p, 0, PAGE_SIZE / 2);
+			prandom_bytes(p + PAGE_SIZE / 2, PAGE_SIZE / 2);
+			break;
+		default:
+			prandom_bytes(p, PAGE_SIZE);
+			break;
+		}
+	}
+}
+
+static ssize_t comp_benchmark_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned int nr = 0;
+	ssize_t ret;
+	void *data;
+
+	data = vmalloc(ZRAM_BENCH_PAGES * PAGE_SIZE);
+	if (!data)
+		return -ENOMEM;
+
+	down_read(&zram->init_lock);
+	if (init_done(zram))
+		nr = zram_bench_sample(zram, data);
+	up_read(&zram->init_lock);
+
+	if (!nr) {
+		zram_bench_fill(data);
+		nr = ZRAM_BENCH_PAGES;
+	}
+
+	ret = zcomp_benchmark_show(data, nr, buf);
+	vfree(data);
+	return ret;
+}
+
+static ssize_t async_write_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", zram->async_write);
+}
+
+static ssize_t async_write_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	if (strtobool(buf, &val))
+		return -EINVAL;
+
+	WRITE_ONCE(zram->async_write, val);
+	return len;
+}
+
+static ssize_t dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", zram->dedup);
+}
+
+static ssize_t dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	if (strtobool(buf, &val))
+		return -EINVAL;
+
+	/* Pages stored meanwhile keep their own objects */
+	WRITE_ONCE(zram->dedup, val);
+	return len;
+}
+
 static ssize_t compact_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
@@ -388,14 +536,15 @@ static ssize_t mm_stat_show(struct device *dev,
 	max_used = atomic_long_read(&zram->stats.max_used_pages);
 
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu\n",
+			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu\n",
 			orig_size << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.compr_data_size),
 			mem_used << PAGE_SHIFT,
 			zram->limit_pages << PAGE_SHIFT,
 			max_used << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.same_pages),
-			pool_stats.pages_compacted);
+			pool_stats.pages_compacted,
+			(u64)atomic64_read(&zram->stats.dup_pages));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -432,6 +581,95 @@ static void zram_slot_unlock(struct zram *zram, u32 index)
 	bit_spin_unlock(ZRAM_ACCESS, &zram->table[index].value);
 }
 
+static struct hlist_head *zram_dedup_bucket(struct zram *zram, u32 checksum)
+{
+	return &zram->dedup_hash[hash_32(checksum, zram->dedup_hash_bits)];
+}
+
+/*
+ * Find a stored object with the same compressed data and take a reference
+ * to it. The compressor is deterministic, so the same compressed data
+ * means the same page content.
+ */
+static struct zram_dedup_entry *zram_dedup_get(struct zram *zram,
+		u32 checksum, const void *src, unsigned int len)
+{
+	struct zram_dedup_entry *entry;
+	bool match;
+	void *obj;
+
+	spin_lock(&zram->dedup_lock);
+	hlist_for_each_entry(entry, zram_dedup_bucket(zram, checksum), node) {
+		if (entry->checksum != checksum || entry->len != len)
+			continue;
+
+		obj = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+		match = !memcmp(obj, src, len);
+		zs_unmap_object(zram->mem_pool, entry->handle);
+		if (match) {
+			entry->refcount++;
+			spin_unlock(&zram->dedup_lock);
+			atomic64_inc(&zram->stats.dup_pages);
+			return entry;
+		}
+	}
+	spin_unlock(&zram->dedup_lock);
+
+	return NULL;
+}
+
+static struct zram_dedup_entry *zram_dedup_add(struct zram *zram,
+		u32 checksum, unsigned long handle, unsigned int len)
+{
+	struct zram_dedup_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO | __GFP_NOWARN);
+	if (!entry)
+		return NULL;
+
+	entry->handle = handle;
+	entry->len = len;
+	entry->checksum = checksum;
+	entry->refcount = 1;
+
+	spin_lock(&zram->dedup_lock);
+	hlist_add_head(&entry->node, zram_dedup_bucket(zram, checksum));
+	spin_unlock(&zram->dedup_lock);
+
+	return entry;
+}
+
+/* Drop a page's reference, the last one frees the object */
+static void zram_dedup_put(struct zram *zram, struct zram_dedup_entry *entry)
+{
+	bool last;
+
+	spin_lock(&zram->dedup_lock);
+	last = !--entry->refcount;
+	if (last)
+		hlist_del(&entry->node);
+	spin_unlock(&zram->dedup_lock);
+
+	if (!last) {
+		atomic64_dec(&zram->stats.dup_pages);
+		return;
+	}
+
+	zs_free(zram->mem_pool, entry->handle);
+	atomic64_sub(entry->len, &zram->stats.compr_data_size);
+	kfree(entry);
+}
+
+/* zsmalloc handle of the object of a compressed page */
+static unsigned long zram_get_obj_handle(struct zram *zram, u32 index)
+{
+	unsigned long handle = zram_get_handle(zram, index);
+
+	if (zram_test_flag(zram, index, ZRAM_DEDUP))
+		handle = ((struct zram_dedup_entry *)handle)->handle;
+	return handle;
+}
+
 static bool zram_same_page_read(struct zram *zram, u32 index,
 				struct page *page,
 				unsigned int offset, unsigned int len)
@@ -487,6 +725,7 @@ static void zram_meta_free(struct zram *zram, u64 disksize)
 		zram_free_page(zram, index);
 
 	zs_destroy_pool(zram->mem_pool);
+	vfree(zram->dedup_hash);
 	vfree(zram->table);
 }
 
@@ -499,8 +738,18 @@ static bool zram_meta_alloc(struct zram *zram, u64 disksize)
 	if (!zram->table)
 		return false;
 
+	/* One dedup bucket per 16 pages */
+	zram->dedup_hash_bits = ilog2(max_t(size_t, num_pages / 16, 256));
+	zram->dedup_hash = vzalloc(sizeof(struct hlist_head) <<
+				   zram->dedup_hash_bits);
+	if (!zram->dedup_hash) {
+		vfree(zram->table);
+		return false;
+	}
+
 	zram->mem_pool = zs_create_pool(zram->disk->disk_name);
 	if (!zram->mem_pool) {
+		vfree(zram->dedup_hash);
 		vfree(zram->table);
 		return false;
 	}
@@ -532,10 +781,14 @@ static void zram_free_page(struct zram *zram, size_t index)
 	if (!handle)
 		return;
 
-	zs_free(zram->mem_pool, handle);
-
-	atomic64_sub(zram_get_obj_size(zram, index),
-			&zram->stats.compr_data_size);
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		zram_clear_flag(zram, index, ZRAM_DEDUP);
+		zram_dedup_put(zram, (struct zram_dedup_entry *)handle);
+	} else {
+		zs_free(zram->mem_pool, handle);
+		atomic64_sub(zram_get_obj_size(zram, index),
+				&zram->stats.compr_data_size);
+	}
 	atomic64_dec(&zram->stats.pages_stored);
 
 	zram_set_handle(zram, index, 0);
@@ -553,7 +806,7 @@ static int zram_decompress_page(struct zram *zram, struct page *page, u32 index)
 		return 0;
 
 	zram_slot_lock(zram, index);
-	handle = zram_get_handle(zram, index);
+	handle = zram_get_obj_handle(zram, index);
 	size = zram_get_obj_size(zram, index);
 
 	src = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
@@ -613,9 +866,15 @@ out:
 	return ret;
 }
 
+/*
+ * With a non-NULL out_checksum, an object with the same compressed data
+ * is looked up first: it is returned in out_entry, with a reference
+ * taken, and no handle is allocated.
+ */
 static int zram_compress(struct zram *zram, struct zcomp_strm **zstrm,
 			struct page *page,
-			unsigned long *out_handle, unsigned int *out_comp_len)
+			unsigned long *out_handle, unsigned int *out_comp_len,
+			u32 *out_checksum, struct zram_dedup_entry **out_entry)
 {
 	int ret;
 	unsigned int comp_len;
@@ -638,6 +897,25 @@ compress_again:
 	if (unlikely(comp_len > max_zpage_size))
 		comp_len = PAGE_SIZE;
 
+	if (out_checksum) {
+		struct zram_dedup_entry *entry;
+
+		src = comp_len == PAGE_SIZE ? kmap_atomic(page) :
+					      (*zstrm)->buffer;
+		*out_checksum = jhash(src, comp_len, 0);
+		entry = zram_dedup_get(zram, *out_checksum, src, comp_len);
+		if (comp_len == PAGE_SIZE)
+			kunmap_atomic(src);
+
+		if (entry) {
+			if (handle)
+				zs_free(zram->mem_pool, handle);
+			*out_entry = entry;
+			*out_comp_len = comp_len;
+			return 0;
+		}
+	}
+
 	/*
 	 * handle allocation has 2 paths:
 	 * a) fast path is executed with preemption disabled (for
@@ -685,22 +963,31 @@ compress_again:
 static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index)
 {
 	int ret;
-	unsigned long handle;
+	unsigned long handle = 0;
 	unsigned int comp_len;
 	void *src, *dst;
 	struct zcomp_strm *zstrm;
 	struct page *page = bvec->bv_page;
+	struct zram_dedup_entry *entry = NULL;
+	bool dedup = READ_ONCE(zram->dedup);
+	u32 checksum;
 
 	if (zram_same_page_write(zram, index, page))
 		return 0;
 
 	zstrm = zcomp_stream_get(zram->comp);
-	ret = zram_compress(zram, &zstrm, page, &handle, &comp_len);
+	ret = zram_compress(zram, &zstrm, page, &handle, &comp_len,
+			    dedup ? &checksum : NULL, &entry);
 	if (ret) {
 		zcomp_stream_put(zram->comp);
 		return ret;
 	}
 
+	if (entry) {
+		zcomp_stream_put(zram->comp);
+		goto store;
+	}
+
 	dst = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
 
 	src = zstrm->buffer;
@@ -713,22 +1000,81 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index)
 	zcomp_stream_put(zram->comp);
 	zs_unmap_object(zram->mem_pool, handle);
 
+	atomic64_add(comp_len, &zram->stats.compr_data_size);
+	if (dedup)
+		entry = zram_dedup_add(zram, checksum, handle, comp_len);
+
+store:
 	/*
 	 * Free memory associated with this sector
 	 * before overwriting unused sectors.
 	 */
 	zram_slot_lock(zram, index);
 	zram_free_page(zram, index);
-	zram_set_handle(zram, index, handle);
+	if (entry) {
+		zram_set_handle(zram, index, (unsigned long)entry);
+		zram_set_flag(zram, index, ZRAM_DEDUP);
+	} else {
+		zram_set_handle(zram, index, handle);
+	}
 	zram_set_obj_size(zram, index, comp_len);
 	zram_slot_unlock(zram, index);
 
 	/* Update stats */
-	atomic64_add(comp_len, &zram->stats.compr_data_size);
 	atomic64_inc(&zram->stats.pages_stored);
 	return 0;
 }
 
+/*
+ * In async write mode, full page writes are compressed by unbound workers,
+ * so that a burst of writes such as a swapout from kswapd is spread over
+ * all CPUs instead of being compressed on the submitting one. The bio
+ * completes when its last page is stored.
+ */
+static struct workqueue_struct *zram_write_wq;
+
+struct zram_write_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct bio *bio;
+	struct bio_vec bvec;
+	u32 index;
+};
+
+static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
+			int offset, bool is_write);
+
+static void zram_write_work_fn(struct work_struct *work)
+{
+	struct zram_write_work *zw = container_of(work,
+					struct zram_write_work, work);
+
+	if (zram_bvec_rw(zw->zram, &zw->bvec, zw->index, 0, true) < 0)
+		zw->bio->bi_status = BLK_STS_IOERR;
+	bio_endio(zw->bio);
+	kfree(zw);
+}
+
+static bool zram_queue_write(struct zram *zram, struct bio *bio,
+			     struct bio_vec *bvec, u32 index)
+{
+	struct zram_write_work *zw;
+
+	zw = kmalloc(sizeof(*zw), GFP_NOIO | __GFP_NORETRY | __GFP_NOWARN);
+	if (!zw)
+		return false;
+
+	INIT_WORK(&zw->work, zram_write_work_fn);
+	zw->zram = zram;
+	zw->bio = bio;
+	zw->bvec = *bvec;
+	zw->index = index;
+
+	bio_inc_remaining(bio);
+	queue_work(zram_write_wq, &zw->work);
+	return true;
+}
+
 static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 				u32 index, int offset)
 {
@@ -845,6 +1191,7 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 	u32 index;
 	struct bio_vec bvec;
 	struct bvec_iter iter;
+	bool async = op_is_write(bio_op(bio)) && READ_ONCE(zram->async_write);
 
 	index = bio->bi_iter.bi_sector >> SECTORS_PER_PAGE_SHIFT;
 	offset = (bio->bi_iter.bi_sector &
@@ -867,9 +1214,12 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 		do {
 			bv.bv_len = min_t(unsigned int, PAGE_SIZE - offset,
 							unwritten);
-			if (zram_bvec_rw(zram, &bv, index, offset,
-					op_is_write(bio_op(bio))) < 0)
-				goto out;
+			if (!async || bv.bv_len != PAGE_SIZE ||
+			    !zram_queue_write(zram, bio, &bv, index)) {
+				if (zram_bvec_rw(zram, &bv, index, offset,
+						op_is_write(bio_op(bio))) < 0)
+					goto out;
+			}
 
 			bv.bv_offset += bv.bv_len;
 			unwritten -= bv.bv_len;
@@ -929,6 +1279,10 @@ static int zram_rw_page(struct block_device *bdev, sector_t sector,
 
 	zram = bdev->bd_disk->private_data;
 
+	/* Let async writes come as bios, which can complete later */
+	if (is_write && READ_ONCE(zram->async_write))
+		return -EOPNOTSUPP;
+
 	if (!valid_io_request(zram, sector, PAGE_SIZE)) {
 		atomic64_inc(&zram->stats.invalid_io);
 		err = -EINVAL;
@@ -980,6 +1334,7 @@ static void zram_reset_device(struct zram *zram)
 
 	up_write(&zram->init_lock);
 	/* I/O operation under all of CPU are done so let's free */
+	flush_workqueue(zram_write_wq);
 	zram_meta_free(zram, disksize);
 	memset(&zram->stats, 0, sizeof(zram->stats));
 	zcomp_destroy(comp);
@@ -1108,6 +1463,9 @@ static DEVICE_ATTR_WO(mem_limit);
 static DEVICE_ATTR_WO(mem_used_max);
 static DEVICE_ATTR_RW(max_comp_streams);
 static DEVICE_ATTR_RW(comp_algorithm);
+static DEVICE_ATTR_RO(comp_benchmark);
+static DEVICE_ATTR_RW(async_write);
+static DEVICE_ATTR_RW(dedup);
 
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
@@ -1118,6 +1476,9 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_mem_used_max.attr,
 	&dev_attr_max_comp_streams.attr,
 	&dev_attr_comp_algorithm.attr,
+	&dev_attr_comp_benchmark.attr,
+	&dev_attr_async_write.attr,
+	&dev_attr_dedup.attr,
 	&dev_attr_io_stat.attr,
 	&dev_attr_mm_stat.attr,
 	&dev_attr_debug_stat.attr,
@@ -1148,6 +1509,7 @@ static int zram_add(void)
 	device_id = ret;
 
 	init_rwsem(&zram->init_lock);
+	spin_lock_init(&zram->dedup_lock);
 
 	queue = blk_alloc_queue(GFP_KERNEL);
 	if (!queue) {
@@ -1354,21 +1716,30 @@ static void destroy_devices(void)
 	idr_destroy(&zram_index_idr);
 	unregister_blkdev(zram_major, "zram");
 	cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+	destroy_workqueue(zram_write_wq);
 }
 
 static int __init zram_init(void)
 {
 	int ret;
 
+	zram_write_wq = alloc_workqueue("zram_write",
+					WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	if (!zram_write_wq)
+		return -ENOMEM;
+
 	ret = cpuhp_setup_state_multi(CPUHP_ZCOMP_PREPARE, "block/zram:prepare",
 				      zcomp_cpu_up_prepare, zcomp_cpu_dead);
-	if (ret < 0)
+	if (ret < 0) {
+		destroy_workqueue(zram_write_wq);
 		return ret;
+	}
 
 	ret = class_register(&zram_control_class);
 	if (ret) {
 		pr_err("Unable to register zram-control class\n");
 		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+		destroy_workqueue(zram_write_wq);
 		return ret;
 	}
 
@@ -1377,6 +1748,7 @@ static int __init zram_init(void)
 		pr_err("Unable to get major number\n");
 		class_unregister(&zram_control_class);
 		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+		destroy_workqueue(zram_write_wq);
 		return -EBUSY;
 	}
 
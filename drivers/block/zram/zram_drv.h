@@ -63,6 +63,7 @@ enum zram_pageflags {
 	/* Page consists entirely of zeros */
 	ZRAM_SAME = ZRAM_FLAG_SHIFT,
 	ZRAM_ACCESS,	/* page is now accessed */
+	ZRAM_DEDUP,	/* handle points to a shared zram_dedup_entry */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -78,6 +79,18 @@ struct zram_table_entry {
 	unsigned long value;
 };
 
+/*
+ * Compressed object shared by the pages with the same content, found by
+ * the checksum of the compressed data.
+ */
+struct zram_dedup_entry {
+	struct hlist_node node;
+	unsigned long handle;
+	unsigned int len;
+	u32 checksum;
+	unsigned int refcount;	/* protected by zram->dedup_lock */
+};
+
 struct zram_stats {
 	atomic64_t compr_data_size;	/* compressed size of pages stored */
 	atomic64_t num_reads;	/* failed + successful */
@@ -90,6 +103,7 @@ struct zram_stats {
 	atomic64_t pages_stored;	/* no. of pages currently stored */
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
 	atomic64_t writestall;		/* no. of write slow paths */
+	atomic64_t dup_pages;		/* no. of pages sharing another's object */
 };
 
 struct zram {
@@ -115,5 +129,12 @@ struct zram {
 	 * zram is claimed so open request will be failed
 	 */
 	bool claim; /* Protected by bdev->bd_mutex */
+	/* Compress full page writes on the zram_write workqueue */
+	bool async_write;
+	/* Share the objects of pages with the same content */
+	bool dedup;
+	spinlock_t dedup_lock;
+	unsigned int dedup_hash_bits;
+	struct hlist_head *dedup_hash;
 };
 #endif
@@ -767,6 +767,22 @@ static struct crng_state **crng_node_pool __read_mostly;
 
 static void invalidate_batched_entropy(void);
 
+/*
+ * Every CPU keeps its own ChaCha20 key, taken from the crng above and
+ * replaced by fast key erasure on each use, so the common paths touch no
+ * shared lock. Bumping crng_generation (whenever the primary crng is
+ * (re)seeded) makes all CPUs fetch a new key on their next use; keys
+ * also expire after CRNG_RESEED_INTERVAL like the node crngs do.
+ */
+struct crng_pcpu {
+	__u32		key[CHACHA20_KEY_SIZE / sizeof(__u32)];
+	unsigned long	generation;
+	unsigned long	init_time;
+};
+
+static DEFINE_PER_CPU(struct crng_pcpu, crng_pcpu);
+static unsigned long crng_generation = 1;
+
 static void crng_initialize(struct crng_state *crng)
 {
 	int		i;
@@ -806,6 +822,7 @@ static int crng_fast_load(const char *cp, size_t len)
 	spin_unlock_irqrestore(&primary_crng.lock, flags);
 	if (crng_init_cnt >= CRNG_INIT_CNT_THRESH) {
 		invalidate_batched_entropy();
+		WRITE_ONCE(crng_generation, crng_generation + 1);
 		crng_init = 1;
 		wake_up_interruptible(&crng_init_wait);
 		pr_notice("random: fast init done\n");
@@ -841,6 +858,8 @@ static void crng_reseed(struct crng_state *crng, struct entropy_store *r)
 	}
 	memzero_explicit(&buf, sizeof(buf));
 	crng->init_time = jiffies;
+	if (crng == &primary_crng)
+		WRITE_ONCE(crng_generation, crng_generation + 1);
 	spin_unlock_irqrestore(&primary_crng.lock, flags);
 	if (crng == &primary_crng && crng_init < 2) {
 		invalidate_batched_entropy();
@@ -918,11 +937,78 @@ static void crng_backtrack_protect(__u8 tmp[CHACHA20_BLOCK_SIZE], int used)
 	_crng_backtrack_protect(crng, tmp, used);
 }
 
+/*
+ * Set up a private ChaCha20 state for one request from this CPU's key.
+ * The first block of the key stream overwrites the per-CPU key before
+ * interrupts are enabled again, and the rest of it keys the caller's
+ * state, so nothing handed out can be used to recover earlier output.
+ * Only used once the crng is ready; before that, per-CPU keys would just
+ * be copies of an unseeded state.
+ */
+static void crng_pcpu_state(__u32 state[16])
+{
+	union {
+		__u8	block[CHACHA20_BLOCK_SIZE];
+		__u32	key[CHACHA20_BLOCK_SIZE / sizeof(__u32)];
+	} buf;
+	struct crng_pcpu *pcpu;
+	unsigned long flags, gen;
+
+	local_irq_save(flags);
+	pcpu = this_cpu_ptr(&crng_pcpu);
+	gen = READ_ONCE(crng_generation);
+	if (unlikely(pcpu->generation != gen ||
+		     time_after(jiffies, pcpu->init_time +
+					 CRNG_RESEED_INTERVAL))) {
+		extract_crng(buf.block);
+		crng_backtrack_protect(buf.block, CHACHA20_KEY_SIZE);
+		memcpy(pcpu->key, buf.block, CHACHA20_KEY_SIZE);
+		pcpu->generation = gen;
+		pcpu->init_time = jiffies;
+	}
+
+	memcpy(&state[0], "expand 32-byte k", 16);
+	memcpy(&state[4], pcpu->key, CHACHA20_KEY_SIZE);
+	memset(&state[12], 0, 16);
+	chacha20_block(state, buf.block);
+	memcpy(pcpu->key, buf.block, CHACHA20_KEY_SIZE);
+	local_irq_restore(flags);
+
+	memcpy(&state[4], &buf.key[CHACHA20_KEY_SIZE / sizeof(__u32)],
+	       CHACHA20_KEY_SIZE);
+	memset(&state[12], 0, 16);
+	memzero_explicit(&buf, sizeof(buf));
+}
+
+static void crng_pcpu_fill(void *out, size_t nbytes)
+{
+	__u8 tmp[CHACHA20_BLOCK_SIZE];
+	__u32 state[16];
+
+	crng_pcpu_state(state);
+	while (nbytes >= CHACHA20_BLOCK_SIZE) {
+		chacha20_block(state, out);
+		out += CHACHA20_BLOCK_SIZE;
+		nbytes -= CHACHA20_BLOCK_SIZE;
+	}
+	if (nbytes > 0) {
+		chacha20_block(state, tmp);
+		memcpy(out, tmp, nbytes);
+		memzero_explicit(tmp, sizeof(tmp));
+	}
+	memzero_explicit(state, sizeof(state));
+}
+
 static ssize_t extract_crng_user(void __user *buf, size_t nbytes)
 {
 	ssize_t ret = 0, i = CHACHA20_BLOCK_SIZE;
 	__u8 tmp[CHACHA20_BLOCK_SIZE];
 	int large_request = (nbytes > 256);
+	bool pcpu = crng_ready();
+	__u32 state[16];
+
+	if (pcpu)
+		crng_pcpu_state(state);
 
 	while (nbytes) {
 		if (large_request && need_resched()) {
@@ -934,7 +1020,10 @@ static ssize_t extract_crng_user(void __user *buf, size_t nbytes)
 			schedule();
 		}
 
-		extract_crng(tmp);
+		if (pcpu)
+			chacha20_block(state, tmp);
+		else
+			extract_crng(tmp);
 		i = min_t(int, nbytes, CHACHA20_BLOCK_SIZE);
 		if (copy_to_user(buf, tmp, i)) {
 			ret = -EFAULT;
@@ -945,7 +1034,10 @@ static ssize_t extract_crng_user(void __user *buf, size_t nbytes)
 		buf += i;
 		ret += i;
 	}
-	crng_backtrack_protect(tmp, i);
+	if (pcpu)
+		memzero_explicit(state, sizeof(state));
+	else
+		crng_backtrack_protect(tmp, i);
 
 	/* Wipe data just written to memory */
 	memzero_explicit(tmp, sizeof(tmp));
@@ -1512,6 +1604,11 @@ static void _get_random_bytes(void *buf, int nbytes)
 
 	trace_get_random_bytes(nbytes, _RET_IP_);
 
+	if (crng_ready()) {
+		crng_pcpu_fill(buf, nbytes);
+		return;
+	}
+
 	while (nbytes >= CHACHA20_BLOCK_SIZE) {
 		extract_crng(buf);
 		buf += CHACHA20_BLOCK_SIZE;
@@ -2115,7 +2212,11 @@ u64 get_random_u64(void)
 	if (use_lock)
 		read_lock_irqsave(&batched_entropy_reset_lock, flags);
 	if (batch->position % ARRAY_SIZE(batch->entropy_u64) == 0) {
-		extract_crng((u8 *)batch->entropy_u64);
+		if (crng_ready())
+			crng_pcpu_fill(batch->entropy_u64,
+				       sizeof(batch->entropy_u64));
+		else
+			extract_crng((u8 *)batch->entropy_u64);
 		batch->position = 0;
 	}
 	ret = batch->entropy_u64[batch->position++];
@@ -2145,7 +2246,11 @@ u32 get_random_u32(void)
 	if (use_lock)
 		read_lock_irqsave(&batched_entropy_reset_lock, flags);
 	if (batch->position % ARRAY_SIZE(batch->entropy_u32) == 0) {
-		extract_crng((u8 *)batch->entropy_u32);
+		if (crng_ready())
+			crng_pcpu_fill(batch->entropy_u32,
+				       sizeof(batch->entropy_u32));
+		else
+			extract_crng((u8 *)batch->entropy_u32);
 		batch->position = 0;
 	}
 	ret = batch->entropy_u32[batch->position++];
@@ -17,6 +17,10 @@
 #include <linux/delay.h>
 #include <linux/timer_riscv.h>
 
+#include <asm/csr.h>
+#include <asm/hwcap.h>
+#include <asm/timex.h>
+
 /*
  * See <linux/timer_riscv.h> for the rationale behind pre-allocating per-cpu
  * timers on RISC-V systems.
@@ -34,20 +38,59 @@ struct clocksource *timer_riscv_source(int cpu)
 	return &per_cpu(clock_source, cpu);
 }
 
+/*
+ * With the Sstc extension the supervisor owns a timer compare CSR, so
+ * events can be programmed without the M-mode round trip of
+ * SBI_SET_TIMER.  Writing stimecmp also clears a pending timer interrupt.
+ */
+static int riscv_timer_next_event_sstc(unsigned long delta,
+				       struct clock_event_device *ce)
+{
+	u64 next = get_cycles64() + delta;
+
+#if __riscv_xlen == 32
+	/* Avoid a spurious interrupt while the two halves are inconsistent */
+	csr_write(CSR_STIMECMP, ULONG_MAX);
+	csr_write(CSR_STIMECMPH, next >> 32);
+	csr_write(CSR_STIMECMP, next & 0xffffffff);
+#else
+	csr_write(CSR_STIMECMP, next);
+#endif
+	return 0;
+}
+
+static int riscv_timer_stop_sstc(struct clock_event_device *ce)
+{
+#if __riscv_xlen == 32
+	csr_write(CSR_STIMECMPH, ULONG_MAX);
+#endif
+	csr_write(CSR_STIMECMP, ULONG_MAX);
+	return 0;
+}
+
 void timer_riscv_init(int cpu_id,
 		      unsigned long riscv_timebase,
 		      unsigned long long (*rdtime)(struct clocksource *),
-		      int (*next)(unsigned long, struct clock_event_device*))
+		      int (*next)(unsigned long, struct clock_event_device*),
+		      int (*stop)(struct clock_event_device *))
 {
 	struct clocksource *cs = &per_cpu(clock_source, cpu_id);
 	struct clock_event_device *ce = &per_cpu(clock_event, cpu_id);
 
+	/* The SBI-based next() and stop() stay as the fallback without Sstc */
+	if (riscv_isa_extension_available(RISCV_ISA_EXT_SSTC)) {
+		next = riscv_timer_next_event_sstc;
+		stop = riscv_timer_stop_sstc;
+	}
+
 	*cs = (struct clocksource) {
 		.name = "riscv_clocksource",
 		.rating = 300,
 		.read = rdtime,
-		.mask = CLOCKSOURCE_MASK(BITS_PER_LONG),
-		.flags = CLOCK_SOURCE_IS_CONTINUOUS,
+		/* rdtime() returns the whole 64-bit counter, even on rv32 */
+		.mask = CLOCKSOURCE_MASK(64),
+		.flags = CLOCK_SOURCE_IS_CONTINUOUS |
+			 CLOCK_SOURCE_ARCH_COUNTER,
 	};
 	clocksource_register_hz(cs, riscv_timebase);
 
@@ -58,7 +101,8 @@ void timer_riscv_init(int cpu_id,
 		.cpumask = cpumask_of(cpu_id),
 		.set_next_event = next,
 		.set_state_oneshot  = NULL,
-		.set_state_shutdown = NULL,
+		.set_state_shutdown = stop,
+		.set_state_oneshot_stopped = stop,
 	};
 	clockevents_config_and_register(ce, riscv_timebase, 100, 0x7fffffff);
 }
@@ -0,0 +1,158 @@
+/*
+ * CPU frequency scaling for RISC-V harts whose clocks the SBI firmware owns
+ *
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#define pr_fmt(fmt)	KBUILD_MODNAME ": " fmt
+
+#include <linux/cpu.h>
+#include <linux/cpufreq.h>
+#include <linux/cpumask.h>
+#include <linux/device.h>
+#include <linux/module.h>
+#include <linux/pm_opp.h>
+#include <linux/smp.h>
+
+#include <asm/sbi.h>
+
+/*
+ * The operating points come from the "operating-points-v2" table of each
+ * CPU node, with "opp-shared" marking the harts of one clock domain.  The
+ * firmware switches between them without sleeping, so fast switching is
+ * always possible and schedutil needs no kthread.  Any hart of a policy
+ * names its domain to the firmware.
+ */
+
+static unsigned int sbi_cpufreq_get_rate(unsigned int cpu)
+{
+	long khz = sbi_cpufreq_get(cpu);
+
+	return khz < 0 ? 0 : khz;
+}
+
+static int sbi_cpufreq_set_target(struct cpufreq_policy *policy,
+				  unsigned int index)
+{
+	if (sbi_cpufreq_set(policy->cpu, policy->freq_table[index].frequency))
+		return -EIO;
+
+	return 0;
+}
+
+static unsigned int sbi_cpufreq_fast_switch(struct cpufreq_policy *policy,
+					    unsigned int target_freq)
+{
+	unsigned int khz;
+	int index;
+
+	index = cpufreq_table_find_index_l(policy, target_freq);
+	khz = policy->freq_table[index].frequency;
+
+	if (sbi_cpufreq_set(policy->cpu, khz))
+		return CPUFREQ_ENTRY_INVALID;
+
+	return khz;
+}
+
+static int sbi_cpufreq_init(struct cpufreq_policy *policy)
+{
+	struct cpufreq_frequency_table *freq_table;
+	struct device *cpu_dev;
+	unsigned int latency;
+	int ret;
+
+	cpu_dev = get_cpu_device(policy->cpu);
+	if (!cpu_dev) {
+		pr_err("failed to get cpu%d device\n", policy->cpu);
+		return -ENODEV;
+	}
+
+	ret = dev_pm_opp_of_get_sharing_cpus(cpu_dev, policy->cpus);
+	if (ret) {
+		dev_err(cpu_dev, "no operating-points-v2 table: %d\n", ret);
+		return ret;
+	}
+
+	ret = dev_pm_opp_of_cpumask_add_table(policy->cpus);
+	if (ret) {
+		dev_err(cpu_dev, "failed to add OPP table: %d\n", ret);
+		return ret;
+	}
+
+	ret = dev_pm_opp_init_cpufreq_table(cpu_dev, &freq_table);
+	if (ret) {
+		dev_err(cpu_dev, "failed to init cpufreq table: %d\n", ret);
+		goto out_remove_table;
+	}
+
+	ret = cpufreq_table_validate_and_show(policy, freq_table);
+	if (ret) {
+		dev_err(cpu_dev, "invalid frequency table: %d\n", ret);
+		goto out_free_table;
+	}
+
+	latency = dev_pm_opp_get_max_transition_latency(cpu_dev);
+	policy->cpuinfo.transition_latency = latency ? latency : CPUFREQ_ETERNAL;
+	policy->suspend_freq = dev_pm_opp_get_suspend_opp_freq(cpu_dev) / 1000;
+	policy->fast_switch_possible = true;
+
+	return 0;
+
+out_free_table:
+	dev_pm_opp_free_cpufreq_table(cpu_dev, &freq_table);
+out_remove_table:
+	dev_pm_opp_of_cpumask_remove_table(policy->cpus);
+	return ret;
+}
+
+static int sbi_cpufreq_exit(struct cpufreq_policy *policy)
+{
+	struct device *cpu_dev = get_cpu_device(policy->cpu);
+
+	dev_pm_opp_free_cpufreq_table(cpu_dev, &policy->freq_table);
+	dev_pm_opp_of_cpumask_remove_table(policy->related_cpus);
+
+	return 0;
+}
+
+static struct cpufreq_driver sbi_cpufreq_driver = {
+	.name		= "riscv-sbi",
+	.flags		= CPUFREQ_STICKY | CPUFREQ_NEED_INITIAL_FREQ_CHECK,
+	.verify		= cpufreq_generic_frequency_table_verify,
+	.target_index	= sbi_cpufreq_set_target,
+	.fast_switch	= sbi_cpufreq_fast_switch,
+	.get		= sbi_cpufreq_get_rate,
+	.init		= sbi_cpufreq_init,
+	.exit		= sbi_cpufreq_exit,
+	.suspend	= cpufreq_generic_suspend,
+	.attr		= cpufreq_generic_attr,
+};
+
+static int __init sbi_cpufreq_module_init(void)
+{
+	/* Firmware that can't scale frequencies fails the call */
+	if (sbi_cpufreq_get(raw_smp_processor_id()) < 0)
+		return -ENODEV;
+
+	return cpufreq_register_driver(&sbi_cpufreq_driver);
+}
+module_init(sbi_cpufreq_module_init);
+
+static void __exit sbi_cpufreq_module_exit(void)
+{
+	cpufreq_unregister_driver(&sbi_cpufreq_driver);
+}
+module_exit(sbi_cpufreq_module_exit);
+
+MODULE_DESCRIPTION("SBI based CPU frequency scaling for RISC-V");
+MODULE_LICENSE("GPL v2");
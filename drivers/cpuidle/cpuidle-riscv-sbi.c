@@ -0,0 +1,254 @@
+/*
+ * RISC-V SBI CPU idle driver.
+ *
+ * Based on drivers/cpuidle/cpuidle-arm.c
+ *
+ * Copyright (C) 2014 ARM Ltd.
+ * Copyright (C) 2017 SiFive
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) "CPUidle riscv-sbi: " fmt
+
+#include <linux/cpuidle.h>
+#include <linux/cpumask.h>
+#include <linux/cpu_pm.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/of.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+
+#include <asm/processor.h>
+#include <asm/sbi.h>
+#include <asm/suspend.h>
+
+#include "dt_idle_states.h"
+
+/* SBI suspend type for each DT idle state, indexed from state 1 */
+static DEFINE_PER_CPU_READ_MOSTLY(u32 *, sbi_cpuidle_params);
+
+static int sbi_suspend_finisher(unsigned long type, unsigned long entry,
+				unsigned long context)
+{
+	return sbi_hart_suspend(type, entry, context) < 0 ? -EIO : 0;
+}
+
+static int sbi_suspend(u32 type)
+{
+	if (type & SBI_SUSPEND_TYPE_NON_RETENTIVE)
+		return cpu_suspend(type, sbi_suspend_finisher);
+
+	return sbi_hart_suspend(type, 0, 0) < 0 ? -EIO : 0;
+}
+
+/*
+ * sbi_enter_idle_state - Programs CPU to enter the specified state
+ *
+ * dev: cpuidle device
+ * drv: cpuidle driver
+ * idx: state index
+ *
+ * Called from the CPUidle framework to program the device to the
+ * specified target state selected by the governor.
+ */
+static int sbi_enter_idle_state(struct cpuidle_device *dev,
+				struct cpuidle_driver *drv, int idx)
+{
+	u32 type;
+	int ret;
+
+	if (!idx) {
+		wait_for_interrupt();
+		return idx;
+	}
+
+	type = __this_cpu_read(sbi_cpuidle_params)[idx - 1];
+
+	/* Retentive states keep everything, so there is nothing to notify */
+	if (!(type & SBI_SUSPEND_TYPE_NON_RETENTIVE))
+		return sbi_suspend(type) ? -1 : idx;
+
+	ret = cpu_pm_enter();
+	if (!ret) {
+		ret = sbi_suspend(type);
+		cpu_pm_exit();
+	}
+
+	return ret ? -1 : idx;
+}
+
+static struct cpuidle_driver sbi_idle_driver __initdata = {
+	.name = "riscv_sbi_idle",
+	.owner = THIS_MODULE,
+	/*
+	 * State at index 0 is a plain WFI, which every hart has.  Deeper
+	 * states come from the DT and are entered through the SBI.
+	 */
+	.states[0] = {
+		.enter                  = sbi_enter_idle_state,
+		.exit_latency           = 1,
+		.target_residency       = 1,
+		.power_usage		= UINT_MAX,
+		.name                   = "WFI",
+		.desc                   = "RISC-V WFI",
+	}
+};
+
+static const struct of_device_id sbi_idle_state_match[] __initconst = {
+	{ .compatible = "riscv,idle-state",
+	  .data = sbi_enter_idle_state },
+	{ },
+};
+
+/*
+ * Read the riscv,sbi-suspend-param of each idle state of a CPU, in the
+ * order dt_init_idle_driver() numbers them.
+ */
+static int __init sbi_cpuidle_init_params(unsigned int cpu, int count)
+{
+	struct device_node *cpu_node, *state_node;
+	u32 *params;
+	int i, n = 0, ret = 0;
+
+	cpu_node = of_get_cpu_node(cpu, NULL);
+	if (!cpu_node)
+		return -ENODEV;
+
+	params = kcalloc(count, sizeof(*params), GFP_KERNEL);
+	if (!params) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; n < count; i++) {
+		state_node = of_parse_phandle(cpu_node, "cpu-idle-states", i);
+		if (!state_node)
+			break;
+
+		if (!of_device_is_available(state_node)) {
+			of_node_put(state_node);
+			continue;
+		}
+
+		ret = of_property_read_u32(state_node, "riscv,sbi-suspend-param",
+					   &params[n]);
+		if (ret) {
+			pr_warn("%pOF: missing riscv,sbi-suspend-param\n",
+				state_node);
+			of_node_put(state_node);
+			goto out_free;
+		}
+
+		of_node_put(state_node);
+		n++;
+	}
+
+	if (n != count) {
+		ret = -ENODEV;
+		goto out_free;
+	}
+
+	per_cpu(sbi_cpuidle_params, cpu) = params;
+	goto out;
+
+out_free:
+	kfree(params);
+out:
+	of_node_put(cpu_node);
+	return ret;
+}
+
+/*
+ * sbi_idle_init
+ *
+ * Registers the riscv sbi specific cpuidle driver with the cpuidle
+ * framework. It relies on core code to parse the idle states
+ * and initialize them using driver data structures accordingly.
+ */
+static int __init sbi_idle_init(void)
+{
+	int cpu, ret;
+	struct cpuidle_driver *drv;
+	struct cpuidle_device *dev;
+
+	for_each_possible_cpu(cpu) {
+
+		drv = kmemdup(&sbi_idle_driver, sizeof(*drv), GFP_KERNEL);
+		if (!drv) {
+			ret = -ENOMEM;
+			goto out_fail;
+		}
+
+		drv->cpumask = (struct cpumask *)cpumask_of(cpu);
+
+		/*
+		 * Initialize idle states data, starting at index 1.  This
+		 * driver is DT only, if no DT idle states are detected (ret
+		 * == 0) let the driver initialization fail accordingly since
+		 * there is no reason to initialize the idle driver if only
+		 * wfi is supported.
+		 */
+		ret = dt_init_idle_driver(drv, sbi_idle_state_match, 1);
+		if (ret <= 0) {
+			ret = ret ? : -ENODEV;
+			kfree(drv);
+			goto out_fail;
+		}
+
+		ret = sbi_cpuidle_init_params(cpu, drv->state_count - 1);
+		if (ret) {
+			pr_err("CPU %d failed to parse SBI suspend types\n",
+			       cpu);
+			kfree(drv);
+			goto out_fail;
+		}
+
+		ret = cpuidle_register_driver(drv);
+		if (ret) {
+			pr_err("Failed to register cpuidle driver\n");
+			kfree(per_cpu(sbi_cpuidle_params, cpu));
+			kfree(drv);
+			goto out_fail;
+		}
+
+		dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+		if (!dev) {
+			pr_err("Failed to allocate cpuidle device\n");
+			ret = -ENOMEM;
+			goto out_unregister_drv;
+		}
+		dev->cpu = cpu;
+
+		ret = cpuidle_register_device(dev);
+		if (ret) {
+			pr_err("Failed to register cpuidle device for CPU %d\n",
+			       cpu);
+			kfree(dev);
+			goto out_unregister_drv;
+		}
+	}
+
+	return 0;
+
+out_unregister_drv:
+	cpuidle_unregister_driver(drv);
+	kfree(per_cpu(sbi_cpuidle_params, cpu));
+	kfree(drv);
+out_fail:
+	while (--cpu >= 0) {
+		dev = per_cpu(cpuidle_devices, cpu);
+		drv = cpuidle_get_cpu_driver(dev);
+		cpuidle_unregister_device(dev);
+		cpuidle_unregister_driver(drv);
+		kfree(per_cpu(sbi_cpuidle_params, cpu));
+		kfree(dev);
+		kfree(drv);
+	}
+
+	return ret;
+}
+device_initcall(sbi_idle_init);
@@ -22,6 +22,7 @@
 #include <linux/sched/stat.h>
 #include <linux/math64.h>
 #include <linux/cpu.h>
+#include <linux/interrupt.h>
 
 /*
  * Please note when changing the tuning values:
@@ -324,6 +325,13 @@ static int menu_select(struct cpuidle_driver *drv, struct cpuidle_device *dev)
 	expected_interval = get_typical_interval(data);
 	expected_interval = min(expected_interval, data->next_timer_us);
 
+	/*
+	 * A device interrupt predicted from the irq timings ends the idle
+	 * period before the next timer does.
+	 */
+	expected_interval = min_t(u64, expected_interval,
+				  ktime_to_us(tick_nohz_get_next_irq()));
+
 	if (CPUIDLE_DRIVER_STATE_START > 0) {
 		struct cpuidle_state *s = &drv->states[CPUIDLE_DRIVER_STATE_START];
 		unsigned int polling_threshold;
@@ -509,6 +517,9 @@ static struct cpuidle_governor menu_governor = {
  */
 static int __init init_menu(void)
 {
+#ifdef CONFIG_CPU_IDLE_GOV_MENU_IRQ_TIMINGS
+	irq_timings_enable();
+#endif
 	return cpuidle_register_governor(&menu_governor);
 }
 
@@ -0,0 +1,363 @@
+/*
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+/*
+ * Incoming MSI controller: each hart has an interrupt file, a page of
+ * MMIO that a device writes an interrupt identity to, and a set of CSRs
+ * through which the hart enables and claims those identities.  The file
+ * raises the hart's supervisor external interrupt.
+ *
+ * Every identity is enabled in every hart's file, so a vector is steered
+ * by nothing more than the address its message is written to.  A message
+ * already on its way to the old hart when a vector moves is still taken
+ * there, rather than lost.
+ */
+
+#define pr_fmt(fmt) "riscv-imsic: " fmt
+
+#include <linux/bitmap.h>
+#include <linux/cpu.h>
+#include <linux/cpuhotplug.h>
+#include <linux/interrupt.h>
+#include <linux/io.h>
+#include <linux/irq.h>
+#include <linux/irqchip.h>
+#include <linux/irqchip/chained_irq.h>
+#include <linux/irqdomain.h>
+#include <linux/msi.h>
+#include <linux/of.h>
+#include <linux/of_address.h>
+#include <linux/of_irq.h>
+#include <linux/pci.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#include <asm/csr.h>
+
+#define IMSIC_FILE_SIZE		0x1000
+#define IMSIC_SETEIPNUM_LE	0x00
+#define IMSIC_MAX_IDS		2048
+
+struct imsic_data {
+	struct irq_domain	*domain;	/* hwirq is the identity */
+	phys_addr_t		base;		/* context i's file is page i */
+	u32			nr_ids;		/* identities 1 to nr_ids - 1 */
+	unsigned long		*ids;		/* allocated identities */
+	unsigned int		*target;	/* hart each identity is sent to */
+	struct irq_desc		**desc;		/* per identity, NULL if free */
+	raw_spinlock_t		lock;		/* ids and target */
+};
+
+struct imsic_hart {
+	phys_addr_t		msi_addr;	/* 0 if the hart has no file */
+	int			parent_irq;
+};
+
+static struct imsic_data *imsic;
+static DEFINE_PER_CPU(struct imsic_hart, imsic_harts);
+
+static void imsic_csr_write(unsigned long reg, unsigned long val)
+{
+	csr_write(CSR_SISELECT, reg);
+	csr_write(CSR_SIREG, val);
+}
+
+static void imsic_handle_irq(struct irq_desc *desc)
+{
+	struct irq_chip *chip = irq_desc_get_chip(desc);
+	unsigned long id;
+
+	chained_irq_enter(chip, desc);
+
+	/* Reading and writing stopei claims the highest pending identity */
+	while ((id = csr_swap(CSR_STOPEI, 0) >> IMSIC_TOPEI_ID_SHIFT)) {
+		struct irq_desc *idesc =
+			likely(id < imsic->nr_ids) ? imsic->desc[id] : NULL;
+		if (likely(idesc))
+			generic_handle_irq_desc(idesc);
+		else
+			handle_bad_irq(desc);
+	}
+
+	chained_irq_exit(chip, desc);
+}
+
+/*
+ * Called on each hart as it comes up, with interrupts off: the file and
+ * the CSRs behind it can only be reached from the hart itself.
+ */
+static int imsic_starting_cpu(unsigned int cpu)
+{
+	struct imsic_hart *hart = this_cpu_ptr(&imsic_harts);
+	unsigned int i;
+
+	if (!hart->msi_addr)
+		return 0;
+
+	imsic_csr_write(IMSIC_EIDELIVERY, 0);
+	imsic_csr_write(IMSIC_EITHRESHOLD, 0);
+	/* On RV64 only the even-numbered eie registers exist */
+	for (i = 0; i < DIV_ROUND_UP(imsic->nr_ids, BITS_PER_LONG); i++)
+		imsic_csr_write(IMSIC_EIE0 + i * (BITS_PER_LONG / 32), ~0UL);
+	imsic_csr_write(IMSIC_EIDELIVERY, 1);
+
+	/* The cpu-intc can only unmask SEIE on the hart it is running on */
+	irq_set_chained_handler_and_data(hart->parent_irq, imsic_handle_irq,
+					 NULL);
+	return 0;
+}
+
+/* Identities are enabled everywhere; masking is up to the device */
+static void imsic_irq_mask(struct irq_data *d) { }
+static void imsic_irq_unmask(struct irq_data *d) { }
+
+static void imsic_irq_compose_msi_msg(struct irq_data *d, struct msi_msg *msg)
+{
+	struct imsic_hart *hart = per_cpu_ptr(&imsic_harts,
+					      imsic->target[d->hwirq]);
+	phys_addr_t addr = hart->msi_addr + IMSIC_SETEIPNUM_LE;
+
+	msg->address_hi = upper_32_bits(addr);
+	msg->address_lo = lower_32_bits(addr);
+	msg->data = d->hwirq;
+}
+
+#ifdef CONFIG_SMP
+static int imsic_irq_set_affinity(struct irq_data *d,
+				  const struct cpumask *mask, bool force)
+{
+	unsigned long flags;
+	unsigned int cpu;
+
+	for_each_cpu(cpu, mask)
+		if (per_cpu(imsic_harts, cpu).msi_addr &&
+		    (force || cpu_online(cpu)))
+			break;
+	if (cpu >= nr_cpu_ids)
+		return -EINVAL;
+
+	raw_spin_lock_irqsave(&imsic->lock, flags);
+	imsic->target[d->hwirq] = cpu;
+	raw_spin_unlock_irqrestore(&imsic->lock, flags);
+
+	/* msi_domain_set_affinity() then rewrites the device's message */
+	irq_data_update_effective_affinity(d, cpumask_of(cpu));
+	return IRQ_SET_MASK_OK;
+}
+#endif
+
+static struct irq_chip imsic_irq_chip = {
+	.name			= "RISC-V IMSIC",
+	.irq_mask		= imsic_irq_mask,
+	.irq_unmask		= imsic_irq_unmask,
+	.irq_compose_msi_msg	= imsic_irq_compose_msi_msg,
+#ifdef CONFIG_SMP
+	.irq_set_affinity	= imsic_irq_set_affinity,
+#endif
+};
+
+static int imsic_domain_alloc(struct irq_domain *domain, unsigned int virq,
+			      unsigned int nr_irqs, void *args)
+{
+	unsigned int cpu = cpumask_first(cpu_online_mask);
+	unsigned long flags;
+	int hwirq, i;
+
+	/* Multi-MSI needs a naturally aligned, power of two block */
+	raw_spin_lock_irqsave(&imsic->lock, flags);
+	hwirq = bitmap_find_free_region(imsic->ids, imsic->nr_ids,
+					get_count_order(nr_irqs));
+	if (hwirq >= 0)
+		for (i = 0; i < nr_irqs; i++)
+			imsic->target[hwirq + i] = cpu;
+	raw_spin_unlock_irqrestore(&imsic->lock, flags);
+	if (hwirq < 0)
+		return -ENOSPC;
+
+	for (i = 0; i < nr_irqs; i++) {
+		irq_domain_set_info(domain, virq + i, hwirq + i,
+				    &imsic_irq_chip, imsic, handle_simple_irq,
+				    NULL, NULL);
+		irq_data_update_effective_affinity(irq_get_irq_data(virq + i),
+						   cpumask_of(cpu));
+		imsic->desc[hwirq + i] = irq_to_desc(virq + i);
+	}
+	return 0;
+}
+
+static void imsic_domain_free(struct irq_domain *domain, unsigned int virq,
+			      unsigned int nr_irqs)
+{
+	struct irq_data *d = irq_domain_get_irq_data(domain, virq);
+	unsigned long flags;
+	int i;
+
+	for (i = 0; i < nr_irqs; i++)
+		imsic->desc[d->hwirq + i] = NULL;
+
+	raw_spin_lock_irqsave(&imsic->lock, flags);
+	bitmap_release_region(imsic->ids, d->hwirq, get_count_order(nr_irqs));
+	raw_spin_unlock_irqrestore(&imsic->lock, flags);
+
+	for (i = 0; i < nr_irqs; i++)
+		irq_domain_reset_irq_data(irq_domain_get_irq_data(domain,
+								  virq + i));
+}
+
+static const struct irq_domain_ops imsic_domain_ops = {
+	.alloc	= imsic_domain_alloc,
+	.free	= imsic_domain_free,
+};
+
+#ifdef CONFIG_PCI_MSI
+static void imsic_pci_msi_mask(struct irq_data *d)
+{
+	pci_msi_mask_irq(d);
+	irq_chip_mask_parent(d);
+}
+
+static void imsic_pci_msi_unmask(struct irq_data *d)
+{
+	pci_msi_unmask_irq(d);
+	irq_chip_unmask_parent(d);
+}
+
+static struct irq_chip imsic_pci_msi_chip = {
+	.name		= "PCI-MSI",
+	.irq_mask	= imsic_pci_msi_mask,
+	.irq_unmask	= imsic_pci_msi_unmask,
+};
+
+static struct msi_domain_info imsic_pci_msi_info = {
+	.flags	= MSI_FLAG_USE_DEF_DOM_OPS | MSI_FLAG_USE_DEF_CHIP_OPS |
+		  MSI_FLAG_MULTI_PCI_MSI | MSI_FLAG_PCI_MSIX,
+	.chip	= &imsic_pci_msi_chip,
+};
+
+static int __init imsic_pci_init(struct device_node *node)
+{
+	struct irq_domain *pci_domain;
+
+	pci_domain = pci_msi_create_irq_domain(of_node_to_fwnode(node),
+					       &imsic_pci_msi_info,
+					       imsic->domain);
+	if (!pci_domain)
+		return -ENOMEM;
+	return 0;
+}
+#else
+static int __init imsic_pci_init(struct device_node *node)
+{
+	return 0;
+}
+#endif
+
+static int __init imsic_init(struct device_node *node,
+			     struct device_node *parent)
+{
+	struct resource res;
+	int i, nr_contexts, ok = 0, ret;
+
+	if (imsic) {
+		pr_warn("%s: only one set of interrupt files is supported\n",
+			node->full_name);
+		return -EBUSY;
+	}
+
+	if (of_address_to_resource(node, 0, &res))
+		return -EINVAL;
+	nr_contexts = of_irq_count(node);
+	if (WARN_ON(!nr_contexts) ||
+	    WARN_ON(resource_size(&res) < nr_contexts * IMSIC_FILE_SIZE))
+		return -EINVAL;
+
+	imsic = kzalloc(sizeof(*imsic), GFP_KERNEL);
+	if (!imsic)
+		return -ENOMEM;
+	imsic->base = res.start;
+	raw_spin_lock_init(&imsic->lock);
+
+	if (of_property_read_u32(node, "riscv,num-ids", &imsic->nr_ids) ||
+	    imsic->nr_ids < 2 || imsic->nr_ids > IMSIC_MAX_IDS) {
+		ret = -EINVAL;
+		goto out_free;
+	}
+
+	ret = -ENOMEM;
+	imsic->ids = kcalloc(BITS_TO_LONGS(imsic->nr_ids), sizeof(long),
+			     GFP_KERNEL);
+	imsic->target = kcalloc(imsic->nr_ids, sizeof(*imsic->target),
+				GFP_KERNEL);
+	imsic->desc = kcalloc(imsic->nr_ids, sizeof(*imsic->desc), GFP_KERNEL);
+	if (!imsic->ids || !imsic->target || !imsic->desc)
+		goto out_free;
+	/* Identity 0 means "none pending" */
+	__set_bit(0, imsic->ids);
+
+	for (i = 0; i < nr_contexts; i++) {
+		struct of_phandle_args args;
+		int hart;
+
+		if (of_irq_parse_one(node, i, &args))
+			continue;
+		if (!of_device_is_compatible(args.np, "riscv,cpu-intc") ||
+		    !args.np->parent)
+			continue;
+		hart = riscv_of_processor_hart(args.np->parent);
+		if (hart < 0)
+			continue;
+
+		per_cpu(imsic_harts, hart).parent_irq =
+			irq_create_of_mapping(&args);
+		if (!per_cpu(imsic_harts, hart).parent_irq)
+			continue;
+		per_cpu(imsic_harts, hart).msi_addr =
+			imsic->base + i * IMSIC_FILE_SIZE;
+		++ok;
+	}
+	if (WARN_ON(!ok)) {
+		ret = -ENODEV;
+		goto out_free;
+	}
+
+	imsic->domain = irq_domain_add_tree(node, &imsic_domain_ops, imsic);
+	if (!imsic->domain)
+		goto out_free;
+	irq_domain_update_bus_token(imsic->domain, DOMAIN_BUS_NEXUS);
+
+	ret = imsic_pci_init(node);
+	if (ret)
+		goto out_domain;
+
+	/* Secondary harts set up their own file as they come online */
+	imsic_starting_cpu(smp_processor_id());
+	cpuhp_setup_state_nocalls(CPUHP_AP_IRQ_RISCV_IMSIC_STARTING,
+				  "irqchip/riscv/imsic:starting",
+				  imsic_starting_cpu, NULL);
+
+	pr_info("%s: %u identities on %d/%d harts\n", node->full_name,
+		imsic->nr_ids - 1, ok, nr_contexts);
+	return 0;
+
+out_domain:
+	irq_domain_remove(imsic->domain);
+out_free:
+	kfree(imsic->desc);
+	kfree(imsic->target);
+	kfree(imsic->ids);
+	kfree(imsic);
+	imsic = NULL;
+	return ret;
+}
+
+IRQCHIP_DECLARE(riscv_imsic, "riscv,imsics", imsic_init);
@@ -24,11 +24,15 @@
 #include <asm/sbi.h>
 #include <asm/smp.h>
 
+#define RISCV_IRQ_NR	(8*sizeof(uintptr_t))
+
 struct riscv_irq_data {
 	struct irq_chip		chip;
 	struct irq_domain	*domain;
 	int			hart;
 	char			name[20];
+	/* Filled in as causes are mapped, so do_IRQ skips the domain lookup */
+	struct irq_desc		*desc[RISCV_IRQ_NR];
 };
 DEFINE_PER_CPU(struct riscv_irq_data, riscv_irq_data);
 
@@ -50,10 +54,11 @@ static void riscv_software_interrupt(void)
 #endif
 }
 
-asmlinkage void __irq_entry do_IRQ(unsigned int cause, struct pt_regs *regs)
+static __always_inline void __do_IRQ(unsigned int cause,
+				     struct pt_regs *regs)
 {
 	struct pt_regs *old_regs = set_irq_regs(regs);
-	struct irq_domain *domain;
+	struct irq_desc *desc;
 
 	irq_enter();
 
@@ -70,8 +75,13 @@ asmlinkage void __irq_entry do_IRQ(unsigned int cause, struct pt_regs *regs)
 		riscv_software_interrupt();
 		break;
 	default:
-		domain = per_cpu(riscv_irq_data, smp_processor_id()).domain;
-		generic_handle_irq(irq_find_mapping(domain, cause));
+		desc = likely(cause < RISCV_IRQ_NR) ?
+			this_cpu_read(riscv_irq_data.desc[cause]) : NULL;
+		if (likely(desc))
+			generic_handle_irq_desc(desc);
+		else
+			pr_warn_ratelimited("unexpected interrupt cause %u\n",
+					    cause);
 		break;
 	}
 
@@ -79,6 +89,30 @@ asmlinkage void __irq_entry do_IRQ(unsigned int cause, struct pt_regs *regs)
 	set_irq_regs(old_regs);
 }
 
+asmlinkage void __irq_entry do_IRQ(unsigned int cause, struct pt_regs *regs)
+{
+	__do_IRQ(cause, regs);
+}
+
+/*
+ * With stvec in vectored mode the entry code already knows the cause of
+ * these, so each gets its own copy of the dispatch with the switch folded.
+ */
+asmlinkage void __irq_entry do_IRQ_software(struct pt_regs *regs)
+{
+	__do_IRQ(INTERRUPT_CAUSE_SOFTWARE, regs);
+}
+
+asmlinkage void __irq_entry do_IRQ_timer(struct pt_regs *regs)
+{
+	__do_IRQ(INTERRUPT_CAUSE_TIMER, regs);
+}
+
+asmlinkage void __irq_entry do_IRQ_external(struct pt_regs *regs)
+{
+	__do_IRQ(INTERRUPT_CAUSE_EXTERNAL, regs);
+}
+
 static int riscv_irqdomain_map(struct irq_domain *d, unsigned int irq,
 			       irq_hw_number_t hwirq)
 {
@@ -88,12 +122,24 @@ static int riscv_irqdomain_map(struct irq_domain *d, unsigned int irq,
 	irq_set_chip_data(irq, data);
 	irq_set_noprobe(irq);
 	irq_set_affinity(irq, cpumask_of(data->hart));
+	if (hwirq < RISCV_IRQ_NR)
+		data->desc[hwirq] = irq_to_desc(irq);
 
 	return 0;
 }
 
+static void riscv_irqdomain_unmap(struct irq_domain *d, unsigned int irq)
+{
+	struct riscv_irq_data *data = d->host_data;
+	irq_hw_number_t hwirq = irq_get_irq_data(irq)->hwirq;
+
+	if (hwirq < RISCV_IRQ_NR)
+		data->desc[hwirq] = NULL;
+}
+
 static const struct irq_domain_ops riscv_irqdomain_ops = {
 	.map	= riscv_irqdomain_map,
+	.unmap	= riscv_irqdomain_unmap,
 	.xlate	= irq_domain_xlate_onecell,
 };
 
@@ -194,13 +240,13 @@ static int riscv_intc_init(struct device_node *node, struct device_node *parent)
 	data->chip.irq_disable = riscv_irq_disable;
 	data->domain = irq_domain_add_linear(
 		node,
-		8*sizeof(uintptr_t),
+		RISCV_IRQ_NR,
 		&riscv_irqdomain_ops,
 		data);
 	if (!data->domain)
 		goto error_add_linear;
 	pr_info("%s: %d local interrupts mapped\n",
-	        data->name, 8*(int)sizeof(uintptr_t));
+	        data->name, (int)RISCV_IRQ_NR);
 	return 0;
 
 error_add_linear:
@@ -12,17 +12,23 @@
  *   more details.
  */
 
+#include <linux/cpumask.h>
 #include <linux/interrupt.h>
 #include <linux/io.h>
 #include <linux/irq.h>
 #include <linux/irqchip.h>
 #include <linux/irqchip/chained_irq.h>
 #include <linux/irqdomain.h>
+#include <linux/kobject.h>
+#include <linux/list.h>
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/of_address.h>
 #include <linux/of_irq.h>
 #include <linux/platform_device.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/sysfs.h>
 
 #define MAX_DEVICES	1024 // 0 is reserved
 #define MAX_CONTEXTS	15872
@@ -57,14 +63,26 @@ struct plic_data {
 	void __iomem		*reg;
 	int			handlers;
 	struct plic_handler	*handler;
+	struct cpumask		harts;	// harts with a context to steer to
+	u32			max_priority;
+	u32			*priority; // per source, written when enabled
+	struct irq_desc		**desc;	// per source, NULL until mapped
+	raw_spinlock_t		lock;	// priority[] and threshold changes
+	struct kobject		*kobj;
+	struct list_head	list;
 	char			name[30];
 };
 
 struct plic_handler {
 	struct plic_hart_context	*context;
 	struct plic_data		*data;
+	int				cpu;	// -1 unless a hart's context
+	u32				threshold;
 };
 
+// PLICs probed before sysfs was up, registered by plic_sysfs_init()
+static LIST_HEAD(plic_list);
+
 static void plic_disable(struct plic_data *data, int i, int hwirq)
 {
 	struct plic_enable_context *enable = PLIC_ENABLE_CONTEXT(data, i);
@@ -77,32 +95,102 @@ static void plic_enable(struct plic_data *data, int i, int hwirq)
 	atomic_or((1 << (hwirq % 32)), &enable->mask[hwirq / 32]);
 }
 
+static bool plic_enabled(struct plic_data *data, int i, int hwirq)
+{
+	struct plic_enable_context *enable = PLIC_ENABLE_CONTEXT(data, i);
+	return atomic_read(&enable->mask[hwirq / 32]) & (1 << (hwirq % 32));
+}
+
+// Does an interrupt routed to cpu (-1 for nowhere) belong in this context?
+static bool plic_routed(struct plic_handler *handler, int cpu)
+{
+	return cpu >= 0 && (handler->cpu < 0 || handler->cpu == cpu);
+}
+
+// Enable hwirq only in the contexts of one hart, or in none if cpu < 0.
+// The new hart is enabled before the old one is disabled, so an edge
+// arriving meanwhile is claimed by one of them rather than lost.
+static void plic_route(struct plic_data *data, int hwirq, int cpu)
+{
+	int i;
+	for (i = 0; i < data->handlers; ++i)
+		if (data->handler[i].context && plic_routed(&data->handler[i], cpu))
+			plic_enable(data, i, hwirq);
+	for (i = 0; i < data->handlers; ++i)
+		if (data->handler[i].context && !plic_routed(&data->handler[i], cpu))
+			plic_disable(data, i, hwirq);
+}
+
+// A context only takes sources with a priority above its threshold
+static bool plic_hart_accepts(struct plic_data *data, int cpu, u32 prio)
+{
+	int i;
+	for (i = 0; i < data->handlers; ++i)
+		if (data->handler[i].context && data->handler[i].cpu == cpu &&
+		    prio > data->handler[i].threshold)
+			return true;
+	return false;
+}
+
+// Pick the online hart in mask to deliver hwirq to, or -1 if there is none
+static int plic_target(struct plic_data *data, int hwirq,
+		       const struct cpumask *mask, bool force)
+{
+	int cpu;
+	for_each_cpu(cpu, mask)
+		if (cpumask_test_cpu(cpu, &data->harts) &&
+		    (force || cpu_online(cpu)) &&
+		    plic_hart_accepts(data, cpu, data->priority[hwirq]))
+			return cpu;
+	return -1;
+}
+
 // There is no need to mask/unmask PLIC interrupts
 // They are "masked" by reading claim and "unmasked" when writing it back.
 static void plic_irq_mask(struct irq_data *d) { }
 static void plic_irq_unmask(struct irq_data *d) { }
 
+// Only one hart is enabled for each interrupt, so the harts don't all
+// take the external interrupt and race to claim it.
 static void plic_irq_enable(struct irq_data *d)
 {
 	struct plic_data *data = irq_data_get_irq_chip_data(d);
 	struct plic_priority *priority = PLIC_PRIORITY(data);
-	int i;
-	iowrite32(1, &priority->prio[d->hwirq]);
-	for (i = 0; i < data->handlers; ++i)
-		if (data->handler[i].context)
-			plic_enable(data, i, d->hwirq);
+	int cpu = plic_target(data, d->hwirq, irq_data_get_affinity_mask(d), false);
+	if (cpu < 0)
+		cpu = plic_target(data, d->hwirq, cpu_online_mask, false);
+	raw_spin_lock(&data->lock);
+	iowrite32(data->priority[d->hwirq], &priority->prio[d->hwirq]);
+	raw_spin_unlock(&data->lock);
+	plic_route(data, d->hwirq, cpu);
+	if (cpu >= 0)
+		irq_data_update_effective_affinity(d, cpumask_of(cpu));
 }
 
 static void plic_irq_disable(struct irq_data *d)
 {
 	struct plic_data *data = irq_data_get_irq_chip_data(d);
 	struct plic_priority *priority = PLIC_PRIORITY(data);
-	int i;
+	raw_spin_lock(&data->lock);
 	iowrite32(0, &priority->prio[d->hwirq]);
-	for (i = 0; i < data->handlers; ++i)
-		if (data->handler[i].context)
-			plic_disable(data, i, d->hwirq);
+	raw_spin_unlock(&data->lock);
+	plic_route(data, d->hwirq, -1);
+}
+
+#ifdef CONFIG_SMP
+static int plic_irq_set_affinity(struct irq_data *d,
+				 const struct cpumask *mask, bool force)
+{
+	struct plic_data *data = irq_data_get_irq_chip_data(d);
+	int cpu = plic_target(data, d->hwirq, mask, force);
+	if (cpu < 0)
+		return -EINVAL;
+	if (!irqd_irq_disabled(d))
+		plic_route(data, d->hwirq, cpu);
+	irq_data_update_effective_affinity(d, cpumask_of(cpu));
+	return IRQ_SET_MASK_OK_DONE;
 }
+#endif
 
 static int plic_irqdomain_map(struct irq_domain *d, unsigned int irq, irq_hw_number_t hwirq)
 {
@@ -111,44 +199,234 @@ static int plic_irqdomain_map(struct irq_domain *d, unsigned int irq, irq_hw_num
         irq_set_chip_and_handler(irq, &data->chip, handle_simple_irq);
         irq_set_chip_data(irq, data);
         irq_set_noprobe(irq);
+        data->desc[hwirq] = irq_to_desc(irq);
 
         return 0;
 }
 
+static void plic_irqdomain_unmap(struct irq_domain *d, unsigned int irq)
+{
+	struct plic_data *data = d->host_data;
+
+	data->desc[irq_get_irq_data(irq)->hwirq] = NULL;
+}
+
+// Priorities are WARL: clamp to what the PLIC implements, 0 is "never"
+static u32 plic_clamp_priority(struct plic_data *data, u32 prio)
+{
+	return clamp_t(u32, prio, 1, data->max_priority);
+}
+
+// Sources are <hwirq> or <hwirq priority>; the priority defaults to 1
+static int plic_irqdomain_xlate(struct irq_domain *d, struct device_node *node,
+				const u32 *intspec, unsigned int intsize,
+				unsigned long *out_hwirq, unsigned int *out_type)
+{
+	struct plic_data *data = d->host_data;
+
+	if (WARN_ON(intsize < 1)) return -EINVAL;
+	if (intspec[0] == 0 || intspec[0] > data->ndev) return -EINVAL;
+
+	*out_hwirq = intspec[0];
+	*out_type = IRQ_TYPE_NONE;
+	if (intsize >= 2)
+		data->priority[intspec[0]] = plic_clamp_priority(data, intspec[1]);
+	return 0;
+}
+
 static const struct irq_domain_ops plic_irqdomain_ops = {
 	.map	= plic_irqdomain_map,
-	.xlate	= irq_domain_xlate_onecell,
+	.unmap	= plic_irqdomain_unmap,
+	.xlate	= plic_irqdomain_xlate,
 };
 
+// Complete an interrupt that has been routed away from this context
+// since it was claimed.  The PLIC ignores a completion from a context the
+// source isn't enabled in, so enable it here for the write, under the
+// descriptor lock so that a concurrent plic_route() isn't undone.
+static void plic_complete_moved(struct plic_handler *handler, int ctx,
+				struct irq_desc *desc, u32 hwirq)
+{
+	struct plic_data *data = handler->data;
+	struct irq_data *d = &desc->irq_data;
+	int cpu;
+
+	raw_spin_lock(&desc->lock);
+	cpu = irqd_irq_disabled(d) ? -1 :
+		plic_target(data, hwirq,
+			    irq_data_get_effective_affinity_mask(d), false);
+	plic_enable(data, ctx, hwirq);
+	iowrite32(hwirq, &handler->context->claim);
+	if (!plic_routed(handler, cpu))
+		plic_disable(data, ctx, hwirq);
+	raw_spin_unlock(&desc->lock);
+}
+
+// Drain every pending source in one pass: each claim returns the highest
+// priority source pending for this context, and 0 once there are none.
 static void plic_chained_handle_irq(struct irq_desc *desc)
 {
         struct plic_handler *handler = irq_desc_get_handler_data(desc);
 	struct irq_chip *chip = irq_desc_get_chip(desc);
-	struct irq_domain *domain = handler->data->domain;
+	struct plic_data *data = handler->data;
+	int ctx = handler - data->handler;
 	u32 what;
 
 	chained_irq_enter(chip, desc);
 
 	while ((what = ioread32(&handler->context->claim))) {
-		int irq = irq_find_mapping(domain, what);
-		if (irq > 0) {
-			generic_handle_irq(irq);
+		struct irq_desc *idesc =
+			likely(what <= data->ndev) ? data->desc[what] : NULL;
+		if (likely(idesc)) {
+			generic_handle_irq_desc(idesc);
 		} else {
 			handle_bad_irq(desc);
 		}
-		iowrite32(what, &handler->context->claim);
+		// The PLIC ignores a completion from a context the source
+		// isn't enabled in, which happens when the interrupt was moved
+		// to another hart while this one handled it.
+		if (unlikely(idesc && !plic_enabled(data, ctx, what)))
+			plic_complete_moved(handler, ctx, idesc, what);
+		else
+			iowrite32(what, &handler->context->claim);
 	}
 
 	chained_irq_exit(chip, desc);
 }
 
-// TODO: add a /sys interface to set priority + per-hart enables for steering
+// Reroute a source after a priority or threshold change made its hart
+// stop taking it; irq_set_affinity() takes the descriptor lock.
+static void plic_refresh_affinity(struct plic_data *data, int hwirq)
+{
+	unsigned int irq = irq_find_mapping(data->domain, hwirq);
+	if (irq)
+		irq_set_affinity(irq, irq_get_affinity_mask(irq));
+}
+
+static struct plic_data *plic_from_kobj(struct kobject *kobj)
+{
+	struct plic_data *data;
+	list_for_each_entry(data, &plic_list, list)
+		if (data->kobj == kobj)
+			return data;
+	BUG();
+}
+
+// /sys/kernel/plic/<name>/priority: one "hwirq priority" line per mapped
+// source; write "hwirq priority" to change one.
+static ssize_t priority_show(struct kobject *kobj, struct kobj_attribute *attr,
+			     char *buf)
+{
+	struct plic_data *data = plic_from_kobj(kobj);
+	ssize_t len = 0;
+	int hwirq;
+	for (hwirq = 1; hwirq <= data->ndev; ++hwirq)
+		if (irq_find_mapping(data->domain, hwirq))
+			len += scnprintf(buf + len, PAGE_SIZE - len, "%d %u\n",
+					 hwirq, data->priority[hwirq]);
+	return len;
+}
+
+static ssize_t priority_store(struct kobject *kobj, struct kobj_attribute *attr,
+			      const char *buf, size_t count)
+{
+	struct plic_data *data = plic_from_kobj(kobj);
+	struct plic_priority *priority = PLIC_PRIORITY(data);
+	unsigned int hwirq, irq;
+	unsigned long flags;
+	u32 prio;
+
+	if (sscanf(buf, "%u %u", &hwirq, &prio) != 2) return -EINVAL;
+	if (hwirq == 0 || hwirq > data->ndev) return -EINVAL;
+	irq = irq_find_mapping(data->domain, hwirq);
+
+	raw_spin_lock_irqsave(&data->lock, flags);
+	data->priority[hwirq] = plic_clamp_priority(data, prio);
+	if (irq && !irqd_irq_disabled(irq_get_irq_data(irq)))
+		iowrite32(data->priority[hwirq], &priority->prio[hwirq]);
+	raw_spin_unlock_irqrestore(&data->lock, flags);
+
+	plic_refresh_affinity(data, hwirq);
+	return count;
+}
+
+// /sys/kernel/plic/<name>/threshold: one "context hart threshold" line per
+// context; write "context threshold" to mask sources at or below it there.
+static ssize_t threshold_show(struct kobject *kobj, struct kobj_attribute *attr,
+			      char *buf)
+{
+	struct plic_data *data = plic_from_kobj(kobj);
+	ssize_t len = 0;
+	int i;
+	for (i = 0; i < data->handlers; ++i)
+		if (data->handler[i].context)
+			len += scnprintf(buf + len, PAGE_SIZE - len, "%d %d %u\n",
+					 i, data->handler[i].cpu,
+					 data->handler[i].threshold);
+	return len;
+}
+
+static ssize_t threshold_store(struct kobject *kobj, struct kobj_attribute *attr,
+			       const char *buf, size_t count)
+{
+	struct plic_data *data = plic_from_kobj(kobj);
+	struct plic_handler *handler;
+	unsigned long flags;
+	unsigned int ctx;
+	u32 threshold;
+	int hwirq;
+
+	if (sscanf(buf, "%u %u", &ctx, &threshold) != 2) return -EINVAL;
+	if (ctx >= data->handlers || !data->handler[ctx].context) return -EINVAL;
+	handler = &data->handler[ctx];
+
+	raw_spin_lock_irqsave(&data->lock, flags);
+	handler->threshold = min(threshold, data->max_priority);
+	iowrite32(handler->threshold, &handler->context->threshold);
+	raw_spin_unlock_irqrestore(&data->lock, flags);
+
+	for (hwirq = 1; hwirq <= data->ndev; ++hwirq)
+		if (plic_enabled(data, ctx, hwirq))
+			plic_refresh_affinity(data, hwirq);
+	return count;
+}
+
+static struct kobj_attribute plic_priority_attr = __ATTR_RW(priority);
+static struct kobj_attribute plic_threshold_attr = __ATTR_RW(threshold);
+
+static struct attribute *plic_attrs[] = {
+	&plic_priority_attr.attr,
+	&plic_threshold_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group plic_attr_group = {
+	.attrs = plic_attrs,
+};
+
+static int __init plic_sysfs_init(void)
+{
+	struct kobject *parent;
+	struct plic_data *data;
+
+	parent = kobject_create_and_add("plic", kernel_kobj);
+	if (!parent) return -ENOMEM;
+
+	list_for_each_entry(data, &plic_list, list) {
+		data->kobj = kobject_create_and_add(data->name, parent);
+		if (WARN_ON(!data->kobj)) continue;
+		WARN_ON(sysfs_create_group(data->kobj, &plic_attr_group));
+	}
+	return 0;
+}
+device_initcall(plic_sysfs_init);
 
 static int plic_init(struct device_node *node, struct device_node *parent)
 {
 	struct plic_data *data;
+	struct plic_priority *priority;
 	struct resource resource;
-	int i, ok = 0;
+	int i, hwirq, ok = 0;
 
 	data = kzalloc(sizeof(*data), GFP_KERNEL);
 	if (WARN_ON(!data)) return -ENOMEM;
@@ -165,6 +443,20 @@ static int plic_init(struct device_node *node, struct device_node *parent)
 	data->handler = kzalloc(sizeof(*data->handler)*data->handlers, GFP_KERNEL);
 	if (WARN_ON(!data->handler)) return -ENOMEM;
 
+	data->priority = kcalloc(data->ndev+1, sizeof(*data->priority), GFP_KERNEL);
+	if (WARN_ON(!data->priority)) return -ENOMEM;
+
+	data->desc = kcalloc(data->ndev+1, sizeof(*data->desc), GFP_KERNEL);
+	if (WARN_ON(!data->desc)) return -ENOMEM;
+
+	// the implemented priority bits read back after writing all ones
+	priority = PLIC_PRIORITY(data);
+	iowrite32(~0U, &priority->prio[1]);
+	data->max_priority = ioread32(&priority->prio[1]) ?: 1;
+	iowrite32(0, &priority->prio[1]);
+	for (hwirq = 1; hwirq <= data->ndev; ++hwirq) data->priority[hwirq] = 1;
+	raw_spin_lock_init(&data->lock);
+
 	data->domain = irq_domain_add_linear(node, data->ndev+1, &plic_irqdomain_ops, data);
 	if (WARN_ON(!data->domain)) return -ENOMEM;
 
@@ -175,11 +467,14 @@ static int plic_init(struct device_node *node, struct device_node *parent)
 	data->chip.irq_unmask = plic_irq_unmask;
 	data->chip.irq_enable = plic_irq_enable;
 	data->chip.irq_disable = plic_irq_disable;
+#ifdef CONFIG_SMP
+	data->chip.irq_set_affinity = plic_irq_set_affinity;
+#endif
 
 	for (i = 0; i < data->handlers; ++i) {
 		struct plic_handler *handler = &data->handler[i];
 		struct of_phandle_args parent;
-		int parent_irq, hwirq;
+		int parent_irq;
 
 		if (of_irq_parse_one(node, i, &parent)) continue;
 		if (parent.args[0] == -1) continue; // skip context holes
@@ -194,13 +489,23 @@ static int plic_init(struct device_node *node, struct device_node *parent)
 
 		handler->context = PLIC_HART_CONTEXT(data, i);
 		handler->data = data;
+		handler->cpu = -1;
+		if (of_device_is_compatible(parent.np, "riscv,cpu-intc") &&
+		    parent.np->parent) {
+			// hart IDs are the kernel's CPU numbers
+			handler->cpu = riscv_of_processor_hart(parent.np->parent);
+			cpumask_set_cpu(handler->cpu, &data->harts);
+		}
 		iowrite32(0, &handler->context->threshold); // hwirq prio must be > this to trigger an interrupt
 		for (hwirq = 1; hwirq <= data->ndev; ++hwirq) plic_disable(data, i, hwirq);
 		irq_set_chained_handler_and_data(parent_irq, plic_chained_handle_irq, handler);
 		++ok;
 	}
 
-	printk("%s: mapped %d interrupts to %d/%d handlers\n", data->name, data->ndev, ok, data->handlers);
+	list_add_tail(&data->list, &plic_list);
+
+	printk("%s: mapped %d interrupts to %d/%d handlers, priorities 1-%u\n",
+	       data->name, data->ndev, ok, data->handlers, data->max_priority);
 	WARN_ON(!ok);
 	return 0;
 }
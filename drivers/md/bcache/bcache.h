@@ -324,16 +324,24 @@ struct cached_dev {
 	struct bch_ratelimit	writeback_rate;
 	struct delayed_work	writeback_rate_update;
 
-	/*
-	 * Internal to the writeback code, so read_dirty() can keep track of
-	 * where it's at.
-	 */
-	sector_t		last_read;
-
 	/* Limit number of writeback bios in flight */
 	struct semaphore	in_flight;
 	struct task_struct	*writeback_thread;
 
+	/*
+	 * Reads of a writeback pass complete in any order; writes to the
+	 * backing device are issued in sequence so it sees them sorted.
+	 */
+	atomic_t		writeback_sequence_next;
+	struct closure_waitlist	writeback_ordering_wait;
+
+	/*
+	 * jiffies of the last foreground request; with none for a while
+	 * writeback runs at the maximum rate until the next one arrives.
+	 */
+	unsigned long		last_foreground_io;
+	bool			writeback_rate_idle;
+
 	struct keybuf		writeback_keys;
 
 	/* For tracking sequential IO */
@@ -530,7 +538,13 @@ struct cache_set {
 	 * high order page allocations can be rather expensive, and it's quite
 	 * common to delete and allocate btree nodes in quick succession. It
 	 * should never grow past ~2-3 nodes in practice.
+	 *
+	 * The lists, btree_cache_used and bucket_hash insertions are protected
+	 * by btree_cache_lock rather than bucket_lock, so that cache misses and
+	 * the shrinker don't serialize against bucket allocation. When both
+	 * are needed, bucket_lock is taken first.
 	 */
+	struct mutex		btree_cache_lock;
 	struct list_head	btree_cache;
 	struct list_head	btree_cache_freeable;
 	struct list_head	btree_cache_freed;
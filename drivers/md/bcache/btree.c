@@ -620,7 +620,7 @@ static int mca_reap(struct btree *b, unsigned min_order, bool flush)
 	struct closure cl;
 
 	closure_init_stack(&cl);
-	lockdep_assert_held(&b->c->bucket_lock);
+	lockdep_assert_held(&b->c->btree_cache_lock);
 
 	if (!down_write_trylock(&b->lock))
 		return -ENOMEM;
@@ -672,8 +672,8 @@ static unsigned long bch_mca_scan(struct shrinker *shrink,
 
 	/* Return -1 if we can't do anything right now */
 	if (sc->gfp_mask & __GFP_IO)
-		mutex_lock(&c->bucket_lock);
-	else if (!mutex_trylock(&c->bucket_lock))
+		mutex_lock(&c->btree_cache_lock);
+	else if (!mutex_trylock(&c->btree_cache_lock))
 		return -1;
 
 	/*
@@ -716,7 +716,7 @@ static unsigned long bch_mca_scan(struct shrinker *shrink,
 			b->accessed = 0;
 	}
 out:
-	mutex_unlock(&c->bucket_lock);
+	mutex_unlock(&c->btree_cache_lock);
 	return freed;
 }
 
@@ -743,7 +743,7 @@ void bch_btree_cache_free(struct cache_set *c)
 	if (c->shrink.list.next)
 		unregister_shrinker(&c->shrink);
 
-	mutex_lock(&c->bucket_lock);
+	mutex_lock(&c->btree_cache_lock);
 
 #ifdef CONFIG_BCACHE_DEBUG
 	if (c->verify_data)
@@ -773,7 +773,7 @@ void bch_btree_cache_free(struct cache_set *c)
 		kfree(b);
 	}
 
-	mutex_unlock(&c->bucket_lock);
+	mutex_unlock(&c->btree_cache_lock);
 }
 
 int bch_btree_cache_alloc(struct cache_set *c)
@@ -890,7 +890,7 @@ static struct btree *mca_alloc(struct cache_set *c, struct btree_op *op,
 
 	BUG_ON(current->bio_list);
 
-	lockdep_assert_held(&c->bucket_lock);
+	lockdep_assert_held(&c->btree_cache_lock);
 
 	if (mca_find(c, k))
 		return NULL;
@@ -978,9 +978,9 @@ retry:
 		if (current->bio_list)
 			return ERR_PTR(-EAGAIN);
 
-		mutex_lock(&c->bucket_lock);
+		mutex_lock(&c->btree_cache_lock);
 		b = mca_alloc(c, op, k, level);
-		mutex_unlock(&c->bucket_lock);
+		mutex_unlock(&c->btree_cache_lock);
 
 		if (!b)
 			goto retry;
@@ -1025,9 +1025,9 @@ static void btree_node_prefetch(struct btree *parent, struct bkey *k)
 {
 	struct btree *b;
 
-	mutex_lock(&parent->c->bucket_lock);
+	mutex_lock(&parent->c->btree_cache_lock);
 	b = mca_alloc(parent->c, NULL, k, parent->level - 1);
-	mutex_unlock(&parent->c->bucket_lock);
+	mutex_unlock(&parent->c->btree_cache_lock);
 
 	if (!IS_ERR_OR_NULL(b)) {
 		b->parent = parent;
@@ -1056,8 +1056,11 @@ static void btree_node_free(struct btree *b)
 
 	mutex_lock(&b->c->bucket_lock);
 	bch_bucket_free(b->c, &b->key);
-	mca_bucket_free(b);
 	mutex_unlock(&b->c->bucket_lock);
+
+	mutex_lock(&b->c->btree_cache_lock);
+	mca_bucket_free(b);
+	mutex_unlock(&b->c->btree_cache_lock);
 }
 
 struct btree *__bch_btree_node_alloc(struct cache_set *c, struct btree_op *op,
@@ -1075,7 +1078,9 @@ retry:
 	bkey_put(c, &k.key);
 	SET_KEY_SIZE(&k.key, c->btree_pages * PAGE_SECTORS);
 
+	mutex_lock(&c->btree_cache_lock);
 	b = mca_alloc(c, op, &k.key, level);
+	mutex_unlock(&c->btree_cache_lock);
 	if (IS_ERR(b))
 		goto err_free;
 
@@ -2251,9 +2256,9 @@ void bch_btree_set_root(struct btree *b)
 	for (i = 0; i < KEY_PTRS(&b->key); i++)
 		BUG_ON(PTR_BUCKET(b->c, &b->key, i)->prio != BTREE_PRIO);
 
-	mutex_lock(&b->c->bucket_lock);
+	mutex_lock(&b->c->btree_cache_lock);
 	list_del_init(&b->list);
-	mutex_unlock(&b->c->bucket_lock);
+	mutex_unlock(&b->c->btree_cache_lock);
 
 	b->c->root = b;
 
@@ -960,6 +960,7 @@ static blk_qc_t cached_dev_make_request(struct request_queue *q,
 	int rw = bio_data_dir(bio);
 
 	generic_start_io_acct(rw, bio_sectors(bio), &d->disk->part0);
+	bch_writeback_foreground_io(dc);
 
 	bio->bi_bdev = dc->bdev;
 	bio->bi_iter.bi_sector += dc->sb.data_offset;
@@ -471,11 +471,11 @@ static size_t bch_cache_size(struct cache_set *c)
 	size_t ret = 0;
 	struct btree *b;
 
-	mutex_lock(&c->bucket_lock);
+	mutex_lock(&c->btree_cache_lock);
 	list_for_each_entry(b, &c->btree_cache, list)
 		ret += 1 << (b->keys.page_order + PAGE_SHIFT);
 
-	mutex_unlock(&c->bucket_lock);
+	mutex_unlock(&c->btree_cache_lock);
 	return ret;
 }
 
@@ -484,7 +484,7 @@ static unsigned bch_cache_max_chain(struct cache_set *c)
 	unsigned ret = 0;
 	struct hlist_head *h;
 
-	mutex_lock(&c->bucket_lock);
+	mutex_lock(&c->btree_cache_lock);
 
 	for (h = c->bucket_hash;
 	     h < c->bucket_hash + (1 << BUCKET_HASH_BITS);
@@ -498,7 +498,7 @@ static unsigned bch_cache_max_chain(struct cache_set *c)
 		ret = max(ret, i);
 	}
 
-	mutex_unlock(&c->bucket_lock);
+	mutex_unlock(&c->btree_cache_lock);
 	return ret;
 }
 
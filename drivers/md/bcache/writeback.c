@@ -16,8 +16,18 @@
 #include <linux/sched/clock.h>
 #include <trace/events/bcache.h>
 
+/* Max keys and sectors gathered into one sequential writeback pass */
+#define MAX_WRITEBACKS_IN_PASS	5
+#define MAX_WRITESIZE_IN_PASS	5000
+
 /* Rate limiting */
 
+static bool writeback_idle(struct cached_dev *dc)
+{
+	return time_after(jiffies, READ_ONCE(dc->last_foreground_io) +
+			  dc->writeback_rate_update_seconds * 2 * HZ);
+}
+
 static void __update_writeback_rate(struct cached_dev *dc)
 {
 	struct cache_set *c = dc->disk.c;
@@ -59,6 +69,12 @@ static void __update_writeback_rate(struct cached_dev *dc)
 			 dc->writeback_rate.next + NSEC_PER_MSEC))
 		change = 0;
 
+	/* Nothing in the foreground to protect: write back flat out */
+	if (writeback_idle(dc)) {
+		dc->writeback_rate_idle = true;
+		change = NSEC_PER_MSEC;
+	}
+
 	dc->writeback_rate.rate =
 		clamp_t(int64_t, (int64_t) dc->writeback_rate.rate + change,
 			1, NSEC_PER_MSEC);
@@ -99,6 +115,7 @@ static unsigned writeback_delay(struct cached_dev *dc, unsigned sectors)
 struct dirty_io {
 	struct closure		cl;
 	struct cached_dev	*dc;
+	unsigned		sequence;
 	struct bio		bio;
 };
 
@@ -177,14 +194,36 @@ static void write_dirty(struct closure *cl)
 {
 	struct dirty_io *io = container_of(cl, struct dirty_io, cl);
 	struct keybuf_key *w = io->bio.bi_private;
+	struct cached_dev *dc = io->dc;
 
-	dirty_init(w);
-	bio_set_op_attrs(&io->bio, REQ_OP_WRITE, 0);
-	io->bio.bi_iter.bi_sector = KEY_START(&w->key);
-	io->bio.bi_bdev		= io->dc->bdev;
-	io->bio.bi_end_io	= dirty_endio;
+	if (atomic_read(&dc->writeback_sequence_next) != io->sequence) {
+		/* Not our turn yet; wait for the previous write to go out */
+		closure_wait(&dc->writeback_ordering_wait, cl);
 
-	closure_bio_submit(&io->bio, cl);
+		/* It may have gone out before we were on the waitlist */
+		if (atomic_read(&dc->writeback_sequence_next) == io->sequence)
+			closure_wake_up(&dc->writeback_ordering_wait);
+
+		continue_at(cl, write_dirty, system_wq);
+		return;
+	}
+
+	/*
+	 * A failed read clears the dirty bit; don't write garbage to the
+	 * backing device, but still pass the turn on.
+	 */
+	if (KEY_DIRTY(&w->key)) {
+		dirty_init(w);
+		bio_set_op_attrs(&io->bio, REQ_OP_WRITE, 0);
+		io->bio.bi_iter.bi_sector = KEY_START(&w->key);
+		io->bio.bi_bdev		= dc->bdev;
+		io->bio.bi_end_io	= dirty_endio;
+
+		closure_bio_submit(&io->bio, cl);
+	}
+
+	atomic_set(&dc->writeback_sequence_next, io->sequence + 1);
+	closure_wake_up(&dc->writeback_ordering_wait);
 
 	continue_at(cl, write_dirty_finish, system_wq);
 }
@@ -212,10 +251,15 @@ static void read_dirty_submit(struct closure *cl)
 static void read_dirty(struct cached_dev *dc)
 {
 	unsigned delay = 0;
-	struct keybuf_key *w;
+	struct keybuf_key *next, *keys[MAX_WRITEBACKS_IN_PASS], *w;
+	unsigned sequence = 0;
+	size_t size;
+	int nk, i;
 	struct dirty_io *io;
 	struct closure cl;
 
+	BUG_ON(!llist_empty(&dc->writeback_ordering_wait.list));
+	atomic_set(&dc->writeback_sequence_next, sequence);
 	closure_init_stack(&cl);
 
 	/*
@@ -223,53 +267,82 @@ static void read_dirty(struct cached_dev *dc)
 	 * mempools.
 	 */
 
-	while (!kthread_should_stop()) {
+	next = bch_keybuf_next(&dc->writeback_keys);
 
-		w = bch_keybuf_next(&dc->writeback_keys);
-		if (!w)
-			break;
+	while (!kthread_should_stop() && next) {
+		size = 0;
+		nk = 0;
 
-		BUG_ON(ptr_stale(dc->disk.c, &w->key, 0));
+		/*
+		 * The keybuf is sorted, so gather a run of keys that are
+		 * contiguous on the backing device: their reads go to the
+		 * cache in parallel, and the writes reach the backing device
+		 * back to back as one sequential stream.
+		 */
+		do {
+			BUG_ON(ptr_stale(dc->disk.c, &next->key, 0));
 
-		if (KEY_START(&w->key) != dc->last_read ||
-		    jiffies_to_msecs(delay) > 50)
-			while (!kthread_should_stop() && delay)
-				delay = schedule_timeout_interruptible(delay);
+			if (nk >= MAX_WRITEBACKS_IN_PASS ||
+			    size >= MAX_WRITESIZE_IN_PASS)
+				break;
 
-		dc->last_read	= KEY_OFFSET(&w->key);
+			if (nk && bkey_cmp(&keys[nk - 1]->key,
+					   &START_KEY(&next->key)))
+				break;
 
-		io = kzalloc(sizeof(struct dirty_io) + sizeof(struct bio_vec)
-			     * DIV_ROUND_UP(KEY_SIZE(&w->key), PAGE_SECTORS),
-			     GFP_KERNEL);
-		if (!io)
-			goto err;
+			size += KEY_SIZE(&next->key);
+			keys[nk++] = next;
+		} while ((next = bch_keybuf_next(&dc->writeback_keys)));
 
-		w->private	= io;
-		io->dc		= dc;
+		for (i = 0; i < nk; i++) {
+			w = keys[i];
 
-		dirty_init(w);
-		bio_set_op_attrs(&io->bio, REQ_OP_READ, 0);
-		io->bio.bi_iter.bi_sector = PTR_OFFSET(&w->key, 0);
-		io->bio.bi_bdev		= PTR_CACHE(dc->disk.c,
-						    &w->key, 0)->bdev;
-		io->bio.bi_end_io	= read_dirty_endio;
+			io = kzalloc(sizeof(struct dirty_io) +
+				     sizeof(struct bio_vec) *
+				     DIV_ROUND_UP(KEY_SIZE(&w->key), PAGE_SECTORS),
+				     GFP_KERNEL);
+			if (!io)
+				goto err;
+
+			w->private	= io;
+			io->dc		= dc;
 
-		if (bio_alloc_pages(&io->bio, GFP_KERNEL))
-			goto err_free;
+			dirty_init(w);
+			bio_set_op_attrs(&io->bio, REQ_OP_READ, 0);
+			io->bio.bi_iter.bi_sector = PTR_OFFSET(&w->key, 0);
+			io->bio.bi_bdev		= PTR_CACHE(dc->disk.c,
+							    &w->key, 0)->bdev;
+			io->bio.bi_end_io	= read_dirty_endio;
 
-		trace_bcache_writeback(&w->key);
+			if (bio_alloc_pages(&io->bio, GFP_KERNEL))
+				goto err_free;
 
-		down(&dc->in_flight);
-		closure_call(&io->cl, read_dirty_submit, NULL, &cl);
+			trace_bcache_writeback(&w->key);
 
-		delay = writeback_delay(dc, KEY_SIZE(&w->key));
+			/* Only issued IOs get a place in the write order */
+			io->sequence	= sequence++;
+
+			down(&dc->in_flight);
+			closure_call(&io->cl, read_dirty_submit, NULL, &cl);
+		}
+
+		delay = writeback_delay(dc, size);
+
+		while (!kthread_should_stop() && delay) {
+			schedule_timeout_interruptible(delay);
+			delay = writeback_delay(dc, 0);
+		}
 	}
 
 	if (0) {
 err_free:
 		kfree(w->private);
 err:
-		bch_keybuf_del(&dc->writeback_keys, w);
+		/* Drop the rest of the pass; the next refill finds it again */
+		for (; i < nk; i++)
+			bch_keybuf_del(&dc->writeback_keys, keys[i]);
+		if (next)
+			bch_keybuf_del(&dc->writeback_keys, next);
 	}
 
 	/*
@@ -506,6 +579,7 @@ void bch_cached_dev_writeback_init(struct cached_dev *dc)
 	dc->writeback_percent		= 10;
 	dc->writeback_delay		= 30;
 	dc->writeback_rate.rate		= 1024;
+	dc->last_foreground_io		= jiffies;
 
 	dc->writeback_rate_update_seconds = 5;
 	dc->writeback_rate_d_term	= 30;
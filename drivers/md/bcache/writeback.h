@@ -60,6 +60,22 @@ static inline bool should_writeback(struct cached_dev *dc, struct bio *bio,
 	return op_is_sync(bio->bi_opf) || in_use <= CUTOFF_WRITEBACK;
 }
 
+/*
+ * Called for every foreground request: drops writeback back to the slowest
+ * rate if it was running flat out on an idle device, and lets the PD
+ * controller take over again.
+ */
+static inline void bch_writeback_foreground_io(struct cached_dev *dc)
+{
+	if (READ_ONCE(dc->last_foreground_io) != jiffies)
+		WRITE_ONCE(dc->last_foreground_io, jiffies);
+
+	if (unlikely(READ_ONCE(dc->writeback_rate_idle))) {
+		WRITE_ONCE(dc->writeback_rate_idle, false);
+		dc->writeback_rate.rate = 1;
+	}
+}
+
 static inline void bch_writeback_queue(struct cached_dev *dc)
 {
 	if (!IS_ERR_OR_NULL(dc->writeback_thread))
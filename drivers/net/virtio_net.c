@@ -48,6 +48,12 @@ module_param(napi_tx, bool, 0644);
 /* Amount of XDP headroom to prepend to packets for use by xdp_adjust_head */
 #define VIRTIO_XDP_HEADROOM 256
 
+/* Buffers added to or got from a virtqueue at once.  An RX batch is filled
+ * into rq->sg, so it may not exceed MAX_SKB_FRAGS + 2 entries.
+ */
+#define VIRTNET_RX_BATCH 16
+#define VIRTNET_TX_BATCH 32
+
 /* RX packet size EWMA. The average packet size is used to determine the packet
  * buffer size when refilling RX rings. As the entire RX ring may be refilled
  * at once, the weight is chosen so that the EWMA will be insensitive to short-
@@ -370,16 +376,12 @@ static struct sk_buff *page_to_skb(struct virtnet_info *vi,
 	return skb;
 }
 
-static bool virtnet_xdp_xmit(struct virtnet_info *vi,
-			     struct receive_queue *rq,
-			     struct xdp_buff *xdp)
+/* The XDP send queue of this cpu, with the buffers already sent freed */
+static struct send_queue *virtnet_xdp_sq(struct virtnet_info *vi)
 {
-	struct virtio_net_hdr_mrg_rxbuf *hdr;
-	unsigned int len;
 	struct send_queue *sq;
-	unsigned int qp;
+	unsigned int len, qp;
 	void *xdp_sent;
-	int err;
 
 	qp = vi->curr_queue_pairs - vi->xdp_queue_pairs + smp_processor_id();
 	sq = &vi->sq[qp];
@@ -391,6 +393,15 @@ static bool virtnet_xdp_xmit(struct virtnet_info *vi,
 		put_page(sent_page);
 	}
 
+	return sq;
+}
+
+static int __virtnet_xdp_xmit(struct virtnet_info *vi, struct send_queue *sq,
+			      struct xdp_buff *xdp)
+{
+	struct virtio_net_hdr_mrg_rxbuf *hdr;
+	int err;
+
 	xdp->data -= vi->hdr_len;
 	/* Zero header and leave csum up to XDP layers */
 	hdr = xdp->data;
@@ -399,7 +410,19 @@ static bool virtnet_xdp_xmit(struct virtnet_info *vi,
 	sg_init_one(sq->sg, xdp->data, xdp->data_end - xdp->data);
 
 	err = virtqueue_add_outbuf(sq->vq, sq->sg, 1, xdp->data, GFP_ATOMIC);
-	if (unlikely(err)) {
+	if (unlikely(err))
+		xdp->data += vi->hdr_len;
+
+	return err;
+}
+
+static bool virtnet_xdp_xmit(struct virtnet_info *vi,
+			     struct receive_queue *rq,
+			     struct xdp_buff *xdp)
+{
+	struct send_queue *sq = virtnet_xdp_sq(vi);
+
+	if (unlikely(__virtnet_xdp_xmit(vi, sq, xdp))) {
 		struct page *page = virt_to_head_page(xdp->data);
 
 		put_page(page);
@@ -410,6 +433,55 @@ static bool virtnet_xdp_xmit(struct virtnet_info *vi,
 	return true;
 }
 
+/* Frames redirected here from other devices go out on the XDP send queues,
+ * which only exist while a program is attached to this one. They are only
+ * queued; the kick is left to virtnet_xdp_flush().
+ */
+static int virtnet_xdp_xmit_bulk(struct net_device *dev,
+				 struct xdp_buff *frames, int n)
+{
+	struct virtnet_info *vi = netdev_priv(dev);
+	struct send_queue *sq;
+	int i = 0;
+
+	rcu_read_lock();
+	if (!rcu_dereference(vi->rq[0].xdp_prog))
+		goto out;
+
+	sq = virtnet_xdp_sq(vi);
+	for (; i < n; i++) {
+		struct xdp_buff *xdp = &frames[i];
+
+		/* The virtio header goes in front of the frame */
+		if (unlikely(xdp->data - xdp->data_hard_start < vi->hdr_len))
+			break;
+		if (unlikely(__virtnet_xdp_xmit(vi, sq, xdp)))
+			break;
+	}
+out:
+	rcu_read_unlock();
+	return i;
+}
+
+static int virtnet_xdp_xmit_one(struct net_device *dev, struct xdp_buff *xdp)
+{
+	return virtnet_xdp_xmit_bulk(dev, xdp, 1) == 1 ? 0 : -ENOSPC;
+}
+
+static void virtnet_xdp_flush(struct net_device *dev)
+{
+	struct virtnet_info *vi = netdev_priv(dev);
+	unsigned int qp;
+
+	rcu_read_lock();
+	if (rcu_dereference(vi->rq[0].xdp_prog)) {
+		qp = vi->curr_queue_pairs - vi->xdp_queue_pairs +
+		     smp_processor_id();
+		virtqueue_kick(vi->sq[qp].vq);
+	}
+	rcu_read_unlock();
+}
+
 static unsigned int virtnet_get_headroom(struct virtnet_info *vi)
 {
 	return vi->xdp_queue_pairs ? VIRTIO_XDP_HEADROOM : 0;
@@ -850,15 +922,14 @@ frame_err:
  * not need to use  mergeable_len_to_ctx here - it is enough
  * to store the headroom as the context ignoring the truesize.
  */
-static int add_recvbuf_small(struct virtnet_info *vi, struct receive_queue *rq,
-			     gfp_t gfp)
+static int fill_recvbuf_small(struct virtnet_info *vi, struct receive_queue *rq,
+			      struct scatterlist *sg, void **pbuf, void **pctx,
+			      gfp_t gfp)
 {
 	struct page_frag *alloc_frag = &rq->alloc_frag;
 	char *buf;
 	unsigned int xdp_headroom = virtnet_get_headroom(vi);
-	void *ctx = (void *)(unsigned long)xdp_headroom;
 	int len = vi->hdr_len + VIRTNET_RX_PAD + GOOD_PACKET_LEN + xdp_headroom;
-	int err;
 
 	len = SKB_DATA_ALIGN(len) +
 	      SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
@@ -868,12 +939,11 @@ static int add_recvbuf_small(struct virtnet_info *vi, struct receive_queue *rq,
 	buf = (char *)page_address(alloc_frag->page) + alloc_frag->offset;
 	get_page(alloc_frag->page);
 	alloc_frag->offset += len;
-	sg_init_one(rq->sg, buf + VIRTNET_RX_PAD + xdp_headroom,
+	sg_init_one(sg, buf + VIRTNET_RX_PAD + xdp_headroom,
 		    vi->hdr_len + GOOD_PACKET_LEN);
-	err = virtqueue_add_inbuf_ctx(rq->vq, rq->sg, 1, buf, ctx, gfp);
-	if (err < 0)
-		put_page(virt_to_head_page(buf));
-	return err;
+	*pbuf = buf;
+	*pctx = (void *)(unsigned long)xdp_headroom;
+	return 0;
 }
 
 static int add_recvbuf_big(struct virtnet_info *vi, struct receive_queue *rq,
@@ -936,14 +1006,14 @@ static unsigned int get_mergeable_buf_len(struct receive_queue *rq,
 	return ALIGN(len, L1_CACHE_BYTES);
 }
 
-static int add_recvbuf_mergeable(struct virtnet_info *vi,
-				 struct receive_queue *rq, gfp_t gfp)
+static int fill_recvbuf_mergeable(struct virtnet_info *vi,
+				  struct receive_queue *rq,
+				  struct scatterlist *sg, void **pbuf,
+				  void **pctx, gfp_t gfp)
 {
 	struct page_frag *alloc_frag = &rq->alloc_frag;
 	unsigned int headroom = virtnet_get_headroom(vi);
 	char *buf;
-	void *ctx;
-	int err;
 	unsigned int len, hole;
 
 	len = get_mergeable_buf_len(rq, &rq->mrg_avg_pkt_len);
@@ -952,7 +1022,7 @@ static int add_recvbuf_mergeable(struct virtnet_info *vi,
 
 	buf = (char *)page_address(alloc_frag->page) + alloc_frag->offset;
 	buf += headroom; /* advance address leaving hole at front of pkt */
-	ctx = mergeable_len_to_ctx(len, headroom);
+	*pctx = mergeable_len_to_ctx(len, headroom);
 	get_page(alloc_frag->page);
 	alloc_frag->offset += len + headroom;
 	hole = alloc_frag->size - alloc_frag->offset;
@@ -966,11 +1036,44 @@ static int add_recvbuf_mergeable(struct virtnet_info *vi,
 		alloc_frag->offset += hole;
 	}
 
-	sg_init_one(rq->sg, buf, len);
-	err = virtqueue_add_inbuf_ctx(rq->vq, rq->sg, 1, buf, ctx, gfp);
-	if (err < 0)
-		put_page(virt_to_head_page(buf));
+	sg_init_one(sg, buf, len);
+	*pbuf = buf;
+	return 0;
+}
+
+/*
+ * Small and mergeable buffers are a single sg entry each, so a batch of
+ * them is filled into rq->sg and exposed to the device at once.
+ */
+static int add_recvbufs(struct virtnet_info *vi, struct receive_queue *rq,
+			gfp_t gfp)
+{
+	void *bufs[VIRTNET_RX_BATCH], *ctxs[VIRTNET_RX_BATCH];
+	unsigned int i, n, num;
+	int err = 0, added;
 
+	num = min_t(unsigned int, rq->vq->num_free, VIRTNET_RX_BATCH);
+	for (n = 0; n < num; n++) {
+		if (vi->mergeable_rx_bufs)
+			err = fill_recvbuf_mergeable(vi, rq, &rq->sg[n],
+						     &bufs[n], &ctxs[n], gfp);
+		else
+			err = fill_recvbuf_small(vi, rq, &rq->sg[n],
+						 &bufs[n], &ctxs[n], gfp);
+		if (err)
+			break;
+	}
+	if (!n)
+		return err;
+
+	added = virtqueue_add_inbufs_ctx(rq->vq, rq->sg, n, bufs, ctxs, gfp);
+	for (i = max(added, 0); i < n; i++)
+		put_page(virt_to_head_page(bufs[i]));
+
+	if (added < 0)
+		return added;
+	if (added < n)
+		return -ENOSPC;
 	return err;
 }
 
@@ -989,12 +1092,10 @@ static bool try_fill_recv(struct virtnet_info *vi, struct receive_queue *rq,
 
 	gfp |= __GFP_COLD;
 	do {
-		if (vi->mergeable_rx_bufs)
-			err = add_recvbuf_mergeable(vi, rq, gfp);
-		else if (vi->big_packets)
+		if (!vi->mergeable_rx_bufs && vi->big_packets)
 			err = add_recvbuf_big(vi, rq, gfp);
 		else
-			err = add_recvbuf_small(vi, rq, gfp);
+			err = add_recvbufs(vi, rq, gfp);
 
 		oom = err == -ENOMEM;
 		if (err)
@@ -1078,7 +1179,25 @@ static int virtnet_receive(struct receive_queue *rq, int budget)
 	void *buf;
 	struct virtnet_stats *stats = this_cpu_ptr(vi->stats);
 
-	if (!vi->big_packets || vi->mergeable_rx_bufs) {
+	if (!vi->big_packets && !vi->mergeable_rx_bufs) {
+		void *bufs[VIRTNET_RX_BATCH], *ctxs[VIRTNET_RX_BATCH];
+		unsigned int lens[VIRTNET_RX_BATCH];
+		unsigned int i, n;
+
+		while (received < budget) {
+			n = virtqueue_get_bufs_ctx(rq->vq, bufs, lens, ctxs,
+					min_t(unsigned int, budget - received,
+					      VIRTNET_RX_BATCH));
+			if (!n)
+				break;
+			for (i = 0; i < n; i++)
+				bytes += receive_buf(vi, rq, bufs[i], lens[i],
+						     ctxs[i]);
+			received += n;
+		}
+	} else if (vi->mergeable_rx_bufs) {
+		/* receive_mergeable() gets the rest of a packet's buffers
+		 * itself, so they are got one at a time. */
 		void *ctx;
 
 		while (received < budget &&
@@ -1110,19 +1229,24 @@ static int virtnet_receive(struct receive_queue *rq, int budget)
 static void free_old_xmit_skbs(struct send_queue *sq)
 {
 	struct sk_buff *skb;
-	unsigned int len;
+	void *skbs[VIRTNET_TX_BATCH];
 	struct virtnet_info *vi = sq->vq->vdev->priv;
 	struct virtnet_stats *stats = this_cpu_ptr(vi->stats);
 	unsigned int packets = 0;
 	unsigned int bytes = 0;
+	unsigned int i, n;
 
-	while ((skb = virtqueue_get_buf(sq->vq, &len)) != NULL) {
-		pr_debug("Sent skb %p\n", skb);
+	while ((n = virtqueue_get_bufs(sq->vq, skbs, NULL,
+				       VIRTNET_TX_BATCH)) != 0) {
+		for (i = 0; i < n; i++) {
+			skb = skbs[i];
+			pr_debug("Sent skb %p\n", skb);
 
-		bytes += skb->len;
-		packets++;
+			bytes += skb->len;
+			packets++;
 
-		dev_kfree_skb_any(skb);
+			dev_kfree_skb_any(skb);
+		}
 	}
 
 	/* Avoid overhead when no packets have been processed
@@ -2069,6 +2193,9 @@ static const struct net_device_ops virtnet_netdev = {
 	.ndo_poll_controller = virtnet_netpoll,
 #endif
 	.ndo_xdp		= virtnet_xdp,
+	.ndo_xdp_xmit		= virtnet_xdp_xmit_one,
+	.ndo_xdp_xmit_bulk	= virtnet_xdp_xmit_bulk,
+	.ndo_xdp_flush		= virtnet_xdp_flush,
 	.ndo_features_check	= passthru_features_check,
 };
 
@@ -18,6 +18,7 @@
 #include <linux/blk-mq.h>
 #include <linux/blk-mq-pci.h>
 #include <linux/dmi.h>
+#include <linux/hrtimer.h>
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/io.h>
@@ -66,6 +67,31 @@ static int io_queue_depth = 1024;
 module_param_cb(io_queue_depth, &io_queue_depth_ops, &io_queue_depth, 0644);
 MODULE_PARM_DESC(io_queue_depth, "set io queue depth, should >= 2");
 
+static bool poll_queues;
+module_param(poll_queues, bool, 0444);
+MODULE_PARM_DESC(poll_queues,
+	"pair each I/O queue with an interrupt-less queue for polled I/O");
+
+static unsigned int irq_coalesce_thr;
+module_param(irq_coalesce_thr, uint, 0444);
+MODULE_PARM_DESC(irq_coalesce_thr,
+	"completions aggregated per interrupt on busy queues (0/1 disables)");
+
+static unsigned int irq_coalesce_time;
+module_param(irq_coalesce_time, uint, 0444);
+MODULE_PARM_DESC(irq_coalesce_time,
+	"longest interrupt aggregation on busy queues, in 100us units (0 disables)");
+
+static unsigned int irq_coalesce_min_rate = 20000;
+module_param(irq_coalesce_min_rate, uint, 0644);
+MODULE_PARM_DESC(irq_coalesce_min_rate,
+	"completions per second from which a queue's interrupts are coalesced");
+
+static bool poll_hybrid_sleep = true;
+module_param(poll_hybrid_sleep, bool, 0644);
+MODULE_PARM_DESC(poll_hybrid_sleep,
+	"sleep through half the mean completion time before polling a poll queue");
+
 struct nvme_dev;
 struct nvme_queue;
 
@@ -85,6 +111,11 @@ struct nvme_dev {
 	struct dma_pool *prp_small_pool;
 	unsigned online_queues;
 	unsigned max_qid;
+	unsigned nr_irq_queues;	/* I/O queues with an interrupt vector */
+	unsigned io_queues;	/* online I/O queues with an interrupt vector */
+	unsigned poll_queues;	/* online poll queues, paired with the above */
+	bool irq_coalesce;	/* interrupt coalescing is configured */
+	struct work_struct coalesce_work;
 	int q_depth;
 	u32 db_stride;
 	void __iomem *bar;
@@ -146,7 +177,8 @@ static inline struct nvme_dev *to_nvme_dev(struct nvme_ctrl *ctrl)
 struct nvme_queue {
 	struct device *q_dmadev;
 	struct nvme_dev *dev;
-	spinlock_t q_lock;
+	spinlock_t q_lock;	/* completion side: cq_head, cq_phase */
+	spinlock_t sq_lock;	/* submission side: sq_tail, last_sq_tail */
 	struct nvme_command *sq_cmds;
 	struct nvme_command __iomem *sq_cmds_io;
 	volatile struct nvme_completion *cqes;
@@ -157,14 +189,27 @@ struct nvme_queue {
 	u16 q_depth;
 	s16 cq_vector;
 	u16 sq_tail;
+	u16 last_sq_tail;	/* sq_tail last written to the doorbell */
 	u16 cq_head;
 	u16 qid;
 	u8 cq_phase;
-	u8 cqe_seen;
 	u32 *dbbuf_sq_db;
 	u32 *dbbuf_cq_db;
 	u32 *dbbuf_sq_ei;
 	u32 *dbbuf_cq_ei;
+	/*
+	 * An interrupt driven I/O queue and its poll queue point at each
+	 * other; polled requests of the first are submitted to the second,
+	 * which completes them on the tags of the first.
+	 */
+	struct nvme_queue *pollq;
+	struct nvme_queue *irqq;
+	u64 poll_lat_ns;	/* mean polled completion time, poll queues */
+	/* Adaptive interrupt coalescing, interrupt driven queues */
+	unsigned long rate_stamp;
+	unsigned int rate_cqes;
+	bool coalesce_want;
+	bool coalesced;
 };
 
 /*
@@ -180,6 +225,8 @@ struct nvme_iod {
 	int npages;		/* In the PRP list. 0 means small pool in use */
 	int nents;		/* Used in scatterlist */
 	int length;		/* Of data, in bytes */
+	bool poll_slept;	/* hybrid polling slept for this request */
+	u64 start_ns;		/* submitted to a poll queue at */
 	dma_addr_t first_dma;
 	struct scatterlist meta_sg; /* metadata requires single contiguous buffer */
 	struct scatterlist *sg;
@@ -398,15 +445,32 @@ static int nvme_pci_map_queues(struct blk_mq_tag_set *set)
 	return blk_mq_pci_map_queues(set, to_pci_dev(dev->dev));
 }
 
+/*
+ * Write the SQ tail doorbell for all commands copied into the queue since
+ * the last write.  Caller holds sq_lock.
+ */
+static void nvme_write_sq_db(struct nvme_queue *nvmeq)
+{
+	u16 tail = nvmeq->sq_tail;
+
+	if (tail == nvmeq->last_sq_tail)
+		return;
+	if (nvme_dbbuf_update_and_check_event(tail, nvmeq->dbbuf_sq_db,
+					      nvmeq->dbbuf_sq_ei))
+		writel(tail, nvmeq->q_db);
+	nvmeq->last_sq_tail = tail;
+}
+
 /**
  * __nvme_submit_cmd() - Copy a command into a queue and ring the doorbell
  * @nvmeq: The queue to use
  * @cmd: The command to send
+ * @write_sq: Ring the doorbell now rather than leave it to a later command
  *
- * Safe to use from interrupt context
+ * Safe to use from interrupt context.  Caller holds sq_lock.
  */
 static void __nvme_submit_cmd(struct nvme_queue *nvmeq,
-						struct nvme_command *cmd)
+			      struct nvme_command *cmd, bool write_sq)
 {
 	u16 tail = nvmeq->sq_tail;
 
@@ -417,10 +481,20 @@ static void __nvme_submit_cmd(struct nvme_queue *nvmeq,
 
 	if (++tail == nvmeq->q_depth)
 		tail = 0;
-	if (nvme_dbbuf_update_and_check_event(tail, nvmeq->dbbuf_sq_db,
-					      nvmeq->dbbuf_sq_ei))
-		writel(tail, nvmeq->q_db);
 	nvmeq->sq_tail = tail;
+	if (write_sq)
+		nvme_write_sq_db(nvmeq);
+}
+
+/*
+ * Flush a doorbell write deferred by a previous non-last request, for when
+ * the batch ends without a command that could carry it.
+ */
+static void nvme_commit_sq(struct nvme_queue *nvmeq)
+{
+	spin_lock_irq(&nvmeq->sq_lock);
+	nvme_write_sq_db(nvmeq);
+	spin_unlock_irq(&nvmeq->sq_lock);
 }
 
 static __le64 **iod_list(struct request *req)
@@ -714,12 +788,13 @@ static blk_status_t nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 	struct nvme_queue *nvmeq = hctx->driver_data;
 	struct nvme_dev *dev = nvmeq->dev;
 	struct request *req = bd->rq;
+	struct nvme_iod *iod;
 	struct nvme_command cmnd;
 	blk_status_t ret;
 
 	ret = nvme_setup_cmd(ns, req, &cmnd);
 	if (ret)
-		return ret;
+		goto out_commit;
 
 	ret = nvme_init_iod(req, dev);
 	if (ret)
@@ -731,22 +806,45 @@ static blk_status_t nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 			goto out_cleanup_iod;
 	}
 
+	iod = blk_mq_rq_to_pdu(req);
+	iod->nvmeq = nvmeq;
+	if ((req->cmd_flags & REQ_HIPRI) && nvmeq->pollq) {
+		nvmeq = nvmeq->pollq;
+		iod->nvmeq = nvmeq;
+		iod->poll_slept = false;
+		iod->start_ns = ktime_get_ns();
+	}
+
 	blk_mq_start_request(req);
 
-	spin_lock_irq(&nvmeq->q_lock);
+	/*
+	 * Only the last request of a dispatch batch rings the doorbell, which
+	 * then covers every command copied in before it.  Completions are
+	 * reaped by the interrupt handler or poller under q_lock only, so
+	 * submission never contends with them.  Poll queues are shared by
+	 * no other hctx batch and always ring at once.
+	 */
+	spin_lock_irq(&nvmeq->sq_lock);
 	if (unlikely(nvmeq->cq_vector < 0)) {
 		ret = BLK_STS_IOERR;
-		spin_unlock_irq(&nvmeq->q_lock);
+		spin_unlock_irq(&nvmeq->sq_lock);
 		goto out_cleanup_iod;
 	}
-	__nvme_submit_cmd(nvmeq, &cmnd);
-	nvme_process_cq(nvmeq);
-	spin_unlock_irq(&nvmeq->q_lock);
+	__nvme_submit_cmd(nvmeq, &cmnd, bd->last || nvmeq->irqq);
+	spin_unlock_irq(&nvmeq->sq_lock);
+	if (nvmeq->irqq && bd->last)
+		nvme_commit_sq(nvmeq->irqq);
 	return BLK_STS_OK;
 out_cleanup_iod:
 	nvme_free_iod(dev, req);
 out_free_cmd:
 	nvme_cleanup_cmd(req);
+out_commit:
+	/*
+	 * blk-mq stops dispatching on an error, so flush the doorbell for
+	 * any earlier request of the batch that deferred it to us.
+	 */
+	nvme_commit_sq(hctx->driver_data);
 	return ret;
 }
 
@@ -776,15 +874,15 @@ static inline void nvme_ring_cq_doorbell(struct nvme_queue *nvmeq)
 	}
 }
 
-static inline void nvme_handle_cqe(struct nvme_queue *nvmeq,
-		struct nvme_completion *cqe)
+static inline void nvme_handle_cqe(struct nvme_queue *nvmeq, u16 idx)
 {
+	struct nvme_completion cqe = nvmeq->cqes[idx];
 	struct request *req;
 
-	if (unlikely(cqe->command_id >= nvmeq->q_depth)) {
+	if (unlikely(cqe.command_id >= nvmeq->q_depth)) {
 		dev_warn(nvmeq->dev->ctrl.device,
 			"invalid id %d completed on queue %d\n",
-			cqe->command_id, le16_to_cpu(cqe->sq_id));
+			cqe.command_id, le16_to_cpu(cqe.sq_id));
 		return;
 	}
 
@@ -795,57 +893,127 @@ static inline void nvme_handle_cqe(struct nvme_queue *nvmeq,
 	 * for them but rather special case them here.
 	 */
 	if (unlikely(nvmeq->qid == 0 &&
-			cqe->command_id >= NVME_AQ_BLKMQ_DEPTH)) {
+			cqe.command_id >= NVME_AQ_BLKMQ_DEPTH)) {
 		nvme_complete_async_event(&nvmeq->dev->ctrl,
-				cqe->status, &cqe->result);
+				cqe.status, &cqe.result);
 		return;
 	}
 
-	req = blk_mq_tag_to_rq(*nvmeq->tags, cqe->command_id);
-	nvme_end_request(req, cqe->status, cqe->result);
+	if (nvmeq->irqq) {
+		struct nvme_iod *iod;
+		u64 lat;
+
+		req = blk_mq_tag_to_rq(*nvmeq->irqq->tags, cqe.command_id);
+		iod = blk_mq_rq_to_pdu(req);
+		lat = ktime_get_ns() - iod->start_ns;
+		nvmeq->poll_lat_ns = nvmeq->poll_lat_ns ?
+			(nvmeq->poll_lat_ns * 7 + lat) >> 3 : lat;
+	} else {
+		req = blk_mq_tag_to_rq(*nvmeq->tags, cqe.command_id);
+	}
+	nvme_end_request(req, cqe.status, cqe.result);
 }
 
-static inline bool nvme_read_cqe(struct nvme_queue *nvmeq,
-		struct nvme_completion *cqe)
+/*
+ * Completions are handled after dropping the queue lock, which only
+ * covers taking them off the CQ.  This is safe: the device cannot reuse
+ * the slots of [start, end) before their requests complete, as their
+ * commands still count against the queue depth until then.
+ */
+static void nvme_complete_cqes(struct nvme_queue *nvmeq, u16 start, u16 end)
 {
-	if (nvme_cqe_valid(nvmeq, nvmeq->cq_head, nvmeq->cq_phase)) {
-		*cqe = nvmeq->cqes[nvmeq->cq_head];
+	while (start != end) {
+		nvme_handle_cqe(nvmeq, start);
+		if (++start == nvmeq->q_depth)
+			start = 0;
+	}
+}
 
-		if (++nvmeq->cq_head == nvmeq->q_depth) {
-			nvmeq->cq_head = 0;
-			nvmeq->cq_phase = !nvmeq->cq_phase;
-		}
-		return true;
+static inline void nvme_update_cq_head(struct nvme_queue *nvmeq)
+{
+	if (++nvmeq->cq_head == nvmeq->q_depth) {
+		nvmeq->cq_head = 0;
+		nvmeq->cq_phase = !nvmeq->cq_phase;
 	}
-	return false;
 }
 
-static void nvme_process_cq(struct nvme_queue *nvmeq)
+/*
+ * Takes the new entries off the CQ, up to and including the one for tag
+ * if it is not -1, and returns their range.  Caller holds q_lock.
+ */
+static inline bool nvme_process_cq_range(struct nvme_queue *nvmeq,
+		u16 *start, u16 *end, int tag)
 {
-	struct nvme_completion cqe;
-	int consumed = 0;
+	bool found = false;
 
-	while (nvme_read_cqe(nvmeq, &cqe)) {
-		nvme_handle_cqe(nvmeq, &cqe);
-		consumed++;
+	*start = nvmeq->cq_head;
+	while (!found &&
+	       nvme_cqe_valid(nvmeq, nvmeq->cq_head, nvmeq->cq_phase)) {
+		if (tag == nvmeq->cqes[nvmeq->cq_head].command_id)
+			found = true;
+		nvme_update_cq_head(nvmeq);
 	}
+	*end = nvmeq->cq_head;
 
-	if (consumed) {
+	if (*start != *end)
 		nvme_ring_cq_doorbell(nvmeq);
-		nvmeq->cqe_seen = 1;
+	return found;
+}
+
+static void nvme_process_cq(struct nvme_queue *nvmeq)
+{
+	u16 start, end;
+
+	nvme_process_cq_range(nvmeq, &start, &end, -1);
+	nvme_complete_cqes(nvmeq, start, end);
+}
+
+/* How often the completion rate of a queue is looked at */
+#define NVME_COALESCE_PERIOD	(HZ / 10)
+
+/*
+ * Coalescing trades latency for fewer interrupts, which only pays off on
+ * queues completing many commands: switch it on and off for the vector of
+ * a queue as its completion rate crosses irq_coalesce_min_rate.  The Set
+ * Features commands are sent from nvme_coalesce_work().
+ */
+static void nvme_irq_rate(struct nvme_queue *nvmeq, u16 start, u16 end)
+{
+	unsigned long elapsed;
+	bool want;
+
+	if (!nvmeq->dev->irq_coalesce || !nvmeq->qid)
+		return;
+
+	nvmeq->rate_cqes += (end - start + nvmeq->q_depth) % nvmeq->q_depth;
+	elapsed = jiffies - nvmeq->rate_stamp;
+	if (elapsed < NVME_COALESCE_PERIOD)
+		return;
+
+	want = (u64)nvmeq->rate_cqes * HZ >=
+		(u64)irq_coalesce_min_rate * elapsed;
+	nvmeq->rate_stamp = jiffies;
+	nvmeq->rate_cqes = 0;
+	if (want != nvmeq->coalesce_want) {
+		WRITE_ONCE(nvmeq->coalesce_want, want);
+		queue_work(nvme_wq, &nvmeq->dev->coalesce_work);
 	}
 }
 
 static irqreturn_t nvme_irq(int irq, void *data)
 {
-	irqreturn_t result;
 	struct nvme_queue *nvmeq = data;
+	u16 start, end;
+
 	spin_lock(&nvmeq->q_lock);
-	nvme_process_cq(nvmeq);
-	result = nvmeq->cqe_seen ? IRQ_HANDLED : IRQ_NONE;
-	nvmeq->cqe_seen = 0;
+	nvme_process_cq_range(nvmeq, &start, &end, -1);
 	spin_unlock(&nvmeq->q_lock);
-	return result;
+
+	if (start == end)
+		return IRQ_NONE;
+	nvme_complete_cqes(nvmeq, start, end);
+	nvme_irq_rate(nvmeq, start, end);
+	return IRQ_HANDLED;
 }
 
 static irqreturn_t nvme_irq_check(int irq, void *data)
@@ -858,35 +1026,65 @@ static irqreturn_t nvme_irq_check(int irq, void *data)
 
 static int __nvme_poll(struct nvme_queue *nvmeq, unsigned int tag)
 {
-	struct nvme_completion cqe;
-	int found = 0, consumed = 0;
+	u16 start, end;
+	bool found;
 
 	if (!nvme_cqe_valid(nvmeq, nvmeq->cq_head, nvmeq->cq_phase))
 		return 0;
 
 	spin_lock_irq(&nvmeq->q_lock);
-	while (nvme_read_cqe(nvmeq, &cqe)) {
-		nvme_handle_cqe(nvmeq, &cqe);
-		consumed++;
-
-		if (tag == cqe.command_id) {
-			found = 1;
-			break;
-		}
-       }
-
-	if (consumed)
-		nvme_ring_cq_doorbell(nvmeq);
+	found = nvme_process_cq_range(nvmeq, &start, &end, tag);
 	spin_unlock_irq(&nvmeq->q_lock);
 
+	nvme_complete_cqes(nvmeq, start, end);
 	return found;
 }
 
+/*
+ * Hybrid polling: rather than spinning from submission on, sleep until half
+ * of the mean completion time of the poll queue has gone by, once per
+ * request.
+ */
+static void nvme_poll_sleep(struct nvme_queue *nvmeq, struct request *req)
+{
+	struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
+	u64 mean = READ_ONCE(nvmeq->poll_lat_ns) / 2;
+	u64 elapsed;
+	ktime_t kt;
+
+	if (iod->poll_slept)
+		return;
+	iod->poll_slept = true;
+
+	elapsed = ktime_get_ns() - iod->start_ns;
+	if (!mean || elapsed >= mean)
+		return;
+
+	kt = ns_to_ktime(mean - elapsed);
+	set_current_state(TASK_UNINTERRUPTIBLE);
+	schedule_hrtimeout(&kt, HRTIMER_MODE_REL);
+}
+
 static int nvme_poll(struct blk_mq_hw_ctx *hctx, unsigned int tag)
 {
 	struct nvme_queue *nvmeq = hctx->driver_data;
+	struct nvme_queue *pollq = nvmeq->pollq;
+	struct nvme_iod *iod;
+	struct request *req;
+
+	if (!pollq)
+		return __nvme_poll(nvmeq, tag);
 
-	return __nvme_poll(nvmeq, tag);
+	req = blk_mq_tag_to_rq(hctx->tags, tag);
+	if (!req)
+		return 0;
+	iod = blk_mq_rq_to_pdu(req);
+	if (iod->nvmeq != pollq)
+		return __nvme_poll(nvmeq, tag);
+
+	if (poll_hybrid_sleep)
+		nvme_poll_sleep(pollq, req);
+	return __nvme_poll(pollq, tag);
 }
 
 static void nvme_pci_submit_async_event(struct nvme_ctrl *ctrl, int aer_idx)
@@ -899,9 +1097,9 @@ static void nvme_pci_submit_async_event(struct nvme_ctrl *ctrl, int aer_idx)
 	c.common.opcode = nvme_admin_async_event;
 	c.common.command_id = NVME_AQ_BLKMQ_DEPTH + aer_idx;
 
-	spin_lock_irq(&nvmeq->q_lock);
-	__nvme_submit_cmd(nvmeq, &c);
-	spin_unlock_irq(&nvmeq->q_lock);
+	spin_lock_irq(&nvmeq->sq_lock);
+	__nvme_submit_cmd(nvmeq, &c, true);
+	spin_unlock_irq(&nvmeq->sq_lock);
 }
 
 static int adapter_delete_queue(struct nvme_dev *dev, u8 opcode, u16 id)
@@ -919,7 +1117,11 @@ static int adapter_alloc_cq(struct nvme_dev *dev, u16 qid,
 						struct nvme_queue *nvmeq)
 {
 	struct nvme_command c;
-	int flags = NVME_QUEUE_PHYS_CONTIG | NVME_CQ_IRQ_ENABLED;
+	int flags = NVME_QUEUE_PHYS_CONTIG;
+
+	/* Poll queues complete without interrupts. */
+	if (!nvmeq->irqq)
+		flags |= NVME_CQ_IRQ_ENABLED;
 
 	/*
 	 * Note: we (ab)use the fact the the prp fields survive if no data
@@ -931,7 +1133,7 @@ static int adapter_alloc_cq(struct nvme_dev *dev, u16 qid,
 	c.create_cq.cqid = cpu_to_le16(qid);
 	c.create_cq.qsize = cpu_to_le16(nvmeq->q_depth - 1);
 	c.create_cq.cq_flags = cpu_to_le16(flags);
-	c.create_cq.irq_vector = cpu_to_le16(nvmeq->cq_vector);
+	c.create_cq.irq_vector = cpu_to_le16(nvmeq->irqq ? 0 : nvmeq->cq_vector);
 
 	return nvme_submit_sync_cmd(dev->ctrl.admin_q, &c, NULL, 0);
 }
@@ -1158,13 +1360,16 @@ static int nvme_suspend_queue(struct nvme_queue *nvmeq)
 	}
 	vector = nvmeq->cq_vector;
 	nvmeq->dev->online_queues--;
+	spin_lock(&nvmeq->sq_lock);
 	nvmeq->cq_vector = -1;
+	spin_unlock(&nvmeq->sq_lock);
 	spin_unlock_irq(&nvmeq->q_lock);
 
 	if (!nvmeq->qid && nvmeq->dev->ctrl.admin_q)
 		blk_mq_quiesce_queue(nvmeq->dev->ctrl.admin_q);
 
-	pci_free_irq(to_pci_dev(nvmeq->dev->dev), vector, nvmeq);
+	if (!nvmeq->irqq)
+		pci_free_irq(to_pci_dev(nvmeq->dev->dev), vector, nvmeq);
 
 	return 0;
 }
@@ -1249,6 +1454,7 @@ static struct nvme_queue *nvme_alloc_queue(struct nvme_dev *dev, int qid,
 	nvmeq->q_dmadev = dev->dev;
 	nvmeq->dev = dev;
 	spin_lock_init(&nvmeq->q_lock);
+	spin_lock_init(&nvmeq->sq_lock);
 	nvmeq->cq_head = 0;
 	nvmeq->cq_phase = 1;
 	nvmeq->q_db = &dev->dbs[qid * 2 * dev->db_stride];
@@ -1287,7 +1493,10 @@ static void nvme_init_queue(struct nvme_queue *nvmeq, u16 qid)
 	struct nvme_dev *dev = nvmeq->dev;
 
 	spin_lock_irq(&nvmeq->q_lock);
+	spin_lock(&nvmeq->sq_lock);
 	nvmeq->sq_tail = 0;
+	nvmeq->last_sq_tail = 0;
+	spin_unlock(&nvmeq->sq_lock);
 	nvmeq->cq_head = 0;
 	nvmeq->cq_phase = 1;
 	nvmeq->q_db = &dev->dbs[qid * 2 * dev->db_stride];
@@ -1325,6 +1534,38 @@ static int nvme_create_queue(struct nvme_queue *nvmeq, int qid)
 	return result;
 }
 
+/*
+ * A poll queue has no interrupt vector of its own; cq_vector only marks it
+ * online, as for the other queues.
+ */
+static int nvme_create_poll_queue(struct nvme_queue *nvmeq, int qid,
+				  struct nvme_queue *irqq)
+{
+	struct nvme_dev *dev = nvmeq->dev;
+	int result;
+
+	nvmeq->irqq = irqq;
+	nvmeq->cq_vector = irqq->cq_vector;
+	nvmeq->poll_lat_ns = 0;
+	result = adapter_alloc_cq(dev, qid, nvmeq);
+	if (result < 0)
+		goto out;
+
+	result = adapter_alloc_sq(dev, qid, nvmeq);
+	if (result < 0) {
+		adapter_delete_cq(dev, qid);
+		goto out;
+	}
+
+	nvme_init_queue(nvmeq, qid);
+	irqq->pollq = nvmeq;
+	return result;
+ out:
+	nvmeq->cq_vector = -1;
+	nvmeq->irqq = NULL;
+	return result;
+}
+
 static const struct blk_mq_ops nvme_mq_admin_ops = {
 	.queue_rq	= nvme_queue_rq,
 	.complete	= nvme_pci_complete_rq,
@@ -1472,24 +1713,50 @@ static int nvme_pci_configure_admin_queue(struct nvme_dev *dev)
 
 static int nvme_create_io_queues(struct nvme_dev *dev)
 {
-	unsigned i, max;
+	unsigned i, max, vector;
 	int ret = 0;
 
 	for (i = dev->ctrl.queue_count; i <= dev->max_qid; i++) {
-		/* vector == qid - 1, match nvme_create_queue */
+		/* vector == qid - 1, match nvme_create_queue; a poll queue
+		 * lives on the node of the queue it is paired with */
+		vector = (i - 1) % dev->nr_irq_queues;
 		if (!nvme_alloc_queue(dev, i, dev->q_depth,
-		     pci_irq_get_node(to_pci_dev(dev->dev), i - 1))) {
+		     pci_irq_get_node(to_pci_dev(dev->dev), vector))) {
 			ret = -ENOMEM;
 			break;
 		}
 	}
 
-	max = min(dev->max_qid, dev->ctrl.queue_count - 1);
+	/* Queues may change roles from one reset to the next. */
+	for (i = 1; i < dev->ctrl.queue_count; i++) {
+		dev->queues[i]->pollq = NULL;
+		dev->queues[i]->irqq = NULL;
+	}
+
+	max = min(dev->nr_irq_queues, dev->ctrl.queue_count - 1);
 	for (i = dev->online_queues; i <= max; i++) {
 		ret = nvme_create_queue(dev->queues[i], i);
 		if (ret)
 			break;
 	}
+	dev->io_queues = dev->online_queues - 1;
+
+	/*
+	 * Poll queues take the qids right after the interrupt driven queues
+	 * that came up, so that the online queues stay contiguous.
+	 */
+	dev->poll_queues = 0;
+	max = min(dev->max_qid, dev->ctrl.queue_count - 1);
+	for (i = 1; i <= dev->io_queues && ret >= 0; i++) {
+		if (dev->io_queues + i > max)
+			break;
+		ret = nvme_create_poll_queue(dev->queues[dev->io_queues + i],
+					     dev->io_queues + i,
+					     dev->queues[i]);
+		if (ret)
+			break;
+		dev->poll_queues++;
+	}
 
 	/*
 	 * Ignore failing Create SQ/CQ commands, we can continue with less
@@ -1723,14 +1990,81 @@ static void nvme_setup_host_mem(struct nvme_dev *dev)
 		nvme_free_host_mem(dev);
 }
 
+static int nvme_set_irq_config(struct nvme_dev *dev, u16 vector, bool coalesce)
+{
+	u32 dw11 = vector | (coalesce ? 0 : NVME_IRQ_CONFIG_CD);
+
+	return nvme_set_features(&dev->ctrl, NVME_FEAT_IRQ_CONFIG, dw11,
+				 NULL, 0, NULL);
+}
+
+static void nvme_coalesce_work(struct work_struct *work)
+{
+	struct nvme_dev *dev = container_of(work, struct nvme_dev,
+					    coalesce_work);
+	struct nvme_queue *nvmeq;
+	bool want;
+	int i;
+
+	for (i = 1; i <= dev->io_queues; i++) {
+		if (dev->ctrl.state != NVME_CTRL_LIVE)
+			return;
+
+		nvmeq = dev->queues[i];
+		want = READ_ONCE(nvmeq->coalesce_want);
+		if (want == nvmeq->coalesced || nvmeq->cq_vector < 0)
+			continue;
+		if (nvme_set_irq_config(dev, nvmeq->cq_vector, want))
+			return;
+		nvmeq->coalesced = want;
+	}
+}
+
+/*
+ * Set the controller wide aggregation threshold and time, then leave it
+ * off for every vector until its queue gets busy.
+ */
+static void nvme_setup_irq_coalescing(struct nvme_dev *dev)
+{
+	struct nvme_queue *nvmeq;
+	int i;
+
+	dev->irq_coalesce = false;
+	if (irq_coalesce_thr < 2 || !irq_coalesce_time)
+		return;
+
+	if (nvme_set_features(&dev->ctrl, NVME_FEAT_IRQ_COALESCE,
+			      min(irq_coalesce_thr - 1, 255U) |
+			      min(irq_coalesce_time, 255U) << 8,
+			      NULL, 0, NULL)) {
+		dev_warn(dev->ctrl.device,
+			 "unable to set interrupt coalescing\n");
+		return;
+	}
+
+	for (i = 1; i <= dev->io_queues; i++) {
+		nvmeq = dev->queues[i];
+		if (nvme_set_irq_config(dev, nvmeq->cq_vector, false))
+			return;
+		nvmeq->coalesce_want = false;
+		nvmeq->coalesced = false;
+		nvmeq->rate_stamp = jiffies;
+		nvmeq->rate_cqes = 0;
+	}
+	dev->irq_coalesce = true;
+}
+
 static int nvme_setup_io_queues(struct nvme_dev *dev)
 {
 	struct nvme_queue *adminq = dev->queues[0];
 	struct pci_dev *pdev = to_pci_dev(dev->dev);
 	int result, nr_io_queues;
 	unsigned long size;
+	bool polled = poll_queues;
 
 	nr_io_queues = num_present_cpus();
+	if (polled)
+		nr_io_queues *= 2;
 	result = nvme_set_queue_count(&dev->ctrl, &nr_io_queues);
 	if (result < 0)
 		return result;
@@ -1757,6 +2091,10 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 	} while (1);
 	adminq->q_db = dev->dbs;
 
+	/* Poll queues only come in pairs with interrupt driven ones. */
+	if (nr_io_queues < 2)
+		polled = false;
+
 	/* Deregister the admin queue's interrupt */
 	pci_free_irq(pdev, 0, adminq);
 
@@ -1765,11 +2103,13 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 	 * setting up the full range we need.
 	 */
 	pci_free_irq_vectors(pdev);
-	nr_io_queues = pci_alloc_irq_vectors(pdev, 1, nr_io_queues,
+	nr_io_queues = pci_alloc_irq_vectors(pdev, 1,
+			polled ? nr_io_queues / 2 : nr_io_queues,
 			PCI_IRQ_ALL_TYPES | PCI_IRQ_AFFINITY);
 	if (nr_io_queues <= 0)
 		return -EIO;
-	dev->max_qid = nr_io_queues;
+	dev->nr_irq_queues = nr_io_queues;
+	dev->max_qid = polled ? nr_io_queues * 2 : nr_io_queues;
 
 	/*
 	 * Should investigate if there's a performance win from allocating
@@ -1783,7 +2123,13 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 		adminq->cq_vector = -1;
 		return result;
 	}
-	return nvme_create_io_queues(dev);
+
+	result = nvme_create_io_queues(dev);
+	if (result)
+		return result;
+
+	nvme_setup_irq_coalescing(dev);
+	return 0;
 }
 
 static void nvme_del_queue_end(struct request *req, blk_status_t error)
@@ -1875,7 +2221,7 @@ static int nvme_dev_add(struct nvme_dev *dev)
 {
 	if (!dev->ctrl.tagset) {
 		dev->tagset.ops = &nvme_mq_ops;
-		dev->tagset.nr_hw_queues = dev->online_queues - 1;
+		dev->tagset.nr_hw_queues = dev->io_queues;
 		dev->tagset.timeout = NVME_IO_TIMEOUT;
 		dev->tagset.numa_node = dev_to_node(dev->dev);
 		dev->tagset.queue_depth =
@@ -1890,7 +2236,7 @@ static int nvme_dev_add(struct nvme_dev *dev)
 
 		nvme_dbbuf_set(dev);
 	} else {
-		blk_mq_update_nr_hw_queues(&dev->tagset, dev->online_queues - 1);
+		blk_mq_update_nr_hw_queues(&dev->tagset, dev->io_queues);
 
 		/* Free previously allocated queues that are no longer usable */
 		nvme_free_queues(dev, dev->online_queues);
@@ -2130,6 +2476,7 @@ static void nvme_reset_work(struct work_struct *work)
 	 */
 	if (dev->ctrl.ctrl_config & NVME_CC_ENABLE)
 		nvme_dev_disable(dev, false);
+	cancel_work_sync(&dev->coalesce_work);
 
 	result = nvme_pci_enable(dev);
 	if (result)
@@ -2303,6 +2650,7 @@ static int nvme_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 
 	INIT_WORK(&dev->ctrl.reset_work, nvme_reset_work);
 	INIT_WORK(&dev->remove_work, nvme_remove_dead_ctrl_work);
+	INIT_WORK(&dev->coalesce_work, nvme_coalesce_work);
 	mutex_init(&dev->shutdown_lock);
 	init_completion(&dev->ioq_wait);
 
@@ -2376,6 +2724,7 @@ static void nvme_remove(struct pci_dev *pdev)
 	nvme_stop_ctrl(&dev->ctrl);
 	nvme_remove_namespaces(&dev->ctrl);
 	nvme_dev_disable(dev, true);
+	cancel_work_sync(&dev->coalesce_work);
 	nvme_free_host_mem(dev);
 	nvme_dev_remove_admin(dev);
 	nvme_free_queues(dev, 0);
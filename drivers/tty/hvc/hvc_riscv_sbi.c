@@ -23,16 +23,38 @@
 #include <linux/moduleparam.h>
 #include <linux/types.h>
 #include <linux/irq.h>
+#include <linux/of.h>
+#include <linux/of_irq.h>
 
 #include <asm/sbi.h>
 
 #include "hvc_console.h"
 
+/* Bytes hvc_console hands to put_chars at a time */
+#define HVC_SBI_OUTBUF_SIZE	256
+
+static bool hvc_sbi_write_unsupported;
+
+/*
+ * hvc_console passes either its kmalloc'ed outbuf or a buffer on the
+ * kernel stack, both of which are in the linear map, so they can go to
+ * the firmware a buffer per SBI call.
+ */
 static int hvc_sbi_tty_put(uint32_t vtermno, const char *buf, int count)
 {
-	int i;
+	long ret;
+	int i = 0;
 
-	for (i = 0; i < count; i++)
+	while (i < count && !hvc_sbi_write_unsupported) {
+		ret = sbi_console_write_buf(buf + i, count - i);
+		if (ret <= 0) {
+			hvc_sbi_write_unsupported = true;
+			break;
+		}
+		i += ret;
+	}
+
+	for ( ; i < count; i++)
 		sbi_console_putchar(buf[i]);
 
 	return i;
@@ -56,9 +78,40 @@ static const struct hv_ops hvc_sbi_ops = {
 	.put_chars = hvc_sbi_tty_put,
 };
 
+/* Input is signalled by an interrupt, so khvcd need not poll for it */
+static const struct hv_ops hvc_sbi_irq_ops = {
+	.get_chars = hvc_sbi_tty_get,
+	.put_chars = hvc_sbi_tty_put,
+	.notifier_add = notifier_add_irq,
+	.notifier_del = notifier_del_irq,
+	.notifier_hangup = notifier_hangup_irq,
+};
+
+/*
+ * Firmware that raises an interrupt when console input arrives describes
+ * it with a "riscv,sbi-console" node.  Without one, input is polled.
+ */
+static int __init hvc_sbi_irq(void)
+{
+	struct device_node *np;
+	int irq = 0;
+
+	np = of_find_compatible_node(NULL, NULL, "riscv,sbi-console");
+	if (np) {
+		irq = irq_of_parse_and_map(np, 0);
+		of_node_put(np);
+	}
+
+	return irq;
+}
+
 static int __init hvc_sbi_init(void)
 {
-	return PTR_ERR_OR_ZERO(hvc_alloc(0, 0, &hvc_sbi_ops, 16));
+	int irq = hvc_sbi_irq();
+
+	return PTR_ERR_OR_ZERO(hvc_alloc(0, irq,
+					 irq ? &hvc_sbi_irq_ops : &hvc_sbi_ops,
+					 HVC_SBI_OUTBUF_SIZE));
 }
 device_initcall(hvc_sbi_init);
 
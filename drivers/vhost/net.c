@@ -40,6 +40,12 @@ module_param(experimental_zcopytx, int, 0444);
 MODULE_PARM_DESC(experimental_zcopytx, "Enable Zero Copy TX;"
 		                       " 1 -Enable; 0 - Disable");
 
+static bool busy_poll_adaptive = true;
+module_param(busy_poll_adaptive, bool, 0644);
+MODULE_PARM_DESC(busy_poll_adaptive, "Shorten the busy loop of a ring that"
+		 " keeps idling, lengthen it again up to its timeout when work"
+		 " shows up");
+
 /* Max number of bytes transferred before requeueing the job.
  * Using this limit prevents one virtqueue from starving others. */
 #define VHOST_NET_WEIGHT 0x80000
@@ -48,6 +54,9 @@ MODULE_PARM_DESC(experimental_zcopytx, "Enable Zero Copy TX;"
 #define VHOST_MAX_PEND 128
 #define VHOST_GOODCOPY_LEN 256
 
+/* Max number of TX used buffers written to the guest at once when copying */
+#define VHOST_NET_BATCH 64
+
 /*
  * For transmit, used buffer len is unused; we override it to track buffer
  * status internally; used for zerocopy tx only.
@@ -110,6 +119,9 @@ struct vhost_net_virtqueue {
 	struct vhost_net_ubuf_ref *ubufs;
 	struct skb_array *rx_array;
 	struct vhost_net_buf rxq;
+	/* Copied TX buffers whose used entries are not written yet */
+	struct vring_used_elem batched[VHOST_NET_BATCH];
+	int nbatched;
 };
 
 struct vhost_net {
@@ -273,6 +285,7 @@ static void vhost_net_vq_reset(struct vhost_net *n)
 
 	for (i = 0; i < VHOST_NET_VQ_MAX; i++) {
 		n->vqs[i].done_idx = 0;
+		n->vqs[i].nbatched = 0;
 		n->vqs[i].upend_idx = 0;
 		n->vqs[i].ubufs = NULL;
 		n->vqs[i].vhost_hlen = 0;
@@ -373,13 +386,50 @@ static inline unsigned long busy_clock(void)
 	return local_clock() >> 10;
 }
 
-static bool vhost_can_busy_poll(struct vhost_dev *dev,
+static bool vhost_can_busy_poll(struct vhost_virtqueue *vq,
 				unsigned long endtime)
 {
 	return likely(!need_resched()) &&
 	       likely(!time_after(busy_clock(), endtime)) &&
 	       likely(!signal_pending(current)) &&
-	       !vhost_has_work(dev);
+	       !vhost_vq_has_work(vq);
+}
+
+/* Smallest busy loop window, as a shift of the busy loop timeout */
+#define VHOST_NET_BUSY_WINDOW_SHIFT 4
+
+static unsigned long vhost_net_busy_poll_start(struct vhost_virtqueue *vq,
+					       unsigned long *endtime)
+{
+	unsigned long start = busy_clock();
+
+	if (busy_poll_adaptive && vq->busyloop_window)
+		*endtime = start + vq->busyloop_window;
+	else
+		*endtime = start + vq->busyloop_timeout;
+	return start;
+}
+
+/*
+ * A loop that ran until its end found nothing to do: halve the window.
+ * Otherwise make it at least twice the time work took to show up, so
+ * that a ring going busy gets its full timeout back quickly.
+ */
+static void vhost_net_busy_poll_end(struct vhost_virtqueue *vq,
+				    unsigned long start, unsigned long endtime)
+{
+	unsigned long now = busy_clock();
+	u32 least = max(vq->busyloop_timeout >> VHOST_NET_BUSY_WINDOW_SHIFT, 1U);
+	u32 window = vq->busyloop_window;
+
+	if (!busy_poll_adaptive)
+		return;
+
+	if (time_after(now, endtime))
+		window = max(window >> 1, least);
+	else
+		window = max_t(unsigned long, window, 2 * (now - start));
+	vq->busyloop_window = min(window, vq->busyloop_timeout);
 }
 
 static void vhost_net_disable_vq(struct vhost_net *n,
@@ -413,16 +463,17 @@ static int vhost_net_tx_get_vq_desc(struct vhost_net *net,
 				    struct iovec iov[], unsigned int iov_size,
 				    unsigned int *out_num, unsigned int *in_num)
 {
-	unsigned long uninitialized_var(endtime);
+	unsigned long uninitialized_var(endtime), start;
 	int r = vhost_get_vq_desc(vq, vq->iov, ARRAY_SIZE(vq->iov),
 				  out_num, in_num, NULL, NULL);
 
 	if (r == vq->num && vq->busyloop_timeout) {
 		preempt_disable();
-		endtime = busy_clock() + vq->busyloop_timeout;
-		while (vhost_can_busy_poll(vq->dev, endtime) &&
+		start = vhost_net_busy_poll_start(vq, &endtime);
+		while (vhost_can_busy_poll(vq, endtime) &&
 		       vhost_vq_avail_empty(vq->dev, vq))
 			cpu_relax();
+		vhost_net_busy_poll_end(vq, start, endtime);
 		preempt_enable();
 		r = vhost_get_vq_desc(vq, vq->iov, ARRAY_SIZE(vq->iov),
 				      out_num, in_num, NULL, NULL);
@@ -440,9 +491,66 @@ static bool vhost_exceeds_maxpend(struct vhost_net *net)
 		== nvq->done_idx;
 }
 
-/* Expects to be always run from workqueue - which acts as
- * read-size critical section for our kind of RCU. */
-static void handle_tx(struct vhost_net *net)
+static void vhost_net_signal_used(struct vhost_net_virtqueue *nvq)
+{
+	struct vhost_virtqueue *vq = &nvq->vq;
+
+	if (!nvq->nbatched)
+		return;
+
+	vhost_add_used_and_signal_n(vq->dev, vq, nvq->batched, nvq->nbatched);
+	nvq->nbatched = 0;
+}
+
+/* Fetches the next TX buffer and points msg at its data, past the vnet
+ * header.  Returns the head, vq->num if there is none, or -EFAULT. */
+static int get_tx_bufs(struct vhost_net *net,
+		       struct vhost_net_virtqueue *nvq,
+		       struct msghdr *msg,
+		       unsigned int *out, unsigned int *in,
+		       size_t *len)
+{
+	struct vhost_virtqueue *vq = &nvq->vq;
+	int head;
+
+	head = vhost_net_tx_get_vq_desc(net, vq, vq->iov, ARRAY_SIZE(vq->iov),
+					out, in);
+	if (head < 0 || head == vq->num)
+		return head;
+
+	if (*in) {
+		vq_err(vq, "Unexpected descriptor format for TX: "
+		       "out %d, int %d\n", *out, *in);
+		return -EFAULT;
+	}
+	/* Skip header. TODO: support TSO. */
+	*len = iov_length(vq->iov, *out);
+	iov_iter_init(&msg->msg_iter, WRITE, vq->iov, *out, *len);
+	iov_iter_advance(&msg->msg_iter, nvq->vhost_hlen);
+	/* Sanity check */
+	if (!msg_data_left(msg)) {
+		vq_err(vq, "Unexpected header len for TX: "
+		       "%zd expected %zd\n",
+		       *len, nvq->vhost_hlen);
+		return -EFAULT;
+	}
+	*len = msg_data_left(msg);
+	return head;
+}
+
+/* More packets follow in this run of handle_tx? */
+static bool tx_can_batch(struct vhost_virtqueue *vq, size_t total_len)
+{
+	return total_len < VHOST_NET_WEIGHT &&
+	       !vhost_vq_avail_empty(vq->dev, vq);
+}
+
+/*
+ * Copying TX completes buffers as soon as sendmsg returns: their used
+ * entries are collected in nvq->batched and written, with a single guest
+ * notification, once per VHOST_NET_BATCH packets and when the run ends.
+ */
+static void handle_tx_copy(struct vhost_net *net, struct socket *sock)
 {
 	struct vhost_net_virtqueue *nvq = &net->vqs[VHOST_NET_VQ_TX];
 	struct vhost_virtqueue *vq = &nvq->vq;
@@ -457,28 +565,79 @@ static void handle_tx(struct vhost_net *net)
 	};
 	size_t len, total_len = 0;
 	int err;
-	size_t hdr_size;
-	struct socket *sock;
-	struct vhost_net_ubuf_ref *uninitialized_var(ubufs);
-	bool zcopy, zcopy_used;
 
-	mutex_lock(&vq->mutex);
-	sock = vq->private_data;
-	if (!sock)
-		goto out;
+	for (;;) {
+		head = get_tx_bufs(net, nvq, &msg, &out, &in, &len);
+		/* On error, stop handling until the next kick. */
+		if (unlikely(head < 0))
+			break;
+		/* Nothing new?  Wait for eventfd to tell us they refilled. */
+		if (head == vq->num) {
+			if (unlikely(vhost_enable_notify(&net->dev, vq))) {
+				vhost_disable_notify(&net->dev, vq);
+				continue;
+			}
+			break;
+		}
 
-	if (!vq_iotlb_prefetch(vq))
-		goto out;
+		total_len += len;
+		/* Let the socket batch its work until the last packet. */
+		if (tx_can_batch(vq, total_len))
+			msg.msg_flags |= MSG_MORE;
+		else
+			msg.msg_flags &= ~MSG_MORE;
 
-	vhost_disable_notify(&net->dev, vq);
+		/* TODO: Check specific error and bomb out unless ENOBUFS? */
+		err = sock->ops->sendmsg(sock, &msg, len);
+		if (unlikely(err < 0)) {
+			vhost_discard_vq_desc(vq, 1);
+			break;
+		}
+		if (err != len)
+			pr_debug("Truncated TX packet: "
+				 " len %d != %zd\n", err, len);
 
-	hdr_size = nvq->vhost_hlen;
-	zcopy = nvq->ubufs;
+		nvq->batched[nvq->nbatched].id = cpu_to_vhost32(vq, head);
+		nvq->batched[nvq->nbatched].len = 0;
+		if (++nvq->nbatched >= VHOST_NET_BATCH)
+			vhost_net_signal_used(nvq);
+		vhost_net_tx_packet(net);
+		if (unlikely(total_len >= VHOST_NET_WEIGHT)) {
+			vhost_poll_queue(&vq->poll);
+			break;
+		}
+	}
+
+	vhost_net_signal_used(nvq);
+}
+
+/*
+ * Zerocopy TX completes buffers when the lower device is done with them.
+ * Buffers it copies anyway are put in the same in-flight ring already
+ * done, so that all used entries go out in order and in batches from
+ * vhost_zerocopy_signal_used().
+ */
+static void handle_tx_zerocopy(struct vhost_net *net, struct socket *sock)
+{
+	struct vhost_net_virtqueue *nvq = &net->vqs[VHOST_NET_VQ_TX];
+	struct vhost_virtqueue *vq = &nvq->vq;
+	unsigned out, in;
+	int head;
+	struct msghdr msg = {
+		.msg_name = NULL,
+		.msg_namelen = 0,
+		.msg_control = NULL,
+		.msg_controllen = 0,
+		.msg_flags = MSG_DONTWAIT,
+	};
+	size_t len, total_len = 0;
+	int err;
+	struct vhost_net_ubuf_ref *uninitialized_var(ubufs);
+	bool zcopy_used;
 
 	for (;;) {
 		/* Release DMAs done buffers first */
-		if (zcopy)
-			vhost_zerocopy_signal_used(net, vq);
+		vhost_zerocopy_signal_used(net, vq);
 
 		/* If more outstanding DMAs, queue the work.
 		 * Handle upend_idx wrap around
@@ -486,9 +645,7 @@ static void handle_tx(struct vhost_net *net)
 		if (unlikely(vhost_exceeds_maxpend(net)))
 			break;
 
-		head = vhost_net_tx_get_vq_desc(net, vq, vq->iov,
-						ARRAY_SIZE(vq->iov),
-						&out, &in);
+		head = get_tx_bufs(net, nvq, &msg, &out, &in, &len);
 		/* On error, stop handling until the next kick. */
 		if (unlikely(head < 0))
 			break;
@@ -500,35 +657,19 @@ static void handle_tx(struct vhost_net *net)
 			}
 			break;
 		}
-		if (in) {
-			vq_err(vq, "Unexpected descriptor format for TX: "
-			       "out %d, int %d\n", out, in);
-			break;
-		}
-		/* Skip header. TODO: support TSO. */
-		len = iov_length(vq->iov, out);
-		iov_iter_init(&msg.msg_iter, WRITE, vq->iov, out, len);
-		iov_iter_advance(&msg.msg_iter, hdr_size);
-		/* Sanity check */
-		if (!msg_data_left(&msg)) {
-			vq_err(vq, "Unexpected header len for TX: "
-			       "%zd expected %zd\n",
-			       len, hdr_size);
-			break;
-		}
-		len = msg_data_left(&msg);
 
-		zcopy_used = zcopy && len >= VHOST_GOODCOPY_LEN
-				   && (nvq->upend_idx + 1) % UIO_MAXIOV !=
-				      nvq->done_idx
-				   && vhost_net_tx_select_zcopy(net);
+		zcopy_used = len >= VHOST_GOODCOPY_LEN
+			     && (nvq->upend_idx + 1) % UIO_MAXIOV !=
+				nvq->done_idx
+			     && vhost_net_tx_select_zcopy(net);
+
+		vq->heads[nvq->upend_idx].id = cpu_to_vhost32(vq, head);
 
 		/* use msg_control to pass vhost zerocopy ubuf info to skb */
 		if (zcopy_used) {
 			struct ubuf_info *ubuf;
 			ubuf = nvq->ubuf_info + nvq->upend_idx;
 
-			vq->heads[nvq->upend_idx].id = cpu_to_vhost32(vq, head);
 			vq->heads[nvq->upend_idx].len = VHOST_DMA_IN_PROGRESS;
 			ubuf->callback = vhost_zerocopy_callback;
 			ubuf->ctx = nvq->ubufs;
@@ -537,15 +678,15 @@ static void handle_tx(struct vhost_net *net)
 			msg.msg_controllen = sizeof(ubuf);
 			ubufs = nvq->ubufs;
 			atomic_inc(&ubufs->refcount);
-			nvq->upend_idx = (nvq->upend_idx + 1) % UIO_MAXIOV;
 		} else {
+			vq->heads[nvq->upend_idx].len = VHOST_DMA_DONE_LEN;
 			msg.msg_control = NULL;
 			ubufs = NULL;
 		}
+		nvq->upend_idx = (nvq->upend_idx + 1) % UIO_MAXIOV;
 
 		total_len += len;
-		if (total_len < VHOST_NET_WEIGHT &&
-		    !vhost_vq_avail_empty(&net->dev, vq) &&
+		if (tx_can_batch(vq, total_len) &&
 		    likely(!vhost_exceeds_maxpend(net))) {
 			msg.msg_flags |= MSG_MORE;
 		} else {
@@ -555,27 +696,49 @@ static void handle_tx(struct vhost_net *net)
 		/* TODO: Check specific error and bomb out unless ENOBUFS? */
 		err = sock->ops->sendmsg(sock, &msg, len);
 		if (unlikely(err < 0)) {
-			if (zcopy_used) {
+			if (zcopy_used)
 				vhost_net_ubuf_put(ubufs);
-				nvq->upend_idx = ((unsigned)nvq->upend_idx - 1)
-					% UIO_MAXIOV;
-			}
+			nvq->upend_idx = ((unsigned)nvq->upend_idx - 1)
+				% UIO_MAXIOV;
 			vhost_discard_vq_desc(vq, 1);
 			break;
 		}
 		if (err != len)
 			pr_debug("Truncated TX packet: "
 				 " len %d != %zd\n", err, len);
-		if (!zcopy_used)
-			vhost_add_used_and_signal(&net->dev, vq, head, 0);
-		else
-			vhost_zerocopy_signal_used(net, vq);
 		vhost_net_tx_packet(net);
 		if (unlikely(total_len >= VHOST_NET_WEIGHT)) {
 			vhost_poll_queue(&vq->poll);
 			break;
 		}
 	}
+
+	vhost_zerocopy_signal_used(net, vq);
+}
+
+/* Expects to be always run from workqueue - which acts as
+ * read-size critical section for our kind of RCU. */
+static void handle_tx(struct vhost_net *net)
+{
+	struct vhost_net_virtqueue *nvq = &net->vqs[VHOST_NET_VQ_TX];
+	struct vhost_virtqueue *vq = &nvq->vq;
+	struct socket *sock;
+
+	mutex_lock(&vq->mutex);
+	sock = vq->private_data;
+	if (!sock)
+		goto out;
+
+	if (!vq_iotlb_prefetch(vq))
+		goto out;
+
+	vhost_disable_notify(&net->dev, vq);
+
+	if (nvq->ubufs)
+		handle_tx_zerocopy(net, sock);
+	else
+		handle_tx_copy(net, sock);
+
 out:
 	mutex_unlock(&vq->mutex);
 }
@@ -616,7 +779,7 @@ static int vhost_net_rx_peek_head_len(struct vhost_net *net, struct sock *sk)
 	struct vhost_net_virtqueue *rvq = &net->vqs[VHOST_NET_VQ_RX];
 	struct vhost_net_virtqueue *nvq = &net->vqs[VHOST_NET_VQ_TX];
 	struct vhost_virtqueue *vq = &nvq->vq;
-	unsigned long uninitialized_var(endtime);
+	unsigned long uninitialized_var(endtime), start;
 	int len = peek_head_len(rvq, sk);
 
 	if (!len && vq->busyloop_timeout) {
@@ -625,13 +788,14 @@ static int vhost_net_rx_peek_head_len(struct vhost_net *net, struct sock *sk)
 		vhost_disable_notify(&net->dev, vq);
 
 		preempt_disable();
-		endtime = busy_clock() + vq->busyloop_timeout;
+		start = vhost_net_busy_poll_start(vq, &endtime);
 
-		while (vhost_can_busy_poll(&net->dev, endtime) &&
+		while (vhost_can_busy_poll(&rvq->vq, endtime) &&
 		       !sk_has_rx_data(sk) &&
 		       vhost_vq_avail_empty(&net->dev, vq))
 			cpu_relax();
 
+		vhost_net_busy_poll_end(vq, start, endtime);
 		preempt_enable();
 
 		if (vhost_enable_notify(&net->dev, vq))
@@ -925,14 +1089,17 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 		n->vqs[i].ubuf_info = NULL;
 		n->vqs[i].upend_idx = 0;
 		n->vqs[i].done_idx = 0;
+		n->vqs[i].nbatched = 0;
 		n->vqs[i].vhost_hlen = 0;
 		n->vqs[i].sock_hlen = 0;
 		vhost_net_buf_init(&n->vqs[i].rxq);
 	}
 	vhost_dev_init(dev, vqs, VHOST_NET_VQ_MAX);
 
-	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, POLLOUT, dev);
-	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, POLLIN, dev);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, POLLOUT, dev,
+			vqs[VHOST_NET_VQ_TX]);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, POLLIN, dev,
+			vqs[VHOST_NET_VQ_RX]);
 
 	f->private_data = n;
 
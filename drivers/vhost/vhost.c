@@ -49,6 +49,44 @@ enum {
 #define vhost_used_event(vq) ((__virtio16 __user *)&vq->avail->ring[vq->num])
 #define vhost_avail_event(vq) ((__virtio16 __user *)&vq->used->ring[vq->num])
 
+/* The packed ring indexes run freely and num is a power of 2 no larger than
+ * 2^15: the ring slot is the index modulo num, and the wrap counter, which
+ * starts at 1, flips with each pass over the ring. */
+static inline u16 vhost_packed_slot(struct vhost_virtqueue *vq, u16 idx)
+{
+	return idx & (vq->num - 1);
+}
+
+static inline bool vhost_packed_wrap(struct vhost_virtqueue *vq, u16 idx)
+{
+	return !(idx & vq->num);
+}
+
+static inline u16 vhost_packed_off_wrap(struct vhost_virtqueue *vq, u16 idx)
+{
+	return vhost_packed_slot(vq, idx) |
+	       (u16)vhost_packed_wrap(vq, idx) << VRING_PACKED_EVENT_F_WRAP_CTR;
+}
+
+/* The free running index of a ring slot and wrap counter, in the pass over
+ * the ring nearest to @idx. */
+static u16 vhost_packed_idx(struct vhost_virtqueue *vq, u16 off_wrap, u16 idx)
+{
+	u16 off = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+	bool wrap = off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR;
+	unsigned int period = 2 * vq->num;
+	u16 ret;
+	s16 d;
+
+	ret = (idx & ~(period - 1)) + (wrap ? 0 : vq->num) + off;
+	d = ret - idx;
+	if (d > (int)vq->num)
+		ret -= period;
+	else if (d < -(int)vq->num)
+		ret += period;
+	return ret;
+}
+
 INTERVAL_TREE_DEFINE(struct vhost_umem_node,
 		     rb, __u64, __subtree_last,
 		     START, LAST, static inline, vhost_umem_interval_tree);
@@ -187,12 +225,14 @@ EXPORT_SYMBOL_GPL(vhost_work_init);
 
 /* Init poll structure */
 void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
-		     unsigned long mask, struct vhost_dev *dev)
+		     unsigned long mask, struct vhost_dev *dev,
+		     struct vhost_virtqueue *vq)
 {
 	init_waitqueue_func_entry(&poll->wait, vhost_poll_wakeup);
 	init_poll_funcptr(&poll->table, vhost_poll_func);
 	poll->mask = mask;
 	poll->dev = dev;
+	poll->vq = vq;
 	poll->wqh = NULL;
 
 	vhost_work_init(&poll->work, fn);
@@ -233,54 +273,102 @@ void vhost_poll_stop(struct vhost_poll *poll)
 }
 EXPORT_SYMBOL_GPL(vhost_poll_stop);
 
-void vhost_work_flush(struct vhost_dev *dev, struct vhost_work *work)
+static struct vhost_worker *vhost_vq_worker(struct vhost_virtqueue *vq)
+{
+	struct vhost_worker *worker = READ_ONCE(vq->worker);
+
+	return worker ? worker : vq->dev->worker;
+}
+
+static struct vhost_worker *vhost_poll_worker(struct vhost_poll *poll)
+{
+	return poll->vq ? vhost_vq_worker(poll->vq) : poll->dev->worker;
+}
+
+static void vhost_worker_queue(struct vhost_worker *worker,
+			       struct vhost_work *work)
+{
+	if (!worker)
+		return;
+
+	if (!test_and_set_bit(VHOST_WORK_QUEUED, &work->flags)) {
+		/* We can only add the work to the list after we're
+		 * sure it was not in the list.
+		 * test_and_set_bit() implies a memory barrier.
+		 */
+		llist_add(&work->node, &worker->work_list);
+		wake_up_process(worker->task);
+	}
+}
+
+static void vhost_worker_flush(struct vhost_worker *worker)
 {
 	struct vhost_flush_struct flush;
 
-	if (dev->worker) {
+	if (worker) {
 		init_completion(&flush.wait_event);
 		vhost_work_init(&flush.work, vhost_flush_work);
 
-		vhost_work_queue(dev, &flush.work);
+		vhost_worker_queue(worker, &flush.work);
 		wait_for_completion(&flush.wait_event);
 	}
 }
+
+/* Flush the works of all the workers of the device */
+void vhost_work_flush(struct vhost_dev *dev, struct vhost_work *work)
+{
+	int i;
+
+	if (!dev->workers)
+		return;
+
+	for (i = 0; i < dev->nvqs; ++i)
+		vhost_worker_flush(dev->workers[i]);
+}
 EXPORT_SYMBOL_GPL(vhost_work_flush);
 
 /* Flush any work that has been scheduled. When calling this, don't hold any
  * locks that are also used by the callback. */
 void vhost_poll_flush(struct vhost_poll *poll)
 {
-	vhost_work_flush(poll->dev, &poll->work);
+	vhost_worker_flush(vhost_poll_worker(poll));
 }
 EXPORT_SYMBOL_GPL(vhost_poll_flush);
 
 void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work)
 {
-	if (!dev->worker)
-		return;
-
-	if (!test_and_set_bit(VHOST_WORK_QUEUED, &work->flags)) {
-		/* We can only add the work to the list after we're
-		 * sure it was not in the list.
-		 * test_and_set_bit() implies a memory barrier.
-		 */
-		llist_add(&work->node, &dev->work_list);
-		wake_up_process(dev->worker);
-	}
+	vhost_worker_queue(dev->worker, work);
 }
 EXPORT_SYMBOL_GPL(vhost_work_queue);
 
 /* A lockless hint for busy polling code to exit the loop */
 bool vhost_has_work(struct vhost_dev *dev)
 {
-	return !llist_empty(&dev->work_list);
+	int i;
+
+	if (!dev->workers)
+		return false;
+
+	for (i = 0; i < dev->nvqs; ++i)
+		if (dev->workers[i] &&
+		    !llist_empty(&dev->workers[i]->work_list))
+			return true;
+	return false;
 }
 EXPORT_SYMBOL_GPL(vhost_has_work);
 
+/* Same as vhost_has_work(), for the worker serving vq only */
+bool vhost_vq_has_work(struct vhost_virtqueue *vq)
+{
+	struct vhost_worker *worker = vhost_vq_worker(vq);
+
+	return worker && !llist_empty(&worker->work_list);
+}
+EXPORT_SYMBOL_GPL(vhost_vq_has_work);
+
 void vhost_poll_queue(struct vhost_poll *poll)
 {
-	vhost_work_queue(poll->dev, &poll->work);
+	vhost_worker_queue(vhost_poll_worker(poll), &poll->work);
 }
 EXPORT_SYMBOL_GPL(vhost_poll_queue);
 
@@ -327,6 +415,8 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 	vhost_reset_is_le(vq);
 	vhost_disable_cross_endian(vq);
 	vq->busyloop_timeout = 0;
+	vq->busyloop_window = 0;
+	vq->worker = NULL;
 	vq->umem = NULL;
 	vq->iotlb = NULL;
 	__vhost_vq_meta_reset(vq);
@@ -334,7 +424,8 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 
 static int vhost_worker(void *data)
 {
-	struct vhost_dev *dev = data;
+	struct vhost_worker *worker = data;
+	struct vhost_dev *dev = worker->dev;
 	struct vhost_work *work, *work_next;
 	struct llist_node *node;
 	mm_segment_t oldfs = get_fs();
@@ -351,7 +442,7 @@ static int vhost_worker(void *data)
 			break;
 		}
 
-		node = llist_del_all(&dev->work_list);
+		node = llist_del_all(&worker->work_list);
 		if (!node)
 			schedule();
 
@@ -379,6 +470,9 @@ static void vhost_vq_free_iovecs(struct vhost_virtqueue *vq)
 	vq->log = NULL;
 	kfree(vq->heads);
 	vq->heads = NULL;
+	kvfree(vq->packed_ndescs);
+	vq->packed_ndescs = NULL;
+	vq->packed_fetched = NULL;
 }
 
 /* Helper to allocate iovec buffers for all vqs. */
@@ -427,7 +521,7 @@ void vhost_dev_init(struct vhost_dev *dev,
 	dev->iotlb = NULL;
 	dev->mm = NULL;
 	dev->worker = NULL;
-	init_llist_head(&dev->work_list);
+	dev->workers = NULL;
 	init_waitqueue_head(&dev->wait);
 	INIT_LIST_HEAD(&dev->read_list);
 	INIT_LIST_HEAD(&dev->pending_list);
@@ -439,12 +533,14 @@ void vhost_dev_init(struct vhost_dev *dev,
 		vq->log = NULL;
 		vq->indirect = NULL;
 		vq->heads = NULL;
+		vq->packed_ndescs = NULL;
+		vq->packed_fetched = NULL;
 		vq->dev = dev;
 		mutex_init(&vq->mutex);
 		vhost_vq_reset(dev, vq);
 		if (vq->handle_kick)
 			vhost_poll_init(&vq->poll, vq->handle_kick,
-					POLLIN, dev);
+					POLLIN, dev, vq);
 	}
 }
 EXPORT_SYMBOL_GPL(vhost_dev_init);
@@ -471,17 +567,98 @@ static void vhost_attach_cgroups_work(struct vhost_work *work)
 	s->ret = cgroup_attach_task_all(s->owner, current);
 }
 
-static int vhost_attach_cgroups(struct vhost_dev *dev)
+static int vhost_attach_cgroups(struct vhost_worker *worker)
 {
 	struct vhost_attach_cgroups_struct attach;
 
 	attach.owner = current;
 	vhost_work_init(&attach.work, vhost_attach_cgroups_work);
-	vhost_work_queue(dev, &attach.work);
-	vhost_work_flush(dev, &attach.work);
+	vhost_worker_queue(worker, &attach.work);
+	vhost_worker_flush(worker);
 	return attach.ret;
 }
 
+static void vhost_worker_destroy(struct vhost_worker *worker)
+{
+	WARN_ON(!llist_empty(&worker->work_list));
+	kthread_stop(worker->task);
+	kfree(worker);
+}
+
+/* Caller should have device mutex */
+static struct vhost_worker *vhost_worker_create(struct vhost_dev *dev, int id)
+{
+	struct vhost_worker *worker;
+	struct task_struct *task;
+	int err;
+
+	worker = kzalloc(sizeof(*worker), GFP_KERNEL);
+	if (!worker)
+		return ERR_PTR(-ENOMEM);
+
+	worker->dev = dev;
+	worker->id = id;
+	init_llist_head(&worker->work_list);
+
+	task = kthread_create(vhost_worker, worker, "vhost-%d", current->pid);
+	if (IS_ERR(task)) {
+		kfree(worker);
+		return ERR_CAST(task);
+	}
+
+	worker->task = task;
+	wake_up_process(task);	/* avoid contributing to loadavg */
+
+	err = vhost_attach_cgroups(worker);
+	if (err) {
+		vhost_worker_destroy(worker);
+		return ERR_PTR(err);
+	}
+
+	dev->workers[id] = worker;
+	return worker;
+}
+
+/* Caller should have device mutex */
+static void vhost_dev_free_workers(struct vhost_dev *dev)
+{
+	int i;
+
+	if (!dev->workers)
+		return;
+
+	for (i = 0; i < dev->nvqs; ++i)
+		if (dev->workers[i])
+			vhost_worker_destroy(dev->workers[i]);
+	kfree(dev->workers);
+	dev->workers = NULL;
+	dev->worker = NULL;
+}
+
+/* Caller should have device mutex */
+static long vhost_set_worker_cpu(struct vhost_dev *d, void __user *argp)
+{
+	struct vhost_vring_state s;
+	const struct cpumask *mask;
+
+	if (copy_from_user(&s, argp, sizeof(s)))
+		return -EFAULT;
+	if (s.index >= d->nvqs || !d->workers[s.index])
+		return -ENOENT;
+
+	/* Stay within what the owner may run on. */
+	if (s.num == VHOST_WORKER_CPU_ANY) {
+		mask = &current->cpus_allowed;
+	} else {
+		if (s.num >= nr_cpu_ids ||
+		    !cpumask_test_cpu(s.num, &current->cpus_allowed))
+			return -EINVAL;
+		mask = cpumask_of(s.num);
+	}
+
+	return set_cpus_allowed_ptr(d->workers[s.index]->task, mask);
+}
+
 /* Caller should have device mutex */
 bool vhost_dev_has_owner(struct vhost_dev *dev)
 {
@@ -492,7 +669,7 @@ EXPORT_SYMBOL_GPL(vhost_dev_has_owner);
 /* Caller should have device mutex */
 long vhost_dev_set_owner(struct vhost_dev *dev)
 {
-	struct task_struct *worker;
+	struct vhost_worker *worker;
 	int err;
 
 	/* Is there an owner already? */
@@ -503,18 +680,18 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	/* No owner, become one */
 	dev->mm = get_task_mm(current);
-	worker = kthread_create(vhost_worker, dev, "vhost-%d", current->pid);
-	if (IS_ERR(worker)) {
-		err = PTR_ERR(worker);
+	dev->workers = kcalloc(dev->nvqs, sizeof(*dev->workers), GFP_KERNEL);
+	if (!dev->workers) {
+		err = -ENOMEM;
 		goto err_worker;
 	}
 
-	dev->worker = worker;
-	wake_up_process(worker);	/* avoid contributing to loadavg */
-
-	err = vhost_attach_cgroups(dev);
-	if (err)
+	worker = vhost_worker_create(dev, 0);
+	if (IS_ERR(worker)) {
+		err = PTR_ERR(worker);
 		goto err_cgroup;
+	}
+	dev->worker = worker;
 
 	err = vhost_dev_alloc_iovecs(dev);
 	if (err)
@@ -522,8 +699,7 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	return 0;
 err_cgroup:
-	kthread_stop(worker);
-	dev->worker = NULL;
+	vhost_dev_free_workers(dev);
 err_worker:
 	if (dev->mm)
 		mmput(dev->mm);
@@ -643,11 +819,7 @@ void vhost_dev_cleanup(struct vhost_dev *dev, bool locked)
 	dev->iotlb = NULL;
 	vhost_clear_msg(dev);
 	wake_up_interruptible_poll(&dev->wait, POLLIN | POLLRDNORM);
-	WARN_ON(!llist_empty(&dev->work_list));
-	if (dev->worker) {
-		kthread_stop(dev->worker);
-		dev->worker = NULL;
-	}
+	vhost_dev_free_workers(dev);
 	if (dev->mm)
 		mmput(dev->mm);
 	dev->mm = NULL;
@@ -859,7 +1031,7 @@ static inline void __user *__vhost_get_user(struct vhost_virtqueue *vq,
 	return __vhost_get_user_slow(vq, addr, size, type);
 }
 
-#define vhost_put_user(vq, x, ptr)		\
+#define __vhost_put_user(vq, x, ptr, type)	\
 ({ \
 	int ret = -EFAULT; \
 	if (!vq->iotlb) { \
@@ -867,7 +1039,7 @@ static inline void __user *__vhost_get_user(struct vhost_virtqueue *vq,
 	} else { \
 		__typeof__(ptr) to = \
 			(__typeof__(ptr)) __vhost_get_user(vq, ptr,	\
-					  sizeof(*ptr), VHOST_ADDR_USED); \
+					  sizeof(*ptr), type); \
 		if (to != NULL) \
 			ret = __put_user(x, to); \
 		else \
@@ -876,6 +1048,13 @@ static inline void __user *__vhost_get_user(struct vhost_virtqueue *vq,
 	ret; \
 })
 
+#define vhost_put_user(vq, x, ptr) \
+	__vhost_put_user(vq, x, ptr, VHOST_ADDR_USED)
+
+/* The device writes used descriptors back into a packed ring. */
+#define vhost_put_desc(vq, x, ptr) \
+	__vhost_put_user(vq, x, ptr, VHOST_ADDR_DESC)
+
 #define vhost_get_user(vq, x, ptr, type)		\
 ({ \
 	int ret; \
@@ -900,6 +1079,9 @@ static inline void __user *__vhost_get_user(struct vhost_virtqueue *vq,
 #define vhost_get_used(vq, x, ptr) \
 	vhost_get_user(vq, x, ptr, VHOST_ADDR_USED)
 
+#define vhost_get_desc(vq, x, ptr) \
+	vhost_get_user(vq, x, ptr, VHOST_ADDR_DESC)
+
 static void vhost_dev_lock_vqs(struct vhost_dev *d)
 {
 	int i = 0;
@@ -1152,6 +1334,14 @@ static int vq_access_ok(struct vhost_virtqueue *vq, unsigned int num,
 {
 	size_t s = vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX) ? 2 : 0;
 
+	if (vhost_has_feature(vq, VIRTIO_F_RING_PACKED))
+		return access_ok(VERIFY_WRITE, desc,
+				 num * sizeof(struct vring_packed_desc)) &&
+		       access_ok(VERIFY_READ, avail,
+				 sizeof(struct vring_packed_desc_event)) &&
+		       access_ok(VERIFY_WRITE, used,
+				 sizeof(struct vring_packed_desc_event));
+
 	return access_ok(VERIFY_READ, desc, num * sizeof *desc) &&
 	       access_ok(VERIFY_READ, avail,
 			 sizeof *avail + num * sizeof *avail->ring + s) &&
@@ -1166,7 +1356,11 @@ static void vhost_vq_meta_update(struct vhost_virtqueue *vq,
 	int access = (type == VHOST_ADDR_USED) ?
 		     VHOST_ACCESS_WO : VHOST_ACCESS_RO;
 
-	if (likely(node->perm & access))
+	if (type == VHOST_ADDR_DESC &&
+	    vhost_has_feature(vq, VIRTIO_F_RING_PACKED))
+		access = VHOST_ACCESS_RW;
+
+	if (likely((node->perm & access) == access))
 		vq->meta_iotlb[type] = node;
 }
 
@@ -1187,7 +1381,7 @@ static int iotlb_access_ok(struct vhost_virtqueue *vq,
 		if (node == NULL || node->start > addr) {
 			vhost_iotlb_miss(vq, addr, access);
 			return false;
-		} else if (!(node->perm & access)) {
+		} else if ((node->perm & access) != access) {
 			/* Report the possible access violation by
 			 * request another translation from userspace.
 			 */
@@ -1214,6 +1408,20 @@ int vq_iotlb_prefetch(struct vhost_virtqueue *vq)
 	if (!vq->iotlb)
 		return 1;
 
+	if (vhost_has_feature(vq, VIRTIO_F_RING_PACKED))
+		return iotlb_access_ok(vq, VHOST_ACCESS_RW,
+				       (u64)(uintptr_t)vq->desc_packed,
+				       num * sizeof(*vq->desc_packed),
+				       VHOST_ADDR_DESC) &&
+		       iotlb_access_ok(vq, VHOST_ACCESS_RO,
+				       (u64)(uintptr_t)vq->driver_event,
+				       sizeof(*vq->driver_event),
+				       VHOST_ADDR_AVAIL) &&
+		       iotlb_access_ok(vq, VHOST_ACCESS_WO,
+				       (u64)(uintptr_t)vq->device_event,
+				       sizeof(*vq->device_event),
+				       VHOST_ADDR_USED);
+
 	return iotlb_access_ok(vq, VHOST_ACCESS_RO, (u64)(uintptr_t)vq->desc,
 			       num * sizeof(*vq->desc), VHOST_ADDR_DESC) &&
 	       iotlb_access_ok(vq, VHOST_ACCESS_RO, (u64)(uintptr_t)vq->avail,
@@ -1235,18 +1443,27 @@ int vhost_log_access_ok(struct vhost_dev *dev)
 }
 EXPORT_SYMBOL_GPL(vhost_log_access_ok);
 
+/* Size of the ring area whose writes are logged from log_addr: the used
+ * ring, or the descriptor ring of a packed ring. */
+static size_t vhost_log_used_size(struct vhost_virtqueue *vq)
+{
+	size_t s = vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX) ? 2 : 0;
+
+	if (vhost_has_feature(vq, VIRTIO_F_RING_PACKED))
+		return vq->num * sizeof(struct vring_packed_desc);
+
+	return sizeof *vq->used + vq->num * sizeof *vq->used->ring + s;
+}
+
 /* Verify access for write logging. */
 /* Caller should have vq mutex and device mutex */
 static int vq_log_access_ok(struct vhost_virtqueue *vq,
 			    void __user *log_base)
 {
-	size_t s = vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX) ? 2 : 0;
-
 	return vq_memory_access_ok(log_base, vq->umem,
 				   vhost_has_feature(vq, VHOST_F_LOG_ALL)) &&
 		(!vq->log_used || log_access_ok(log_base, vq->log_addr,
-					sizeof *vq->used +
-					vq->num * sizeof *vq->used->ring + s));
+						vhost_log_used_size(vq)));
 }
 
 /* Can we start vq? */
@@ -1355,6 +1572,7 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 	struct vhost_vring_state s;
 	struct vhost_vring_file f;
 	struct vhost_vring_addr a;
+	struct vhost_worker *worker, *oldworker = NULL;
 	u32 idx;
 	long r;
 
@@ -1384,6 +1602,11 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 			r = -EINVAL;
 			break;
 		}
+		if (s.num != vq->num) {
+			kvfree(vq->packed_ndescs);
+			vq->packed_ndescs = NULL;
+			vq->packed_fetched = NULL;
+		}
 		vq->num = s.num;
 		break;
 	case VHOST_SET_VRING_BASE:
@@ -1397,17 +1620,33 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 			r = -EFAULT;
 			break;
 		}
-		if (s.num > 0xffff) {
+		if (vhost_has_feature(vq, VIRTIO_F_RING_PACKED)) {
+			/* The avail and used ring slots with their wrap
+			 * counters in bit 15, in the low and high half. */
+			if ((s.num & 0x7fff) >= vq->num ||
+			    ((s.num >> 16) & 0x7fff) >= vq->num) {
+				r = -EINVAL;
+				break;
+			}
+			vq->last_avail_idx = vhost_packed_idx(vq, s.num, 0);
+			vq->last_used_idx = vhost_packed_idx(vq, s.num >> 16, 0);
+		} else if (s.num > 0xffff) {
 			r = -EINVAL;
 			break;
+		} else {
+			vq->last_avail_idx = s.num;
 		}
-		vq->last_avail_idx = s.num;
 		/* Forget the cached index value. */
 		vq->avail_idx = vq->last_avail_idx;
 		break;
 	case VHOST_GET_VRING_BASE:
 		s.index = idx;
-		s.num = vq->last_avail_idx;
+		if (vhost_has_feature(vq, VIRTIO_F_RING_PACKED))
+			s.num = vhost_packed_off_wrap(vq, vq->last_avail_idx) |
+				(u32)vhost_packed_off_wrap(vq,
+					vq->last_used_idx) << 16;
+		else
+			s.num = vq->last_avail_idx;
 		if (copy_to_user(argp, &s, sizeof s))
 			r = -EFAULT;
 		break;
@@ -1454,8 +1693,7 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 			/* Also validate log access for used ring if enabled. */
 			if ((a.flags & (0x1 << VHOST_VRING_F_LOG)) &&
 			    !log_access_ok(vq->log_base, a.log_guest_addr,
-					   sizeof *vq->used +
-					   vq->num * sizeof *vq->used->ring)) {
+					   vhost_log_used_size(vq))) {
 				r = -EINVAL;
 				break;
 			}
@@ -1533,6 +1771,7 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 			break;
 		}
 		vq->busyloop_timeout = s.num;
+		vq->busyloop_window = s.num;
 		break;
 	case VHOST_GET_VRING_BUSYLOOP_TIMEOUT:
 		s.index = idx;
@@ -1540,6 +1779,36 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 		if (copy_to_user(argp, &s, sizeof(s)))
 			r = -EFAULT;
 		break;
+	case VHOST_SET_VRING_WORKER:
+		if (copy_from_user(&s, argp, sizeof(s))) {
+			r = -EFAULT;
+			break;
+		}
+		if (s.num >= d->nvqs) {
+			r = -EINVAL;
+			break;
+		}
+		if (vq->private_data) {
+			r = -EBUSY;
+			break;
+		}
+		worker = d->workers[s.num];
+		if (!worker) {
+			worker = vhost_worker_create(d, s.num);
+			if (IS_ERR(worker)) {
+				r = PTR_ERR(worker);
+				break;
+			}
+		}
+		oldworker = vhost_vq_worker(vq);
+		WRITE_ONCE(vq->worker, worker == d->worker ? NULL : worker);
+		break;
+	case VHOST_GET_VRING_WORKER:
+		s.index = idx;
+		s.num = vhost_vq_worker(vq)->id;
+		if (copy_to_user(argp, &s, sizeof(s)))
+			r = -EFAULT;
+		break;
 	default:
 		r = -ENOIOCTLCMD;
 	}
@@ -1559,6 +1828,9 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 
 	if (pollstop && vq->handle_kick)
 		vhost_poll_flush(&vq->poll);
+	/* Kicks may still have been queued on the worker we left. */
+	if (oldworker)
+		vhost_worker_flush(oldworker);
 	return r;
 }
 EXPORT_SYMBOL_GPL(vhost_vring_ioctl);
@@ -1611,6 +1883,9 @@ long vhost_dev_ioctl(struct vhost_dev *d, unsigned int ioctl, void __user *argp)
 	case VHOST_SET_MEM_TABLE:
 		r = vhost_set_memory(d, argp);
 		break;
+	case VHOST_SET_WORKER_CPU:
+		r = vhost_set_worker_cpu(d, argp);
+		break;
 	case VHOST_SET_LOG_BASE:
 		if (copy_from_user(&p, argp, sizeof p)) {
 			r = -EFAULT;
@@ -1744,9 +2019,38 @@ int vhost_log_write(struct vhost_virtqueue *vq, struct vhost_log *log,
 }
 EXPORT_SYMBOL_GPL(vhost_log_write);
 
+/* Tell the guest whether, or from which descriptor on, to notify us of a
+ * packed ring.  The device event area isn't logged: only log_addr, the
+ * descriptor ring, is known to be in guest memory. */
+static int vhost_update_device_event(struct vhost_virtqueue *vq)
+{
+	u16 flags = VRING_PACKED_EVENT_FLAG_DISABLE;
+
+	if (!(vq->used_flags & VRING_USED_F_NO_NOTIFY)) {
+		if (vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX)) {
+			if (vhost_put_user(vq, cpu_to_le16(vhost_packed_off_wrap(vq,
+					   vq->last_avail_idx)),
+					   &vq->device_event->off_wrap))
+				return -EFAULT;
+			/* The offset must be seen before the flags. */
+			smp_wmb();
+			flags = VRING_PACKED_EVENT_FLAG_DESC;
+		} else {
+			flags = VRING_PACKED_EVENT_FLAG_ENABLE;
+		}
+	}
+	if (vhost_put_user(vq, cpu_to_le16(flags), &vq->device_event->flags))
+		return -EFAULT;
+	return 0;
+}
+
 static int vhost_update_used_flags(struct vhost_virtqueue *vq)
 {
 	void __user *used;
+
+	if (vhost_has_feature(vq, VIRTIO_F_RING_PACKED))
+		return vhost_update_device_event(vq);
+
 	if (vhost_put_user(vq, cpu_to_vhost16(vq, vq->used_flags),
 			   &vq->used->flags) < 0)
 		return -EFAULT;
@@ -1795,10 +2099,26 @@ int vhost_vq_init_access(struct vhost_virtqueue *vq)
 
 	vhost_init_is_le(vq);
 
+	if (vhost_has_feature(vq, VIRTIO_F_RING_PACKED) &&
+	    !vq->packed_ndescs) {
+		vq->packed_ndescs = kvmalloc_array(2 * vq->num,
+						   sizeof *vq->packed_ndescs,
+						   GFP_KERNEL);
+		if (!vq->packed_ndescs) {
+			r = -ENOMEM;
+			goto err;
+		}
+		vq->packed_fetched = vq->packed_ndescs + vq->num;
+		vq->packed_fetch_idx = 0;
+	}
+
 	r = vhost_update_used_flags(vq);
 	if (r)
 		goto err;
 	vq->signalled_used_valid = false;
+	/* A packed ring has no used index, SET_VRING_BASE gave ours. */
+	if (vhost_has_feature(vq, VIRTIO_F_RING_PACKED))
+		return 0;
 	if (!vq->iotlb &&
 	    !access_ok(VERIFY_READ, &vq->used->idx, sizeof vq->used->idx)) {
 		r = -EFAULT;
@@ -1984,6 +2304,221 @@ static int get_indirect(struct vhost_virtqueue *vq,
 	return 0;
 }
 
+/* Add one packed ring descriptor to the iovecs, after those already there. */
+static int packed_desc_iov(struct vhost_virtqueue *vq,
+			   struct vring_packed_desc *desc,
+			   struct iovec iov[], unsigned int iov_size,
+			   unsigned int *out_num, unsigned int *in_num,
+			   struct vhost_log *log, unsigned int *log_num)
+{
+	unsigned iov_count = *in_num + *out_num;
+	int ret, access;
+
+	if (desc->flags & cpu_to_le16(VRING_DESC_F_WRITE))
+		access = VHOST_ACCESS_WO;
+	else
+		access = VHOST_ACCESS_RO;
+	ret = translate_desc(vq, le64_to_cpu(desc->addr),
+			     le32_to_cpu(desc->len), iov + iov_count,
+			     iov_size - iov_count, access);
+	if (unlikely(ret < 0)) {
+		if (ret != -EAGAIN)
+			vq_err(vq, "Translation failure %d descriptor addr 0x%llx\n",
+			       ret, (unsigned long long)le64_to_cpu(desc->addr));
+		return ret;
+	}
+	if (access == VHOST_ACCESS_WO) {
+		/* If this is an input descriptor,
+		 * increment that count. */
+		*in_num += ret;
+		if (unlikely(log)) {
+			log[*log_num].addr = le64_to_cpu(desc->addr);
+			log[*log_num].len = le32_to_cpu(desc->len);
+			++*log_num;
+		}
+	} else {
+		/* If it's an output descriptor, they're all supposed
+		 * to come before any input descriptors. */
+		if (unlikely(*in_num)) {
+			vq_err(vq, "Descriptor has out after in\n");
+			return -EINVAL;
+		}
+		*out_num += ret;
+	}
+	return 0;
+}
+
+static int get_indirect_packed(struct vhost_virtqueue *vq,
+			       struct iovec iov[], unsigned int iov_size,
+			       unsigned int *out_num, unsigned int *in_num,
+			       struct vhost_log *log, unsigned int *log_num,
+			       struct vring_packed_desc *indirect)
+{
+	struct vring_packed_desc desc;
+	unsigned int i, count;
+	u32 len = le32_to_cpu(indirect->len);
+	struct iov_iter from;
+	int ret;
+
+	/* Sanity check */
+	if (unlikely(!len || len % sizeof desc)) {
+		vq_err(vq, "Invalid length in indirect descriptor: "
+		       "len 0x%llx not multiple of 0x%zx\n",
+		       (unsigned long long)len,
+		       sizeof desc);
+		return -EINVAL;
+	}
+
+	ret = translate_desc(vq, le64_to_cpu(indirect->addr), len,
+			     vq->indirect, UIO_MAXIOV, VHOST_ACCESS_RO);
+	if (unlikely(ret < 0)) {
+		if (ret != -EAGAIN)
+			vq_err(vq, "Translation failure %d in indirect.\n", ret);
+		return ret;
+	}
+	iov_iter_init(&from, READ, vq->indirect, ret, len);
+
+	/* We will use the result as an address to read from, so most
+	 * architectures only need a compiler barrier here. */
+	read_barrier_depends();
+
+	/* The table is read in order, there is no next field to follow. */
+	count = len / sizeof desc;
+	for (i = 0; i < count; i++) {
+		if (unlikely(!copy_from_iter_full(&desc, sizeof(desc), &from))) {
+			vq_err(vq, "Failed indirect descriptor: idx %d, %zx\n",
+			       i, (size_t)le64_to_cpu(indirect->addr) + i * sizeof desc);
+			return -EINVAL;
+		}
+		if (unlikely(desc.flags & cpu_to_le16(VRING_DESC_F_INDIRECT))) {
+			vq_err(vq, "Nested indirect descriptor: idx %d, %zx\n",
+			       i, (size_t)le64_to_cpu(indirect->addr) + i * sizeof desc);
+			return -EINVAL;
+		}
+		ret = packed_desc_iov(vq, &desc, iov, iov_size, out_num,
+				      in_num, log, log_num);
+		if (unlikely(ret < 0))
+			return ret;
+	}
+	return 0;
+}
+
+static bool packed_desc_avail(struct vhost_virtqueue *vq, __le16 flags,
+			      u16 idx)
+{
+	bool wrap = vhost_packed_wrap(vq, idx);
+
+	return !!(flags & cpu_to_le16(1 << VRING_PACKED_DESC_F_AVAIL)) == wrap &&
+	       !!(flags & cpu_to_le16(1 << VRING_PACKED_DESC_F_USED)) != wrap;
+}
+
+/* The packed ring counterpart of vhost_get_vq_desc(): the guest makes the
+ * descriptors of a buffer available in ring order, the head last, and the
+ * buffer id is in the last one. */
+static int vhost_get_vq_desc_packed(struct vhost_virtqueue *vq,
+				    struct iovec iov[], unsigned int iov_size,
+				    unsigned int *out_num, unsigned int *in_num,
+				    struct vhost_log *log, unsigned int *log_num)
+{
+	struct vring_packed_desc desc;
+	struct vring_packed_desc __user *d;
+	unsigned int found = 0;
+	u16 idx = vq->last_avail_idx;
+	__le16 flags;
+	u16 id;
+	int ret;
+
+	if (unlikely(!vq->packed_ndescs)) {
+		vq_err(vq, "Packed ring used before it was initialized\n");
+		return -EINVAL;
+	}
+
+	d = vq->desc_packed + vhost_packed_slot(vq, idx);
+	if (unlikely(vhost_get_desc(vq, flags, &d->flags))) {
+		vq_err(vq, "Failed to access descriptor flags at %p\n",
+		       &d->flags);
+		return -EFAULT;
+	}
+
+	/* If there's nothing new since last we looked, return invalid. */
+	if (!packed_desc_avail(vq, flags, idx))
+		return vq->num;
+
+	/* Only read the descriptors after the head has been exposed by
+	 * guest. */
+	smp_rmb();
+
+	/* When we start there are none of either input nor output. */
+	*out_num = *in_num = 0;
+	if (unlikely(log))
+		*log_num = 0;
+
+	do {
+		if (unlikely(++found > vq->num)) {
+			vq_err(vq, "Loop detected: last one at %u "
+			       "vq size %u\n", idx, vq->num);
+			return -EINVAL;
+		}
+		d = vq->desc_packed + vhost_packed_slot(vq, idx);
+		ret = vhost_copy_from_user(vq, &desc, d, sizeof desc);
+		if (unlikely(ret)) {
+			vq_err(vq, "Failed to get descriptor: idx %d addr %p\n",
+			       idx, d);
+			return -EFAULT;
+		}
+		if (unlikely(!packed_desc_avail(vq, desc.flags, idx))) {
+			vq_err(vq, "Descriptor list not available: idx %u\n",
+			       idx);
+			return -EINVAL;
+		}
+		idx++;
+
+		if (desc.flags & cpu_to_le16(VRING_DESC_F_INDIRECT)) {
+			if (unlikely(found > 1 ||
+				     desc.flags & cpu_to_le16(VRING_DESC_F_NEXT))) {
+				vq_err(vq, "Indirect descriptor in a list: "
+				       "idx %u\n", idx - 1);
+				return -EINVAL;
+			}
+			ret = get_indirect_packed(vq, iov, iov_size,
+						  out_num, in_num,
+						  log, log_num, &desc);
+			if (unlikely(ret < 0)) {
+				if (ret != -EAGAIN)
+					vq_err(vq, "Failure detected "
+						"in indirect descriptor at idx %d\n",
+						idx - 1);
+				return ret;
+			}
+			continue;
+		}
+
+		ret = packed_desc_iov(vq, &desc, iov, iov_size, out_num,
+				      in_num, log, log_num);
+		if (unlikely(ret < 0))
+			return ret;
+	} while (desc.flags & cpu_to_le16(VRING_DESC_F_NEXT));
+
+	id = le16_to_cpu(desc.id);
+	if (unlikely(id >= vq->num)) {
+		vq_err(vq, "Guest says buffer id %u > %u is available",
+		       id, vq->num);
+		return -EINVAL;
+	}
+
+	/* On success, move past the list and remember its length: used
+	 * buffers skip as many slots, discarded ones give them back. */
+	vq->packed_ndescs[id] = found;
+	vq->packed_fetched[vq->packed_fetch_idx++ & (vq->num - 1)] = found;
+	vq->last_avail_idx = idx;
+	vq->avail_idx = idx;
+
+	/* Assume notifications from guest are disabled at this point,
+	 * if they aren't we would need to update the device event. */
+	BUG_ON(!(vq->used_flags & VRING_USED_F_NO_NOTIFY));
+	return id;
+}
+
 /* This looks in the virtqueue and for the first available buffer, and converts
  * it to an iovec for convenient access.  Since descriptors consist of some
  * number of output then some number of input descriptors, it's actually two
@@ -2004,6 +2539,10 @@ int vhost_get_vq_desc(struct vhost_virtqueue *vq,
 	__virtio16 ring_head;
 	int ret, access;
 
+	if (vhost_has_feature(vq, VIRTIO_F_RING_PACKED))
+		return vhost_get_vq_desc_packed(vq, iov, iov_size, out_num,
+						in_num, log, log_num);
+
 	/* Check it isn't doing very strange things with descriptor numbers. */
 	last_avail_idx = vq->last_avail_idx;
 
@@ -2138,6 +2677,14 @@ EXPORT_SYMBOL_GPL(vhost_get_vq_desc);
 /* Reverse the effect of vhost_get_vq_desc. Useful for error handling. */
 void vhost_discard_vq_desc(struct vhost_virtqueue *vq, int n)
 {
+	if (vhost_has_feature(vq, VIRTIO_F_RING_PACKED)) {
+		/* Step back over the lists of the last n buffers. */
+		while (n--)
+			vq->last_avail_idx -= vq->packed_fetched[
+				--vq->packed_fetch_idx & (vq->num - 1)];
+		vq->avail_idx = vq->last_avail_idx;
+		return;
+	}
 	vq->last_avail_idx -= n;
 }
 EXPORT_SYMBOL_GPL(vhost_discard_vq_desc);
@@ -2198,6 +2745,81 @@ static int __vhost_add_used_n(struct vhost_virtqueue *vq,
 	return 0;
 }
 
+/* A packed ring takes used buffers back in its descriptor slots, each
+ * skipping the length of its list.  The first flags written make the whole
+ * batch visible to the guest, so they go last. */
+static int vhost_add_used_n_packed(struct vhost_virtqueue *vq,
+				   struct vring_used_elem *heads,
+				   unsigned count)
+{
+	struct vring_packed_desc __user *desc, *first = NULL;
+	__le16 flags, uninitialized_var(first_flags);
+	unsigned int i;
+	u16 old, new, id;
+
+	old = vq->last_used_idx;
+	for (i = 0; i < count; i++) {
+		id = vhost32_to_cpu(vq, heads[i].id);
+		if (unlikely(id >= vq->num)) {
+			vq_err(vq, "Used buffer id %u > %u", id, vq->num);
+			return -EINVAL;
+		}
+		desc = vq->desc_packed + vhost_packed_slot(vq, vq->last_used_idx);
+		flags = vhost_packed_wrap(vq, vq->last_used_idx) ?
+			cpu_to_le16(1 << VRING_PACKED_DESC_F_AVAIL |
+				    1 << VRING_PACKED_DESC_F_USED) : 0;
+		if (vhost_put_desc(vq, cpu_to_le16(id), &desc->id) ||
+		    vhost_put_desc(vq, cpu_to_le32(vhost32_to_cpu(vq,
+				   heads[i].len)), &desc->len)) {
+			vq_err(vq, "Failed to write used descriptor");
+			return -EFAULT;
+		}
+		if (!first) {
+			first = desc;
+			first_flags = flags;
+		} else {
+			if (vhost_put_desc(vq, flags, &desc->flags)) {
+				vq_err(vq, "Failed to write used flags");
+				return -EFAULT;
+			}
+			if (unlikely(vq->log_used)) {
+				/* Make sure data is seen before log. */
+				smp_wmb();
+				log_write(vq->log_base, vq->log_addr +
+					  ((void __user *)desc -
+					   (void __user *)vq->desc_packed),
+					  sizeof *desc);
+			}
+		}
+		vq->last_used_idx += vq->packed_ndescs[id];
+	}
+	if (!first)
+		return 0;
+
+	/* Make sure buffer is written before we update the first flags. */
+	smp_wmb();
+	if (vhost_put_desc(vq, first_flags, &first->flags)) {
+		vq_err(vq, "Failed to write used flags");
+		return -EFAULT;
+	}
+	if (unlikely(vq->log_used)) {
+		/* Make sure the flags are seen before log. */
+		smp_wmb();
+		log_write(vq->log_base, vq->log_addr +
+			  ((void __user *)first - (void __user *)vq->desc_packed),
+			  sizeof *first);
+		if (vq->log_ctx)
+			eventfd_signal(vq->log_ctx, 1);
+	}
+	new = vq->last_used_idx;
+	/* If the driver never bothers to signal in a very long while,
+	 * used index might wrap around. If that happens, invalidate
+	 * signalled_used index we stored. */
+	if (unlikely((u16)(new - vq->signalled_used) < (u16)(new - old)))
+		vq->signalled_used_valid = false;
+	return 0;
+}
+
 /* After we've used one of their buffers, we tell them about it.  We'll then
  * want to notify the guest, using eventfd. */
 int vhost_add_used_n(struct vhost_virtqueue *vq, struct vring_used_elem *heads,
@@ -2205,6 +2827,9 @@ int vhost_add_used_n(struct vhost_virtqueue *vq, struct vring_used_elem *heads,
 {
 	int start, n, r;
 
+	if (vhost_has_feature(vq, VIRTIO_F_RING_PACKED))
+		return vhost_add_used_n_packed(vq, heads, count);
+
 	start = vq->last_used_idx & (vq->num - 1);
 	n = vq->num - start;
 	if (n < count) {
@@ -2235,6 +2860,40 @@ int vhost_add_used_n(struct vhost_virtqueue *vq, struct vring_used_elem *heads,
 }
 EXPORT_SYMBOL_GPL(vhost_add_used_n);
 
+static bool vhost_notify_packed(struct vhost_virtqueue *vq)
+{
+	__u16 old, new;
+	__le16 flags, off_wrap;
+	bool v;
+
+	if (vhost_get_avail(vq, flags, &vq->driver_event->flags)) {
+		vq_err(vq, "Failed to get driver event flags");
+		return true;
+	}
+	if (flags == cpu_to_le16(VRING_PACKED_EVENT_FLAG_DISABLE))
+		return false;
+	if (flags == cpu_to_le16(VRING_PACKED_EVENT_FLAG_ENABLE) ||
+	    !vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX))
+		return true;
+
+	old = vq->signalled_used;
+	v = vq->signalled_used_valid;
+	new = vq->signalled_used = vq->last_used_idx;
+	vq->signalled_used_valid = true;
+
+	if (unlikely(!v))
+		return true;
+
+	/* The guest writes the event offset before the flags. */
+	smp_rmb();
+	if (vhost_get_avail(vq, off_wrap, &vq->driver_event->off_wrap)) {
+		vq_err(vq, "Failed to get driver event offset");
+		return true;
+	}
+	return vring_need_event(vhost_packed_idx(vq, le16_to_cpu(off_wrap),
+						 new), new, old);
+}
+
 static bool vhost_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 {
 	__u16 old, new;
@@ -2245,6 +2904,9 @@ static bool vhost_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 	 * interrupts. */
 	smp_mb();
 
+	if (vhost_has_feature(vq, VIRTIO_F_RING_PACKED))
+		return vhost_notify_packed(vq);
+
 	if (vhost_has_feature(vq, VIRTIO_F_NOTIFY_ON_EMPTY) &&
 	    unlikely(vq->avail_idx == vq->last_avail_idx))
 		return true;
@@ -2301,12 +2963,29 @@ void vhost_add_used_and_signal_n(struct vhost_dev *dev,
 }
 EXPORT_SYMBOL_GPL(vhost_add_used_and_signal_n);
 
+/* Is the descriptor at last_avail_idx of a packed ring available?  Returns
+ * a negative error, or whether it is. */
+static int vhost_packed_avail(struct vhost_virtqueue *vq)
+{
+	__le16 flags;
+	int r;
+
+	r = vhost_get_desc(vq, flags, &vq->desc_packed[vhost_packed_slot(vq,
+					vq->last_avail_idx)].flags);
+	if (unlikely(r))
+		return r;
+	return packed_desc_avail(vq, flags, vq->last_avail_idx);
+}
+
 /* return true if we're sure that avaiable ring is empty */
 bool vhost_vq_avail_empty(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 {
 	__virtio16 avail_idx;
 	int r;
 
+	if (vhost_has_feature(vq, VIRTIO_F_RING_PACKED))
+		return vhost_packed_avail(vq) == 0;
+
 	if (vq->avail_idx != vq->last_avail_idx)
 		return false;
 
@@ -2328,6 +3007,23 @@ bool vhost_enable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 	if (!(vq->used_flags & VRING_USED_F_NO_NOTIFY))
 		return false;
 	vq->used_flags &= ~VRING_USED_F_NO_NOTIFY;
+	if (vhost_has_feature(vq, VIRTIO_F_RING_PACKED)) {
+		r = vhost_update_used_flags(vq);
+		if (r) {
+			vq_err(vq, "Failed to enable notification at %p: %d\n",
+			       vq->device_event, r);
+			return false;
+		}
+		/* They could have slipped one in as we were doing that:
+		 * make sure it's written, then check again. */
+		smp_mb();
+		r = vhost_packed_avail(vq);
+		if (r < 0) {
+			vq_err(vq, "Failed to check avail descriptor: %d\n", r);
+			return false;
+		}
+		return r;
+	}
 	if (!vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX)) {
 		r = vhost_update_used_flags(vq);
 		if (r) {
@@ -2365,7 +3061,9 @@ void vhost_disable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 	if (vq->used_flags & VRING_USED_F_NO_NOTIFY)
 		return;
 	vq->used_flags |= VRING_USED_F_NO_NOTIFY;
-	if (!vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX)) {
+	/* A packed ring has no avail event to leave behind: always tell. */
+	if (!vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX) ||
+	    vhost_has_feature(vq, VIRTIO_F_RING_PACKED)) {
 		r = vhost_update_used_flags(vq);
 		if (r)
 			vq_err(vq, "Failed to enable notification at %p: %d\n",
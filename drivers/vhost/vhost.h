@@ -26,6 +26,14 @@ struct vhost_work {
 	unsigned long		  flags;
 };
 
+/* A kthread serving works in the address space of the device owner */
+struct vhost_worker {
+	struct task_struct	 *task;
+	struct llist_head	  work_list;
+	struct vhost_dev	 *dev;
+	int			  id;
+};
+
 /* Poll a file (eventfd or socket) */
 /* Note: there's nothing vhost specific about this structure. */
 struct vhost_poll {
@@ -35,14 +43,18 @@ struct vhost_poll {
 	struct vhost_work	  work;
 	unsigned long		  mask;
 	struct vhost_dev	 *dev;
+	/* Its work runs on the worker of this vq, if any */
+	struct vhost_virtqueue	 *vq;
 };
 
 void vhost_work_init(struct vhost_work *work, vhost_work_fn_t fn);
 void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work);
 bool vhost_has_work(struct vhost_dev *dev);
+bool vhost_vq_has_work(struct vhost_virtqueue *vq);
 
 void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
-		     unsigned long mask, struct vhost_dev *dev);
+		     unsigned long mask, struct vhost_dev *dev,
+		     struct vhost_virtqueue *vq);
 int vhost_poll_start(struct vhost_poll *poll, struct file *file);
 void vhost_poll_stop(struct vhost_poll *poll);
 void vhost_poll_flush(struct vhost_poll *poll);
@@ -90,9 +102,19 @@ struct vhost_virtqueue {
 	/* The actual ring of buffers. */
 	struct mutex mutex;
 	unsigned int num;
-	struct vring_desc __user *desc;
-	struct vring_avail __user *avail;
-	struct vring_used __user *used;
+	/* A packed ring has one descriptor ring and two event areas. */
+	union {
+		struct vring_desc __user *desc;
+		struct vring_packed_desc __user *desc_packed;
+	};
+	union {
+		struct vring_avail __user *avail;
+		struct vring_packed_desc_event __user *driver_event;
+	};
+	union {
+		struct vring_used __user *used;
+		struct vring_packed_desc_event __user *device_event;
+	};
 	const struct vhost_umem_node *meta_iotlb[VHOST_NUM_ADDRS];
 	struct file *kick;
 	struct file *call;
@@ -106,7 +128,9 @@ struct vhost_virtqueue {
 	/* The routine to call when the Guest pings us, or timeout. */
 	vhost_work_fn_t handle_kick;
 
-	/* Last available index we saw. */
+	/* Last available index we saw.  The packed ring indexes run freely
+	 * too: the slot is the index modulo num, the wrap counter its parity
+	 * (see vhost_packed_wrap()). */
 	u16 last_avail_idx;
 
 	/* Caches available index value from user. */
@@ -128,6 +152,12 @@ struct vhost_virtqueue {
 	bool log_used;
 	u64 log_addr;
 
+	/* Packed ring: ring slots of each buffer id in flight, and of the
+	 * buffers in the order they were fetched, for discards. */
+	u16 *packed_ndescs;
+	u16 *packed_fetched;
+	u16 packed_fetch_idx;
+
 	struct iovec iov[UIO_MAXIOV];
 	struct iovec iotlb_iov[64];
 	struct iovec *indirect;
@@ -149,6 +179,11 @@ struct vhost_virtqueue {
 	bool user_be;
 #endif
 	u32 busyloop_timeout;
+	/* Busy loop time currently used, adapted within busyloop_timeout */
+	u32 busyloop_window;
+	/* Worker serving the vq, NULL for the device's default worker.
+	 * Only changes while the vq has no backend. */
+	struct vhost_worker *worker;
 };
 
 struct vhost_msg_node {
@@ -164,8 +199,10 @@ struct vhost_dev {
 	int nvqs;
 	struct file *log_file;
 	struct eventfd_ctx *log_ctx;
-	struct llist_head work_list;
-	struct task_struct *worker;
+	/* workers[0] is the default worker, the others are created when a
+	 * vq is given its own; there are at most nvqs of them. */
+	struct vhost_worker *worker;
+	struct vhost_worker **workers;
 	struct vhost_umem *umem;
 	struct vhost_umem *iotlb;
 	spinlock_t iotlb_lock;
@@ -236,7 +273,8 @@ enum {
 			 (1ULL << VIRTIO_RING_F_EVENT_IDX) |
 			 (1ULL << VHOST_F_LOG_ALL) |
 			 (1ULL << VIRTIO_F_ANY_LAYOUT) |
-			 (1ULL << VIRTIO_F_VERSION_1)
+			 (1ULL << VIRTIO_F_VERSION_1) |
+			 (1ULL << VIRTIO_F_RING_PACKED)
 };
 
 static inline bool vhost_has_feature(struct vhost_virtqueue *vq, int bit)
@@ -32,6 +32,8 @@
 #include <linux/mm.h>
 #include <linux/mount.h>
 #include <linux/magic.h>
+#include <linux/pageblock-flags.h>
+#include <linux/scatterlist.h>
 
 /*
  * Balloon device works in 4K page units.  So each page is pointed to by
@@ -43,6 +45,14 @@
 #define OOM_VBALLOON_DEFAULT_PAGES 256
 #define VIRTBALLOON_OOM_NOTIFY_PRIORITY 80
 
+/*
+ * Free page reporting hands the host chunks of this order, which match
+ * what it can back with huge pages, at most CAPACITY of them per pass.
+ */
+#define VIRTIO_BALLOON_REPORT_ORDER	pageblock_order
+#define VIRTIO_BALLOON_REPORT_CAPACITY	32
+#define VIRTIO_BALLOON_REPORT_DELAY	(2 * HZ)
+
 static int oom_pages = OOM_VBALLOON_DEFAULT_PAGES;
 module_param(oom_pages, int, S_IRUSR | S_IWUSR);
 MODULE_PARM_DESC(oom_pages, "pages to free on OOM");
@@ -53,7 +63,7 @@ static struct vfsmount *balloon_mnt;
 
 struct virtio_balloon {
 	struct virtio_device *vdev;
-	struct virtqueue *inflate_vq, *deflate_vq, *stats_vq;
+	struct virtqueue *inflate_vq, *deflate_vq, *stats_vq, *reporting_vq;
 
 	/* The balloon servicing is delegated to a freezable workqueue. */
 	struct work_struct update_balloon_stats_work;
@@ -88,6 +98,12 @@ struct virtio_balloon {
 
 	/* To register callback in oom notifier call chain */
 	struct notifier_block nb;
+
+	/* Free page reporting */
+	struct delayed_work report_free_pages_work;
+	/* Free page count after the last reporting pass */
+	unsigned long reported_free;
+	struct scatterlist report_sg[VIRTIO_BALLOON_REPORT_CAPACITY];
 };
 
 static struct virtio_device_id id_table[] = {
@@ -402,28 +418,93 @@ static void update_balloon_size_func(struct work_struct *work)
 		queue_work(system_freezable_wq, work);
 }
 
+/*
+ * Take free chunks out of the buddy allocator, tell the host it may drop
+ * their backing, and give them straight back once it has acknowledged.
+ * Only as much as was freed since the last pass is reported; allocation
+ * never reclaims or dips into reserves, so this backs off by itself when
+ * the guest needs its memory.
+ */
+static void report_free_pages_func(struct work_struct *work)
+{
+	struct virtio_balloon *vb = container_of(to_delayed_work(work),
+						 struct virtio_balloon,
+						 report_free_pages_work);
+	const unsigned int order = VIRTIO_BALLOON_REPORT_ORDER;
+	gfp_t gfp = (GFP_HIGHUSER_MOVABLE & ~__GFP_RECLAIM) |
+		    __GFP_NOWARN | __GFP_NORETRY | __GFP_NOMEMALLOC;
+	unsigned long free = nr_free_pages();
+	unsigned int budget, nents, i, len;
+	struct page *page;
+
+	if (free < vb->reported_free + (1UL << order)) {
+		vb->reported_free = min(vb->reported_free, free);
+		goto out;
+	}
+	budget = min_t(unsigned long, (free - vb->reported_free) >> order,
+		       VIRTIO_BALLOON_REPORT_CAPACITY);
+
+	sg_init_table(vb->report_sg, budget);
+	for (nents = 0; nents < budget; nents++) {
+		page = alloc_pages(gfp, order);
+		if (!page)
+			break;
+		sg_set_page(&vb->report_sg[nents], page, PAGE_SIZE << order, 0);
+	}
+	if (!nents)
+		goto out;
+	sg_mark_end(&vb->report_sg[nents - 1]);
+
+	if (virtqueue_add_inbuf(vb->reporting_vq, vb->report_sg, nents, vb,
+				GFP_KERNEL) == 0) {
+		virtqueue_kick(vb->reporting_vq);
+		/* When host has read buffer, this completes via balloon_ack */
+		wait_event(vb->acked, virtqueue_get_buf(vb->reporting_vq, &len));
+	}
+
+	for (i = 0; i < nents; i++)
+		__free_pages(sg_page(&vb->report_sg[i]), order);
+
+	vb->reported_free = nr_free_pages();
+out:
+	queue_delayed_work(system_freezable_wq, &vb->report_free_pages_work,
+			   VIRTIO_BALLOON_REPORT_DELAY);
+}
+
 static int init_vqs(struct virtio_balloon *vb)
 {
-	struct virtqueue *vqs[3];
-	vq_callback_t *callbacks[] = { balloon_ack, balloon_ack, stats_request };
-	static const char * const names[] = { "inflate", "deflate", "stats" };
-	int err, nvqs;
+	struct virtqueue *vqs[4];
+	vq_callback_t *callbacks[4] = { balloon_ack, balloon_ack };
+	const char *names[4] = { "inflate", "deflate" };
+	int err, nvqs = 2;
+	int stats = -1, reporting = -1;
 
 	/*
 	 * We expect two virtqueues: inflate and deflate, and
-	 * optionally stat.
+	 * optionally stat and reporting, numbered in that order
+	 * among those present.
 	 */
-	nvqs = virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ) ? 3 : 2;
+	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ)) {
+		stats = nvqs++;
+		callbacks[stats] = stats_request;
+		names[stats] = "stats";
+	}
+	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_REPORTING)) {
+		reporting = nvqs++;
+		callbacks[reporting] = balloon_ack;
+		names[reporting] = "reporting_vq";
+	}
 	err = virtio_find_vqs(vb->vdev, nvqs, vqs, callbacks, names, NULL);
 	if (err)
 		return err;
 
 	vb->inflate_vq = vqs[0];
 	vb->deflate_vq = vqs[1];
-	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ)) {
+	vb->reporting_vq = reporting >= 0 ? vqs[reporting] : NULL;
+	if (stats >= 0) {
 		struct scatterlist sg;
 		unsigned int num_stats;
-		vb->stats_vq = vqs[2];
+		vb->stats_vq = vqs[stats];
 
 		/*
 		 * Prime this virtqueue with one buffer so the hypervisor can
@@ -540,6 +621,8 @@ static int virtballoon_probe(struct virtio_device *vdev)
 
 	INIT_WORK(&vb->update_balloon_stats_work, update_balloon_stats_func);
 	INIT_WORK(&vb->update_balloon_size_work, update_balloon_size_func);
+	INIT_DELAYED_WORK(&vb->report_free_pages_work, report_free_pages_func);
+	vb->reported_free = 0;
 	spin_lock_init(&vb->stop_update_lock);
 	vb->stop_update = false;
 	vb->num_pages = 0;
@@ -583,6 +666,10 @@ static int virtballoon_probe(struct virtio_device *vdev)
 
 	if (towards_target(vb))
 		virtballoon_changed(vdev);
+	if (vb->reporting_vq)
+		queue_delayed_work(system_freezable_wq,
+				   &vb->report_free_pages_work,
+				   VIRTIO_BALLOON_REPORT_DELAY);
 	return 0;
 
 out_del_vqs:
@@ -617,6 +704,7 @@ static void virtballoon_remove(struct virtio_device *vdev)
 	spin_unlock_irq(&vb->stop_update_lock);
 	cancel_work_sync(&vb->update_balloon_size_work);
 	cancel_work_sync(&vb->update_balloon_stats_work);
+	cancel_delayed_work_sync(&vb->report_free_pages_work);
 
 	remove_common(vb);
 #ifdef CONFIG_BALLOON_COMPACTION
@@ -637,6 +725,7 @@ static int virtballoon_freeze(struct virtio_device *vdev)
 	 * The workqueue is already frozen by the PM core before this
 	 * function is called.
 	 */
+	cancel_delayed_work_sync(&vb->report_free_pages_work);
 	remove_common(vb);
 	return 0;
 }
@@ -655,12 +744,23 @@ static int virtballoon_restore(struct virtio_device *vdev)
 	if (towards_target(vb))
 		virtballoon_changed(vdev);
 	update_balloon_size(vb);
+	if (vb->reporting_vq)
+		queue_delayed_work(system_freezable_wq,
+				   &vb->report_free_pages_work,
+				   VIRTIO_BALLOON_REPORT_DELAY);
 	return 0;
 }
 #endif
 
 static int virtballoon_validate(struct virtio_device *vdev)
 {
+	/*
+	 * Poisoned free pages would come back zeroed from the host, or be
+	 * faulted right back in by the poisoning itself.
+	 */
+	if (page_poisoning_enabled())
+		__virtio_clear_bit(vdev, VIRTIO_BALLOON_F_REPORTING);
+
 	__virtio_clear_bit(vdev, VIRTIO_F_IOMMU_PLATFORM);
 	return 0;
 }
@@ -669,6 +769,7 @@ static unsigned int features[] = {
 	VIRTIO_BALLOON_F_MUST_TELL_HOST,
 	VIRTIO_BALLOON_F_STATS_VQ,
 	VIRTIO_BALLOON_F_DEFLATE_ON_OOM,
+	VIRTIO_BALLOON_F_REPORTING,
 };
 
 static struct virtio_driver virtio_balloon_driver = {
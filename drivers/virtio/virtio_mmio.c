@@ -148,6 +148,63 @@ static int vm_finalize_features(struct virtio_device *vdev)
 	return 0;
 }
 
+/*
+ * Legacy devices keep their config space in guest byte order, so any
+ * access width yields the bytes as laid out. Every access traps to the
+ * hypervisor: use the widest aligned one rather than going byte by byte.
+ */
+static void vm_get_legacy(void __iomem *base, unsigned offset,
+			  u8 *ptr, unsigned len)
+{
+	__le16 w;
+	__le32 l;
+
+	while (len) {
+		if (len >= 4 && IS_ALIGNED(offset, 4)) {
+			l = cpu_to_le32(readl(base + offset));
+			memcpy(ptr, &l, sizeof l);
+			offset += sizeof l;
+			ptr += sizeof l;
+			len -= sizeof l;
+		} else if (len >= 2 && IS_ALIGNED(offset, 2)) {
+			w = cpu_to_le16(readw(base + offset));
+			memcpy(ptr, &w, sizeof w);
+			offset += sizeof w;
+			ptr += sizeof w;
+			len -= sizeof w;
+		} else {
+			*ptr++ = readb(base + offset++);
+			len--;
+		}
+	}
+}
+
+static void vm_set_legacy(void __iomem *base, unsigned offset,
+			  const u8 *ptr, unsigned len)
+{
+	__le16 w;
+	__le32 l;
+
+	while (len) {
+		if (len >= 4 && IS_ALIGNED(offset, 4)) {
+			memcpy(&l, ptr, sizeof l);
+			writel(le32_to_cpu(l), base + offset);
+			offset += sizeof l;
+			ptr += sizeof l;
+			len -= sizeof l;
+		} else if (len >= 2 && IS_ALIGNED(offset, 2)) {
+			memcpy(&w, ptr, sizeof w);
+			writew(le16_to_cpu(w), base + offset);
+			offset += sizeof w;
+			ptr += sizeof w;
+			len -= sizeof w;
+		} else {
+			writeb(*ptr++, base + offset++);
+			len--;
+		}
+	}
+}
+
 static void vm_get(struct virtio_device *vdev, unsigned offset,
 		   void *buf, unsigned len)
 {
@@ -158,11 +215,7 @@ static void vm_get(struct virtio_device *vdev, unsigned offset,
 	__le32 l;
 
 	if (vm_dev->version == 1) {
-		u8 *ptr = buf;
-		int i;
-
-		for (i = 0; i < len; i++)
-			ptr[i] = readb(base + offset + i);
+		vm_get_legacy(base, offset, buf, len);
 		return;
 	}
 
@@ -200,12 +253,7 @@ static void vm_set(struct virtio_device *vdev, unsigned offset,
 	__le32 l;
 
 	if (vm_dev->version == 1) {
-		const u8 *ptr = buf;
-		int i;
-
-		for (i = 0; i < len; i++)
-			writeb(ptr[i], base + offset + i);
-
+		vm_set_legacy(base, offset, buf, len);
 		return;
 	}
 
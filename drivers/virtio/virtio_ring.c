@@ -56,9 +56,46 @@
 #define END_USE(vq)
 #endif
 
+#ifdef DEBUG
+#define LAST_ADD_TIME_UPDATE(_vq)				\
+	do {							\
+		ktime_t now = ktime_get();			\
+								\
+		/* No kick or get, with .1 second between?  Warn. */ \
+		if ((_vq)->last_add_time_valid)			\
+			WARN_ON(ktime_to_ms(ktime_sub(now,	\
+				(_vq)->last_add_time)) > 100);	\
+		(_vq)->last_add_time = now;			\
+		(_vq)->last_add_time_valid = true;		\
+	} while (0)
+#define LAST_ADD_TIME_CHECK(_vq)				\
+	do {							\
+		if ((_vq)->last_add_time_valid) {		\
+			WARN_ON(ktime_to_ms(ktime_sub(ktime_get(), \
+				      (_vq)->last_add_time)) > 100); \
+		}						\
+	} while (0)
+#define LAST_ADD_TIME_INVALID(_vq)				\
+	((_vq)->last_add_time_valid = false)
+#else
+#define LAST_ADD_TIME_UPDATE(_vq)
+#define LAST_ADD_TIME_CHECK(_vq)
+#define LAST_ADD_TIME_INVALID(_vq)
+#endif
+
 struct vring_desc_state {
 	void *data;			/* Data for callback. */
-	struct vring_desc *indir_desc;	/* Indirect descriptor, if any. */
+	void *indir_desc;		/* Indirect descriptor, if any. */
+	u16 num;			/* Descriptor list length (packed). */
+	u16 last;			/* The last desc state in a list (packed). */
+};
+
+/* What the driver has to remember of a packed ring descriptor to unmap it. */
+struct vring_desc_extra_packed {
+	dma_addr_t addr;		/* Buffer DMA addr. */
+	u32 len;			/* Buffer length. */
+	u16 flags;			/* Descriptor flags. */
+	u16 next;			/* The next desc state in a list. */
 };
 
 struct vring_virtqueue {
@@ -79,20 +116,68 @@ struct vring_virtqueue {
 	/* Host publishes avail event idx */
 	bool event;
 
-	/* Head of free buffer list. */
+	/* Is this a packed ring? */
+	bool packed_ring;
+
+	/* Host uses buffers in the order they were made available */
+	bool in_order;
+
+	/* Adds are exposed to the other side at the end of a batch */
+	bool batching;
+
+	/* Head of free buffer list (buffer id list for a packed ring). */
 	unsigned int free_head;
 	/* Number we've added since last sync. */
 	unsigned int num_added;
 
-	/* Last used index we've seen. */
+	/* Last used index we've seen (ring position for a packed ring). */
 	u16 last_used_idx;
 
+	/*
+	 * In order: the head of the oldest buffer not handed back yet, and
+	 * the last head and length of a used entry covering a batch of
+	 * buffers, vring.num if there is none left to hand back.
+	 */
+	u16 used_head;
+	u16 batch_last;
+	u32 batch_len;
+
 	/* Last written value to avail->flags */
 	u16 avail_flags_shadow;
 
 	/* Last written value to avail->idx in guest byte order */
 	u16 avail_idx_shadow;
 
+	/*
+	 * A packed ring has a single descriptor ring, which the device
+	 * overwrites with used descriptors, and an event suppression area
+	 * for each side.  vring.num is its size, the rest of vring is unused.
+	 */
+	struct {
+		/* Actual memory layout for this queue. */
+		struct vring_packed_desc *desc;
+		struct vring_packed_desc_event *driver;
+		struct vring_packed_desc_event *device;
+
+		/* Driver ring wrap counter. */
+		bool avail_wrap_counter;
+
+		/* Device ring wrap counter. */
+		bool used_wrap_counter;
+
+		/* Avail and used flags of the descriptors we make available. */
+		u16 avail_used_flags;
+
+		/* Index of the next avail descriptor. */
+		u16 next_avail_idx;
+
+		/* Last written value to driver->flags in guest byte order. */
+		u16 event_flags_shadow;
+
+		/* Per-descriptor state kept out of the shared ring. */
+		struct vring_desc_extra_packed *desc_extra;
+	} packed;
+
 	/* How to notify other side. FIXME: commonalize hcalls! */
 	bool (*notify)(struct virtqueue *vq);
 
@@ -235,6 +320,54 @@ static int vring_mapping_error(const struct vring_virtqueue *vq,
 	return dma_mapping_error(vring_dma_dev(vq), addr);
 }
 
+static void vring_unmap_state_packed(const struct vring_virtqueue *vq,
+				     struct vring_desc_extra_packed *state)
+{
+	u16 flags;
+
+	if (!vring_use_dma_api(vq->vq.vdev))
+		return;
+
+	flags = state->flags;
+
+	if (flags & VRING_DESC_F_INDIRECT) {
+		dma_unmap_single(vring_dma_dev(vq),
+				 state->addr, state->len,
+				 (flags & VRING_DESC_F_WRITE) ?
+				 DMA_FROM_DEVICE : DMA_TO_DEVICE);
+	} else {
+		dma_unmap_page(vring_dma_dev(vq),
+			       state->addr, state->len,
+			       (flags & VRING_DESC_F_WRITE) ?
+			       DMA_FROM_DEVICE : DMA_TO_DEVICE);
+	}
+}
+
+static void vring_unmap_desc_packed(const struct vring_virtqueue *vq,
+				    struct vring_packed_desc *desc)
+{
+	u16 flags;
+
+	if (!vring_use_dma_api(vq->vq.vdev))
+		return;
+
+	flags = le16_to_cpu(desc->flags);
+
+	if (flags & VRING_DESC_F_INDIRECT) {
+		dma_unmap_single(vring_dma_dev(vq),
+				 le64_to_cpu(desc->addr),
+				 le32_to_cpu(desc->len),
+				 (flags & VRING_DESC_F_WRITE) ?
+				 DMA_FROM_DEVICE : DMA_TO_DEVICE);
+	} else {
+		dma_unmap_page(vring_dma_dev(vq),
+			       le64_to_cpu(desc->addr),
+			       le32_to_cpu(desc->len),
+			       (flags & VRING_DESC_F_WRITE) ?
+			       DMA_FROM_DEVICE : DMA_TO_DEVICE);
+	}
+}
+
 static struct vring_desc *alloc_indirect(struct virtqueue *_vq,
 					 unsigned int total_sg, gfp_t gfp)
 {
@@ -257,14 +390,598 @@ static struct vring_desc *alloc_indirect(struct virtqueue *_vq,
 	return desc;
 }
 
-static inline int virtqueue_add(struct virtqueue *_vq,
-				struct scatterlist *sgs[],
-				unsigned int total_sg,
-				unsigned int out_sgs,
-				unsigned int in_sgs,
-				void *data,
-				void *ctx,
-				gfp_t gfp)
+/*
+ * Packed ring specific functions - *_packed().
+ */
+
+static struct vring_packed_desc *alloc_indirect_packed(unsigned int total_sg,
+						       gfp_t gfp)
+{
+	/*
+	 * We require lowmem mappings for the descriptors because
+	 * otherwise virt_to_phys will give us bogus addresses in the
+	 * virtqueue.
+	 */
+	gfp &= ~__GFP_HIGHMEM;
+
+	return kmalloc(total_sg * sizeof(struct vring_packed_desc), gfp);
+}
+
+static int virtqueue_add_indirect_packed(struct vring_virtqueue *vq,
+					 struct scatterlist *sgs[],
+					 unsigned int total_sg,
+					 unsigned int out_sgs,
+					 unsigned int in_sgs,
+					 void *data,
+					 gfp_t gfp)
+{
+	struct vring_packed_desc *desc;
+	struct scatterlist *sg;
+	unsigned int i, n, err_idx;
+	u16 head, id;
+	dma_addr_t addr;
+
+	head = vq->packed.next_avail_idx;
+	desc = alloc_indirect_packed(total_sg, gfp);
+	if (!desc)
+		return -ENOMEM;
+
+	if (unlikely(vq->vq.num_free < 1)) {
+		pr_debug("Can't add buf len 1 - avail = 0\n");
+		kfree(desc);
+		END_USE(vq);
+		return -ENOSPC;
+	}
+
+	i = 0;
+	id = vq->free_head;
+	BUG_ON(id == vq->vring.num);
+
+	for (n = 0; n < out_sgs + in_sgs; n++) {
+		for (sg = sgs[n]; sg; sg = sg_next(sg)) {
+			addr = vring_map_one_sg(vq, sg, n < out_sgs ?
+						DMA_TO_DEVICE : DMA_FROM_DEVICE);
+			if (vring_mapping_error(vq, addr))
+				goto unmap_release;
+
+			desc[i].flags = cpu_to_le16(n < out_sgs ?
+						    0 : VRING_DESC_F_WRITE);
+			desc[i].addr = cpu_to_le64(addr);
+			desc[i].len = cpu_to_le32(sg->length);
+			i++;
+		}
+	}
+
+	/* Now that the indirect table is filled in, map it. */
+	addr = vring_map_single(vq, desc,
+				total_sg * sizeof(struct vring_packed_desc),
+				DMA_TO_DEVICE);
+	if (vring_mapping_error(vq, addr))
+		goto unmap_release;
+
+	vq->packed.desc[head].addr = cpu_to_le64(addr);
+	vq->packed.desc[head].len = cpu_to_le32(total_sg *
+				sizeof(struct vring_packed_desc));
+	vq->packed.desc[head].id = cpu_to_le16(id);
+
+	if (vring_use_dma_api(vq->vq.vdev)) {
+		vq->packed.desc_extra[id].addr = addr;
+		vq->packed.desc_extra[id].len = total_sg *
+				sizeof(struct vring_packed_desc);
+		vq->packed.desc_extra[id].flags = VRING_DESC_F_INDIRECT |
+						  vq->packed.avail_used_flags;
+	}
+
+	/* The descriptor has to be complete before the device can see it. */
+	virtio_wmb(vq->weak_barriers);
+	vq->packed.desc[head].flags = cpu_to_le16(VRING_DESC_F_INDIRECT |
+						vq->packed.avail_used_flags);
+
+	/* We're using some buffers from the free list. */
+	vq->vq.num_free -= 1;
+
+	/* Update free pointer */
+	n = head + 1;
+	if (n >= vq->vring.num) {
+		n = 0;
+		vq->packed.avail_wrap_counter ^= 1;
+		vq->packed.avail_used_flags ^=
+				1 << VRING_PACKED_DESC_F_AVAIL |
+				1 << VRING_PACKED_DESC_F_USED;
+	}
+	vq->packed.next_avail_idx = n;
+	vq->free_head = vq->packed.desc_extra[id].next;
+
+	/* Store token and indirect buffer state. */
+	vq->desc_state[id].num = 1;
+	vq->desc_state[id].data = data;
+	vq->desc_state[id].indir_desc = desc;
+	vq->desc_state[id].last = id;
+
+	vq->num_added += 1;
+
+	pr_debug("Added buffer head %i to %p\n", head, vq);
+	END_USE(vq);
+
+	return 0;
+
+unmap_release:
+	err_idx = i;
+
+	for (i = 0; i < err_idx; i++)
+		vring_unmap_desc_packed(vq, &desc[i]);
+
+	kfree(desc);
+
+	END_USE(vq);
+	return -EIO;
+}
+
+static inline int virtqueue_add_packed(struct virtqueue *_vq,
+				       struct scatterlist *sgs[],
+				       unsigned int total_sg,
+				       unsigned int out_sgs,
+				       unsigned int in_sgs,
+				       void *data,
+				       void *ctx,
+				       gfp_t gfp)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	struct vring_packed_desc *desc;
+	struct scatterlist *sg;
+	unsigned int i, n, c, descs_used, err_idx;
+	__le16 uninitialized_var(head_flags), flags;
+	u16 head, id, uninitialized_var(prev), curr, avail_used_flags;
+	bool avail_wrap_counter;
+	int err;
+
+	START_USE(vq);
+
+	BUG_ON(data == NULL);
+	BUG_ON(ctx && vq->indirect);
+
+	if (unlikely(vq->broken)) {
+		END_USE(vq);
+		return -EIO;
+	}
+
+	LAST_ADD_TIME_UPDATE(vq);
+
+	BUG_ON(total_sg == 0);
+
+	/* If the host supports indirect descriptor tables, and we have multiple
+	 * buffers, then go indirect, falling back to the ring if we can't
+	 * allocate the table. FIXME: tune this threshold */
+	if (vq->indirect && total_sg > 1 && vq->vq.num_free) {
+		err = virtqueue_add_indirect_packed(vq, sgs, total_sg, out_sgs,
+						    in_sgs, data, gfp);
+		if (err != -ENOMEM)
+			return err;
+	}
+
+	BUG_ON(total_sg > vq->vring.num);
+
+	head = vq->packed.next_avail_idx;
+	avail_used_flags = vq->packed.avail_used_flags;
+	avail_wrap_counter = vq->packed.avail_wrap_counter;
+
+	desc = vq->packed.desc;
+	i = head;
+	descs_used = total_sg;
+
+	if (unlikely(vq->vq.num_free < descs_used)) {
+		pr_debug("Can't add buf len %i - avail = %i\n",
+			 descs_used, vq->vq.num_free);
+		/* FIXME: for historical reasons, we force a notify here if
+		 * there are outgoing parts to the buffer.  Presumably the
+		 * host should service the ring ASAP. */
+		if (out_sgs)
+			vq->notify(&vq->vq);
+		END_USE(vq);
+		return -ENOSPC;
+	}
+
+	id = vq->free_head;
+	BUG_ON(id == vq->vring.num);
+
+	curr = id;
+	c = 0;
+	for (n = 0; n < out_sgs + in_sgs; n++) {
+		for (sg = sgs[n]; sg; sg = sg_next(sg)) {
+			dma_addr_t addr = vring_map_one_sg(vq, sg, n < out_sgs ?
+					DMA_TO_DEVICE : DMA_FROM_DEVICE);
+			if (vring_mapping_error(vq, addr))
+				goto unmap_release;
+
+			flags = cpu_to_le16(vq->packed.avail_used_flags |
+				    (++c == total_sg ? 0 : VRING_DESC_F_NEXT) |
+				    (n < out_sgs ? 0 : VRING_DESC_F_WRITE));
+			/* The head is made available last, below. */
+			if (i == head)
+				head_flags = flags;
+			else
+				desc[i].flags = flags;
+
+			desc[i].addr = cpu_to_le64(addr);
+			desc[i].len = cpu_to_le32(sg->length);
+			desc[i].id = cpu_to_le16(id);
+
+			if (vring_use_dma_api(vq->vq.vdev)) {
+				vq->packed.desc_extra[curr].addr = addr;
+				vq->packed.desc_extra[curr].len = sg->length;
+				vq->packed.desc_extra[curr].flags =
+					le16_to_cpu(flags);
+			}
+			prev = curr;
+			curr = vq->packed.desc_extra[curr].next;
+
+			if (unlikely(++i >= vq->vring.num)) {
+				i = 0;
+				vq->packed.avail_wrap_counter ^= 1;
+				vq->packed.avail_used_flags ^=
+					1 << VRING_PACKED_DESC_F_AVAIL |
+					1 << VRING_PACKED_DESC_F_USED;
+			}
+		}
+	}
+
+	/* We're using some buffers from the free list. */
+	vq->vq.num_free -= descs_used;
+
+	/* Update free pointer */
+	vq->packed.next_avail_idx = i;
+	vq->free_head = curr;
+
+	/* Store token. */
+	vq->desc_state[id].num = descs_used;
+	vq->desc_state[id].data = data;
+	vq->desc_state[id].indir_desc = ctx;
+	vq->desc_state[id].last = prev;
+
+	/* The rest of the list has to be visible before the head makes the
+	 * whole buffer available to the device. */
+	virtio_wmb(vq->weak_barriers);
+	vq->packed.desc[head].flags = head_flags;
+	vq->num_added += descs_used;
+
+	pr_debug("Added buffer head %i to %p\n", head, vq);
+	END_USE(vq);
+
+	return 0;
+
+unmap_release:
+	err_idx = i;
+	i = head;
+
+	vq->packed.avail_used_flags = avail_used_flags;
+	vq->packed.avail_wrap_counter = avail_wrap_counter;
+
+	for (n = 0; n < total_sg; n++) {
+		if (i == err_idx)
+			break;
+		vring_unmap_desc_packed(vq, &desc[i]);
+		if (++i >= vq->vring.num)
+			i = 0;
+	}
+
+	END_USE(vq);
+	return -EIO;
+}
+
+static bool virtqueue_kick_prepare_packed(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	u16 new, old, off_wrap, flags, wrap_counter, event_idx;
+	bool needs_kick;
+	union {
+		struct {
+			__le16 off_wrap;
+			__le16 flags;
+		};
+		u32 u32;
+	} snapshot;
+
+	START_USE(vq);
+
+	/* We need to expose the new flags value before checking notification
+	 * suppressions. */
+	virtio_mb(vq->weak_barriers);
+
+	old = vq->packed.next_avail_idx - vq->num_added;
+	new = vq->packed.next_avail_idx;
+	vq->num_added = 0;
+
+	/* Read both fields at once, so they are consistent. */
+	snapshot.u32 = READ_ONCE(*(u32 *)vq->packed.device);
+	flags = le16_to_cpu(snapshot.flags);
+
+	LAST_ADD_TIME_CHECK(vq);
+	LAST_ADD_TIME_INVALID(vq);
+
+	if (flags != VRING_PACKED_EVENT_FLAG_DESC) {
+		needs_kick = (flags != VRING_PACKED_EVENT_FLAG_DISABLE);
+		goto out;
+	}
+
+	off_wrap = le16_to_cpu(snapshot.off_wrap);
+
+	wrap_counter = off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR;
+	event_idx = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+	if (wrap_counter != vq->packed.avail_wrap_counter)
+		event_idx -= vq->vring.num;
+
+	needs_kick = vring_need_event(event_idx, new, old);
+out:
+	END_USE(vq);
+	return needs_kick;
+}
+
+static void detach_buf_packed(struct vring_virtqueue *vq,
+			      unsigned int id, void **ctx)
+{
+	struct vring_desc_state *state = &vq->desc_state[id];
+	struct vring_packed_desc *desc;
+	unsigned int i, curr;
+	u32 len;
+
+	/* Clear data ptr. */
+	state->data = NULL;
+
+	vq->packed.desc_extra[state->last].next = vq->free_head;
+	vq->free_head = id;
+	vq->vq.num_free += state->num;
+
+	if (vring_use_dma_api(vq->vq.vdev)) {
+		curr = id;
+		for (i = 0; i < state->num; i++) {
+			vring_unmap_state_packed(vq,
+						 &vq->packed.desc_extra[curr]);
+			curr = vq->packed.desc_extra[curr].next;
+		}
+	}
+
+	if (vq->indirect) {
+		/* Free the indirect table, if any, now that it's unmapped. */
+		desc = state->indir_desc;
+		if (!desc)
+			return;
+
+		if (vring_use_dma_api(vq->vq.vdev)) {
+			len = vq->packed.desc_extra[id].len;
+			for (i = 0; i < len / sizeof(struct vring_packed_desc);
+			     i++)
+				vring_unmap_desc_packed(vq, &desc[i]);
+		}
+		kfree(desc);
+		state->indir_desc = NULL;
+	} else if (ctx) {
+		*ctx = state->indir_desc;
+	}
+}
+
+static inline bool is_used_desc_packed(const struct vring_virtqueue *vq,
+				       u16 idx, bool used_wrap_counter)
+{
+	bool avail, used;
+	u16 flags;
+
+	flags = le16_to_cpu(vq->packed.desc[idx].flags);
+	avail = !!(flags & (1 << VRING_PACKED_DESC_F_AVAIL));
+	used = !!(flags & (1 << VRING_PACKED_DESC_F_USED));
+
+	return avail == used && used == used_wrap_counter;
+}
+
+static inline bool more_used_packed(const struct vring_virtqueue *vq)
+{
+	return is_used_desc_packed(vq, vq->last_used_idx,
+				   vq->packed.used_wrap_counter);
+}
+
+static inline u16 packed_off_wrap(u16 idx, bool wrap_counter)
+{
+	return idx | (u16)wrap_counter << VRING_PACKED_EVENT_F_WRAP_CTR;
+}
+
+static void *virtqueue_get_buf_ctx_packed(struct virtqueue *_vq,
+					  unsigned int *len,
+					  void **ctx)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	u16 last_used, id;
+	void *ret;
+
+	START_USE(vq);
+
+	if (unlikely(vq->broken)) {
+		END_USE(vq);
+		return NULL;
+	}
+
+	if (!more_used_packed(vq)) {
+		pr_debug("No more buffers in queue\n");
+		END_USE(vq);
+		return NULL;
+	}
+
+	/* Only get used elements after they have been exposed by host. */
+	virtio_rmb(vq->weak_barriers);
+
+	last_used = vq->last_used_idx;
+	id = le16_to_cpu(vq->packed.desc[last_used].id);
+	*len = le32_to_cpu(vq->packed.desc[last_used].len);
+
+	if (unlikely(id >= vq->vring.num)) {
+		BAD_RING(vq, "id %u out of range\n", id);
+		return NULL;
+	}
+	if (unlikely(!vq->desc_state[id].data)) {
+		BAD_RING(vq, "id %u is not a head!\n", id);
+		return NULL;
+	}
+
+	/* detach_buf_packed clears data, so grab it now. */
+	ret = vq->desc_state[id].data;
+	detach_buf_packed(vq, id, ctx);
+
+	/* The device skips the whole list, completions come in order. */
+	vq->last_used_idx += vq->desc_state[id].num;
+	if (unlikely(vq->last_used_idx >= vq->vring.num)) {
+		vq->last_used_idx -= vq->vring.num;
+		vq->packed.used_wrap_counter ^= 1;
+	}
+
+	/* If we expect an interrupt for the next entry, tell host
+	 * by writing event index and flush out the write before
+	 * the read in the next get_buf call. */
+	if (vq->packed.event_flags_shadow == VRING_PACKED_EVENT_FLAG_DESC) {
+		WRITE_ONCE(vq->packed.driver->off_wrap,
+			   cpu_to_le16(packed_off_wrap(vq->last_used_idx,
+					vq->packed.used_wrap_counter)));
+		virtio_mb(vq->weak_barriers);
+	}
+
+	LAST_ADD_TIME_INVALID(vq);
+
+	END_USE(vq);
+	return ret;
+}
+
+static void virtqueue_disable_cb_packed(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	if (vq->packed.event_flags_shadow != VRING_PACKED_EVENT_FLAG_DISABLE) {
+		vq->packed.event_flags_shadow = VRING_PACKED_EVENT_FLAG_DISABLE;
+		vq->packed.driver->flags =
+			cpu_to_le16(vq->packed.event_flags_shadow);
+	}
+}
+
+static unsigned virtqueue_enable_cb_prepare_packed(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	START_USE(vq);
+
+	/* We optimistically turn back on interrupts, then check if there was
+	 * more to do. */
+	if (vq->event) {
+		vq->packed.driver->off_wrap =
+			cpu_to_le16(packed_off_wrap(vq->last_used_idx,
+					vq->packed.used_wrap_counter));
+		/* The event offset has to be visible before the flags
+		 * enable it. */
+		virtio_wmb(vq->weak_barriers);
+	}
+
+	if (vq->packed.event_flags_shadow == VRING_PACKED_EVENT_FLAG_DISABLE) {
+		vq->packed.event_flags_shadow = vq->event ?
+				VRING_PACKED_EVENT_FLAG_DESC :
+				VRING_PACKED_EVENT_FLAG_ENABLE;
+		vq->packed.driver->flags =
+			cpu_to_le16(vq->packed.event_flags_shadow);
+	}
+
+	END_USE(vq);
+	return packed_off_wrap(vq->last_used_idx,
+			       vq->packed.used_wrap_counter);
+}
+
+static bool virtqueue_poll_packed(struct virtqueue *_vq, u16 off_wrap)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	bool wrap_counter;
+	u16 used_idx;
+
+	wrap_counter = off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR;
+	used_idx = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+
+	return is_used_desc_packed(vq, used_idx, wrap_counter);
+}
+
+static bool virtqueue_enable_cb_delayed_packed(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	u16 used_idx, bufs;
+	bool wrap_counter;
+
+	START_USE(vq);
+
+	/* We optimistically turn back on interrupts, then check if there was
+	 * more to do. */
+	used_idx = vq->last_used_idx;
+	wrap_counter = vq->packed.used_wrap_counter;
+
+	if (vq->event) {
+		/* TODO: tune this threshold */
+		bufs = (vq->vring.num - vq->vq.num_free) * 3 / 4;
+		used_idx += bufs;
+		if (used_idx >= vq->vring.num) {
+			used_idx -= vq->vring.num;
+			wrap_counter ^= 1;
+		}
+
+		vq->packed.driver->off_wrap =
+			cpu_to_le16(packed_off_wrap(used_idx, wrap_counter));
+		/* The event offset has to be visible before the flags
+		 * enable it. */
+		virtio_wmb(vq->weak_barriers);
+	}
+
+	if (vq->packed.event_flags_shadow == VRING_PACKED_EVENT_FLAG_DISABLE) {
+		vq->packed.event_flags_shadow = vq->event ?
+				VRING_PACKED_EVENT_FLAG_DESC :
+				VRING_PACKED_EVENT_FLAG_ENABLE;
+		vq->packed.driver->flags =
+			cpu_to_le16(vq->packed.event_flags_shadow);
+	}
+
+	/* The event suppression area has to be updated before we check for
+	 * more used buffers. */
+	virtio_mb(vq->weak_barriers);
+
+	if (is_used_desc_packed(vq, used_idx, wrap_counter)) {
+		END_USE(vq);
+		return false;
+	}
+
+	END_USE(vq);
+	return true;
+}
+
+static void *virtqueue_detach_unused_buf_packed(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int i;
+	void *buf;
+
+	START_USE(vq);
+
+	for (i = 0; i < vq->vring.num; i++) {
+		if (!vq->desc_state[i].data)
+			continue;
+		/* detach_buf_packed clears data, so grab it now. */
+		buf = vq->desc_state[i].data;
+		detach_buf_packed(vq, i, NULL);
+		END_USE(vq);
+		return buf;
+	}
+	/* That should have freed everything. */
+	BUG_ON(vq->vq.num_free != vq->vring.num);
+
+	END_USE(vq);
+	return NULL;
+}
+
+static inline int virtqueue_add_split(struct virtqueue *_vq,
+				      struct scatterlist *sgs[],
+				      unsigned int total_sg,
+				      unsigned int out_sgs,
+				      unsigned int in_sgs,
+				      void *data,
+				      void *ctx,
+				      gfp_t gfp)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	struct scatterlist *sg;
@@ -283,18 +1000,7 @@ static inline int virtqueue_add(struct virtqueue *_vq,
 		return -EIO;
 	}
 
-#ifdef DEBUG
-	{
-		ktime_t now = ktime_get();
-
-		/* No kick or get, with .1 second between?  Warn. */
-		if (vq->last_add_time_valid)
-			WARN_ON(ktime_to_ms(ktime_sub(now, vq->last_add_time))
-					    > 100);
-		vq->last_add_time = now;
-		vq->last_add_time_valid = true;
-	}
-#endif
+	LAST_ADD_TIME_UPDATE(vq);
 
 	BUG_ON(total_sg > vq->vring.num);
 	BUG_ON(total_sg == 0);
@@ -388,6 +1094,7 @@ static inline int virtqueue_add(struct virtqueue *_vq,
 		vq->free_head = i;
 
 	/* Store token and indirect buffer state. */
+	vq->desc_state[head].num = descs_used;
 	vq->desc_state[head].data = data;
 	if (indirect)
 		vq->desc_state[head].indir_desc = desc;
@@ -398,14 +1105,17 @@ static inline int virtqueue_add(struct virtqueue *_vq,
 	 * do sync). */
 	avail = vq->avail_idx_shadow & (vq->vring.num - 1);
 	vq->vring.avail->ring[avail] = cpu_to_virtio16(_vq->vdev, head);
-
-	/* Descriptors and available array need to be set before we expose the
-	 * new available array entries. */
-	virtio_wmb(vq->weak_barriers);
 	vq->avail_idx_shadow++;
-	vq->vring.avail->idx = cpu_to_virtio16(_vq->vdev, vq->avail_idx_shadow);
 	vq->num_added++;
 
+	/* Descriptors and available array need to be set before we expose the
+	 * new available array entries.  A batch exposes them all at its end. */
+	if (!vq->batching) {
+		virtio_wmb(vq->weak_barriers);
+		vq->vring.avail->idx = cpu_to_virtio16(_vq->vdev,
+						       vq->avail_idx_shadow);
+	}
+
 	pr_debug("Added buffer head %i to %p\n", head, vq);
 	END_USE(vq);
 
@@ -436,6 +1146,24 @@ unmap_release:
 	return -EIO;
 }
 
+static inline int virtqueue_add(struct virtqueue *_vq,
+				struct scatterlist *sgs[],
+				unsigned int total_sg,
+				unsigned int out_sgs,
+				unsigned int in_sgs,
+				void *data,
+				void *ctx,
+				gfp_t gfp)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	if (vq->packed_ring)
+		return virtqueue_add_packed(_vq, sgs, total_sg, out_sgs,
+					    in_sgs, data, ctx, gfp);
+	return virtqueue_add_split(_vq, sgs, total_sg, out_sgs, in_sgs,
+				   data, ctx, gfp);
+}
+
 /**
  * virtqueue_add_sgs - expose buffers to other end
  * @vq: the struct virtqueue we're talking about.
@@ -538,6 +1266,58 @@ int virtqueue_add_inbuf_ctx(struct virtqueue *vq,
 }
 EXPORT_SYMBOL_GPL(virtqueue_add_inbuf_ctx);
 
+/**
+ * virtqueue_add_inbufs_ctx - expose a batch of input buffers to other end
+ * @vq: the struct virtqueue we're talking about.
+ * @sg: scatterlists, each entry a whole buffer (must be terminated!)
+ * @num: the number of buffers in @sg
+ * @data: the tokens identifying the buffers.
+ * @ctx: extra context for the tokens, or NULL
+ * @gfp: how to do memory allocations (if necessary).
+ *
+ * This is virtqueue_add_inbuf_ctx() for @num single entry buffers, except
+ * that the other side sees them all at once: a split ring updates
+ * avail->idx a single time.  Buffers are added in order until one fails.
+ *
+ * Caller must ensure we don't call this with other virtqueue operations
+ * at the same time (except where noted).
+ *
+ * Returns the number of buffers added, or a negative error (ie. ENOSPC,
+ * ENOMEM, EIO) if none was.
+ */
+int virtqueue_add_inbufs_ctx(struct virtqueue *_vq,
+			     struct scatterlist sg[], unsigned int num,
+			     void *data[],
+			     void *ctx[],
+			     gfp_t gfp)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	struct scatterlist *sgs;
+	unsigned int i;
+	int err = 0;
+
+	vq->batching = true;
+	for (i = 0; i < num; i++) {
+		sgs = &sg[i];
+		err = virtqueue_add(_vq, &sgs, 1, 0, 1, data[i],
+				    ctx ? ctx[i] : NULL, gfp);
+		if (err)
+			break;
+	}
+	vq->batching = false;
+
+	if (!i)
+		return err;
+
+	if (!vq->packed_ring) {
+		virtio_wmb(vq->weak_barriers);
+		vq->vring.avail->idx = cpu_to_virtio16(_vq->vdev,
+						       vq->avail_idx_shadow);
+	}
+	return i;
+}
+EXPORT_SYMBOL_GPL(virtqueue_add_inbufs_ctx);
+
 /**
  * virtqueue_kick_prepare - first half of split virtqueue_kick call.
  * @vq: the struct virtqueue
@@ -555,6 +1335,9 @@ bool virtqueue_kick_prepare(struct virtqueue *_vq)
 	u16 new, old;
 	bool needs_kick;
 
+	if (vq->packed_ring)
+		return virtqueue_kick_prepare_packed(_vq);
+
 	START_USE(vq);
 	/* We need to expose available array entries before checking avail
 	 * event. */
@@ -564,13 +1347,8 @@ bool virtqueue_kick_prepare(struct virtqueue *_vq)
 	new = vq->avail_idx_shadow;
 	vq->num_added = 0;
 
-#ifdef DEBUG
-	if (vq->last_add_time_valid) {
-		WARN_ON(ktime_to_ms(ktime_sub(ktime_get(),
-					      vq->last_add_time)) > 100);
-	}
-	vq->last_add_time_valid = false;
-#endif
+	LAST_ADD_TIME_CHECK(vq);
+	LAST_ADD_TIME_INVALID(vq);
 
 	if (vq->event) {
 		needs_kick = vring_need_event(virtio16_to_cpu(_vq->vdev, vring_avail_event(&vq->vring)),
@@ -676,11 +1454,137 @@ static void detach_buf(struct vring_virtqueue *vq, unsigned int head,
 	}
 }
 
-static inline bool more_used(const struct vring_virtqueue *vq)
+/*
+ * In order, descriptors are taken from the ring in turn and their next
+ * fields never change, so a buffer is given back without following them.
+ */
+static void detach_buf_in_order(struct vring_virtqueue *vq, unsigned int head,
+				void **ctx)
+{
+	struct vring_desc_state *state = &vq->desc_state[head];
+	unsigned int i, j;
+
+	/* Clear data ptr. */
+	state->data = NULL;
+
+	if (vring_use_dma_api(vq->vq.vdev)) {
+		for (i = head, j = 0; j < state->num; j++) {
+			vring_unmap_one(vq, &vq->vring.desc[i]);
+			i = (i + 1) & (vq->vring.num - 1);
+		}
+	}
+	vq->vq.num_free += state->num;
+
+	if (vq->indirect) {
+		struct vring_desc *indir_desc = state->indir_desc;
+		u32 len;
+
+		/* Free the indirect table, if any, now that it's unmapped. */
+		if (!indir_desc)
+			return;
+
+		len = virtio32_to_cpu(vq->vq.vdev, vq->vring.desc[head].len);
+
+		BUG_ON(!(vq->vring.desc[head].flags &
+			 cpu_to_virtio16(vq->vq.vdev, VRING_DESC_F_INDIRECT)));
+		BUG_ON(len == 0 || len % sizeof(struct vring_desc));
+
+		for (j = 0; j < len / sizeof(struct vring_desc); j++)
+			vring_unmap_one(vq, &indir_desc[j]);
+
+		kfree(indir_desc);
+		state->indir_desc = NULL;
+	} else if (ctx) {
+		*ctx = state->indir_desc;
+	}
+}
+
+static inline bool more_used_split(const struct vring_virtqueue *vq)
 {
 	return vq->last_used_idx != virtio16_to_cpu(vq->vq.vdev, vq->vring.used->idx);
 }
 
+static inline bool more_used(const struct vring_virtqueue *vq)
+{
+	if (vq->packed_ring)
+		return more_used_packed(vq);
+	return vq->batch_last != vq->vring.num || more_used_split(vq);
+}
+
+static void *virtqueue_get_buf_ctx_in_order(struct virtqueue *_vq,
+					    unsigned int *len,
+					    void **ctx)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int head, last;
+	u16 last_used;
+	void *ret;
+
+	START_USE(vq);
+
+	if (unlikely(vq->broken)) {
+		END_USE(vq);
+		return NULL;
+	}
+
+	if (vq->batch_last == vq->vring.num) {
+		if (!more_used_split(vq)) {
+			pr_debug("No more buffers in queue\n");
+			END_USE(vq);
+			return NULL;
+		}
+
+		/* Only get used array entries after they have been exposed
+		 * by host. */
+		virtio_rmb(vq->weak_barriers);
+
+		last_used = (vq->last_used_idx & (vq->vring.num - 1));
+		last = virtio32_to_cpu(_vq->vdev,
+				       vq->vring.used->ring[last_used].id);
+		if (unlikely(last >= vq->vring.num)) {
+			BAD_RING(vq, "id %u out of range\n", last);
+			return NULL;
+		}
+		vq->batch_last = last;
+		vq->batch_len = virtio32_to_cpu(_vq->vdev,
+					vq->vring.used->ring[last_used].len);
+		vq->last_used_idx++;
+		/* If we expect an interrupt for the next entry, tell host
+		 * by writing event index and flush out the write before
+		 * the read in the next get_buf call. */
+		if (!(vq->avail_flags_shadow & VRING_AVAIL_F_NO_INTERRUPT))
+			virtio_store_mb(vq->weak_barriers,
+					&vring_used_event(&vq->vring),
+					cpu_to_virtio16(_vq->vdev,
+							vq->last_used_idx));
+	}
+
+	/* A used entry may stand for all the buffers made available up to
+	 * its own, which have no length then. */
+	head = vq->used_head;
+	if (unlikely(!vq->desc_state[head].data)) {
+		BAD_RING(vq, "id %u is not a head!\n", head);
+		return NULL;
+	}
+	if (head == vq->batch_last) {
+		*len = vq->batch_len;
+		vq->batch_last = vq->vring.num;
+	} else {
+		*len = 0;
+	}
+
+	/* detach_buf_in_order clears data, so grab it now. */
+	ret = vq->desc_state[head].data;
+	vq->used_head = (head + vq->desc_state[head].num) &
+			(vq->vring.num - 1);
+	detach_buf_in_order(vq, head, ctx);
+
+	LAST_ADD_TIME_INVALID(vq);
+
+	END_USE(vq);
+	return ret;
+}
+
 /**
  * virtqueue_get_buf - get the next used buffer
  * @vq: the struct virtqueue we're talking about.
@@ -705,6 +1609,11 @@ void *virtqueue_get_buf_ctx(struct virtqueue *_vq, unsigned int *len,
 	unsigned int i;
 	u16 last_used;
 
+	if (vq->packed_ring)
+		return virtqueue_get_buf_ctx_packed(_vq, len, ctx);
+	if (vq->in_order)
+		return virtqueue_get_buf_ctx_in_order(_vq, len, ctx);
+
 	START_USE(vq);
 
 	if (unlikely(vq->broken)) {
@@ -712,7 +1621,7 @@ void *virtqueue_get_buf_ctx(struct virtqueue *_vq, unsigned int *len,
 		return NULL;
 	}
 
-	if (!more_used(vq)) {
+	if (!more_used_split(vq)) {
 		pr_debug("No more buffers in queue\n");
 		END_USE(vq);
 		return NULL;
@@ -746,9 +1655,7 @@ void *virtqueue_get_buf_ctx(struct virtqueue *_vq, unsigned int *len,
 				&vring_used_event(&vq->vring),
 				cpu_to_virtio16(_vq->vdev, vq->last_used_idx));
 
-#ifdef DEBUG
-	vq->last_add_time_valid = false;
-#endif
+	LAST_ADD_TIME_INVALID(vq);
 
 	END_USE(vq);
 	return ret;
@@ -760,6 +1667,113 @@ void *virtqueue_get_buf(struct virtqueue *_vq, unsigned int *len)
 	return virtqueue_get_buf_ctx(_vq, len, NULL);
 }
 EXPORT_SYMBOL_GPL(virtqueue_get_buf);
+
+static unsigned int virtqueue_get_bufs_split(struct vring_virtqueue *vq,
+					     void *bufs[],
+					     unsigned int lens[],
+					     void *ctxs[],
+					     unsigned int max)
+{
+	struct virtio_device *vdev = vq->vq.vdev;
+	unsigned int i, n, used;
+	u16 last_used;
+
+	START_USE(vq);
+
+	if (unlikely(vq->broken)) {
+		END_USE(vq);
+		return 0;
+	}
+
+	used = (u16)(virtio16_to_cpu(vdev, vq->vring.used->idx) -
+		     vq->last_used_idx);
+	if (!used) {
+		END_USE(vq);
+		return 0;
+	}
+
+	/* Only get used array entries after they have been exposed by host. */
+	virtio_rmb(vq->weak_barriers);
+
+	for (n = 0; n < min(used, max); n++) {
+		last_used = (vq->last_used_idx & (vq->vring.num - 1));
+		i = virtio32_to_cpu(vdev, vq->vring.used->ring[last_used].id);
+
+		if (unlikely(i >= vq->vring.num)) {
+			BAD_RING(vq, "id %u out of range\n", i);
+			break;
+		}
+		if (unlikely(!vq->desc_state[i].data)) {
+			BAD_RING(vq, "id %u is not a head!\n", i);
+			break;
+		}
+
+		if (lens)
+			lens[n] = virtio32_to_cpu(vdev,
+					vq->vring.used->ring[last_used].len);
+		/* detach_buf clears data, so grab it now. */
+		bufs[n] = vq->desc_state[i].data;
+		detach_buf(vq, i, ctxs ? &ctxs[n] : NULL);
+		vq->last_used_idx++;
+	}
+
+	/* A single event index update for the whole batch. */
+	if (n && !(vq->avail_flags_shadow & VRING_AVAIL_F_NO_INTERRUPT))
+		virtio_store_mb(vq->weak_barriers,
+				&vring_used_event(&vq->vring),
+				cpu_to_virtio16(vdev, vq->last_used_idx));
+
+	LAST_ADD_TIME_INVALID(vq);
+
+	END_USE(vq);
+	return n;
+}
+
+/**
+ * virtqueue_get_bufs_ctx - get a batch of used buffers
+ * @vq: the struct virtqueue we're talking about.
+ * @bufs: where to store the "data" tokens handed to virtqueue_add_*().
+ * @lens: where to store the lengths written into the buffers, or NULL
+ * @ctxs: where to store the contexts of the tokens, or NULL
+ * @max: the most buffers to get
+ *
+ * This is virtqueue_get_buf_ctx() until there are no used buffers left or
+ * @max are got, except that a split ring reads used->idx and updates the
+ * used event index a single time.
+ *
+ * Caller must ensure we don't call this with other virtqueue
+ * operations at the same time (except where noted).
+ *
+ * Returns the number of buffers got.
+ */
+unsigned int virtqueue_get_bufs_ctx(struct virtqueue *_vq, void *bufs[],
+				    unsigned int lens[], void *ctxs[],
+				    unsigned int max)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int n, len;
+
+	if (!vq->packed_ring && !vq->in_order)
+		return virtqueue_get_bufs_split(vq, bufs, lens, ctxs, max);
+
+	for (n = 0; n < max; n++) {
+		bufs[n] = virtqueue_get_buf_ctx(_vq, &len,
+						ctxs ? &ctxs[n] : NULL);
+		if (!bufs[n])
+			break;
+		if (lens)
+			lens[n] = len;
+	}
+	return n;
+}
+EXPORT_SYMBOL_GPL(virtqueue_get_bufs_ctx);
+
+unsigned int virtqueue_get_bufs(struct virtqueue *_vq, void *bufs[],
+				unsigned int lens[], unsigned int max)
+{
+	return virtqueue_get_bufs_ctx(_vq, bufs, lens, NULL, max);
+}
+EXPORT_SYMBOL_GPL(virtqueue_get_bufs);
 /**
  * virtqueue_disable_cb - disable callbacks
  * @vq: the struct virtqueue we're talking about.
@@ -773,6 +1787,11 @@ void virtqueue_disable_cb(struct virtqueue *_vq)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 
+	if (vq->packed_ring) {
+		virtqueue_disable_cb_packed(_vq);
+		return;
+	}
+
 	if (!(vq->avail_flags_shadow & VRING_AVAIL_F_NO_INTERRUPT)) {
 		vq->avail_flags_shadow |= VRING_AVAIL_F_NO_INTERRUPT;
 		if (!vq->event)
@@ -799,6 +1818,9 @@ unsigned virtqueue_enable_cb_prepare(struct virtqueue *_vq)
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	u16 last_used_idx;
 
+	if (vq->packed_ring)
+		return virtqueue_enable_cb_prepare_packed(_vq);
+
 	START_USE(vq);
 
 	/* We optimistically turn back on interrupts, then check if there was
@@ -812,6 +1834,9 @@ unsigned virtqueue_enable_cb_prepare(struct virtqueue *_vq)
 			vq->vring.avail->flags = cpu_to_virtio16(_vq->vdev, vq->avail_flags_shadow);
 	}
 	vring_used_event(&vq->vring) = cpu_to_virtio16(_vq->vdev, last_used_idx = vq->last_used_idx);
+	/* Buffers of a used batch not handed back yet are pending too. */
+	if (vq->batch_last != vq->vring.num)
+		last_used_idx--;
 	END_USE(vq);
 	return last_used_idx;
 }
@@ -831,6 +1856,8 @@ bool virtqueue_poll(struct virtqueue *_vq, unsigned last_used_idx)
 	struct vring_virtqueue *vq = to_vvq(_vq);
 
 	virtio_mb(vq->weak_barriers);
+	if (vq->packed_ring)
+		return virtqueue_poll_packed(_vq, last_used_idx);
 	return (u16)last_used_idx != virtio16_to_cpu(_vq->vdev, vq->vring.used->idx);
 }
 EXPORT_SYMBOL_GPL(virtqueue_poll);
@@ -871,6 +1898,9 @@ bool virtqueue_enable_cb_delayed(struct virtqueue *_vq)
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	u16 bufs;
 
+	if (vq->packed_ring)
+		return virtqueue_enable_cb_delayed_packed(_vq);
+
 	START_USE(vq);
 
 	/* We optimistically turn back on interrupts, then check if there was
@@ -890,7 +1920,8 @@ bool virtqueue_enable_cb_delayed(struct virtqueue *_vq)
 			&vring_used_event(&vq->vring),
 			cpu_to_virtio16(_vq->vdev, vq->last_used_idx + bufs));
 
-	if (unlikely((u16)(virtio16_to_cpu(_vq->vdev, vq->vring.used->idx) - vq->last_used_idx) > bufs)) {
+	if (unlikely(vq->batch_last != vq->vring.num ||
+		     (u16)(virtio16_to_cpu(_vq->vdev, vq->vring.used->idx) - vq->last_used_idx) > bufs)) {
 		END_USE(vq);
 		return false;
 	}
@@ -914,6 +1945,9 @@ void *virtqueue_detach_unused_buf(struct virtqueue *_vq)
 	unsigned int i;
 	void *buf;
 
+	if (vq->packed_ring)
+		return virtqueue_detach_unused_buf_packed(_vq);
+
 	START_USE(vq);
 
 	for (i = 0; i < vq->vring.num; i++) {
@@ -921,7 +1955,10 @@ void *virtqueue_detach_unused_buf(struct virtqueue *_vq)
 			continue;
 		/* detach_buf clears data, so grab it now. */
 		buf = vq->desc_state[i].data;
-		detach_buf(vq, i, NULL);
+		if (vq->in_order)
+			detach_buf_in_order(vq, i, NULL);
+		else
+			detach_buf(vq, i, NULL);
 		vq->avail_idx_shadow--;
 		vq->vring.avail->idx = cpu_to_virtio16(_vq->vdev, vq->avail_idx_shadow);
 		END_USE(vq);
@@ -984,7 +2021,12 @@ struct virtqueue *__vring_new_virtqueue(unsigned int index,
 	vq->notify = notify;
 	vq->weak_barriers = weak_barriers;
 	vq->broken = false;
+	vq->packed_ring = false;
+	vq->batching = false;
 	vq->last_used_idx = 0;
+	vq->used_head = 0;
+	vq->batch_last = vring.num;
+	vq->batch_len = 0;
 	vq->avail_flags_shadow = 0;
 	vq->avail_idx_shadow = 0;
 	vq->num_added = 0;
@@ -997,6 +2039,7 @@ struct virtqueue *__vring_new_virtqueue(unsigned int index,
 	vq->indirect = virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC) &&
 		!context;
 	vq->event = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
+	vq->in_order = virtio_has_feature(vdev, VIRTIO_F_IN_ORDER);
 
 	/* No callback?  Tell other side not to bother us. */
 	if (!callback) {
@@ -1005,10 +2048,13 @@ struct virtqueue *__vring_new_virtqueue(unsigned int index,
 			vq->vring.avail->flags = cpu_to_virtio16(vdev, vq->avail_flags_shadow);
 	}
 
-	/* Put everything in free lists. */
+	/* Put everything in free lists.  In order, the list is a circle
+	 * that is taken from and given back to in turn. */
 	vq->free_head = 0;
 	for (i = 0; i < vring.num-1; i++)
 		vq->vring.desc[i].next = cpu_to_virtio16(vdev, i + 1);
+	if (vq->in_order)
+		vq->vring.desc[i].next = cpu_to_virtio16(vdev, 0);
 	memset(vq->desc_state, 0, vring.num * sizeof(struct vring_desc_state));
 
 	return &vq->vq;
@@ -1057,6 +2103,124 @@ static void vring_free_queue(struct virtio_device *vdev, size_t size,
 	}
 }
 
+/* The descriptor ring, followed by the driver and device event areas. */
+static size_t vring_size_packed(unsigned int num)
+{
+	return num * sizeof(struct vring_packed_desc) +
+		2 * sizeof(struct vring_packed_desc_event);
+}
+
+static struct virtqueue *vring_create_virtqueue_packed(
+	unsigned int index,
+	unsigned int num,
+	struct virtio_device *vdev,
+	bool weak_barriers,
+	bool context,
+	bool (*notify)(struct virtqueue *),
+	void (*callback)(struct virtqueue *),
+	const char *name)
+{
+	struct vring_virtqueue *vq;
+	struct vring_packed_desc *ring = NULL;
+	dma_addr_t dma_addr;
+	unsigned int i;
+
+	for (; num && vring_size_packed(num) > PAGE_SIZE; num /= 2) {
+		ring = vring_alloc_queue(vdev, vring_size_packed(num),
+					 &dma_addr,
+					 GFP_KERNEL|__GFP_NOWARN|__GFP_ZERO);
+		if (ring)
+			break;
+	}
+
+	if (!num)
+		return NULL;
+
+	if (!ring)
+		ring = vring_alloc_queue(vdev, vring_size_packed(num),
+					 &dma_addr, GFP_KERNEL|__GFP_ZERO);
+	if (!ring)
+		return NULL;
+
+	vq = kmalloc(sizeof(*vq) + num * sizeof(struct vring_desc_state),
+		     GFP_KERNEL);
+	if (!vq)
+		goto err_vq;
+
+	vq->packed.desc_extra = kmalloc_array(num,
+				sizeof(struct vring_desc_extra_packed),
+				GFP_KERNEL);
+	if (!vq->packed.desc_extra)
+		goto err_desc_extra;
+
+	memset(&vq->vring, 0, sizeof(vq->vring));
+	vq->vring.num = num;
+	vq->vq.callback = callback;
+	vq->vq.vdev = vdev;
+	vq->vq.name = name;
+	vq->vq.num_free = num;
+	vq->vq.index = index;
+	vq->we_own_ring = true;
+	vq->queue_dma_addr = dma_addr;
+	vq->queue_size_in_bytes = vring_size_packed(num);
+	vq->notify = notify;
+	vq->weak_barriers = weak_barriers;
+	vq->broken = false;
+	vq->packed_ring = true;
+	vq->in_order = false;
+	vq->batching = false;
+	vq->last_used_idx = 0;
+	vq->used_head = 0;
+	vq->batch_last = num;
+	vq->batch_len = 0;
+	vq->avail_flags_shadow = 0;
+	vq->avail_idx_shadow = 0;
+	vq->num_added = 0;
+#ifdef DEBUG
+	vq->in_use = false;
+	vq->last_add_time_valid = false;
+#endif
+
+	vq->indirect = virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC) &&
+		!context;
+	vq->event = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
+
+	vq->packed.desc = ring;
+	vq->packed.driver = (void *)&ring[num];
+	vq->packed.device = vq->packed.driver + 1;
+
+	/* Both wrap counters start at 1. */
+	vq->packed.next_avail_idx = 0;
+	vq->packed.avail_wrap_counter = 1;
+	vq->packed.used_wrap_counter = 1;
+	vq->packed.event_flags_shadow = 0;
+	vq->packed.avail_used_flags = 1 << VRING_PACKED_DESC_F_AVAIL;
+
+	/* Put everything in free lists. */
+	vq->free_head = 0;
+	memset(vq->packed.desc_extra, 0,
+	       num * sizeof(struct vring_desc_extra_packed));
+	for (i = 0; i < num - 1; i++)
+		vq->packed.desc_extra[i].next = i + 1;
+	memset(vq->desc_state, 0, num * sizeof(struct vring_desc_state));
+
+	/* No callback?  Tell other side not to bother us. */
+	if (!callback) {
+		vq->packed.event_flags_shadow = VRING_PACKED_EVENT_FLAG_DISABLE;
+		vq->packed.driver->flags =
+			cpu_to_le16(vq->packed.event_flags_shadow);
+	}
+
+	list_add_tail(&vq->vq.list, &vdev->vqs);
+	return &vq->vq;
+
+err_desc_extra:
+	kfree(vq);
+err_vq:
+	vring_free_queue(vdev, vring_size_packed(num), ring, dma_addr);
+	return NULL;
+}
+
 struct virtqueue *vring_create_virtqueue(
 	unsigned int index,
 	unsigned int num,
@@ -1081,6 +2245,11 @@ struct virtqueue *vring_create_virtqueue(
 		return NULL;
 	}
 
+	if (virtio_has_feature(vdev, VIRTIO_F_RING_PACKED))
+		return vring_create_virtqueue_packed(index, num, vdev,
+						     weak_barriers, context,
+						     notify, callback, name);
+
 	/* TODO: allocate each queue chunk individually */
 	for (; num && vring_size(num, vring_align) > PAGE_SIZE; num /= 2) {
 		queue = vring_alloc_queue(vdev, vring_size(num, vring_align),
@@ -1132,6 +2301,11 @@ struct virtqueue *vring_new_virtqueue(unsigned int index,
 				      const char *name)
 {
 	struct vring vring;
+
+	/* The caller laid out a split ring. */
+	if (virtio_has_feature(vdev, VIRTIO_F_RING_PACKED))
+		return NULL;
+
 	vring_init(&vring, num, pages, vring_align);
 	return __vring_new_virtqueue(index, vring, vdev, weak_barriers, context,
 				     notify, callback, name);
@@ -1142,7 +2316,11 @@ void vring_del_virtqueue(struct virtqueue *_vq)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 
-	if (vq->we_own_ring) {
+	if (vq->packed_ring) {
+		vring_free_queue(vq->vq.vdev, vq->queue_size_in_bytes,
+				 vq->packed.desc, vq->queue_dma_addr);
+		kfree(vq->packed.desc_extra);
+	} else if (vq->we_own_ring) {
 		vring_free_queue(vq->vq.vdev, vq->queue_size_in_bytes,
 				 vq->vring.desc, vq->queue_dma_addr);
 	}
@@ -1166,6 +2344,13 @@ void vring_transport_features(struct virtio_device *vdev)
 			break;
 		case VIRTIO_F_IOMMU_PLATFORM:
 			break;
+		case VIRTIO_F_RING_PACKED:
+			break;
+		case VIRTIO_F_IN_ORDER:
+			/* Only the split ring takes batched used entries. */
+			if (__virtio_test_bit(vdev, VIRTIO_F_RING_PACKED))
+				__virtio_clear_bit(vdev, i);
+			break;
 		default:
 			/* We don't understand this bit. */
 			__virtio_clear_bit(vdev, i);
@@ -1229,6 +2414,10 @@ dma_addr_t virtqueue_get_avail_addr(struct virtqueue *_vq)
 
 	BUG_ON(!vq->we_own_ring);
 
+	if (vq->packed_ring)
+		return vq->queue_dma_addr +
+			((char *)vq->packed.driver - (char *)vq->packed.desc);
+
 	return vq->queue_dma_addr +
 		((char *)vq->vring.avail - (char *)vq->vring.desc);
 }
@@ -1240,6 +2429,10 @@ dma_addr_t virtqueue_get_used_addr(struct virtqueue *_vq)
 
 	BUG_ON(!vq->we_own_ring);
 
+	if (vq->packed_ring)
+		return vq->queue_dma_addr +
+			((char *)vq->packed.device - (char *)vq->packed.desc);
+
 	return vq->queue_dma_addr +
 		((char *)vq->vring.used - (char *)vq->vring.desc);
 }
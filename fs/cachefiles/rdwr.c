@@ -13,8 +13,13 @@
 #include <linux/slab.h>
 #include <linux/file.h>
 #include <linux/swap.h>
+#include <linux/uio.h>
+#include <linux/list_sort.h>
 #include "internal.h"
 
+/* the most netfs pages read from the backing file with a single direct I/O */
+#define CACHEFILES_DIO_PAGES	64
+
 /*
  * detect wake up events generated by the unlocking of pages in which we're
  * interested
@@ -373,6 +378,136 @@ nomem:
 	return -ENOMEM;
 }
 
+/*
+ * open the backing file for direct I/O
+ * - returns NULL if the backing fs can't do direct I/O or can't tell us where
+ *   its data lies with SEEK_DATA/SEEK_HOLE, in which case the caller falls
+ *   back to going through the backing page cache
+ */
+static struct file *cachefiles_open_direct(struct cachefiles_object *object,
+					   struct cachefiles_cache *cache,
+					   int flags)
+{
+	struct inode *inode = d_backing_inode(object->backer);
+	struct file *file;
+	struct path path;
+
+	if (!inode->i_mapping->a_ops->direct_IO ||
+	    !inode->i_fop->llseek ||
+	    inode->i_fop->llseek == generic_file_llseek ||
+	    inode->i_fop->llseek == noop_llseek)
+		return NULL;
+
+	path.mnt = cache->mnt;
+	path.dentry = object->backer;
+	file = dentry_open(&path, flags | O_LARGEFILE | O_DIRECT,
+			   cache->cache_cred);
+	if (IS_ERR(file)) {
+		_debug("no direct I/O [%ld]", PTR_ERR(file));
+		return NULL;
+	}
+	return file;
+}
+
+/*
+ * determine whether the backing file holds data for a page
+ * - if we have a direct I/O file, the extent of data around the page is looked
+ *   up with SEEK_DATA/SEEK_HOLE and cached in extent[] so that a run of pages
+ *   costs one lookup
+ * - otherwise we assume the absence or presence of the first block is a good
+ *   enough indication for the page as a whole; bmap() doesn't indicate errors,
+ *   but it's all some backing filesystems give us
+ */
+static bool cachefiles_page_backed(struct inode *inode, struct file *file,
+				   struct page *page, loff_t extent[2])
+{
+	loff_t pos = page_offset(page);
+	sector_t block0, block;
+
+	if (file) {
+		if (pos >= extent[0] && pos < extent[1])
+			return true;
+
+		extent[0] = extent[1] = 0;
+		if (vfs_llseek(file, pos, SEEK_DATA) != pos)
+			return false;
+		extent[1] = vfs_llseek(file, pos, SEEK_HOLE);
+		if (extent[1] <= pos) {
+			extent[1] = 0;
+			return false;
+		}
+		extent[0] = pos;
+		_debug("data %llx-%llx", extent[0], extent[1]);
+		return true;
+	}
+
+	block0 = page->index;
+	block0 <<= PAGE_SHIFT - inode->i_sb->s_blocksize_bits;
+
+	block = inode->i_mapping->a_ops->bmap(inode->i_mapping, block0);
+	_debug("%llx -> %llx",
+	       (unsigned long long) block0,
+	       (unsigned long long) block);
+	return block != 0;
+}
+
+/*
+ * read a run of contiguous netfs pages straight from the backing file with a
+ * single direct I/O, bypassing the backing page cache
+ * - the netfs pages must be locked and in the netfs's page cache
+ * - each page is completed and has a ref dropped
+ * - a short read means EOF, so the remainder of the last page is cleared
+ */
+static void cachefiles_read_direct(struct cachefiles_object *object,
+				   struct fscache_retrieval *op,
+				   struct file *file,
+				   struct bio_vec *bvec, unsigned nr)
+{
+	struct iov_iter iter;
+	struct page *netpage;
+	loff_t pos = page_offset(bvec[0].bv_page);
+	ssize_t ret;
+	size_t done;
+	unsigned i;
+	int error;
+
+	_enter("{%lx},%u", bvec[0].bv_page->index, nr);
+
+	if (test_bit(FSCACHE_COOKIE_INVALIDATING,
+		     &object->fscache.cookie->flags)) {
+		ret = -ESTALE;
+	} else {
+		iov_iter_bvec(&iter, ITER_BVEC | READ, bvec, nr,
+			      nr * PAGE_SIZE);
+		ret = vfs_iter_read(file, &iter, &pos, 0);
+		if (ret == -EIO)
+			cachefiles_io_error_obj(object,
+						"Direct read failed on backing file");
+	}
+
+	done = ret > 0 ? ret : 0;
+	for (i = 0; i < nr; i++) {
+		netpage = bvec[i].bv_page;
+
+		if (done > 0) {
+			if (done < PAGE_SIZE)
+				zero_user_segment(netpage, done, PAGE_SIZE);
+			done -= min_t(size_t, done, PAGE_SIZE);
+			fscache_mark_page_cached(op, netpage);
+			error = 0;
+		} else {
+			error = ret < 0 ? ret : -ENODATA;
+		}
+
+		/* the netpage is unlocked and marked up to date here */
+		fscache_end_io(op, netpage, error);
+		put_page(netpage);
+		fscache_retrieval_complete(op, 1);
+	}
+
+	_leave(" [%zd]", ret);
+}
+
 /*
  * read a page from the cache or allocate a block in which to store it
  * - cache withdrawal is prevented by the caller
@@ -393,9 +528,10 @@ int cachefiles_read_or_alloc_page(struct fscache_retrieval *op,
 {
 	struct cachefiles_object *object;
 	struct cachefiles_cache *cache;
+	struct bio_vec bvec;
 	struct inode *inode;
-	sector_t block0, block;
-	unsigned shift;
+	struct file *file;
+	loff_t extent[2] = { 0, 0 };
 	int ret;
 
 	object = container_of(op->op.object,
@@ -413,40 +549,40 @@ int cachefiles_read_or_alloc_page(struct fscache_retrieval *op,
 	ASSERT(inode->i_mapping->a_ops->bmap);
 	ASSERT(inode->i_mapping->a_ops->readpages);
 
-	/* calculate the shift required to use bmap */
-	shift = PAGE_SHIFT - inode->i_sb->s_blocksize_bits;
-
 	op->op.flags &= FSCACHE_OP_KEEP_FLAGS;
 	op->op.flags |= FSCACHE_OP_ASYNC;
 	op->op.processor = cachefiles_read_copier;
 
-	/* we assume the absence or presence of the first block is a good
-	 * enough indication for the page as a whole
-	 * - TODO: don't use bmap() for this as it is _not_ actually good
-	 *   enough for this as it doesn't indicate errors, but it's all we've
-	 *   got for the moment
-	 */
-	block0 = page->index;
-	block0 <<= shift;
-
-	block = inode->i_mapping->a_ops->bmap(inode->i_mapping, block0);
-	_debug("%llx -> %llx",
-	       (unsigned long long) block0,
-	       (unsigned long long) block);
+	file = cachefiles_open_direct(object, cache, O_RDONLY);
 
-	if (block) {
+	if (cachefiles_page_backed(inode, file, page, extent)) {
 		/* submit the apparently valid page to the backing fs to be
 		 * read from disk */
-		ret = cachefiles_read_backing_file_one(object, op, page);
+		if (file) {
+			/* the netfs keeps its ref on the page */
+			get_page(page);
+			bvec.bv_page = page;
+			bvec.bv_len = PAGE_SIZE;
+			bvec.bv_offset = 0;
+			cachefiles_read_direct(object, op, file, &bvec, 1);
+			ret = 0;
+		} else {
+			ret = cachefiles_read_backing_file_one(object, op,
+							       page);
+		}
 	} else if (cachefiles_has_space(cache, 0, 1) == 0) {
 		/* there's space in the cache we can use */
 		fscache_mark_page_cached(op, page);
 		fscache_retrieval_complete(op, 1);
 		ret = -ENODATA;
 	} else {
+		if (file)
+			fput(file);
 		goto enobufs;
 	}
 
+	if (file)
+		fput(file);
 	_leave(" = %d", ret);
 	return ret;
 
@@ -668,6 +804,86 @@ record_page_complete:
 	goto out;
 }
 
+static int cachefiles_page_cmp(void *priv, struct list_head *a,
+			       struct list_head *b)
+{
+	struct page *pa = list_entry(a, struct page, lru);
+	struct page *pb = list_entry(b, struct page, lru);
+
+	return pa->index < pb->index ? -1 : pa->index > pb->index;
+}
+
+/*
+ * read a list of pages from the backing file with direct I/O, in runs of
+ * contiguous pages
+ * - any uncertain pages are simply discarded, to be tried again another time
+ */
+static int cachefiles_read_backing_file_direct(struct cachefiles_object *object,
+					       struct fscache_retrieval *op,
+					       struct file *file,
+					       struct list_head *list)
+{
+	struct page *netpage, *_n;
+	struct bio_vec *bvec;
+	unsigned nr = 0;
+	int ret = 0;
+
+	_enter("");
+
+	bvec = kmalloc_array(CACHEFILES_DIO_PAGES, sizeof(*bvec),
+			     cachefiles_gfp);
+	if (!bvec) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* readahead hands us the pages in any order it likes */
+	list_sort(NULL, list, cachefiles_page_cmp);
+
+	list_for_each_entry_safe(netpage, _n, list, lru) {
+		list_del(&netpage->lru);
+
+		if (nr > 0 &&
+		    (nr == CACHEFILES_DIO_PAGES ||
+		     netpage->index != bvec[nr - 1].bv_page->index + 1)) {
+			cachefiles_read_direct(object, op, file, bvec, nr);
+			nr = 0;
+		}
+
+		ret = add_to_page_cache_lru(netpage, op->mapping,
+					    netpage->index, cachefiles_gfp);
+		if (ret < 0) {
+			put_page(netpage);
+			fscache_retrieval_complete(op, 1);
+			if (ret == -EEXIST) {
+				ret = 0;
+				continue;
+			}
+			ret = -ENOMEM;
+			break;
+		}
+
+		bvec[nr].bv_page = netpage;
+		bvec[nr].bv_len = PAGE_SIZE;
+		bvec[nr].bv_offset = 0;
+		nr++;
+	}
+
+	if (nr > 0)
+		cachefiles_read_direct(object, op, file, bvec, nr);
+	kfree(bvec);
+
+out:
+	list_for_each_entry_safe(netpage, _n, list, lru) {
+		list_del(&netpage->lru);
+		put_page(netpage);
+		fscache_retrieval_complete(op, 1);
+	}
+
+	_leave(" = %d", ret);
+	return ret;
+}
+
 /*
  * read a list of pages from the cache or allocate blocks in which to store
  * them
@@ -683,7 +899,9 @@ int cachefiles_read_or_alloc_pages(struct fscache_retrieval *op,
 	struct pagevec pagevec;
 	struct inode *inode;
 	struct page *page, *_n;
-	unsigned shift, nrbackpages;
+	struct file *file;
+	loff_t extent[2] = { 0, 0 };
+	unsigned nrbackpages;
 	int ret, ret2, space;
 
 	object = container_of(op->op.object,
@@ -707,8 +925,7 @@ int cachefiles_read_or_alloc_pages(struct fscache_retrieval *op,
 	ASSERT(inode->i_mapping->a_ops->bmap);
 	ASSERT(inode->i_mapping->a_ops->readpages);
 
-	/* calculate the shift required to use bmap */
-	shift = PAGE_SHIFT - inode->i_sb->s_blocksize_bits;
+	file = cachefiles_open_direct(object, cache, O_RDONLY);
 
 	pagevec_init(&pagevec, 0);
 
@@ -721,24 +938,7 @@ int cachefiles_read_or_alloc_pages(struct fscache_retrieval *op,
 
 	ret = space ? -ENODATA : -ENOBUFS;
 	list_for_each_entry_safe(page, _n, pages, lru) {
-		sector_t block0, block;
-
-		/* we assume the absence or presence of the first block is a
-		 * good enough indication for the page as a whole
-		 * - TODO: don't use bmap() for this as it is _not_ actually
-		 *   good enough for this as it doesn't indicate errors, but
-		 *   it's all we've got for the moment
-		 */
-		block0 = page->index;
-		block0 <<= shift;
-
-		block = inode->i_mapping->a_ops->bmap(inode->i_mapping,
-						      block0);
-		_debug("%llx -> %llx",
-		       (unsigned long long) block0,
-		       (unsigned long long) block);
-
-		if (block) {
+		if (cachefiles_page_backed(inode, file, page, extent)) {
 			/* we have data - add it to the list to give to the
 			 * backing fs */
 			list_move(&page->lru, &backpages);
@@ -762,11 +962,20 @@ int cachefiles_read_or_alloc_pages(struct fscache_retrieval *op,
 	/* submit the apparently valid pages to the backing fs to be read from
 	 * disk */
 	if (nrbackpages > 0) {
-		ret2 = cachefiles_read_backing_file(object, op, &backpages);
+		if (file)
+			ret2 = cachefiles_read_backing_file_direct(object, op,
+								   file,
+								   &backpages);
+		else
+			ret2 = cachefiles_read_backing_file(object, op,
+							    &backpages);
 		if (ret2 == -ENOMEM || ret2 == -EINTR)
 			ret = ret2;
 	}
 
+	if (file)
+		fput(file);
+
 	_leave(" = %d [nr=%u%s]",
 	       ret, *nr_pages, list_empty(pages) ? " empty" : "");
 	return ret;
@@ -874,6 +1083,8 @@ int cachefiles_write_page(struct fscache_storage *op, struct page *page)
 {
 	struct cachefiles_object *object;
 	struct cachefiles_cache *cache;
+	struct iov_iter iter;
+	struct bio_vec bvec;
 	struct file *file;
 	struct path path;
 	loff_t pos, eof;
@@ -908,16 +1119,6 @@ int cachefiles_write_page(struct fscache_storage *op, struct page *page)
 	if (pos >= eof)
 		goto error;
 
-	/* write the page to the backing filesystem and let it store it in its
-	 * own time */
-	path.mnt = cache->mnt;
-	path.dentry = object->backer;
-	file = dentry_open(&path, O_RDWR | O_LARGEFILE, cache->cache_cred);
-	if (IS_ERR(file)) {
-		ret = PTR_ERR(file);
-		goto error_2;
-	}
-
 	len = PAGE_SIZE;
 	if (eof & ~PAGE_MASK) {
 		if (eof - pos < PAGE_SIZE) {
@@ -928,9 +1129,36 @@ int cachefiles_write_page(struct fscache_storage *op, struct page *page)
 		}
 	}
 
-	data = kmap(page);
-	ret = __kernel_write(file, data, len, &pos);
-	kunmap(page);
+	/* a whole page is written straight to disk so that it doesn't occupy
+	 * the backing page cache as well as the netfs's; a partial page at EOF
+	 * can't be, so the backing filesystem stores that in its own time */
+	file = NULL;
+	if (len == PAGE_SIZE)
+		file = cachefiles_open_direct(object, cache, O_RDWR);
+
+	if (file) {
+		bvec.bv_page = page;
+		bvec.bv_len = PAGE_SIZE;
+		bvec.bv_offset = 0;
+		iov_iter_bvec(&iter, ITER_BVEC | WRITE, &bvec, 1, PAGE_SIZE);
+
+		file_start_write(file);
+		ret = vfs_iter_write(file, &iter, &pos, 0);
+		file_end_write(file);
+	} else {
+		path.mnt = cache->mnt;
+		path.dentry = object->backer;
+		file = dentry_open(&path, O_RDWR | O_LARGEFILE,
+				   cache->cache_cred);
+		if (IS_ERR(file)) {
+			ret = PTR_ERR(file);
+			goto error_2;
+		}
+
+		data = kmap(page);
+		ret = __kernel_write(file, data, len, &pos);
+		kunmap(page);
+	}
 	fput(file);
 	if (ret != len)
 		goto error_eio;
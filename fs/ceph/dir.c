@@ -1012,6 +1012,58 @@ static int drop_caps_for_unlink(struct inode *inode)
 	return drop;
 }
 
+static void ceph_async_unlink_cb(struct ceph_mds_client *mdsc,
+				 struct ceph_mds_request *req)
+{
+	int result = req->r_err ? req->r_err :
+			le32_to_cpu(req->r_reply_info.head->result);
+
+	/* -EJUKEBOX: never sent, the caller retries synchronously */
+	if (result && result != -EJUKEBOX) {
+		pr_warn("ceph: async unlink failure path=(%llx)%pd result=%d!\n",
+			ceph_ino(req->r_parent), req->r_dentry, result);
+		ceph_dir_clear_complete(req->r_parent);
+		/* the inode we dropped the link of may still be linked */
+		mapping_set_error(req->r_old_inode->i_mapping, result);
+	}
+
+	/* without any reply this is an early error under mdsc->mutex */
+	if (test_bit(CEPH_MDS_R_GOT_UNSAFE, &req->r_req_flags) ||
+	    test_bit(CEPH_MDS_R_GOT_SAFE, &req->r_req_flags))
+		ceph_put_cap_refs(ceph_inode(req->r_parent), req->r_dir_caps);
+	else
+		ceph_put_cap_refs_no_check_caps(ceph_inode(req->r_parent),
+						req->r_dir_caps);
+	req->r_dir_caps = 0;
+}
+
+/*
+ * Holding Fx and DIR_UNLINK on the directory, the outcome of unlinking its
+ * only link is known in advance, so the reply need not be waited for.
+ * Returns the cap refs taken, 0 if the unlink has to be synchronous.
+ */
+static int get_caps_for_async_unlink(struct inode *dir, struct dentry *dentry)
+{
+	struct ceph_inode_info *ci = ceph_inode(dir);
+	struct ceph_dentry_info *di = ceph_dentry(dentry);
+	struct inode *inode = d_inode(dentry);
+	int want = CEPH_CAP_FILE_EXCL | CEPH_CAP_DIR_UNLINK;
+	int got = 0;
+
+	if (d_is_dir(dentry) || inode->i_nlink != 1)
+		return 0;
+
+	spin_lock(&ci->i_ceph_lock);
+	if ((__ceph_caps_issued(ci, NULL) & want) == want &&
+	    di->lease_shared_gen == ci->i_shared_gen) {
+		__ceph_get_cap_refs(ci, want);
+		got = want;
+	}
+	spin_unlock(&ci->i_ceph_lock);
+
+	return got;
+}
+
 /*
  * rmdir and unlink are differ only by the metadata op code
  */
@@ -1021,6 +1073,7 @@ static int ceph_unlink(struct inode *dir, struct dentry *dentry)
 	struct ceph_mds_client *mdsc = fsc->mdsc;
 	struct inode *inode = d_inode(dentry);
 	struct ceph_mds_request *req;
+	bool try_async = ceph_test_mount_opt(fsc, ASYNC_DIROPS);
 	int err = -EROFS;
 	int op;
 
@@ -1035,6 +1088,7 @@ static int ceph_unlink(struct inode *dir, struct dentry *dentry)
 			CEPH_MDS_OP_RMDIR : CEPH_MDS_OP_UNLINK;
 	} else
 		goto out;
+retry:
 	req = ceph_mdsc_create_request(mdsc, op, USE_AUTH_MDS);
 	if (IS_ERR(req)) {
 		err = PTR_ERR(req);
@@ -1043,13 +1097,34 @@ static int ceph_unlink(struct inode *dir, struct dentry *dentry)
 	req->r_dentry = dget(dentry);
 	req->r_num_caps = 2;
 	req->r_parent = dir;
-	set_bit(CEPH_MDS_R_PARENT_LOCKED, &req->r_req_flags);
 	req->r_dentry_drop = CEPH_CAP_FILE_SHARED;
 	req->r_dentry_unless = CEPH_CAP_FILE_EXCL;
 	req->r_inode_drop = drop_caps_for_unlink(inode);
-	err = ceph_mdsc_do_request(mdsc, dir, req);
-	if (!err && !req->r_reply_info.head->is_dentry)
-		d_delete(dentry);
+
+	if (try_async && op == CEPH_MDS_OP_UNLINK &&
+	    (req->r_dir_caps = get_caps_for_async_unlink(dir, dentry))) {
+		dout("async_unlink dir %p dn %p inode %p\n", dir, dentry,
+		     inode);
+		set_bit(CEPH_MDS_R_ASYNC, &req->r_req_flags);
+		req->r_callback = ceph_async_unlink_cb;
+		req->r_old_inode = inode;
+		ihold(inode);
+		err = ceph_mdsc_submit_request(mdsc, dir, req);
+		if (!err) {
+			/* the caps we hold say the unlink will succeed */
+			drop_nlink(inode);
+			d_delete(dentry);
+		} else if (err == -EJUKEBOX) {
+			try_async = false;
+			ceph_mdsc_put_request(req);
+			goto retry;
+		}
+	} else {
+		set_bit(CEPH_MDS_R_PARENT_LOCKED, &req->r_req_flags);
+		err = ceph_mdsc_do_request(mdsc, dir, req);
+		if (!err && !req->r_reply_info.head->is_dentry)
+			d_delete(dentry);
+	}
 	ceph_mdsc_put_request(req);
 out:
 	return err;
@@ -551,6 +551,7 @@ void ceph_mdsc_release_request(struct kref *kref)
 	if (req->r_parent)
 		ceph_put_cap_refs(ceph_inode(req->r_parent), CEPH_CAP_PIN);
 	iput(req->r_target_inode);
+	iput(req->r_old_inode);
 	if (req->r_dentry)
 		dput(req->r_dentry);
 	if (req->r_old_dentry)
@@ -622,6 +623,15 @@ static void __register_request(struct ceph_mds_client *mdsc,
 		ihold(dir);
 		req->r_unsafe_dir = dir;
 	}
+
+	/* Nobody waits for an async request, dir fsync has to from now on */
+	if (dir && test_bit(CEPH_MDS_R_ASYNC, &req->r_req_flags)) {
+		struct ceph_inode_info *ci = ceph_inode(dir);
+
+		spin_lock(&ci->i_unsafe_lock);
+		list_add_tail(&req->r_unsafe_dir_item, &ci->i_unsafe_dirops);
+		spin_unlock(&ci->i_unsafe_lock);
+	}
 }
 
 static void __unregister_request(struct ceph_mds_client *mdsc,
@@ -649,7 +659,8 @@ static void __unregister_request(struct ceph_mds_client *mdsc,
 	erase_request(&mdsc->request_tree, req);
 
 	if (req->r_unsafe_dir  &&
-	    test_bit(CEPH_MDS_R_GOT_UNSAFE, &req->r_req_flags)) {
+	    (test_bit(CEPH_MDS_R_GOT_UNSAFE, &req->r_req_flags) ||
+	     test_bit(CEPH_MDS_R_ASYNC, &req->r_req_flags))) {
 		struct ceph_inode_info *ci = ceph_inode(req->r_unsafe_dir);
 		spin_lock(&ci->i_unsafe_lock);
 		list_del_init(&req->r_unsafe_dir_item);
@@ -2121,6 +2132,8 @@ static int __prepare_send_request(struct ceph_mds_client *mdsc,
 		flags |= CEPH_MDS_FLAG_REPLAY;
 	if (req->r_parent)
 		flags |= CEPH_MDS_FLAG_WANT_DENTRY;
+	if (test_bit(CEPH_MDS_R_ASYNC, &req->r_req_flags))
+		flags |= CEPH_MDS_FLAG_ASYNC;
 	rhead->flags = cpu_to_le32(flags);
 	rhead->num_fwd = req->r_num_fwd;
 	rhead->num_retry = req->r_attempts - 1;
@@ -2206,6 +2219,16 @@ static int __do_request(struct ceph_mds_client *mdsc,
 			err = -EACCES;
 			goto out_session;
 		}
+		/*
+		 * The caps an async request relies on may not survive the
+		 * session (re)open, let the caller retry synchronously if
+		 * it has not been sent yet.
+		 */
+		if (test_bit(CEPH_MDS_R_ASYNC, &req->r_req_flags) &&
+		    !req->r_attempts) {
+			err = -EJUKEBOX;
+			goto out_session;
+		}
 		if (session->s_state == CEPH_MDS_SESSION_NEW ||
 		    session->s_state == CEPH_MDS_SESSION_CLOSING)
 			__open_session(mdsc, session);
@@ -2284,27 +2307,17 @@ static void kick_requests(struct ceph_mds_client *mdsc, int mds)
 	}
 }
 
-void ceph_mdsc_submit_request(struct ceph_mds_client *mdsc,
-			      struct ceph_mds_request *req)
-{
-	dout("submit_request on %p\n", req);
-	mutex_lock(&mdsc->mutex);
-	__register_request(mdsc, req, NULL);
-	__do_request(mdsc, req);
-	mutex_unlock(&mdsc->mutex);
-}
-
 /*
- * Synchrously perform an mds request.  Take care of all of the
- * session setup, forwarding, retry details.
+ * Send an mds request without waiting for the reply.  Returns an early
+ * error only; the result is reported through r_callback or r_completion.
  */
-int ceph_mdsc_do_request(struct ceph_mds_client *mdsc,
-			 struct inode *dir,
-			 struct ceph_mds_request *req)
+int ceph_mdsc_submit_request(struct ceph_mds_client *mdsc,
+			     struct inode *dir,
+			     struct ceph_mds_request *req)
 {
 	int err;
 
-	dout("do_request on %p\n", req);
+	dout("submit_request on %p for inode %p\n", req, dir);
 
 	/* take CAP_PIN refs for r_inode, r_parent, r_old_dentry */
 	if (req->r_inode)
@@ -2319,14 +2332,29 @@ int ceph_mdsc_do_request(struct ceph_mds_client *mdsc,
 	mutex_lock(&mdsc->mutex);
 	__register_request(mdsc, req, dir);
 	__do_request(mdsc, req);
+	err = req->r_err;
+	mutex_unlock(&mdsc->mutex);
 
-	if (req->r_err) {
-		err = req->r_err;
+	return err;
+}
+
+/*
+ * Synchrously perform an mds request.  Take care of all of the
+ * session setup, forwarding, retry details.
+ */
+int ceph_mdsc_do_request(struct ceph_mds_client *mdsc,
+			 struct inode *dir,
+			 struct ceph_mds_request *req)
+{
+	int err;
+
+	dout("do_request on %p\n", req);
+
+	err = ceph_mdsc_submit_request(mdsc, dir, req);
+	if (err)
 		goto out;
-	}
 
 	/* wait */
-	mutex_unlock(&mdsc->mutex);
 	dout("do_request waiting\n");
 	if (!req->r_timeout && req->r_wait_for_completion) {
 		err = req->r_wait_for_completion(mdsc, req);
@@ -2367,8 +2395,8 @@ int ceph_mdsc_do_request(struct ceph_mds_client *mdsc,
 		err = req->r_err;
 	}
 
-out:
 	mutex_unlock(&mdsc->mutex);
+out:
 	dout("do_request %p done, result %d\n", req, err);
 	return err;
 }
@@ -2503,7 +2531,8 @@ static void handle_reply(struct ceph_mds_session *session, struct ceph_msg *msg)
 	} else {
 		set_bit(CEPH_MDS_R_GOT_UNSAFE, &req->r_req_flags);
 		list_add_tail(&req->r_unsafe_item, &req->r_session->s_unsafe);
-		if (req->r_unsafe_dir) {
+		if (req->r_unsafe_dir &&
+		    !test_bit(CEPH_MDS_R_ASYNC, &req->r_req_flags)) {
 			struct ceph_inode_info *ci =
 					ceph_inode(req->r_unsafe_dir);
 			spin_lock(&ci->i_unsafe_lock);
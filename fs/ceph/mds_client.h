@@ -217,6 +217,7 @@ struct ceph_mds_request {
 #define CEPH_MDS_R_GOT_RESULT		(5) /* got a result */
 #define CEPH_MDS_R_DID_PREPOPULATE	(6) /* prepopulated readdir */
 #define CEPH_MDS_R_PARENT_LOCKED	(7) /* is r_parent->i_rwsem wlocked? */
+#define CEPH_MDS_R_ASYNC		(8) /* caller does not wait for reply */
 	unsigned long	r_req_flags;
 
 	struct mutex r_fill_mutex;
@@ -241,6 +242,9 @@ struct ceph_mds_request {
 	struct inode *r_old_inode;
 	int r_old_inode_drop, r_old_inode_unless;
 
+	/* cap refs on r_parent held for an async request, until the reply */
+	int r_dir_caps;
+
 	struct ceph_msg  *r_request;  /* original request */
 	int r_request_release_offset;
 	struct ceph_msg  *r_reply;
@@ -401,8 +405,9 @@ extern int ceph_alloc_readdir_reply_buffer(struct ceph_mds_request *req,
 					   struct inode *dir);
 extern struct ceph_mds_request *
 ceph_mdsc_create_request(struct ceph_mds_client *mdsc, int op, int mode);
-extern void ceph_mdsc_submit_request(struct ceph_mds_client *mdsc,
-				     struct ceph_mds_request *req);
+extern int ceph_mdsc_submit_request(struct ceph_mds_client *mdsc,
+				    struct inode *dir,
+				    struct ceph_mds_request *req);
 extern int ceph_mdsc_do_request(struct ceph_mds_client *mdsc,
 				struct inode *dir,
 				struct ceph_mds_request *req);
@@ -140,6 +140,8 @@ enum {
 	Opt_nopoolperm,
 	Opt_require_active_mds,
 	Opt_norequire_active_mds,
+	Opt_wsync,
+	Opt_nowsync,
 #ifdef CONFIG_CEPH_FS_POSIX_ACL
 	Opt_acl,
 #endif
@@ -177,6 +179,8 @@ static match_table_t fsopt_tokens = {
 	{Opt_nopoolperm, "nopoolperm"},
 	{Opt_require_active_mds, "require_active_mds"},
 	{Opt_norequire_active_mds, "norequire_active_mds"},
+	{Opt_wsync, "wsync"},
+	{Opt_nowsync, "nowsync"},
 #ifdef CONFIG_CEPH_FS_POSIX_ACL
 	{Opt_acl, "acl"},
 #endif
@@ -307,6 +311,12 @@ static int parse_fsopt_token(char *c, void *private)
 	case Opt_norequire_active_mds:
 		fsopt->flags |= CEPH_MOUNT_OPT_MOUNTWAIT;
 		break;
+	case Opt_wsync:
+		fsopt->flags &= ~CEPH_MOUNT_OPT_ASYNC_DIROPS;
+		break;
+	case Opt_nowsync:
+		fsopt->flags |= CEPH_MOUNT_OPT_ASYNC_DIROPS;
+		break;
 #ifdef CONFIG_CEPH_FS_POSIX_ACL
 	case Opt_acl:
 		fsopt->sb_flags |= MS_POSIXACL;
@@ -496,6 +506,8 @@ static int ceph_show_options(struct seq_file *m, struct dentry *root)
 	}
 	if (fsopt->flags & CEPH_MOUNT_OPT_NOPOOLPERM)
 		seq_puts(m, ",nopoolperm");
+	if (fsopt->flags & CEPH_MOUNT_OPT_ASYNC_DIROPS)
+		seq_puts(m, ",nowsync");
 
 #ifdef CONFIG_CEPH_FS_POSIX_ACL
 	if (fsopt->sb_flags & MS_POSIXACL)
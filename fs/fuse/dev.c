@@ -21,6 +21,7 @@
 #include <linux/swap.h>
 #include <linux/splice.h>
 #include <linux/sched.h>
+#include <linux/mm.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
@@ -309,11 +310,52 @@ static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
+	req->fiq = fiq;
 	list_add_tail(&req->list, &fiq->pending);
 	wake_up_locked(&fiq->waitq);
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 }
 
+/*
+ * Lock the input queue for a new request: the per-CPU queue of the
+ * submitting CPU when a device is bound to it, the main queue otherwise.
+ * Each daemon thread reading a per-CPU queue then only contends with the
+ * submitters on its CPU.
+ */
+static struct fuse_iqueue *lock_iqueue(struct fuse_conn *fc)
+{
+	struct fuse_iqueue **cpu_iq = smp_load_acquire(&fc->cpu_iq);
+	struct fuse_iqueue *fiq;
+
+	if (cpu_iq) {
+		fiq = smp_load_acquire(&cpu_iq[raw_smp_processor_id()]);
+		if (fiq) {
+			spin_lock(&fiq->waitq.lock);
+			if (fiq->bound)
+				return fiq;
+			spin_unlock(&fiq->waitq.lock);
+		}
+	}
+
+	fiq = &fc->iq;
+	spin_lock(&fiq->waitq.lock);
+	return fiq;
+}
+
+/* Lock the input queue of a pending request, which may requeue it */
+static struct fuse_iqueue *lock_req_iqueue(struct fuse_req *req)
+{
+	struct fuse_iqueue *fiq;
+
+	for (;;) {
+		fiq = READ_ONCE(req->fiq);
+		spin_lock(&fiq->waitq.lock);
+		if (likely(fiq == req->fiq))
+			return fiq;
+		spin_unlock(&fiq->waitq.lock);
+	}
+}
+
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
@@ -339,12 +381,12 @@ static void flush_bg_queue(struct fuse_conn *fc)
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
 		struct fuse_req *req;
-		struct fuse_iqueue *fiq = &fc->iq;
+		struct fuse_iqueue *fiq;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->waitq.lock);
+		fiq = lock_iqueue(fc);
 		req->in.h.unique = fuse_get_unique(fiq);
 		queue_request(fiq, req);
 		spin_unlock(&fiq->waitq.lock);
@@ -438,7 +480,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->waitq.lock);
+		fiq = lock_req_iqueue(req);
 		/* Request is not yet in userspace, bail out */
 		if (test_bit(FR_PENDING, &req->flags)) {
 			list_del(&req->list);
@@ -459,10 +501,10 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 
 static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->waitq.lock);
+	fiq = lock_iqueue(fc);
 	if (!fiq->connected) {
 		spin_unlock(&fiq->waitq.lock);
 		req->out.h.error = -ENOTCONN;
@@ -685,6 +727,7 @@ struct fuse_copy_state {
 	unsigned len;
 	unsigned offset;
 	unsigned move_pages:1;
+	struct fuse_shm *shm;
 };
 
 static void fuse_copy_init(struct fuse_copy_state *cs, int write,
@@ -914,6 +957,123 @@ out_fallback:
 	return 1;
 }
 
+/*
+ * Move a whole pool page of the reply into the page cache in place of
+ * the request page, and give the pool a new zeroed page in its slot.
+ * Returns 1 to copy the data instead, when it isn't a whole pool page or
+ * the pool page is still used elsewhere.
+ */
+static int fuse_try_move_shm_page(struct fuse_copy_state *cs,
+				  struct page **pagep)
+{
+	struct fuse_shm *shm = cs->shm;
+	struct page *oldpage = *pagep;
+	struct page *page, *newpage;
+	unsigned long idx;
+	ssize_t len;
+	size_t off;
+	int err;
+
+	err = unlock_request(cs->req);
+	if (err)
+		return err;
+
+	fuse_copy_finish(cs);
+
+	len = iov_iter_get_pages(cs->iter, &page, PAGE_SIZE, 1, &off);
+	if (len < 0)
+		return len;
+	BUG_ON(!len);
+	iov_iter_advance(cs->iter, len);
+	cs->pg = page;
+	cs->offset = off;
+	cs->len = len;
+
+	if (off || len != PAGE_SIZE ||
+	    page_private(page) != (unsigned long)shm)
+		goto out_fallback;
+
+	/*
+	 * This is a new and locked page, it shouldn't be mapped or
+	 * have any special flags on it
+	 */
+	if (WARN_ON(page_mapped(oldpage) || page_has_private(oldpage) ||
+		    PageDirty(oldpage) || PageWriteback(oldpage) ||
+		    PageMlocked(oldpage)))
+		goto out_fallback;
+
+	newpage = alloc_page(GFP_HIGHUSER | __GFP_ZERO);
+	if (!newpage)
+		goto out_fallback;
+
+	lock_page(page);
+	spin_lock(&shm->lock);
+	idx = page->index;
+	if (page_private(page) != (unsigned long)shm ||
+	    idx >= shm->nr_pages || shm->pages[idx] != page) {
+		spin_unlock(&shm->lock);
+		unlock_page(page);
+		__free_page(newpage);
+		goto out_fallback;
+	}
+	set_page_private(newpage, (unsigned long)shm);
+	newpage->index = idx;
+	shm->pages[idx] = newpage;
+	set_page_private(page, 0);
+	spin_unlock(&shm->lock);
+
+	/*
+	 * Faults map the new page from now on, see fuse_shm_fault(). The
+	 * mapping is the one of /dev/fuse, so this also makes the other
+	 * daemons refault their page at this offset.
+	 */
+	unmap_mapping_range(shm->mapping, (loff_t)idx << PAGE_SHIFT,
+			    PAGE_SIZE, 1);
+
+	/* Only the pool reference, now ours, and the one of this copy */
+	if (page_mapped(page) || page_count(page) != 2) {
+		unlock_page(page);
+		put_page(page);
+		goto out_fallback;
+	}
+	ClearPageDirty(page);
+	SetPageUptodate(page);
+
+	err = replace_page_cache_page(oldpage, page, GFP_KERNEL);
+	if (err) {
+		unlock_page(page);
+		put_page(page);
+		return err;
+	}
+	lru_cache_add_file(page);
+
+	spin_lock(&cs->req->waitq.lock);
+	if (test_bit(FR_ABORTED, &cs->req->flags))
+		err = -ENOENT;
+	else
+		*pagep = page;
+	spin_unlock(&cs->req->waitq.lock);
+
+	if (err) {
+		unlock_page(page);
+		put_page(page);
+		return err;
+	}
+
+	unlock_page(oldpage);
+	put_page(oldpage);
+	cs->len = 0;
+
+	return 0;
+
+out_fallback:
+	err = lock_request(cs->req);
+	if (err)
+		return err;
+
+	return 1;
+}
+
 static int fuse_ref_page(struct fuse_copy_state *cs, struct page *page,
 			 unsigned offset, unsigned count)
 {
@@ -964,6 +1124,11 @@ static int fuse_copy_page(struct fuse_copy_state *cs, struct page **pagep,
 				err = fuse_try_move_page(cs, pagep);
 				if (err <= 0)
 					return err;
+			} else if (cs->shm && page &&
+				   offset == 0 && count == PAGE_SIZE) {
+				err = fuse_try_move_shm_page(cs, pagep);
+				if (err <= 0)
+					return err;
 			} else {
 				err = fuse_copy_fill(cs);
 				if (err)
@@ -1216,7 +1381,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 {
 	ssize_t err;
 	struct fuse_conn *fc = fud->fc;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq = READ_ONCE(fud->iq);
 	struct fuse_pqueue *fpq = &fud->pq;
 	struct fuse_req *req;
 	struct fuse_in *in;
@@ -1300,7 +1465,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	/* matches barrier in request_wait_answer() */
 	smp_mb__after_atomic();
 	if (test_bit(FR_INTERRUPTED, &req->flags))
-		queue_interrupt(fiq, req);
+		queue_interrupt(&fc->iq, req);
 
 	return reqsize;
 
@@ -1658,7 +1823,7 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 		num = file_size - outarg->offset;
 
 	num_pages = (num + offset + PAGE_SIZE - 1) >> PAGE_SHIFT;
-	num_pages = min(num_pages, FUSE_MAX_PAGES_PER_REQ);
+	num_pages = min(num_pages, fc->max_pages);
 
 	req = fuse_get_req(fc, num_pages);
 	if (IS_ERR(req))
@@ -1882,8 +2047,10 @@ static ssize_t fuse_dev_do_write(struct fuse_dev *fud,
 	set_bit(FR_LOCKED, &req->flags);
 	spin_unlock(&fpq->lock);
 	cs->req = req;
-	if (!req->out.page_replace)
+	if (!req->out.page_replace) {
 		cs->move_pages = 0;
+		cs->shm = NULL;
+	}
 
 	err = copy_out_args(cs, &req->out, nbytes);
 	fuse_copy_finish(cs);
@@ -1921,6 +2088,7 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, struct iov_iter *from)
 		return -EINVAL;
 
 	fuse_copy_init(&cs, 0, from);
+	cs.shm = READ_ONCE(fud->shm);
 
 	return fuse_dev_do_write(fud, &cs, iov_iter_count(from));
 }
@@ -2003,6 +2171,115 @@ out:
 	return ret;
 }
 
+/* Largest buffer pool a device can map */
+#define FUSE_SHM_MAX_PAGES	4096
+
+static struct fuse_shm *fuse_shm_alloc(struct address_space *mapping,
+				       unsigned nr_pages)
+{
+	struct fuse_shm *shm;
+	struct page *page;
+	unsigned i;
+
+	shm = kvzalloc(sizeof(*shm) + nr_pages * sizeof(struct page *),
+		       GFP_KERNEL);
+	if (!shm)
+		return NULL;
+
+	spin_lock_init(&shm->lock);
+	shm->mapping = mapping;
+	shm->nr_pages = nr_pages;
+	for (i = 0; i < nr_pages; i++) {
+		page = alloc_page(GFP_HIGHUSER | __GFP_ZERO);
+		if (!page) {
+			fuse_shm_free(shm);
+			return NULL;
+		}
+		/* Identifies the pool pages passed in replies */
+		set_page_private(page, (unsigned long)shm);
+		page->index = i;
+		shm->pages[i] = page;
+	}
+
+	return shm;
+}
+
+void fuse_shm_free(struct fuse_shm *shm)
+{
+	unsigned i;
+
+	for (i = 0; i < shm->nr_pages; i++) {
+		if (!shm->pages[i])
+			break;
+		set_page_private(shm->pages[i], 0);
+		put_page(shm->pages[i]);
+	}
+	kvfree(shm);
+}
+
+static int fuse_shm_fault(struct vm_fault *vmf)
+{
+	struct fuse_shm *shm = vmf->vma->vm_private_data;
+	struct page *page;
+
+	if (vmf->pgoff >= shm->nr_pages)
+		return VM_FAULT_SIGBUS;
+
+	spin_lock(&shm->lock);
+	page = shm->pages[vmf->pgoff];
+	get_page(page);
+	spin_unlock(&shm->lock);
+
+	/* Moved to the page cache meanwhile, refault the new one */
+	lock_page(page);
+	if (unlikely(READ_ONCE(shm->pages[vmf->pgoff]) != page)) {
+		unlock_page(page);
+		put_page(page);
+		return VM_FAULT_NOPAGE;
+	}
+
+	vmf->page = page;
+	return VM_FAULT_LOCKED;
+}
+
+static const struct vm_operations_struct fuse_shm_vm_ops = {
+	.fault		= fuse_shm_fault,
+};
+
+/*
+ * Map the buffer pool of the device. The daemon can then reply to
+ * FUSE_READ requests of readahead with whole pages of the pool, which
+ * are moved into the page cache instead of being copied: the pool slot
+ * is given a new zeroed page. The pool is mapped once per device.
+ */
+static int fuse_dev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+	unsigned long nr_pages = vma_pages(vma);
+	struct fuse_shm *shm;
+
+	if (!fud)
+		return -EPERM;
+
+	if (!(vma->vm_flags & VM_SHARED) || vma->vm_pgoff ||
+	    nr_pages > FUSE_SHM_MAX_PAGES)
+		return -EINVAL;
+
+	shm = fuse_shm_alloc(file->f_mapping, nr_pages);
+	if (!shm)
+		return -ENOMEM;
+
+	if (cmpxchg(&fud->shm, NULL, shm)) {
+		fuse_shm_free(shm);
+		return -EBUSY;
+	}
+
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND | VM_DONTDUMP;
+	vma->vm_private_data = shm;
+	vma->vm_ops = &fuse_shm_vm_ops;
+	return 0;
+}
+
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
@@ -2012,7 +2289,7 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 	if (!fud)
 		return POLLERR;
 
-	fiq = &fud->fc->iq;
+	fiq = READ_ONCE(fud->iq);
 	poll_wait(file, &fiq->waitq, wait);
 
 	spin_lock(&fiq->waitq.lock);
@@ -2120,6 +2397,24 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		wake_up_all_locked(&fiq->waitq);
 		spin_unlock(&fiq->waitq.lock);
 		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+		if (fc->cpu_iq) {
+			int cpu;
+
+			for_each_possible_cpu(cpu) {
+				struct fuse_iqueue *cpu_fiq = fc->cpu_iq[cpu];
+
+				if (!cpu_fiq)
+					continue;
+				spin_lock(&cpu_fiq->waitq.lock);
+				cpu_fiq->connected = 0;
+				list_for_each_entry(req, &cpu_fiq->pending, list)
+					clear_bit(FR_PENDING, &req->flags);
+				list_splice_init(&cpu_fiq->pending, &to_end2);
+				wake_up_all_locked(&cpu_fiq->waitq);
+				spin_unlock(&cpu_fiq->waitq.lock);
+				kill_fasync(&cpu_fiq->fasync, SIGIO, POLL_IN);
+			}
+		}
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
 		spin_unlock(&fc->lock);
@@ -2137,6 +2432,85 @@ void fuse_abort_conn(struct fuse_conn *fc)
 }
 EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
+/*
+ * Bind a device to the per-CPU queue of a CPU, creating the queue on the
+ * node of that CPU first.
+ */
+static int fuse_device_bind(struct fuse_dev *fud, struct file *file,
+			    unsigned int cpu)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue **cpu_iq;
+	struct fuse_iqueue *fiq;
+	int err = 0;
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+
+	/* The fasync registration is on the queue read */
+	if (fud->iq != &fc->iq || (file->f_flags & FASYNC))
+		return -EBUSY;
+
+	mutex_lock(&fuse_mutex);
+	cpu_iq = fc->cpu_iq;
+	if (!cpu_iq) {
+		cpu_iq = kcalloc(nr_cpu_ids, sizeof(*cpu_iq), GFP_KERNEL);
+		err = -ENOMEM;
+		if (!cpu_iq)
+			goto out;
+		smp_store_release(&fc->cpu_iq, cpu_iq);
+	}
+
+	fiq = cpu_iq[cpu];
+	if (!fiq) {
+		fiq = kmalloc_node(sizeof(*fiq), GFP_KERNEL, cpu_to_node(cpu));
+		err = -ENOMEM;
+		if (!fiq)
+			goto out;
+		fuse_iqueue_init(fiq);
+		fiq->reqctr = (u64)(cpu + 1) << FUSE_IQUEUE_UNIQUE_SHIFT;
+		smp_store_release(&cpu_iq[cpu], fiq);
+	}
+
+	/* Serializes with fuse_abort_conn() disconnecting the queues */
+	spin_lock(&fc->lock);
+	err = -ENOTCONN;
+	if (fc->connected) {
+		spin_lock(&fiq->waitq.lock);
+		fiq->bound++;
+		spin_unlock(&fiq->waitq.lock);
+		WRITE_ONCE(fud->iq, fiq);
+		err = 0;
+	}
+	spin_unlock(&fc->lock);
+out:
+	mutex_unlock(&fuse_mutex);
+	return err;
+}
+
+/* Requests still pending when the last device unbinds go to the main queue */
+static void fuse_device_unbind(struct fuse_conn *fc, struct fuse_iqueue *fiq)
+{
+	struct fuse_iqueue *main_fiq = &fc->iq;
+	struct fuse_req *req;
+	bool requeued = false;
+
+	spin_lock(&fiq->waitq.lock);
+	if (!--fiq->bound && !list_empty(&fiq->pending)) {
+		spin_lock_nested(&main_fiq->waitq.lock, SINGLE_DEPTH_NESTING);
+		list_for_each_entry(req, &fiq->pending, list)
+			WRITE_ONCE(req->fiq, main_fiq);
+		list_splice_tail_init(&fiq->pending, &main_fiq->pending);
+		wake_up_locked(&main_fiq->waitq);
+		spin_unlock(&main_fiq->waitq.lock);
+		requeued = true;
+	}
+	spin_unlock(&fiq->waitq.lock);
+
+	if (requeued)
+		kill_fasync(&main_fiq->fasync, SIGIO, POLL_IN);
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
@@ -2147,6 +2521,8 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 
 		WARN_ON(!list_empty(&fpq->io));
 		end_requests(fc, &fpq->processing);
+		if (fud->iq != &fc->iq)
+			fuse_device_unbind(fc, fud->iq);
 		/* Are we the last open device? */
 		if (atomic_dec_and_test(&fc->dev_count)) {
 			WARN_ON(fc->iq.fasync != NULL);
@@ -2166,7 +2542,7 @@ static int fuse_dev_fasync(int fd, struct file *file, int on)
 		return -EPERM;
 
 	/* No locking - fasync_helper does its own locking */
-	return fasync_helper(fd, file, on, &fud->fc->iq.fasync);
+	return fasync_helper(fd, file, on, &READ_ONCE(fud->iq)->fasync);
 }
 
 static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
@@ -2218,6 +2594,16 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 				fput(old);
 			}
 		}
+	} else if (cmd == FUSE_DEV_IOC_BIND_QUEUE) {
+		struct fuse_dev *fud = fuse_get_dev(file);
+		u32 cpu;
+
+		err = -EPERM;
+		if (fud) {
+			err = -EFAULT;
+			if (!get_user(cpu, (__u32 __user *) arg))
+				err = fuse_device_bind(fud, file, cpu);
+		}
 	}
 	return err;
 }
@@ -2231,6 +2617,7 @@ const struct file_operations fuse_dev_operations = {
 	.write_iter	= fuse_dev_write,
 	.splice_write	= fuse_dev_splice_write,
 	.poll		= fuse_dev_poll,
+	.mmap		= fuse_dev_mmap,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
 	.unlocked_ioctl = fuse_dev_ioctl,
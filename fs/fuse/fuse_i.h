@@ -27,8 +27,11 @@
 #include <linux/pid_namespace.h>
 #include <linux/refcount.h>
 
-/** Max number of pages that can be used in a single read request */
-#define FUSE_MAX_PAGES_PER_REQ 32
+/** Default max number of pages that can be used in a single request */
+#define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
+
+/** Max number of pages a request can be negotiated up to in INIT */
+#define FUSE_MAX_MAX_PAGES 256
 
 /** Bias for fi->writectr, meaning new writepages must not be sent */
 #define FUSE_NOWRITE INT_MIN
@@ -307,6 +310,9 @@ struct fuse_req {
 	/** Entry on the interrupts list  */
 	struct list_head intr_entry;
 
+	/** Input queue the request is pending on */
+	struct fuse_iqueue *fiq;
+
 	/** refcount */
 	refcount_t count;
 
@@ -408,8 +414,14 @@ struct fuse_iqueue {
 
 	/** O_ASYNC requests */
 	struct fasync_struct *fasync;
+
+	/** Number of devices bound to a per-CPU queue */
+	unsigned bound;
 };
 
+/** Unique ids of the per-CPU queue of CPU n start at (n + 1) << 48 */
+#define FUSE_IQUEUE_UNIQUE_SHIFT	48
+
 struct fuse_pqueue {
 	/** Connection established */
 	unsigned connected;
@@ -424,6 +436,23 @@ struct fuse_pqueue {
 	struct list_head io;
 };
 
+/**
+ * Buffer pool shared with the daemon by mmap() of the device
+ */
+struct fuse_shm {
+	/** Lock protecting the pool pages */
+	spinlock_t lock;
+
+	/** Mapping of the device, to unmap the pages moved out */
+	struct address_space *mapping;
+
+	/** Number of pages in the pool */
+	unsigned nr_pages;
+
+	/** Pool pages, replaced by new ones when moved to the page cache */
+	struct page *pages[];
+};
+
 /**
  * Fuse device instance
  */
@@ -434,6 +463,12 @@ struct fuse_dev {
 	/** Processing queue */
 	struct fuse_pqueue pq;
 
+	/** Input queue read by this device */
+	struct fuse_iqueue *iq;
+
+	/** Buffer pool mapped by the daemon, or NULL */
+	struct fuse_shm *shm;
+
 	/** list entry on fc->devices */
 	struct list_head entry;
 };
@@ -472,9 +507,15 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
+	/** Maximum number of pages that can be used in a single request */
+	unsigned max_pages;
+
 	/** Input queue */
 	struct fuse_iqueue iq;
 
+	/** Per-CPU input queues, created when a device is bound to them */
+	struct fuse_iqueue **cpu_iq;
+
 	/** The next unique kernel file handle */
 	u64 khctr;
 
@@ -538,6 +579,9 @@ struct fuse_conn {
 	/** allow parallel lookups and readdir (default is serialized) */
 	unsigned parallel_dirops:1;
 
+	/** allow parallel non-extending direct writes to a file */
+	unsigned parallel_direct_writes:1;
+
 	/** handle fs handles killing suid/sgid/cap on write/chown/trunc */
 	unsigned handle_killpriv:1;
 
@@ -792,6 +836,11 @@ int fuse_dev_init(void);
  */
 void fuse_dev_cleanup(void);
 
+/**
+ * Free the buffer pool of a device
+ */
+void fuse_shm_free(struct fuse_shm *shm);
+
 int fuse_ctl_init(void);
 void __exit fuse_ctl_cleanup(void);
 
@@ -872,6 +921,11 @@ struct fuse_conn *fuse_conn_get(struct fuse_conn *fc);
  */
 void fuse_conn_init(struct fuse_conn *fc);
 
+/**
+ * Initialize an input queue
+ */
+void fuse_iqueue_init(struct fuse_iqueue *fiq);
+
 /**
  * Release reference to fuse_conn
  */
@@ -946,6 +1000,9 @@ int fuse_do_open(struct fuse_conn *fc, u64 nodeid, struct file *file,
 /** CUSE pass fuse_direct_io() a file which f_mapping->host is not from FUSE */
 #define FUSE_DIO_CUSE  (1 << 1)
 
+/** The inode lock is held shared, don't wait for writeback */
+#define FUSE_DIO_SHARED (1 << 2)
+
 ssize_t fuse_direct_io(struct fuse_io_priv *io, struct iov_iter *iter,
 		       loff_t *ppos, int flags);
 long fuse_do_ioctl(struct file *file, unsigned int cmd, unsigned long arg,
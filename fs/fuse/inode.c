@@ -578,7 +578,7 @@ static int fuse_show_options(struct seq_file *m, struct dentry *root)
 	return 0;
 }
 
-static void fuse_iqueue_init(struct fuse_iqueue *fiq)
+void fuse_iqueue_init(struct fuse_iqueue *fiq)
 {
 	memset(fiq, 0, sizeof(struct fuse_iqueue));
 	init_waitqueue_head(&fiq->waitq);
@@ -614,6 +614,7 @@ void fuse_conn_init(struct fuse_conn *fc)
 	fc->max_background = FUSE_DEFAULT_MAX_BACKGROUND;
 	fc->congestion_threshold = FUSE_DEFAULT_CONGESTION_THRESHOLD;
 	fc->khctr = 0;
+	fc->max_pages = FUSE_DEFAULT_MAX_PAGES_PER_REQ;
 	fc->polled_files = RB_ROOT;
 	fc->blocked = 0;
 	fc->initialized = 0;
@@ -627,6 +628,13 @@ EXPORT_SYMBOL_GPL(fuse_conn_init);
 void fuse_conn_put(struct fuse_conn *fc)
 {
 	if (refcount_dec_and_test(&fc->count)) {
+		if (fc->cpu_iq) {
+			int cpu;
+
+			for_each_possible_cpu(cpu)
+				kfree(fc->cpu_iq[cpu]);
+			kfree(fc->cpu_iq);
+		}
 		if (fc->destroy_req)
 			fuse_request_free(fc->destroy_req);
 		put_pid_ns(fc->pid_ns);
@@ -909,6 +917,14 @@ static void process_init_reply(struct fuse_conn *fc, struct fuse_req *req)
 				fc->writeback_cache = 1;
 			if (arg->flags & FUSE_PARALLEL_DIROPS)
 				fc->parallel_dirops = 1;
+			if (arg->flags & FUSE_PARALLEL_DIRECT_WRITES)
+				fc->parallel_direct_writes = 1;
+			if (arg->flags & FUSE_MAX_PAGES) {
+				fc->max_pages = min_t(unsigned,
+						      FUSE_MAX_MAX_PAGES,
+						      max_t(unsigned,
+							    arg->max_pages, 1));
+			}
 			if (arg->flags & FUSE_HANDLE_KILLPRIV)
 				fc->handle_killpriv = 1;
 			if (arg->time_gran && arg->time_gran <= 1000000000)
@@ -948,7 +964,8 @@ static void fuse_send_init(struct fuse_conn *fc, struct fuse_req *req)
 		FUSE_FLOCK_LOCKS | FUSE_HAS_IOCTL_DIR | FUSE_AUTO_INVAL_DATA |
 		FUSE_DO_READDIRPLUS | FUSE_READDIRPLUS_AUTO | FUSE_ASYNC_DIO |
 		FUSE_WRITEBACK_CACHE | FUSE_NO_OPEN_SUPPORT |
-		FUSE_PARALLEL_DIROPS | FUSE_HANDLE_KILLPRIV | FUSE_POSIX_ACL;
+		FUSE_PARALLEL_DIROPS | FUSE_HANDLE_KILLPRIV | FUSE_POSIX_ACL |
+		FUSE_MAX_PAGES | FUSE_PARALLEL_DIRECT_WRITES;
 	req->in.h.opcode = FUSE_INIT;
 	req->in.numargs = 1;
 	req->in.args[0].size = sizeof(*arg);
@@ -1018,6 +1035,7 @@ struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc)
 	if (fud) {
 		fud->fc = fuse_conn_get(fc);
 		fuse_pqueue_init(&fud->pq);
+		fud->iq = &fc->iq;
 
 		spin_lock(&fc->lock);
 		list_add_tail(&fud->entry, &fc->devices);
@@ -1039,6 +1057,8 @@ void fuse_dev_free(struct fuse_dev *fud)
 
 		fuse_conn_put(fc);
 	}
+	if (fud->shm)
+		fuse_shm_free(fud->shm);
 	kfree(fud);
 }
 EXPORT_SYMBOL_GPL(fuse_dev_free);
@@ -23,6 +23,8 @@
 #include <linux/errno.h>
 #include <linux/slab.h>
 #include <linux/blkdev.h>
+#include <linux/workqueue.h>
+#include <linux/math64.h>
 #include <trace/events/jbd2.h>
 
 /*
@@ -178,6 +180,68 @@ void __jbd2_log_wait_for_space(journal_t *journal)
 	}
 }
 
+/* Blocks of the log in use, as a percentage of the log size */
+static unsigned int jbd2_log_used_pct(journal_t *journal)
+{
+	unsigned long size = journal->j_last - journal->j_first;
+	unsigned long used = size - READ_ONCE(journal->j_free);
+
+	return div64_ul((u64)used * 100, size);
+}
+
+/*
+ * jbd2_log_start_checkpoint: start checkpointing in the background once
+ * the log is filled past its watermark, so that handles rarely have to
+ * wait for a checkpoint in __jbd2_log_wait_for_space().
+ */
+void jbd2_log_start_checkpoint(journal_t *journal)
+{
+	unsigned int watermark = READ_ONCE(journal->j_chkpt_watermark);
+
+	if (!watermark || (journal->j_flags & (JBD2_UNMOUNT | JBD2_ABORT)))
+		return;
+
+	if (jbd2_log_used_pct(journal) >= watermark)
+		queue_work(jbd2_checkpoint_wq, &journal->j_checkpoint_work);
+}
+
+/*
+ * Checkpoint the oldest transactions until the log is used to half of its
+ * watermark. The checkpoint mutex is dropped between transactions so that
+ * a handle waiting for space can checkpoint as well, and the writes of
+ * the successive batches are plugged together.
+ */
+void jbd2_checkpoint_work(struct work_struct *work)
+{
+	journal_t *journal = container_of(work, journal_t, j_checkpoint_work);
+	struct blk_plug plug;
+	bool idle = false;
+	int err = 0;
+
+	blk_start_plug(&plug);
+	while (!err && !idle &&
+	       !(journal->j_flags & (JBD2_UNMOUNT | JBD2_ABORT)) &&
+	       jbd2_log_used_pct(journal) >=
+			READ_ONCE(journal->j_chkpt_watermark) / 2) {
+		mutex_lock_io(&journal->j_checkpoint_mutex);
+		spin_lock(&journal->j_list_lock);
+		idle = !journal->j_checkpoint_transactions;
+		spin_unlock(&journal->j_list_lock);
+		if (!idle)
+			err = jbd2_log_do_checkpoint(journal);
+		mutex_unlock(&journal->j_checkpoint_mutex);
+		cond_resched();
+	}
+	blk_finish_plug(&plug);
+
+	/* Release the log space of the transactions checkpointed last */
+	if (!err && !(journal->j_flags & (JBD2_UNMOUNT | JBD2_ABORT))) {
+		mutex_lock_io(&journal->j_checkpoint_mutex);
+		jbd2_cleanup_journal_tail(journal);
+		mutex_unlock(&journal->j_checkpoint_mutex);
+	}
+}
+
 static void
 __flush_batch(journal_t *journal, int *batch_count)
 {
@@ -59,6 +59,13 @@ module_param_named(jbd2_debug, jbd2_journal_enable_debug, ushort, 0644);
 MODULE_PARM_DESC(jbd2_debug, "Debugging level for jbd2");
 #endif
 
+static unsigned int jbd2_checkpoint_watermark = 50;
+module_param_named(checkpoint_watermark, jbd2_checkpoint_watermark, uint, 0644);
+MODULE_PARM_DESC(checkpoint_watermark,
+		 "Default percentage of the journal in use from which it is checkpointed in the background, 0 to disable");
+
+struct workqueue_struct *jbd2_checkpoint_wq;
+
 EXPORT_SYMBOL(jbd2_journal_extend);
 EXPORT_SYMBOL(jbd2_journal_stop);
 EXPORT_SYMBOL(jbd2_journal_lock_updates);
@@ -101,6 +108,13 @@ EXPORT_SYMBOL(jbd2_journal_init_jbd_inode);
 EXPORT_SYMBOL(jbd2_journal_release_jbd_inode);
 EXPORT_SYMBOL(jbd2_journal_begin_ordered_truncate);
 EXPORT_SYMBOL(jbd2_inode_cache);
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+EXPORT_SYMBOL(jbd2_fc_end_commit_fallback);
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+EXPORT_SYMBOL(jbd2_fc_submit_buf);
+EXPORT_SYMBOL(jbd2_fc_wait_bufs);
+EXPORT_SYMBOL(jbd2_fc_release_bufs);
 
 static void __journal_abort_soft (journal_t *journal, int errno);
 static int jbd2_journal_create_slab(size_t slab_size);
@@ -769,6 +783,213 @@ wait_commit:
 }
 EXPORT_SYMBOL(jbd2_complete_transaction);
 
+/*
+ * Fast commits:
+ *
+ * A fast commit logs compact records of the running transaction, in a
+ * format only the filesystem knows, to the fast commit area at the end of
+ * the journal.  It costs a few blocks written in parallel instead of a full
+ * commit of every dirty metadata buffer, and recovery hands the blocks back
+ * to the filesystem through j_fc_replay_callback.  A full commit makes the
+ * fast commit blocks obsolete and the area is reused from its start.
+ */
+
+/**
+ * int jbd2_fc_begin_commit() - Start a fast commit
+ * @journal: Journal to act on.
+ * @tid: Transaction the fast commit logs the changes of.
+ *
+ * Returns -EALREADY if @tid has already been committed in full, or after
+ * waiting for another fast or full commit to finish: the caller then checks
+ * again whether its changes still need committing.  Any other error means a
+ * full commit is needed.  On success the caller writes its blocks with
+ * jbd2_fc_get_buf() and finishes with jbd2_fc_end_commit().
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	write_lock(&journal->j_state_lock);
+	if (!tid_gt(tid, journal->j_commit_sequence)) {
+		write_unlock(&journal->j_state_lock);
+		return -EALREADY;
+	}
+
+	/*
+	 * Recovery skips a log marked empty on disk, fast commit blocks
+	 * included, until a full commit updates the superblock.
+	 */
+	if (journal->j_flags & (JBD2_FLUSHED | JBD2_ABORT)) {
+		write_unlock(&journal->j_state_lock);
+		return -EINVAL;
+	}
+
+	if (journal->j_flags &
+	    (JBD2_FULL_COMMIT_ONGOING | JBD2_FAST_COMMIT_ONGOING)) {
+		DEFINE_WAIT(wait);
+
+		prepare_to_wait(&journal->j_fc_wait, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		finish_wait(&journal->j_fc_wait, &wait);
+		return -EALREADY;
+	}
+	journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+
+	return 0;
+}
+
+static int __jbd2_fc_end_commit(journal_t *journal, bool fallback)
+{
+	tid_t tid = 0;
+
+	if (journal->j_fc_cleanup_callback)
+		journal->j_fc_cleanup_callback(journal, 0);
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	if (journal->j_running_transaction)
+		tid = journal->j_running_transaction->t_tid;
+	else
+		fallback = false;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+
+	if (fallback)
+		return jbd2_complete_transaction(journal, tid);
+	return 0;
+}
+
+/**
+ * int jbd2_fc_end_commit() - Finish a fast commit
+ * @journal: Journal to act on.
+ *
+ * The caller must have waited for its blocks with jbd2_fc_wait_bufs().
+ */
+int jbd2_fc_end_commit(journal_t *journal)
+{
+	return __jbd2_fc_end_commit(journal, false);
+}
+
+/**
+ * int jbd2_fc_end_commit_fallback() - Give up a fast commit for a full one
+ * @journal: Journal to act on.
+ *
+ * Finishes the fast commit and commits the running transaction in full,
+ * waiting for it, e.g. when the changes do not fit in the fast commit area.
+ */
+int jbd2_fc_end_commit_fallback(journal_t *journal)
+{
+	return __jbd2_fc_end_commit(journal, true);
+}
+
+/**
+ * int jbd2_fc_get_buf() - Get the next fast commit block
+ * @journal: Journal to act on.
+ * @bh_out: Buffer head of the block, referenced until jbd2_fc_wait_bufs()
+ *
+ * Returns -ENOSPC once the fast commit area is full.
+ */
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out)
+{
+	unsigned long long pblock;
+	unsigned long blocknr;
+	struct buffer_head *bh;
+	int fc_off, err;
+
+	*bh_out = NULL;
+
+	if (journal->j_fc_first + journal->j_fc_off >= journal->j_fc_last)
+		return -ENOSPC;
+	fc_off = journal->j_fc_off;
+	blocknr = journal->j_fc_first + fc_off;
+
+	err = jbd2_journal_bmap(journal, blocknr, &pblock);
+	if (err)
+		return err;
+
+	bh = __getblk(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+
+	journal->j_fc_off++;
+	journal->j_fc_wbuf[fc_off] = bh;
+	*bh_out = bh;
+	return 0;
+}
+
+/**
+ * void jbd2_fc_submit_buf() - Write a fast commit block
+ * @journal: Journal to act on.
+ * @bh: Block filled in by the caller, from jbd2_fc_get_buf()
+ * @is_tail: @bh is the last block of this fast commit
+ *
+ * The blocks are written as soon as they are filled and all in flight at
+ * once, so the filesystem must be able to tell a torn fast commit from its
+ * records (e.g. by a checksum in the tail block).  The tail block flushes
+ * the cache and is written FUA so that it follows the data it refers to.
+ */
+void jbd2_fc_submit_buf(journal_t *journal, struct buffer_head *bh,
+			bool is_tail)
+{
+	int write_flags = REQ_SYNC;
+
+	if (is_tail && (journal->j_flags & JBD2_BARRIER))
+		write_flags |= REQ_PREFLUSH | REQ_FUA;
+
+	lock_buffer(bh);
+	set_buffer_uptodate(bh);
+	clear_buffer_dirty(bh);
+	get_bh(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(REQ_OP_WRITE, write_flags, bh);
+}
+
+/**
+ * int jbd2_fc_wait_bufs() - Wait for the last fast commit blocks written
+ * @journal: Journal to act on.
+ * @num_blks: Number of blocks of this fast commit
+ *
+ * Drops the references taken by jbd2_fc_get_buf().  Returns -EIO if any of
+ * the blocks failed to write.
+ */
+int jbd2_fc_wait_bufs(journal_t *journal, int num_blks)
+{
+	struct buffer_head *bh;
+	int i, err = 0;
+
+	/* Wait in reverse order, the last block is the likeliest in flight */
+	for (i = journal->j_fc_off - 1; i >= 0 &&
+	     i >= (int)journal->j_fc_off - num_blks; i--) {
+		bh = journal->j_fc_wbuf[i];
+		if (!bh)
+			continue;
+		wait_on_buffer(bh);
+		if (unlikely(!buffer_uptodate(bh)))
+			err = -EIO;
+		put_bh(bh);
+		journal->j_fc_wbuf[i] = NULL;
+	}
+	return err;
+}
+
+/**
+ * void jbd2_fc_release_bufs() - Drop the fast commit blocks not waited for
+ * @journal: Journal to act on.
+ */
+void jbd2_fc_release_bufs(journal_t *journal)
+{
+	struct buffer_head *bh;
+	int i;
+
+	for (i = journal->j_fc_off - 1; i >= 0; i--) {
+		bh = journal->j_fc_wbuf[i];
+		if (!bh)
+			continue;
+		put_bh(bh);
+		journal->j_fc_wbuf[i] = NULL;
+	}
+}
+
 /*
  * Log buffer allocation routines:
  */
@@ -1087,6 +1308,46 @@ static const struct file_operations jbd2_seq_info_fops = {
 	.release        = jbd2_seq_info_release,
 };
 
+static int jbd2_seq_watermark_show(struct seq_file *m, void *v)
+{
+	journal_t *journal = m->private;
+
+	seq_printf(m, "%u\n", READ_ONCE(journal->j_chkpt_watermark));
+	return 0;
+}
+
+static int jbd2_seq_watermark_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, jbd2_seq_watermark_show, PDE_DATA(inode));
+}
+
+static ssize_t jbd2_seq_watermark_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	journal_t *journal = PDE_DATA(file_inode(file));
+	unsigned int val;
+	int err;
+
+	err = kstrtouint_from_user(buf, count, 0, &val);
+	if (err)
+		return err;
+	if (val > 100)
+		return -EINVAL;
+
+	WRITE_ONCE(journal->j_chkpt_watermark, val);
+	jbd2_log_start_checkpoint(journal);
+	return count;
+}
+
+static const struct file_operations jbd2_seq_watermark_fops = {
+	.owner		= THIS_MODULE,
+	.open		= jbd2_seq_watermark_open,
+	.read		= seq_read,
+	.write		= jbd2_seq_watermark_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static struct proc_dir_entry *proc_jbd2_stats;
 
 static void jbd2_stats_proc_init(journal_t *journal)
@@ -1095,11 +1356,15 @@ static void jbd2_stats_proc_init(journal_t *journal)
 	if (journal->j_proc_entry) {
 		proc_create_data("info", S_IRUGO, journal->j_proc_entry,
 				 &jbd2_seq_info_fops, journal);
+		proc_create_data("checkpoint_watermark", S_IRUGO | S_IWUSR,
+				 journal->j_proc_entry,
+				 &jbd2_seq_watermark_fops, journal);
 	}
 }
 
 static void jbd2_stats_proc_exit(journal_t *journal)
 {
+	remove_proc_entry("checkpoint_watermark", journal->j_proc_entry);
 	remove_proc_entry("info", journal->j_proc_entry);
 	remove_proc_entry(journal->j_devname, proc_jbd2_stats);
 }
@@ -1132,8 +1397,11 @@ static journal_t *journal_init_common(struct block_device *bdev,
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
 	init_waitqueue_head(&journal->j_wait_reserved);
+	init_waitqueue_head(&journal->j_fc_wait);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
+	INIT_WORK(&journal->j_checkpoint_work, jbd2_checkpoint_work);
+	journal->j_chkpt_watermark = min(jbd2_checkpoint_watermark, 100U);
 	spin_lock_init(&journal->j_revoke_lock);
 	spin_lock_init(&journal->j_list_lock);
 	rwlock_init(&journal->j_state_lock);
@@ -1169,6 +1437,10 @@ static journal_t *journal_init_common(struct block_device *bdev,
 	if (!journal->j_wbuf)
 		goto err_cleanup;
 
+	journal->j_credit_cache = alloc_percpu(struct jbd2_credit_cache);
+	if (!journal->j_credit_cache)
+		goto err_cleanup;
+
 	bh = getblk_unmovable(journal->j_dev, start, journal->j_blocksize);
 	if (!bh) {
 		pr_err("%s: Cannot get buffer for journal superblock\n",
@@ -1181,6 +1453,8 @@ static journal_t *journal_init_common(struct block_device *bdev,
 	return journal;
 
 err_cleanup:
+	kfree(journal->j_fc_wbuf);
+	free_percpu(journal->j_credit_cache);
 	kfree(journal->j_wbuf);
 	jbd2_journal_destroy_revoke(journal);
 	kfree(journal);
@@ -1286,13 +1560,23 @@ static void journal_fail_superblock (journal_t *journal)
  * subsequent use.
  */
 
+static void journal_set_max_transaction_buffers(journal_t *journal)
+{
+	journal->j_max_transaction_buffers =
+		(journal->j_maxlen - journal->j_fc_wbufsize) / 4;
+	/* Credits cached by all CPUs may hold back at most a quarter of it */
+	journal->j_credit_batch = min_t(int, JBD2_CREDIT_BATCH,
+					journal->j_max_transaction_buffers /
+					(8 * num_possible_cpus()));
+}
+
 static int journal_reset(journal_t *journal)
 {
 	journal_superblock_t *sb = journal->j_superblock;
 	unsigned long long first, last;
 
 	first = be32_to_cpu(sb->s_first);
-	last = be32_to_cpu(sb->s_maxlen);
+	last = be32_to_cpu(sb->s_maxlen) - journal->j_fc_wbufsize;
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD2: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1311,7 +1595,7 @@ static int journal_reset(journal_t *journal)
 	journal->j_commit_sequence = journal->j_transaction_sequence - 1;
 	journal->j_commit_request = journal->j_commit_sequence;
 
-	journal->j_max_transaction_buffers = journal->j_maxlen / 4;
+	journal_set_max_transaction_buffers(journal);
 
 	/*
 	 * As a special case, if the on-disk copy is already marked as needing
@@ -1597,6 +1881,70 @@ out:
 	return err;
 }
 
+/*
+ * Carve the fast commit area out of the end of the journal, shrinking the
+ * log used by full commits.
+ */
+static int journal_init_fast_commit(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	unsigned long maxlen = be32_to_cpu(sb->s_maxlen);
+	int num_fc_blks = jbd2_journal_get_num_fc_blks(sb);
+	struct buffer_head **wbuf;
+
+	if (be32_to_cpu(sb->s_first) + JBD2_MIN_JOURNAL_BLOCKS + num_fc_blks >
+	    maxlen + 1) {
+		printk(KERN_ERR "JBD2: Journal too short for %d fast commit "
+		       "blocks.\n", num_fc_blks);
+		return -EINVAL;
+	}
+
+	if (journal->j_fc_wbufsize != num_fc_blks) {
+		wbuf = kcalloc(num_fc_blks, sizeof(*wbuf), GFP_KERNEL);
+		if (!wbuf)
+			return -ENOMEM;
+		kfree(journal->j_fc_wbuf);
+		journal->j_fc_wbuf = wbuf;
+		journal->j_fc_wbufsize = num_fc_blks;
+	}
+
+	journal->j_fc_last = maxlen;
+	journal->j_fc_first = maxlen - num_fc_blks;
+	journal->j_fc_off = 0;
+	journal->j_last = journal->j_fc_first;
+	return 0;
+}
+
+/*
+ * Turn fast commits on for a journal just loaded: the log has to be empty
+ * since its end moves down to make room for the fast commit area.
+ */
+static int journal_enable_fast_commit(journal_t *journal)
+{
+	int err;
+
+	if (!(journal->j_flags & JBD2_LOADED))
+		return 0;
+
+	if (journal->j_running_transaction ||
+	    journal->j_head != journal->j_first ||
+	    journal->j_tail != journal->j_first) {
+		printk(KERN_ERR "JBD2: Cannot enable fast commits on a "
+		       "journal in use.\n");
+		return -EBUSY;
+	}
+
+	err = journal_init_fast_commit(journal);
+	if (err)
+		return err;
+
+	write_lock(&journal->j_state_lock);
+	journal->j_free = journal->j_last - journal->j_first;
+	journal_set_max_transaction_buffers(journal);
+	write_unlock(&journal->j_state_lock);
+	return 0;
+}
+
 /*
  * Load the on-disk journal superblock and read the key fields into the
  * journal_t.
@@ -1619,6 +1967,8 @@ static int load_superblock(journal_t *journal)
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
+	if (jbd2_has_feature_fast_commit(journal))
+		return journal_init_fast_commit(journal);
 	return 0;
 }
 
@@ -1703,6 +2053,7 @@ int jbd2_journal_destroy(journal_t *journal)
 
 	/* Wait for the commit thread to wake up and die. */
 	journal_kill_thread(journal);
+	cancel_work_sync(&journal->j_checkpoint_work);
 
 	/* Force a final log commit */
 	if (journal->j_running_transaction)
@@ -1758,6 +2109,8 @@ int jbd2_journal_destroy(journal_t *journal)
 		jbd2_journal_destroy_revoke(journal);
 	if (journal->j_chksum_driver)
 		crypto_free_shash(journal->j_chksum_driver);
+	free_percpu(journal->j_credit_cache);
+	kfree(journal->j_fc_wbuf);
 	kfree(journal->j_wbuf);
 	kfree(journal);
 
@@ -1905,6 +2258,11 @@ int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
 			~cpu_to_be32(JBD2_FEATURE_INCOMPAT_CSUM_V2 |
 				     JBD2_FEATURE_INCOMPAT_CSUM_V3);
 
+	/* Reserve the fast commit area, unless load_superblock() will */
+	if (INCOMPAT_FEATURE_ON(JBD2_FEATURE_INCOMPAT_FAST_COMMIT) &&
+	    journal_enable_fast_commit(journal))
+		return 0;
+
 	sb->s_feature_compat    |= cpu_to_be32(compat);
 	sb->s_feature_ro_compat |= cpu_to_be32(ro);
 	sb->s_feature_incompat  |= cpu_to_be32(incompat);
@@ -2676,11 +3034,17 @@ static int __init journal_init(void)
 
 	BUILD_BUG_ON(sizeof(struct journal_superblock_s) != 1024);
 
+	jbd2_checkpoint_wq = alloc_workqueue("jbd2-checkpoint",
+					     WQ_MEM_RECLAIM | WQ_UNBOUND, 0);
+	if (!jbd2_checkpoint_wq)
+		return -ENOMEM;
+
 	ret = journal_init_caches();
 	if (ret == 0) {
 		jbd2_create_jbd_stats_proc_entry();
 	} else {
 		jbd2_journal_destroy_caches();
+		destroy_workqueue(jbd2_checkpoint_wq);
 	}
 	return ret;
 }
@@ -2694,6 +3058,7 @@ static void __exit journal_exit(void)
 #endif
 	jbd2_remove_jbd_stats_proc_entry();
 	jbd2_journal_destroy_caches();
+	destroy_workqueue(jbd2_checkpoint_wq);
 }
 
 MODULE_LICENSE("GPL");
@@ -38,7 +38,6 @@ struct recovery_info
 	int		nr_revoke_hits;
 };
 
-enum passtype {PASS_SCAN, PASS_REVOKE, PASS_REPLAY};
 static int do_one_pass(journal_t *journal,
 				struct recovery_info *info, enum passtype pass);
 static int scan_revoke_records(journal_t *, struct buffer_head *,
@@ -416,6 +415,43 @@ static int jbd2_block_tag_csum_verify(journal_t *j, journal_block_tag_t *tag,
 		return tag->t_checksum == cpu_to_be16(csum32);
 }
 
+/*
+ * Hand the fast commit blocks to the filesystem, which logged them after the
+ * last full commit.  Only the filesystem knows their format, so it decides
+ * which records are valid and how far to go.
+ */
+static int fc_do_one_pass(journal_t *journal,
+			  struct recovery_info *info, enum passtype pass)
+{
+	unsigned long next_fc_block = journal->j_fc_first;
+	struct buffer_head *bh;
+	int err = 0;
+
+	if (!journal->j_fc_replay_callback)
+		return 0;
+
+	while (next_fc_block < journal->j_fc_last) {
+		jbd_debug(3, "Fast commit replay: next block %lu\n",
+			  next_fc_block);
+		err = jread(&bh, journal, next_fc_block);
+		if (err)
+			break;
+
+		err = journal->j_fc_replay_callback(journal, bh, pass,
+					next_fc_block - journal->j_fc_first,
+					info->end_transaction);
+		brelse(bh);
+		next_fc_block++;
+		if (err < 0 || err == JBD2_FC_REPLAY_STOP)
+			break;
+		err = 0;
+	}
+
+	if (err < 0)
+		jbd_debug(1, "Fast commit replay failed, err = %d\n", err);
+	return err < 0 ? err : 0;
+}
+
 static int do_one_pass(journal_t *journal,
 			struct recovery_info *info, enum passtype pass)
 {
@@ -802,6 +838,11 @@ static int do_one_pass(journal_t *journal,
 				success = -EIO;
 		}
 	}
+
+	/* Fast commits only follow the transactions found in the log */
+	if (jbd2_has_feature_fast_commit(journal) && pass != PASS_REVOKE &&
+	    !success)
+		success = fc_do_one_pass(journal, info, pass);
 	if (block_error && success == 0)
 		success = -EIO;
 	return success;
@@ -171,6 +171,92 @@ static void sub_reserved_credits(journal_t *journal, int blocks)
 	wake_up(&journal->j_wait_reserved);
 }
 
+/*
+ * Take @blocks credits of the running transaction @t from those this CPU
+ * claimed in advance, claiming another j_credit_batch of them from
+ * t_outstanding_credits when they run out.  Called with j_state_lock held
+ * for reading and @t running.  Returns false, with nothing charged to @t, if
+ * the credits have to be added to t_outstanding_credits directly.
+ */
+static bool get_cached_credits(journal_t *journal, transaction_t *t,
+			       int blocks)
+{
+	struct jbd2_credit_cache *cc;
+	int batch = journal->j_credit_batch;
+	bool ret = true;
+
+	if (blocks > batch)
+		return false;
+
+	cc = get_cpu_ptr(journal->j_credit_cache);
+	if (cc->cc_tid != t->t_tid) {
+		/* Leftovers of a transaction that has been locked for commit */
+		atomic_set(&cc->cc_credits, 0);
+		cc->cc_tid = t->t_tid;
+	}
+	if (atomic_read(&cc->cc_credits) < blocks) {
+		if (atomic_add_return(batch, &t->t_outstanding_credits) >
+		    journal->j_max_transaction_buffers) {
+			atomic_sub(batch, &t->t_outstanding_credits);
+			ret = false;
+			goto out;
+		}
+		atomic_add(batch, &cc->cc_credits);
+	}
+	atomic_sub(blocks, &cc->cc_credits);
+out:
+	put_cpu_ptr(journal->j_credit_cache);
+	return ret;
+}
+
+/*
+ * Give back @blocks unused credits of transaction @t.  While @t is running
+ * they are kept for the next handles started on this CPU, up to two batches,
+ * and only the rest is taken off t_outstanding_credits.  Credits put here
+ * after the commit reclaimed them stay accounted in the committing
+ * transaction, which merely overestimates the log space it needs.
+ */
+static void put_cached_credits(journal_t *journal, transaction_t *t,
+			       int blocks)
+{
+	struct jbd2_credit_cache *cc;
+
+	cc = get_cpu_ptr(journal->j_credit_cache);
+	if (cc->cc_tid == t->t_tid && READ_ONCE(t->t_state) == T_RUNNING &&
+	    atomic_read(&cc->cc_credits) + blocks <=
+	    2 * journal->j_credit_batch) {
+		atomic_add(blocks, &cc->cc_credits);
+		blocks = 0;
+	}
+	put_cpu_ptr(journal->j_credit_cache);
+	if (blocks)
+		atomic_sub(blocks, &t->t_outstanding_credits);
+}
+
+/**
+ * jbd2_journal_reclaim_credits() - take back the credits cached per CPU
+ * @journal: journal of @transaction
+ * @transaction: transaction being locked for commit
+ *
+ * Called with j_state_lock held for writing once @transaction is T_LOCKED,
+ * so that its t_outstanding_credits no longer counts the credits that the
+ * CPUs claimed in advance but did not hand out to any handle.
+ */
+void jbd2_journal_reclaim_credits(journal_t *journal,
+				  transaction_t *transaction)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct jbd2_credit_cache *cc;
+
+		cc = per_cpu_ptr(journal->j_credit_cache, cpu);
+		if (cc->cc_tid == transaction->t_tid)
+			atomic_sub(atomic_xchg(&cc->cc_credits, 0),
+				   &transaction->t_outstanding_credits);
+	}
+}
+
 /*
  * Wait until we can add credits for handle to the running transaction.  Called
  * with j_state_lock held for reading. Returns 0 if handle joined the running
@@ -193,6 +279,10 @@ static int add_transaction_credits(journal_t *journal, int blocks,
 		return 1;
 	}
 
+	/* Plain handles are served from the credits cached on this CPU */
+	if (!rsv_blocks && get_cached_credits(journal, t, blocks))
+		goto check_space;
+
 	/*
 	 * If there is not enough space left in the log to write all
 	 * potential buffers requested by this operation, we need to
@@ -236,8 +326,9 @@ static int add_transaction_credits(journal_t *journal, int blocks,
 	 * *before* starting to dirty potentially checkpointed buffers
 	 * in the new transaction.
 	 */
+check_space:
 	if (jbd2_log_space_left(journal) < jbd2_space_needed(journal)) {
-		atomic_sub(total, &t->t_outstanding_credits);
+		put_cached_credits(journal, t, total);
 		read_unlock(&journal->j_state_lock);
 		jbd2_might_wait_for_commit(journal);
 		write_lock(&journal->j_state_lock);
@@ -1722,8 +1813,7 @@ int jbd2_journal_stop(handle_t *handle)
 	if (handle->h_sync)
 		transaction->t_synchronous_commit = 1;
 	current->journal_info = NULL;
-	atomic_sub(handle->h_buffer_credits,
-		   &transaction->t_outstanding_credits);
+	put_cached_credits(journal, transaction, handle->h_buffer_credits);
 
 	/*
 	 * If the handle is marked SYNC, we need to set another commit
@@ -101,11 +101,12 @@ static int __kernfs_setattr(struct kernfs_node *kn, const struct iattr *iattr)
  */
 int kernfs_setattr(struct kernfs_node *kn, const struct iattr *iattr)
 {
+	struct kernfs_root *root = kernfs_root(kn);
 	int ret;
 
-	mutex_lock(&kernfs_mutex);
+	down_write(&root->kernfs_rwsem);
 	ret = __kernfs_setattr(kn, iattr);
-	mutex_unlock(&kernfs_mutex);
+	up_write(&root->kernfs_rwsem);
 	return ret;
 }
 
@@ -113,12 +114,14 @@ int kernfs_iop_setattr(struct dentry *dentry, struct iattr *iattr)
 {
 	struct inode *inode = d_inode(dentry);
 	struct kernfs_node *kn = inode->i_private;
+	struct kernfs_root *root;
 	int error;
 
 	if (!kn)
 		return -EINVAL;
 
-	mutex_lock(&kernfs_mutex);
+	root = kernfs_root(kn);
+	down_write(&root->kernfs_rwsem);
 	error = setattr_prepare(dentry, iattr);
 	if (error)
 		goto out;
@@ -131,7 +134,7 @@ int kernfs_iop_setattr(struct dentry *dentry, struct iattr *iattr)
 	setattr_copy(inode, iattr);
 
 out:
-	mutex_unlock(&kernfs_mutex);
+	up_write(&root->kernfs_rwsem);
 	return error;
 }
 
@@ -181,10 +184,15 @@ static inline void set_inode_attr(struct inode *inode, struct iattr *iattr)
 	inode->i_ctime = timespec_trunc(iattr->ia_ctime, sb->s_time_gran);
 }
 
+/*
+ * Called with kernfs_rwsem held for reading, so several tasks may refresh
+ * the same inode at once.  i_lock keeps the copied attributes consistent.
+ */
 static void kernfs_refresh_inode(struct kernfs_node *kn, struct inode *inode)
 {
 	struct kernfs_iattrs *attrs = kn->iattr;
 
+	spin_lock(&inode->i_lock);
 	inode->i_mode = kn->mode;
 	if (attrs) {
 		/*
@@ -192,12 +200,15 @@ static void kernfs_refresh_inode(struct kernfs_node *kn, struct inode *inode)
 		 * persistent copy in kernfs_node.
 		 */
 		set_inode_attr(inode, &attrs->ia_iattr);
-		security_inode_notifysecctx(inode, attrs->ia_secdata,
-					    attrs->ia_secdata_len);
 	}
 
 	if (kernfs_type(kn) == KERNFS_DIR)
 		set_nlink(inode, kn->dir.subdirs + 2);
+	spin_unlock(&inode->i_lock);
+
+	if (attrs)
+		security_inode_notifysecctx(inode, attrs->ia_secdata,
+					    attrs->ia_secdata_len);
 }
 
 int kernfs_iop_getattr(const struct path *path, struct kstat *stat,
@@ -205,10 +216,11 @@ int kernfs_iop_getattr(const struct path *path, struct kstat *stat,
 {
 	struct inode *inode = d_inode(path->dentry);
 	struct kernfs_node *kn = inode->i_private;
+	struct kernfs_root *root = kernfs_root(kn);
 
-	mutex_lock(&kernfs_mutex);
+	down_read(&root->kernfs_rwsem);
 	kernfs_refresh_inode(kn, inode);
-	mutex_unlock(&kernfs_mutex);
+	up_read(&root->kernfs_rwsem);
 
 	generic_fillattr(inode, stat);
 	return 0;
@@ -291,16 +303,26 @@ void kernfs_evict_inode(struct inode *inode)
 
 int kernfs_iop_permission(struct inode *inode, int mask)
 {
-	struct kernfs_node *kn;
+	struct kernfs_node *kn = inode->i_private;
+	struct kernfs_root *root;
+
+	/*
+	 * Mode and ownership can only change through __kernfs_setattr(),
+	 * which allocates ->iattr first.  Without it the inode still holds
+	 * what kernfs_init_inode() set up and needs no refresh, so the
+	 * common case is checked locklessly, even during RCU walk.
+	 */
+	if (!READ_ONCE(kn->iattr))
+		return generic_permission(inode, mask);
 
 	if (mask & MAY_NOT_BLOCK)
 		return -ECHILD;
 
-	kn = inode->i_private;
+	root = kernfs_root(kn);
 
-	mutex_lock(&kernfs_mutex);
+	down_read(&root->kernfs_rwsem);
 	kernfs_refresh_inode(kn, inode);
-	mutex_unlock(&kernfs_mutex);
+	up_read(&root->kernfs_rwsem);
 
 	return generic_permission(inode, mask);
 }
@@ -364,9 +386,9 @@ static int kernfs_security_xattr_set(const struct xattr_handler *handler,
 	if (error)
 		return error;
 
-	mutex_lock(&kernfs_mutex);
+	down_write(&kernfs_root(kn)->kernfs_rwsem);
 	error = kernfs_node_setsecdata(attrs, &secdata, &secdata_len);
-	mutex_unlock(&kernfs_mutex);
+	up_write(&kernfs_root(kn)->kernfs_rwsem);
 
 	if (secdata)
 		security_release_secctx(secdata, secdata_len);
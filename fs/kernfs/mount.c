@@ -237,9 +237,9 @@ static int kernfs_fill_super(struct super_block *sb, unsigned long magic)
 	sb->s_time_gran = 1;
 
 	/* get root inode, initialize and unlock it */
-	mutex_lock(&kernfs_mutex);
+	down_read(&info->root->kernfs_rwsem);
 	inode = kernfs_get_inode(sb, info->root->kn);
-	mutex_unlock(&kernfs_mutex);
+	up_read(&info->root->kernfs_rwsem);
 	if (!inode) {
 		pr_debug("kernfs: could not get root inode\n");
 		return -ENOMEM;
@@ -337,9 +337,9 @@ struct dentry *kernfs_mount_ns(struct file_system_type *fs_type, int flags,
 		}
 		sb->s_flags |= MS_ACTIVE;
 
-		mutex_lock(&kernfs_mutex);
+		down_write(&root->kernfs_rwsem);
 		list_add(&info->node, &root->supers);
-		mutex_unlock(&kernfs_mutex);
+		up_write(&root->kernfs_rwsem);
 	}
 
 	return dget(sb->s_root);
@@ -356,10 +356,11 @@ struct dentry *kernfs_mount_ns(struct file_system_type *fs_type, int flags,
 void kernfs_kill_sb(struct super_block *sb)
 {
 	struct kernfs_super_info *info = kernfs_info(sb);
+	struct kernfs_root *root = info->root;
 
-	mutex_lock(&kernfs_mutex);
+	down_write(&root->kernfs_rwsem);
 	list_del(&info->node);
-	mutex_unlock(&kernfs_mutex);
+	up_write(&root->kernfs_rwsem);
 
 	/*
 	 * Remove the superblock from fs_supers/s_instances
@@ -386,7 +387,7 @@ struct super_block *kernfs_pin_sb(struct kernfs_root *root, const void *ns)
 	struct kernfs_super_info *info;
 	struct super_block *sb = NULL;
 
-	mutex_lock(&kernfs_mutex);
+	down_read(&root->kernfs_rwsem);
 	list_for_each_entry(info, &root->supers, node) {
 		if (info->ns == ns) {
 			sb = info->sb;
@@ -395,7 +396,7 @@ struct super_block *kernfs_pin_sb(struct kernfs_root *root, const void *ns)
 			break;
 		}
 	}
-	mutex_unlock(&kernfs_mutex);
+	up_read(&root->kernfs_rwsem);
 	return sb;
 }
 
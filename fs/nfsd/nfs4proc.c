@@ -747,6 +747,30 @@ nfsd4_lookup(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
 			   &cstate->current_fh);
 }
 
+/*
+ * Whether only ops that leave file data alone follow the current one.
+ * Clients commonly finish a READ compound with GETATTR; that shouldn't
+ * cost them the zero copy reply.
+ */
+static bool nfsd4_rest_keeps_data(struct svc_rqst *rqstp)
+{
+	struct nfsd4_compoundres *resp = rqstp->rq_resp;
+	struct nfsd4_compoundargs *argp = rqstp->rq_argp;
+	int i;
+
+	for (i = resp->opcnt; i < argp->opcnt; i++) {
+		switch (argp->ops[i].opnum) {
+		case OP_ACCESS:
+		case OP_GETATTR:
+		case OP_GETFH:
+			break;
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
 static __be32
 nfsd4_read(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
 	   union nfsd4_op_u *u)
@@ -764,9 +788,10 @@ nfsd4_read(struct svc_rqst *rqstp, struct nfsd4_compound_state *cstate,
 	 * following compound.
 	 *
 	 * To ensure proper ordering, we therefore turn off zero copy if
-	 * the client wants us to do more in this compound:
+	 * the client wants us to do anything more in this compound that
+	 * could change the data:
 	 */
-	if (!nfsd4_last_compound_op(rqstp))
+	if (!nfsd4_rest_keeps_data(rqstp))
 		clear_bit(RQ_SPLICE_OK, &rqstp->rq_flags);
 
 	/* check stateid */
@@ -1,6 +1,7 @@
 #include <linux/fanotify.h>
 #include <linux/fdtable.h>
 #include <linux/fsnotify_backend.h>
+#include <linux/hash.h>
 #include <linux/init.h>
 #include <linux/jiffies.h>
 #include <linux/kernel.h> /* UINT_MAX */
@@ -28,12 +29,24 @@ static bool should_merge(struct fsnotify_event *old_fsn,
 	return false;
 }
 
-/* and the list better be locked by something too! */
-static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
+/* Events that may merge share inode and tgid, so hash on those two */
+static struct hlist_head *fanotify_merge_bucket(struct fsnotify_group *group,
+						struct fsnotify_event *fse)
 {
-	struct fsnotify_event *test_event;
+	unsigned int hash = hash_ptr(fse->inode, 32) ^
+			    hash_ptr(FANOTIFY_E(fse)->tgid, 32);
 
-	pr_debug("%s: list=%p event=%p\n", __func__, list, event);
+	return &group->fanotify_data.merge_hash[hash_32(hash,
+							FANOTIFY_HASH_BITS)];
+}
+
+/* called with group->notification_lock held */
+static int fanotify_merge(struct fsnotify_group *group,
+			  struct fsnotify_event *event)
+{
+	struct fanotify_event_info *test_event;
+
+	pr_debug("%s: group=%p event=%p\n", __func__, group, event);
 
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
 	/*
@@ -45,9 +58,11 @@ static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
 		return 0;
 #endif
 
-	list_for_each_entry_reverse(test_event, list, list) {
-		if (should_merge(test_event, event)) {
-			test_event->mask |= event->mask;
+	/* Buckets are newest first, like the reverse list walk used to be */
+	hlist_for_each_entry(test_event, fanotify_merge_bucket(group, event),
+			     merge_list) {
+		if (should_merge(&test_event->fse, event)) {
+			test_event->fse.mask |= event->mask;
 			return 1;
 		}
 	}
@@ -55,6 +70,21 @@ static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
 	return 0;
 }
 
+/*
+ * Index a newly queued event for fanotify_merge().  Permission events wait
+ * for their own answer and the overflow event carries no object, so
+ * neither is ever merged into.  Called with group->notification_lock held.
+ */
+void fanotify_insert_event(struct fsnotify_group *group,
+			   struct fsnotify_event *fse)
+{
+	if (fse->mask & (FS_Q_OVERFLOW | FAN_ALL_PERM_EVENTS))
+		return;
+
+	hlist_add_head(&FANOTIFY_E(fse)->merge_list,
+		       fanotify_merge_bucket(group, fse));
+}
+
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
 static int fanotify_get_response(struct fsnotify_group *group,
 				 struct fanotify_perm_event_info *event,
@@ -170,6 +200,7 @@ struct fanotify_event_info *fanotify_alloc_event(struct inode *inode, u32 mask,
 		return NULL;
 init: __maybe_unused
 	fsnotify_init_event(&event->fse, inode, mask);
+	INIT_HLIST_NODE(&event->merge_list);
 	event->tgid = get_pid(task_tgid(current));
 	if (path) {
 		event->path = *path;
@@ -216,7 +247,8 @@ static int fanotify_handle_event(struct fsnotify_group *group,
 		return -ENOMEM;
 
 	fsn_event = &event->fse;
-	ret = fsnotify_add_event(group, fsn_event, fanotify_merge);
+	ret = fsnotify_add_event(group, fsn_event, fanotify_merge,
+				 fanotify_insert_event);
 	if (ret) {
 		/* Permission events shouldn't be merged */
 		BUG_ON(ret == 1 && mask & FAN_ALL_PERM_EVENTS);
@@ -240,6 +272,7 @@ static void fanotify_free_group_priv(struct fsnotify_group *group)
 {
 	struct user_struct *user;
 
+	kfree(group->fanotify_data.merge_hash);
 	user = group->fanotify_data.user;
 	atomic_dec(&user->fanotify_listeners);
 	free_uid(user);
@@ -2,6 +2,10 @@
 #include <linux/path.h>
 #include <linux/slab.h>
 
+/* Buckets of the per-group index of queued events used for merging */
+#define FANOTIFY_HASH_BITS	7
+#define FANOTIFY_HASH_SIZE	(1 << FANOTIFY_HASH_BITS)
+
 extern struct kmem_cache *fanotify_mark_cache;
 extern struct kmem_cache *fanotify_event_cachep;
 extern struct kmem_cache *fanotify_perm_event_cachep;
@@ -19,6 +23,8 @@ struct fanotify_event_info {
 	 */
 	struct path path;
 	struct pid *tgid;
+	/* Entry in group->fanotify_data.merge_hash while queued */
+	struct hlist_node merge_list;
 };
 
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
@@ -47,5 +53,18 @@ static inline struct fanotify_event_info *FANOTIFY_E(struct fsnotify_event *fse)
 	return container_of(fse, struct fanotify_event_info, fse);
 }
 
+/*
+ * Events must leave the merge hash together with the notification list so
+ * that nothing merges into an event userspace is already reading.  Called
+ * with group->notification_lock held.
+ */
+static inline void fanotify_unhash_event(struct fsnotify_event *fse)
+{
+	hlist_del_init(&FANOTIFY_E(fse)->merge_list);
+}
+
+void fanotify_insert_event(struct fsnotify_group *group,
+			   struct fsnotify_event *fse);
+
 struct fanotify_event_info *fanotify_alloc_event(struct inode *inode, u32 mask,
 						 const struct path *path);
@@ -26,6 +26,9 @@
 #define FANOTIFY_DEFAULT_MAX_MARKS	8192
 #define FANOTIFY_DEFAULT_MAX_LISTENERS	128
 
+/* Events taken off the queue per notification_lock round trip in read() */
+#define FANOTIFY_READ_BATCH		32
+
 /*
  * All flags that may be specified in parameter event_f_flags of fanotify_init.
  *
@@ -45,29 +48,65 @@ struct kmem_cache *fanotify_mark_cache __read_mostly;
 struct kmem_cache *fanotify_event_cachep __read_mostly;
 struct kmem_cache *fanotify_perm_event_cachep __read_mostly;
 
+/* Called with the group->notification_lock held. */
+static struct fsnotify_event *remove_first_event(struct fsnotify_group *group)
+{
+	struct fsnotify_event *fsn_event;
+
+	fsn_event = fsnotify_remove_first_event(group);
+	fanotify_unhash_event(fsn_event);
+	return fsn_event;
+}
+
 /*
- * Get an fsnotify notification event if one exists and is small
- * enough to fit in "count". Return an error pointer if the count
- * is not large enough.
+ * Move as many queued events as fit in "count", up to FANOTIFY_READ_BATCH,
+ * to @batch so that read() doesn't take the notification lock once per
+ * event. Return the number of events moved, or -EINVAL if the count is not
+ * large enough for a single one.
  *
  * Called with the group->notification_lock held.
  */
-static struct fsnotify_event *get_one_event(struct fsnotify_group *group,
-					    size_t count)
+static int get_events(struct fsnotify_group *group, size_t count,
+		      struct list_head *batch)
 {
+	int nr = 0;
+
 	assert_spin_locked(&group->notification_lock);
 
 	pr_debug("%s: group=%p count=%zd\n", __func__, group, count);
 
 	if (fsnotify_notify_queue_is_empty(group))
-		return NULL;
+		return 0;
 
 	if (FAN_EVENT_METADATA_LEN > count)
-		return ERR_PTR(-EINVAL);
+		return -EINVAL;
 
-	/* held the notification_lock the whole time, so this is the
-	 * same event we peeked above */
-	return fsnotify_remove_first_event(group);
+	do {
+		list_add_tail(&remove_first_event(group)->list, batch);
+		count -= FAN_EVENT_METADATA_LEN;
+	} while (++nr < FANOTIFY_READ_BATCH &&
+		 count >= FAN_EVENT_METADATA_LEN &&
+		 !fsnotify_notify_queue_is_empty(group));
+
+	return nr;
+}
+
+/*
+ * Put the events read() took but could not copy out back at the head of
+ * the queue, in their original order.
+ */
+static void requeue_events(struct fsnotify_group *group,
+			   struct list_head *batch)
+{
+	struct fsnotify_event *fsn_event, *next;
+
+	spin_lock(&group->notification_lock);
+	list_for_each_entry_safe_reverse(fsn_event, next, batch, list) {
+		list_move(&fsn_event->list, &group->notification_list);
+		group->q_len++;
+		fanotify_insert_event(group, fsn_event);
+	}
+	spin_unlock(&group->notification_lock);
 }
 
 static int create_fd(struct fsnotify_group *group,
@@ -259,6 +298,7 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 	struct fsnotify_group *group;
 	struct fsnotify_event *kevent;
 	char __user *start;
+	LIST_HEAD(batch);
 	int ret;
 	DEFINE_WAIT_FUNC(wait, woken_wake_function);
 
@@ -269,16 +309,16 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 
 	add_wait_queue(&group->notification_waitq, &wait);
 	while (1) {
-		spin_lock(&group->notification_lock);
-		kevent = get_one_event(group, count);
-		spin_unlock(&group->notification_lock);
+		if (list_empty(&batch)) {
+			spin_lock(&group->notification_lock);
+			ret = get_events(group, count, &batch);
+			spin_unlock(&group->notification_lock);
 
-		if (IS_ERR(kevent)) {
-			ret = PTR_ERR(kevent);
-			break;
+			if (ret < 0)
+				break;
 		}
 
-		if (!kevent) {
+		if (list_empty(&batch)) {
 			ret = -EAGAIN;
 			if (file->f_flags & O_NONBLOCK)
 				break;
@@ -294,6 +334,9 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 			continue;
 		}
 
+		kevent = list_first_entry(&batch, struct fsnotify_event, list);
+		list_del_init(&kevent->list);
+
 		ret = copy_event_to_user(group, kevent, buf);
 		if (unlikely(ret == -EOPENSTALE)) {
 			/*
@@ -331,6 +374,9 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 	}
 	remove_wait_queue(&group->notification_waitq, &wait);
 
+	if (!list_empty(&batch))
+		requeue_events(group, &batch);
+
 	if (start != buf && ret != -EFAULT)
 		ret = buf - start;
 	return ret;
@@ -398,7 +444,7 @@ static int fanotify_release(struct inode *ignored, struct file *file)
 	 * response is consumed and fanotify_get_response() returns.
 	 */
 	while (!fsnotify_notify_queue_is_empty(group)) {
-		fsn_event = fsnotify_remove_first_event(group);
+		fsn_event = remove_first_event(group);
 		if (!(fsn_event->mask & FAN_ALL_PERM_EVENTS)) {
 			spin_unlock(&group->notification_lock);
 			fsnotify_destroy_event(group, fsn_event);
@@ -707,6 +753,21 @@ static int fanotify_add_inode_mark(struct fsnotify_group *group,
 	return 0;
 }
 
+static struct hlist_head *fanotify_alloc_merge_hash(void)
+{
+	struct hlist_head *hash;
+	int i;
+
+	hash = kmalloc_array(FANOTIFY_HASH_SIZE, sizeof(*hash), GFP_KERNEL);
+	if (!hash)
+		return NULL;
+
+	for (i = 0; i < FANOTIFY_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&hash[i]);
+
+	return hash;
+}
+
 /* fanotify syscalls */
 SYSCALL_DEFINE2(fanotify_init, unsigned int, flags, unsigned int, event_f_flags)
 {
@@ -758,6 +819,12 @@ SYSCALL_DEFINE2(fanotify_init, unsigned int, flags, unsigned int, event_f_flags)
 	group->fanotify_data.user = user;
 	atomic_inc(&user->fanotify_listeners);
 
+	group->fanotify_data.merge_hash = fanotify_alloc_merge_hash();
+	if (!group->fanotify_data.merge_hash) {
+		fd = -ENOMEM;
+		goto out_destroy_group;
+	}
+
 	oevent = fanotify_alloc_event(NULL, FS_Q_OVERFLOW, NULL);
 	if (unlikely(!oevent)) {
 		fd = -ENOMEM;
@@ -139,6 +139,8 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 {
 	struct file *old_file;
 	struct file *new_file;
+	ssize_t (*copy_file_range)(struct file *, loff_t, struct file *,
+				   loff_t, size_t, unsigned int);
 	loff_t old_pos = 0;
 	loff_t new_pos = 0;
 	int error = 0;
@@ -163,6 +165,15 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 	/* Couldn't clone, so now we try to copy the data */
 	error = 0;
 
+	/*
+	 * Let the upper fs copy within itself if it can (e.g. server side
+	 * copy).  We already hold write access to upper, so call the method
+	 * directly rather than through vfs_copy_file_range().
+	 */
+	copy_file_range = new_file->f_op->copy_file_range;
+	if (file_inode(old_file)->i_sb != file_inode(new_file)->i_sb)
+		copy_file_range = NULL;
+
 	/* FIXME: copy up sparse files efficiently */
 	while (len) {
 		size_t this_len = OVL_COPY_UP_CHUNK_SIZE;
@@ -176,9 +187,21 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 			break;
 		}
 
-		bytes = do_splice_direct(old_file, &old_pos,
-					 new_file, &new_pos,
-					 this_len, SPLICE_F_MOVE);
+		if (copy_file_range) {
+			bytes = copy_file_range(old_file, old_pos, new_file,
+						new_pos, this_len, 0);
+			if (bytes > 0) {
+				old_pos += bytes;
+				new_pos += bytes;
+			} else if (bytes == -EOPNOTSUPP || bytes == -EXDEV) {
+				copy_file_range = NULL;
+				continue;
+			}
+		} else {
+			bytes = do_splice_direct(old_file, &old_pos,
+						 new_file, &new_pos,
+						 this_len, SPLICE_F_MOVE);
+		}
 		if (bytes <= 0) {
 			error = bytes;
 			break;
@@ -208,6 +231,16 @@ static int ovl_set_timestamps(struct dentry *upperdentry, struct kstat *stat)
 	return notify_change(upperdentry, &attr, NULL);
 }
 
+static int ovl_set_size(struct dentry *upperdentry, struct kstat *stat)
+{
+	struct iattr attr = {
+		.ia_valid = ATTR_SIZE,
+		.ia_size = stat->size,
+	};
+
+	return notify_change(upperdentry, &attr, NULL);
+}
+
 int ovl_set_attr(struct dentry *upperdentry, struct kstat *stat)
 {
 	int err = 0;
@@ -328,6 +361,7 @@ struct ovl_copy_up_ctx {
 	struct dentry *workdir;
 	bool tmpfile;
 	bool origin;
+	bool metacopy;
 };
 
 static int ovl_link_up(struct ovl_copy_up_ctx *c)
@@ -445,7 +479,7 @@ static int ovl_copy_up_inode(struct ovl_copy_up_ctx *c, struct dentry *temp)
 {
 	int err;
 
-	if (S_ISREG(c->stat.mode)) {
+	if (S_ISREG(c->stat.mode) && !c->metacopy) {
 		struct path upperpath;
 
 		ovl_path_upper(c->dentry, &upperpath);
@@ -462,7 +496,10 @@ static int ovl_copy_up_inode(struct ovl_copy_up_ctx *c, struct dentry *temp)
 		return err;
 
 	inode_lock(temp->d_inode);
-	err = ovl_set_attr(temp, &c->stat);
+	if (c->metacopy)
+		err = ovl_set_size(temp, &c->stat);
+	if (!err)
+		err = ovl_set_attr(temp, &c->stat);
 	inode_unlock(temp->d_inode);
 	if (err)
 		return err;
@@ -480,6 +517,13 @@ static int ovl_copy_up_inode(struct ovl_copy_up_ctx *c, struct dentry *temp)
 			return err;
 	}
 
+	/* The origin is where the data will be read from until copied up */
+	if (c->metacopy) {
+		err = ovl_do_setxattr(temp, OVL_XATTR_METACOPY, NULL, 0, 0);
+		if (err)
+			return err;
+	}
+
 	return 0;
 }
 
@@ -508,6 +552,9 @@ static int ovl_copy_up_locked(struct ovl_copy_up_ctx *c)
 	if (err)
 		goto out_cleanup;
 
+	/* Made visible along with the upper dentry by ovl_inode_update() */
+	if (c->metacopy)
+		ovl_set_flag(OVL_METACOPY, d_inode(c->dentry));
 	ovl_inode_update(d_inode(c->dentry), newdentry);
 out:
 	dput(temp);
@@ -541,6 +588,15 @@ static int ovl_do_copy_up(struct ovl_copy_up_ctx *c)
 	if (S_ISDIR(c->stat.mode) || c->stat.nlink == 1 || indexed)
 		c->origin = true;
 
+	/*
+	 * Data of a metacopy is found by decoding the origin file handle,
+	 * so this needs an origin that can be decoded.  Leave hard links
+	 * alone, they may share the upper inode through the index.
+	 */
+	if (!c->origin || indexed ||
+	    !ovl_can_decode_fh(c->lowerpath.dentry->d_sb))
+		c->metacopy = false;
+
 	if (indexed) {
 		c->destdir = ovl_indexdir(c->dentry->d_sb);
 		err = ovl_get_index_name(c->lowerpath.dentry, &c->destname);
@@ -588,6 +644,63 @@ static int ovl_do_copy_up(struct ovl_copy_up_ctx *c)
 	return err;
 }
 
+/*
+ * Copy the data of a metacopy upper file.  Only the data and the metacopy
+ * xattr change, so the upper file is written in place.
+ */
+static int ovl_copy_up_meta_inode_data(struct ovl_copy_up_ctx *c)
+{
+	struct path upperpath;
+	struct kstat ustat;
+	int err;
+
+	ovl_path_upper(c->dentry, &upperpath);
+
+	/* Recheck, lookup may have raced with an earlier data copy up */
+	if (!ovl_check_metacopy_xattr(upperpath.dentry))
+		goto out;
+
+	err = vfs_getattr(&upperpath, &ustat,
+			  STATX_ATIME | STATX_MTIME, AT_STATX_SYNC_AS_STAT);
+	if (err)
+		return err;
+
+	err = ovl_copy_up_data(&c->lowerpath, &upperpath, c->stat.size);
+	if (err)
+		return err;
+
+	err = ovl_do_removexattr(upperpath.dentry, OVL_XATTR_METACOPY);
+	if (err)
+		return err;
+
+	/* Restore timestamps on upper (best effort) */
+	inode_lock(d_inode(upperpath.dentry));
+	ovl_set_timestamps(upperpath.dentry, &ustat);
+	inode_unlock(d_inode(upperpath.dentry));
+out:
+	/* Order the data copy before the readers switch over to upper */
+	smp_mb__before_atomic();
+	ovl_clear_flag(OVL_METACOPY, d_inode(c->dentry));
+
+	return 0;
+}
+
+/*
+ * Copy up only the metadata if the data is not needed right away.  The
+ * data is copied on open for write or truncate.
+ */
+static bool ovl_need_meta_copy_up(struct dentry *dentry, umode_t mode,
+				  int flags)
+{
+	if (!S_ISREG(mode) || !ovl_metacopy(dentry->d_sb))
+		return false;
+
+	if ((OPEN_FMODE(flags) & FMODE_WRITE) || (flags & O_TRUNC))
+		return false;
+
+	return true;
+}
+
 static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 			   int flags)
 {
@@ -622,6 +735,8 @@ static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 	if (flags & O_TRUNC)
 		ctx.stat.size = 0;
 
+	ctx.metacopy = ovl_need_meta_copy_up(dentry, ctx.stat.mode, flags);
+
 	if (S_ISLNK(ctx.stat.mode)) {
 		ctx.link = vfs_get_link(ctx.lowerpath.dentry, &done);
 		if (IS_ERR(ctx.link))
@@ -637,6 +752,8 @@ static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 	} else {
 		if (!ovl_dentry_upper(dentry))
 			err = ovl_do_copy_up(&ctx);
+		else if (!ctx.metacopy && ovl_dentry_is_metacopy(dentry))
+			err = ovl_copy_up_meta_inode_data(&ctx);
 		if (!err && !ovl_dentry_has_upper_alias(dentry))
 			err = ovl_link_up(&ctx);
 		ovl_copy_up_end(dentry);
@@ -669,7 +786,10 @@ int ovl_copy_up_flags(struct dentry *dentry, int flags)
 		 *      with rename.
 		 */
 		if (ovl_dentry_upper(dentry) &&
-		    ovl_dentry_has_upper_alias(dentry))
+		    ovl_dentry_has_upper_alias(dentry) &&
+		    (!ovl_dentry_is_metacopy(dentry) ||
+		     ovl_need_meta_copy_up(dentry, d_inode(dentry)->i_mode,
+					   flags)))
 			break;
 
 		next = dget(dentry);
@@ -698,3 +818,8 @@ int ovl_copy_up(struct dentry *dentry)
 {
 	return ovl_copy_up_flags(dentry, 0);
 }
+
+int ovl_copy_up_with_data(struct dentry *dentry)
+{
+	return ovl_copy_up_flags(dentry, O_WRONLY);
+}
@@ -38,7 +38,10 @@ int ovl_setattr(struct dentry *dentry, struct iattr *attr)
 	if (err)
 		goto out;
 
-	err = ovl_copy_up(dentry);
+	if (attr->ia_valid & ATTR_SIZE)
+		err = ovl_copy_up_with_data(dentry);
+	else
+		err = ovl_copy_up(dentry);
 	if (!err) {
 		upperdentry = ovl_dentry_upper(dentry);
 
@@ -74,6 +77,18 @@ int ovl_getattr(const struct path *path, struct kstat *stat,
 	if (err)
 		goto out;
 
+	/* The blocks of a metacopy are still allocated in lower */
+	if (ovl_dentry_is_metacopy(dentry)) {
+		struct kstat lowerstat;
+
+		ovl_path_lower(dentry, &realpath);
+		err = vfs_getattr(&realpath, &lowerstat, STATX_BLOCKS, flags);
+		if (err)
+			goto out;
+
+		stat->blocks = lowerstat.blocks;
+	}
+
 	/*
 	 * When all layers are on the same fs, all real inode number are
 	 * unique, so we use the overlay st_dev, which is friendly to du -x.
@@ -320,7 +335,8 @@ struct posix_acl *ovl_get_acl(struct inode *inode, int type)
 static bool ovl_open_need_copy_up(struct dentry *dentry, int flags)
 {
 	if (ovl_dentry_upper(dentry) &&
-	    ovl_dentry_has_upper_alias(dentry))
+	    ovl_dentry_has_upper_alias(dentry) &&
+	    !ovl_dentry_is_metacopy(dentry))
 		return false;
 
 	if (special_file(d_inode(dentry)->i_mode))
@@ -639,6 +655,9 @@ struct inode *ovl_get_inode(struct dentry *dentry, struct dentry *upperdentry)
 	if (upperdentry && ovl_is_impuredir(upperdentry))
 		ovl_set_flag(OVL_IMPURE, inode);
 
+	if (upperdentry && ovl_check_metacopy_xattr(upperdentry))
+		ovl_set_flag(OVL_METACOPY, inode);
+
 	if (inode->i_state & I_NEW)
 		unlock_new_inode(inode);
 out:
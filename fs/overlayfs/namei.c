@@ -631,6 +631,14 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 					       roe->numlower, &stack, &ctr);
 			if (err)
 				goto out;
+
+			/* Without the origin there is no data to read */
+			if (!ctr && ovl_check_metacopy_xattr(upperdentry)) {
+				pr_warn_ratelimited("overlayfs: metacopy with no origin (%pd2)\n",
+						    upperdentry);
+				err = -EIO;
+				goto out_put_upper;
+			}
 		}
 
 		if (d.redirect) {
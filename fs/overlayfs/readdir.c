@@ -15,7 +15,9 @@
 #include <linux/rbtree.h>
 #include <linux/security.h>
 #include <linux/cred.h>
+#include <linux/workqueue.h>
 #include "overlayfs.h"
+#include "ovl_entry.h"
 
 struct ovl_cache_entry {
 	unsigned int len;
@@ -47,6 +49,15 @@ struct ovl_readdir_data {
 	bool d_type_supported;
 };
 
+/* Entries of one layer, read by a worker while the layers above merge */
+struct ovl_layer_read {
+	struct work_struct work;
+	const struct cred *cred;
+	struct path realpath;
+	struct list_head entries;
+	int err;
+};
+
 struct ovl_dir_file {
 	bool is_real;
 	bool is_upper;
@@ -172,21 +183,31 @@ void ovl_cache_free(struct list_head *list)
 	INIT_LIST_HEAD(list);
 }
 
-static void ovl_cache_put(struct ovl_dir_file *od, struct dentry *dentry)
+static void ovl_dir_cache_put(struct ovl_dir_cache *cache)
 {
-	struct ovl_dir_cache *cache = od->cache;
-
 	WARN_ON(cache->refcount <= 0);
 	cache->refcount--;
 	if (!cache->refcount) {
-		if (ovl_dir_cache(dentry) == cache)
-			ovl_set_dir_cache(dentry, NULL);
-
 		ovl_cache_free(&cache->entries);
 		kfree(cache);
 	}
 }
 
+/*
+ * The inode keeps a reference to its merged dir cache, so the cache
+ * outlives the files that use it until the directory changes or the inode
+ * is evicted.
+ */
+void ovl_dir_cache_free(struct inode *inode)
+{
+	struct ovl_dir_cache *cache = OVL_I(inode)->cache;
+
+	if (cache) {
+		OVL_I(inode)->cache = NULL;
+		ovl_dir_cache_put(cache);
+	}
+}
+
 static int ovl_fill_merge(struct dir_context *ctx, const char *name,
 			  int namelen, loff_t offset, u64 ino,
 			  unsigned int d_type)
@@ -264,7 +285,7 @@ static void ovl_dir_reset(struct file *file)
 	enum ovl_path_type type = ovl_path_type(dentry);
 
 	if (cache && ovl_dentry_version_get(dentry) != cache->version) {
-		ovl_cache_put(od, dentry);
+		ovl_dir_cache_put(cache);
 		od->cache = NULL;
 		od->cursor = NULL;
 	}
@@ -273,9 +294,70 @@ static void ovl_dir_reset(struct file *file)
 		od->is_real = false;
 }
 
+static int ovl_fill_layer(struct dir_context *ctx, const char *name,
+			  int namelen, loff_t offset, u64 ino,
+			  unsigned int d_type)
+{
+	struct ovl_readdir_data *rdd =
+		container_of(ctx, struct ovl_readdir_data, ctx);
+	struct ovl_cache_entry *p;
+
+	rdd->count++;
+	p = ovl_cache_entry_new(rdd, name, namelen, ino, d_type);
+	if (p == NULL)
+		return -ENOMEM;
+
+	list_add_tail(&p->l_node, rdd->list);
+
+	return 0;
+}
+
+static void ovl_layer_read_work(struct work_struct *work)
+{
+	struct ovl_layer_read *lr =
+		container_of(work, struct ovl_layer_read, work);
+	struct ovl_readdir_data rdd = {
+		.ctx.actor = ovl_fill_layer,
+		.list = &lr->entries,
+	};
+	const struct cred *old_cred;
+
+	old_cred = override_creds(lr->cred);
+	lr->err = ovl_dir_read(&lr->realpath, &rdd);
+	revert_creds(old_cred);
+}
+
+/* Merge the entries a worker read from a lower layer, in layer order */
+static int ovl_dir_merge_layer(struct ovl_readdir_data *rdd,
+			       struct ovl_layer_read *lr)
+{
+	struct ovl_cache_entry *p;
+	int err = 0;
+
+	rdd->first_maybe_whiteout = NULL;
+	rdd->err = 0;
+	list_for_each_entry(p, &lr->entries, l_node) {
+		err = ovl_fill_merge(&rdd->ctx, p->name, p->len, 0, p->ino,
+				     p->type);
+		if (err)
+			return err;
+	}
+
+	if (rdd->first_maybe_whiteout)
+		err = ovl_check_whiteouts(lr->realpath.dentry, rdd);
+
+	return err;
+}
+
+/*
+ * Read the layers below the topmost one in parallel, so a directory in an
+ * image with many layers costs about as much as its largest layer.  The
+ * merge itself stays in layer order.
+ */
 static int ovl_dir_read_merged(struct dentry *dentry, struct list_head *list)
 {
-	int err;
+	int err = 0;
+	struct ovl_layer_read *layers, *lr;
 	struct path realpath;
 	struct ovl_readdir_data rdd = {
 		.ctx.actor = ovl_fill_merge,
@@ -284,26 +366,58 @@ static int ovl_dir_read_merged(struct dentry *dentry, struct list_head *list)
 		.root = RB_ROOT,
 		.is_lowest = false,
 	};
-	int idx, next;
+	int idx, next, i, nr = 0;
 
 	for (idx = 0; idx != -1; idx = next) {
 		next = ovl_path_next(idx, dentry, &realpath);
+		nr++;
+	}
 
-		if (next != -1) {
-			err = ovl_dir_read(&realpath, &rdd);
-			if (err)
-				break;
-		} else {
+	layers = kcalloc(nr, sizeof(*layers), GFP_KERNEL);
+	if (!layers)
+		return -ENOMEM;
+
+	for (i = 0, idx = 0; idx != -1; i++, idx = next) {
+		lr = &layers[i];
+		next = ovl_path_next(idx, dentry, &lr->realpath);
+		INIT_LIST_HEAD(&lr->entries);
+		if (i > 0) {
+			lr->cred = current_cred();
+			INIT_WORK(&lr->work, ovl_layer_read_work);
+			queue_work(system_unbound_wq, &lr->work);
+		}
+	}
+
+	for (i = 0; i < nr && !err; i++) {
+		lr = &layers[i];
+		if (i == nr - 1) {
 			/*
 			 * Insert lowest layer entries before upper ones, this
 			 * allows offsets to be reasonably constant
 			 */
 			list_add(&rdd.middle, rdd.list);
 			rdd.is_lowest = true;
-			err = ovl_dir_read(&realpath, &rdd);
-			list_del(&rdd.middle);
 		}
+
+		if (i == 0) {
+			err = ovl_dir_read(&lr->realpath, &rdd);
+		} else {
+			flush_work(&lr->work);
+			err = lr->err;
+			if (!err)
+				err = ovl_dir_merge_layer(&rdd, lr);
+		}
+
+		if (i == nr - 1)
+			list_del(&rdd.middle);
+	}
+
+	for (i = 1; i < nr; i++) {
+		flush_work(&layers[i].work);
+		ovl_cache_free(&layers[i].entries);
 	}
+	kfree(layers);
+
 	return err;
 }
 
@@ -331,13 +445,14 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 		cache->refcount++;
 		return cache;
 	}
-	ovl_set_dir_cache(dentry, NULL);
+	ovl_dir_cache_free(d_inode(dentry));
 
 	cache = kzalloc(sizeof(struct ovl_dir_cache), GFP_KERNEL);
 	if (!cache)
 		return ERR_PTR(-ENOMEM);
 
-	cache->refcount = 1;
+	/* One reference for the inode, one for the file */
+	cache->refcount = 2;
 	INIT_LIST_HEAD(&cache->entries);
 
 	res = ovl_dir_read_merged(dentry, &cache->entries);
@@ -473,7 +588,7 @@ static int ovl_dir_release(struct inode *inode, struct file *file)
 
 	if (od->cache) {
 		inode_lock(inode);
-		ovl_cache_put(od, file->f_path.dentry);
+		ovl_dir_cache_put(od->cache);
 		inode_unlock(inode);
 	}
 	fput(od->realfile);
@@ -234,6 +234,25 @@ bool ovl_redirect_dir(struct super_block *sb)
 	return ofs->config.redirect_dir && !ofs->noxattr;
 }
 
+bool ovl_metacopy(struct super_block *sb)
+{
+	struct ovl_fs *ofs = sb->s_fs_info;
+
+	return ofs->config.metacopy && !ofs->noxattr;
+}
+
+/*
+ * Is the dentry copied up without its data?  Once this returns false for
+ * an upper dentry, the data is in upper to stay.
+ */
+bool ovl_dentry_is_metacopy(struct dentry *dentry)
+{
+	if (!ovl_dentry_upper(dentry))
+		return false;
+
+	return ovl_test_flag(OVL_METACOPY, d_inode(dentry));
+}
+
 const char *ovl_dentry_get_redirect(struct dentry *dentry)
 {
 	return OVL_I(d_inode(dentry))->redirect;
@@ -337,6 +356,21 @@ bool ovl_check_dir_xattr(struct dentry *dentry, const char *name)
 	return false;
 }
 
+bool ovl_check_metacopy_xattr(struct dentry *dentry)
+{
+	int res;
+
+	if (!d_is_reg(dentry))
+		return false;
+
+	res = vfs_getxattr(dentry, OVL_XATTR_METACOPY, NULL, 0);
+	if (res < 0 && res != -ENODATA && res != -EOPNOTSUPP)
+		pr_warn_ratelimited("overlayfs: failed to get metacopy (%i)\n",
+				    res);
+
+	return res >= 0;
+}
+
 int ovl_check_setxattr(struct dentry *dentry, struct dentry *upperdentry,
 		       const char *name, const void *value, size_t size,
 		       int xerr)
@@ -382,6 +416,11 @@ void ovl_set_flag(unsigned long flag, struct inode *inode)
 	set_bit(flag, &OVL_I(inode)->flags);
 }
 
+void ovl_clear_flag(unsigned long flag, struct inode *inode)
+{
+	clear_bit(flag, &OVL_I(inode)->flags);
+}
+
 bool ovl_test_flag(unsigned long flag, struct inode *inode)
 {
 	return test_bit(flag, &OVL_I(inode)->flags);
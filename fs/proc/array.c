@@ -157,6 +157,11 @@ static inline int get_task_umask(struct task_struct *tsk)
 	return umask;
 }
 
+char proc_task_state_char(struct task_struct *tsk)
+{
+	return *get_task_state(tsk);
+}
+
 static inline void task_state(struct seq_file *m, struct pid_namespace *ns,
 				struct pid *pid, struct task_struct *p)
 {
@@ -0,0 +1,264 @@
+/*
+ * /proc/pidstats - batched, fixed-layout process statistics
+ *
+ * Monitoring tools that sample every process otherwise open and parse
+ * stat, status, io and schedstat for each pid.  Here a single read()
+ * returns binary records for as many thread groups as fit in the buffer.
+ * See include/uapi/linux/pidstats.h for the layout and file semantics.
+ */
+#include <linux/cred.h>
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/pid_namespace.h>
+#include <linux/proc_fs.h>
+#include <linux/ptrace.h>
+#include <linux/sched.h>
+#include <linux/sched/cputime.h>
+#include <linux/sched/mm.h>
+#include <linux/sched/signal.h>
+#include <linux/sched/task.h>
+#include <linux/task_io_accounting_ops.h>
+#include <linux/uaccess.h>
+#include <uapi/linux/pidstats.h>
+
+#include "internal.h"
+
+/*
+ * Find the first thread group leader with a pid of at least *nr in @ns,
+ * and return it with a reference held and *nr set to its pid.
+ */
+static struct task_struct *pidstats_next_task(struct pid_namespace *ns,
+					      pid_t *nr)
+{
+	struct task_struct *task = NULL;
+	struct pid *pid;
+
+	rcu_read_lock();
+	for (;;) {
+		pid = find_ge_pid(*nr, ns);
+		if (!pid)
+			break;
+		*nr = pid_nr_ns(pid, ns);
+		task = pid_task(pid, PIDTYPE_PID);
+		if (task && has_group_leader_pid(task)) {
+			get_task_struct(task);
+			break;
+		}
+		task = NULL;
+		(*nr)++;
+	}
+	rcu_read_unlock();
+
+	return task;
+}
+
+static void pidstats_fill_mem(struct pidstats_record *rec,
+			      struct task_struct *task)
+{
+	struct mm_struct *mm = get_task_mm(task);
+
+	if (!mm)
+		return;
+
+	rec->vm_size = mm->total_vm;
+	rec->rss_anon = get_mm_counter(mm, MM_ANONPAGES);
+	rec->rss_file = get_mm_counter(mm, MM_FILEPAGES);
+	rec->rss_shmem = get_mm_counter(mm, MM_SHMEMPAGES);
+	rec->swap = get_mm_counter(mm, MM_SWAPENTS);
+	rec->mask |= PIDSTATS_MEM;
+	mmput(mm);
+}
+
+#ifdef CONFIG_TASK_IO_ACCOUNTING
+static void pidstats_fill_io(struct pidstats_record *rec,
+			     struct task_struct *task)
+{
+	struct task_io_accounting acct = task->ioac;
+	struct task_struct *t = task;
+	unsigned long flags;
+
+	/* Same rules as /proc/PID/io, see do_io_accounting() */
+	if (mutex_lock_killable(&task->signal->cred_guard_mutex))
+		return;
+	if (!ptrace_may_access(task, PTRACE_MODE_READ_FSCREDS))
+		goto out_unlock;
+
+	if (lock_task_sighand(task, &flags)) {
+		task_io_accounting_add(&acct, &task->signal->ioac);
+		while_each_thread(task, t)
+			task_io_accounting_add(&acct, &t->ioac);
+		unlock_task_sighand(task, &flags);
+	}
+
+	rec->rchar = acct.rchar;
+	rec->wchar = acct.wchar;
+	rec->syscr = acct.syscr;
+	rec->syscw = acct.syscw;
+	rec->read_bytes = acct.read_bytes;
+	rec->write_bytes = acct.write_bytes;
+	rec->cancelled_write_bytes = acct.cancelled_write_bytes;
+	rec->mask |= PIDSTATS_IO;
+out_unlock:
+	mutex_unlock(&task->signal->cred_guard_mutex);
+}
+#else
+static inline void pidstats_fill_io(struct pidstats_record *rec,
+				    struct task_struct *task)
+{
+}
+#endif
+
+static void pidstats_fill(struct pidstats_record *rec, struct file *file,
+			  struct pid_namespace *ns, struct task_struct *task,
+			  u64 want)
+{
+	struct user_namespace *user_ns = file->f_cred->user_ns;
+	const struct cred *cred;
+	unsigned long flags;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->rec_size = sizeof(*rec);
+	rec->pid = task_tgid_nr_ns(task, ns);
+	rec->state = proc_task_state_char(task);
+	rec->start_time_ns = task->real_start_time;
+	get_task_comm(rec->comm, task);
+
+	rcu_read_lock();
+	cred = __task_cred(task);
+	rec->uid = from_kuid_munged(user_ns, cred->uid);
+	rec->gid = from_kgid_munged(user_ns, cred->gid);
+	rcu_read_unlock();
+
+	if (lock_task_sighand(task, &flags)) {
+		struct signal_struct *sig = task->signal;
+		struct task_struct *t = task;
+
+		rec->ppid = task_tgid_nr_ns(task->real_parent, ns);
+		rec->nr_threads = get_nr_threads(task);
+
+		if (want & PIDSTATS_CPU) {
+			u64 utime, stime;
+
+			rec->min_flt = sig->min_flt;
+			rec->maj_flt = sig->maj_flt;
+			rec->nvcsw = sig->nvcsw;
+			rec->nivcsw = sig->nivcsw;
+			do {
+				rec->min_flt += t->min_flt;
+				rec->maj_flt += t->maj_flt;
+				rec->nvcsw += t->nvcsw;
+				rec->nivcsw += t->nivcsw;
+			} while_each_thread(task, t);
+
+			thread_group_cputime_adjusted(task, &utime, &stime);
+			rec->utime_ns = utime;
+			rec->stime_ns = stime;
+			rec->mask |= PIDSTATS_CPU;
+		}
+
+		if (want & PIDSTATS_SCHED) {
+			rec->sum_exec_runtime_ns = sig->sum_sched_runtime;
+			t = task;
+			do {
+				rec->sum_exec_runtime_ns += t->se.sum_exec_runtime;
+#ifdef CONFIG_SCHED_INFO
+				rec->run_delay_ns += t->sched_info.run_delay;
+				rec->pcount += t->sched_info.pcount;
+#endif
+			} while_each_thread(task, t);
+			rec->mask |= PIDSTATS_SCHED;
+		}
+
+		unlock_task_sighand(task, &flags);
+	}
+
+	if (want & PIDSTATS_MEM)
+		pidstats_fill_mem(rec, task);
+	if (want & PIDSTATS_IO)
+		pidstats_fill_io(rec, task);
+}
+
+static int pidstats_open(struct inode *inode, struct file *file)
+{
+	file->private_data = (void *)(unsigned long)PIDSTATS_ALL;
+	return 0;
+}
+
+static ssize_t pidstats_read(struct file *file, char __user *buf,
+			     size_t count, loff_t *ppos)
+{
+	struct pid_namespace *ns = file_inode(file)->i_sb->s_fs_info;
+	u64 want = (unsigned long)file->private_data;
+	struct pidstats_record rec;
+	struct task_struct *task;
+	size_t done = 0;
+	pid_t nr;
+
+	if (count < sizeof(rec))
+		return -EINVAL;
+	if (*ppos < 0 || *ppos >= PID_MAX_LIMIT)
+		return 0;
+	nr = *ppos;
+
+	while (count - done >= sizeof(rec)) {
+		task = pidstats_next_task(ns, &nr);
+		if (!task) {
+			nr = PID_MAX_LIMIT;
+			break;
+		}
+
+		if (!has_pid_permissions(ns, task, HIDEPID_INVISIBLE)) {
+			put_task_struct(task);
+			nr++;
+			continue;
+		}
+		pidstats_fill(&rec, file, ns, task, want);
+		put_task_struct(task);
+
+		if (copy_to_user(buf + done, &rec, sizeof(rec))) {
+			if (!done)
+				return -EFAULT;
+			break;
+		}
+		done += sizeof(rec);
+		nr++;
+
+		if (fatal_signal_pending(current))
+			break;
+		cond_resched();
+	}
+
+	*ppos = nr;
+	return done;
+}
+
+static ssize_t pidstats_write(struct file *file, const char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	u64 want;
+
+	if (count != sizeof(want))
+		return -EINVAL;
+	if (copy_from_user(&want, buf, sizeof(want)))
+		return -EFAULT;
+	if (want & ~PIDSTATS_ALL)
+		return -EINVAL;
+
+	file->private_data = (void *)(unsigned long)want;
+	return count;
+}
+
+static const struct file_operations proc_pidstats_operations = {
+	.open		= pidstats_open,
+	.read		= pidstats_read,
+	.write		= pidstats_write,
+	.llseek		= default_llseek,
+};
+
+static int __init proc_pidstats_init(void)
+{
+	proc_create("pidstats", 0666, NULL, &proc_pidstats_operations);
+	return 0;
+}
+fs_initcall(proc_pidstats_init);
@@ -47,6 +47,7 @@
 #include <linux/string.h>
 #include <linux/pagemap.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -497,7 +498,154 @@ out:
 	return 0;
 }
 
+/*
+ * Readahead decompresses the blocks of the readahead window in parallel:
+ * each block is filled by an unbound worker, except the first one which
+ * the reading task needs right away and fills itself. The pages stay
+ * locked until they are uptodate, so readers wait for the workers rather
+ * than decompressing the block a second time.
+ */
+struct squashfs_readahead {
+	struct work_struct	work;
+	struct inode		*inode;
+	int			index;
+	int			nr;
+	struct page		*page[];
+};
+
+static void squashfs_readahead_fill(struct squashfs_readahead *ra)
+{
+	struct inode *inode = ra->inode;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int mask = (1 << (msblk->block_log - PAGE_SHIFT)) - 1;
+	int file_end = i_size_read(inode) >> msblk->block_log;
+	struct squashfs_cache_entry *buffer = NULL;
+	int i, bytes, offset = 0, res = 0;
+
+	if (ra->index < file_end || squashfs_i(inode)->fragment_block ==
+					SQUASHFS_INVALID_BLK) {
+		u64 block = 0;
+		int bsize = read_blocklist(inode, ra->index, &block);
+
+		if (bsize < 0)
+			res = bsize;
+		else if (bsize)
+			buffer = squashfs_get_datablock(inode->i_sb, block,
+							bsize);
+		bytes = buffer ? buffer->length : 0;
+	} else {
+		buffer = squashfs_get_fragment(inode->i_sb,
+			squashfs_i(inode)->fragment_block,
+			squashfs_i(inode)->fragment_size);
+		bytes = i_size_read(inode) & (msblk->block_size - 1);
+		offset = squashfs_i(inode)->fragment_offset;
+	}
+
+	if (buffer && buffer->error) {
+		res = buffer->error;
+		ERROR("Unable to read page, block %llx, size %x\n",
+			buffer->block, buffer->length);
+	}
+
+	for (i = 0; i < ra->nr; i++) {
+		struct page *page = ra->page[i];
+		int start = (page->index & mask) << PAGE_SHIFT;
+		int avail = clamp_t(int, bytes - start, 0, PAGE_SIZE);
+		void *pageaddr;
+
+		if (res) {
+			SetPageError(page);
+		} else {
+			pageaddr = kmap_atomic(page);
+			if (avail)
+				squashfs_copy_data(pageaddr, buffer,
+						   offset + start, avail);
+			memset(pageaddr + avail, 0, PAGE_SIZE - avail);
+			kunmap_atomic(pageaddr);
+			flush_dcache_page(page);
+			SetPageUptodate(page);
+		}
+		unlock_page(page);
+		put_page(page);
+	}
+
+	if (buffer)
+		squashfs_cache_put(buffer);
+}
+
+static void squashfs_readahead_work(struct work_struct *work)
+{
+	struct squashfs_readahead *ra = container_of(work,
+					struct squashfs_readahead, work);
+
+	squashfs_readahead_fill(ra);
+	kfree(ra);
+}
+
+static void squashfs_readahead_queue(struct squashfs_readahead **first,
+				     struct squashfs_readahead *ra)
+{
+	if (!*first) {
+		*first = ra;
+		return;
+	}
+	INIT_WORK(&ra->work, squashfs_readahead_work);
+	queue_work(system_unbound_wq, &ra->work);
+}
+
+static int squashfs_readpages(struct file *file, struct address_space *mapping,
+			      struct list_head *pages, unsigned int nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_SHIFT;
+	gfp_t gfp = readahead_gfp_mask(mapping);
+	struct squashfs_readahead *ra = NULL, *first = NULL;
+
+	TRACE("Entered squashfs_readpages, %u pages, start block %llx\n",
+				nr_pages, squashfs_i(inode)->start);
+
+	/* The pages come in descending index order */
+	while (!list_empty(pages)) {
+		struct page *page = list_entry(pages->prev, struct page, lru);
+
+		list_del(&page->lru);
+		if (add_to_page_cache_lru(page, mapping, page->index, gfp)) {
+			put_page(page);
+			continue;
+		}
+
+		if (ra && ra->index != page->index >> shift) {
+			squashfs_readahead_queue(&first, ra);
+			ra = NULL;
+		}
+
+		if (!ra) {
+			ra = kmalloc(sizeof(*ra) +
+				     (sizeof(struct page *) << shift), gfp);
+			if (!ra) {
+				squashfs_readpage(file, page);
+				put_page(page);
+				continue;
+			}
+			ra->inode = inode;
+			ra->index = page->index >> shift;
+			ra->nr = 0;
+		}
+		ra->page[ra->nr++] = page;
+	}
+
+	if (ra)
+		squashfs_readahead_queue(&first, ra);
+	if (first) {
+		squashfs_readahead_fill(first);
+		kfree(first);
+	}
+	return 0;
+}
+
 
 const struct address_space_operations squashfs_aops = {
-	.readpage = squashfs_readpage
+	.readpage = squashfs_readpage,
+	.readpages = squashfs_readpages
 };
@@ -16,6 +16,12 @@
 #define BPF_REGISTER_MAX_RANGE (1024 * 1024 * 1024)
 #define BPF_REGISTER_MIN_RANGE -1
 
+enum bpf_reg_liveness {
+	REG_LIVE_NONE = 0, /* reg hasn't been read or written this branch */
+	REG_LIVE_READ, /* reg was read, so we're sensitive to initial value */
+	REG_LIVE_WRITTEN, /* reg was written first, screening off later reads */
+};
+
 struct bpf_reg_state {
 	enum bpf_reg_type type;
 	union {
@@ -44,6 +50,11 @@ struct bpf_reg_state {
 	u32 aux_off;
 	u32 aux_off_align;
 	bool value_from_signed;
+	/* Liveness of the value in the state it belongs to: read by the
+	 * code after it, before being written.  Not part of the value, so
+	 * it must stay last; states_equal() compares up to it.
+	 */
+	enum bpf_reg_liveness live;
 };
 
 enum bpf_stack_slot_type {
@@ -61,12 +72,19 @@ struct bpf_verifier_state {
 	struct bpf_reg_state regs[MAX_BPF_REG];
 	u8 stack_slot_type[MAX_BPF_STACK];
 	struct bpf_reg_state spilled_regs[MAX_BPF_STACK / BPF_REG_SIZE];
+	/* ringbuf records reserved and not yet submitted or discarded */
+	u32 ringbuf_refs;
+	/* explored state the straight-line code to this one started from */
+	struct bpf_verifier_state *parent;
 };
 
 /* linked list of verifier states used to prune search */
 struct bpf_verifier_state_list {
 	struct bpf_verifier_state state;
 	struct bpf_verifier_state_list *next;
+	/* times the state did and didn't prune a later one */
+	u32 hit_cnt;
+	u32 miss_cnt;
 };
 
 struct bpf_insn_aux_data {
@@ -105,6 +123,13 @@ struct bpf_verifier_env {
 	bool seen_direct_write;
 	bool varlen_map_value_access;
 	struct bpf_insn_aux_data *insn_aux_data; /* array of per-insn state */
+	/* states no longer searched, kept for the parent links into them */
+	struct bpf_verifier_state_list *free_list;
+	u32 insn_processed;		/* instructions simulated so far */
+	u32 total_states;		/* states added to explored_states */
+	u32 cur_states;			/* of those, states still searched */
+	u32 peak_states;		/* maximum of cur_states */
+	u32 peak_mem;			/* maximum bytes of states held */
 };
 
 int bpf_analyzer(struct bpf_prog *prog, const struct bpf_ext_analyzer_ops *ops,
@@ -18,6 +18,7 @@
 #include <linux/percpu-rwsem.h>
 #include <linux/workqueue.h>
 #include <linux/bpf-cgroup.h>
+#include <linux/psi_types.h>
 
 #ifdef CONFIG_CGROUPS
 
@@ -28,6 +29,7 @@ struct cgroup_taskset;
 struct kernfs_node;
 struct kernfs_ops;
 struct kernfs_open_file;
+struct poll_table_struct;
 struct seq_file;
 
 #define MAX_CGROUP_TYPE_NAMELEN 32
@@ -351,6 +353,9 @@ struct cgroup {
 	/* used to store eBPF programs */
 	struct cgroup_bpf bpf;
 
+	/* used to track pressure stalls */
+	struct psi_group psi;
+
 	/* ids of the ancestors at each level including self */
 	int ancestor_ids[];
 };
@@ -438,6 +443,13 @@ struct cftype {
 	int (*open)(struct kernfs_open_file *of);
 	void (*release)(struct kernfs_open_file *of);
 
+	/*
+	 * poll() is optional; files without it report changes through
+	 * cgroup_file_notify() like any other kernfs file.
+	 */
+	unsigned int (*poll)(struct kernfs_open_file *of,
+			     struct poll_table_struct *pt);
+
 	/*
 	 * read_u64() is a shortcut for the common case of returning a
 	 * single integer. Use it in place of read()
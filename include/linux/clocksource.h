@@ -119,6 +119,12 @@ struct clocksource {
 #define CLOCK_SOURCE_UNSTABLE			0x40
 #define CLOCK_SOURCE_SUSPEND_NONSTOP		0x80
 #define CLOCK_SOURCE_RESELECT			0x100
+/*
+ * read() returns the architected counter, which the fast timekeeper
+ * reads inline with arch_clocksource_counter_read() when the
+ * architecture defines ARCH_HAS_CLOCKSOURCE_COUNTER.
+ */
+#define CLOCK_SOURCE_ARCH_COUNTER		0x200
 
 /* simplify initialization of mask field */
 #define CLOCKSOURCE_MASK(bits) GENMASK_ULL((bits) - 1, 0)
@@ -49,6 +49,8 @@ struct pt_regs;
  * @request_mutex:	mutex to protect request/free before locking desc->lock
  * @dir:		/proc/irq/ procfs entry
  * @debugfs_file:	dentry for the debugfs file
+ * @hardirq_time:	time spent in the hard interrupt handlers in ns
+ * @thread_time:	time spent in the threaded handlers in ns
  * @name:		flow handler name for /proc/interrupts output
  */
 struct irq_desc {
@@ -93,6 +95,8 @@ struct irq_desc {
 #endif
 #ifdef CONFIG_GENERIC_IRQ_DEBUGFS
 	struct dentry		*debugfs_file;
+	atomic64_t		hardirq_time;
+	atomic64_t		thread_time;
 #endif
 #ifdef CONFIG_SPARSE_IRQ
 	struct rcu_head		rcu;
@@ -28,6 +28,7 @@
 #include <linux/stddef.h>
 #include <linux/mutex.h>
 #include <linux/timer.h>
+#include <linux/workqueue.h>
 #include <linux/slab.h>
 #include <linux/bit_spinlock.h>
 #include <crypto/hash.h>
@@ -70,6 +71,7 @@ extern void *jbd2_alloc(size_t size, gfp_t flags);
 extern void jbd2_free(void *ptr, size_t size);
 
 #define JBD2_MIN_JOURNAL_BLOCKS 1024
+#define JBD2_DEFAULT_FAST_COMMIT_BLOCKS 256
 
 #ifdef __KERNEL__
 
@@ -265,7 +267,9 @@ typedef struct journal_superblock_s
 /* 0x0050 */
 	__u8	s_checksum_type;	/* checksum type */
 	__u8	s_padding2[3];
-	__u32	s_padding[42];
+/* 0x0054 */
+	__be32	s_num_fc_blks;		/* Number of fast commit blocks */
+	__u32	s_padding[41];
 	__be32	s_checksum;		/* crc32c(superblock) */
 
 /* 0x0100 */
@@ -291,6 +295,7 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 #define JBD2_FEATURE_INCOMPAT_CSUM_V2		0x00000008
 #define JBD2_FEATURE_INCOMPAT_CSUM_V3		0x00000010
+#define JBD2_FEATURE_INCOMPAT_FAST_COMMIT	0x00000020
 
 /* See "journal feature predicate functions" below */
 
@@ -301,7 +306,8 @@ typedef struct journal_superblock_s
 					JBD2_FEATURE_INCOMPAT_64BIT | \
 					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
 					JBD2_FEATURE_INCOMPAT_CSUM_V2 | \
-					JBD2_FEATURE_INCOMPAT_CSUM_V3)
+					JBD2_FEATURE_INCOMPAT_CSUM_V3 | \
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
 
 #ifdef __KERNEL__
 
@@ -726,6 +732,30 @@ jbd2_time_diff(unsigned long start, unsigned long end)
 
 #define JBD2_NR_BATCH	64
 
+/* Upper bound of the credits a CPU claims from the running transaction */
+#define JBD2_CREDIT_BATCH	64
+
+/**
+ * struct jbd2_credit_cache - credits claimed by a CPU in advance
+ * @cc_tid: Transaction the credits were claimed from
+ * @cc_credits: Credits left, accounted in the t_outstanding_credits of
+ *     transaction @cc_tid but not used by any handle
+ *
+ * Only the owning CPU adds credits, with preemption disabled; the commit
+ * takes them back with atomic_xchg() when it locks the transaction.
+ */
+struct jbd2_credit_cache {
+	tid_t			cc_tid;
+	atomic_t		cc_credits;
+};
+
+/* Recovery passes, also handed to the fast commit replay callback */
+enum passtype {PASS_SCAN, PASS_REVOKE, PASS_REPLAY};
+
+/* Return values of the fast commit replay callback */
+#define JBD2_FC_REPLAY_STOP	0
+#define JBD2_FC_REPLAY_CONTINUE	1
+
 /**
  * struct journal_s - The journal_s type is the concrete type associated with
  *     journal_t.
@@ -749,6 +779,9 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_wait_updates: Wait queue to wait for updates to complete
  * @j_wait_reserved: Wait queue to wait for reserved buffer credits to drop
  * @j_checkpoint_mutex: Mutex for locking against concurrent checkpoints
+ * @j_checkpoint_work: Background checkpoint of the journal
+ * @j_chkpt_watermark: Percentage of the journal in use from which it is
+ *  checkpointed in the background, 0 to disable
  * @j_head: Journal head - identifies the first unused block in the journal
  * @j_tail: Journal tail - identifies the oldest still-used block in the
  *  journal.
@@ -776,6 +809,10 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_task: Pointer to the current commit thread for this journal
  * @j_max_transaction_buffers:  Maximum number of metadata buffers to allow in a
  *     single compound commit transaction
+ * @j_credit_cache: Per-CPU credits claimed from the running transaction in
+ *     advance of the handles started on that CPU
+ * @j_credit_batch: Number of credits claimed at once into @j_credit_cache,
+ *     0 to disable the per-CPU credits
  * @j_commit_interval: What is the maximum transaction lifetime before we begin
  *  a commit?
  * @j_commit_timer:  The timer used to wakeup the commit thread
@@ -786,6 +823,15 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_wbuf: array of buffer_heads for jbd2_journal_commit_transaction
  * @j_wbufsize: maximum number of buffer_heads allowed in j_wbuf, the
  *	number that will fit in j_blocksize
+ * @j_fc_first: The block number of the first fast commit block
+ * @j_fc_last: The block number one beyond the last fast commit block
+ * @j_fc_off: Number of fast commit blocks handed out since the last full
+ *	commit
+ * @j_fc_wbuf: array of buffer_heads of the fast commit blocks in flight
+ * @j_fc_wbufsize: number of fast commit blocks, 0 without fast commits
+ * @j_fc_wait: Wait queue for fast and full commits to wait for each other
+ * @j_fc_cleanup_callback: called after a fast or a full commit completes
+ * @j_fc_replay_callback: called for each fast commit block during recovery
  * @j_last_sync_writer: most recent pid which did a synchronous write
  * @j_history_lock: Protect the transactions statistics history
  * @j_proc_entry: procfs entry for the jbd statistics directory
@@ -871,6 +917,15 @@ struct journal_s
 	 * j_checkpoint_mutex.  [j_checkpoint_mutex]
 	 */
 	struct buffer_head	*j_chkpt_bhs[JBD2_NR_BATCH];
+
+	/* Background checkpoint, started past j_chkpt_watermark */
+	struct work_struct	j_checkpoint_work;
+
+	/*
+	 * Percentage of the journal in use from which checkpointing starts
+	 * in the background, 0 to disable.
+	 */
+	unsigned int		j_chkpt_watermark;
 	
 	/*
 	 * Journal head: identifies the first unused block in the journal.
@@ -967,6 +1022,16 @@ struct journal_s
 	 */
 	int			j_max_transaction_buffers;
 
+	/*
+	 * Credits of the running transaction handed out to handles without
+	 * touching t_outstanding_credits, returned to the transaction when
+	 * the commit locks it.
+	 */
+	struct jbd2_credit_cache __percpu *j_credit_cache;
+
+	/* Number of credits a CPU claims from the transaction at once */
+	int			j_credit_batch;
+
 	/*
 	 * What is the maximum transaction lifetime before we begin a commit?
 	 */
@@ -989,6 +1054,35 @@ struct journal_s
 	struct buffer_head	**j_wbuf;
 	int			j_wbufsize;
 
+	/*
+	 * Fast commit area at the end of the journal, past j_last.  Fast
+	 * commits log compact filesystem-defined records of the running
+	 * transaction there, and a full commit makes them obsolete.
+	 */
+	unsigned long		j_fc_first;
+	unsigned long		j_fc_last;
+	unsigned long		j_fc_off;
+	struct buffer_head	**j_fc_wbuf;
+	int			j_fc_wbufsize;
+	wait_queue_head_t	j_fc_wait;
+
+	/* Called after a fast commit (@full == 0) or a full commit */
+	void			(*j_fc_cleanup_callback)(journal_t *journal,
+							 int full);
+
+	/*
+	 * Called in the scan and replay passes of recovery for each fast
+	 * commit block, at @off from j_fc_first, until it returns
+	 * JBD2_FC_REPLAY_STOP or an error.  @expected_tid is the first
+	 * transaction not found fully committed in the log; records of
+	 * other transactions are stale.
+	 */
+	int			(*j_fc_replay_callback)(journal_t *journal,
+							struct buffer_head *bh,
+							enum passtype pass,
+							int off,
+							tid_t expected_tid);
+
 	/*
 	 * this is the pid of hte last person to run a synchronous operation
 	 * through the journal
@@ -1116,6 +1210,7 @@ JBD2_FEATURE_INCOMPAT_FUNCS(64bit,		64BIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(async_commit,	ASYNC_COMMIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum2,		CSUM_V2)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
+JBD2_FEATURE_INCOMPAT_FUNCS(fast_commit,	FAST_COMMIT)
 
 /*
  * Journal flag definitions
@@ -1130,6 +1225,8 @@ JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
 						 * data write error in ordered
 						 * mode */
 #define JBD2_REC_ERR	0x080	/* The errno in the sb has been recorded */
+#define JBD2_FAST_COMMIT_ONGOING	0x100	/* Fast commit is ongoing */
+#define JBD2_FULL_COMMIT_ONGOING	0x200	/* Full commit is ongoing */
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1215,6 +1312,9 @@ extern void jbd2_journal_destroy_transaction_cache(void);
 extern int  jbd2_journal_init_transaction_cache(void);
 extern void jbd2_journal_free_transaction(transaction_t *);
 
+/* Per-CPU transaction credits */
+extern void jbd2_journal_reclaim_credits(journal_t *, transaction_t *);
+
 /*
  * Journal locking.
  *
@@ -1369,8 +1469,28 @@ int jbd2_journal_start_commit(journal_t *journal, tid_t *tid);
 int jbd2_log_wait_commit(journal_t *journal, tid_t tid);
 int jbd2_complete_transaction(journal_t *journal, tid_t tid);
 int jbd2_log_do_checkpoint(journal_t *journal);
+void jbd2_log_start_checkpoint(journal_t *journal);
+void jbd2_checkpoint_work(struct work_struct *work);
+extern struct workqueue_struct *jbd2_checkpoint_wq;
 int jbd2_trans_will_send_data_barrier(journal_t *journal, tid_t tid);
 
+/* Fast commits */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid);
+int jbd2_fc_end_commit(journal_t *journal);
+int jbd2_fc_end_commit_fallback(journal_t *journal);
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out);
+void jbd2_fc_submit_buf(journal_t *journal, struct buffer_head *bh,
+			bool is_tail);
+int jbd2_fc_wait_bufs(journal_t *journal, int num_blks);
+void jbd2_fc_release_bufs(journal_t *journal);
+
+static inline int jbd2_journal_get_num_fc_blks(journal_superblock_t *jsb)
+{
+	int num_fc_blocks = be32_to_cpu(jsb->s_num_fc_blks);
+
+	return num_fc_blocks ? num_fc_blocks : JBD2_DEFAULT_FAST_COMMIT_BLOCKS;
+}
+
 void __jbd2_log_wait_for_space(journal_t *journal);
 extern void __jbd2_journal_drop_transaction(journal_t *, transaction_t *);
 extern int jbd2_cleanup_journal_tail(journal_t *);
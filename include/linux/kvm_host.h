@@ -214,6 +214,24 @@ struct kvm_mmio_fragment {
 	unsigned len;
 };
 
+struct kvm_dirty_ring {
+	u32 dirty_index;	/* next entry the vcpu fills */
+	u32 reset_index;	/* next entry userspace hands back */
+	u32 size;		/* in entries, a power of two */
+	struct kvm_dirty_gfn *gfns;
+};
+
+#define KVM_HALT_POLL_HIST_BUCKETS	12
+
+/* Per-vcpu halt polling outcomes, log2 buckets of polled microseconds */
+struct kvm_halt_poll_hist {
+	u64 success[KVM_HALT_POLL_HIST_BUCKETS];
+	u64 wasted[KVM_HALT_POLL_HIST_BUCKETS];
+	u64 success_ns;
+	u64 wasted_ns;
+	u64 skipped;		/* polls not started because of host load */
+};
+
 struct kvm_vcpu {
 	struct kvm *kvm;
 #ifdef CONFIG_PREEMPT_NOTIFIERS
@@ -239,6 +257,8 @@ struct kvm_vcpu {
 	sigset_t sigset;
 	struct kvm_vcpu_stat stat;
 	unsigned int halt_poll_ns;
+	struct kvm_halt_poll_hist halt_poll_hist;
+	struct kvm_dirty_ring dirty_ring;
 	bool valid_wakeup;
 
 #ifdef CONFIG_HAS_IOMEM
@@ -401,6 +421,7 @@ struct kvm {
 	 */
 	atomic_t online_vcpus;
 	int created_vcpus;
+	u32 dirty_ring_size;	/* bytes per vcpu ring, 0 if not in use */
 	int last_boosted_vcpu;
 	struct list_head vm_list;
 	struct mutex lock;
@@ -532,6 +553,8 @@ static inline int kvm_vcpu_get_idx(struct kvm_vcpu *vcpu)
 int kvm_vcpu_init(struct kvm_vcpu *vcpu, struct kvm *kvm, unsigned id);
 void kvm_vcpu_uninit(struct kvm_vcpu *vcpu);
 
+struct kvm_vcpu *kvm_get_running_vcpu(void);
+
 int __must_check vcpu_load(struct kvm_vcpu *vcpu);
 void vcpu_put(struct kvm_vcpu *vcpu);
 
@@ -724,6 +747,8 @@ void kvm_put_guest_fpu(struct kvm_vcpu *vcpu);
 
 void kvm_flush_remote_tlbs(struct kvm *kvm);
 void kvm_reload_remote_mmus(struct kvm *kvm);
+bool kvm_make_vcpus_request_mask(struct kvm *kvm, unsigned int req,
+				 unsigned long *vcpu_bitmap, cpumask_var_t tmp);
 bool kvm_make_all_cpus_request(struct kvm *kvm, unsigned int req);
 
 long kvm_arch_dev_ioctl(struct file *filp,
@@ -1147,6 +1172,7 @@ extern bool kvm_rebooting;
 extern unsigned int halt_poll_ns;
 extern unsigned int halt_poll_ns_grow;
 extern unsigned int halt_poll_ns_shrink;
+extern bool halt_poll_load_aware;
 
 struct kvm_device {
 	struct kvm_device_ops *ops;
@@ -1142,6 +1142,11 @@ struct xfrmdev_ops {
  * int (*ndo_xdp_xmit)(struct net_device *dev, struct xdp_buff *xdp);
  *	This function is used to submit a XDP packet for transmit on a
  *	netdevice.
+ * int (*ndo_xdp_xmit_bulk)(struct net_device *dev, struct xdp_buff *frames,
+ *			    int n);
+ *	Like ndo_xdp_xmit, for n packets at once, so that the driver can
+ *	queue them all before a single ndo_xdp_flush. Returns the number of
+ *	packets taken from the start of the array; the caller frees the rest.
  * void (*ndo_xdp_flush)(struct net_device *dev);
  *	This function is used to inform the driver to flush a paticular
  *	xpd tx queue. Must be called on same CPU as xdp_xmit.
@@ -1331,6 +1336,9 @@ struct net_device_ops {
 					   struct netdev_xdp *xdp);
 	int			(*ndo_xdp_xmit)(struct net_device *dev,
 						struct xdp_buff *xdp);
+	int			(*ndo_xdp_xmit_bulk)(struct net_device *dev,
+						     struct xdp_buff *frames,
+						     int n);
 	void			(*ndo_xdp_flush)(struct net_device *dev);
 };
 
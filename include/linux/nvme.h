@@ -690,6 +690,7 @@ enum {
 	NVME_FWACT_REPL		= (0 << 3),
 	NVME_FWACT_REPL_ACTV	= (1 << 3),
 	NVME_FWACT_ACTV		= (2 << 3),
+	NVME_IRQ_CONFIG_CD	= (1 << 16),
 };
 
 struct nvme_identify {
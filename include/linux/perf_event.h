@@ -794,6 +794,10 @@ struct perf_cpu_context {
 	ktime_t				hrtimer_interval;
 	unsigned int			hrtimer_active;
 
+	/* Multiplexing cost, see perf_rotate_context() */
+	u64				mux_rotations;
+	u64				mux_rotation_time;
+
 #ifdef CONFIG_CGROUP_PERF
 	struct perf_cgroup		*cgrp;
 	struct list_head		cgrp_cpuctx_entry;
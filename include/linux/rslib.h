@@ -29,6 +29,8 @@
  * @alpha_to:	log lookup table
  * @index_of:	Antilog lookup table
  * @genpoly:	Generator polynomial
+ * @enc_tab:	Parity update for each feedback symbol, NULL if too large
+ * @syn_tab:	Each symbol multiplied by each syndrome root, NULL if too large
  * @nroots:	Number of generator roots = number of parity symbols
  * @fcr:	First consecutive root, index form
  * @prim:	Primitive element, index form
@@ -44,6 +46,8 @@ struct rs_control {
 	uint16_t	*alpha_to;
 	uint16_t	*index_of;
 	uint16_t	*genpoly;
+	uint16_t	*enc_tab;
+	uint16_t	*syn_tab;
 	int 		nroots;
 	int 		fcr;
 	int 		prim;
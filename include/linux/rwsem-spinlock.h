@@ -24,6 +24,9 @@ struct rw_semaphore {
 	__s32			count;
 	raw_spinlock_t		wait_lock;
 	struct list_head	wait_list;
+#ifdef CONFIG_RWSEM_READER_BIAS
+	struct rwsem_reader_bias *bias;
+#endif
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	struct lockdep_map dep_map;
 #endif
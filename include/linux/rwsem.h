@@ -21,6 +21,24 @@
 
 struct rw_semaphore;
 
+#ifdef CONFIG_RWSEM_READER_BIAS
+struct rwsem_reader_bias;
+
+extern int rwsem_enable_reader_bias(struct rw_semaphore *sem);
+extern void rwsem_free_reader_bias(struct rw_semaphore *sem);
+extern int rwsem_bias_is_locked(struct rw_semaphore *sem);
+#else
+static inline int rwsem_enable_reader_bias(struct rw_semaphore *sem)
+{
+	return 0;
+}
+static inline void rwsem_free_reader_bias(struct rw_semaphore *sem) { }
+static inline int rwsem_bias_is_locked(struct rw_semaphore *sem)
+{
+	return 0;
+}
+#endif
+
 #ifdef CONFIG_RWSEM_GENERIC_SPINLOCK
 #include <linux/rwsem-spinlock.h> /* use a generic implementation */
 #define __RWSEM_INIT_COUNT(name)	.count = RWSEM_UNLOCKED_VALUE
@@ -38,6 +56,10 @@ struct rw_semaphore {
 	 */
 	struct task_struct *owner;
 #endif
+#ifdef CONFIG_RWSEM_READER_BIAS
+	/* Per-CPU readers, once rwsem_enable_reader_bias() is called */
+	struct rwsem_reader_bias *bias;
+#endif
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	struct lockdep_map	dep_map;
 #endif
@@ -55,7 +77,7 @@ extern struct rw_semaphore *rwsem_downgrade_wake(struct rw_semaphore *sem);
 /* In all implementations count != 0 means locked */
 static inline int rwsem_is_locked(struct rw_semaphore *sem)
 {
-	return atomic_long_read(&sem->count) != 0;
+	return atomic_long_read(&sem->count) != 0 || rwsem_bias_is_locked(sem);
 }
 
 #define __RWSEM_INIT_COUNT(name)	.count = ATOMIC_LONG_INIT(RWSEM_UNLOCKED_VALUE)
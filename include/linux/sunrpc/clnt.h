@@ -123,8 +123,12 @@ struct rpc_create_args {
 	unsigned long		flags;
 	char			*client_name;
 	struct svc_xprt		*bc_xprt;	/* NFSv4.1 backchannel */
+	unsigned int		nconnect;	/* connections to the server */
 };
 
+/* Upper bound on rpc_create_args.nconnect */
+#define RPC_MAX_NCONNECT	16
+
 struct rpc_add_xprt_test {
 	int (*add_xprt_test)(struct rpc_clnt *,
 		struct rpc_xprt *,
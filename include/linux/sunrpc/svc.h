@@ -18,11 +18,13 @@
 #include <linux/sunrpc/svcauth.h>
 #include <linux/wait.h>
 #include <linux/mm.h>
+#include <linux/llist.h>
+#include <linux/idr.h>
 
 /* statistics for svc_pool structures */
 struct svc_pool_stats {
 	atomic_long_t	packets;
-	unsigned long	sockets_queued;
+	atomic_long_t	sockets_queued;
 	atomic_long_t	threads_woken;
 	atomic_long_t	threads_timedout;
 };
@@ -36,13 +38,26 @@ struct svc_pool_stats {
  * services that can benefit from it (i.e. nfs but not lockd) will
  * have one pool per NUMA node.  This optimisation reduces cross-
  * node traffic on multi-node NUMA NFS servers.
+ *
+ * Transports are queued without the pool lock: enqueuers push onto
+ * sp_xprts, and the thread that dequeues moves that batch, oldest first,
+ * onto sp_ready under sp_lock.  Idle threads are found through
+ * sp_idle_map rather than by walking sp_all_threads.
  */
+#define RPCSVC_MAXPOOLTHREADS	4096
+
 struct svc_pool {
 	unsigned int		sp_id;	    	/* pool id; also node id on NUMA */
-	spinlock_t		sp_lock;	/* protects all fields */
-	struct list_head	sp_sockets;	/* pending sockets */
+	spinlock_t		sp_lock;	/* protects all fields below
+						 * but sp_xprts and sp_idle_map */
+	struct llist_head	sp_xprts;	/* newly queued transports */
+	struct llist_node	*sp_ready;	/* queued transports, oldest
+						 * first */
 	unsigned int		sp_nrthreads;	/* # of threads in pool */
 	struct list_head	sp_all_threads;	/* all server threads */
+	struct idr		sp_thread_idr;	/* rq_thread_id to svc_rqst */
+	unsigned long		*sp_idle_map;	/* idle threads, by
+						 * rq_thread_id */
 	struct svc_pool_stats	sp_stats;	/* statistics on pool operation */
 #define	SP_TASK_PENDING		(0)		/* still work to do even if no
 						 * xprt is queued. */
@@ -237,6 +252,7 @@ struct svc_rqst {
 
 	struct svc_serv *	rq_server;	/* RPC service definition */
 	struct svc_pool *	rq_pool;	/* thread pool */
+	unsigned int		rq_thread_id;	/* bit in sp_idle_map */
 	const struct svc_procedure *rq_procinfo;/* procedure info */
 	struct auth_ops *	rq_authop;	/* authentication flavour */
 	struct svc_cred		rq_cred;	/* auth info */
@@ -207,6 +207,8 @@ struct rpc_xprt {
 	 * Multipath
 	 */
 	struct list_head	xprt_switch;
+	atomic_long_t		queuelen;	/* tasks bound to this
+						   transport */
 
 	/*
 	 * Connection of transports
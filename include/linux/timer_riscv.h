@@ -25,11 +25,20 @@
  * inherently a per-cpu resource, these callbacks perform operations on the
  * current hart.  There is guaranteed to be exactly one timer per hart on all
  * RISC-V systems.
+ *
+ * stop_event() pushes the comparator out of reach, so that a hart whose
+ * tick has been stopped by NO_HZ isn't woken by the last event it armed.
+ * The timers keep counting in WFI, so no broadcast device is needed.
+ *
+ * When the ISA string advertises Sstc, next_event and stop_event are ignored
+ * and the comparator is written directly from S-mode instead of through the
+ * SBI.
  */
 void timer_riscv_init(int cpu_id,
 		      unsigned long riscv_timebase,
 		      unsigned long long (*rdtime)(struct clocksource *),
-		      int (*next_event)(unsigned long, struct clock_event_device *));
+		      int (*next_event)(unsigned long, struct clock_event_device *),
+		      int (*stop_event)(struct clock_event_device *));
 
 /*
  * Looks up the clocksource or clock_even_device that cooresponds the given
@@ -50,6 +50,12 @@ int virtqueue_add_inbuf_ctx(struct virtqueue *vq,
 			    void *ctx,
 			    gfp_t gfp);
 
+int virtqueue_add_inbufs_ctx(struct virtqueue *vq,
+			     struct scatterlist sg[], unsigned int num,
+			     void *data[],
+			     void *ctx[],
+			     gfp_t gfp);
+
 int virtqueue_add_sgs(struct virtqueue *vq,
 		      struct scatterlist *sgs[],
 		      unsigned int out_sgs,
@@ -68,6 +74,13 @@ void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len);
 void *virtqueue_get_buf_ctx(struct virtqueue *vq, unsigned int *len,
 			    void **ctx);
 
+unsigned int virtqueue_get_bufs(struct virtqueue *vq, void *bufs[],
+				unsigned int lens[], unsigned int max);
+
+unsigned int virtqueue_get_bufs_ctx(struct virtqueue *vq, void *bufs[],
+				    unsigned int lens[], void *ctxs[],
+				    unsigned int max);
+
 void virtqueue_disable_cb(struct virtqueue *vq);
 
 bool virtqueue_enable_cb(struct virtqueue *vq);
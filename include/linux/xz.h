@@ -233,6 +233,31 @@ XZ_EXTERN void xz_dec_reset(struct xz_dec *s);
  */
 XZ_EXTERN void xz_dec_end(struct xz_dec *s);
 
+#if defined(__KERNEL__) && !defined(XZ_PREBOOT)
+/**
+ * xz_dec_mt() - Decode a multi-Block .xz Stream using all online CPUs
+ * @in:         Beginning of the .xz Stream. Other data may follow it.
+ * @in_size:    Number of bytes available at @in
+ * @out:        Output buffer, or NULL to only get the uncompressed size
+ * @in_used:    On success, set to the size of the Stream
+ * @out_size:   Size of @out. Set to the uncompressed size of the Stream
+ *              when XZ_STREAM_END or XZ_BUF_ERROR is returned.
+ *
+ * Streams written by multi-threaded encoders (xz -T) consist of several
+ * independent Blocks whose headers record both sizes. Such Blocks are
+ * decoded in parallel, directly into their place in @out.
+ *
+ * XZ_OPTIONS_ERROR means the Stream cannot be split: it has a single
+ * Block, a Block Header without sizes, or a Check other than CRC32 or
+ * none. The caller then decodes it with xz_dec_run() as usual, which
+ * also reports any format error properly. XZ_BUF_ERROR means @out is
+ * NULL or too small. The other return values are as for xz_dec_run()
+ * in single-call mode.
+ */
+extern enum xz_ret xz_dec_mt(const uint8_t *in, size_t in_size, uint8_t *out,
+			     size_t *in_used, size_t *out_size);
+#endif
+
 /*
  * Standalone build (userspace build or in-kernel build for boot time use)
  * needs a CRC32 implementation. For normal in-kernel use, kernel's own
@@ -111,6 +111,7 @@ struct kcm_psock {
 	struct list_head psock_ready_list;
 	struct bpf_prog *bpf_prog;
 	struct kcm_sock *rx_kcm;
+	bool rx_wake;	/* rx_kcm has queued messages but no wakeup yet */
 	unsigned long long saved_rx_bytes;
 	unsigned long long saved_rx_msgs;
 	struct sk_buff *ready_rx_msg;
@@ -43,6 +43,8 @@ struct netns_xfrm {
 	unsigned int		state_hmask;
 	unsigned int		state_num;
 	struct work_struct	state_hash_work;
+	/* Last SA found by xfrm_input_state_lookup() on each CPU */
+	struct xfrm_state * __percpu *state_cache_input;
 
 	struct list_head	policy_all;
 	struct hlist_head	*policy_byidx;
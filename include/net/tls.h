@@ -35,6 +35,7 @@
 #define _TLS_OFFLOAD_H
 
 #include <linux/types.h>
+#include <linux/completion.h>
 
 #include <uapi/linux/tls.h>
 
@@ -53,6 +54,12 @@
 
 struct tls_sw_context {
 	struct crypto_aead *aead_send;
+	struct aead_request *aead_req;
+
+	/* Completion of an asynchronous cipher */
+	struct completion async_done;
+	int async_err;
+	bool async_pending;
 
 	/* Sending context */
 	char aad_space[TLS_AAD_SPACE_SIZE];
@@ -0,0 +1,72 @@
+/*
+ * pidstats.h - fixed-layout per-process records read from /proc/pidstats
+ *
+ * A read() returns as many whole records as fit in the buffer, one per
+ * thread group in ascending pid order.  The file position is the pid to
+ * continue from, so pread() at a pid starts the walk there and lseek(fd,
+ * 0, SEEK_SET) rewinds it.  Writing a __u64 mask of PIDSTATS_* groups
+ * restricts which groups are filled in; the fields of unselected groups,
+ * and of groups the reader may not see, are zero and their bit is clear
+ * in the record's mask.
+ *
+ * New fields are only ever appended; rec_size tells the reader how long
+ * each record is.
+ */
+#ifndef _UAPI_LINUX_PIDSTATS_H
+#define _UAPI_LINUX_PIDSTATS_H
+
+#include <linux/types.h>
+
+#define PIDSTATS_CPU		(1ULL << 0)	/* times, faults, switches */
+#define PIDSTATS_MEM		(1ULL << 1)	/* mm counters */
+#define PIDSTATS_IO		(1ULL << 2)	/* I/O accounting */
+#define PIDSTATS_SCHED		(1ULL << 3)	/* scheduler statistics */
+#define PIDSTATS_ALL		(PIDSTATS_CPU | PIDSTATS_MEM | \
+				 PIDSTATS_IO | PIDSTATS_SCHED)
+
+#define PIDSTATS_COMM_LEN	16
+
+struct pidstats_record {
+	__u32	rec_size;		/* sizeof(struct pidstats_record) */
+	__u32	pid;			/* tgid in the reader's namespace */
+	__u32	ppid;
+	__u32	uid;
+	__u32	gid;
+	__u32	nr_threads;
+	__u8	state;			/* as in /proc/PID/stat */
+	__u8	__pad[7];
+	__u64	mask;			/* PIDSTATS_* groups present */
+	__u64	start_time_ns;		/* since boot */
+	char	comm[PIDSTATS_COMM_LEN];
+
+	/* PIDSTATS_CPU */
+	__u64	utime_ns;
+	__u64	stime_ns;
+	__u64	min_flt;
+	__u64	maj_flt;
+	__u64	nvcsw;
+	__u64	nivcsw;
+
+	/* PIDSTATS_MEM, in pages */
+	__u64	vm_size;
+	__u64	rss_anon;
+	__u64	rss_file;
+	__u64	rss_shmem;
+	__u64	swap;
+
+	/* PIDSTATS_IO */
+	__u64	rchar;
+	__u64	wchar;
+	__u64	syscr;
+	__u64	syscw;
+	__u64	read_bytes;
+	__u64	write_bytes;
+	__u64	cancelled_write_bytes;
+
+	/* PIDSTATS_SCHED */
+	__u64	sum_exec_runtime_ns;
+	__u64	run_delay_ns;
+	__u64	pcount;
+};
+
+#endif /* _UAPI_LINUX_PIDSTATS_H */
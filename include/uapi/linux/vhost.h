@@ -143,6 +143,16 @@ struct vhost_memory {
 #define VHOST_SET_VRING_ENDIAN _IOW(VHOST_VIRTIO, 0x13, struct vhost_vring_state)
 #define VHOST_GET_VRING_ENDIAN _IOW(VHOST_VIRTIO, 0x14, struct vhost_vring_state)
 
+/* Serve the ring with worker thread num, creating the thread if needed.
+ * Worker 0 is the device's default one; there can be as many workers as
+ * rings.  The ring must not be running (no backend attached). */
+#define VHOST_SET_VRING_WORKER _IOW(VHOST_VIRTIO, 0x15, struct vhost_vring_state)
+#define VHOST_GET_VRING_WORKER _IOWR(VHOST_VIRTIO, 0x15, struct vhost_vring_state)
+/* Run worker thread index on CPU num only, or on any CPU the owner may run
+ * on for VHOST_WORKER_CPU_ANY.  The CPU must be one the owner may use. */
+#define VHOST_SET_WORKER_CPU _IOW(VHOST_VIRTIO, 0x16, struct vhost_vring_state)
+#define VHOST_WORKER_CPU_ANY ((unsigned int)-1)
+
 /* The following ioctls use eventfd file descriptors to signal and poll
  * for events. */
 
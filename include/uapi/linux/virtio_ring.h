@@ -53,6 +53,30 @@
  * optimization.  */
 #define VRING_AVAIL_F_NO_INTERRUPT	1
 
+/* Enable events in the packed ring event suppression structure. */
+#define VRING_PACKED_EVENT_FLAG_ENABLE	0x0
+/* Disable events in the packed ring event suppression structure. */
+#define VRING_PACKED_EVENT_FLAG_DISABLE	0x1
+/*
+ * Enable events for a specific descriptor in the packed ring event
+ * suppression structure (as specified by the descriptor offset and wrap
+ * counter).  Only valid if VIRTIO_RING_F_EVENT_IDX has been negotiated.
+ */
+#define VRING_PACKED_EVENT_FLAG_DESC	0x2
+
+/*
+ * Wrap counter bit shift in the off_wrap field of the packed ring event
+ * suppression structure.
+ */
+#define VRING_PACKED_EVENT_F_WRAP_CTR	15
+
+/*
+ * Mark a packed ring descriptor as available or used: these bits are
+ * shifts in the descriptor flags and are compared to the wrap counters.
+ */
+#define VRING_PACKED_DESC_F_AVAIL	7
+#define VRING_PACKED_DESC_F_USED	15
+
 /* We support indirect buffer descriptors */
 #define VIRTIO_RING_F_INDIRECT_DESC	28
 
@@ -104,6 +128,26 @@ struct vring {
 	struct vring_used *used;
 };
 
+/* Packed ring descriptors: 16 bytes, always little endian. */
+struct vring_packed_desc {
+	/* Buffer address (guest-physical). */
+	__le64 addr;
+	/* Buffer length. */
+	__le32 len;
+	/* Buffer ID. */
+	__le16 id;
+	/* The flags depending on descriptor type. */
+	__le16 flags;
+};
+
+/* Packed ring event suppression structure, one for each side. */
+struct vring_packed_desc_event {
+	/* Descriptor ring change event offset and wrap counter. */
+	__le16 off_wrap;
+	/* Descriptor ring change event flags. */
+	__le16 flags;
+};
+
 /* Alignment requirements for vring elements.
  * When using pre-virtio 1.0 layout, these fall out naturally.
  */
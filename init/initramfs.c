@@ -11,6 +11,7 @@
 #include <linux/init.h>
 #include <linux/fs.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/types.h>
 #include <linux/fcntl.h>
 #include <linux/delay.h>
@@ -18,6 +19,8 @@
 #include <linux/dirent.h>
 #include <linux/syscalls.h>
 #include <linux/utime.h>
+#include <linux/async.h>
+#include <linux/export.h>
 #include <linux/file.h>
 
 static ssize_t __init xwrite(int fd, const char *p, size_t count)
@@ -447,6 +450,45 @@ static unsigned long my_inptr; /* index of next byte to be processed in inbuf */
 
 #include <linux/decompress/generic.h>
 
+#if IS_BUILTIN(CONFIG_XZ_DEC)
+#include <linux/xz.h>
+
+/*
+ * A multi-Block .xz archive (xz -T) is decoded on all CPUs into a
+ * temporary buffer and extracted from there, at the price of holding the
+ * uncompressed archive in memory once more while it is unpacked.
+ * Returns false if the archive can't be split; the caller then uses the
+ * streaming decompressor, which also reports errors properly.
+ */
+static bool __init unpack_xz_mt(char *buf, unsigned long len)
+{
+	size_t in_used, out_size = 0;
+	enum xz_ret ret;
+	u8 *out;
+
+	if (xz_dec_mt(buf, len, NULL, &in_used, &out_size) != XZ_BUF_ERROR)
+		return false;
+
+	out = vmalloc(out_size);
+	if (!out)
+		return false;
+
+	ret = xz_dec_mt(buf, len, out, &in_used, &out_size);
+	if (ret == XZ_STREAM_END) {
+		flush_buffer(out, out_size);
+		my_inptr = in_used;
+	}
+	vfree(out);
+
+	return ret == XZ_STREAM_END;
+}
+#else
+static inline bool unpack_xz_mt(char *buf, unsigned long len)
+{
+	return false;
+}
+#endif
+
 static char * __init unpack_to_rootfs(char *buf, unsigned long len)
 {
 	long written;
@@ -483,8 +525,12 @@ static char * __init unpack_to_rootfs(char *buf, unsigned long len)
 		decompress = decompress_method(buf, len, &compress_name);
 		pr_debug("Detected %s compressed data\n", compress_name);
 		if (decompress) {
-			int res = decompress(buf, len, NULL, flush_buffer, NULL,
-				   &my_inptr, error);
+			int res = 0;
+
+			if (strcmp(compress_name, "xz") ||
+			    !unpack_xz_mt(buf, len))
+				res = decompress(buf, len, NULL, flush_buffer,
+						 NULL, &my_inptr, error);
 			if (res)
 				error("decompressor failed");
 		} else if (compress_name) {
@@ -606,7 +652,15 @@ static void __init clean_rootfs(void)
 }
 #endif
 
-static int __init populate_rootfs(void)
+static bool __initdata initramfs_async = true;
+static int __init initramfs_async_setup(char *str)
+{
+	strtobool(str, &initramfs_async);
+	return 1;
+}
+__setup("initramfs_async=", initramfs_async_setup);
+
+static void __init do_populate_rootfs(void *unused, async_cookie_t cookie)
 {
 	/* Load the built in initramfs */
 	char *err = unpack_to_rootfs(__initramfs_start, __initramfs_size);
@@ -658,7 +712,43 @@ static int __init populate_rootfs(void)
 	 * us a chance to load before device_initcalls.
 	 */
 	load_default_modules();
+}
+
+static ASYNC_DOMAIN_EXCLUSIVE(initramfs_domain);
+static async_cookie_t initramfs_cookie;
+
+/*
+ * Wait until the initramfs has been unpacked into rootfs.  Anything that
+ * looks up files in rootfs after rootfs_initcall - the firmware loader,
+ * the exec of the first userspace process - must call this first.
+ */
+void wait_for_initramfs(void)
+{
+	if (!initramfs_cookie) {
+		/*
+		 * Something before rootfs_initcall wants files from rootfs,
+		 * which is empty at this point anyway.  Don't deadlock on a
+		 * cookie that doesn't exist yet; let the lookup fail.
+		 */
+		pr_warn_once("wait_for_initramfs() called before rootfs_initcalls\n");
+		return;
+	}
+	async_synchronize_cookie_domain(initramfs_cookie + 1, &initramfs_domain);
+}
+EXPORT_SYMBOL_GPL(wait_for_initramfs);
 
+/*
+ * Decompressing and extracting a large initramfs takes a good share of
+ * boot time.  By default it runs as async work on another CPU so that
+ * device initcalls and driver probing proceed meanwhile; booting with
+ * initramfs_async=0 unpacks it synchronously as before.
+ */
+static int __init populate_rootfs(void)
+{
+	initramfs_cookie = async_schedule_domain(do_populate_rootfs, NULL,
+						 &initramfs_domain);
+	if (!initramfs_async)
+		wait_for_initramfs();
 	return 0;
 }
 rootfs_initcall(populate_rootfs);
@@ -1466,20 +1466,32 @@ static int semctl_main(struct ipc_namespace *ns, int semid, int semnum,
 	if (semnum < 0 || semnum >= nsems)
 		goto out_rcu_wakeup;
 
+	/*
+	 * A single value needs no lock: RCU keeps the array alive, and the
+	 * result is as good as one read an instant earlier under the lock.
+	 * Taking the global lock here would force every concurrent semop()
+	 * on the array into complex mode.
+	 */
+	if (cmd == GETVAL || cmd == GETPID) {
+		if (!ipc_valid_object(&sma->sem_perm)) {
+			err = -EIDRM;
+			goto out_rcu_wakeup;
+		}
+		curr = &sma->sems[semnum];
+		if (cmd == GETVAL)
+			err = READ_ONCE(curr->semval);
+		else
+			err = READ_ONCE(curr->sempid);
+		goto out_rcu_wakeup;
+	}
+
 	sem_lock(sma, NULL, -1);
 	if (!ipc_valid_object(&sma->sem_perm)) {
 		err = -EIDRM;
 		goto out_unlock;
 	}
-	curr = &sma->sems[semnum];
 
 	switch (cmd) {
-	case GETVAL:
-		err = curr->semval;
-		goto out_unlock;
-	case GETPID:
-		err = curr->sempid;
-		goto out_unlock;
 	case GETNCNT:
 		err = count_semcnt(sma, semnum, 0);
 		goto out_unlock;
@@ -14,11 +14,36 @@
 #include <linux/err.h>
 #include <linux/slab.h>
 #include <linux/mm.h>
+#include <linux/vmalloc.h>
 #include <linux/filter.h>
 #include <linux/perf_event.h>
 
 #include "map_in_map.h"
 
+/* A BPF_F_MMAPABLE array lives in a vmalloc_user() area; the header takes
+ * the first page(s) so that the values start page aligned, and only the
+ * values are mapped into userspace.  A per-CPU array keeps its values in
+ * the same area, CPU by CPU, instead of in per-CPU allocations.
+ */
+static bool array_map_mmapable(const struct bpf_array *array)
+{
+	return array->map.map_flags & BPF_F_MMAPABLE;
+}
+
+static void *array_map_vmalloc_addr(struct bpf_array *array)
+{
+	return (void *)round_down((unsigned long)array, PAGE_SIZE);
+}
+
+static void *array_percpu_elem(struct bpf_array *array, u32 index, int cpu)
+{
+	if (array_map_mmapable(array))
+		return array->value + (size_t)array->cpu_stride * cpu +
+		       array->elem_size * index;
+
+	return per_cpu_ptr(array->pptrs[index], cpu);
+}
+
 static void bpf_array_free_percpu(struct bpf_array *array)
 {
 	int i;
@@ -49,13 +74,18 @@ static int bpf_array_alloc_percpu(struct bpf_array *array)
 static struct bpf_map *array_map_alloc(union bpf_attr *attr)
 {
 	bool percpu = attr->map_type == BPF_MAP_TYPE_PERCPU_ARRAY;
+	bool mmapable = attr->map_flags & BPF_F_MMAPABLE;
 	struct bpf_array *array;
 	u64 array_size;
 	u32 elem_size;
+	void *data;
 
 	/* check sanity of attributes */
 	if (attr->max_entries == 0 || attr->key_size != 4 ||
-	    attr->value_size == 0 || attr->map_flags)
+	    attr->value_size == 0 || attr->map_flags & ~BPF_F_MMAPABLE)
+		return ERR_PTR(-EINVAL);
+
+	if (mmapable && attr->map_type != BPF_MAP_TYPE_ARRAY && !percpu)
 		return ERR_PTR(-EINVAL);
 
 	if (attr->value_size > KMALLOC_MAX_SIZE)
@@ -66,6 +96,9 @@ static struct bpf_map *array_map_alloc(union bpf_attr *attr)
 
 	elem_size = round_up(attr->value_size, 8);
 
+	if (mmapable)
+		goto alloc_mmapable;
+
 	array_size = sizeof(*array);
 	if (percpu)
 		array_size += (u64) attr->max_entries * sizeof(void *);
@@ -103,6 +136,38 @@ out:
 	array->map.pages = round_up(array_size, PAGE_SIZE) >> PAGE_SHIFT;
 
 	return &array->map;
+
+alloc_mmapable:
+	array_size = (u64) attr->max_entries * elem_size;
+	if (array_size >= U32_MAX - PAGE_SIZE)
+		return ERR_PTR(-ENOMEM);
+
+	array_size = PAGE_ALIGN(array_size);
+	if (percpu)
+		array_size *= nr_cpu_ids;
+	array_size += PAGE_ALIGN(sizeof(*array));
+	if (array_size >= U32_MAX - PAGE_SIZE)
+		return ERR_PTR(-ENOMEM);
+
+	/* zeroed and VM_USERMAP, as remap_vmalloc_range() wants it */
+	data = vmalloc_user(array_size);
+	if (!data)
+		return ERR_PTR(-ENOMEM);
+
+	array = data + PAGE_ALIGN(sizeof(*array)) -
+		offsetof(struct bpf_array, value);
+
+	array->map.map_type = attr->map_type;
+	array->map.key_size = attr->key_size;
+	array->map.value_size = attr->value_size;
+	array->map.max_entries = attr->max_entries;
+	array->map.map_flags = attr->map_flags;
+	array->map.pages = array_size >> PAGE_SHIFT;
+	array->elem_size = elem_size;
+	if (percpu)
+		array->cpu_stride = PAGE_ALIGN(attr->max_entries * elem_size);
+
+	return &array->map;
 }
 
 /* Called from syscall or from eBPF program */
@@ -150,6 +215,9 @@ static void *percpu_array_map_lookup_elem(struct bpf_map *map, void *key)
 	if (unlikely(index >= array->map.max_entries))
 		return NULL;
 
+	if (array_map_mmapable(array))
+		return array_percpu_elem(array, index, smp_processor_id());
+
 	return this_cpu_ptr(array->pptrs[index]);
 }
 
@@ -157,7 +225,6 @@ int bpf_percpu_array_copy(struct bpf_map *map, void *key, void *value)
 {
 	struct bpf_array *array = container_of(map, struct bpf_array, map);
 	u32 index = *(u32 *)key;
-	void __percpu *pptr;
 	int cpu, off = 0;
 	u32 size;
 
@@ -170,9 +237,9 @@ int bpf_percpu_array_copy(struct bpf_map *map, void *key, void *value)
 	 */
 	size = round_up(map->value_size, 8);
 	rcu_read_lock();
-	pptr = array->pptrs[index];
 	for_each_possible_cpu(cpu) {
-		bpf_long_memcpy(value + off, per_cpu_ptr(pptr, cpu), size);
+		bpf_long_memcpy(value + off, array_percpu_elem(array, index, cpu),
+				size);
 		off += size;
 	}
 	rcu_read_unlock();
@@ -218,7 +285,7 @@ static int array_map_update_elem(struct bpf_map *map, void *key, void *value,
 		return -EEXIST;
 
 	if (array->map.map_type == BPF_MAP_TYPE_PERCPU_ARRAY)
-		memcpy(this_cpu_ptr(array->pptrs[index]),
+		memcpy(array_percpu_elem(array, index, smp_processor_id()),
 		       value, map->value_size);
 	else
 		memcpy(array->value + array->elem_size * index,
@@ -231,7 +298,6 @@ int bpf_percpu_array_update(struct bpf_map *map, void *key, void *value,
 {
 	struct bpf_array *array = container_of(map, struct bpf_array, map);
 	u32 index = *(u32 *)key;
-	void __percpu *pptr;
 	int cpu, off = 0;
 	u32 size;
 
@@ -255,9 +321,9 @@ int bpf_percpu_array_update(struct bpf_map *map, void *key, void *value,
 	 */
 	size = round_up(map->value_size, 8);
 	rcu_read_lock();
-	pptr = array->pptrs[index];
 	for_each_possible_cpu(cpu) {
-		bpf_long_memcpy(per_cpu_ptr(pptr, cpu), value + off, size);
+		bpf_long_memcpy(array_percpu_elem(array, index, cpu), value + off,
+				size);
 		off += size;
 	}
 	rcu_read_unlock();
@@ -282,12 +348,31 @@ static void array_map_free(struct bpf_map *map)
 	 */
 	synchronize_rcu();
 
+	if (array_map_mmapable(array)) {
+		vfree(array_map_vmalloc_addr(array));
+		return;
+	}
+
 	if (array->map.map_type == BPF_MAP_TYPE_PERCPU_ARRAY)
 		bpf_array_free_percpu(array);
 
 	bpf_map_area_free(array);
 }
 
+/* Mapped pages stay referenced by the mapping after the map is freed */
+static int array_map_mmap(struct bpf_map *map, struct vm_area_struct *vma)
+{
+	struct bpf_array *array = container_of(map, struct bpf_array, map);
+	pgoff_t pgoff = PAGE_ALIGN(sizeof(*array)) >> PAGE_SHIFT;
+
+	if (!array_map_mmapable(array))
+		return -EINVAL;
+
+	/* remap_vmalloc_range() checks size and offset constraints */
+	return remap_vmalloc_range(vma, array_map_vmalloc_addr(array),
+				   vma->vm_pgoff + pgoff);
+}
+
 const struct bpf_map_ops array_map_ops = {
 	.map_alloc = array_map_alloc,
 	.map_free = array_map_free,
@@ -296,6 +381,9 @@ const struct bpf_map_ops array_map_ops = {
 	.map_update_elem = array_map_update_elem,
 	.map_delete_elem = array_map_delete_elem,
 	.map_gen_lookup = array_map_gen_lookup,
+	.map_lookup_batch = generic_map_lookup_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_mmap = array_map_mmap,
 };
 
 const struct bpf_map_ops percpu_array_map_ops = {
@@ -305,6 +393,9 @@ const struct bpf_map_ops percpu_array_map_ops = {
 	.map_lookup_elem = percpu_array_map_lookup_elem,
 	.map_update_elem = array_map_update_elem,
 	.map_delete_elem = array_map_delete_elem,
+	.map_lookup_batch = generic_map_lookup_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_mmap = array_map_mmap,
 };
 
 static struct bpf_map *fd_array_map_alloc(union bpf_attr *attr)
@@ -7,12 +7,27 @@
 #include <linux/cpumask.h>
 #include <linux/spinlock.h>
 #include <linux/percpu.h>
+#include <linux/jiffies.h>
+#include <linux/seq_file.h>
 
 #include "bpf_lru_list.h"
 
 #define LOCAL_FREE_TARGET		(128)
 #define LOCAL_NR_SCANS			LOCAL_FREE_TARGET
 
+/*
+ * A CPU that finds the global lock contended takes more nodes per refill,
+ * up to a share of the map; one that refills rarely takes fewer, so as not
+ * to sit on nodes other CPUs could use.
+ */
+#define LOCAL_FREE_TARGET_MIN		(16)
+#define LOCAL_FREE_TARGET_MAX		(1024)
+#define LOCAL_FREE_TARGET_IDLE		(HZ)
+
+/* Neighbours whose local free lists are tried before the global list */
+#define LOCAL_STEAL_NEIGHBOURS		(4)
+#define LOCAL_STEAL_MIN			(4)
+
 #define PERCPU_FREE_TARGET		(4)
 #define PERCPU_NR_SCANS			PERCPU_FREE_TARGET
 
@@ -321,11 +336,24 @@ static void bpf_lru_list_push_free(struct bpf_lru_list *l,
 static void bpf_lru_list_pop_free_to_local(struct bpf_lru *lru,
 					   struct bpf_lru_locallist *loc_l)
 {
-	struct bpf_lru_list *l = &lru->common_lru.lru_list;
+	struct bpf_common_lru *clru = &lru->common_lru;
+	struct bpf_lru_list *l = &clru->lru_list;
 	struct bpf_lru_node *node, *tmp_node;
-	unsigned int nfree = 0;
-
-	raw_spin_lock(&l->lock);
+	unsigned int nfree = 0, target;
+
+	if (!raw_spin_trylock(&l->lock)) {
+		loc_l->stats.global_contended++;
+		loc_l->free_target = min_t(unsigned int, loc_l->free_target * 2,
+					   clru->free_target_max);
+		raw_spin_lock(&l->lock);
+	} else if (time_after(jiffies, loc_l->refill_jiffies +
+				       LOCAL_FREE_TARGET_IDLE)) {
+		loc_l->free_target = max_t(unsigned int, loc_l->free_target / 2,
+					   LOCAL_FREE_TARGET_MIN);
+	}
+	loc_l->refill_jiffies = jiffies;
+	loc_l->stats.global_refills++;
+	target = loc_l->free_target;
 
 	__local_list_flush(l, loc_l);
 
@@ -335,16 +363,18 @@ static void bpf_lru_list_pop_free_to_local(struct bpf_lru *lru,
 				 list) {
 		__bpf_lru_node_move_to_free(l, node, local_free_list(loc_l),
 					    BPF_LRU_LOCAL_LIST_T_FREE);
-		if (++nfree == LOCAL_FREE_TARGET)
+		if (++nfree == target)
 			break;
 	}
 
-	if (nfree < LOCAL_FREE_TARGET)
-		__bpf_lru_list_shrink(lru, l, LOCAL_FREE_TARGET - nfree,
-				      local_free_list(loc_l),
-				      BPF_LRU_LOCAL_LIST_T_FREE);
+	if (nfree < target)
+		nfree += __bpf_lru_list_shrink(lru, l, target - nfree,
+					       local_free_list(loc_l),
+					       BPF_LRU_LOCAL_LIST_T_FREE);
 
 	raw_spin_unlock(&l->lock);
+
+	loc_l->nr_free += nfree;
 }
 
 static void __local_list_add_pending(struct bpf_lru *lru,
@@ -368,12 +398,62 @@ __local_list_pop_free(struct bpf_lru_locallist *loc_l)
 	node = list_first_entry_or_null(local_free_list(loc_l),
 					struct bpf_lru_node,
 					list);
-	if (node)
+	if (node) {
 		list_del(&node->list);
+		loc_l->nr_free--;
+	}
 
 	return node;
 }
 
+/*
+ * Take half the free nodes of one of the next few CPUs, to spare the
+ * global lock.  Our own local lock is held, so theirs is only tried:
+ * two CPUs stealing from each other would deadlock otherwise.
+ */
+static bool __local_list_steal_neighbour(struct bpf_common_lru *clru,
+					 struct bpf_lru_locallist *loc_l,
+					 int cpu)
+{
+	struct bpf_lru_node *node, *tmp_node;
+	struct bpf_lru_locallist *nb_l;
+	unsigned int i, n, nmoved;
+	int nb = cpu;
+
+	for (i = 0; i < LOCAL_STEAL_NEIGHBOURS; i++) {
+		nb = get_next_cpu(nb);
+		if (nb == cpu)
+			break;
+
+		nb_l = per_cpu_ptr(clru->local_list, nb);
+		if (READ_ONCE(nb_l->nr_free) < LOCAL_STEAL_MIN)
+			continue;
+		if (!raw_spin_trylock(&nb_l->lock))
+			continue;
+
+		n = nb_l->nr_free / 2;
+		nmoved = 0;
+		list_for_each_entry_safe_reverse(node, tmp_node,
+						 local_free_list(nb_l), list) {
+			if (nmoved == n)
+				break;
+			list_move(&node->list, local_free_list(loc_l));
+			nmoved++;
+		}
+		nb_l->nr_free -= nmoved;
+
+		raw_spin_unlock(&nb_l->lock);
+
+		if (nmoved) {
+			loc_l->nr_free += nmoved;
+			loc_l->stats.neighbour_steals++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
 static struct bpf_lru_node *
 __local_list_pop_pending(struct bpf_lru *lru, struct bpf_lru_locallist *loc_l)
 {
@@ -446,6 +526,8 @@ static struct bpf_lru_node *bpf_common_lru_pop_free(struct bpf_lru *lru,
 	raw_spin_lock_irqsave(&loc_l->lock, flags);
 
 	node = __local_list_pop_free(loc_l);
+	if (!node && __local_list_steal_neighbour(clru, loc_l, cpu))
+		node = __local_list_pop_free(loc_l);
 	if (!node) {
 		bpf_lru_list_pop_free_to_local(lru, loc_l);
 		node = __local_list_pop_free(loc_l);
@@ -487,6 +569,7 @@ static struct bpf_lru_node *bpf_common_lru_pop_free(struct bpf_lru *lru,
 
 	if (node) {
 		raw_spin_lock_irqsave(&loc_l->lock, flags);
+		loc_l->stats.remote_steals++;
 		__local_list_add_pending(lru, loc_l, cpu, node, hash);
 		raw_spin_unlock_irqrestore(&loc_l->lock, flags);
 	}
@@ -526,6 +609,7 @@ static void bpf_common_lru_push_free(struct bpf_lru *lru,
 		node->type = BPF_LRU_LOCAL_LIST_T_FREE;
 		node->ref = 0;
 		list_move(&node->list, local_free_list(loc_l));
+		loc_l->nr_free++;
 
 		raw_spin_unlock_irqrestore(&loc_l->lock, flags);
 		return;
@@ -562,9 +646,16 @@ static void bpf_common_lru_populate(struct bpf_lru *lru, void *buf,
 				    u32 node_offset, u32 elem_size,
 				    u32 nr_elems)
 {
-	struct bpf_lru_list *l = &lru->common_lru.lru_list;
+	struct bpf_common_lru *clru = &lru->common_lru;
+	struct bpf_lru_list *l = &clru->lru_list;
 	u32 i;
 
+	/* Let each CPU hold up to half its share of the map */
+	clru->free_target_max = clamp_t(u32,
+					nr_elems / (2 * num_possible_cpus()),
+					LOCAL_FREE_TARGET,
+					LOCAL_FREE_TARGET_MAX);
+
 	for (i = 0; i < nr_elems; i++) {
 		struct bpf_lru_node *node;
 
@@ -626,6 +717,10 @@ static void bpf_lru_locallist_init(struct bpf_lru_locallist *loc_l, int cpu)
 		INIT_LIST_HEAD(&loc_l->lists[i]);
 
 	loc_l->next_steal = cpu;
+	loc_l->free_target = LOCAL_FREE_TARGET;
+	loc_l->nr_free = 0;
+	loc_l->refill_jiffies = jiffies;
+	memset(&loc_l->stats, 0, sizeof(loc_l->stats));
 
 	raw_spin_lock_init(&loc_l->lock);
 }
@@ -677,6 +772,7 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 		}
 
 		bpf_lru_list_init(&clru->lru_list);
+		clru->free_target_max = LOCAL_FREE_TARGET;
 		lru->nr_scans = LOCAL_NR_SCANS;
 	}
 
@@ -695,3 +791,37 @@ void bpf_lru_destroy(struct bpf_lru *lru)
 	else
 		free_percpu(lru->common_lru.local_list);
 }
+
+void bpf_lru_show_fdinfo(const struct bpf_lru *lru, struct seq_file *m)
+{
+	struct bpf_lru_locallist_stats sum = {};
+	unsigned int nr_free = 0;
+	int cpu;
+
+	if (lru->percpu)
+		return;
+
+	/* The counters are per CPU and read without their locks */
+	for_each_possible_cpu(cpu) {
+		struct bpf_lru_locallist *loc_l;
+
+		loc_l = per_cpu_ptr(lru->common_lru.local_list, cpu);
+		sum.global_refills += READ_ONCE(loc_l->stats.global_refills);
+		sum.global_contended += READ_ONCE(loc_l->stats.global_contended);
+		sum.neighbour_steals += READ_ONCE(loc_l->stats.neighbour_steals);
+		sum.remote_steals += READ_ONCE(loc_l->stats.remote_steals);
+		nr_free += READ_ONCE(loc_l->nr_free);
+	}
+
+	seq_printf(m,
+		   "lru_local_free:\t%u\n"
+		   "lru_global_refills:\t%llu\n"
+		   "lru_global_contended:\t%llu\n"
+		   "lru_neighbour_steals:\t%llu\n"
+		   "lru_remote_steals:\t%llu\n",
+		   nr_free,
+		   sum.global_refills,
+		   sum.global_contended,
+		   sum.neighbour_steals,
+		   sum.remote_steals);
+}
@@ -39,17 +39,34 @@ struct bpf_lru_list {
 	raw_spinlock_t lock ____cacheline_aligned_in_smp;
 };
 
+/* How often a CPU had to go beyond its own local lists, for fdinfo */
+struct bpf_lru_locallist_stats {
+	u64 global_refills;
+	u64 global_contended;
+	u64 neighbour_steals;
+	u64 remote_steals;
+};
+
 struct bpf_lru_locallist {
 	struct list_head lists[NR_BPF_LRU_LOCAL_LIST_T];
 	u16 next_steal;
+	/* Nodes to take from the global list per refill, adapted at runtime */
+	u16 free_target;
+	unsigned int nr_free;
+	unsigned long refill_jiffies;
+	struct bpf_lru_locallist_stats stats;
 	raw_spinlock_t lock;
 };
 
 struct bpf_common_lru {
 	struct bpf_lru_list lru_list;
 	struct bpf_lru_locallist __percpu *local_list;
+	/* What free_target may grow to, from the size of the map */
+	u16 free_target_max;
 };
 
+struct seq_file;
+
 typedef bool (*del_from_htab_func)(void *arg, struct bpf_lru_node *node);
 
 struct bpf_lru {
@@ -80,5 +97,6 @@ void bpf_lru_destroy(struct bpf_lru *lru);
 struct bpf_lru_node *bpf_lru_pop_free(struct bpf_lru *lru, u32 hash);
 void bpf_lru_push_free(struct bpf_lru *lru, struct bpf_lru_node *node);
 void bpf_lru_promote(struct bpf_lru *lru, struct bpf_lru_node *node);
+void bpf_lru_show_fdinfo(const struct bpf_lru *lru, struct seq_file *m);
 
 #endif
@@ -45,6 +45,14 @@
  * conflicting netdev unregister and BPF syscall operations. Updates and
  * deletes from a BPF program (done in rcu critical section) are blocked
  * because of this mutex.
+ *
+ * Frames redirected through __dev_map_enqueue() are not handed to the driver
+ * one at a time. Each bpf_dtab_netdev has a per-cpu bulk queue, and the frames
+ * sit there until the queue fills up or the flush at the end of the napi
+ * poll, when they all go to the driver in a single ndo_xdp_xmit_bulk() call
+ * and a single ndo_xdp_flush(). The flush_needed bit of the entry stays set
+ * while its queue on that cpu is not empty, so the tear down rules above
+ * cover the queued frames too.
  */
 #include <linux/bpf.h>
 #include <linux/jhash.h>
@@ -54,11 +62,19 @@
 #include "bpf_lru_list.h"
 #include "map_in_map.h"
 
+#define DEV_MAP_BULK_SIZE 16
+
+struct xdp_bulk_queue {
+	struct xdp_buff q[DEV_MAP_BULK_SIZE];
+	unsigned int count;
+};
+
 struct bpf_dtab_netdev {
 	struct net_device *dev;
 	int key;
 	struct rcu_head rcu;
 	struct bpf_dtab *dtab;
+	struct xdp_bulk_queue __percpu *bulkq;
 };
 
 struct bpf_dtab {
@@ -177,6 +193,7 @@ static void dev_map_free(struct bpf_map *map)
 		if (!dev)
 			continue;
 
+		free_percpu(dev->bulkq);
 		dev_put(dev->dev);
 		kfree(dev);
 	}
@@ -217,6 +234,70 @@ void __dev_map_insert_ctx(struct bpf_map *map, u32 key)
 	__set_bit(key, bitmap);
 }
 
+/* Hand the queued frames to the driver. Whatever it doesn't take is ours to
+ * free, the same as when ndo_xdp_xmit() fails in the redirect path.
+ */
+static void bq_xmit_all(struct bpf_dtab_netdev *obj, struct xdp_bulk_queue *bq)
+{
+	const struct net_device_ops *ops = obj->dev->netdev_ops;
+	int i, sent = 0;
+
+	if (unlikely(!bq->count))
+		return;
+
+	if (ops->ndo_xdp_xmit_bulk) {
+		sent = ops->ndo_xdp_xmit_bulk(obj->dev, bq->q, bq->count);
+		if (unlikely(sent < 0))
+			sent = 0;
+	} else {
+		for (i = 0; i < bq->count; i++) {
+			struct xdp_buff *xdp = &bq->q[i];
+
+			if (unlikely(ops->ndo_xdp_xmit(obj->dev, xdp)))
+				page_frag_free(xdp->data);
+		}
+		sent = bq->count;
+	}
+
+	for (i = sent; i < bq->count; i++)
+		page_frag_free(bq->q[i].data);
+
+	bq->count = 0;
+}
+
+/* Queue a frame for the device at @key; called from the redirect path in
+ * the same rcu critical section as the bpf program. On success the frame
+ * belongs to the devmap until the next __dev_map_flush() on this cpu, on
+ * error it is still the caller's.
+ */
+int __dev_map_enqueue(struct bpf_map *map, u32 key, struct xdp_buff *xdp)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+	const struct net_device_ops *ops;
+	struct bpf_dtab_netdev *obj;
+	struct xdp_bulk_queue *bq;
+
+	if (unlikely(key >= map->max_entries))
+		return -EINVAL;
+
+	obj = READ_ONCE(dtab->netdev_map[key]);
+	if (unlikely(!obj))
+		return -EINVAL;
+
+	ops = obj->dev->netdev_ops;
+	if (unlikely(!ops->ndo_xdp_xmit_bulk && !ops->ndo_xdp_xmit))
+		return -EOPNOTSUPP;
+
+	bq = this_cpu_ptr(obj->bulkq);
+	if (unlikely(bq->count == DEV_MAP_BULK_SIZE))
+		bq_xmit_all(obj, bq);
+
+	bq->q[bq->count++] = *xdp;
+	__set_bit(key, this_cpu_ptr(dtab->flush_needed));
+
+	return 0;
+}
+
 struct net_device  *__dev_map_lookup_elem(struct bpf_map *map, u32 key)
 {
 	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
@@ -255,7 +336,11 @@ void __dev_map_flush(struct bpf_map *map)
 		netdev = dev->dev;
 
 		__clear_bit(bit, bitmap);
-		if (unlikely(!netdev || !netdev->netdev_ops->ndo_xdp_flush))
+		if (unlikely(!netdev))
+			continue;
+
+		bq_xmit_all(dev, this_cpu_ptr(dev->bulkq));
+		if (unlikely(!netdev->netdev_ops->ndo_xdp_flush))
 			continue;
 
 		netdev->netdev_ops->ndo_xdp_flush(netdev);
@@ -281,17 +366,17 @@ static void *dev_map_lookup_elem(struct bpf_map *map, void *key)
 
 static void dev_map_flush_old(struct bpf_dtab_netdev *old_dev)
 {
-	if (old_dev->dev->netdev_ops->ndo_xdp_flush) {
-		struct net_device *fl = old_dev->dev;
-		unsigned long *bitmap;
-		int cpu;
+	struct net_device *fl = old_dev->dev;
+	unsigned long *bitmap;
+	int cpu;
 
-		for_each_online_cpu(cpu) {
-			bitmap = per_cpu_ptr(old_dev->dtab->flush_needed, cpu);
-			__clear_bit(old_dev->key, bitmap);
+	for_each_online_cpu(cpu) {
+		bitmap = per_cpu_ptr(old_dev->dtab->flush_needed, cpu);
+		bq_xmit_all(old_dev, per_cpu_ptr(old_dev->bulkq, cpu));
+		__clear_bit(old_dev->key, bitmap);
 
+		if (fl->netdev_ops->ndo_xdp_flush)
 			fl->netdev_ops->ndo_xdp_flush(old_dev->dev);
-		}
 	}
 }
 
@@ -301,6 +386,7 @@ static void __dev_map_entry_free(struct rcu_head *rcu)
 
 	old_dev = container_of(rcu, struct bpf_dtab_netdev, rcu);
 	dev_map_flush_old(old_dev);
+	free_percpu(old_dev->bulkq);
 	dev_put(old_dev->dev);
 	kfree(old_dev);
 }
@@ -355,8 +441,17 @@ static int dev_map_update_elem(struct bpf_map *map, void *key, void *value,
 		if (!dev)
 			return -ENOMEM;
 
+		dev->bulkq = __alloc_percpu_gfp(sizeof(*dev->bulkq),
+						__alignof__(*dev->bulkq),
+						GFP_ATOMIC | __GFP_NOWARN);
+		if (!dev->bulkq) {
+			kfree(dev);
+			return -ENOMEM;
+		}
+
 		dev->dev = dev_get_by_index(net, ifindex);
 		if (!dev->dev) {
+			free_percpu(dev->bulkq);
 			kfree(dev);
 			return -EINVAL;
 		}
@@ -14,6 +14,7 @@
 #include <linux/jhash.h>
 #include <linux/filter.h>
 #include <linux/rculist_nulls.h>
+#include <linux/workqueue.h>
 #include "percpu_freelist.h"
 #include "bpf_lru_list.h"
 #include "map_in_map.h"
@@ -23,9 +24,31 @@ struct bucket {
 	raw_spinlock_t lock;
 };
 
+/*
+ * A BPF_F_RESIZABLE map moves to a table of another size a bucket at a
+ * time, in the spirit of lib/rhashtable: while it does, future_tbl points
+ * to the new table, and the buckets of this one below rehash are empty,
+ * their elements gone there.  An element is always in the first table,
+ * following future_tbl, whose bucket for its hash has not been rehashed.
+ *
+ * The nulls marker ending a bucket is its index plus nulls_base, which
+ * alternates between consecutive tables, so that a lockless lookup led
+ * from one table's bucket into the next table's notices and restarts.
+ */
+struct bucket_table {
+	struct bucket *buckets;
+	u32 n_buckets;
+	u32 nulls_base;
+	u32 rehash;
+	struct bucket_table __rcu *future_tbl;
+};
+
+#define HTAB_NULLS_ALT		(1U << 30)
+#define HTAB_MIN_BUCKETS	16
+
 struct bpf_htab {
 	struct bpf_map map;
-	struct bucket *buckets;
+	struct bucket_table __rcu *tbl;
 	void *elems;
 	union {
 		struct pcpu_freelist freelist;
@@ -33,8 +56,12 @@ struct bpf_htab {
 	};
 	struct htab_elem *__percpu *extra_elems;
 	atomic_t count;	/* number of elements in this hashtable */
-	u32 n_buckets;	/* number of hash buckets */
+	u32 n_buckets;	/* number of hash buckets in tbl */
 	u32 elem_size;	/* size of each element in bytes */
+	/* BPF_F_RESIZABLE only */
+	u32 min_buckets;
+	u32 max_buckets;
+	struct work_struct resize_work;
 };
 
 /* each htab element is struct htab_elem + key + value */
@@ -46,6 +73,7 @@ struct htab_elem {
 			union {
 				struct bpf_htab *htab;
 				struct pcpu_freelist_node fnode;
+				struct htab_elem *batch_flink;
 			};
 		};
 	};
@@ -76,6 +104,11 @@ static bool htab_is_prealloc(const struct bpf_htab *htab)
 	return !(htab->map.map_flags & BPF_F_NO_PREALLOC);
 }
 
+static bool htab_is_resizable(const struct bpf_htab *htab)
+{
+	return htab->map.map_flags & BPF_F_RESIZABLE;
+}
+
 static inline void htab_elem_set_ptr(struct htab_elem *l, u32 key_size,
 				     void __percpu *pptr)
 {
@@ -219,6 +252,141 @@ static int alloc_extra_elems(struct bpf_htab *htab)
 	return 0;
 }
 
+static struct bucket_table *htab_tbl_alloc(u32 n_buckets, u32 nulls_base)
+{
+	struct bucket_table *tbl;
+	int i;
+
+	tbl = kzalloc(sizeof(*tbl), GFP_USER);
+	if (!tbl)
+		return NULL;
+
+	tbl->buckets = bpf_map_area_alloc(n_buckets * sizeof(struct bucket));
+	if (!tbl->buckets) {
+		kfree(tbl);
+		return NULL;
+	}
+
+	for (i = 0; i < n_buckets; i++) {
+		INIT_HLIST_NULLS_HEAD(&tbl->buckets[i].head, nulls_base + i);
+		raw_spin_lock_init(&tbl->buckets[i].lock);
+	}
+	tbl->n_buckets = n_buckets;
+	tbl->nulls_base = nulls_base;
+
+	return tbl;
+}
+
+static void htab_tbl_free(struct bucket_table *tbl)
+{
+	bpf_map_area_free(tbl->buckets);
+	kfree(tbl);
+}
+
+/* Grow past 3/4 of an element per bucket, shrink below 3/10, like rhashtable */
+static u32 htab_resize_target(struct bpf_htab *htab, u32 n_buckets)
+{
+	u32 count = atomic_read(&htab->count);
+
+	if (count > n_buckets / 4 * 3 && n_buckets < htab->max_buckets)
+		return n_buckets * 2;
+	if (count < n_buckets / 10 * 3 && n_buckets > htab->min_buckets)
+		return max_t(u32, roundup_pow_of_two(count * 3 / 2 + 1),
+			     htab->min_buckets);
+	return n_buckets;
+}
+
+/* Called whenever the count changes, from any context */
+static void htab_resize_check(struct bpf_htab *htab, u32 count)
+{
+	u32 n_buckets;
+
+	if (!htab_is_resizable(htab))
+		return;
+
+	n_buckets = READ_ONCE(htab->n_buckets);
+	if ((count > n_buckets / 4 * 3 && n_buckets < htab->max_buckets) ||
+	    (count < n_buckets / 10 * 3 && n_buckets > htab->min_buckets))
+		schedule_work(&htab->resize_work);
+}
+
+/*
+ * Move the elements of one bucket of old to new.  Each is linked into new
+ * before it's unlinked from old, so that a lookup missing it in old finds
+ * it in new; and it's always the last one that moves, so that a lookup
+ * following it from old into new hasn't skipped any in old.  That lookup
+ * then ends on a nulls marker of new, and restarts.
+ */
+static void htab_rehash_bucket(struct bucket_table *old,
+			       struct bucket_table *new, u32 idx)
+{
+	struct bucket *b = &old->buckets[idx];
+	struct hlist_nulls_node *n, **pprev;
+	struct htab_elem *l, *tail;
+	unsigned long flags;
+	struct bucket *nb;
+
+	raw_spin_lock_irqsave(&b->lock, flags);
+
+	for (;;) {
+		tail = NULL;
+		hlist_nulls_for_each_entry(l, n, &b->head, hash_node)
+			tail = l;
+		if (!tail)
+			break;
+
+		pprev = tail->hash_node.pprev;
+		nb = __select_bucket(new, tail->hash);
+		raw_spin_lock_nested(&nb->lock, SINGLE_DEPTH_NESTING);
+		hlist_nulls_add_head_rcu(&tail->hash_node, &nb->head);
+		raw_spin_unlock(&nb->lock);
+
+		smp_wmb();
+		WRITE_ONCE(*pprev, (struct hlist_nulls_node *)
+			   NULLS_MARKER(old->nulls_base + idx));
+	}
+
+	/* Updaters for this bucket go to new from now on */
+	WRITE_ONCE(old->rehash, idx + 1);
+
+	raw_spin_unlock_irqrestore(&b->lock, flags);
+}
+
+static void htab_resize_work(struct work_struct *work)
+{
+	struct bpf_htab *htab = container_of(work, struct bpf_htab,
+					     resize_work);
+	struct bucket_table *old, *new;
+	u32 n_buckets, i;
+
+	for (;;) {
+		old = rcu_dereference_raw(htab->tbl);
+		n_buckets = htab_resize_target(htab, old->n_buckets);
+		if (n_buckets == old->n_buckets)
+			return;
+
+		/* On failure, the next update crossing a threshold retries */
+		new = htab_tbl_alloc(n_buckets,
+				     old->nulls_base ^ HTAB_NULLS_ALT);
+		if (!new)
+			return;
+
+		rcu_assign_pointer(old->future_tbl, new);
+
+		for (i = 0; i < old->n_buckets; i++) {
+			htab_rehash_bucket(old, new, i);
+			cond_resched();
+		}
+
+		rcu_assign_pointer(htab->tbl, new);
+		WRITE_ONCE(htab->n_buckets, n_buckets);
+
+		/* Lookups may still be in old, or on their way from it */
+		synchronize_rcu();
+		htab_tbl_free(old);
+	}
+}
+
 /* Called from syscall */
 static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 {
@@ -233,8 +401,11 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	 */
 	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
+	bool resizable = (attr->map_flags & BPF_F_RESIZABLE);
+	struct bucket_table *tbl;
 	struct bpf_htab *htab;
-	int err, i;
+	u32 n_buckets;
+	int err;
 	u64 cost;
 
 	BUILD_BUG_ON(offsetof(struct htab_elem, htab) !=
@@ -248,7 +419,8 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		 */
 		return ERR_PTR(-EPERM);
 
-	if (attr->map_flags & ~(BPF_F_NO_PREALLOC | BPF_F_NO_COMMON_LRU))
+	if (attr->map_flags & ~(BPF_F_NO_PREALLOC | BPF_F_NO_COMMON_LRU |
+				BPF_F_RESIZABLE))
 		/* reserved bits should not be used */
 		return ERR_PTR(-EINVAL);
 
@@ -258,6 +430,10 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	if (lru && !prealloc)
 		return ERR_PTR(-ENOTSUPP);
 
+	/* Resizing follows the element count, which only these maps keep */
+	if (resizable && (lru || prealloc))
+		return ERR_PTR(-EINVAL);
+
 	htab = kzalloc(sizeof(*htab), GFP_USER);
 	if (!htab)
 		return ERR_PTR(-ENOMEM);
@@ -290,7 +466,7 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	}
 
 	/* hash table size must be power of 2 */
-	htab->n_buckets = roundup_pow_of_two(htab->map.max_entries);
+	n_buckets = roundup_pow_of_two(htab->map.max_entries);
 
 	err = -E2BIG;
 	if (htab->map.key_size > MAX_BPF_STACK)
@@ -320,11 +496,12 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		htab->elem_size += round_up(htab->map.value_size, 8);
 
 	/* prevent zero size kmalloc and check for u32 overflow */
-	if (htab->n_buckets == 0 ||
-	    htab->n_buckets > U32_MAX / sizeof(struct bucket))
+	if (n_buckets == 0 ||
+	    n_buckets > U32_MAX / sizeof(struct bucket))
 		goto free_htab;
 
-	cost = (u64) htab->n_buckets * sizeof(struct bucket) +
+	/* A resizable map is charged for the table it may grow to */
+	cost = (u64) n_buckets * sizeof(struct bucket) +
 	       (u64) htab->elem_size * htab->map.max_entries;
 
 	if (percpu)
@@ -344,16 +521,19 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	if (err)
 		goto free_htab;
 
+	htab->max_buckets = n_buckets;
+	if (resizable) {
+		htab->min_buckets = min_t(u32, n_buckets, HTAB_MIN_BUCKETS);
+		n_buckets = htab->min_buckets;
+		INIT_WORK(&htab->resize_work, htab_resize_work);
+	}
+
 	err = -ENOMEM;
-	htab->buckets = bpf_map_area_alloc(htab->n_buckets *
-					   sizeof(struct bucket));
-	if (!htab->buckets)
+	tbl = htab_tbl_alloc(n_buckets, 0);
+	if (!tbl)
 		goto free_htab;
-
-	for (i = 0; i < htab->n_buckets; i++) {
-		INIT_HLIST_NULLS_HEAD(&htab->buckets[i].head, i);
-		raw_spin_lock_init(&htab->buckets[i].lock);
-	}
+	RCU_INIT_POINTER(htab->tbl, tbl);
+	htab->n_buckets = n_buckets;
 
 	if (prealloc) {
 		err = prealloc_init(htab);
@@ -375,7 +555,7 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 free_prealloc:
 	prealloc_destroy(htab);
 free_buckets:
-	bpf_map_area_free(htab->buckets);
+	htab_tbl_free(tbl);
 free_htab:
 	kfree(htab);
 	return ERR_PTR(err);
@@ -386,14 +566,37 @@ static inline u32 htab_map_hash(const void *key, u32 key_len)
 	return jhash(key, key_len, 0);
 }
 
-static inline struct bucket *__select_bucket(struct bpf_htab *htab, u32 hash)
+static inline struct bucket *__select_bucket(struct bucket_table *tbl, u32 hash)
 {
-	return &htab->buckets[hash & (htab->n_buckets - 1)];
+	return &tbl->buckets[hash & (tbl->n_buckets - 1)];
 }
 
-static inline struct hlist_nulls_head *select_bucket(struct bpf_htab *htab, u32 hash)
+static inline struct hlist_nulls_head *select_bucket(struct bucket_table *tbl, u32 hash)
 {
-	return &__select_bucket(htab, hash)->head;
+	return &__select_bucket(tbl, hash)->head;
+}
+
+/*
+ * Lock the bucket an element with this hash belongs in: the one of the
+ * first table where it hasn't been rehashed yet.  There is no newer
+ * table than the one a resize is moving to, as the next resize only
+ * starts after a grace period.
+ */
+static struct bucket *htab_lock_bucket(struct bpf_htab *htab, u32 hash,
+				       unsigned long *flags)
+{
+	struct bucket_table *tbl = rcu_dereference_raw(htab->tbl);
+	struct bucket *b;
+
+	for (;;) {
+		b = __select_bucket(tbl, hash);
+		raw_spin_lock_irqsave(&b->lock, *flags);
+		if (likely(READ_ONCE(tbl->rehash) <=
+			   (hash & (tbl->n_buckets - 1))))
+			return b;
+		raw_spin_unlock_irqrestore(&b->lock, *flags);
+		tbl = rcu_dereference_raw(tbl->future_tbl);
+	}
 }
 
 /* this lookup function can only be called with bucket lock taken */
@@ -414,10 +617,12 @@ static struct htab_elem *lookup_elem_raw(struct hlist_nulls_head *head, u32 hash
  * the unlikely event when elements moved from one bucket into another
  * while link list is being walked
  */
-static struct htab_elem *lookup_nulls_elem_raw(struct hlist_nulls_head *head,
+static struct htab_elem *lookup_nulls_elem_raw(struct bucket_table *tbl,
 					       u32 hash, void *key,
-					       u32 key_size, u32 n_buckets)
+					       u32 key_size)
 {
+	u32 idx = hash & (tbl->n_buckets - 1);
+	struct hlist_nulls_head *head = &tbl->buckets[idx].head;
 	struct hlist_nulls_node *n;
 	struct htab_elem *l;
 
@@ -426,12 +631,35 @@ again:
 		if (l->hash == hash && !memcmp(&l->key, key, key_size))
 			return l;
 
-	if (unlikely(get_nulls_value(n) != (hash & (n_buckets - 1))))
+	if (unlikely(get_nulls_value(n) != tbl->nulls_base + idx))
 		goto again;
 
 	return NULL;
 }
 
+/* Look in *ptbl and the tables a resize is moving to, leaving where found */
+static struct htab_elem *lookup_elem_tbls(struct bucket_table **ptbl,
+					  u32 hash, void *key, u32 key_size)
+{
+	struct bucket_table *tbl = *ptbl;
+	struct htab_elem *l;
+
+	do {
+		l = lookup_nulls_elem_raw(tbl, hash, key, key_size);
+		if (l) {
+			*ptbl = tbl;
+			return l;
+		}
+		/* An element is linked into future_tbl before it's unlinked
+		 * from here: if we missed it here, it's there.
+		 */
+		smp_rmb();
+		tbl = rcu_dereference_raw(tbl->future_tbl);
+	} while (unlikely(tbl));
+
+	return NULL;
+}
+
 /* Called from syscall or from eBPF program directly, so
  * arguments have to match bpf_map_lookup_elem() exactly.
  * The return value is adjusted by BPF instructions
@@ -440,8 +668,7 @@ again:
 static void *__htab_map_lookup_elem(struct bpf_map *map, void *key)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
-	struct hlist_nulls_head *head;
-	struct htab_elem *l;
+	struct bucket_table *tbl;
 	u32 hash, key_size;
 
 	/* Must be called with rcu_read_lock. */
@@ -451,11 +678,9 @@ static void *__htab_map_lookup_elem(struct bpf_map *map, void *key)
 
 	hash = htab_map_hash(key, key_size);
 
-	head = select_bucket(htab, hash);
+	tbl = rcu_dereference_raw(htab->tbl);
 
-	l = lookup_nulls_elem_raw(head, hash, key, key_size, htab->n_buckets);
-
-	return l;
+	return lookup_elem_tbls(&tbl, hash, key, key_size);
 }
 
 static void *htab_map_lookup_elem(struct bpf_map *map, void *key)
@@ -517,11 +742,9 @@ static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node)
 	struct bucket *b;
 
 	tgt_l = container_of(node, struct htab_elem, lru_node);
-	b = __select_bucket(htab, tgt_l->hash);
+	b = htab_lock_bucket(htab, tgt_l->hash, &flags);
 	head = &b->head;
 
-	raw_spin_lock_irqsave(&b->lock, flags);
-
 	hlist_nulls_for_each_entry_rcu(l, n, head, hash_node)
 		if (l == tgt_l) {
 			hlist_nulls_del_rcu(&l->hash_node);
@@ -539,6 +762,7 @@ static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
 	struct hlist_nulls_head *head;
 	struct htab_elem *l, *next_l;
+	struct bucket_table *tbl;
 	u32 hash, key_size;
 	int i = 0;
 
@@ -546,15 +770,15 @@ static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 
 	key_size = map->key_size;
 
+	tbl = rcu_dereference_raw(htab->tbl);
+
 	if (!key)
 		goto find_first_elem;
 
 	hash = htab_map_hash(key, key_size);
 
-	head = select_bucket(htab, hash);
-
 	/* lookup the key */
-	l = lookup_nulls_elem_raw(head, hash, key, key_size, htab->n_buckets);
+	l = lookup_elem_tbls(&tbl, hash, key, key_size);
 
 	if (!l)
 		goto find_first_elem;
@@ -570,21 +794,26 @@ static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 	}
 
 	/* no more elements in this hash list, go to the next bucket */
-	i = hash & (htab->n_buckets - 1);
+	i = hash & (tbl->n_buckets - 1);
 	i++;
 
 find_first_elem:
-	/* iterate over buckets */
-	for (; i < htab->n_buckets; i++) {
-		head = select_bucket(htab, i);
-
-		/* pick first element in the bucket */
-		next_l = hlist_nulls_entry_safe(rcu_dereference_raw(hlist_nulls_first_rcu(head)),
-					  struct htab_elem, hash_node);
-		if (next_l) {
-			/* if it's not empty, just return it */
-			memcpy(next_key, next_l->key, key_size);
-			return 0;
+	/* iterate over buckets, then those of the table a resize is filling;
+	 * what it moves meanwhile may be seen twice or not at all, as with
+	 * any update made during the walk
+	 */
+	for (; tbl; tbl = rcu_dereference_raw(tbl->future_tbl), i = 0) {
+		for (; i < tbl->n_buckets; i++) {
+			head = select_bucket(tbl, i);
+
+			/* pick first element in the bucket */
+			next_l = hlist_nulls_entry_safe(rcu_dereference_raw(hlist_nulls_first_rcu(head)),
+						  struct htab_elem, hash_node);
+			if (next_l) {
+				/* if it's not empty, just return it */
+				memcpy(next_key, next_l->key, key_size);
+				return 0;
+			}
 		}
 	}
 
@@ -628,7 +857,7 @@ static void free_htab_elem(struct bpf_htab *htab, struct htab_elem *l)
 	if (htab_is_prealloc(htab)) {
 		pcpu_freelist_push(&htab->freelist, &l->fnode);
 	} else {
-		atomic_dec(&htab->count);
+		htab_resize_check(htab, atomic_dec_return(&htab->count));
 		l->htab = htab;
 		call_rcu(&l->rcu, htab_elem_free_rcu);
 	}
@@ -679,7 +908,9 @@ static struct htab_elem *alloc_htab_elem(struct bpf_htab *htab, void *key,
 			l_new = container_of(l, struct htab_elem, fnode);
 		}
 	} else {
-		if (atomic_inc_return(&htab->count) > htab->map.max_entries)
+		u32 count = atomic_inc_return(&htab->count);
+
+		if (count > htab->map.max_entries)
 			if (!old_elem) {
 				/* when map is full and update() is replacing
 				 * old element, it's ok to allocate, since
@@ -689,6 +920,7 @@ static struct htab_elem *alloc_htab_elem(struct bpf_htab *htab, void *key,
 				atomic_dec(&htab->count);
 				return ERR_PTR(-E2BIG);
 			}
+		htab_resize_check(htab, count);
 		l_new = kmalloc(htab->elem_size, GFP_ATOMIC | __GFP_NOWARN);
 		if (!l_new)
 			return ERR_PTR(-ENOMEM);
@@ -759,11 +991,9 @@ static int htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 
 	hash = htab_map_hash(key, key_size);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
 	/* bpf_map_update_elem() can be called in_irq() */
-	raw_spin_lock_irqsave(&b->lock, flags);
+	b = htab_lock_bucket(htab, hash, &flags);
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -815,9 +1045,6 @@ static int htab_lru_map_update_elem(struct bpf_map *map, void *key, void *value,
 
 	hash = htab_map_hash(key, key_size);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
 	/* For LRU, we need to alloc before taking bucket's
 	 * spinlock because getting free nodes from LRU may need
 	 * to remove older elements from htab and this removal
@@ -829,7 +1056,8 @@ static int htab_lru_map_update_elem(struct bpf_map *map, void *key, void *value,
 	memcpy(l_new->key + round_up(map->key_size, 8), value, map->value_size);
 
 	/* bpf_map_update_elem() can be called in_irq() */
-	raw_spin_lock_irqsave(&b->lock, flags);
+	b = htab_lock_bucket(htab, hash, &flags);
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -880,11 +1108,9 @@ static int __htab_percpu_map_update_elem(struct bpf_map *map, void *key,
 
 	hash = htab_map_hash(key, key_size);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
 	/* bpf_map_update_elem() can be called in_irq() */
-	raw_spin_lock_irqsave(&b->lock, flags);
+	b = htab_lock_bucket(htab, hash, &flags);
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -933,9 +1159,6 @@ static int __htab_lru_percpu_map_update_elem(struct bpf_map *map, void *key,
 
 	hash = htab_map_hash(key, key_size);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
 	/* For LRU, we need to alloc before taking bucket's
 	 * spinlock because LRU's elem alloc may need
 	 * to remove older elem from htab and this removal
@@ -948,7 +1171,8 @@ static int __htab_lru_percpu_map_update_elem(struct bpf_map *map, void *key,
 	}
 
 	/* bpf_map_update_elem() can be called in_irq() */
-	raw_spin_lock_irqsave(&b->lock, flags);
+	b = htab_lock_bucket(htab, hash, &flags);
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1005,11 +1229,9 @@ static int htab_map_delete_elem(struct bpf_map *map, void *key)
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size);
-	b = __select_bucket(htab, hash);
+	b = htab_lock_bucket(htab, hash, &flags);
 	head = &b->head;
 
-	raw_spin_lock_irqsave(&b->lock, flags);
-
 	l = lookup_elem_raw(head, hash, key, key_size);
 
 	if (l) {
@@ -1037,11 +1259,9 @@ static int htab_lru_map_delete_elem(struct bpf_map *map, void *key)
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size);
-	b = __select_bucket(htab, hash);
+	b = htab_lock_bucket(htab, hash, &flags);
 	head = &b->head;
 
-	raw_spin_lock_irqsave(&b->lock, flags);
-
 	l = lookup_elem_raw(head, hash, key, key_size);
 
 	if (l) {
@@ -1057,10 +1277,11 @@ static int htab_lru_map_delete_elem(struct bpf_map *map, void *key)
 
 static void delete_all_elements(struct bpf_htab *htab)
 {
+	struct bucket_table *tbl = rcu_dereference_raw(htab->tbl);
 	int i;
 
-	for (i = 0; i < htab->n_buckets; i++) {
-		struct hlist_nulls_head *head = select_bucket(htab, i);
+	for (i = 0; i < tbl->n_buckets; i++) {
+		struct hlist_nulls_head *head = select_bucket(tbl, i);
 		struct hlist_nulls_node *n;
 		struct htab_elem *l;
 
@@ -1083,6 +1304,10 @@ static void htab_map_free(struct bpf_map *map)
 	 */
 	synchronize_rcu();
 
+	/* nothing can queue a resize any more; let one in flight finish */
+	if (htab_is_resizable(htab))
+		cancel_work_sync(&htab->resize_work);
+
 	/* some of free_htab_elem() callbacks for elements of this map may
 	 * not have executed. Wait for them.
 	 */
@@ -1093,10 +1318,297 @@ static void htab_map_free(struct bpf_map *map)
 		prealloc_destroy(htab);
 
 	free_percpu(htab->extra_elems);
-	bpf_map_area_free(htab->buckets);
+	htab_tbl_free(rcu_dereference_raw(htab->tbl));
 	kfree(htab);
 }
 
+static void htab_lru_map_show_fdinfo(const struct bpf_map *map,
+				     struct seq_file *m)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+
+	bpf_lru_show_fdinfo(&htab->lru, m);
+}
+
+/*
+ * Batched lookup goes a bucket at a time, with the bucket index as the
+ * cursor in in_batch/out_batch, so that no key is looked up twice and
+ * deleting what was copied out doesn't upset the walk.  A bucket is
+ * copied whole or not at all: if the first one left doesn't fit in what
+ * userspace asked for, that's -ENOSPC.
+ */
+static int
+__htab_map_lookup_and_delete_batch(struct bpf_map *map,
+				   const union bpf_attr *attr,
+				   union bpf_attr __user *uattr,
+				   bool do_delete, bool is_lru_map,
+				   bool is_percpu)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	u32 bucket_cnt, total, key_size, value_size, roundup_key_size;
+	void *keys = NULL, *values = NULL, *value, *dst_key, *dst_val;
+	void __user *uvalues = u64_to_user_ptr(attr->batch.values);
+	void __user *ukeys = u64_to_user_ptr(attr->batch.keys);
+	void __user *ubatch = u64_to_user_ptr(attr->batch.in_batch);
+	u32 batch, max_count, size, bucket_size;
+	struct htab_elem *node_to_free = NULL;
+	struct hlist_nulls_head *head;
+	struct bucket_table *tbl;
+	struct hlist_nulls_node *n;
+	unsigned long flags = 0;
+	bool locked = false;
+	struct htab_elem *l;
+	struct bucket *b;
+	int ret = 0;
+
+	if (attr->batch.elem_flags || attr->batch.flags)
+		return -EINVAL;
+
+	/* A bucket index means nothing once the map has been resized */
+	if (htab_is_resizable(htab)) {
+		if (do_delete)
+			return -ENOTSUPP;
+		return generic_map_lookup_batch(map, attr, uattr);
+	}
+	tbl = rcu_dereference_raw(htab->tbl);
+
+	max_count = attr->batch.count;
+	if (!max_count)
+		return 0;
+
+	if (put_user(0, &uattr->batch.count))
+		return -EFAULT;
+
+	batch = 0;
+	if (ubatch && copy_from_user(&batch, ubatch, sizeof(batch)))
+		return -EFAULT;
+
+	if (batch >= tbl->n_buckets)
+		return -ENOENT;
+
+	key_size = htab->map.key_size;
+	roundup_key_size = round_up(htab->map.key_size, 8);
+	value_size = htab->map.value_size;
+	size = round_up(value_size, 8);
+	if (is_percpu)
+		value_size = size * num_possible_cpus();
+	total = 0;
+	/* Room for a few elements per bucket to start with, grown below */
+	bucket_size = 5;
+
+alloc:
+	keys = kvmalloc_array(key_size, bucket_size, GFP_USER | __GFP_NOWARN);
+	values = kvmalloc_array(value_size, bucket_size, GFP_USER | __GFP_NOWARN);
+	if (!keys || !values) {
+		ret = -ENOMEM;
+		goto after_loop;
+	}
+
+again:
+	preempt_disable();
+	this_cpu_inc(bpf_prog_active);
+	rcu_read_lock();
+again_nocopy:
+	dst_key = keys;
+	dst_val = values;
+	b = &tbl->buckets[batch];
+	head = &b->head;
+
+	/* Empty buckets are common in a sparse table: don't lock those */
+	bucket_cnt = 0;
+	hlist_nulls_for_each_entry_rcu(l, n, head, hash_node)
+		bucket_cnt++;
+
+	if (bucket_cnt) {
+		raw_spin_lock_irqsave(&b->lock, flags);
+		locked = true;
+		/* Count again, now that the bucket can't change under us */
+		bucket_cnt = 0;
+		hlist_nulls_for_each_entry_rcu(l, n, head, hash_node)
+			bucket_cnt++;
+	}
+
+	if (bucket_cnt > (max_count - total) || bucket_cnt > bucket_size) {
+		bool grow = bucket_cnt <= (max_count - total);
+
+		if (locked) {
+			raw_spin_unlock_irqrestore(&b->lock, flags);
+			locked = false;
+		}
+		rcu_read_unlock();
+		this_cpu_dec(bpf_prog_active);
+		preempt_enable();
+
+		if (!grow) {
+			if (total == 0)
+				ret = -ENOSPC;
+			goto after_loop;
+		}
+
+		bucket_size = bucket_cnt;
+		kvfree(keys);
+		kvfree(values);
+		goto alloc;
+	}
+
+	if (!bucket_cnt)
+		goto next_batch;
+
+	hlist_nulls_for_each_entry_safe(l, n, head, hash_node) {
+		memcpy(dst_key, l->key, key_size);
+
+		if (is_percpu) {
+			void __percpu *pptr;
+			int off = 0, cpu;
+
+			pptr = htab_elem_get_ptr(l, map->key_size);
+			for_each_possible_cpu(cpu) {
+				bpf_long_memcpy(dst_val + off,
+						per_cpu_ptr(pptr, cpu), size);
+				off += size;
+			}
+		} else {
+			value = l->key + roundup_key_size;
+			memcpy(dst_val, value, value_size);
+		}
+
+		if (do_delete) {
+			hlist_nulls_del_rcu(&l->hash_node);
+
+			/* The LRU lists have locks of their own, which can't
+			 * nest in the bucket lock: free once it's dropped.
+			 */
+			if (is_lru_map) {
+				l->batch_flink = node_to_free;
+				node_to_free = l;
+			} else {
+				free_htab_elem(htab, l);
+			}
+		}
+		dst_key += key_size;
+		dst_val += value_size;
+	}
+
+	raw_spin_unlock_irqrestore(&b->lock, flags);
+	locked = false;
+
+	while (node_to_free) {
+		l = node_to_free;
+		node_to_free = node_to_free->batch_flink;
+		bpf_lru_push_free(&htab->lru, &l->lru_node);
+	}
+
+next_batch:
+	/* Nothing to copy out: go on to the next bucket straight away */
+	if (!bucket_cnt && (batch + 1 < tbl->n_buckets)) {
+		batch++;
+		goto again_nocopy;
+	}
+
+	rcu_read_unlock();
+	this_cpu_dec(bpf_prog_active);
+	preempt_enable();
+	if (bucket_cnt && (copy_to_user(ukeys + total * key_size, keys,
+					key_size * bucket_cnt) ||
+			   copy_to_user(uvalues + total * value_size, values,
+					value_size * bucket_cnt))) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	total += bucket_cnt;
+	batch++;
+	if (batch >= tbl->n_buckets) {
+		ret = -ENOENT;
+		goto after_loop;
+	}
+	goto again;
+
+after_loop:
+	if (ret == -EFAULT)
+		goto out;
+
+	/* Tell userspace how many were copied and where to go on from */
+	ubatch = u64_to_user_ptr(attr->batch.out_batch);
+	if (copy_to_user(ubatch, &batch, sizeof(batch)) ||
+	    put_user(total, &uattr->batch.count))
+		ret = -EFAULT;
+
+out:
+	kvfree(keys);
+	kvfree(values);
+	return ret;
+}
+
+static int
+htab_map_lookup_batch(struct bpf_map *map, const union bpf_attr *attr,
+		      union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, false,
+						  false, false);
+}
+
+static int
+htab_map_lookup_and_delete_batch(struct bpf_map *map,
+				 const union bpf_attr *attr,
+				 union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, true,
+						  false, false);
+}
+
+static int
+htab_lru_map_lookup_batch(struct bpf_map *map, const union bpf_attr *attr,
+			  union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, false,
+						  true, false);
+}
+
+static int
+htab_lru_map_lookup_and_delete_batch(struct bpf_map *map,
+				     const union bpf_attr *attr,
+				     union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, true,
+						  true, false);
+}
+
+static int
+htab_percpu_map_lookup_batch(struct bpf_map *map, const union bpf_attr *attr,
+			     union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, false,
+						  false, true);
+}
+
+static int
+htab_percpu_map_lookup_and_delete_batch(struct bpf_map *map,
+					const union bpf_attr *attr,
+					union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, true,
+						  false, true);
+}
+
+static int
+htab_lru_percpu_map_lookup_batch(struct bpf_map *map,
+				 const union bpf_attr *attr,
+				 union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, false,
+						  true, true);
+}
+
+static int
+htab_lru_percpu_map_lookup_and_delete_batch(struct bpf_map *map,
+					    const union bpf_attr *attr,
+					    union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, true,
+						  true, true);
+}
+
 const struct bpf_map_ops htab_map_ops = {
 	.map_alloc = htab_map_alloc,
 	.map_free = htab_map_free,
@@ -1105,6 +1617,10 @@ const struct bpf_map_ops htab_map_ops = {
 	.map_update_elem = htab_map_update_elem,
 	.map_delete_elem = htab_map_delete_elem,
 	.map_gen_lookup = htab_map_gen_lookup,
+	.map_lookup_batch = htab_map_lookup_batch,
+	.map_lookup_and_delete_batch = htab_map_lookup_and_delete_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
 };
 
 const struct bpf_map_ops htab_lru_map_ops = {
@@ -1114,6 +1630,11 @@ const struct bpf_map_ops htab_lru_map_ops = {
 	.map_lookup_elem = htab_lru_map_lookup_elem,
 	.map_update_elem = htab_lru_map_update_elem,
 	.map_delete_elem = htab_lru_map_delete_elem,
+	.map_lookup_batch = htab_lru_map_lookup_batch,
+	.map_lookup_and_delete_batch = htab_lru_map_lookup_and_delete_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
+	.map_show_fdinfo = htab_lru_map_show_fdinfo,
 };
 
 /* Called from eBPF program */
@@ -1196,6 +1717,10 @@ const struct bpf_map_ops htab_percpu_map_ops = {
 	.map_lookup_elem = htab_percpu_map_lookup_elem,
 	.map_update_elem = htab_percpu_map_update_elem,
 	.map_delete_elem = htab_map_delete_elem,
+	.map_lookup_batch = htab_percpu_map_lookup_batch,
+	.map_lookup_and_delete_batch = htab_percpu_map_lookup_and_delete_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
 };
 
 const struct bpf_map_ops htab_lru_percpu_map_ops = {
@@ -1205,6 +1730,10 @@ const struct bpf_map_ops htab_lru_percpu_map_ops = {
 	.map_lookup_elem = htab_lru_percpu_map_lookup_elem,
 	.map_update_elem = htab_lru_percpu_map_update_elem,
 	.map_delete_elem = htab_lru_map_delete_elem,
+	.map_lookup_batch = htab_lru_percpu_map_lookup_batch,
+	.map_lookup_and_delete_batch = htab_lru_percpu_map_lookup_and_delete_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
 };
 
 static struct bpf_map *fd_htab_map_alloc(union bpf_attr *attr)
@@ -1227,11 +1756,18 @@ static void fd_htab_map_free(struct bpf_map *map)
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
 	struct hlist_nulls_node *n;
 	struct hlist_nulls_head *head;
+	struct bucket_table *tbl;
 	struct htab_elem *l;
 	int i;
 
-	for (i = 0; i < htab->n_buckets; i++) {
-		head = select_bucket(htab, i);
+	/* the last delete may have queued a resize: let it finish */
+	if (htab_is_resizable(htab))
+		cancel_work_sync(&htab->resize_work);
+
+	tbl = rcu_dereference_raw(htab->tbl);
+
+	for (i = 0; i < tbl->n_buckets; i++) {
+		head = select_bucket(tbl, i);
 
 		hlist_nulls_for_each_entry_safe(l, n, head, hash_node) {
 			void *ptr = fd_htab_map_get_ptr(map, l);
@@ -14,6 +14,7 @@
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include <net/ipv6.h>
 
 /* Intermediate node */
@@ -29,6 +30,29 @@ struct lpm_trie_node {
 	u8				data[0];
 };
 
+/* Multibit lookup snapshot, see below */
+#define LPM_MB_STRIDE		4
+#define LPM_MB_FANOUT		(1 << LPM_MB_STRIDE)
+#define LPM_MB_LEAF		BIT(31)
+#define LPM_MB_CHILD		(LPM_MB_LEAF - 1)
+#define LPM_MB_NODES_PER_ENTRY	4
+#define LPM_MB_REBUILD_DELAY	(HZ / 10)
+
+/* One cache line: the low 31 bits of each entry index the child node */
+struct lpm_mb_node {
+	u32				entry[LPM_MB_FANOUT];
+};
+
+struct lpm_trie_mb {
+	struct rcu_head			rcu;
+	unsigned long			gen;
+	u32				nr_nodes;
+	u32				cap_nodes;
+	u32				max_nodes;
+	struct lpm_mb_node		*nodes;
+	struct lpm_trie_node		**leaves;
+};
+
 struct lpm_trie {
 	struct bpf_map			map;
 	struct lpm_trie_node __rcu	*root;
@@ -36,6 +60,10 @@ struct lpm_trie {
 	size_t				max_prefixlen;
 	size_t				data_size;
 	raw_spinlock_t			lock;
+	/* Odd while an update is in progress */
+	unsigned long			gen;
+	struct lpm_trie_mb __rcu	*mb;
+	struct delayed_work		mb_work;
 };
 
 /* This trie implements a longest prefix match algorithm that can be used to
@@ -147,6 +175,20 @@ struct lpm_trie {
  * is a child that can be used to become more specific, the trie is traversed
  * downwards. The last node in the traversal that is a non-intermediate one is
  * returned.
+ *
+ * Walking that trie costs a pointer chase and a longest_prefix_match() per
+ * level, so full-length lookups normally go through a second, read-only
+ * copy of it instead: a multibit trie that consumes LPM_MB_STRIDE bits of
+ * the key per level, with every prefix expanded over the entries of the
+ * node it ends in (controlled prefix expansion). Each node is an array of
+ * 16 u32 entries, one cache line, holding the index of the child node and
+ * a flag saying whether the entry has a match; the matching trie nodes
+ * sit in a parallel array that is only read once, at the end of the walk.
+ *
+ * The copy is rebuilt from the binary trie by a work item at most every
+ * LPM_MB_REBUILD_DELAY, so that a burst of updates costs one rebuild. The
+ * trie's generation count tells lookups whether the copy is current; until
+ * the rebuild, they fall back to the binary trie.
  */
 
 static inline int extract_bit(const u8 *data, size_t index)
@@ -185,12 +227,48 @@ static size_t longest_prefix_match(const struct lpm_trie *trie,
 	return prefixlen;
 }
 
+static inline unsigned int lpm_mb_index(const u8 *data, size_t pos)
+{
+	return (data[pos / 8] >> (pos % 8 ? 0 : 4)) & (LPM_MB_FANOUT - 1);
+}
+
+static struct lpm_trie_node *lpm_mb_lookup(const struct lpm_trie_mb *mb,
+					   const u8 *data)
+{
+	u32 n = 0, best = 0, e;
+	bool found = false;
+	size_t pos = 0;
+
+	do {
+		unsigned int i = lpm_mb_index(data, pos);
+
+		e = mb->nodes[n].entry[i];
+		if (e & LPM_MB_LEAF) {
+			best = n * LPM_MB_FANOUT + i;
+			found = true;
+		}
+		n = e & LPM_MB_CHILD;
+		pos += LPM_MB_STRIDE;
+	} while (n);
+
+	return found ? mb->leaves[best] : NULL;
+}
+
 /* Called from syscall or from eBPF program */
 static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 {
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
 	struct lpm_trie_node *node, *found = NULL;
 	struct bpf_lpm_trie_key *key = _key;
+	struct lpm_trie_mb *mb;
+
+	if (key->prefixlen == trie->max_prefixlen) {
+		mb = rcu_dereference(trie->mb);
+		if (mb && mb->gen == READ_ONCE(trie->gen)) {
+			found = lpm_mb_lookup(mb, key->data);
+			goto out;
+		}
+	}
 
 	/* Start walking the trie from the root node ... */
 
@@ -229,6 +307,7 @@ static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 		node = rcu_dereference(node->child[next_bit]);
 	}
 
+out:
 	if (!found)
 		return NULL;
 
@@ -257,12 +336,205 @@ static struct lpm_trie_node *lpm_trie_node_alloc(const struct lpm_trie *trie,
 	return node;
 }
 
+static void lpm_mb_free(struct lpm_trie_mb *mb)
+{
+	if (!mb)
+		return;
+	kvfree(mb->nodes);
+	kvfree(mb->leaves);
+	kfree(mb);
+}
+
+static void lpm_mb_free_rcu(struct rcu_head *head)
+{
+	lpm_mb_free(container_of(head, struct lpm_trie_mb, rcu));
+}
+
+/* Returns the index of a new, empty node */
+static int lpm_mb_node_alloc(struct lpm_trie_mb *mb)
+{
+	struct lpm_trie_node **leaves;
+	struct lpm_mb_node *nodes;
+	u32 cap;
+
+	if (mb->nr_nodes >= mb->max_nodes)
+		return -E2BIG;
+
+	if (mb->nr_nodes == mb->cap_nodes) {
+		cap = mb->cap_nodes ? min_t(u64, (u64)mb->cap_nodes * 2,
+					    mb->max_nodes) : 64;
+		nodes = kvzalloc(cap * sizeof(*nodes), GFP_KERNEL);
+		leaves = kvzalloc(cap * LPM_MB_FANOUT * sizeof(*leaves),
+				  GFP_KERNEL);
+		if (!nodes || !leaves) {
+			kvfree(nodes);
+			kvfree(leaves);
+			return -ENOMEM;
+		}
+		if (mb->nodes) {
+			memcpy(nodes, mb->nodes, mb->nr_nodes * sizeof(*nodes));
+			memcpy(leaves, mb->leaves, mb->nr_nodes *
+			       LPM_MB_FANOUT * sizeof(*leaves));
+			kvfree(mb->nodes);
+			kvfree(mb->leaves);
+		}
+		mb->nodes = nodes;
+		mb->leaves = leaves;
+		mb->cap_nodes = cap;
+	}
+
+	return mb->nr_nodes++;
+}
+
+/*
+ * Add one prefix to the multibit trie.  Prefixes must come in an order
+ * where a prefix follows those containing it, so that more specific
+ * matches overwrite less specific ones in the entries they share.
+ */
+static int lpm_mb_insert(struct lpm_trie_mb *mb, const u8 *data,
+			 u32 prefixlen, struct lpm_trie_node *leaf)
+{
+	u32 depth = prefixlen ? (prefixlen - 1) / LPM_MB_STRIDE : 0;
+	u32 n = 0, d, r, i, base;
+	int child;
+
+	for (d = 0; d < depth; d++) {
+		i = lpm_mb_index(data, d * LPM_MB_STRIDE);
+		child = mb->nodes[n].entry[i] & LPM_MB_CHILD;
+		if (!child) {
+			child = lpm_mb_node_alloc(mb);
+			if (child < 0)
+				return child;
+			mb->nodes[n].entry[i] |= child;
+		}
+		n = child;
+	}
+
+	r = prefixlen - depth * LPM_MB_STRIDE;
+	base = r ? lpm_mb_index(data, depth * LPM_MB_STRIDE) &
+		   ~((1U << (LPM_MB_STRIDE - r)) - 1) : 0;
+	for (i = base; i < base + (1U << (LPM_MB_STRIDE - r)); i++) {
+		mb->nodes[n].entry[i] |= LPM_MB_LEAF;
+		mb->leaves[n * LPM_MB_FANOUT + i] = leaf;
+	}
+
+	return 0;
+}
+
+/*
+ * Build a multibit copy of the trie as of generation @gen.  It runs
+ * without the trie lock, against concurrent updates: the walk is done
+ * under RCU, copying out the prefixes, and the caller drops the result if
+ * the generation moved meanwhile.
+ */
+static struct lpm_trie_mb *lpm_mb_build(struct lpm_trie *trie,
+					unsigned long gen)
+{
+	size_t rec_size = ALIGN(sizeof(void *) + sizeof(u32) +
+				trie->data_size, sizeof(void *));
+	struct lpm_trie_node *node, *child, **stack;
+	size_t nr = 0, max, top = 0, i;
+	struct lpm_trie_mb *mb;
+	u8 *recs, *rec;
+	int err = 0;
+
+	max = READ_ONCE(trie->n_entries);
+	stack = kmalloc((trie->max_prefixlen + 2) * sizeof(*stack),
+			GFP_KERNEL);
+	recs = kvmalloc(max_t(size_t, max, 1) * rec_size, GFP_KERNEL);
+	mb = kzalloc(sizeof(*mb), GFP_KERNEL);
+	if (!stack || !recs || !mb)
+		goto err;
+
+	/* Pre-order, so that each prefix comes after those containing it */
+	rcu_read_lock();
+	node = rcu_dereference(trie->root);
+	if (node)
+		stack[top++] = node;
+	while (top) {
+		node = stack[--top];
+		if (!(node->flags & LPM_TREE_NODE_FLAG_IM)) {
+			if (nr == max) {
+				err = -EAGAIN;
+				break;
+			}
+			rec = recs + nr++ * rec_size;
+			*(struct lpm_trie_node **)rec = node;
+			*(u32 *)(rec + sizeof(void *)) = node->prefixlen;
+			memcpy(rec + sizeof(void *) + sizeof(u32), node->data,
+			       trie->data_size);
+		}
+		child = rcu_dereference(node->child[1]);
+		if (child)
+			stack[top++] = child;
+		child = rcu_dereference(node->child[0]);
+		if (child)
+			stack[top++] = child;
+	}
+	rcu_read_unlock();
+	if (err)
+		goto err;
+
+	mb->gen = gen;
+	mb->max_nodes = min_t(u64, (u64)trie->map.max_entries *
+			      LPM_MB_NODES_PER_ENTRY + 1,
+			      U32_MAX / (LPM_MB_FANOUT * sizeof(void *)));
+	/* The root, node 0; no entry can point back to it */
+	if (lpm_mb_node_alloc(mb) < 0)
+		goto err;
+	for (i = 0; i < nr; i++) {
+		rec = recs + i * rec_size;
+		if (lpm_mb_insert(mb, rec + sizeof(void *) + sizeof(u32),
+				  *(u32 *)(rec + sizeof(void *)),
+				  *(struct lpm_trie_node **)rec))
+			goto err;
+	}
+
+	kvfree(recs);
+	kfree(stack);
+	return mb;
+err:
+	lpm_mb_free(mb);
+	kvfree(recs);
+	kfree(stack);
+	return NULL;
+}
+
+static void lpm_mb_rebuild(struct work_struct *work)
+{
+	struct lpm_trie *trie = container_of(to_delayed_work(work),
+					     struct lpm_trie, mb_work);
+	struct lpm_trie_mb *mb, *old;
+	unsigned long gen;
+
+	/* An update in progress will queue us again when it is done */
+	gen = READ_ONCE(trie->gen);
+	if (gen & 1)
+		return;
+	smp_rmb(); /* Read ->gen before walking the trie. */
+
+	mb = lpm_mb_build(trie, gen);
+
+	smp_rmb(); /* Walk the trie before rechecking ->gen. */
+	if (mb && READ_ONCE(trie->gen) != gen) {
+		lpm_mb_free(mb);
+		return;
+	}
+
+	/* Only this work item ever changes ->mb, besides trie_free() */
+	old = rcu_dereference_protected(trie->mb, 1);
+	rcu_assign_pointer(trie->mb, mb);
+	if (old)
+		call_rcu(&old->rcu, lpm_mb_free_rcu);
+}
+
 /* Called from syscall or from eBPF program */
 static int trie_update_elem(struct bpf_map *map,
 			    void *_key, void *value, u64 flags)
 {
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
 	struct lpm_trie_node *node, *im_node = NULL, *new_node = NULL;
+	struct lpm_trie_node *free_node = NULL;
 	struct lpm_trie_node __rcu **slot;
 	struct bpf_lpm_trie_key *key = _key;
 	unsigned long irq_flags;
@@ -278,6 +550,10 @@ static int trie_update_elem(struct bpf_map *map,
 
 	raw_spin_lock_irqsave(&trie->lock, irq_flags);
 
+	/* Make lookups ignore the multibit copy from here on */
+	WRITE_ONCE(trie->gen, trie->gen + 1);
+	smp_wmb(); /* ->gen update before trie changes. */
+
 	/* Allocate and fill a new node */
 
 	if (trie->n_entries == trie->map.max_entries) {
@@ -337,7 +613,7 @@ static int trie_update_elem(struct bpf_map *map,
 			trie->n_entries--;
 
 		rcu_assign_pointer(*slot, new_node);
-		kfree_rcu(node, rcu);
+		free_node = node;
 
 		goto out;
 	}
@@ -383,8 +659,20 @@ out:
 		kfree(im_node);
 	}
 
+	/*
+	 * The old node may only be freed once no lookup can reach it through
+	 * a multibit copy that predates this update.
+	 */
+	smp_wmb(); /* Trie changes before ->gen update. */
+	WRITE_ONCE(trie->gen, trie->gen + 1);
+	if (free_node)
+		kfree_rcu(free_node, rcu);
+
 	raw_spin_unlock_irqrestore(&trie->lock, irq_flags);
 
+	if (!ret)
+		schedule_delayed_work(&trie->mb_work, LPM_MB_REBUILD_DELAY);
+
 	return ret;
 }
 
@@ -452,6 +740,7 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 		goto out_err;
 
 	raw_spin_lock_init(&trie->lock);
+	INIT_DELAYED_WORK(&trie->mb_work, lpm_mb_rebuild);
 
 	return &trie->map;
 out_err:
@@ -465,6 +754,9 @@ static void trie_free(struct bpf_map *map)
 	struct lpm_trie_node __rcu **slot;
 	struct lpm_trie_node *node;
 
+	cancel_delayed_work_sync(&trie->mb_work);
+	lpm_mb_free(rcu_dereference_protected(trie->mb, 1));
+
 	raw_spin_lock(&trie->lock);
 
 	/* Always start at the root and walk down to a node that has no
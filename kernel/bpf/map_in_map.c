@@ -28,6 +28,14 @@ struct bpf_map *bpf_map_meta_alloc(int inner_map_ufd)
 		return ERR_PTR(-ENOTSUPP);
 	}
 
+	/* The ringbuf helpers need the ring behind the map, which
+	 * inner_map_meta doesn't have.
+	 */
+	if (inner_map->map_type == BPF_MAP_TYPE_RINGBUF) {
+		fdput(f);
+		return ERR_PTR(-ENOTSUPP);
+	}
+
 	/* Does not support >1 level map-in-map */
 	if (inner_map->inner_map_meta) {
 		fdput(f);
@@ -9,6 +9,9 @@
 #include <linux/filter.h>
 #include <linux/stacktrace.h>
 #include <linux/perf_event.h>
+#include <linux/elf.h>
+#include <linux/pagemap.h>
+#include <linux/irq_work.h>
 #include "percpu_freelist.h"
 
 struct stack_map_bucket {
@@ -18,14 +21,76 @@ struct stack_map_bucket {
 	u64 ip[];
 };
 
+/*
+ * With BPF_F_STACK_DEDUP, a stackid names a record, not a bucket.  The
+ * records hang off the hash buckets in chains, so stacks that collide
+ * are both kept, and hold their frames in a chain of fixed-size chunks
+ * from an arena shared by all stacks, so a short stack takes little
+ * room.  Programs add records with cmpxchg() on the chain head, as they
+ * may run in NMI context; unlinking them is serialized by unlink_lock.
+ */
+#define STACK_CHUNK_SIZE	120
+
+struct stack_map_chunk {
+	union {
+		struct pcpu_freelist_node fnode;
+		struct stack_map_chunk *next;
+	};
+	u8 data[STACK_CHUNK_SIZE];
+};
+
+struct stack_map_rec {
+	struct pcpu_freelist_node fnode;
+	struct stack_map_rec *next;
+	struct stack_map_chunk *chunks;
+	u32 hash;
+	/* in bytes, 0 if the record is free */
+	u32 len;
+};
+
 struct bpf_stack_map {
 	struct bpf_map map;
 	void *elems;
 	struct pcpu_freelist freelist;
 	u32 n_buckets;
+	/* BPF_F_STACK_DEDUP: elems and freelist are the records */
+	struct stack_map_rec **chains;
+	void *chunks;
+	struct pcpu_freelist chunk_freelist;
+	raw_spinlock_t unlink_lock;
+	/* BPF_F_STACK_BUILD_ID: where frames are turned into build ids */
+	void __percpu *scratch;
 	struct stack_map_bucket *buckets[];
 };
 
+static inline bool stack_map_use_dedup(struct bpf_map *map)
+{
+	return map->map_flags & BPF_F_STACK_DEDUP;
+}
+
+static inline bool stack_map_use_build_id(struct bpf_map *map)
+{
+	return map->map_flags & BPF_F_STACK_BUILD_ID;
+}
+
+static inline int stack_map_data_size(struct bpf_map *map)
+{
+	return stack_map_use_build_id(map) ?
+		sizeof(struct bpf_stack_build_id) : sizeof(u64);
+}
+
+/*
+ * The arena is sized for stacks a quarter of value_size deep on average,
+ * though never so small that a full set of one-chunk stacks doesn't fit.
+ */
+static u32 stack_map_dedup_nr_chunks(u32 max_entries, u32 value_size)
+{
+	u64 bytes = (u64)max_entries * value_size / 4;
+
+	return max_t(u64, max_entries,
+		     DIV_ROUND_UP_ULL(bytes, STACK_CHUNK_SIZE));
+}
+
 static int prealloc_elems_and_freelist(struct bpf_stack_map *smap)
 {
 	u32 elem_size = sizeof(struct stack_map_bucket) + smap->map.value_size;
@@ -48,30 +113,100 @@ free_elems:
 	return err;
 }
 
+static int prealloc_dedup(struct bpf_stack_map *smap)
+{
+	u32 nr_chunks = stack_map_dedup_nr_chunks(smap->map.max_entries,
+						  smap->map.value_size);
+	int err = -ENOMEM;
+
+	smap->elems = bpf_map_area_alloc(sizeof(struct stack_map_rec) *
+					 smap->map.max_entries);
+	if (!smap->elems)
+		return -ENOMEM;
+
+	smap->chains = bpf_map_area_alloc(sizeof(*smap->chains) *
+					  smap->n_buckets);
+	if (!smap->chains)
+		goto free_elems;
+
+	smap->chunks = bpf_map_area_alloc(sizeof(struct stack_map_chunk) *
+					  nr_chunks);
+	if (!smap->chunks)
+		goto free_chains;
+
+	if (stack_map_use_build_id(&smap->map)) {
+		smap->scratch = __alloc_percpu_gfp(smap->map.value_size, 8,
+						   GFP_USER | __GFP_NOWARN);
+		if (!smap->scratch)
+			goto free_chunks;
+	}
+
+	err = pcpu_freelist_init(&smap->freelist);
+	if (err)
+		goto free_scratch;
+
+	err = pcpu_freelist_init(&smap->chunk_freelist);
+	if (err)
+		goto free_freelist;
+
+	pcpu_freelist_populate(&smap->freelist, smap->elems,
+			       sizeof(struct stack_map_rec),
+			       smap->map.max_entries);
+	pcpu_freelist_populate(&smap->chunk_freelist, smap->chunks,
+			       sizeof(struct stack_map_chunk), nr_chunks);
+	raw_spin_lock_init(&smap->unlink_lock);
+	return 0;
+
+free_freelist:
+	pcpu_freelist_destroy(&smap->freelist);
+free_scratch:
+	free_percpu(smap->scratch);
+free_chunks:
+	bpf_map_area_free(smap->chunks);
+free_chains:
+	bpf_map_area_free(smap->chains);
+free_elems:
+	bpf_map_area_free(smap->elems);
+	return err;
+}
+
 /* Called from syscall */
 static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 {
 	u32 value_size = attr->value_size;
+	bool dedup = attr->map_flags & BPF_F_STACK_DEDUP;
 	struct bpf_stack_map *smap;
 	u64 cost, n_buckets;
+	u32 elem_size = 8;
 	int err;
 
 	if (!capable(CAP_SYS_ADMIN))
 		return ERR_PTR(-EPERM);
 
-	if (attr->map_flags)
+	if (attr->map_flags & ~(BPF_F_STACK_DEDUP | BPF_F_STACK_BUILD_ID))
 		return ERR_PTR(-EINVAL);
 
+	if (attr->map_flags & BPF_F_STACK_BUILD_ID) {
+		if (!dedup)
+			return ERR_PTR(-EINVAL);
+		elem_size = sizeof(struct bpf_stack_build_id);
+		if (value_size > PCPU_MIN_UNIT_SIZE)
+			return ERR_PTR(-E2BIG);
+	}
+
 	/* check sanity of attributes */
 	if (attr->max_entries == 0 || attr->key_size != 4 ||
-	    value_size < 8 || value_size % 8 ||
-	    value_size / 8 > sysctl_perf_event_max_stack)
+	    value_size < elem_size || value_size % elem_size ||
+	    value_size / elem_size > sysctl_perf_event_max_stack)
 		return ERR_PTR(-EINVAL);
 
 	/* hash table size must be power of 2 */
 	n_buckets = roundup_pow_of_two(attr->max_entries);
 
-	cost = n_buckets * sizeof(struct stack_map_bucket *) + sizeof(*smap);
+	/* the dedup chains are allocated on their own */
+	cost = sizeof(*smap);
+	if (!dedup)
+		cost += n_buckets * sizeof(struct stack_map_bucket *);
 	if (cost >= U32_MAX - PAGE_SIZE)
 		return ERR_PTR(-E2BIG);
 
@@ -80,7 +215,17 @@ static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 		return ERR_PTR(-ENOMEM);
 
 	err = -E2BIG;
-	cost += n_buckets * (value_size + sizeof(struct stack_map_bucket));
+	if (!dedup) {
+		cost += n_buckets * (value_size + sizeof(struct stack_map_bucket));
+	} else {
+		cost += n_buckets * sizeof(struct stack_map_rec *) +
+			(u64)attr->max_entries * sizeof(struct stack_map_rec) +
+			(u64)stack_map_dedup_nr_chunks(attr->max_entries,
+						       value_size) *
+			sizeof(struct stack_map_chunk);
+		if (attr->map_flags & BPF_F_STACK_BUILD_ID)
+			cost += (u64)value_size * num_possible_cpus();
+	}
 	if (cost >= U32_MAX - PAGE_SIZE)
 		goto free_smap;
 
@@ -100,7 +245,10 @@ static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 	if (err)
 		goto free_smap;
 
-	err = prealloc_elems_and_freelist(smap);
+	if (dedup)
+		err = prealloc_dedup(smap);
+	else
+		err = prealloc_elems_and_freelist(smap);
 	if (err)
 		goto put_buffers;
 
@@ -113,13 +261,345 @@ free_smap:
 	return ERR_PTR(err);
 }
 
+static void stack_map_chunks_free(struct bpf_stack_map *smap,
+				  struct stack_map_chunk *c)
+{
+	struct stack_map_chunk *next;
+
+	for (; c; c = next) {
+		next = c->next;
+		pcpu_freelist_push(&smap->chunk_freelist, &c->fnode);
+	}
+}
+
+static struct stack_map_chunk *
+stack_map_chunks_store(struct bpf_stack_map *smap, const void *data, u32 len)
+{
+	struct stack_map_chunk *first = NULL, **pnext = &first, *c;
+	u32 off, n;
+
+	for (off = 0; off < len; off += n) {
+		c = (struct stack_map_chunk *)
+			pcpu_freelist_pop(&smap->chunk_freelist);
+		if (unlikely(!c)) {
+			stack_map_chunks_free(smap, first);
+			return NULL;
+		}
+
+		n = min_t(u32, len - off, STACK_CHUNK_SIZE);
+		memcpy(c->data, data + off, n);
+		c->next = NULL;
+		*pnext = c;
+		pnext = &c->next;
+	}
+
+	return first;
+}
+
+static bool stack_map_chunks_equal(const struct stack_map_chunk *c,
+				   const void *data, u32 len)
+{
+	u32 off, n;
+
+	for (off = 0; off < len; off += n, c = READ_ONCE(c->next)) {
+		if (unlikely(!c))
+			return false;
+		n = min_t(u32, len - off, STACK_CHUNK_SIZE);
+		if (memcmp(c->data, data + off, n))
+			return false;
+	}
+
+	return true;
+}
+
+static void stack_map_chunks_copy(const struct stack_map_chunk *c,
+				  void *dst, u32 len)
+{
+	u32 off, n;
+
+	for (off = 0; off < len && c; off += n, c = c->next) {
+		n = min_t(u32, len - off, STACK_CHUNK_SIZE);
+		memcpy(dst + off, c->data, n);
+	}
+}
+
+/* Look for a stack in the chain, from first up to but excluding last */
+static struct stack_map_rec *stack_map_dedup_find(struct stack_map_rec *first,
+						  struct stack_map_rec *last,
+						  const void *data, u32 len,
+						  u32 hash, bool fast_cmp)
+{
+	struct stack_map_rec *rec;
+
+	for (rec = first; rec && rec != last; rec = READ_ONCE(rec->next)) {
+		if (rec->hash != hash || READ_ONCE(rec->len) != len)
+			continue;
+		if (fast_cmp || stack_map_chunks_equal(READ_ONCE(rec->chunks),
+						       data, len))
+			return rec;
+	}
+
+	return NULL;
+}
+
+static long stack_map_dedup_get_id(struct bpf_stack_map *smap,
+				   const void *data, u32 len, u32 hash,
+				   u64 flags)
+{
+	struct stack_map_rec **head = &smap->chains[hash & (smap->n_buckets - 1)];
+	struct stack_map_rec *recs = smap->elems, *rec, *first, *old;
+	bool fast_cmp = flags & BPF_F_FAST_STACK_CMP;
+
+	first = READ_ONCE(*head);
+	rec = stack_map_dedup_find(first, NULL, data, len, hash, fast_cmp);
+	if (rec)
+		return rec - recs;
+
+	rec = (struct stack_map_rec *)pcpu_freelist_pop(&smap->freelist);
+	if (unlikely(!rec))
+		return -ENOMEM;
+
+	rec->chunks = stack_map_chunks_store(smap, data, len);
+	if (unlikely(!rec->chunks)) {
+		pcpu_freelist_push(&smap->freelist, &rec->fnode);
+		return -ENOMEM;
+	}
+	rec->hash = hash;
+	rec->len = len;
+
+	for (;;) {
+		rec->next = first;
+		old = cmpxchg(head, first, rec);
+		if (old == first)
+			return rec - recs;
+
+		/* Someone else got in first: maybe with this very stack */
+		old = stack_map_dedup_find(old, first, data, len, hash,
+					   fast_cmp);
+		if (old) {
+			stack_map_chunks_free(smap, rec->chunks);
+			rec->len = 0;
+			pcpu_freelist_push(&smap->freelist, &rec->fnode);
+			return old - recs;
+		}
+		first = READ_ONCE(*head);
+	}
+}
+
+/*
+ * Build ids of the files user frames are in, from the ELF notes in their
+ * first page; frames whose build id can't be had keep their ip.
+ */
+#define BPF_BUILD_ID 3
+
+/* mmap_sem can't be released from NMI context: leave it to an irq_work */
+struct stack_map_irq_work {
+	struct irq_work irq_work;
+	struct rw_semaphore *sem;
+};
+
+static void do_up_read(struct irq_work *entry)
+{
+	struct stack_map_irq_work *work;
+
+	work = container_of(entry, struct stack_map_irq_work, irq_work);
+	up_read_non_owner(work->sem);
+	work->sem = NULL;
+}
+
+static DEFINE_PER_CPU(struct stack_map_irq_work, up_read_work);
+
+static int stack_map_parse_build_id(void *page_addr,
+				    unsigned char *build_id,
+				    void *note_start,
+				    Elf32_Word note_size)
+{
+	Elf32_Word note_offs = 0, new_offs;
+
+	/* check for overflow */
+	if (note_start < page_addr || note_start + note_size < note_start)
+		return -EINVAL;
+
+	/* only supports note that fits in the first page */
+	if (note_start + note_size > page_addr + PAGE_SIZE)
+		return -EINVAL;
+
+	while (note_offs + sizeof(Elf32_Nhdr) < note_size) {
+		Elf32_Nhdr *nhdr = (Elf32_Nhdr *)(note_start + note_offs);
+
+		if (nhdr->n_type == BPF_BUILD_ID &&
+		    nhdr->n_namesz == sizeof("GNU") &&
+		    nhdr->n_descsz == BPF_BUILD_ID_SIZE) {
+			memcpy(build_id,
+			       note_start + note_offs +
+			       ALIGN(sizeof("GNU"), 4) + sizeof(Elf32_Nhdr),
+			       BPF_BUILD_ID_SIZE);
+			return 0;
+		}
+		new_offs = note_offs + sizeof(Elf32_Nhdr) +
+			ALIGN(nhdr->n_namesz, 4) + ALIGN(nhdr->n_descsz, 4);
+		if (new_offs <= note_offs)  /* overflow */
+			break;
+		note_offs = new_offs;
+	}
+	return -EINVAL;
+}
+
+/* Parse build ID from 32-bit ELF */
+static int stack_map_get_build_id_32(void *page_addr,
+				     unsigned char *build_id)
+{
+	Elf32_Ehdr *ehdr = (Elf32_Ehdr *)page_addr;
+	Elf32_Phdr *phdr;
+	int i;
+
+	/* only supports phdr that fits in one page */
+	if (ehdr->e_phnum >
+	    (PAGE_SIZE - sizeof(Elf32_Ehdr)) / sizeof(Elf32_Phdr))
+		return -EINVAL;
+
+	phdr = (Elf32_Phdr *)(page_addr + sizeof(Elf32_Ehdr));
+
+	for (i = 0; i < ehdr->e_phnum; ++i)
+		if (phdr[i].p_type == PT_NOTE)
+			return stack_map_parse_build_id(page_addr, build_id,
+					page_addr + phdr[i].p_offset,
+					phdr[i].p_filesz);
+	return -EINVAL;
+}
+
+/* Parse build ID from 64-bit ELF */
+static int stack_map_get_build_id_64(void *page_addr,
+				     unsigned char *build_id)
+{
+	Elf64_Ehdr *ehdr = (Elf64_Ehdr *)page_addr;
+	Elf64_Phdr *phdr;
+	int i;
+
+	/* only supports phdr that fits in one page */
+	if (ehdr->e_phnum >
+	    (PAGE_SIZE - sizeof(Elf64_Ehdr)) / sizeof(Elf64_Phdr))
+		return -EINVAL;
+
+	phdr = (Elf64_Phdr *)(page_addr + sizeof(Elf64_Ehdr));
+
+	for (i = 0; i < ehdr->e_phnum; ++i)
+		if (phdr[i].p_type == PT_NOTE)
+			return stack_map_parse_build_id(page_addr, build_id,
+					page_addr + phdr[i].p_offset,
+					phdr[i].p_filesz);
+	return -EINVAL;
+}
+
+/* Parse build ID of ELF file mapped to vma */
+static int stack_map_get_build_id(struct vm_area_struct *vma,
+				  unsigned char *build_id)
+{
+	Elf32_Ehdr *ehdr;
+	struct page *page;
+	void *page_addr;
+	int ret;
+
+	/* only works for page backed storage  */
+	if (!vma->vm_file)
+		return -EINVAL;
+
+	page = find_get_page(vma->vm_file->f_mapping, 0);
+	if (!page)
+		return -EFAULT;	/* page not mapped */
+
+	ret = -EINVAL;
+	page_addr = kmap_atomic(page);
+	ehdr = (Elf32_Ehdr *)page_addr;
+
+	/* compare magic x7f "ELF" */
+	if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0)
+		goto out;
+
+	/* only support executable file and shared object file */
+	if (ehdr->e_type != ET_EXEC && ehdr->e_type != ET_DYN)
+		goto out;
+
+	if (ehdr->e_ident[EI_CLASS] == ELFCLASS32)
+		ret = stack_map_get_build_id_32(page_addr, build_id);
+	else if (ehdr->e_ident[EI_CLASS] == ELFCLASS64)
+		ret = stack_map_get_build_id_64(page_addr, build_id);
+out:
+	kunmap_atomic(page_addr);
+	put_page(page);
+	return ret;
+}
+
+static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
+					  u64 *ips, u32 trace_nr, bool user)
+{
+	struct stack_map_irq_work *work = NULL;
+	struct vm_area_struct *vma;
+	bool irq_work_busy = false;
+	int i;
+
+	if (in_nmi()) {
+		work = this_cpu_ptr(&up_read_work);
+		if (work->irq_work.flags & IRQ_WORK_BUSY)
+			/* cannot queue more up_read, fallback */
+			irq_work_busy = true;
+	}
+
+	/*
+	 * We cannot do up_read() in nmi context, so build_id lookup is
+	 * only supported for non-nmi events.  If at some point, it is
+	 * possible to run find_vma() without taking the semaphore, we
+	 * would like to allow build_id lookup in nmi context.
+	 *
+	 * Same fallback is used for kernel stack (!user) on a stackmap
+	 * with build_id.
+	 */
+	if (!user || !current || !current->mm || irq_work_busy ||
+	    down_read_trylock(&current->mm->mmap_sem) == 0) {
+		/* cannot access current->mm, fall back to ips */
+		for (i = 0; i < trace_nr; i++) {
+			id_offs[i].status = BPF_STACK_BUILD_ID_IP;
+			id_offs[i].ip = ips[i];
+			memset(id_offs[i].build_id, 0, BPF_BUILD_ID_SIZE);
+		}
+		return;
+	}
+
+	for (i = 0; i < trace_nr; i++) {
+		vma = find_vma(current->mm, ips[i]);
+		if (!vma || stack_map_get_build_id(vma, id_offs[i].build_id)) {
+			/* per entry fall back to ips */
+			id_offs[i].status = BPF_STACK_BUILD_ID_IP;
+			id_offs[i].ip = ips[i];
+			memset(id_offs[i].build_id, 0, BPF_BUILD_ID_SIZE);
+			continue;
+		}
+		id_offs[i].offset = (vma->vm_pgoff << PAGE_SHIFT) + ips[i]
+			- vma->vm_start;
+		id_offs[i].status = BPF_STACK_BUILD_ID_VALID;
+	}
+
+	if (!work) {
+		up_read(&current->mm->mmap_sem);
+	} else {
+		work->sem = &current->mm->mmap_sem;
+		irq_work_queue(&work->irq_work);
+		/*
+		 * The irq_work will release the mmap_sem with
+		 * up_read_non_owner(). The rwsem_release() is called
+		 * here to release the lock from lockdep's perspective.
+		 */
+		rwsem_release(&current->mm->mmap_sem.dep_map, 1, _RET_IP_);
+	}
+}
+
 BPF_CALL_3(bpf_get_stackid, struct pt_regs *, regs, struct bpf_map *, map,
 	   u64, flags)
 {
 	struct bpf_stack_map *smap = container_of(map, struct bpf_stack_map, map);
 	struct perf_callchain_entry *trace;
 	struct stack_map_bucket *bucket, *new_bucket, *old_bucket;
-	u32 max_depth = map->value_size / 8;
+	u32 max_depth = map->value_size / stack_map_data_size(map);
 	/* stack_map_alloc() checks that max_depth <= sysctl_perf_event_max_stack */
 	u32 init_nr = sysctl_perf_event_max_stack - max_depth;
 	u32 skip = flags & BPF_F_SKIP_FIELD_MASK;
@@ -151,6 +631,21 @@ BPF_CALL_3(bpf_get_stackid, struct pt_regs *, regs, struct bpf_map *, map,
 	trace_nr -= skip;
 	trace_len = trace_nr * sizeof(u64);
 	ips = trace->ip + skip + init_nr;
+
+	if (stack_map_use_dedup(map)) {
+		void *data = ips;
+
+		if (stack_map_use_build_id(map)) {
+			data = this_cpu_ptr(smap->scratch);
+			stack_map_get_build_id_offset(data, ips, trace_nr,
+						      user);
+			trace_len = trace_nr * sizeof(struct bpf_stack_build_id);
+		}
+		hash = jhash2(data, trace_len / sizeof(u32), 0);
+		return stack_map_dedup_get_id(smap, data, trace_len, hash,
+					      flags);
+	}
+
 	hash = jhash2((u32 *)ips, trace_len / sizeof(u32), 0);
 	id = hash & (smap->n_buckets - 1);
 	bucket = READ_ONCE(smap->buckets[id]);
@@ -197,6 +692,88 @@ static void *stack_map_lookup_elem(struct bpf_map *map, void *key)
 	return NULL;
 }
 
+/* unlink_lock can be wanted from NMI context, where it can only be tried */
+static bool stack_map_unlink_lock(struct bpf_stack_map *smap,
+				  unsigned long *flags)
+{
+	if (in_nmi()) {
+		if (!raw_spin_trylock(&smap->unlink_lock))
+			return false;
+		*flags = 0;
+		return true;
+	}
+	raw_spin_lock_irqsave(&smap->unlink_lock, *flags);
+	return true;
+}
+
+static void stack_map_unlink_unlock(struct bpf_stack_map *smap,
+				    unsigned long flags)
+{
+	if (in_nmi())
+		raw_spin_unlock(&smap->unlink_lock);
+	else
+		raw_spin_unlock_irqrestore(&smap->unlink_lock, flags);
+}
+
+/* Deleting a record waits for copies out of it, under unlink_lock */
+static int stack_map_dedup_copy(struct bpf_stack_map *smap, u32 id,
+				void *value)
+{
+	struct stack_map_rec *rec;
+	unsigned long flags;
+	u32 len;
+
+	if (unlikely(id >= smap->map.max_entries))
+		return -ENOENT;
+	rec = (struct stack_map_rec *)smap->elems + id;
+
+	stack_map_unlink_lock(smap, &flags);
+	len = rec->len;
+	if (len)
+		stack_map_chunks_copy(rec->chunks, value, len);
+	stack_map_unlink_unlock(smap, flags);
+
+	if (!len)
+		return -ENOENT;
+	memset(value + len, 0, smap->map.value_size - len);
+	return 0;
+}
+
+static int stack_map_dedup_delete(struct bpf_stack_map *smap, u32 id)
+{
+	struct stack_map_rec *rec, *prev, **head;
+	unsigned long flags;
+
+	if (unlikely(id >= smap->map.max_entries))
+		return -E2BIG;
+	rec = (struct stack_map_rec *)smap->elems + id;
+
+	if (!stack_map_unlink_lock(smap, &flags))
+		return -EBUSY;
+
+	if (!rec->len) {
+		stack_map_unlink_unlock(smap, flags);
+		return -ENOENT;
+	}
+
+	/* Adding records only ever changes the head of a chain */
+	head = &smap->chains[rec->hash & (smap->n_buckets - 1)];
+	if (cmpxchg(head, rec, rec->next) != rec) {
+		for (prev = READ_ONCE(*head); prev && prev->next != rec;
+		     prev = prev->next)
+			;
+		if (!WARN_ON_ONCE(!prev))
+			WRITE_ONCE(prev->next, rec->next);
+	}
+	WRITE_ONCE(rec->len, 0);
+
+	stack_map_unlink_unlock(smap, flags);
+
+	stack_map_chunks_free(smap, rec->chunks);
+	pcpu_freelist_push(&smap->freelist, &rec->fnode);
+	return 0;
+}
+
 /* Called from syscall */
 int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
 {
@@ -204,6 +781,9 @@ int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
 	struct stack_map_bucket *bucket, *old_bucket;
 	u32 id = *(u32 *)key, trace_len;
 
+	if (stack_map_use_dedup(map))
+		return stack_map_dedup_copy(smap, id, value);
+
 	if (unlikely(id >= smap->n_buckets))
 		return -ENOENT;
 
@@ -223,7 +803,23 @@ int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
 
 static int stack_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 {
-	return -EINVAL;
+	struct bpf_stack_map *smap = container_of(map, struct bpf_stack_map, map);
+	struct stack_map_rec *recs = smap->elems;
+	u32 id;
+
+	/* Only records can be walked: a bucket may be overwritten anytime */
+	if (!stack_map_use_dedup(map))
+		return -EINVAL;
+
+	id = key ? *(u32 *)key + 1 : 0;
+	for (; id < map->max_entries; id++) {
+		if (READ_ONCE(recs[id].len)) {
+			*(u32 *)next_key = id;
+			return 0;
+		}
+	}
+
+	return -ENOENT;
 }
 
 static int stack_map_update_elem(struct bpf_map *map, void *key, void *value,
@@ -239,6 +835,9 @@ static int stack_map_delete_elem(struct bpf_map *map, void *key)
 	struct stack_map_bucket *old_bucket;
 	u32 id = *(u32 *)key;
 
+	if (stack_map_use_dedup(map))
+		return stack_map_dedup_delete(smap, id);
+
 	if (unlikely(id >= smap->n_buckets))
 		return -E2BIG;
 
@@ -261,6 +860,12 @@ static void stack_map_free(struct bpf_map *map)
 
 	bpf_map_area_free(smap->elems);
 	pcpu_freelist_destroy(&smap->freelist);
+	if (stack_map_use_dedup(map)) {
+		pcpu_freelist_destroy(&smap->chunk_freelist);
+		bpf_map_area_free(smap->chunks);
+		bpf_map_area_free(smap->chains);
+		free_percpu(smap->scratch);
+	}
 	bpf_map_area_free(smap);
 	put_callchain_buffers();
 }
@@ -273,3 +878,16 @@ const struct bpf_map_ops stack_map_ops = {
 	.map_update_elem = stack_map_update_elem,
 	.map_delete_elem = stack_map_delete_elem,
 };
+
+static int __init stack_map_init(void)
+{
+	int cpu;
+	struct stack_map_irq_work *work;
+
+	for_each_possible_cpu(cpu) {
+		work = per_cpu_ptr(&up_read_work, cpu);
+		init_irq_work(&work->irq_work, do_up_read);
+	}
+	return 0;
+}
+subsys_initcall(stack_map_init);
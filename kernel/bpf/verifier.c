@@ -151,6 +151,7 @@ struct bpf_call_arg_meta {
 	bool pkt_access;
 	int regno;
 	int access_size;
+	u32 ringbuf_id;
 };
 
 /* verbose verifier prints what it's seeing
@@ -413,6 +414,16 @@ static void print_bpf_insn(const struct bpf_verifier_env *env,
 	}
 }
 
+/* Explored states are only freed at the end, so they all count */
+static void update_peak_mem(struct bpf_verifier_env *env)
+{
+	u64 mem;
+
+	mem = (u64)env->total_states * sizeof(struct bpf_verifier_state_list) +
+	      (u64)env->stack_size * sizeof(struct bpf_verifier_stack_elem);
+	env->peak_mem = max_t(u64, env->peak_mem, min_t(u64, mem, U32_MAX));
+}
+
 static int pop_stack(struct bpf_verifier_env *env, int *prev_insn_idx)
 {
 	struct bpf_verifier_stack_elem *elem;
@@ -447,6 +458,7 @@ static struct bpf_verifier_state *push_stack(struct bpf_verifier_env *env,
 	elem->next = env->head;
 	env->head = elem;
 	env->stack_size++;
+	update_peak_mem(env);
 	if (env->stack_size > BPF_COMPLEXITY_LIMIT_STACK) {
 		verbose("BPF program is too complex\n");
 		goto err;
@@ -521,9 +533,46 @@ enum reg_arg_type {
 	DST_OP_NO_MARK	/* same as above, check only, don't mark */
 };
 
-static int check_reg_arg(struct bpf_reg_state *regs, u32 regno,
+/* Liveness: a state's registers and spilled stack slots are marked
+ * REG_LIVE_READ once the code after it reads them without writing them
+ * first.  Explored states only have to match a later state in what they
+ * read, which lets far more states prune; each state records what was
+ * written since its parent, which screens the parent from later reads.
+ */
+static void mark_reg_read(const struct bpf_verifier_state *state, u32 regno)
+{
+	struct bpf_verifier_state *parent = state->parent;
+
+	while (parent) {
+		/* if read wasn't screened by an earlier write ... */
+		if (state->regs[regno].live & REG_LIVE_WRITTEN)
+			break;
+		/* ... then we depend on parent's value */
+		parent->regs[regno].live |= REG_LIVE_READ;
+		state = parent;
+		parent = state->parent;
+	}
+}
+
+static void mark_stack_slot_read(const struct bpf_verifier_state *state,
+				 int slot)
+{
+	struct bpf_verifier_state *parent = state->parent;
+
+	while (parent) {
+		if (state->spilled_regs[slot].live & REG_LIVE_WRITTEN)
+			break;
+		parent->spilled_regs[slot].live |= REG_LIVE_READ;
+		state = parent;
+		parent = state->parent;
+	}
+}
+
+static int check_reg_arg(struct bpf_verifier_env *env, u32 regno,
 			 enum reg_arg_type t)
 {
+	struct bpf_reg_state *regs = env->cur_state.regs;
+
 	if (regno >= MAX_BPF_REG) {
 		verbose("R%d is invalid\n", regno);
 		return -EINVAL;
@@ -535,12 +584,14 @@ static int check_reg_arg(struct bpf_reg_state *regs, u32 regno,
 			verbose("R%d !read_ok\n", regno);
 			return -EACCES;
 		}
+		mark_reg_read(&env->cur_state, regno);
 	} else {
 		/* check whether register used as dest operand can be written to */
 		if (regno == BPF_REG_FP) {
 			verbose("frame pointer is read only\n");
 			return -EACCES;
 		}
+		regs[regno].live |= REG_LIVE_WRITTEN;
 		if (t == DST_OP)
 			mark_reg_unknown_value(regs, regno);
 	}
@@ -588,6 +639,8 @@ static int check_stack_write(struct bpf_verifier_state *state, int off,
 		/* save register state */
 		state->spilled_regs[(MAX_BPF_STACK + off) / BPF_REG_SIZE] =
 			state->regs[value_regno];
+		state->spilled_regs[(MAX_BPF_STACK + off) / BPF_REG_SIZE].live =
+			REG_LIVE_WRITTEN;
 
 		for (i = 0; i < BPF_REG_SIZE; i++)
 			state->stack_slot_type[MAX_BPF_STACK + off + i] = STACK_SPILL;
@@ -622,10 +675,14 @@ static int check_stack_read(struct bpf_verifier_state *state, int off, int size,
 			}
 		}
 
-		if (value_regno >= 0)
+		mark_stack_slot_read(state,
+				     (MAX_BPF_STACK + off) / BPF_REG_SIZE);
+		if (value_regno >= 0) {
 			/* restore register state from stack */
 			state->regs[value_regno] =
 				state->spilled_regs[(MAX_BPF_STACK + off) / BPF_REG_SIZE];
+			state->regs[value_regno].live = REG_LIVE_WRITTEN;
+		}
 		return 0;
 	} else {
 		for (i = 0; i < size; i++) {
@@ -981,7 +1038,6 @@ static int check_mem_access(struct bpf_verifier_env *env, int insn_idx, u32 regn
 
 static int check_xadd(struct bpf_verifier_env *env, int insn_idx, struct bpf_insn *insn)
 {
-	struct bpf_reg_state *regs = env->cur_state.regs;
 	int err;
 
 	if ((BPF_SIZE(insn->code) != BPF_W && BPF_SIZE(insn->code) != BPF_DW) ||
@@ -991,12 +1047,12 @@ static int check_xadd(struct bpf_verifier_env *env, int insn_idx, struct bpf_ins
 	}
 
 	/* check src1 operand */
-	err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+	err = check_reg_arg(env, insn->src_reg, SRC_OP);
 	if (err)
 		return err;
 
 	/* check src2 operand */
-	err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+	err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 	if (err)
 		return err;
 
@@ -1101,6 +1157,7 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 regno,
 		verbose("R%d !read_ok\n", regno);
 		return -EACCES;
 	}
+	mark_reg_read(&env->cur_state, regno);
 
 	if (arg_type == ARG_ANYTHING) {
 		if (is_pointer_value(env, regno)) {
@@ -1137,6 +1194,10 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 regno,
 		expected_type = PTR_TO_CTX;
 		if (type != expected_type)
 			goto err_type;
+	} else if (arg_type == ARG_PTR_TO_RINGBUF_REC) {
+		expected_type = PTR_TO_MAP_VALUE;
+		if (type != expected_type)
+			goto err_type;
 	} else if (arg_type == ARG_PTR_TO_MEM ||
 		   arg_type == ARG_PTR_TO_UNINIT_MEM) {
 		expected_type = PTR_TO_STACK;
@@ -1158,6 +1219,18 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 regno,
 	if (arg_type == ARG_CONST_MAP_PTR) {
 		/* bpf_map_xxx(map_ptr) call: remember that map_ptr */
 		meta->map_ptr = reg->map_ptr;
+	} else if (arg_type == ARG_PTR_TO_RINGBUF_REC) {
+		/* bpf_ringbuf_submit(rec) call: rec must be the start of a
+		 * record that bpf_ringbuf_reserve() returned and that hasn't
+		 * been released yet; only those keep their id
+		 */
+		if (reg->map_ptr->map_type != BPF_MAP_TYPE_RINGBUF ||
+		    !reg->id) {
+			verbose("R%d is not a ringbuf record\n", regno);
+			return -EACCES;
+		}
+		meta->map_ptr = reg->map_ptr;
+		meta->ringbuf_id = reg->id;
 	} else if (arg_type == ARG_PTR_TO_MAP_KEY) {
 		/* bpf_map_xxx(..., map_ptr, ..., key) call:
 		 * check that [key, key + map->key_size) are within
@@ -1295,6 +1368,15 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 	case BPF_MAP_TYPE_HASH_OF_MAPS:
 		if (func_id != BPF_FUNC_map_lookup_elem)
 			goto error;
+		break;
+	case BPF_MAP_TYPE_RINGBUF:
+		if (func_id != BPF_FUNC_ringbuf_output &&
+		    func_id != BPF_FUNC_ringbuf_reserve &&
+		    func_id != BPF_FUNC_ringbuf_submit &&
+		    func_id != BPF_FUNC_ringbuf_discard &&
+		    func_id != BPF_FUNC_ringbuf_query)
+			goto error;
+		break;
 	default:
 		break;
 	}
@@ -1323,6 +1405,14 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 		if (map->map_type != BPF_MAP_TYPE_DEVMAP)
 			goto error;
 		break;
+	case BPF_FUNC_ringbuf_output:
+	case BPF_FUNC_ringbuf_reserve:
+	case BPF_FUNC_ringbuf_submit:
+	case BPF_FUNC_ringbuf_discard:
+	case BPF_FUNC_ringbuf_query:
+		if (map->map_type != BPF_MAP_TYPE_RINGBUF)
+			goto error;
+		break;
 	default:
 		break;
 	}
@@ -1375,6 +1465,36 @@ static void clear_all_pkt_pointers(struct bpf_verifier_env *env)
 	}
 }
 
+/* Once a ringbuf record is submitted or discarded, the consumer may
+ * have read it and another producer may own its space, so all copies of
+ * the pointer to it, adjusted or not, are gone.
+ */
+static void release_ringbuf_record(struct bpf_verifier_env *env, u32 id)
+{
+	struct bpf_verifier_state *state = &env->cur_state;
+	struct bpf_reg_state *regs = state->regs, *reg;
+	int i;
+
+	state->ringbuf_refs--;
+
+	for (i = 0; i < MAX_BPF_REG; i++)
+		if ((regs[i].type == PTR_TO_MAP_VALUE ||
+		     regs[i].type == PTR_TO_MAP_VALUE_ADJ) &&
+		    regs[i].id == id)
+			mark_reg_unknown_value(regs, i);
+
+	for (i = 0; i < MAX_BPF_STACK; i += BPF_REG_SIZE) {
+		if (state->stack_slot_type[i] != STACK_SPILL)
+			continue;
+		reg = &state->spilled_regs[i / BPF_REG_SIZE];
+		if ((reg->type != PTR_TO_MAP_VALUE &&
+		     reg->type != PTR_TO_MAP_VALUE_ADJ) || reg->id != id)
+			continue;
+		__mark_reg_unknown_value(state->spilled_regs,
+					 i / BPF_REG_SIZE);
+	}
+}
+
 static int check_call(struct bpf_verifier_env *env, int func_id, int insn_idx)
 {
 	struct bpf_verifier_state *state = &env->cur_state;
@@ -1404,6 +1524,12 @@ static int check_call(struct bpf_verifier_env *env, int func_id, int insn_idx)
 		return -EINVAL;
 	}
 
+	/* a tail call doesn't come back to release what we hold */
+	if (func_id == BPF_FUNC_tail_call && state->ringbuf_refs) {
+		verbose("tail_call would leak a ringbuf record\n");
+		return -EINVAL;
+	}
+
 	changes_data = bpf_helper_changes_pkt_data(fn->func);
 
 	memset(&meta, 0, sizeof(meta));
@@ -1445,9 +1571,14 @@ static int check_call(struct bpf_verifier_env *env, int func_id, int insn_idx)
 			return err;
 	}
 
+	if (meta.ringbuf_id)
+		release_ringbuf_record(env, meta.ringbuf_id);
+
 	/* reset caller saved regs */
-	for (i = 0; i < CALLER_SAVED_REGS; i++)
+	for (i = 0; i < CALLER_SAVED_REGS; i++) {
 		mark_reg_not_init(regs, caller_saved[i]);
+		check_reg_arg(env, caller_saved[i], DST_OP_NO_MARK);
+	}
 
 	/* update return register */
 	if (fn->ret_type == RET_INTEGER) {
@@ -1469,6 +1600,11 @@ static int check_call(struct bpf_verifier_env *env, int func_id, int insn_idx)
 		}
 		regs[BPF_REG_0].map_ptr = meta.map_ptr;
 		regs[BPF_REG_0].id = ++env->id_gen;
+		/* held until the NULL check says it wasn't reserved after
+		 * all, or until the program passes it back
+		 */
+		if (func_id == BPF_FUNC_ringbuf_reserve)
+			state->ringbuf_refs++;
 		insn_aux = &env->insn_aux_data[insn_idx];
 		if (!insn_aux->map_ptr)
 			insn_aux->map_ptr = meta.map_ptr;
@@ -1524,6 +1660,7 @@ add_imm:
 			/* R6=pkt(id=0,off=0,r=62) R7=imm22; r7 += r6 */
 			tmp_reg = *dst_reg;  /* save r7 state */
 			*dst_reg = *src_reg; /* copy pkt_ptr state r6 into r7 */
+			dst_reg->live |= REG_LIVE_WRITTEN;
 			src_reg = &tmp_reg;  /* pretend it's src_reg state */
 			/* if the checks below reject it, the copy won't matter,
 			 * since we're rejecting the whole program. If all ok,
@@ -1997,7 +2134,7 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check src operand */
-		err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+		err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 		if (err)
 			return err;
 
@@ -2008,7 +2145,7 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check dest operand */
-		err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+		err = check_reg_arg(env, insn->dst_reg, DST_OP);
 		if (err)
 			return err;
 
@@ -2021,7 +2158,7 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 			}
 
 			/* check src operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 		} else {
@@ -2032,7 +2169,7 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check dest operand */
-		err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+		err = check_reg_arg(env, insn->dst_reg, DST_OP);
 		if (err)
 			return err;
 
@@ -2047,6 +2184,7 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 				 * copy register state to dest reg
 				 */
 				regs[insn->dst_reg] = regs[insn->src_reg];
+				regs[insn->dst_reg].live |= REG_LIVE_WRITTEN;
 			} else {
 				if (is_pointer_value(env, insn->src_reg)) {
 					verbose("R%d partial copy of pointer\n",
@@ -2080,7 +2218,7 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 				return -EINVAL;
 			}
 			/* check src1 operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 		} else {
@@ -2091,7 +2229,7 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check src2 operand */
-		err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+		err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 		if (err)
 			return err;
 
@@ -2112,7 +2250,7 @@ static int check_alu_op(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		}
 
 		/* check dest operand */
-		err = check_reg_arg(regs, insn->dst_reg, DST_OP_NO_MARK);
+		err = check_reg_arg(env, insn->dst_reg, DST_OP_NO_MARK);
 		if (err)
 			return err;
 
@@ -2409,9 +2547,12 @@ static void mark_map_reg(struct bpf_reg_state *regs, u32 regno, u32 id,
 		}
 		/* We don't need id from this point onwards anymore, thus we
 		 * should better reset it, so that state pruning has chances
-		 * to take effect.
+		 * to take effect.  Ringbuf records keep theirs, it is what
+		 * bpf_ringbuf_submit() releases them by.
 		 */
-		reg->id = 0;
+		if (reg->type != PTR_TO_MAP_VALUE ||
+		    reg->map_ptr->map_type != BPF_MAP_TYPE_RINGBUF)
+			reg->id = 0;
 	}
 }
 
@@ -2425,6 +2566,11 @@ static void mark_map_regs(struct bpf_verifier_state *state, u32 regno,
 	u32 id = regs[regno].id;
 	int i;
 
+	/* No record was reserved on the NULL branch */
+	if (type == UNKNOWN_VALUE &&
+	    regs[regno].map_ptr->map_type == BPF_MAP_TYPE_RINGBUF)
+		state->ringbuf_refs--;
+
 	for (i = 0; i < MAX_BPF_REG; i++)
 		mark_map_reg(regs, i, id, type);
 
@@ -2455,7 +2601,7 @@ static int check_cond_jmp_op(struct bpf_verifier_env *env,
 		}
 
 		/* check src1 operand */
-		err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+		err = check_reg_arg(env, insn->src_reg, SRC_OP);
 		if (err)
 			return err;
 
@@ -2472,7 +2618,7 @@ static int check_cond_jmp_op(struct bpf_verifier_env *env,
 	}
 
 	/* check src2 operand */
-	err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+	err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 	if (err)
 		return err;
 
@@ -2569,7 +2715,7 @@ static int check_ld_imm(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		return -EINVAL;
 	}
 
-	err = check_reg_arg(regs, insn->dst_reg, DST_OP);
+	err = check_reg_arg(env, insn->dst_reg, DST_OP);
 	if (err)
 		return err;
 
@@ -2628,6 +2774,12 @@ static int check_ld_abs(struct bpf_verifier_env *env, struct bpf_insn *insn)
 		return -EINVAL;
 	}
 
+	/* a failed load ends the program, with whatever it holds */
+	if (env->cur_state.ringbuf_refs) {
+		verbose("BPF_LD_[ABS|IND] would leak a ringbuf record\n");
+		return -EINVAL;
+	}
+
 	if (insn->dst_reg != BPF_REG_0 || insn->off != 0 ||
 	    BPF_SIZE(insn->code) == BPF_DW ||
 	    (mode == BPF_ABS && insn->src_reg != BPF_REG_0)) {
@@ -2636,7 +2788,7 @@ static int check_ld_abs(struct bpf_verifier_env *env, struct bpf_insn *insn)
 	}
 
 	/* check whether implicit source operand (register R6) is readable */
-	err = check_reg_arg(regs, BPF_REG_6, SRC_OP);
+	err = check_reg_arg(env, BPF_REG_6, SRC_OP);
 	if (err)
 		return err;
 
@@ -2647,14 +2799,16 @@ static int check_ld_abs(struct bpf_verifier_env *env, struct bpf_insn *insn)
 
 	if (mode == BPF_IND) {
 		/* check explicit source operand */
-		err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+		err = check_reg_arg(env, insn->src_reg, SRC_OP);
 		if (err)
 			return err;
 	}
 
 	/* reset caller saved regs to unreadable */
-	for (i = 0; i < CALLER_SAVED_REGS; i++)
+	for (i = 0; i < CALLER_SAVED_REGS; i++) {
 		mark_reg_not_init(regs, caller_saved[i]);
+		check_reg_arg(env, caller_saved[i], DST_OP_NO_MARK);
+	}
 
 	/* mark destination R0 register as readable, since it contains
 	 * the value fetched from the packet
@@ -2950,11 +3104,19 @@ static bool states_equal(struct bpf_verifier_env *env,
 	struct bpf_reg_state *rold, *rcur;
 	int i;
 
+	if (old->ringbuf_refs != cur->ringbuf_refs)
+		return false;
+
 	for (i = 0; i < MAX_BPF_REG; i++) {
 		rold = &old->regs[i];
 		rcur = &cur->regs[i];
 
-		if (memcmp(rold, rcur, sizeof(*rold)) == 0)
+		if (!(rold->live & REG_LIVE_READ))
+			/* explored state didn't use this */
+			continue;
+
+		if (memcmp(rold, rcur,
+			   offsetof(struct bpf_reg_state, live)) == 0)
 			continue;
 
 		/* If the ranges were not the same, but everything else was and
@@ -3000,9 +3162,12 @@ static bool states_equal(struct bpf_verifier_env *env,
 			continue;
 		if (old->stack_slot_type[i] != STACK_SPILL)
 			continue;
+		if (!(old->spilled_regs[i / BPF_REG_SIZE].live & REG_LIVE_READ))
+			/* explored state didn't use this spilled register */
+			continue;
 		if (memcmp(&old->spilled_regs[i / BPF_REG_SIZE],
 			   &cur->spilled_regs[i / BPF_REG_SIZE],
-			   sizeof(old->spilled_regs[0])))
+			   offsetof(struct bpf_reg_state, live)))
 			/* when explored and current stack slot types are
 			 * the same, check that stored pointers types
 			 * are the same as well.
@@ -3020,12 +3185,75 @@ static bool states_equal(struct bpf_verifier_env *env,
 	return true;
 }
 
+/* Mark in parent what state reads, where state didn't write it first */
+static bool do_propagate_liveness(const struct bpf_verifier_state *state,
+				  struct bpf_verifier_state *parent)
+{
+	bool touched = false; /* any changes made? */
+	int i;
+
+	if (!parent)
+		return touched;
+	/* Propagate read liveness of registers... */
+	BUILD_BUG_ON(BPF_REG_FP + 1 != MAX_BPF_REG);
+	/* We don't need to worry about FP liveness because it's read-only */
+	for (i = 0; i < BPF_REG_FP; i++) {
+		if (parent->regs[i].live & REG_LIVE_READ)
+			continue;
+		if (state->regs[i].live == REG_LIVE_READ) {
+			parent->regs[i].live |= REG_LIVE_READ;
+			touched = true;
+		}
+	}
+	/* ... and stack slots */
+	for (i = 0; i < MAX_BPF_STACK / BPF_REG_SIZE; i++) {
+		if (parent->stack_slot_type[i * BPF_REG_SIZE] != STACK_SPILL)
+			continue;
+		if (state->stack_slot_type[i * BPF_REG_SIZE] != STACK_SPILL)
+			continue;
+		if (parent->spilled_regs[i].live & REG_LIVE_READ)
+			continue;
+		if (state->spilled_regs[i].live == REG_LIVE_READ) {
+			parent->spilled_regs[i].live |= REG_LIVE_READ;
+			touched = true;
+		}
+	}
+	return touched;
+}
+
+/* When the current state is pruned, what the explored state it matched
+ * goes on to read is read by the current state's parents too.  The
+ * first "parent" is the current state itself; from there the marks
+ * follow the parent links for as long as they change anything.
+ */
+static void propagate_liveness(const struct bpf_verifier_state *state,
+			       struct bpf_verifier_state *parent)
+{
+	while (do_propagate_liveness(state, parent)) {
+		/* Something changed, so we need to feed those changes onward */
+		state = parent;
+		parent = state->parent;
+	}
+}
+
+/* A state that keeps failing to prune is unlikely to start now, and on
+ * large programs long lists of them spend most of the verification time
+ * in states_equal().  Stop searching such states; they stay allocated,
+ * as later states' parent links may point into them.
+ */
+static bool state_is_stale(const struct bpf_verifier_state_list *sl)
+{
+	return sl->miss_cnt > sl->hit_cnt * 3 + 3;
+}
+
 static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 {
 	struct bpf_verifier_state_list *new_sl;
-	struct bpf_verifier_state_list *sl;
+	struct bpf_verifier_state_list *sl, **pprev;
+	int i;
 
-	sl = env->explored_states[insn_idx];
+	pprev = &env->explored_states[insn_idx];
+	sl = *pprev;
 	if (!sl)
 		/* this 'insn_idx' instruction wasn't marked, so we will not
 		 * be doing state search here
@@ -3033,12 +3261,31 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 		return 0;
 
 	while (sl != STATE_LIST_MARK) {
-		if (states_equal(env, &sl->state, &env->cur_state))
+		if (states_equal(env, &sl->state, &env->cur_state)) {
 			/* reached equivalent register/stack state,
-			 * prune the search
+			 * prune the search.
+			 * Registers read by the continuation are read by us.
+			 * If we have any write marks in env->cur_state, they
+			 * will prevent corresponding reads in the continuation
+			 * from reaching our parent (an explored_state).  Our
+			 * own state will get the read marks recorded, but
+			 * they'll be immediately forgotten as we're pruning
+			 * this state and will pop a new one.
 			 */
+			sl->hit_cnt++;
+			propagate_liveness(&sl->state, &env->cur_state);
 			return 1;
-		sl = sl->next;
+		}
+		sl->miss_cnt++;
+		if (state_is_stale(sl)) {
+			*pprev = sl->next;
+			sl->next = env->free_list;
+			env->free_list = sl;
+			env->cur_states--;
+		} else {
+			pprev = &sl->next;
+		}
+		sl = *pprev;
 	}
 
 	/* there were no equivalent states, remember current one.
@@ -3053,8 +3300,25 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 
 	/* add new state to the head of linked list */
 	memcpy(&new_sl->state, &env->cur_state, sizeof(env->cur_state));
+	new_sl->hit_cnt = 0;
+	new_sl->miss_cnt = 0;
 	new_sl->next = env->explored_states[insn_idx];
 	env->explored_states[insn_idx] = new_sl;
+
+	env->total_states++;
+	env->cur_states++;
+	env->peak_states = max(env->peak_states, env->cur_states);
+	update_peak_mem(env);
+
+	/* connect new state to parentage chain */
+	env->cur_state.parent = &new_sl->state;
+	/* clear liveness marks in current state */
+	for (i = 0; i < BPF_REG_FP; i++)
+		env->cur_state.regs[i].live = REG_LIVE_NONE;
+	for (i = 0; i < MAX_BPF_STACK / BPF_REG_SIZE; i++)
+		if (env->cur_state.stack_slot_type[i * BPF_REG_SIZE] ==
+		    STACK_SPILL)
+			env->cur_state.spilled_regs[i].live = REG_LIVE_NONE;
 	return 0;
 }
 
@@ -3074,10 +3338,10 @@ static int do_check(struct bpf_verifier_env *env)
 	struct bpf_reg_state *regs = state->regs;
 	int insn_cnt = env->prog->len;
 	int insn_idx, prev_insn_idx = 0;
-	int insn_processed = 0;
 	bool do_print_state = false;
 
 	init_reg_state(regs);
+	state->parent = NULL;
 	insn_idx = 0;
 	env->varlen_map_value_access = false;
 	for (;;) {
@@ -3094,9 +3358,9 @@ static int do_check(struct bpf_verifier_env *env)
 		insn = &insns[insn_idx];
 		class = BPF_CLASS(insn->code);
 
-		if (++insn_processed > BPF_COMPLEXITY_LIMIT_INSNS) {
+		if (++env->insn_processed > BPF_COMPLEXITY_LIMIT_INSNS) {
 			verbose("BPF program is too large. Processed %d insn\n",
-				insn_processed);
+				env->insn_processed);
 			return -E2BIG;
 		}
 
@@ -3148,11 +3412,11 @@ static int do_check(struct bpf_verifier_env *env)
 			/* check for reserved fields is already done */
 
 			/* check src operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 
-			err = check_reg_arg(regs, insn->dst_reg, DST_OP_NO_MARK);
+			err = check_reg_arg(env, insn->dst_reg, DST_OP_NO_MARK);
 			if (err)
 				return err;
 
@@ -3202,11 +3466,11 @@ static int do_check(struct bpf_verifier_env *env)
 			}
 
 			/* check src1 operand */
-			err = check_reg_arg(regs, insn->src_reg, SRC_OP);
+			err = check_reg_arg(env, insn->src_reg, SRC_OP);
 			if (err)
 				return err;
 			/* check src2 operand */
-			err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+			err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 			if (err)
 				return err;
 
@@ -3237,7 +3501,7 @@ static int do_check(struct bpf_verifier_env *env)
 				return -EINVAL;
 			}
 			/* check src operand */
-			err = check_reg_arg(regs, insn->dst_reg, SRC_OP);
+			err = check_reg_arg(env, insn->dst_reg, SRC_OP);
 			if (err)
 				return err;
 
@@ -3291,7 +3555,7 @@ static int do_check(struct bpf_verifier_env *env)
 				 * of bpf_exit, which means that program wrote
 				 * something into it earlier
 				 */
-				err = check_reg_arg(regs, BPF_REG_0, SRC_OP);
+				err = check_reg_arg(env, BPF_REG_0, SRC_OP);
 				if (err)
 					return err;
 
@@ -3300,6 +3564,11 @@ static int do_check(struct bpf_verifier_env *env)
 					return -EACCES;
 				}
 
+				if (state->ringbuf_refs) {
+					verbose("ringbuf record not submitted or discarded\n");
+					return -EINVAL;
+				}
+
 process_bpf_exit:
 				insn_idx = pop_stack(env, &prev_insn_idx);
 				if (insn_idx < 0) {
@@ -3341,7 +3610,14 @@ process_bpf_exit:
 	}
 
 	verbose("processed %d insns, stack depth %d\n",
-		insn_processed, env->prog->aux->stack_depth);
+		env->insn_processed, env->prog->aux->stack_depth);
+	verbose("total_states %u peak_states %u peak_mem %u\n",
+		env->total_states, env->peak_states, env->peak_mem);
+
+	env->prog->aux->verified_insns = env->insn_processed;
+	env->prog->aux->verifier_states = env->total_states;
+	env->prog->aux->verifier_peak_states = env->peak_states;
+	env->prog->aux->verifier_peak_mem = env->peak_mem;
 	return 0;
 }
 
@@ -3750,6 +4026,12 @@ static void free_states(struct bpf_verifier_env *env)
 			}
 	}
 
+	while (env->free_list) {
+		sl = env->free_list;
+		env->free_list = sl->next;
+		kfree(sl);
+	}
+
 	kfree(env->explored_states);
 }
 
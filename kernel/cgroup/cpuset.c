@@ -848,6 +848,37 @@ void rebuild_sched_domains(void)
 	mutex_unlock(&cpuset_mutex);
 }
 
+/*
+ * Can a change to the cpus or the load balance flag of @cs alter the sched
+ * domains?  While the top cpuset is load balanced, generate_sched_domains()
+ * returns a single domain of all non-isolated CPUs however the cpusets
+ * below it are laid out, so those only matter through relax_domain_level,
+ * which is rarely set.  Skipping the rebuild keeps frequent cpuset updates
+ * from regenerating and comparing the domains each time.
+ *
+ * Call with cpuset_mutex held.
+ */
+static bool cpuset_affects_sched_domains(struct cpuset *cs)
+{
+	struct cpuset *cp;
+	struct cgroup_subsys_state *pos_css;
+	bool ret = false;
+
+	if (cs == &top_cpuset || !is_sched_load_balance(&top_cpuset))
+		return true;
+
+	rcu_read_lock();
+	cpuset_for_each_descendant_pre(cp, pos_css, cs) {
+		if (cp->relax_domain_level != -1) {
+			ret = true;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	return ret;
+}
+
 /**
  * update_tasks_cpumask - Update the cpumasks of tasks in the cpuset.
  * @cs: the cpuset in which each task's cpus_allowed mask needs to be changed
@@ -931,7 +962,7 @@ static void update_cpumasks_hier(struct cpuset *cs, struct cpumask *new_cpus)
 	}
 	rcu_read_unlock();
 
-	if (need_rebuild_sched_domains)
+	if (need_rebuild_sched_domains && cpuset_affects_sched_domains(cs))
 		rebuild_sched_domains_locked();
 }
 
@@ -1330,7 +1361,8 @@ static int update_flag(cpuset_flagbits_t bit, struct cpuset *cs,
 	cs->flags = trialcs->flags;
 	spin_unlock_irq(&callback_lock);
 
-	if (!cpumask_empty(trialcs->cpus_allowed) && balance_flag_changed)
+	if (!cpumask_empty(trialcs->cpus_allowed) && balance_flag_changed &&
+	    cpuset_affects_sched_domains(cs))
 		rebuild_sched_domains_locked();
 
 	if (spread_flag_changed)
@@ -3100,6 +3100,9 @@ ctx_flexible_sched_in(struct perf_event_context *ctx,
 		/* Ignore events in OFF or ERROR state */
 		if (event->state <= PERF_EVENT_STATE_OFF)
 			continue;
+		/* Left on by an incremental rotation */
+		if (event->state == PERF_EVENT_STATE_ACTIVE)
+			continue;
 		/*
 		 * Listen to the 'cpu' scheduling filter constraint
 		 * of events:
@@ -3415,56 +3418,80 @@ static void perf_adjust_freq_unthr_context(struct perf_event_context *ctx,
 	raw_spin_unlock(&ctx->lock);
 }
 
+static inline bool ctx_needs_rotation(struct perf_event_context *ctx)
+{
+	return ctx && ctx->nr_events && ctx->nr_events != ctx->nr_active &&
+	       (ctx->is_active & EVENT_FLEXIBLE);
+}
+
 /*
  * Round-robin a context's events:
+ *
+ * Schedule out the first non-pinned group, if it is on, and rotate it to
+ * the end of the list. The caller then schedules in the groups which are
+ * not on and fit. The other groups stay on the PMU. Rotation might be
+ * disabled by the inheritance code.
  */
-static void rotate_ctx(struct perf_event_context *ctx)
+static void rotate_ctx(struct perf_event_context *ctx,
+		       struct perf_cpu_context *cpuctx)
 {
-	/*
-	 * Rotate the first entry last of non-pinned groups. Rotation might be
-	 * disabled by the inheritance code.
-	 */
-	if (!ctx->rotate_disable)
-		list_rotate_left(&ctx->flexible_groups);
+	struct perf_event *event;
+
+	/* Groups are scheduled in and out at the current context time */
+	update_context_time(ctx);
+	update_cgrp_time_from_cpuctx(cpuctx);
+
+	if (ctx->rotate_disable)
+		return;
+
+	event = list_first_entry_or_null(&ctx->flexible_groups,
+					 struct perf_event, group_entry);
+	if (!event)
+		return;
+
+	if (event->state == PERF_EVENT_STATE_ACTIVE)
+		group_sched_out(event, cpuctx, ctx);
+	list_rotate_left(&ctx->flexible_groups);
 }
 
 static int perf_rotate_context(struct perf_cpu_context *cpuctx)
 {
-	struct perf_event_context *ctx = NULL;
-	int rotate = 0;
+	struct perf_event_context *ctx = cpuctx->task_ctx;
+	bool rotate_cpu, rotate_task;
+	u64 start;
 
-	if (cpuctx->ctx.nr_events) {
-		if (cpuctx->ctx.nr_events != cpuctx->ctx.nr_active)
-			rotate = 1;
-	}
-
-	ctx = cpuctx->task_ctx;
-	if (ctx && ctx->nr_events) {
-		if (ctx->nr_events != ctx->nr_active)
-			rotate = 1;
-	}
+	rotate_cpu = ctx_needs_rotation(&cpuctx->ctx);
+	rotate_task = ctx_needs_rotation(ctx);
 
-	if (!rotate)
-		goto done;
+	if (!rotate_cpu && !rotate_task)
+		return 0;
 
+	start = perf_clock();
 	perf_ctx_lock(cpuctx, cpuctx->task_ctx);
 	perf_pmu_disable(cpuctx->ctx.pmu);
 
-	cpu_ctx_sched_out(cpuctx, EVENT_FLEXIBLE);
-	if (ctx)
-		ctx_sched_out(ctx, cpuctx, EVENT_FLEXIBLE);
+	if (rotate_cpu)
+		rotate_ctx(&cpuctx->ctx, cpuctx);
+	if (rotate_task)
+		rotate_ctx(ctx, cpuctx);
 
-	rotate_ctx(&cpuctx->ctx);
-	if (ctx)
-		rotate_ctx(ctx);
-
-	perf_event_sched_in(cpuctx, ctx, current);
+	/*
+	 * Pinned groups were not touched. Refill the freed counters, CPU
+	 * flexible groups first, as perf_event_sched_in() would. A context
+	 * which needs no rotation has all its groups on already.
+	 */
+	if (rotate_cpu)
+		ctx_flexible_sched_in(&cpuctx->ctx, cpuctx);
+	if (rotate_task)
+		ctx_flexible_sched_in(ctx, cpuctx);
 
 	perf_pmu_enable(cpuctx->ctx.pmu);
 	perf_ctx_unlock(cpuctx, cpuctx->task_ctx);
-done:
 
-	return rotate;
+	cpuctx->mux_rotations++;
+	cpuctx->mux_rotation_time += perf_clock() - start;
+
+	return 1;
 }
 
 void perf_event_task_tick(void)
@@ -5318,7 +5345,7 @@ static int perf_mmap(struct file *file, struct vm_area_struct *vma)
 again:
 	mutex_lock(&event->mmap_mutex);
 	if (event->rb) {
-		if (event->rb->nr_pages != nr_pages) {
+		if (data_page_nr(event->rb) != nr_pages) {
 			ret = -EINVAL;
 			goto unlock;
 		}
@@ -5366,6 +5393,9 @@ accounting:
 	if (vma->vm_flags & VM_WRITE)
 		flags |= RING_BUFFER_WRITABLE;
 
+	if (event->attr.huge_buffer)
+		flags |= RING_BUFFER_HUGE;
+
 	if (!rb) {
 		rb = rb_alloc(nr_pages,
 			      event->attr.watermark ? event->attr.wakeup_watermark : 0,
@@ -8948,9 +8978,48 @@ perf_event_mux_interval_ms_store(struct device *dev,
 }
 static DEVICE_ATTR_RW(perf_event_mux_interval_ms);
 
+/*
+ * Multiplexing cost of the PMU: the number of rotations and the time
+ * spent in them, summed up over all CPU contexts. Lets tools size their
+ * event sets to the counters which are available.
+ */
+static ssize_t
+perf_event_mux_rotations_show(struct device *dev,
+			      struct device_attribute *attr,
+			      char *page)
+{
+	struct pmu *pmu = dev_get_drvdata(dev);
+	u64 sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += per_cpu_ptr(pmu->pmu_cpu_context, cpu)->mux_rotations;
+
+	return snprintf(page, PAGE_SIZE-1, "%llu\n", sum);
+}
+static DEVICE_ATTR_RO(perf_event_mux_rotations);
+
+static ssize_t
+perf_event_mux_rotation_ns_show(struct device *dev,
+				struct device_attribute *attr,
+				char *page)
+{
+	struct pmu *pmu = dev_get_drvdata(dev);
+	u64 sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += per_cpu_ptr(pmu->pmu_cpu_context, cpu)->mux_rotation_time;
+
+	return snprintf(page, PAGE_SIZE-1, "%llu\n", sum);
+}
+static DEVICE_ATTR_RO(perf_event_mux_rotation_ns);
+
 static struct attribute *pmu_dev_attrs[] = {
 	&dev_attr_type.attr,
 	&dev_attr_perf_event_mux_interval_ms.attr,
+	&dev_attr_perf_event_mux_rotations.attr,
+	&dev_attr_perf_event_mux_rotation_ns.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(pmu_dev);
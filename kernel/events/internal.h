@@ -7,14 +7,15 @@
 /* Buffer handling */
 
 #define RING_BUFFER_WRITABLE		0x01
+#define RING_BUFFER_HUGE		0x02
 
 struct ring_buffer {
 	atomic_t			refcount;
 	struct rcu_head			rcu_head;
 #ifdef CONFIG_PERF_USE_VMALLOC
 	struct work_struct		work;
-	int				page_order;	/* allocation order  */
 #endif
+	int				page_order;	/* allocation order  */
 	int				nr_pages;	/* nr of data pages  */
 	int				overwrite;	/* can overwrite itself */
 	int				paused;		/* can write into ring buffer */
@@ -93,25 +94,20 @@ void perf_event_aux_event(struct perf_event *event, unsigned long head,
 extern struct page *
 perf_mmap_to_page(struct ring_buffer *rb, unsigned long pgoff);
 
-#ifdef CONFIG_PERF_USE_VMALLOC
 /*
- * Back perf_mmap() with vmalloc memory.
- *
- * Required for architectures that have d-cache aliasing issues.
+ * The data area is nr_pages chunks of 2^page_order pages each: one
+ * vmalloc area with CONFIG_PERF_USE_VMALLOC, high-order pages with
+ * RING_BUFFER_HUGE, single pages otherwise.
  */
-
 static inline int page_order(struct ring_buffer *rb)
 {
 	return rb->page_order;
 }
 
-#else
-
-static inline int page_order(struct ring_buffer *rb)
+static inline int data_page_nr(struct ring_buffer *rb)
 {
-	return 0;
+	return rb->nr_pages << page_order(rb);
 }
-#endif
 
 static inline unsigned long perf_data_size(struct ring_buffer *rb)
 {
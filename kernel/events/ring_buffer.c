@@ -674,39 +674,99 @@ void rb_free_aux(struct ring_buffer *rb)
 #ifndef CONFIG_PERF_USE_VMALLOC
 
 /*
- * Back perf_mmap() with regular GFP_KERNEL-0 pages.
+ * Back perf_mmap() with regular GFP_KERNEL-0 pages, or with high-order
+ * pages for RING_BUFFER_HUGE. High-order pages are split, so the fault
+ * and free paths can treat every page on its own.
  */
 
+static void *rb_data_page(struct ring_buffer *rb, int idx)
+{
+	int order = page_order(rb);
+
+	return rb->data_pages[idx >> order] +
+	       ((idx & ((1 << order) - 1)) << PAGE_SHIFT);
+}
+
 static struct page *
 __perf_mmap_to_page(struct ring_buffer *rb, unsigned long pgoff)
 {
-	if (pgoff > rb->nr_pages)
+	if (pgoff > data_page_nr(rb))
 		return NULL;
 
 	if (pgoff == 0)
 		return virt_to_page(rb->user_page);
 
-	return virt_to_page(rb->data_pages[pgoff - 1]);
+	return virt_to_page(rb_data_page(rb, pgoff - 1));
 }
 
-static void *perf_mmap_alloc_page(int cpu)
+static void *perf_mmap_alloc_page(int cpu, int order)
 {
+	gfp_t gfp_mask = GFP_KERNEL | __GFP_ZERO;
 	struct page *page;
 	int node;
 
+	/* High-order attempts fall back to smaller orders, keep them quiet */
+	if (order)
+		gfp_mask |= __GFP_NORETRY | __GFP_NOWARN;
+
 	node = (cpu == -1) ? cpu : cpu_to_node(cpu);
-	page = alloc_pages_node(node, GFP_KERNEL | __GFP_ZERO, 0);
+	page = alloc_pages_node(node, gfp_mask, order);
 	if (!page)
 		return NULL;
 
+	if (order)
+		split_page(page, order);
+
 	return page_address(page);
 }
 
+static void perf_mmap_free_page(unsigned long addr)
+{
+	struct page *page = virt_to_page((void *)addr);
+
+	page->mapping = NULL;
+	__free_page(page);
+}
+
+static void perf_mmap_free_pages(void *addr, int order)
+{
+	int i;
+
+	for (i = 0; i < (1 << order); i++)
+		perf_mmap_free_page((unsigned long)addr + (i << PAGE_SHIFT));
+}
+
+/*
+ * Allocate the data area in chunks of 2^order pages. All chunks must have
+ * the same order, so on failure everything is released and the caller
+ * retries with a smaller order.
+ */
+static int rb_alloc_data_pages(struct ring_buffer *rb, int nr_pages, int cpu,
+			       int order)
+{
+	int i, nr_chunks = nr_pages >> order;
+
+	for (i = 0; i < nr_chunks; i++) {
+		rb->data_pages[i] = perf_mmap_alloc_page(cpu, order);
+		if (!rb->data_pages[i])
+			goto fail;
+	}
+
+	rb->nr_pages = nr_chunks;
+	rb->page_order = order;
+	return 0;
+
+fail:
+	for (i--; i >= 0; i--)
+		perf_mmap_free_pages(rb->data_pages[i], order);
+	return -ENOMEM;
+}
+
 struct ring_buffer *rb_alloc(int nr_pages, long watermark, int cpu, int flags)
 {
 	struct ring_buffer *rb;
 	unsigned long size;
-	int i;
+	int order = 0;
 
 	size = sizeof(struct ring_buffer);
 	size += nr_pages * sizeof(void *);
@@ -715,27 +775,31 @@ struct ring_buffer *rb_alloc(int nr_pages, long watermark, int cpu, int flags)
 	if (!rb)
 		goto fail;
 
-	rb->user_page = perf_mmap_alloc_page(cpu);
+	rb->user_page = perf_mmap_alloc_page(cpu, 0);
 	if (!rb->user_page)
 		goto fail_user_page;
 
-	for (i = 0; i < nr_pages; i++) {
-		rb->data_pages[i] = perf_mmap_alloc_page(cpu);
-		if (!rb->data_pages[i])
-			goto fail_data_pages;
-	}
+	/*
+	 * Physically contiguous chunks let both the output code and the
+	 * kernel mapping cover the buffer with far fewer TLB entries. Try
+	 * the largest order that fits and fall back down to single pages.
+	 */
+	if ((flags & RING_BUFFER_HUGE) && nr_pages > 1)
+		order = min(ilog2(nr_pages), MAX_ORDER - 1);
 
-	rb->nr_pages = nr_pages;
+	for (; order >= 0; order--) {
+		if (!rb_alloc_data_pages(rb, nr_pages, cpu, order))
+			break;
+	}
+	if (order < 0)
+		goto fail_data_pages;
 
 	ring_buffer_init(rb, watermark, flags);
 
 	return rb;
 
 fail_data_pages:
-	for (i--; i >= 0; i--)
-		free_page((unsigned long)rb->data_pages[i]);
-
-	free_page((unsigned long)rb->user_page);
+	perf_mmap_free_page((unsigned long)rb->user_page);
 
 fail_user_page:
 	kfree(rb);
@@ -744,30 +808,23 @@ fail:
 	return NULL;
 }
 
-static void perf_mmap_free_page(unsigned long addr)
-{
-	struct page *page = virt_to_page((void *)addr);
-
-	page->mapping = NULL;
-	__free_page(page);
-}
-
 void rb_free(struct ring_buffer *rb)
 {
 	int i;
 
 	perf_mmap_free_page((unsigned long)rb->user_page);
 	for (i = 0; i < rb->nr_pages; i++)
-		perf_mmap_free_page((unsigned long)rb->data_pages[i]);
+		perf_mmap_free_pages(rb->data_pages[i], page_order(rb));
 	kfree(rb);
 }
 
 #else
-static int data_page_nr(struct ring_buffer *rb)
-{
-	return rb->nr_pages << page_order(rb);
-}
-
+/*
+ * Back perf_mmap() with vmalloc memory.
+ *
+ * Required for architectures that have d-cache aliasing issues. The area
+ * is virtually contiguous already, RING_BUFFER_HUGE is ignored.
+ */
 static struct page *
 __perf_mmap_to_page(struct ring_buffer *rb, unsigned long pgoff)
 {
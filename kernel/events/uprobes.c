@@ -43,7 +43,10 @@
 #include <linux/uprobes.h>
 
 #define UINSNS_PER_PAGE			(PAGE_SIZE/UPROBE_XOL_SLOT_BYTES)
-#define MAX_UPROBE_XOL_SLOTS		UINSNS_PER_PAGE
+#define UPROBE_XOL_PAGES		4
+#define MAX_UPROBE_XOL_SLOTS		(UINSNS_PER_PAGE * UPROBE_XOL_PAGES)
+/* Slots are handed out a bitmap word at a time, each CPU from its own */
+#define UPROBE_XOL_SLOT_GROUPS		BITS_TO_LONGS(MAX_UPROBE_XOL_SLOTS)
 
 static struct rb_root uprobes_tree = RB_ROOT;
 /*
@@ -94,16 +97,15 @@ struct uprobe {
  * mangled by set_swbp().
  *
  * On a breakpoint hit, thread contests for a slot.  It frees the
- * slot after singlestep. Currently a fixed number of slots are
- * allocated.
+ * slot after singlestep. A fixed number of slots are allocated,
+ * UPROBE_XOL_PAGES pages of them; a slot never crosses a page.
  */
 struct xol_area {
 	wait_queue_head_t 		wq;		/* if all slots are busy */
-	atomic_t 			slot_count;	/* number of in-use slots */
 	unsigned long 			*bitmap;	/* 0 = free slot */
 
 	struct vm_special_mapping	xol_mapping;
-	struct page 			*pages[2];
+	struct page 			*pages[UPROBE_XOL_PAGES + 1];
 	/*
 	 * We keep the vma's vm_start rather than a pointer to the vma
 	 * itself.  The probed process or a naughty kernel module could make
@@ -1150,15 +1152,17 @@ static int xol_add_vma(struct mm_struct *mm, struct xol_area *area)
 
 	if (!area->vaddr) {
 		/* Try to map as high as possible, this is only a hint. */
-		area->vaddr = get_unmapped_area(NULL, TASK_SIZE - PAGE_SIZE,
-						PAGE_SIZE, 0, 0);
+		area->vaddr = get_unmapped_area(NULL,
+				TASK_SIZE - UPROBE_XOL_PAGES * PAGE_SIZE,
+				UPROBE_XOL_PAGES * PAGE_SIZE, 0, 0);
 		if (area->vaddr & ~PAGE_MASK) {
 			ret = area->vaddr;
 			goto fail;
 		}
 	}
 
-	vma = _install_special_mapping(mm, area->vaddr, PAGE_SIZE,
+	vma = _install_special_mapping(mm, area->vaddr,
+				UPROBE_XOL_PAGES * PAGE_SIZE,
 				VM_EXEC|VM_MAYEXEC|VM_DONTCOPY|VM_IO,
 				&area->xol_mapping);
 	if (IS_ERR(vma)) {
@@ -1180,35 +1184,38 @@ static struct xol_area *__create_xol_area(unsigned long vaddr)
 	struct mm_struct *mm = current->mm;
 	uprobe_opcode_t insn = UPROBE_SWBP_INSN;
 	struct xol_area *area;
+	int i;
 
 	area = kmalloc(sizeof(*area), GFP_KERNEL);
 	if (unlikely(!area))
 		goto out;
 
-	area->bitmap = kzalloc(BITS_TO_LONGS(UINSNS_PER_PAGE) * sizeof(long), GFP_KERNEL);
+	area->bitmap = kzalloc(UPROBE_XOL_SLOT_GROUPS * sizeof(long), GFP_KERNEL);
 	if (!area->bitmap)
 		goto free_area;
 
 	area->xol_mapping.name = "[uprobes]";
 	area->xol_mapping.fault = NULL;
 	area->xol_mapping.pages = area->pages;
-	area->pages[0] = alloc_page(GFP_HIGHUSER);
-	if (!area->pages[0])
-		goto free_bitmap;
-	area->pages[1] = NULL;
+	for (i = 0; i < UPROBE_XOL_PAGES; i++) {
+		area->pages[i] = alloc_page(GFP_HIGHUSER);
+		if (!area->pages[i])
+			goto free_pages;
+	}
+	area->pages[i] = NULL;
 
 	area->vaddr = vaddr;
 	init_waitqueue_head(&area->wq);
 	/* Reserve the 1st slot for get_trampoline_vaddr() */
 	set_bit(0, area->bitmap);
-	atomic_set(&area->slot_count, 1);
 	arch_uprobe_copy_ixol(area->pages[0], 0, &insn, UPROBE_SWBP_INSN_SIZE);
 
 	if (!xol_add_vma(mm, area))
 		return area;
 
-	__free_page(area->pages[0]);
- free_bitmap:
+ free_pages:
+	while (--i >= 0)
+		__free_page(area->pages[i]);
 	kfree(area->bitmap);
  free_area:
 	kfree(area);
@@ -1241,11 +1248,13 @@ static struct xol_area *get_xol_area(void)
 void uprobe_clear_state(struct mm_struct *mm)
 {
 	struct xol_area *area = mm->uprobes_state.xol_area;
+	int i;
 
 	if (!area)
 		return;
 
-	put_page(area->pages[0]);
+	for (i = 0; i < UPROBE_XOL_PAGES; i++)
+		put_page(area->pages[i]);
 	kfree(area->bitmap);
 	kfree(area);
 }
@@ -1271,30 +1280,41 @@ void uprobe_dup_mmap(struct mm_struct *oldmm, struct mm_struct *newmm)
 	}
 }
 
-/*
- *  - search for a free slot.
- */
-static unsigned long xol_take_insn_slot(struct xol_area *area)
+static unsigned long xol_slot_vaddr(struct xol_area *area, int slot_nr)
 {
-	unsigned long slot_addr;
-	int slot_nr;
+	return area->vaddr + (slot_nr / UINSNS_PER_PAGE) * PAGE_SIZE +
+	       (slot_nr % UINSNS_PER_PAGE) * UPROBE_XOL_SLOT_BYTES;
+}
 
-	do {
-		slot_nr = find_first_zero_bit(area->bitmap, UINSNS_PER_PAGE);
-		if (slot_nr < UINSNS_PER_PAGE) {
-			if (!test_and_set_bit(slot_nr, area->bitmap))
-				break;
+static bool xol_area_full(struct xol_area *area)
+{
+	return find_first_zero_bit(area->bitmap, MAX_UPROBE_XOL_SLOTS) >=
+	       MAX_UPROBE_XOL_SLOTS;
+}
 
-			slot_nr = UINSNS_PER_PAGE;
+/*
+ *  - search for a free slot, starting in the bitmap word of this CPU
+ *    so that threads stepping on different CPUs do not fight over the
+ *    same bits.
+ */
+static int xol_take_insn_slot(struct xol_area *area)
+{
+	unsigned int first, slot_nr;
+
+	first = (raw_smp_processor_id() % UPROBE_XOL_SLOT_GROUPS) * BITS_PER_LONG;
+	for (;;) {
+		slot_nr = find_next_zero_bit(area->bitmap, MAX_UPROBE_XOL_SLOTS,
+					     first);
+		if (slot_nr >= MAX_UPROBE_XOL_SLOTS)
+			slot_nr = find_first_zero_bit(area->bitmap,
+						      MAX_UPROBE_XOL_SLOTS);
+		if (slot_nr < MAX_UPROBE_XOL_SLOTS) {
+			if (!test_and_set_bit(slot_nr, area->bitmap))
+				return slot_nr;
 			continue;
 		}
-		wait_event(area->wq, (atomic_read(&area->slot_count) < UINSNS_PER_PAGE));
-	} while (slot_nr >= UINSNS_PER_PAGE);
-
-	slot_addr = area->vaddr + (slot_nr * UPROBE_XOL_SLOT_BYTES);
-	atomic_inc(&area->slot_count);
-
-	return slot_addr;
+		wait_event(area->wq, !xol_area_full(area));
+	}
 }
 
 /*
@@ -1305,16 +1325,16 @@ static unsigned long xol_get_insn_slot(struct uprobe *uprobe)
 {
 	struct xol_area *area;
 	unsigned long xol_vaddr;
+	int slot_nr;
 
 	area = get_xol_area();
 	if (!area)
 		return 0;
 
-	xol_vaddr = xol_take_insn_slot(area);
-	if (unlikely(!xol_vaddr))
-		return 0;
+	slot_nr = xol_take_insn_slot(area);
+	xol_vaddr = xol_slot_vaddr(area, slot_nr);
 
-	arch_uprobe_copy_ixol(area->pages[0], xol_vaddr,
+	arch_uprobe_copy_ixol(area->pages[slot_nr / UINSNS_PER_PAGE], xol_vaddr,
 			      &uprobe->arch.ixol, sizeof(uprobe->arch.ixol));
 
 	return xol_vaddr;
@@ -1339,18 +1359,18 @@ static void xol_free_insn_slot(struct task_struct *tsk)
 		return;
 
 	area = tsk->mm->uprobes_state.xol_area;
-	vma_end = area->vaddr + PAGE_SIZE;
+	vma_end = area->vaddr + UPROBE_XOL_PAGES * PAGE_SIZE;
 	if (area->vaddr <= slot_addr && slot_addr < vma_end) {
 		unsigned long offset;
 		int slot_nr;
 
 		offset = slot_addr - area->vaddr;
-		slot_nr = offset / UPROBE_XOL_SLOT_BYTES;
+		slot_nr = (offset & ~PAGE_MASK) / UPROBE_XOL_SLOT_BYTES;
 		if (slot_nr >= UINSNS_PER_PAGE)
 			return;
+		slot_nr += (offset >> PAGE_SHIFT) * UINSNS_PER_PAGE;
 
 		clear_bit(slot_nr, area->bitmap);
-		atomic_dec(&area->slot_count);
 		smp_mb__after_atomic(); /* pairs with prepare_to_wait() */
 		if (waitqueue_active(&area->wq))
 			wake_up(&area->wq);
@@ -160,6 +160,10 @@ static int irq_debug_show(struct seq_file *m, void *p)
 	irq_debug_show_bits(m, 0, irqd_get(data), irqdata_states,
 			    ARRAY_SIZE(irqdata_states));
 	seq_printf(m, "node:     %d\n", irq_data_get_node(data));
+	seq_printf(m, "hardirq:  %llu ns\n",
+		   (u64)atomic64_read(&desc->hardirq_time));
+	seq_printf(m, "thread:   %llu ns\n",
+		   (u64)atomic64_read(&desc->thread_time));
 	irq_debug_show_masks(m, desc);
 	irq_debug_show_data(m, data, 0);
 	raw_spin_unlock_irq(&desc->lock);
@@ -129,6 +129,15 @@ void __irq_wake_thread(struct irq_desc *desc, struct irqaction *action)
 	 */
 	atomic_inc(&desc->threads_active);
 
+	/*
+	 * A thread which is draining its activations checks
+	 * IRQTF_RUNTHREAD again before going to sleep. The
+	 * test_and_set_bit() above orders against the clearing of
+	 * IRQTF_BATCHING in irq_thread_batch().
+	 */
+	if (test_bit(IRQTF_BATCHING, &action->thread_flags))
+		return;
+
 	wake_up_process(action->thread);
 }
 
@@ -183,8 +192,10 @@ irqreturn_t handle_irq_event_percpu(struct irq_desc *desc)
 {
 	irqreturn_t retval;
 	unsigned int flags = 0;
+	u64 start = irq_time_start();
 
 	retval = __handle_irq_event_percpu(desc, &flags);
+	irq_account_hardirq_time(desc, start);
 
 	add_interrupt_randomness(desc->irq_data.irq, flags);
 
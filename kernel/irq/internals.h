@@ -28,12 +28,17 @@ extern struct irqaction chained_action;
  * IRQTF_WARNED    - warning "IRQ_WAKE_THREAD w/o thread_fn" has been printed
  * IRQTF_AFFINITY  - irq thread is requested to adjust affinity
  * IRQTF_FORCED_THREAD  - irq action is force threaded
+ * IRQTF_BATCHING  - irq thread rechecks IRQTF_RUNTHREAD before sleeping,
+ *		     no wakeup needed
+ * IRQTF_SHARED_THREAD  - irq action is served by the shared irq thread
  */
 enum {
 	IRQTF_RUNTHREAD,
 	IRQTF_WARNED,
 	IRQTF_AFFINITY,
 	IRQTF_FORCED_THREAD,
+	IRQTF_BATCHING,
+	IRQTF_SHARED_THREAD,
 };
 
 /*
@@ -439,11 +444,28 @@ static inline bool irq_fixup_move_pending(struct irq_desc *desc, bool fclear)
 #ifdef CONFIG_GENERIC_IRQ_DEBUGFS
 #include <linux/debugfs.h>
 
+#include <linux/sched/clock.h>
+
 void irq_add_debugfs_entry(unsigned int irq, struct irq_desc *desc);
 static inline void irq_remove_debugfs_entry(struct irq_desc *desc)
 {
 	debugfs_remove(desc->debugfs_file);
 }
+
+static inline u64 irq_time_start(void)
+{
+	return local_clock();
+}
+
+static inline void irq_account_hardirq_time(struct irq_desc *desc, u64 start)
+{
+	atomic64_add(local_clock() - start, &desc->hardirq_time);
+}
+
+static inline void irq_account_thread_time(struct irq_desc *desc, u64 start)
+{
+	atomic64_add(local_clock() - start, &desc->thread_time);
+}
 # ifdef CONFIG_IRQ_DOMAIN
 void irq_domain_debugfs_init(struct dentry *root);
 # else
@@ -458,4 +480,7 @@ static inline void irq_add_debugfs_entry(unsigned int irq, struct irq_desc *d)
 static inline void irq_remove_debugfs_entry(struct irq_desc *d)
 {
 }
+static inline u64 irq_time_start(void) { return 0; }
+static inline void irq_account_hardirq_time(struct irq_desc *d, u64 s) { }
+static inline void irq_account_thread_time(struct irq_desc *d, u64 s) { }
 #endif /* CONFIG_GENERIC_IRQ_DEBUGFS */
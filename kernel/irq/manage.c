@@ -18,6 +18,7 @@
 #include <linux/sched.h>
 #include <linux/sched/rt.h>
 #include <linux/sched/task.h>
+#include <linux/rculist.h>
 #include <uapi/linux/sched/types.h>
 #include <linux/task_work.h>
 
@@ -920,6 +921,64 @@ static void irq_wake_secondary(struct irq_desc *desc, struct irqaction *action)
 	raw_spin_unlock_irq(&desc->lock);
 }
 
+/*
+ * Maximum number of back to back activations an irq thread handles
+ * before it goes through irq_wait_for_interrupt() again.
+ */
+#define IRQ_THREAD_BATCH	16
+
+static irqreturn_t (*irq_thread_handler_fn(struct irqaction *action))
+	(struct irq_desc *, struct irqaction *)
+{
+	if (force_irqthreads && test_bit(IRQTF_FORCED_THREAD,
+					&action->thread_flags))
+		return irq_forced_thread_fn;
+	return irq_thread_fn;
+}
+
+static void irq_thread_run(struct irq_desc *desc, struct irqaction *action,
+			   irqreturn_t (*handler_fn)(struct irq_desc *desc,
+						     struct irqaction *action))
+{
+	irqreturn_t action_ret;
+	u64 start = irq_time_start();
+
+	action_ret = handler_fn(desc, action);
+	if (action_ret == IRQ_HANDLED)
+		atomic_inc(&desc->threads_handled);
+	if (action_ret == IRQ_WAKE_THREAD)
+		irq_wake_secondary(desc, action);
+
+	irq_account_thread_time(desc, start);
+	wake_threads_waitq(desc);
+}
+
+/*
+ * Run the handler as long as the hard interrupt reactivates the thread
+ * meanwhile. The hard interrupt does not wake the thread while
+ * IRQTF_BATCHING is set, which saves a wakeup per interrupt at high
+ * rates.
+ */
+static void irq_thread_batch(struct irq_desc *desc, struct irqaction *action,
+			     irqreturn_t (*handler_fn)(struct irq_desc *desc,
+						       struct irqaction *action))
+{
+	int budget = IRQ_THREAD_BATCH;
+
+	set_bit(IRQTF_BATCHING, &action->thread_flags);
+	do {
+		irq_thread_run(desc, action, handler_fn);
+	} while (--budget && test_and_clear_bit(IRQTF_RUNTHREAD,
+						&action->thread_flags));
+	clear_bit(IRQTF_BATCHING, &action->thread_flags);
+	/*
+	 * Pairs with __irq_wake_thread(): either the hard interrupt sees
+	 * IRQTF_BATCHING cleared and wakes us up, or we see its
+	 * IRQTF_RUNTHREAD in irq_wait_for_interrupt().
+	 */
+	smp_mb__after_atomic();
+}
+
 /*
  * Interrupt handler thread
  */
@@ -931,11 +990,7 @@ static int irq_thread(void *data)
 	irqreturn_t (*handler_fn)(struct irq_desc *desc,
 			struct irqaction *action);
 
-	if (force_irqthreads && test_bit(IRQTF_FORCED_THREAD,
-					&action->thread_flags))
-		handler_fn = irq_forced_thread_fn;
-	else
-		handler_fn = irq_thread_fn;
+	handler_fn = irq_thread_handler_fn(action);
 
 	init_task_work(&on_exit_work, irq_thread_dtor);
 	task_work_add(current, &on_exit_work, false);
@@ -943,17 +998,8 @@ static int irq_thread(void *data)
 	irq_thread_check_affinity(desc, action);
 
 	while (!irq_wait_for_interrupt(action)) {
-		irqreturn_t action_ret;
-
 		irq_thread_check_affinity(desc, action);
-
-		action_ret = handler_fn(desc, action);
-		if (action_ret == IRQ_HANDLED)
-			atomic_inc(&desc->threads_handled);
-		if (action_ret == IRQ_WAKE_THREAD)
-			irq_wake_secondary(desc, action);
-
-		wake_threads_waitq(desc);
+		irq_thread_batch(desc, action, handler_fn);
 	}
 
 	/*
@@ -969,6 +1015,100 @@ static int irq_thread(void *data)
 	return 0;
 }
 
+/*
+ * Low rate interrupts requested with IRQF_SHARED_THREAD share a single
+ * thread instead of one thread each. The list is modified under
+ * irq_shared_lock, which the thread holds while it runs the handlers,
+ * and is walked under RCU to check for pending work before sleeping.
+ */
+static struct task_struct *irq_shared_thread;
+static LIST_HEAD(irq_shared_actions);
+static DEFINE_MUTEX(irq_shared_lock);
+
+static bool irq_shared_thread_pending(void)
+{
+	struct irqaction *action;
+	bool pending = false;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(action, &irq_shared_actions, shared_list) {
+		if (test_bit(IRQTF_RUNTHREAD, &action->thread_flags)) {
+			pending = true;
+			break;
+		}
+	}
+	rcu_read_unlock();
+	return pending;
+}
+
+static int irq_shared_thread_fn(void *data)
+{
+	struct irqaction *action;
+
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!irq_shared_thread_pending()) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		mutex_lock(&irq_shared_lock);
+		list_for_each_entry(action, &irq_shared_actions, shared_list) {
+			if (test_and_clear_bit(IRQTF_RUNTHREAD,
+					       &action->thread_flags))
+				irq_thread_run(irq_to_desc(action->irq), action,
+					       irq_thread_handler_fn(action));
+		}
+		mutex_unlock(&irq_shared_lock);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static int irq_setup_shared_thread(struct irqaction *new,
+				   struct sched_param *param)
+{
+	struct task_struct *t;
+
+	mutex_lock(&irq_shared_lock);
+	if (!irq_shared_thread) {
+		t = kthread_create(irq_shared_thread_fn, NULL, "irq/shared");
+		if (IS_ERR(t)) {
+			mutex_unlock(&irq_shared_lock);
+			return PTR_ERR(t);
+		}
+		sched_setscheduler_nocheck(t, SCHED_FIFO, param);
+		irq_shared_thread = t;
+		wake_up_process(t);
+	}
+	get_task_struct(irq_shared_thread);
+	new->thread = irq_shared_thread;
+	set_bit(IRQTF_SHARED_THREAD, &new->thread_flags);
+	list_add_tail_rcu(&new->shared_list, &irq_shared_actions);
+	mutex_unlock(&irq_shared_lock);
+	return 0;
+}
+
+/*
+ * Stop the thread of an action, or detach it from the shared thread.
+ */
+static void irq_stop_thread(struct irqaction *action)
+{
+	struct task_struct *t = action->thread;
+
+	action->thread = NULL;
+	if (test_bit(IRQTF_SHARED_THREAD, &action->thread_flags)) {
+		mutex_lock(&irq_shared_lock);
+		list_del_rcu(&action->shared_list);
+		mutex_unlock(&irq_shared_lock);
+		synchronize_rcu();
+	} else {
+		kthread_stop(t);
+	}
+	put_task_struct(t);
+}
+
 /**
  *	irq_wake_thread - wake the irq thread for the action identified by dev_id
  *	@irq:		Interrupt line
@@ -1053,6 +1193,13 @@ setup_irq_thread(struct irqaction *new, unsigned int irq, bool secondary)
 		.sched_priority = MAX_USER_RT_PRIO/2,
 	};
 
+	/*
+	 * The shared thread does not follow the affinity of any of its
+	 * interrupts.
+	 */
+	if (!secondary && (new->flags & IRQF_SHARED_THREAD))
+		return irq_setup_shared_thread(new, &param);
+
 	if (!secondary) {
 		t = kthread_create(irq_thread, new, "irq/%d-%s", irq,
 				   new->name);
@@ -1415,20 +1562,10 @@ out_bus_unlock:
 	mutex_unlock(&desc->request_mutex);
 
 out_thread:
-	if (new->thread) {
-		struct task_struct *t = new->thread;
-
-		new->thread = NULL;
-		kthread_stop(t);
-		put_task_struct(t);
-	}
-	if (new->secondary && new->secondary->thread) {
-		struct task_struct *t = new->secondary->thread;
-
-		new->secondary->thread = NULL;
-		kthread_stop(t);
-		put_task_struct(t);
-	}
+	if (new->thread)
+		irq_stop_thread(new);
+	if (new->secondary && new->secondary->thread)
+		irq_stop_thread(new->secondary);
 out_mput:
 	module_put(desc->owner);
 	return ret;
@@ -1558,12 +1695,9 @@ static struct irqaction *__free_irq(unsigned int irq, void *dev_id)
 #endif
 
 	if (action->thread) {
-		kthread_stop(action->thread);
-		put_task_struct(action->thread);
-		if (action->secondary && action->secondary->thread) {
-			kthread_stop(action->secondary->thread);
-			put_task_struct(action->secondary->thread);
-		}
+		irq_stop_thread(action);
+		if (action->secondary && action->secondary->thread)
+			irq_stop_thread(action->secondary);
 	}
 
 	/* Last action releases resources */
@@ -25,6 +25,15 @@ DEFINE_STATIC_KEY_FALSE(irq_timing_enabled);
 
 DEFINE_PER_CPU(struct irq_timings, irq_timings);
 
+/*
+ * Number of past intervals kept per interrupt to detect a repeating
+ * pattern, and the longest pattern looked for. A pattern must be seen
+ * three times in a row before it is trusted.
+ */
+#define IRQT_HIST_SIZE		32
+#define IRQT_HIST_MASK		(IRQT_HIST_SIZE - 1)
+#define IRQT_PERIOD_MAX		8
+
 struct irqt_stat {
 	u64	next_evt;
 	u64	last_ts;
@@ -33,6 +42,9 @@ struct irqt_stat {
 	u32	nr_samples;
 	int	anomalies;
 	int	valid;
+	int	period;
+	u32	nr_intervals;
+	u32	intervals[IRQT_HIST_SIZE];
 };
 
 static DEFINE_IDR(irqt_stats);
@@ -47,6 +59,58 @@ void irq_timings_disable(void)
 	static_branch_disable(&irq_timing_enabled);
 }
 
+/*
+ * Return the interval @n steps back in the history, 0 being the most
+ * recent one.
+ */
+static inline u32 irqs_interval(struct irqt_stat *irqs, int n)
+{
+	return irqs->intervals[(irqs->nr_intervals - 1 - n) & IRQT_HIST_MASK];
+}
+
+/*
+ * Two intervals match when they are within 1/8 of each other, which
+ * absorbs the jitter of the interrupt delivery and of local_clock().
+ */
+static inline bool irqs_interval_match(u32 a, u32 b)
+{
+	u32 diff = a > b ? a - b : b - a;
+
+	return diff <= (max(a, b) >> 3);
+}
+
+/**
+ * irqs_find_period - detect a repeating pattern of intervals
+ *
+ * @irqs: an irqt_stat struct pointer
+ *
+ * Devices like audio, network with interrupt coalescing or storage with
+ * several queues often raise interrupts in a repeating pattern, e.g. two
+ * short intervals followed by a long one. Such a pattern is not a normal
+ * distribution around the average, so the statistical model below sees
+ * anomalies and resets, while the next interval is actually known: it is
+ * the one a period ago.
+ *
+ * Returns the shortest period, in number of intervals, which repeats over
+ * the last three periods, or 0 if there is none.
+ */
+static int irqs_find_period(struct irqt_stat *irqs)
+{
+	int nr = min_t(u32, irqs->nr_intervals, IRQT_HIST_SIZE);
+	int period, i;
+
+	for (period = 1; period <= IRQT_PERIOD_MAX && 3 * period <= nr; period++) {
+		for (i = 0; i < 2 * period; i++) {
+			if (!irqs_interval_match(irqs_interval(irqs, i),
+						 irqs_interval(irqs, i + period)))
+				break;
+		}
+		if (i == 2 * period)
+			return period;
+	}
+	return 0;
+}
+
 /**
  * irqs_update - update the irq timing statistics with a new timestamp
  *
@@ -147,6 +211,13 @@ static void irqs_update(struct irqt_stat *irqs, u64 ts)
 		return;
 	}
 
+	/*
+	 * Keep the interval history and look for a repeating pattern
+	 * in it.
+	 */
+	irqs->intervals[irqs->nr_intervals++ & IRQT_HIST_MASK] = interval;
+	irqs->period = irqs_find_period(irqs);
+
 	/*
 	 * Pre-compute the delta with the average as the result is
 	 * used several times in this function.
@@ -174,7 +245,8 @@ static void irqs_update(struct irqt_stat *irqs, u64 ts)
 	 * apply. Values outside the interval are considered as an
 	 * anomaly.
 	 */
-	if ((irqs->nr_samples >= 30) && ((diff * diff) > (9 * variance))) {
+	if ((irqs->nr_samples >= 30) && ((diff * diff) > (9 * variance)) &&
+	    !irqs->period) {
 		/*
 		 * After three consecutive anomalies, we reset the
 		 * stats as it is no longer stable enough.
@@ -220,9 +292,14 @@ static void irqs_update(struct irqt_stat *irqs, u64 ts)
 	irqs->variance = irqs->variance + (diff * (interval - irqs->avg));
 
 	/*
-	 * Update the next event
+	 * Update the next event: one period ago, the interval which
+	 * followed is the one we expect now. Without a pattern, use the
+	 * average.
 	 */
-	irqs->next_evt = ts + irqs->avg;
+	if (irqs->period)
+		irqs->next_evt = ts + irqs_interval(irqs, irqs->period - 1);
+	else
+		irqs->next_evt = ts + irqs->avg;
 }
 
 /**
@@ -40,6 +40,8 @@
 #include <linux/slab.h>
 #include <linux/percpu-rwsem.h>
 #include <linux/torture.h>
+#include <linux/math64.h>
+#include <linux/sched/clock.h>
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Paul E. McKenney <paulmck@us.ibm.com>");
@@ -59,6 +61,12 @@ torture_param(int, stat_interval, 60,
 torture_param(int, stutter, 5, "Number of jiffies to run/halt test, 0=disable");
 torture_param(bool, verbose, true,
 	     "Enable verbose debugging printk()s");
+torture_param(bool, bench, false,
+	     "Measure lock performance instead of torture-testing");
+torture_param(int, bench_cs_ns, 1000,
+	     "Critical section length in bench mode (ns)");
+torture_param(int, bench_ncs_ns, 1000,
+	     "Time between critical sections in bench mode (ns)");
 
 static char *torture_type = "spin_lock";
 module_param(torture_type, charp, 0444);
@@ -72,11 +80,19 @@ static struct task_struct **reader_tasks;
 static bool lock_is_write_held;
 static bool lock_is_read_held;
 
+/* log2 buckets of nanoseconds, the last one open-ended */
+#define LOCK_BENCH_BUCKETS	32
+
 struct lock_stress_stats {
 	long n_lock_fail;
 	long n_lock_acquired;
+	/* bench mode only: time to acquire, and time held */
+	unsigned long wait_hist[LOCK_BENCH_BUCKETS];
+	unsigned long hold_hist[LOCK_BENCH_BUCKETS];
 };
 
+static u64 bench_start;
+
 int torture_runnable = IS_ENABLED(MODULE);
 module_param(torture_runnable, int, 0444);
 MODULE_PARM_DESC(torture_runnable, "Start locktorture at module init");
@@ -201,6 +217,73 @@ static struct lock_torture_ops spin_lock_ops = {
 	.name		= "spin_lock"
 };
 
+/*
+ * Reference spinlock algorithms, to compare the architecture's spinlock
+ * against under the same load: a test-and-test-and-set lock like the one
+ * riscv used to have, and a plain ticket lock.
+ */
+static atomic_t torture_tas_lock = ATOMIC_INIT(0);
+
+static int torture_tas_lock_write_lock(void)
+{
+	preempt_disable();
+	for (;;) {
+		while (atomic_read(&torture_tas_lock))
+			cpu_relax();
+		if (!atomic_xchg_acquire(&torture_tas_lock, 1))
+			break;
+	}
+	return 0;
+}
+
+static void torture_tas_lock_write_unlock(void)
+{
+	atomic_set_release(&torture_tas_lock, 0);
+	preempt_enable();
+}
+
+static struct lock_torture_ops tas_lock_ops = {
+	.writelock	= torture_tas_lock_write_lock,
+	.write_delay	= torture_spin_lock_write_delay,
+	.task_boost     = torture_boost_dummy,
+	.writeunlock	= torture_tas_lock_write_unlock,
+	.readlock       = NULL,
+	.read_delay     = NULL,
+	.readunlock     = NULL,
+	.name		= "tas_lock"
+};
+
+static atomic_t torture_ticket_next = ATOMIC_INIT(0);
+static int torture_ticket_owner;
+
+static int torture_ticket_lock_write_lock(void)
+{
+	int ticket;
+
+	preempt_disable();
+	ticket = atomic_fetch_inc_relaxed(&torture_ticket_next);
+	while (smp_load_acquire(&torture_ticket_owner) != ticket)
+		cpu_relax();
+	return 0;
+}
+
+static void torture_ticket_lock_write_unlock(void)
+{
+	smp_store_release(&torture_ticket_owner, torture_ticket_owner + 1);
+	preempt_enable();
+}
+
+static struct lock_torture_ops ticket_lock_ops = {
+	.writelock	= torture_ticket_lock_write_lock,
+	.write_delay	= torture_spin_lock_write_delay,
+	.task_boost     = torture_boost_dummy,
+	.writeunlock	= torture_ticket_lock_write_unlock,
+	.readlock       = NULL,
+	.read_delay     = NULL,
+	.readunlock     = NULL,
+	.name		= "ticket_lock"
+};
+
 static int torture_spin_lock_write_lock_irq(void)
 __acquires(torture_spinlock)
 {
@@ -638,6 +721,43 @@ static struct lock_torture_ops percpu_rwsem_lock_ops = {
 	.name		= "percpu_rwsem_lock"
 };
 
+static void lock_bench_delay(int ns)
+{
+	if (ns >= 1000)
+		udelay(ns / 1000);
+	ndelay(ns % 1000);
+}
+
+static int lock_bench_bucket(u64 ns)
+{
+	return min(fls64(ns), LOCK_BENCH_BUCKETS - 1);
+}
+
+/*
+ * One bench-mode iteration: fixed critical and non-critical sections, no
+ * random delays and no checking, which would only add shared cache lines
+ * of their own to what is measured.
+ */
+static void lock_bench_one(struct lock_stress_stats *sp,
+			   int (*lock)(void), void (*unlock)(void))
+{
+	u64 t0, t1, t2;
+
+	t0 = local_clock();
+	lock();
+	t1 = local_clock();
+	lock_bench_delay(bench_cs_ns);
+	t2 = local_clock();
+	unlock();
+
+	sp->n_lock_acquired++;
+	sp->wait_hist[lock_bench_bucket(t1 - t0)]++;
+	sp->hold_hist[lock_bench_bucket(t2 - t1)]++;
+
+	lock_bench_delay(bench_ncs_ns);
+	cond_resched();
+}
+
 /*
  * Lock torture writer kthread.  Repeatedly acquires and releases
  * the lock, checking for duplicate acquisitions.
@@ -651,6 +771,12 @@ static int lock_torture_writer(void *arg)
 	set_user_nice(current, MAX_NICE);
 
 	do {
+		if (bench) {
+			lock_bench_one(lwsp, cxt.cur_ops->writelock,
+				       cxt.cur_ops->writeunlock);
+			continue;
+		}
+
 		if ((torture_random(&rand) & 0xfffff) == 0)
 			schedule_timeout_uninterruptible(1);
 
@@ -688,6 +814,12 @@ static int lock_torture_reader(void *arg)
 	set_user_nice(current, MAX_NICE);
 
 	do {
+		if (bench) {
+			lock_bench_one(lrsp, cxt.cur_ops->readlock,
+				       cxt.cur_ops->readunlock);
+			continue;
+		}
+
 		if ((torture_random(&rand) & 0xfffff) == 0)
 			schedule_timeout_uninterruptible(1);
 
@@ -707,6 +839,58 @@ static int lock_torture_reader(void *arg)
 	return 0;
 }
 
+static char *lock_bench_print_hist(char *page, const char *what,
+				   struct lock_stress_stats *statp,
+				   int n_stress, bool hold)
+{
+	unsigned long hist[LOCK_BENCH_BUCKETS] = { 0 };
+	int i, b, last = 0;
+
+	for (i = 0; i < n_stress; i++) {
+		for (b = 0; b < LOCK_BENCH_BUCKETS; b++) {
+			hist[b] += hold ? statp[i].hold_hist[b] :
+					  statp[i].wait_hist[b];
+			if (hist[b])
+				last = b;
+		}
+	}
+
+	page += sprintf(page, "  %s (log2 ns):", what);
+	for (b = 0; b <= last; b++)
+		page += sprintf(page, " %lu", hist[b]);
+	page += sprintf(page, "\n");
+
+	return page;
+}
+
+/*
+ * Bench-mode summary: throughput over the whole run so far, and how
+ * evenly the acquisitions were spread over the threads.
+ */
+static void lock_bench_print(char *page, struct lock_stress_stats *statp,
+			     bool write)
+{
+	int i, n_stress = write ? cxt.nrealwriters_stress :
+				  cxt.nrealreaders_stress;
+	long max = 0, min = LONG_MAX;
+	u64 sum = 0, elapsed;
+
+	for (i = 0; i < n_stress; i++) {
+		sum += statp[i].n_lock_acquired;
+		max = max(max, statp[i].n_lock_acquired);
+		min = min(min, statp[i].n_lock_acquired);
+	}
+	elapsed = max_t(u64, local_clock() - bench_start, 1);
+
+	page += sprintf(page,
+			"%s bench: %llu ops/s  cs/ncs: %d/%d ns  Thread max/min: %ld/%ld\n",
+			write ? "Writes" : "Reads ",
+			div64_u64(sum * NSEC_PER_SEC, elapsed),
+			bench_cs_ns, bench_ncs_ns, max, n_stress ? min : 0);
+	page = lock_bench_print_hist(page, "wait", statp, n_stress, false);
+	lock_bench_print_hist(page, "hold", statp, n_stress, true);
+}
+
 /*
  * Create an lock-torture-statistics message in the specified buffer.
  */
@@ -761,7 +945,10 @@ static void lock_torture_stats_print(void)
 		return;
 	}
 
-	__torture_print_stats(buf, cxt.lwsa, true);
+	if (bench)
+		lock_bench_print(buf, cxt.lwsa, true);
+	else
+		__torture_print_stats(buf, cxt.lwsa, true);
 	pr_alert("%s", buf);
 	kfree(buf);
 
@@ -773,7 +960,10 @@ static void lock_torture_stats_print(void)
 			return;
 		}
 
-		__torture_print_stats(buf, cxt.lrsa, false);
+		if (bench)
+			lock_bench_print(buf, cxt.lrsa, false);
+		else
+			__torture_print_stats(buf, cxt.lrsa, false);
 		pr_alert("%s", buf);
 		kfree(buf);
 	}
@@ -803,11 +993,12 @@ lock_torture_print_module_parms(struct lock_torture_ops *cur_ops,
 				const char *tag)
 {
 	pr_alert("%s" TORTURE_FLAG
-		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d\n",
+		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d bench=%d bench_cs_ns=%d bench_ncs_ns=%d\n",
 		 torture_type, tag, cxt.debug_lock ? " [debug]": "",
 		 cxt.nrealwriters_stress, cxt.nrealreaders_stress, stat_interval,
 		 verbose, shuffle_interval, stutter, shutdown_secs,
-		 onoff_interval, onoff_holdoff);
+		 onoff_interval, onoff_holdoff, bench, bench_cs_ns,
+		 bench_ncs_ns);
 }
 
 static void lock_torture_cleanup(void)
@@ -869,6 +1060,7 @@ static int __init lock_torture_init(void)
 	static struct lock_torture_ops *torture_ops[] = {
 		&lock_busted_ops,
 		&spin_lock_ops, &spin_lock_irq_ops,
+		&tas_lock_ops, &ticket_lock_ops,
 		&rw_lock_ops, &rw_lock_irq_ops,
 		&mutex_lock_ops,
 		&ww_mutex_lock_ops,
@@ -901,6 +1093,18 @@ static int __init lock_torture_init(void)
 	if (cxt.cur_ops->init)
 		cxt.cur_ops->init();
 
+	/*
+	 * Bench numbers have to be reproducible: no stuttering, no
+	 * shuffling of the threads over the CPUs, no CPU hotplug.
+	 */
+	if (bench) {
+		stutter = 0;
+		shuffle_interval = 0;
+		onoff_interval = 0;
+		bench_cs_ns = max(bench_cs_ns, 0);
+		bench_ncs_ns = max(bench_ncs_ns, 0);
+	}
+
 	if (nwriters_stress >= 0)
 		cxt.nrealwriters_stress = nwriters_stress;
 	else
@@ -929,10 +1133,7 @@ static int __init lock_torture_init(void)
 		firsterr = -ENOMEM;
 		goto unwind;
 	}
-	for (i = 0; i < cxt.nrealwriters_stress; i++) {
-		cxt.lwsa[i].n_lock_fail = 0;
-		cxt.lwsa[i].n_lock_acquired = 0;
-	}
+	memset(cxt.lwsa, 0, sizeof(*cxt.lwsa) * cxt.nrealwriters_stress);
 
 	if (cxt.cur_ops->readlock) {
 		if (nreaders_stress >= 0)
@@ -958,10 +1159,7 @@ static int __init lock_torture_init(void)
 			goto unwind;
 		}
 
-		for (i = 0; i < cxt.nrealreaders_stress; i++) {
-			cxt.lrsa[i].n_lock_fail = 0;
-			cxt.lrsa[i].n_lock_acquired = 0;
-		}
+		memset(cxt.lrsa, 0, sizeof(*cxt.lrsa) * cxt.nrealreaders_stress);
 	}
 
 	lock_torture_print_module_parms(cxt.cur_ops, "Start of test");
@@ -1038,6 +1236,7 @@ static int __init lock_torture_init(void)
 		if (firsterr)
 			goto unwind;
 	}
+	bench_start = local_clock();
 	if (stat_interval > 0) {
 		firsterr = torture_create_kthread(lock_torture_stats, NULL,
 						  stats_task);
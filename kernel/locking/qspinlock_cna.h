@@ -0,0 +1,195 @@
+#ifndef _GEN_CNA_LOCK_SLOWPATH
+#error "do not include this file"
+#endif
+
+#include <linux/topology.h>
+
+/*
+ * NUMA-aware queueing for the qspinlock slowpath, after the compact
+ * NUMA-aware (CNA) lock of Dice and Kogan:
+ *
+ *   https://arxiv.org/abs/1810.05600
+ *
+ * The MCS queue is split in two.  The main queue is the one the lock word
+ * points to; the secondary queue holds waiters from other nodes that the
+ * queue head moved out of the way, so that the lock goes to a waiter on
+ * its own node next and the data protected by the lock stays there.
+ *
+ * The secondary queue isn't anchored anywhere: it is passed along with
+ * the MCS lock, as the value the lock holder stores in its successor's
+ * ->locked.  That is 1 when there is no secondary queue, and the encoded
+ * tail of its last node otherwise; the queue is circular, so the last
+ * node's ->next is its first.
+ *
+ * When nobody from the main queue is left, or after numa_spinlock_threshold
+ * hand-offs within a node, the secondary queue goes back in front of the
+ * main one, which bounds how long a remote waiter can be passed over.
+ */
+
+struct cna_node {
+	struct mcs_spinlock	mcs;
+	struct mcs_spinlock	__res[3];
+
+	int			numa_node;
+	u32			encoded_tail;
+	/* Of the last node of a secondary queue: hand-offs since it formed */
+	u32			intra_count;
+};
+
+static bool numa_spinlock __initdata;
+static u32 numa_spinlock_threshold __read_mostly = 1 << 16;
+
+static int __init numa_spinlock_setup(char *str)
+{
+	return kstrtobool(str, &numa_spinlock) ? -EINVAL : 0;
+}
+early_param("numa_spinlock", numa_spinlock_setup);
+
+static int __init numa_spinlock_threshold_setup(char *str)
+{
+	return kstrtou32(str, 0, &numa_spinlock_threshold) ? -EINVAL : 0;
+}
+early_param("numa_spinlock_threshold", numa_spinlock_threshold_setup);
+
+/*
+ * Switch before the other CPUs come up, while no lock can have waiters
+ * queued in the native format.
+ */
+static int __init cna_configure_spin_lock_slowpath(void)
+{
+	BUILD_BUG_ON(sizeof(struct cna_node) > 5 * sizeof(struct mcs_spinlock));
+
+	if (!numa_spinlock || nr_node_ids < 2)
+		return 0;
+
+	static_branch_enable(&numa_spinlock_key);
+	pr_info("qspinlock: NUMA-aware queueing enabled\n");
+	return 0;
+}
+early_initcall(cna_configure_spin_lock_slowpath);
+
+static __always_inline struct cna_node *to_cna(struct mcs_spinlock *node)
+{
+	return (struct cna_node *)node;
+}
+
+static __always_inline void cna_init_node(struct mcs_spinlock *node)
+{
+	int cpu = smp_processor_id();
+
+	to_cna(node)->numa_node = cpu_to_node(cpu);
+	to_cna(node)->encoded_tail =
+		encode_tail(cpu, node - this_cpu_ptr(&mcs_nodes[0]));
+}
+
+/* Append the waiters from @first to @last to our secondary queue */
+static void cna_splice_secondary(struct mcs_spinlock *node,
+				 struct mcs_spinlock *first,
+				 struct mcs_spinlock *last)
+{
+	u32 sec = node->locked;
+
+	if (sec > 1) {
+		struct mcs_spinlock *tail = decode_tail(sec);
+
+		WRITE_ONCE(last->next, tail->next);
+		WRITE_ONCE(tail->next, first);
+		to_cna(last)->intra_count = to_cna(tail)->intra_count;
+	} else {
+		WRITE_ONCE(last->next, first);
+		to_cna(last)->intra_count = 0;
+	}
+
+	node->locked = to_cna(last)->encoded_tail;
+}
+
+/*
+ * Called by the queue head while it waits for the owner: if our successor
+ * is on another node, look for the first waiter on ours and move the ones
+ * in between to the secondary queue.  Waiters can't leave the queue
+ * before they get the lock, so walking it is safe; a NULL ->next means
+ * its waiter is still linking itself in, and we stop there, so the tail
+ * of the main queue is never moved.
+ */
+static u32 cna_wait_head_or_lock(struct qspinlock *lock,
+				 struct mcs_spinlock *node)
+{
+	struct mcs_spinlock *next = READ_ONCE(node->next);
+	struct mcs_spinlock *last, *cur;
+	int numa_node = to_cna(node)->numa_node;
+
+	if (!next || to_cna(next)->numa_node == numa_node)
+		return 0;
+
+	for (last = next; ; last = cur) {
+		cur = READ_ONCE(last->next);
+		if (!cur)
+			return 0;
+		if (to_cna(cur)->numa_node == numa_node)
+			break;
+	}
+
+	cna_splice_secondary(node, next, last);
+	WRITE_ONCE(node->next, cur);
+
+	/* Go on to spin on the lock word as usual */
+	return 0;
+}
+
+/*
+ * We're the last waiter in the main queue.  Without a secondary queue the
+ * lock word just loses its tail; with one, that becomes the main queue:
+ * break the circle first, as new waiters will link behind its last node
+ * as soon as the lock word points there.
+ */
+static u32 cna_try_clear_tail(struct qspinlock *lock, u32 val,
+			      struct mcs_spinlock *node)
+{
+	struct mcs_spinlock *tail, *head;
+	u32 sec = node->locked;
+	u32 old;
+
+	if (sec <= 1)
+		return atomic_cmpxchg_relaxed(&lock->val, val, _Q_LOCKED_VAL);
+
+	tail = decode_tail(sec);
+	head = tail->next;
+	WRITE_ONCE(tail->next, NULL);
+
+	old = atomic_cmpxchg_release(&lock->val, val, _Q_LOCKED_VAL | sec);
+	if (old == val) {
+		smp_store_release(&head->locked, 1);
+		return val;
+	}
+
+	WRITE_ONCE(tail->next, head);
+	return old;
+}
+
+/*
+ * Hand the MCS lock on.  cna_wait_head_or_lock() may have changed our
+ * successor since the caller looked, so go by node->next.
+ */
+static void cna_pass_lock(struct mcs_spinlock *node, struct mcs_spinlock *next)
+{
+	u32 sec = node->locked;
+	u32 val = 1;
+
+	next = READ_ONCE(node->next);
+
+	if (sec > 1) {
+		struct mcs_spinlock *tail = decode_tail(sec);
+
+		if (to_cna(tail)->intra_count++ < numa_spinlock_threshold) {
+			val = sec;
+		} else {
+			/* Time the other nodes had a turn */
+			struct mcs_spinlock *head = tail->next;
+
+			WRITE_ONCE(tail->next, next);
+			next = head;
+		}
+	}
+
+	smp_store_release(&next->locked, val);
+}
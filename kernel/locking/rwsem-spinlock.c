@@ -27,7 +27,7 @@ int rwsem_is_locked(struct rw_semaphore *sem)
 	unsigned long flags;
 
 	if (raw_spin_trylock_irqsave(&sem->wait_lock, flags)) {
-		ret = (sem->count != 0);
+		ret = (sem->count != 0) || rwsem_bias_is_locked(sem);
 		raw_spin_unlock_irqrestore(&sem->wait_lock, flags);
 	}
 	return ret;
@@ -50,6 +50,9 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->count = 0;
 	raw_spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef CONFIG_RWSEM_READER_BIAS
+	sem->bias = NULL;
+#endif
 }
 EXPORT_SYMBOL(__init_rwsem);
 
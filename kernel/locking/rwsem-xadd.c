@@ -89,6 +89,9 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->owner = NULL;
 	osq_lock_init(&sem->osq);
 #endif
+#ifdef CONFIG_RWSEM_READER_BIAS
+	sem->bias = NULL;
+#endif
 }
 
 EXPORT_SYMBOL(__init_rwsem);
@@ -11,9 +11,259 @@
 #include <linux/export.h>
 #include <linux/rwsem.h>
 #include <linux/atomic.h>
+#include <linux/percpu.h>
+#include <linux/rcuwait.h>
+#include <linux/slab.h>
 
 #include "rwsem.h"
 
+#ifdef CONFIG_RWSEM_READER_BIAS
+/*
+ * Reader-biased mode, for read-mostly semaphores whose readers would
+ * otherwise all bounce the cache line of sem->count: readers only count
+ * themselves in a per-CPU counter, and it is writers that do the work.
+ *
+ * A writer first takes the semaphore as usual, which keeps out other
+ * writers, then sets readers_block so new readers stop taking the fast
+ * path, and waits for the per-CPU counts to sum to zero.  Readers that
+ * see readers_block queue up behind the writer in the semaphore proper
+ * and count themselves once they get it, so they never starve a writer
+ * and a writer never waits for a grace period, unlike percpu-rwsem.
+ *
+ * Counts are only ever summed, so a reader may sleep and migrate while
+ * it holds the lock, as mmap_sem readers do in page faults.
+ */
+struct rwsem_reader_bias {
+	unsigned int __percpu	*read_count;
+	struct rcuwait		writer;
+	int			readers_block;
+};
+
+static inline struct rwsem_reader_bias *rwsem_bias(struct rw_semaphore *sem)
+{
+	return sem->bias;
+}
+
+static inline void rwsem_bias_read_release(struct rwsem_reader_bias *b)
+{
+	smp_mb(); /* B matches C */
+	this_cpu_dec(*b->read_count);
+
+	/* Prod a writer to recheck the counts; also a full barrier */
+	rcuwait_wake_up(&b->writer);
+}
+
+static inline bool rwsem_bias_read_trylock(struct rwsem_reader_bias *b)
+{
+	this_cpu_inc(*b->read_count);
+
+	smp_mb(); /* A matches D */
+
+	/* If !readers_block, matched by the release in rwsem_bias_unblock() */
+	if (likely(!smp_load_acquire(&b->readers_block)))
+		return true;
+
+	rwsem_bias_read_release(b);
+	return false;
+}
+
+static void rwsem_bias_down_read(struct rw_semaphore *sem,
+				 struct rwsem_reader_bias *b)
+{
+	if (rwsem_bias_read_trylock(b))
+		return;
+
+	/*
+	 * A writer holds or is about to hold the semaphore: wait for it
+	 * there.  No writer can get in while we hold it for reading, and
+	 * the next one will see our count as it takes it after us.
+	 */
+	__down_read(sem);
+	this_cpu_inc(*b->read_count);
+	__up_read(sem);
+}
+
+#define per_cpu_sum(var)						\
+({									\
+	typeof(var) __sum = 0;						\
+	int cpu;							\
+	compiletime_assert_atomic_type(__sum);				\
+	for_each_possible_cpu(cpu)					\
+		__sum += per_cpu(var, cpu);				\
+	__sum;								\
+})
+
+/*
+ * The sum is modular since readers may release on another CPU.  Once it
+ * is zero with readers_block set it stays zero, as any new reader backs
+ * its increment out again.
+ */
+static bool rwsem_bias_readers_gone(struct rwsem_reader_bias *b)
+{
+	if (per_cpu_sum(*b->read_count) != 0)
+		return false;
+
+	smp_mb(); /* C matches B */
+
+	return true;
+}
+
+/* Called with the semaphore held for writing */
+static void rwsem_bias_block(struct rwsem_reader_bias *b)
+{
+	WRITE_ONCE(b->readers_block, 1);
+
+	smp_mb(); /* D matches A */
+
+	/* Readers may sleep with the lock held, so this can't be killable */
+	rcuwait_wait_event(&b->writer, rwsem_bias_readers_gone(b));
+}
+
+static bool rwsem_bias_tryblock(struct rwsem_reader_bias *b)
+{
+	WRITE_ONCE(b->readers_block, 1);
+
+	smp_mb(); /* D matches A */
+
+	if (rwsem_bias_readers_gone(b))
+		return true;
+
+	smp_store_release(&b->readers_block, 0);
+	return false;
+}
+
+static inline void rwsem_bias_unblock(struct rwsem_reader_bias *b)
+{
+	smp_store_release(&b->readers_block, 0);
+}
+
+static void rwsem_bias_downgrade(struct rw_semaphore *sem,
+				 struct rwsem_reader_bias *b)
+{
+	/* Count ourselves as a reader before letting the others in */
+	this_cpu_inc(*b->read_count);
+	rwsem_clear_owner(sem);
+	rwsem_bias_unblock(b);
+	__up_write(sem);
+}
+
+/*
+ * Switch @sem to reader-biased mode.  It must be initialised and must not
+ * be in use, which in practice means calling this right after init_rwsem().
+ */
+int rwsem_enable_reader_bias(struct rw_semaphore *sem)
+{
+	struct rwsem_reader_bias *b;
+
+	b = kzalloc(sizeof(*b), GFP_KERNEL);
+	if (!b)
+		return -ENOMEM;
+
+	b->read_count = alloc_percpu(unsigned int);
+	if (!b->read_count) {
+		kfree(b);
+		return -ENOMEM;
+	}
+	rcuwait_init(&b->writer);
+
+	sem->bias = b;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(rwsem_enable_reader_bias);
+
+/* Also safe on a semaphore that was never switched */
+void rwsem_free_reader_bias(struct rw_semaphore *sem)
+{
+	struct rwsem_reader_bias *b = sem->bias;
+
+	if (!b)
+		return;
+
+	sem->bias = NULL;
+	free_percpu(b->read_count);
+	kfree(b);
+}
+EXPORT_SYMBOL_GPL(rwsem_free_reader_bias);
+
+int rwsem_bias_is_locked(struct rw_semaphore *sem)
+{
+	struct rwsem_reader_bias *b = sem->bias;
+
+	return b && per_cpu_sum(*b->read_count) != 0;
+}
+EXPORT_SYMBOL(rwsem_bias_is_locked);
+#else
+struct rwsem_reader_bias;
+
+static inline struct rwsem_reader_bias *rwsem_bias(struct rw_semaphore *sem)
+{
+	return NULL;
+}
+
+static inline void rwsem_bias_read_release(struct rwsem_reader_bias *b) { }
+static inline bool rwsem_bias_read_trylock(struct rwsem_reader_bias *b)
+{
+	return false;
+}
+static inline void rwsem_bias_down_read(struct rw_semaphore *sem,
+					struct rwsem_reader_bias *b) { }
+static inline void rwsem_bias_block(struct rwsem_reader_bias *b) { }
+static inline bool rwsem_bias_tryblock(struct rwsem_reader_bias *b)
+{
+	return true;
+}
+static inline void rwsem_bias_unblock(struct rwsem_reader_bias *b) { }
+static inline void rwsem_bias_downgrade(struct rw_semaphore *sem,
+					struct rwsem_reader_bias *b) { }
+#endif /* CONFIG_RWSEM_READER_BIAS */
+
+static inline void __rwsem_down_read(struct rw_semaphore *sem)
+{
+	struct rwsem_reader_bias *b = rwsem_bias(sem);
+
+	if (b) {
+		rwsem_bias_down_read(sem, b);
+		return;
+	}
+
+	LOCK_CONTENDED(sem, __down_read_trylock, __down_read);
+	rwsem_set_reader_owned(sem);
+}
+
+static inline void __rwsem_up_read(struct rw_semaphore *sem)
+{
+	struct rwsem_reader_bias *b = rwsem_bias(sem);
+
+	if (b)
+		rwsem_bias_read_release(b);
+	else
+		__up_read(sem);
+}
+
+static inline void __rwsem_down_write(struct rw_semaphore *sem)
+{
+	struct rwsem_reader_bias *b = rwsem_bias(sem);
+
+	LOCK_CONTENDED(sem, __down_write_trylock, __down_write);
+	rwsem_set_owner(sem);
+
+	if (b)
+		rwsem_bias_block(b);
+}
+
+static inline int __rwsem_down_write_killable(struct rw_semaphore *sem)
+{
+	struct rwsem_reader_bias *b = rwsem_bias(sem);
+
+	if (LOCK_CONTENDED_RETURN(sem, __down_write_trylock, __down_write_killable))
+		return -EINTR;
+	rwsem_set_owner(sem);
+
+	if (b)
+		rwsem_bias_block(b);
+	return 0;
+}
+
 /*
  * lock for reading
  */
@@ -22,8 +272,7 @@ void __sched down_read(struct rw_semaphore *sem)
 	might_sleep();
 	rwsem_acquire_read(&sem->dep_map, 0, 0, _RET_IP_);
 
-	LOCK_CONTENDED(sem, __down_read_trylock, __down_read);
-	rwsem_set_reader_owned(sem);
+	__rwsem_down_read(sem);
 }
 
 EXPORT_SYMBOL(down_read);
@@ -33,8 +282,17 @@ EXPORT_SYMBOL(down_read);
  */
 int down_read_trylock(struct rw_semaphore *sem)
 {
-	int ret = __down_read_trylock(sem);
+	struct rwsem_reader_bias *b = rwsem_bias(sem);
+	int ret;
+
+	if (b) {
+		ret = rwsem_bias_read_trylock(b);
+		if (ret)
+			rwsem_acquire_read(&sem->dep_map, 0, 1, _RET_IP_);
+		return ret;
+	}
 
+	ret = __down_read_trylock(sem);
 	if (ret == 1) {
 		rwsem_acquire_read(&sem->dep_map, 0, 1, _RET_IP_);
 		rwsem_set_reader_owned(sem);
@@ -52,8 +310,7 @@ void __sched down_write(struct rw_semaphore *sem)
 	might_sleep();
 	rwsem_acquire(&sem->dep_map, 0, 0, _RET_IP_);
 
-	LOCK_CONTENDED(sem, __down_write_trylock, __down_write);
-	rwsem_set_owner(sem);
+	__rwsem_down_write(sem);
 }
 
 EXPORT_SYMBOL(down_write);
@@ -66,12 +323,11 @@ int __sched down_write_killable(struct rw_semaphore *sem)
 	might_sleep();
 	rwsem_acquire(&sem->dep_map, 0, 0, _RET_IP_);
 
-	if (LOCK_CONTENDED_RETURN(sem, __down_write_trylock, __down_write_killable)) {
+	if (__rwsem_down_write_killable(sem)) {
 		rwsem_release(&sem->dep_map, 1, _RET_IP_);
 		return -EINTR;
 	}
 
-	rwsem_set_owner(sem);
 	return 0;
 }
 
@@ -82,8 +338,14 @@ EXPORT_SYMBOL(down_write_killable);
  */
 int down_write_trylock(struct rw_semaphore *sem)
 {
+	struct rwsem_reader_bias *b = rwsem_bias(sem);
 	int ret = __down_write_trylock(sem);
 
+	if (ret == 1 && b && !rwsem_bias_tryblock(b)) {
+		__up_write(sem);
+		ret = 0;
+	}
+
 	if (ret == 1) {
 		rwsem_acquire(&sem->dep_map, 0, 1, _RET_IP_);
 		rwsem_set_owner(sem);
@@ -101,7 +363,7 @@ void up_read(struct rw_semaphore *sem)
 {
 	rwsem_release(&sem->dep_map, 1, _RET_IP_);
 
-	__up_read(sem);
+	__rwsem_up_read(sem);
 }
 
 EXPORT_SYMBOL(up_read);
@@ -111,9 +373,13 @@ EXPORT_SYMBOL(up_read);
  */
 void up_write(struct rw_semaphore *sem)
 {
+	struct rwsem_reader_bias *b = rwsem_bias(sem);
+
 	rwsem_release(&sem->dep_map, 1, _RET_IP_);
 
 	rwsem_clear_owner(sem);
+	if (b)
+		rwsem_bias_unblock(b);
 	__up_write(sem);
 }
 
@@ -124,8 +390,15 @@ EXPORT_SYMBOL(up_write);
  */
 void downgrade_write(struct rw_semaphore *sem)
 {
+	struct rwsem_reader_bias *b = rwsem_bias(sem);
+
 	lock_downgrade(&sem->dep_map, _RET_IP_);
 
+	if (b) {
+		rwsem_bias_downgrade(sem, b);
+		return;
+	}
+
 	rwsem_set_reader_owned(sem);
 	__downgrade_write(sem);
 }
@@ -139,8 +412,7 @@ void down_read_nested(struct rw_semaphore *sem, int subclass)
 	might_sleep();
 	rwsem_acquire_read(&sem->dep_map, subclass, 0, _RET_IP_);
 
-	LOCK_CONTENDED(sem, __down_read_trylock, __down_read);
-	rwsem_set_reader_owned(sem);
+	__rwsem_down_read(sem);
 }
 
 EXPORT_SYMBOL(down_read_nested);
@@ -150,17 +422,21 @@ void _down_write_nest_lock(struct rw_semaphore *sem, struct lockdep_map *nest)
 	might_sleep();
 	rwsem_acquire_nest(&sem->dep_map, 0, 0, nest, _RET_IP_);
 
-	LOCK_CONTENDED(sem, __down_write_trylock, __down_write);
-	rwsem_set_owner(sem);
+	__rwsem_down_write(sem);
 }
 
 EXPORT_SYMBOL(_down_write_nest_lock);
 
 void down_read_non_owner(struct rw_semaphore *sem)
 {
+	struct rwsem_reader_bias *b = rwsem_bias(sem);
+
 	might_sleep();
 
-	__down_read(sem);
+	if (b)
+		rwsem_bias_down_read(sem, b);
+	else
+		__down_read(sem);
 }
 
 EXPORT_SYMBOL(down_read_non_owner);
@@ -170,8 +446,7 @@ void down_write_nested(struct rw_semaphore *sem, int subclass)
 	might_sleep();
 	rwsem_acquire(&sem->dep_map, subclass, 0, _RET_IP_);
 
-	LOCK_CONTENDED(sem, __down_write_trylock, __down_write);
-	rwsem_set_owner(sem);
+	__rwsem_down_write(sem);
 }
 
 EXPORT_SYMBOL(down_write_nested);
@@ -181,12 +456,11 @@ int __sched down_write_killable_nested(struct rw_semaphore *sem, int subclass)
 	might_sleep();
 	rwsem_acquire(&sem->dep_map, subclass, 0, _RET_IP_);
 
-	if (LOCK_CONTENDED_RETURN(sem, __down_write_trylock, __down_write_killable)) {
+	if (__rwsem_down_write_killable(sem)) {
 		rwsem_release(&sem->dep_map, 1, _RET_IP_);
 		return -EINTR;
 	}
 
-	rwsem_set_owner(sem);
 	return 0;
 }
 
@@ -194,7 +468,7 @@ EXPORT_SYMBOL(down_write_killable_nested);
 
 void up_read_non_owner(struct rw_semaphore *sem)
 {
-	__up_read(sem);
+	__rwsem_up_read(sem);
 }
 
 EXPORT_SYMBOL(up_read_non_owner);
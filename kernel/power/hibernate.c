@@ -38,6 +38,7 @@
 
 
 static int nocompress;
+static int compress_lz4;
 static int noresume;
 static int nohibernate;
 static int resume_wait;
@@ -727,6 +728,8 @@ int hibernate(void)
 			flags |= SF_NOCOMPRESS_MODE;
 		else
 		        flags |= SF_CRC32_MODE;
+		if (!nocompress && compress_lz4)
+			flags |= SF_LZ4_MODE;
 
 		pm_pr_dbg("Writing image.\n");
 		error = swsusp_write(flags);
@@ -1154,6 +1157,8 @@ static int __init hibernate_setup(char *str)
 		noresume = 1;
 	} else if (!strncmp(str, "nocompress", 10)) {
 		nocompress = 1;
+	} else if (!strncmp(str, "lz4", 3)) {
+		compress_lz4 = 1;
 	} else if (!strncmp(str, "no", 2)) {
 		noresume = 1;
 		nohibernate = 1;
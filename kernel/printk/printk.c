@@ -42,6 +42,7 @@
 #include <linux/rculist.h>
 #include <linux/poll.h>
 #include <linux/irq_work.h>
+#include <linux/kthread.h>
 #include <linux/utsname.h>
 #include <linux/ctype.h>
 #include <linux/uio.h>
@@ -1692,12 +1693,75 @@ static size_t log_output(int facility, int level, enum log_flags lflags, const c
 	return log_store(facility, level, lflags, 0, dict, dictlen, text, text_len);
 }
 
+/*
+ * Messages are formatted into a per-CPU buffer before logbuf_lock is
+ * taken, so that the lock only covers storing the record. NMIs which
+ * print directly get their own buffer, as they can interrupt the
+ * formatting.
+ */
+struct printk_textbuf {
+	char text[LOG_LINE_MAX];
+};
+static DEFINE_PER_CPU(struct printk_textbuf, printk_textbuf[2]);
+
+/*
+ * The consoles are driven from a dedicated thread, so that a burst of
+ * messages does not stall every CPU which logs while a slow console
+ * catches up. The messages are printed directly until the thread runs,
+ * and when it might not get to run anymore: during an oops, a panic or
+ * a shutdown.
+ */
+static struct task_struct *printk_kthread;
+
+static bool printk_offload(void)
+{
+	return printk_kthread && !oops_in_progress &&
+	       system_state == SYSTEM_RUNNING;
+}
+
+static bool printk_console_pending(void)
+{
+	bool pending;
+
+	logbuf_lock_irq();
+	pending = !console_suspended && console_seq != log_next_seq;
+	logbuf_unlock_irq();
+	return pending;
+}
+
+static int printk_kthread_func(void *data)
+{
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!printk_console_pending())
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		console_lock();
+		console_unlock();
+	}
+	return 0;
+}
+
+static int __init printk_kthread_init(void)
+{
+	struct task_struct *tsk;
+
+	tsk = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(tsk)) {
+		pr_err("printk: failed to start the console thread\n");
+		return PTR_ERR(tsk);
+	}
+	printk_kthread = tsk;
+	return 0;
+}
+late_initcall(printk_kthread_init);
+
 asmlinkage int vprintk_emit(int facility, int level,
 			    const char *dict, size_t dictlen,
 			    const char *fmt, va_list args)
 {
-	static char textbuf[LOG_LINE_MAX];
-	char *text = textbuf;
+	char *text;
 	size_t text_len;
 	enum log_flags lflags = 0;
 	unsigned long flags;
@@ -1712,13 +1776,13 @@ asmlinkage int vprintk_emit(int facility, int level,
 	boot_delay_msec(level);
 	printk_delay();
 
-	/* This stops the holder of console_sem just where we want him */
-	logbuf_lock_irqsave(flags);
+	printk_safe_enter_irqsave(flags);
 	/*
 	 * The printf needs to come first; we need the syslog
 	 * prefix which might be passed-in as a parameter.
 	 */
-	text_len = vscnprintf(text, sizeof(textbuf), fmt, args);
+	text = this_cpu_ptr(&printk_textbuf[!!in_nmi()])->text;
+	text_len = vscnprintf(text, LOG_LINE_MAX, fmt, args);
 
 	/* mark and strip a trailing newline */
 	if (text_len && text[text_len-1] == '\n') {
@@ -1754,18 +1818,22 @@ asmlinkage int vprintk_emit(int facility, int level,
 	if (dict)
 		lflags |= LOG_PREFIX|LOG_NEWLINE;
 
+	/* This stops the holder of console_sem just where we want him */
+	raw_spin_lock(&logbuf_lock);
 	printed_len = log_output(facility, level, lflags, dict, dictlen, text, text_len);
-
 	logbuf_unlock_irqrestore(flags);
 
 	/* If called from the scheduler, we can not call up(). */
 	if (!in_sched) {
 		/*
-		 * Try to acquire and then immediately release the console
+		 * Leave the printing to the console thread, or try to
+		 * acquire and then immediately release the console
 		 * semaphore.  The release will print out buffers and wake up
 		 * /dev/kmsg and syslog() users.
 		 */
-		if (console_trylock())
+		if (printk_offload())
+			wake_up_process(printk_kthread);
+		else if (console_trylock())
 			console_unlock();
 	}
 
@@ -2703,7 +2771,9 @@ static void wake_up_klogd_work_func(struct irq_work *irq_work)
 
 	if (pending & PRINTK_PENDING_OUTPUT) {
 		/* If trylock fails, someone else is doing the printing */
-		if (console_trylock())
+		if (printk_offload())
+			wake_up_process(printk_kthread);
+		else if (console_trylock())
 			console_unlock();
 	}
 
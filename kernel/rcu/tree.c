@@ -162,6 +162,7 @@ static void invoke_rcu_core(void);
 static void invoke_rcu_callbacks(struct rcu_state *rsp, struct rcu_data *rdp);
 static void rcu_report_exp_rdp(struct rcu_state *rsp,
 			       struct rcu_data *rdp, bool wake);
+static void rcu_sched_exp_qs_req(void);
 static void sync_sched_exp_online_cleanup(int cpu);
 
 /* rcuc/rcub kthread realtime priority */
@@ -230,6 +231,7 @@ static int rcu_gp_in_progress(struct rcu_state *rsp)
 void rcu_sched_qs(void)
 {
 	RCU_LOCKDEP_WARN(preemptible(), "rcu_sched_qs() invoked with preemption enabled!!!");
+	rcu_sched_exp_qs_req();
 	if (!__this_cpu_read(rcu_sched_data.cpu_no_qs.s))
 		return;
 	trace_rcu_grace_period(TPS("rcu_sched"),
@@ -790,6 +792,7 @@ static void rcu_eqs_enter_common(bool user)
 		rdp = this_cpu_ptr(rsp->rda);
 		do_nocb_deferred_wakeup(rdp);
 	}
+	rcu_sched_exp_qs_req();
 	rcu_prepare_for_idle();
 	__this_cpu_inc(disable_rcu_irq_enter);
 	rdtp->dynticks_nesting = 0; /* Breaks tracing momentarily. */
@@ -3116,10 +3119,8 @@ EXPORT_SYMBOL_GPL(call_rcu_bh);
 
 /*
  * Queue an RCU callback for lazy invocation after a grace period.
- * This will likely be later named something like "call_rcu_lazy()",
- * but this change will require some way of tagging the lazy RCU
- * callbacks in the list of pending callbacks. Until then, this
- * function may only be called from __kfree_rcu().
+ * This may only be called from __kfree_rcu(); other callers wanting
+ * lazy invocation use call_rcu_lazy().
  */
 void kfree_call_rcu(struct rcu_head *head,
 		    rcu_callback_t func)
@@ -3128,6 +3129,22 @@ void kfree_call_rcu(struct rcu_head *head,
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
+/**
+ * call_rcu_lazy() - Queue an RCU callback that is in no hurry
+ * @head: structure to be used for queueing the RCU updates.
+ * @func: actual callback function to be invoked after the grace period
+ *
+ * Like call_rcu(), but for callbacks that only free memory, such as
+ * those for closed files or freed network buffers: on no-CBs CPUs they
+ * may wait up to rcutree.rcu_nocb_lazy_delay jiffies, or until memory
+ * gets tight, before their grace period is even started.
+ */
+void call_rcu_lazy(struct rcu_head *head, rcu_callback_t func)
+{
+	__call_rcu(head, func, rcu_state_p, -1, 1);
+}
+EXPORT_SYMBOL_GPL(call_rcu_lazy);
+
 /*
  * Because a context switch is a grace period for RCU-sched and RCU-bh,
  * any blocking grace-period wait automatically implies a grace period
@@ -255,6 +255,7 @@ struct rcu_data {
 	atomic_long_t exp_workdone2;	/* # done by others #2. */
 	atomic_long_t exp_workdone3;	/* # done by others #3. */
 	int exp_dynticks_snap;		/* Double-check need for IPI. */
+	int exp_qs_req;			/* Expedited QS wanted, IPI held back. */
 
 	/* 7) Callback offloading. */
 #ifdef CONFIG_RCU_NOCB_CPU
@@ -269,6 +270,8 @@ struct rcu_data {
 	raw_spinlock_t nocb_lock;	/* Guard following pair of fields. */
 	int nocb_defer_wakeup;		/* Defer wakeup of nocb_kthread. */
 	struct timer_list nocb_timer;	/* Enforce finite deferral. */
+	unsigned long nocb_batch_jiffies; /* Jiffy nocb_batch_count is for. */
+	int nocb_batch_count;		/* # CBs enqueued during that jiffy. */
 
 	/* The following fields are used by the leader, hence own cacheline. */
 	struct rcu_head *nocb_gp_head ____cacheline_internodealigned_in_smp;
@@ -290,10 +293,15 @@ struct rcu_data {
 	struct rcu_state *rsp;
 };
 
-/* Values for nocb_defer_wakeup field in struct rcu_data. */
+/*
+ * Values for nocb_defer_wakeup field in struct rcu_data, in increasing
+ * order of urgency.  LAZY and BATCH wakeups are left to ->nocb_timer.
+ */
 #define RCU_NOCB_WAKE_NOT	0
-#define RCU_NOCB_WAKE		1
-#define RCU_NOCB_WAKE_FORCE	2
+#define RCU_NOCB_WAKE_LAZY	1
+#define RCU_NOCB_WAKE_BATCH	2
+#define RCU_NOCB_WAKE		3
+#define RCU_NOCB_WAKE_FORCE	4
 
 #define RCU_JIFFIES_TILL_FORCE_QS (1 + (HZ > 250) + (HZ > 500))
 					/* For jiffies_till_first_fqs and */
@@ -313,6 +313,30 @@ fastpath:
 	return false;
 }
 
+/*
+ * How long, in microseconds, an expedited RCU-sched grace period first
+ * waits for CPUs to notice ->exp_qs_req on their own before IPIing them.
+ * Zero IPIs right away.
+ */
+static int rcu_exp_ipi_delay = 100;
+module_param(rcu_exp_ipi_delay, int, 0644);
+
+/*
+ * Report the expedited quiescent state sync_rcu_exp_select_cpus() asked
+ * this CPU for without an IPI, if any.  Called on context switch, on
+ * ticks from user mode and on entry to idle or nohz_full usermode, all
+ * of which are RCU-sched quiescent states.
+ */
+static void rcu_sched_exp_qs_req(void)
+{
+	struct rcu_data *rdp = this_cpu_ptr(&rcu_sched_data);
+
+	if (likely(!READ_ONCE(rdp->exp_qs_req)))
+		return;
+	if (xchg(&rdp->exp_qs_req, 0))
+		rcu_report_exp_rdp(&rcu_sched_state, rdp, true);
+}
+
 /* Invoked on each online non-idle CPU for expedited quiescent state. */
 static void sync_sched_exp_handler(void *data)
 {
@@ -352,6 +376,85 @@ static void sync_sched_exp_online_cleanup(int cpu)
 	WARN_ON_ONCE(ret);
 }
 
+/*
+ * IPI one CPU for an expedited quiescent state.  Returns true if the
+ * caller is to report the quiescent state itself, because the CPU was
+ * idle or went offline.
+ */
+static bool sync_rcu_exp_ipi_cpu(struct rcu_state *rsp, struct rcu_node *rnp,
+				 int cpu, smp_call_func_t func)
+{
+	unsigned long mask = leaf_node_cpu_bit(rnp, cpu);
+	struct rcu_data *rdp = per_cpu_ptr(rsp->rda, cpu);
+	unsigned long flags;
+	bool report;
+	int ret;
+
+retry_ipi:
+	if (rcu_dynticks_in_eqs_since(rdp->dynticks, rdp->exp_dynticks_snap))
+		return true;
+	ret = smp_call_function_single(cpu, func, rsp, 0);
+	if (!ret)
+		return false;
+	/* Failed, raced with CPU hotplug operation. */
+	raw_spin_lock_irqsave_rcu_node(rnp, flags);
+	if ((rnp->qsmaskinitnext & mask) &&
+	    (rnp->expmask & mask)) {
+		/* Online, so delay for a bit and try again. */
+		raw_spin_unlock_irqrestore_rcu_node(rnp, flags);
+		schedule_timeout_uninterruptible(1);
+		goto retry_ipi;
+	}
+	/* CPU really is offline, so we can ignore it. */
+	report = rnp->expmask & mask;
+	raw_spin_unlock_irqrestore_rcu_node(rnp, flags);
+	return report;
+}
+
+/*
+ * Rather than IPI a busy CPU for an RCU-sched expedited grace period,
+ * ask it for a quiescent state through ->exp_qs_req, which it will
+ * notice at its next context switch or idle entry.  Those that didn't
+ * within rcu_exp_ipi_delay get their IPI in sync_rcu_exp_ipi_deferred().
+ * That way CPUs just going idle, whose interrupt would have been
+ * wasted, aren't disturbed at all.
+ */
+static bool sync_rcu_exp_defer_ipi(struct rcu_state *rsp, int cpu,
+				   smp_call_func_t func)
+{
+	if (func != sync_sched_exp_handler || READ_ONCE(rcu_exp_ipi_delay) <= 0)
+		return false;
+	WRITE_ONCE(per_cpu_ptr(rsp->rda, cpu)->exp_qs_req, 1);
+	return true;
+}
+
+static void sync_rcu_exp_ipi_deferred(struct rcu_state *rsp,
+				      smp_call_func_t func)
+{
+	int cpu;
+	int delay = max(READ_ONCE(rcu_exp_ipi_delay), 1);
+	unsigned long mask_report;
+	struct rcu_node *rnp;
+
+	smp_mb(); /* ->exp_qs_req stores before the wait. */
+	usleep_range(delay, 2 * delay);
+
+	rcu_for_each_leaf_node(rsp, rnp) {
+		mask_report = 0;
+		for_each_leaf_node_possible_cpu(rnp, cpu) {
+			struct rcu_data *rdp = per_cpu_ptr(rsp->rda, cpu);
+
+			/* Zero if never asked, or if it reported already. */
+			if (!xchg(&rdp->exp_qs_req, 0))
+				continue;
+			if (sync_rcu_exp_ipi_cpu(rsp, rnp, cpu, func))
+				mask_report |= leaf_node_cpu_bit(rnp, cpu);
+		}
+		if (mask_report)
+			rcu_report_exp_cpu_mult(rsp, rnp, mask_report, false);
+	}
+}
+
 /*
  * Select the nodes that the upcoming expedited grace period needs
  * to wait for.
@@ -360,10 +463,10 @@ static void sync_rcu_exp_select_cpus(struct rcu_state *rsp,
 				     smp_call_func_t func)
 {
 	int cpu;
+	bool deferred = false;
 	unsigned long flags;
 	unsigned long mask_ofl_test;
 	unsigned long mask_ofl_ipi;
-	int ret;
 	struct rcu_node *rnp;
 
 	sync_exp_reset_tree(rsp);
@@ -396,40 +499,25 @@ static void sync_rcu_exp_select_cpus(struct rcu_state *rsp,
 		/* IPI the remaining CPUs for expedited quiescent state. */
 		for_each_leaf_node_possible_cpu(rnp, cpu) {
 			unsigned long mask = leaf_node_cpu_bit(rnp, cpu);
-			struct rcu_data *rdp = per_cpu_ptr(rsp->rda, cpu);
 
 			if (!(mask_ofl_ipi & mask))
 				continue;
-retry_ipi:
-			if (rcu_dynticks_in_eqs_since(rdp->dynticks,
-						      rdp->exp_dynticks_snap)) {
-				mask_ofl_test |= mask;
-				continue;
-			}
-			ret = smp_call_function_single(cpu, func, rsp, 0);
-			if (!ret) {
+			if (sync_rcu_exp_defer_ipi(rsp, cpu, func)) {
+				deferred = true;
 				mask_ofl_ipi &= ~mask;
 				continue;
 			}
-			/* Failed, raced with CPU hotplug operation. */
-			raw_spin_lock_irqsave_rcu_node(rnp, flags);
-			if ((rnp->qsmaskinitnext & mask) &&
-			    (rnp->expmask & mask)) {
-				/* Online, so delay for a bit and try again. */
-				raw_spin_unlock_irqrestore_rcu_node(rnp, flags);
-				schedule_timeout_uninterruptible(1);
-				goto retry_ipi;
-			}
-			/* CPU really is offline, so we can ignore it. */
-			if (!(rnp->expmask & mask))
+			if (!sync_rcu_exp_ipi_cpu(rsp, rnp, cpu, func))
 				mask_ofl_ipi &= ~mask;
-			raw_spin_unlock_irqrestore_rcu_node(rnp, flags);
 		}
 		/* Report quiescent states for those that went offline. */
 		mask_ofl_test |= mask_ofl_ipi;
 		if (mask_ofl_test)
 			rcu_report_exp_cpu_mult(rsp, rnp, mask_ofl_test, false);
 	}
+
+	if (deferred)
+		sync_rcu_exp_ipi_deferred(rsp, func);
 }
 
 static void synchronize_sched_expedited_wait(struct rcu_state *rsp)
@@ -27,6 +27,7 @@
 #include <linux/delay.h>
 #include <linux/gfp.h>
 #include <linux/oom.h>
+#include <linux/shrinker.h>
 #include <linux/sched/debug.h>
 #include <linux/smpboot.h>
 #include <uapi/linux/sched/types.h>
@@ -1753,6 +1754,26 @@ static int __init rcu_nocb_setup(char *str)
 }
 __setup("rcu_nocbs=", rcu_nocb_setup);
 
+/*
+ * Above rcu_nocb_batch_thresh callbacks per jiffy from one CPU, a callback
+ * arriving on an empty queue no longer wakes the leader right away: the
+ * wakeup is left to ->nocb_timer, rcu_nocb_batch_delay jiffies later, so
+ * that a stream of short bursts is handed over as one batch.  Zero turns
+ * this off.
+ */
+static int rcu_nocb_batch_thresh = 16;
+module_param(rcu_nocb_batch_thresh, int, 0644);
+static int rcu_nocb_batch_delay = 2;
+module_param(rcu_nocb_batch_delay, int, 0644);
+
+/*
+ * Lazy callbacks (see call_rcu_lazy()) don't wake the leader at all until
+ * rcu_nocb_lazy_delay jiffies have passed, a non-lazy callback is queued
+ * behind them, or the shrinker finds memory tight.  Zero turns this off.
+ */
+static int rcu_nocb_lazy_delay = 10 * HZ;
+module_param(rcu_nocb_lazy_delay, int, 0644);
+
 static int __init parse_rcu_nocb_poll(char *arg)
 {
 	rcu_nocb_poll = true;
@@ -1848,11 +1869,19 @@ static void wake_nocb_leader_defer(struct rcu_data *rdp, int waketype,
 				   const char *reason)
 {
 	unsigned long flags;
+	int delay = 1;
 
+	if (waketype == RCU_NOCB_WAKE_LAZY)
+		delay = max(READ_ONCE(rcu_nocb_lazy_delay), 1);
+	else if (waketype == RCU_NOCB_WAKE_BATCH)
+		delay = max(READ_ONCE(rcu_nocb_batch_delay), 1);
+
+	/* A more urgent wakeup may only pull the timer in, never push it out. */
 	raw_spin_lock_irqsave(&rdp->nocb_lock, flags);
-	if (rdp->nocb_defer_wakeup == RCU_NOCB_WAKE_NOT)
-		mod_timer(&rdp->nocb_timer, jiffies + 1);
-	WRITE_ONCE(rdp->nocb_defer_wakeup, waketype);
+	if (rdp->nocb_defer_wakeup < waketype) {
+		mod_timer(&rdp->nocb_timer, jiffies + delay);
+		WRITE_ONCE(rdp->nocb_defer_wakeup, waketype);
+	}
 	trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu, reason);
 	raw_spin_unlock_irqrestore(&rdp->nocb_lock, flags);
 }
@@ -1903,6 +1932,24 @@ static bool rcu_nocb_cpu_needs_barrier(struct rcu_state *rsp, int cpu)
 	return !!ret;
 }
 
+/*
+ * Is this CPU queueing callbacks quickly enough that wakeups of the
+ * leader should be batched?  Only ever called by the CPU owning rdp,
+ * with interrupts disabled.
+ */
+static bool rcu_nocb_batch_wakeup(struct rcu_data *rdp, int rhcount)
+{
+	int thresh = READ_ONCE(rcu_nocb_batch_thresh);
+
+	if (rdp->nocb_batch_jiffies != jiffies) {
+		rdp->nocb_batch_jiffies = jiffies;
+		rdp->nocb_batch_count = 0;
+	}
+	rdp->nocb_batch_count += rhcount;
+
+	return thresh > 0 && rdp->nocb_batch_count > thresh;
+}
+
 /*
  * Enqueue the specified string of rcu_head structures onto the specified
  * CPU's no-CBs lists.  The CPU is specified by rdp, the head of the
@@ -1918,6 +1965,7 @@ static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
 				    unsigned long flags)
 {
 	int len;
+	bool lazy, batch;
 	struct rcu_head **old_rhpp;
 	struct task_struct *t;
 
@@ -1937,8 +1985,19 @@ static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
 		return;
 	}
 	len = atomic_long_read(&rdp->nocb_q_count);
-	if (old_rhpp == &rdp->nocb_head) {
-		if (!irqs_disabled_flags(flags)) {
+	lazy = rhcount == rhcount_lazy && READ_ONCE(rcu_nocb_lazy_delay) > 0;
+	batch = rcu_nocb_batch_wakeup(rdp, rhcount);
+	/* ... and a queue holding only lazy CBs counts as empty here. */
+	if (old_rhpp == &rdp->nocb_head ||
+	    (!lazy &&
+	     READ_ONCE(rdp->nocb_defer_wakeup) == RCU_NOCB_WAKE_LAZY)) {
+		if (lazy) {
+			wake_nocb_leader_defer(rdp, RCU_NOCB_WAKE_LAZY,
+					       TPS("WakeEmptyIsLazy"));
+		} else if (batch) {
+			wake_nocb_leader_defer(rdp, RCU_NOCB_WAKE_BATCH,
+					       TPS("WakeEmptyIsBatched"));
+		} else if (!irqs_disabled_flags(flags)) {
 			/* ... if queue was empty ... */
 			wake_nocb_leader(rdp, false);
 			trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
@@ -2237,10 +2296,13 @@ static int rcu_nocb_kthread(void *arg)
 	return 0;
 }
 
-/* Is a deferred wakeup of rcu_nocb_kthread() required? */
+/*
+ * Is a deferred wakeup of rcu_nocb_kthread() required?  Lazy and batched
+ * wakeups wait for ->nocb_timer instead.
+ */
 static int rcu_nocb_need_deferred_wakeup(struct rcu_data *rdp)
 {
-	return READ_ONCE(rdp->nocb_defer_wakeup);
+	return READ_ONCE(rdp->nocb_defer_wakeup) >= RCU_NOCB_WAKE;
 }
 
 /* Do a deferred wakeup of rcu_nocb_kthread(). */
@@ -2250,11 +2312,11 @@ static void do_nocb_deferred_wakeup_common(struct rcu_data *rdp)
 	int ndw;
 
 	raw_spin_lock_irqsave(&rdp->nocb_lock, flags);
-	if (!rcu_nocb_need_deferred_wakeup(rdp)) {
+	ndw = READ_ONCE(rdp->nocb_defer_wakeup);
+	if (ndw == RCU_NOCB_WAKE_NOT) {
 		raw_spin_unlock_irqrestore(&rdp->nocb_lock, flags);
 		return;
 	}
-	ndw = READ_ONCE(rdp->nocb_defer_wakeup);
 	WRITE_ONCE(rdp->nocb_defer_wakeup, RCU_NOCB_WAKE_NOT);
 	__wake_nocb_leader(rdp, ndw == RCU_NOCB_WAKE_FORCE, flags);
 	trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu, TPS("DeferredWake"));
@@ -2266,6 +2328,52 @@ static void do_nocb_deferred_wakeup_timer(unsigned long x)
 	do_nocb_deferred_wakeup_common((struct rcu_data *)x);
 }
 
+/*
+ * Under memory pressure, stop waiting on lazy callbacks: wake the leaders
+ * of every no-CBs CPU that has some queued, so that they go through a
+ * grace period and free what they hold.
+ */
+static unsigned long rcu_nocb_lazy_count(struct shrinker *shrink,
+					 struct shrink_control *sc)
+{
+	unsigned long count = 0;
+	struct rcu_state *rsp;
+	int cpu;
+
+	for_each_rcu_flavor(rsp)
+		for_each_cpu(cpu, rcu_nocb_mask)
+			count += atomic_long_read(&per_cpu_ptr(rsp->rda,
+						  cpu)->nocb_q_count_lazy);
+	return count;
+}
+
+static unsigned long rcu_nocb_lazy_scan(struct shrinker *shrink,
+					struct shrink_control *sc)
+{
+	unsigned long count = 0;
+	struct rcu_data *rdp;
+	struct rcu_state *rsp;
+	int cpu;
+
+	for_each_rcu_flavor(rsp) {
+		for_each_cpu(cpu, rcu_nocb_mask) {
+			rdp = per_cpu_ptr(rsp->rda, cpu);
+			if (READ_ONCE(rdp->nocb_defer_wakeup) !=
+			    RCU_NOCB_WAKE_LAZY)
+				continue;
+			count += atomic_long_read(&rdp->nocb_q_count_lazy);
+			do_nocb_deferred_wakeup_common(rdp);
+		}
+	}
+	return count ? count : SHRINK_STOP;
+}
+
+static struct shrinker rcu_nocb_lazy_shrinker = {
+	.count_objects = rcu_nocb_lazy_count,
+	.scan_objects = rcu_nocb_lazy_scan,
+	.seeks = DEFAULT_SEEKS,
+};
+
 /*
  * Do a deferred wakeup of rcu_nocb_kthread() from fastpath.
  * This means we do an inexact common-case check.  Note that if
@@ -2404,6 +2512,8 @@ static void __init rcu_spawn_nocb_kthreads(void)
 
 	for_each_online_cpu(cpu)
 		rcu_spawn_all_nocb_kthreads(cpu);
+	if (have_rcu_nocb_mask && register_shrinker(&rcu_nocb_lazy_shrinker))
+		pr_info("\tLazy callbacks will not be flushed under memory pressure.\n");
 }
 
 /* How many follower CPU IDs per leader?  Default of -1 for sqrt(nr_cpu_ids). */
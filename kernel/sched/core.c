@@ -93,13 +93,16 @@ struct rq *__task_rq_lock(struct task_struct *p, struct rq_flags *rf)
 	__acquires(rq->lock)
 {
 	struct rq *rq;
+	u64 begin;
 
 	lockdep_assert_held(&p->pi_lock);
 
 	for (;;) {
 		rq = task_rq(p);
+		begin = rq_lock_stat_begin();
 		raw_spin_lock(&rq->lock);
 		if (likely(rq == task_rq(p) && !task_on_rq_migrating(p))) {
+			rq_lock_stat_acquired(rq, begin);
 			rq_pin_lock(rq, rf);
 			return rq;
 		}
@@ -118,10 +121,12 @@ struct rq *task_rq_lock(struct task_struct *p, struct rq_flags *rf)
 	__acquires(rq->lock)
 {
 	struct rq *rq;
+	u64 begin;
 
 	for (;;) {
 		raw_spin_lock_irqsave(&p->pi_lock, rf->flags);
 		rq = task_rq(p);
+		begin = rq_lock_stat_begin();
 		raw_spin_lock(&rq->lock);
 		/*
 		 *	move_queued_task()		task_rq_lock()
@@ -140,6 +145,7 @@ struct rq *task_rq_lock(struct task_struct *p, struct rq_flags *rf)
 		 * pair with the WMB to ensure we must then also see migrating.
 		 */
 		if (likely(rq == task_rq(p) && !task_on_rq_migrating(p))) {
+			rq_lock_stat_acquired(rq, begin);
 			rq_pin_lock(rq, rf);
 			return rq;
 		}
@@ -756,8 +762,10 @@ static inline void enqueue_task(struct rq *rq, struct task_struct *p, int flags)
 	if (!(flags & ENQUEUE_NOCLOCK))
 		update_rq_clock(rq);
 
-	if (!(flags & ENQUEUE_RESTORE))
+	if (!(flags & ENQUEUE_RESTORE)) {
 		sched_info_queued(rq, p);
+		psi_enqueue(p, flags & ENQUEUE_WAKEUP);
+	}
 
 	p->sched_class->enqueue_task(rq, p, flags);
 }
@@ -767,8 +775,10 @@ static inline void dequeue_task(struct rq *rq, struct task_struct *p, int flags)
 	if (!(flags & DEQUEUE_NOCLOCK))
 		update_rq_clock(rq);
 
-	if (!(flags & DEQUEUE_SAVE))
+	if (!(flags & DEQUEUE_SAVE)) {
 		sched_info_dequeued(rq, p);
+		psi_dequeue(p, flags & DEQUEUE_SLEEP);
+	}
 
 	p->sched_class->dequeue_task(rq, p, flags);
 }
@@ -1662,6 +1672,7 @@ static void ttwu_do_wakeup(struct rq *rq, struct task_struct *p, int wake_flags,
 	check_preempt_curr(rq, p, wake_flags);
 	p->state = TASK_RUNNING;
 	trace_sched_wakeup(p);
+	schedstat_set(p->se.statistics.wakeup_start, rq_clock(rq));
 
 #ifdef CONFIG_SMP
 	if (p->sched_class->task_woken) {
@@ -1790,17 +1801,50 @@ void scheduler_ipi(void)
 	irq_exit();
 }
 
+/*
+ * Tasks queued for a CPU that is busy running something else can't get
+ * on it before it schedules anyway.  Rather than interrupting it at once,
+ * the reschedule IPI may then be held back for up to this many ns, and
+ * every wakeup that other CPUs queue there meanwhile rides along on the
+ * same IPI.  0, the default, sends it right away.
+ */
+unsigned int sysctl_sched_wakeup_coalesce_ns;
+
+static enum hrtimer_restart ttwu_coalesce_expired(struct hrtimer *timer)
+{
+	struct rq *rq = container_of(timer, struct rq, wake_ipi_timer);
+
+	/* The target may have emptied the list on its own meanwhile */
+	if (!llist_empty(&rq->wake_list))
+		smp_send_reschedule(cpu_of(rq));
+
+	return HRTIMER_NORESTART;
+}
+
+static bool ttwu_coalesce_ipi(struct rq *rq)
+{
+	unsigned int budget = READ_ONCE(sysctl_sched_wakeup_coalesce_ns);
+
+	if (!budget || !READ_ONCE(rq->nr_running))
+		return false;
+
+	hrtimer_start(&rq->wake_ipi_timer, ns_to_ktime(budget),
+		      HRTIMER_MODE_REL);
+	return true;
+}
+
 static void ttwu_queue_remote(struct task_struct *p, int cpu, int wake_flags)
 {
 	struct rq *rq = cpu_rq(cpu);
 
 	p->sched_remote_wakeup = !!(wake_flags & WF_MIGRATED);
 
+	/* Only the wakeup that finds the list empty has to kick the CPU */
 	if (llist_add(&p->wake_entry, &cpu_rq(cpu)->wake_list)) {
-		if (!set_nr_if_polling(rq->idle))
-			smp_send_reschedule(cpu);
-		else
+		if (set_nr_if_polling(rq->idle))
 			trace_sched_wake_idle_without_ipi(cpu);
+		else if (!ttwu_coalesce_ipi(rq))
+			smp_send_reschedule(cpu);
 	}
 }
 
@@ -2050,6 +2094,7 @@ try_to_wake_up(struct task_struct *p, unsigned int state, int wake_flags)
 	cpu = select_task_rq(p, p->wake_cpu, SD_BALANCE_WAKE, wake_flags);
 	if (task_cpu(p) != cpu) {
 		wake_flags |= WF_MIGRATED;
+		psi_ttwu_dequeue(p);
 		set_task_cpu(p, cpu);
 	}
 
@@ -2171,6 +2216,11 @@ static void __sched_fork(unsigned long clone_flags, struct task_struct *p)
 	memset(&p->se.statistics, 0, sizeof(p->se.statistics));
 #endif
 
+#ifdef CONFIG_PSI
+	/* dup_task_struct() copied the parent's stall state */
+	p->psi_flags = 0;
+#endif
+
 	RB_CLEAR_NODE(&p->dl.rb_node);
 	init_dl_task_timer(&p->dl);
 	init_dl_inactive_task_timer(&p->dl);
@@ -3011,6 +3061,7 @@ void scheduler_tick(void)
 	curr->sched_class->task_tick(rq, curr, 0);
 	cpu_load_update_active(rq);
 	calc_global_load_tick(rq);
+	psi_task_tick(rq);
 
 	rq_unlock(rq, &rf);
 
@@ -3339,6 +3390,7 @@ static void __sched notrace __schedule(bool preempt)
 	if (likely(prev != next)) {
 		rq->nr_switches++;
 		rq->curr = next;
+		sched_hist_wakeup(rq, next);
 		/*
 		 * The membarrier system call requires each architecture
 		 * to have a full memory barrier after updating
@@ -3352,7 +3404,8 @@ static void __sched notrace __schedule(bool preempt)
 		 * arm64 and PowerPC), arm64 has a full barrier in
 		 * switch_to(), and PowerPC has
 		 * smp_mb__after_unlock_lock() before
-		 * finish_lock_switch().
+		 * finish_lock_switch().  RISC-V, whose spin_unlock() is
+		 * also a RELEASE, has one in switch_mm().
 		 */
 		++*switch_count;
 
@@ -5909,6 +5962,10 @@ void __init sched_init(void)
 
 		INIT_LIST_HEAD(&rq->cfs_tasks);
 
+		hrtimer_init(&rq->wake_ipi_timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_REL);
+		rq->wake_ipi_timer.function = ttwu_coalesce_expired;
+
 		rq_attach_root(rq, &def_root_domain);
 #ifdef CONFIG_NO_HZ_COMMON
 		rq->last_load_update_tick = jiffies;
@@ -5951,6 +6008,8 @@ void __init sched_init(void)
 
 	init_schedstats();
 
+	psi_init();
+
 	scheduler_running = 1;
 }
 
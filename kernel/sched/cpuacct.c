@@ -2,6 +2,7 @@
 #include <linux/slab.h>
 #include <linux/percpu.h>
 #include <linux/spinlock.h>
+#include <linux/mutex.h>
 #include <linux/cpumask.h>
 #include <linux/seq_file.h>
 #include <linux/rcupdate.h>
@@ -30,8 +31,23 @@ static const char * const cpuacct_stat_desc[] = {
 	[CPUACCT_STAT_SYSTEM] = "system",
 };
 
+/*
+ * Usage is charged to the task's own group only, into pending[].  The
+ * groups with pending usage on a CPU form a tree of their own, linked
+ * through updated_children and updated_next, and a read folds that tree
+ * bottom up into usages[] and the groups' totals.  Only groups charged
+ * since the last read are visited.  All of it is protected by the rq
+ * lock of the CPU.
+ */
 struct cpuacct_usage {
+	/* hierarchical usage on this cpu, as of the last flush */
 	u64	usages[CPUACCT_STAT_NSTATS];
+	/* charged to this group or flushed up from children, not folded yet */
+	u64	pending[CPUACCT_STAT_NSTATS];
+	/* first updated child; NULL if none */
+	struct cpuacct *updated_children;
+	/* next updated sibling, the parent for the last; NULL if not linked */
+	struct cpuacct *updated_next;
 };
 
 /* track cpu usage of a group of tasks and its child groups */
@@ -40,6 +56,8 @@ struct cpuacct {
 	/* cpuusage holds pointer to a u64-type object on every cpu */
 	struct cpuacct_usage __percpu *cpuusage;
 	struct kernel_cpustat __percpu *cpustat;
+	/* sum of usages[] over all cpus, protected by cpuacct_flush_mutex */
+	u64 total[CPUACCT_STAT_NSTATS];
 };
 
 static inline struct cpuacct *css_ca(struct cgroup_subsys_state *css)
@@ -64,6 +82,93 @@ static struct cpuacct root_cpuacct = {
 	.cpuusage	= &root_cpuacct_cpuusage,
 };
 
+/* serializes flushes, and with them the totals */
+static DEFINE_MUTEX(cpuacct_flush_mutex);
+
+/* link @ca and its ancestors into the updated tree of @cpu */
+static void cpuacct_updated(struct cpuacct *ca, int cpu)
+{
+	struct cpuacct_usage *cpuusage, *pcpuusage;
+	struct cpuacct *parent;
+
+	for (; (parent = parent_ca(ca)); ca = parent) {
+		cpuusage = per_cpu_ptr(ca->cpuusage, cpu);
+		/* the ancestors are linked too then */
+		if (cpuusage->updated_next)
+			break;
+
+		pcpuusage = per_cpu_ptr(parent->cpuusage, cpu);
+		cpuusage->updated_next = pcpuusage->updated_children ?: parent;
+		pcpuusage->updated_children = ca;
+	}
+}
+
+/*
+ * Unlink and return the first leaf of the updated tree below @pos, or
+ * NULL once only the root is left.  Starting each walk at the parent of
+ * the previous leaf visits the tree in post-order.
+ */
+static struct cpuacct *cpuacct_pop_updated(struct cpuacct *pos, int cpu)
+{
+	struct cpuacct_usage *cpuusage = per_cpu_ptr(pos->cpuusage, cpu);
+	struct cpuacct_usage *pcpuusage;
+	struct cpuacct *parent;
+
+	while (cpuusage->updated_children) {
+		pos = cpuusage->updated_children;
+		cpuusage = per_cpu_ptr(pos->cpuusage, cpu);
+	}
+
+	parent = parent_ca(pos);
+	if (!parent)
+		return NULL;
+
+	/* a leaf reached through the heads is first on its parent's list */
+	pcpuusage = per_cpu_ptr(parent->cpuusage, cpu);
+	pcpuusage->updated_children = cpuusage->updated_next == parent ?
+				      NULL : cpuusage->updated_next;
+	cpuusage->updated_next = NULL;
+
+	return pos;
+}
+
+static void cpuacct_fold(struct cpuacct *ca, int cpu)
+{
+	struct cpuacct_usage *cpuusage = per_cpu_ptr(ca->cpuusage, cpu);
+	struct cpuacct *parent = parent_ca(ca);
+	int i;
+
+	for (i = 0; i < CPUACCT_STAT_NSTATS; i++) {
+		u64 delta = cpuusage->pending[i];
+
+		cpuusage->pending[i] = 0;
+		cpuusage->usages[i] += delta;
+		ca->total[i] += delta;
+		if (parent)
+			per_cpu_ptr(parent->cpuusage, cpu)->pending[i] += delta;
+	}
+}
+
+/* fold all pending usage into usages[] and the totals */
+static void cpuacct_flush(void)
+{
+	struct cpuacct *pos;
+	int cpu;
+
+	mutex_lock(&cpuacct_flush_mutex);
+	for_each_possible_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+
+		raw_spin_lock_irq(&rq->lock);
+		for (pos = cpuacct_pop_updated(&root_cpuacct, cpu); pos;
+		     pos = cpuacct_pop_updated(parent_ca(pos), cpu))
+			cpuacct_fold(pos, cpu);
+		cpuacct_fold(&root_cpuacct, cpu);
+		raw_spin_unlock_irq(&rq->lock);
+	}
+	mutex_unlock(&cpuacct_flush_mutex);
+}
+
 /* create a new cpu accounting group */
 static struct cgroup_subsys_state *
 cpuacct_css_alloc(struct cgroup_subsys_state *parent_css)
@@ -100,6 +205,9 @@ static void cpuacct_css_free(struct cgroup_subsys_state *css)
 {
 	struct cpuacct *ca = css_ca(css);
 
+	/* hand the last charges to the parent and unlink from all cpus */
+	cpuacct_flush();
+
 	free_percpu(ca->cpustat);
 	free_percpu(ca->cpuusage);
 	kfree(ca);
@@ -141,24 +249,17 @@ static u64 cpuacct_cpuusage_read(struct cpuacct *ca, int cpu,
 	return data;
 }
 
+/* caller holds cpuacct_flush_mutex */
 static void cpuacct_cpuusage_write(struct cpuacct *ca, int cpu, u64 val)
 {
 	struct cpuacct_usage *cpuusage = per_cpu_ptr(ca->cpuusage, cpu);
 	int i;
 
-#ifndef CONFIG_64BIT
-	/*
-	 * Take rq->lock to make 64-bit write safe on 32-bit platforms.
-	 */
+	/* pending[] stays, it belongs to the parent's usage as well */
 	raw_spin_lock_irq(&cpu_rq(cpu)->lock);
-#endif
-
 	for (i = 0; i < CPUACCT_STAT_NSTATS; i++)
 		cpuusage->usages[i] = val;
-
-#ifndef CONFIG_64BIT
 	raw_spin_unlock_irq(&cpu_rq(cpu)->lock);
-#endif
 }
 
 /* return total cpu usage (in nanoseconds) of a group */
@@ -169,8 +270,16 @@ static u64 __cpuusage_read(struct cgroup_subsys_state *css,
 	u64 totalcpuusage = 0;
 	int i;
 
-	for_each_possible_cpu(i)
-		totalcpuusage += cpuacct_cpuusage_read(ca, i, index);
+	cpuacct_flush();
+
+	mutex_lock(&cpuacct_flush_mutex);
+	if (index == CPUACCT_STAT_NSTATS) {
+		for (i = 0; i < CPUACCT_STAT_NSTATS; i++)
+			totalcpuusage += ca->total[i];
+	} else {
+		totalcpuusage = ca->total[index];
+	}
+	mutex_unlock(&cpuacct_flush_mutex);
 
 	return totalcpuusage;
 }
@@ -196,7 +305,7 @@ static int cpuusage_write(struct cgroup_subsys_state *css, struct cftype *cft,
 			  u64 val)
 {
 	struct cpuacct *ca = css_ca(css);
-	int cpu;
+	int cpu, i;
 
 	/*
 	 * Only allow '0' here to do a reset.
@@ -204,8 +313,12 @@ static int cpuusage_write(struct cgroup_subsys_state *css, struct cftype *cft,
 	if (val)
 		return -EINVAL;
 
+	mutex_lock(&cpuacct_flush_mutex);
 	for_each_possible_cpu(cpu)
 		cpuacct_cpuusage_write(ca, cpu, 0);
+	for (i = 0; i < CPUACCT_STAT_NSTATS; i++)
+		ca->total[i] = 0;
+	mutex_unlock(&cpuacct_flush_mutex);
 
 	return 0;
 }
@@ -217,6 +330,8 @@ static int __cpuacct_percpu_seq_show(struct seq_file *m,
 	u64 percpu;
 	int i;
 
+	cpuacct_flush();
+
 	for_each_possible_cpu(i) {
 		percpu = cpuacct_cpuusage_read(ca, i, index);
 		seq_printf(m, "%llu ", (unsigned long long) percpu);
@@ -246,6 +361,8 @@ static int cpuacct_all_seq_show(struct seq_file *m, void *V)
 	int index;
 	int cpu;
 
+	cpuacct_flush();
+
 	seq_puts(m, "cpu");
 	for (index = 0; index < CPUACCT_STAT_NSTATS; index++)
 		seq_printf(m, " %s", cpuacct_stat_desc[index]);
@@ -342,6 +459,7 @@ static struct cftype files[] = {
 
 /*
  * charge this task's execution time to its accounting group.
+ * The ancestors see it at the next flush.
  *
  * called with rq->lock held.
  */
@@ -356,8 +474,9 @@ void cpuacct_charge(struct task_struct *tsk, u64 cputime)
 
 	rcu_read_lock();
 
-	for (ca = task_ca(tsk); ca; ca = parent_ca(ca))
-		this_cpu_ptr(ca->cpuusage)->usages[index] += cputime;
+	ca = task_ca(tsk);
+	this_cpu_ptr(ca->cpuusage)->pending[index] += cputime;
+	cpuacct_updated(ca, smp_processor_id());
 
 	rcu_read_unlock();
 }
@@ -185,6 +185,10 @@ static __init int sched_init_debug(void)
 {
 	debugfs_create_file("sched_features", 0644, NULL, NULL,
 			&sched_feat_fops);
+#ifdef CONFIG_SMP
+	debugfs_create_u32("sched_wakeup_coalesce_ns", 0644, NULL,
+			   &sysctl_sched_wakeup_coalesce_ns);
+#endif
 
 	return 0;
 }
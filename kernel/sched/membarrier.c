@@ -18,6 +18,7 @@
 #include <linux/membarrier.h>
 #include <linux/tick.h>
 #include <linux/cpumask.h>
+#include <linux/mmu_context.h>
 
 #include "sched.h"	/* for cpu_rq(). */
 
@@ -28,6 +29,15 @@
 #define MEMBARRIER_CMD_BITMASK	\
 	(MEMBARRIER_CMD_SHARED | MEMBARRIER_CMD_PRIVATE_EXPEDITED)
 
+/*
+ * The CPUs that may be running threads of mm.  Architectures whose
+ * mm_cpumask() gains a CPU before it switches to the mm, and keeps it for
+ * as long as the CPU may run the mm, can point this at mm_cpumask().
+ */
+#ifndef membarrier_mm_cpumask
+#define membarrier_mm_cpumask(mm)	cpu_possible_mask
+#endif
+
 static void ipi_mb(void *info)
 {
 	smp_mb();	/* IPIs should be serializing but paranoid. */
@@ -38,8 +48,10 @@ static void membarrier_private_expedited(void)
 	int cpu;
 	bool fallback = false;
 	cpumask_var_t tmpmask;
+	struct mm_struct *mm = current->mm;
 
-	if (num_online_cpus() == 1)
+	/* A single-threaded process has no one else to order against. */
+	if (num_online_cpus() == 1 || atomic_read(&mm->mm_users) == 1)
 		return;
 
 	/*
@@ -59,7 +71,7 @@ static void membarrier_private_expedited(void)
 	}
 
 	cpus_read_lock();
-	for_each_online_cpu(cpu) {
+	for_each_cpu_and(cpu, membarrier_mm_cpumask(mm), cpu_online_mask) {
 		struct task_struct *p;
 
 		/*
@@ -74,7 +86,7 @@ static void membarrier_private_expedited(void)
 			continue;
 		rcu_read_lock();
 		p = task_rcu_dereference(&cpu_rq(cpu)->curr);
-		if (p && p->mm == current->mm) {
+		if (p && p->mm == mm) {
 			if (!fallback)
 				__cpumask_set_cpu(cpu, tmpmask);
 			else
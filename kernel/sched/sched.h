@@ -29,6 +29,7 @@
 #include <linux/irq_work.h>
 #include <linux/tick.h>
 #include <linux/slab.h>
+#include <linux/psi.h>
 
 #ifdef CONFIG_PARAVIRT
 #include <asm/paravirt.h>
@@ -659,6 +660,23 @@ extern void rq_attach_root(struct rq *rq, struct root_domain *rd);
 
 #endif /* CONFIG_SMP */
 
+#ifdef CONFIG_SCHEDSTATS
+/*
+ * Per-CPU histograms of how long things take, in nanoseconds: bucket i
+ * counts the samples in [2^(i-1), 2^i), and the last one everything
+ * from about a second up.
+ */
+enum sched_hist_type {
+	SCHED_HIST_WAKEUP,	/* wakeup to running */
+	SCHED_HIST_MIGRATE,	/* detaching and attaching tasks in load_balance() */
+	SCHED_HIST_LOCK_WAIT,	/* spinning on rq->lock */
+	SCHED_HIST_LOCK_HOLD,	/* holding rq->lock */
+	NR_SCHED_HIST
+};
+
+#define SCHED_HIST_BUCKETS	32
+#endif
+
 /*
  * This is the main, per-CPU runqueue data structure.
  *
@@ -790,10 +808,16 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+
+	/* log2 latency histograms, see sched_hist_record() */
+	unsigned int hist[NR_SCHED_HIST][SCHED_HIST_BUCKETS];
+	u64 lock_hold_start;
 #endif
 
 #ifdef CONFIG_SMP
 	struct llist_head wake_list;
+	/* Sends a held-back reschedule IPI for wake_list */
+	struct hrtimer wake_ipi_timer;
 #endif
 
 #ifdef CONFIG_CPU_IDLE
@@ -813,17 +837,16 @@ static inline int cpu_of(struct rq *rq)
 
 
 #ifdef CONFIG_SCHED_SMT
-
 extern struct static_key_false sched_smt_present;
+#endif
 
+#ifdef CONFIG_SMP
 extern void __update_idle_core(struct rq *rq);
 
 static inline void update_idle_core(struct rq *rq)
 {
-	if (static_branch_unlikely(&sched_smt_present))
-		__update_idle_core(rq);
+	__update_idle_core(rq);
 }
-
 #else
 static inline void update_idle_core(struct rq *rq) { }
 #endif
@@ -999,6 +1022,7 @@ queue_balance_callback(struct rq *rq,
 }
 
 extern void sched_ttwu_pending(void);
+extern unsigned int sysctl_sched_wakeup_coalesce_ns;
 
 #define rcu_dereference_check_sched_domain(p) \
 	rcu_dereference_check((p), \
@@ -1055,6 +1079,7 @@ DECLARE_PER_CPU(struct sched_domain *, sd_llc);
 DECLARE_PER_CPU(int, sd_llc_size);
 DECLARE_PER_CPU(int, sd_llc_id);
 DECLARE_PER_CPU(struct sched_domain_shared *, sd_llc_shared);
+DECLARE_PER_CPU(struct sched_domain *, sd_cluster);
 DECLARE_PER_CPU(struct sched_domain *, sd_numa);
 DECLARE_PER_CPU(struct sched_domain *, sd_asym);
 
@@ -1693,6 +1718,7 @@ static inline void __task_rq_unlock(struct rq *rq, struct rq_flags *rf)
 	__releases(rq->lock)
 {
 	rq_unpin_lock(rq, rf);
+	rq_lock_stat_release(rq);
 	raw_spin_unlock(&rq->lock);
 }
 
@@ -1702,6 +1728,7 @@ task_rq_unlock(struct rq *rq, struct task_struct *p, struct rq_flags *rf)
 	__releases(p->pi_lock)
 {
 	rq_unpin_lock(rq, rf);
+	rq_lock_stat_release(rq);
 	raw_spin_unlock(&rq->lock);
 	raw_spin_unlock_irqrestore(&p->pi_lock, rf->flags);
 }
@@ -1710,7 +1737,10 @@ static inline void
 rq_lock_irqsave(struct rq *rq, struct rq_flags *rf)
 	__acquires(rq->lock)
 {
+	u64 begin = rq_lock_stat_begin();
+
 	raw_spin_lock_irqsave(&rq->lock, rf->flags);
+	rq_lock_stat_acquired(rq, begin);
 	rq_pin_lock(rq, rf);
 }
 
@@ -1718,7 +1748,10 @@ static inline void
 rq_lock_irq(struct rq *rq, struct rq_flags *rf)
 	__acquires(rq->lock)
 {
+	u64 begin = rq_lock_stat_begin();
+
 	raw_spin_lock_irq(&rq->lock);
+	rq_lock_stat_acquired(rq, begin);
 	rq_pin_lock(rq, rf);
 }
 
@@ -1726,7 +1759,10 @@ static inline void
 rq_lock(struct rq *rq, struct rq_flags *rf)
 	__acquires(rq->lock)
 {
+	u64 begin = rq_lock_stat_begin();
+
 	raw_spin_lock(&rq->lock);
+	rq_lock_stat_acquired(rq, begin);
 	rq_pin_lock(rq, rf);
 }
 
@@ -1734,7 +1770,10 @@ static inline void
 rq_relock(struct rq *rq, struct rq_flags *rf)
 	__acquires(rq->lock)
 {
+	u64 begin = rq_lock_stat_begin();
+
 	raw_spin_lock(&rq->lock);
+	rq_lock_stat_acquired(rq, begin);
 	rq_repin_lock(rq, rf);
 }
 
@@ -1743,6 +1782,7 @@ rq_unlock_irqrestore(struct rq *rq, struct rq_flags *rf)
 	__releases(rq->lock)
 {
 	rq_unpin_lock(rq, rf);
+	rq_lock_stat_release(rq);
 	raw_spin_unlock_irqrestore(&rq->lock, rf->flags);
 }
 
@@ -1751,6 +1791,7 @@ rq_unlock_irq(struct rq *rq, struct rq_flags *rf)
 	__releases(rq->lock)
 {
 	rq_unpin_lock(rq, rf);
+	rq_lock_stat_release(rq);
 	raw_spin_unlock_irq(&rq->lock);
 }
 
@@ -1759,6 +1800,7 @@ rq_unlock(struct rq *rq, struct rq_flags *rf)
 	__releases(rq->lock)
 {
 	rq_unpin_lock(rq, rf);
+	rq_lock_stat_release(rq);
 	raw_spin_unlock(&rq->lock);
 }
 
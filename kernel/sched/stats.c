@@ -3,6 +3,7 @@
 #include <linux/fs.h>
 #include <linux/seq_file.h>
 #include <linux/proc_fs.h>
+#include <linux/debugfs.h>
 
 #include "sched.h"
 
@@ -136,3 +137,67 @@ static int __init proc_schedstat_init(void)
 	return 0;
 }
 subsys_initcall(proc_schedstat_init);
+
+/*
+ * The log2 histograms go to debugfs rather than into /proc/schedstat, so
+ * that the format parsers of the latter know about doesn't have to change.
+ * Same iterator; per CPU there is one line per histogram, each with
+ * SCHED_HIST_BUCKETS counts where count i is of samples below 2^i ns.
+ */
+#define SCHED_HIST_VERSION 1
+
+static const char * const sched_hist_names[NR_SCHED_HIST] = {
+	[SCHED_HIST_WAKEUP]	= "wakeup",
+	[SCHED_HIST_MIGRATE]	= "migrate",
+	[SCHED_HIST_LOCK_WAIT]	= "lock_wait",
+	[SCHED_HIST_LOCK_HOLD]	= "lock_hold",
+};
+
+static int show_sched_hist(struct seq_file *seq, void *v)
+{
+	int cpu, type, i;
+	struct rq *rq;
+
+	if (v == (void *)1) {
+		seq_printf(seq, "version %d\n", SCHED_HIST_VERSION);
+		seq_printf(seq, "buckets %d\n", SCHED_HIST_BUCKETS);
+		return 0;
+	}
+
+	cpu = (unsigned long)(v - 2);
+	rq = cpu_rq(cpu);
+
+	for (type = 0; type < NR_SCHED_HIST; type++) {
+		seq_printf(seq, "cpu%d %s", cpu, sched_hist_names[type]);
+		for (i = 0; i < SCHED_HIST_BUCKETS; i++)
+			seq_printf(seq, " %u", rq->hist[type][i]);
+		seq_printf(seq, "\n");
+	}
+	return 0;
+}
+
+static const struct seq_operations sched_hist_sops = {
+	.start = schedstat_start,
+	.next  = schedstat_next,
+	.stop  = schedstat_stop,
+	.show  = show_sched_hist,
+};
+
+static int sched_hist_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &sched_hist_sops);
+}
+
+static const struct file_operations sched_hist_fops = {
+	.open    = sched_hist_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = seq_release,
+};
+
+static int __init sched_hist_init(void)
+{
+	debugfs_create_file("sched_hist", 0444, NULL, NULL, &sched_hist_fops);
+	return 0;
+}
+late_initcall(sched_hist_init);
@@ -36,6 +36,60 @@ rq_sched_info_dequeued(struct rq *rq, unsigned long long delta)
 #define schedstat_val(var)		(var)
 #define schedstat_val_or_zero(var)	((schedstat_enabled()) ? (var) : 0)
 
+/*
+ * Expects runqueue lock to be held for atomicity of update.  Deltas taken
+ * across CPUs can come out slightly negative; those count as zero.
+ */
+static inline void
+sched_hist_record(struct rq *rq, enum sched_hist_type type, s64 delta)
+{
+	int bucket = delta > 0 ? fls64(delta) : 0;
+
+	rq->hist[type][min(bucket, SCHED_HIST_BUCKETS - 1)]++;
+}
+
+/* The task has been woken (wakeup_start set) and now gets the CPU */
+static inline void sched_hist_wakeup(struct rq *rq, struct task_struct *p)
+{
+	if (schedstat_enabled() && p->se.statistics.wakeup_start) {
+		sched_hist_record(rq, SCHED_HIST_WAKEUP,
+				  rq_clock(rq) - p->se.statistics.wakeup_start);
+		p->se.statistics.wakeup_start = 0;
+	}
+}
+
+/*
+ * rq->lock is timed through the rq_lock() and task_rq_lock() families: the
+ * wait is recorded once the lock is taken, the hold when it is let go.
+ * Paths that use the raw spinlock directly, __schedule() among them, are
+ * not counted.
+ */
+static inline u64 rq_lock_stat_begin(void)
+{
+	return schedstat_enabled() ? local_clock() : 0;
+}
+
+static inline void rq_lock_stat_acquired(struct rq *rq, u64 begin)
+{
+	u64 now;
+
+	if (!begin)
+		return;
+
+	now = local_clock();
+	sched_hist_record(rq, SCHED_HIST_LOCK_WAIT, now - begin);
+	rq->lock_hold_start = now;
+}
+
+static inline void rq_lock_stat_release(struct rq *rq)
+{
+	if (schedstat_enabled() && rq->lock_hold_start) {
+		sched_hist_record(rq, SCHED_HIST_LOCK_HOLD,
+				  local_clock() - rq->lock_hold_start);
+		rq->lock_hold_start = 0;
+	}
+}
+
 #else /* !CONFIG_SCHEDSTATS */
 static inline void
 rq_sched_info_arrive(struct rq *rq, unsigned long long delta)
@@ -52,8 +106,99 @@ rq_sched_info_depart(struct rq *rq, unsigned long long delta)
 #define schedstat_set(var, val)		do { } while (0)
 #define schedstat_val(var)		0
 #define schedstat_val_or_zero(var)	0
+#define sched_hist_record(rq, type, delta)	do { } while (0)
+static inline void sched_hist_wakeup(struct rq *rq, struct task_struct *p) { }
+static inline u64 rq_lock_stat_begin(void) { return 0; }
+static inline void rq_lock_stat_acquired(struct rq *rq, u64 begin) { }
+static inline void rq_lock_stat_release(struct rq *rq) { }
 #endif /* CONFIG_SCHEDSTATS */
 
+#ifdef CONFIG_PSI
+/*
+ * PSI tracks state that persists across sleeps, such as iowait and
+ * memstall. From the view of the scheduler, these states only appear
+ * and disappear when the task gets dequeued and enqueued again.
+ */
+static inline void psi_enqueue(struct task_struct *p, bool wakeup)
+{
+	int clear = 0, set = TSK_RUNNING;
+
+	if (static_branch_likely(&psi_disabled))
+		return;
+
+	if (!wakeup || p->sched_psi_wake_requeue) {
+		if (p->flags & PF_MEMSTALL)
+			set |= TSK_MEMSTALL;
+		if (p->sched_psi_wake_requeue)
+			p->sched_psi_wake_requeue = 0;
+	} else {
+		if (p->in_iowait)
+			clear |= TSK_IOWAIT;
+	}
+
+	psi_task_change(p, clear, set);
+}
+
+static inline void psi_dequeue(struct task_struct *p, bool sleep)
+{
+	int clear = TSK_RUNNING, set = 0;
+
+	if (static_branch_likely(&psi_disabled))
+		return;
+
+	if (!sleep) {
+		if (p->flags & PF_MEMSTALL)
+			clear |= TSK_MEMSTALL;
+	} else {
+		if (p->in_iowait)
+			set |= TSK_IOWAIT;
+	}
+
+	psi_task_change(p, clear, set);
+}
+
+/*
+ * Is the task being migrated during a wakeup? Make sure to deregister
+ * its sleep-persistent psi states from the old queue, and let
+ * psi_enqueue() know it has to requeue. The caller holds ->pi_lock and
+ * the task is off the runqueue, so task_rq() cannot change under us.
+ */
+static inline void psi_ttwu_dequeue(struct task_struct *p)
+{
+	if (static_branch_likely(&psi_disabled))
+		return;
+
+	if (unlikely(p->in_iowait || (p->flags & PF_MEMSTALL))) {
+		struct rq *rq = task_rq(p);
+		int clear = 0;
+
+		if (p->in_iowait)
+			clear |= TSK_IOWAIT;
+		if (p->flags & PF_MEMSTALL)
+			clear |= TSK_MEMSTALL;
+
+		raw_spin_lock(&rq->lock);
+		psi_task_change(p, clear, 0);
+		p->sched_psi_wake_requeue = 1;
+		raw_spin_unlock(&rq->lock);
+	}
+}
+
+static inline void psi_task_tick(struct rq *rq)
+{
+	if (static_branch_likely(&psi_disabled))
+		return;
+
+	if (unlikely(rq->curr->flags & PF_MEMSTALL))
+		psi_memstall_tick(rq->curr, cpu_of(rq));
+}
+#else /* CONFIG_PSI */
+static inline void psi_enqueue(struct task_struct *p, bool wakeup) {}
+static inline void psi_dequeue(struct task_struct *p, bool sleep) {}
+static inline void psi_ttwu_dequeue(struct task_struct *p) {}
+static inline void psi_task_tick(struct rq *rq) {}
+#endif /* CONFIG_PSI */
+
 #ifdef CONFIG_SCHED_INFO
 static inline void sched_info_reset_dequeued(struct task_struct *t)
 {
@@ -389,13 +389,14 @@ DEFINE_PER_CPU(struct sched_domain *, sd_llc);
 DEFINE_PER_CPU(int, sd_llc_size);
 DEFINE_PER_CPU(int, sd_llc_id);
 DEFINE_PER_CPU(struct sched_domain_shared *, sd_llc_shared);
+DEFINE_PER_CPU(struct sched_domain *, sd_cluster);
 DEFINE_PER_CPU(struct sched_domain *, sd_numa);
 DEFINE_PER_CPU(struct sched_domain *, sd_asym);
 
 static void update_top_cache_domain(int cpu)
 {
 	struct sched_domain_shared *sds = NULL;
-	struct sched_domain *sd;
+	struct sched_domain *sd, *cl = NULL;
 	int id = cpu;
 	int size = 1;
 
@@ -404,12 +405,20 @@ static void update_top_cache_domain(int cpu)
 		id = cpumask_first(sched_domain_span(sd));
 		size = cpumask_weight(sched_domain_span(sd));
 		sds = sd->shared;
+
+		/*
+		 * A cache-sharing level below the LLC that isn't SMT is a
+		 * cluster, which wakeups search before the whole LLC.
+		 */
+		if (sd->child && !(sd->child->flags & SD_SHARE_CPUCAPACITY))
+			cl = sd->child;
 	}
 
 	rcu_assign_pointer(per_cpu(sd_llc, cpu), sd);
 	per_cpu(sd_llc_size, cpu) = size;
 	per_cpu(sd_llc_id, cpu) = id;
 	rcu_assign_pointer(per_cpu(sd_llc_shared, cpu), sds);
+	rcu_assign_pointer(per_cpu(sd_cluster, cpu), cl);
 
 	sd = lowest_flag_domain(cpu, SD_NUMA);
 	rcu_assign_pointer(per_cpu(sd_numa, cpu), sd);
@@ -1208,6 +1217,9 @@ static struct sched_domain_topology_level default_topology[] = {
 #ifdef CONFIG_SCHED_SMT
 	{ cpu_smt_mask, cpu_smt_flags, SD_INIT_NAME(SMT) },
 #endif
+#ifdef CONFIG_SCHED_CLUSTER
+	{ cpu_clustergroup_mask, cpu_cluster_flags, SD_INIT_NAME(CLS) },
+#endif
 #ifdef CONFIG_SCHED_MC
 	{ cpu_coregroup_mask, cpu_core_flags, SD_INIT_NAME(MC) },
 #endif
@@ -1532,6 +1544,7 @@ static int __sdt_alloc(const struct cpumask *cpu_map)
 			if (!sds)
 				return -ENOMEM;
 
+			sds->idle_core = -1;
 			*per_cpu_ptr(sdd->sds, j) = sds;
 
 			sg = kzalloc_node(sizeof(struct sched_group) + cpumask_size(),
@@ -1814,6 +1827,32 @@ static int dattrs_equal(struct sched_domain_attr *cur, int idx_cur,
 			sizeof(struct sched_domain_attr));
 }
 
+/*
+ * Does doms_new[] describe exactly the current partitioning? The masks
+ * of a partitioning don't overlap, so each new mask having an equal
+ * current one in a set of the same size is enough.
+ */
+static bool partition_unchanged(int ndoms_new, cpumask_var_t doms_new[],
+				struct sched_domain_attr *dattr_new)
+{
+	int i, j;
+
+	if (!doms_new || ndoms_new != ndoms_cur)
+		return false;
+
+	for (i = 0; i < ndoms_new; i++) {
+		for (j = 0; j < ndoms_cur; j++) {
+			if (cpumask_equal(doms_new[i], doms_cur[j])
+			    && dattrs_equal(dattr_new, i, dattr_cur, j))
+				break;
+		}
+		if (j == ndoms_cur)
+			return false;
+	}
+
+	return true;
+}
+
 /*
  * Partition sched domains as specified by the 'ndoms_new'
  * cpumasks in the array doms_new[] of cpumasks. This compares
@@ -1848,12 +1887,24 @@ void partition_sched_domains(int ndoms_new, cpumask_var_t doms_new[],
 
 	mutex_lock(&sched_domains_mutex);
 
-	/* Always unregister in case we don't destroy any domains: */
-	unregister_sched_domain_sysctl();
-
 	/* Let the architecture update CPU core mappings: */
 	new_topology = arch_update_cpu_topology();
 
+	/*
+	 * cpusets rebuild on every change that might affect the domains;
+	 * most don't.  Skip the sysctl churn when nothing would be touched.
+	 */
+	if (!new_topology &&
+	    partition_unchanged(ndoms_new, doms_new, dattr_new)) {
+		free_sched_domains(doms_new, ndoms_new);
+		kfree(dattr_new);
+		mutex_unlock(&sched_domains_mutex);
+		return;
+	}
+
+	/* Always unregister in case we don't destroy any domains: */
+	unregister_sched_domain_sysctl();
+
 	n = doms_new ? ndoms_new : 0;
 
 	/* Destroy deleted domains: */
@@ -547,6 +547,41 @@ static inline int hrtimer_hres_active(void)
 	return __hrtimer_hres_active(this_cpu_ptr(&hrtimer_bases));
 }
 
+/*
+ * Program the clock event device on behalf of @cpu_base. On some
+ * architectures (e.g. riscv via SBI) this is a firmware call, so keep
+ * count of it.
+ */
+static inline int hrtimer_program_event(struct hrtimer_cpu_base *cpu_base,
+					ktime_t expires, int force)
+{
+	cpu_base->nr_programs++;
+	return tick_program_event(expires, force);
+}
+
+/*
+ * Check whether the event the device is armed for lies within the slack of
+ * the first expiring timer, i.e. between its soft and its hard expiry. The
+ * timer is then expired by that event together with the timers it was
+ * programmed for, and the device does not need to be programmed again.
+ *
+ * Called with interrupts disabled and base->lock held, after
+ * __hrtimer_get_next_event() updated cpu_base->next_timer.
+ */
+static bool hrtimer_event_in_slack(struct hrtimer_cpu_base *cpu_base,
+				   ktime_t expires_next)
+{
+	struct hrtimer *timer = cpu_base->next_timer;
+	ktime_t armed = cpu_base->expires_next;
+	ktime_t soft;
+
+	if (!timer || armed >= expires_next)
+		return false;
+
+	soft = ktime_sub(hrtimer_get_softexpires(timer), timer->base->offset);
+	return soft <= armed;
+}
+
 /*
  * Reprogram the event source with checking both queues for the
  * next event
@@ -565,6 +600,18 @@ hrtimer_force_reprogram(struct hrtimer_cpu_base *cpu_base, int skip_equal)
 	if (skip_equal && expires_next == cpu_base->expires_next)
 		return;
 
+	/*
+	 * The first timer was removed or moved later. If the event the
+	 * device is armed for still falls into the slack of the new first
+	 * timer, leave the device alone. Not for clock_was_set() and
+	 * resume (!skip_equal), where the armed event is not trustworthy.
+	 */
+	if (skip_equal && !cpu_base->hang_detected &&
+	    hrtimer_event_in_slack(cpu_base, expires_next)) {
+		cpu_base->nr_coalesced++;
+		return;
+	}
+
 	cpu_base->expires_next = expires_next;
 
 	/*
@@ -584,7 +631,7 @@ hrtimer_force_reprogram(struct hrtimer_cpu_base *cpu_base, int skip_equal)
 	if (cpu_base->hang_detected)
 		return;
 
-	tick_program_event(cpu_base->expires_next, 1);
+	hrtimer_program_event(cpu_base, cpu_base->expires_next, 1);
 }
 
 /*
@@ -646,7 +693,7 @@ static void hrtimer_reprogram(struct hrtimer *timer,
 	 * events which are already in the past.
 	 */
 	cpu_base->expires_next = expires;
-	tick_program_event(expires, 1);
+	hrtimer_program_event(cpu_base, expires, 1);
 }
 
 /*
@@ -890,7 +937,8 @@ static void __remove_hrtimer(struct hrtimer *timer,
  * remove hrtimer, called with base lock held
  */
 static inline int
-remove_hrtimer(struct hrtimer *timer, struct hrtimer_clock_base *base, bool restart)
+remove_hrtimer(struct hrtimer *timer, struct hrtimer_clock_base *base,
+	       bool restart, bool keep_local)
 {
 	if (hrtimer_is_queued(timer)) {
 		u8 state = timer->state;
@@ -907,8 +955,14 @@ remove_hrtimer(struct hrtimer *timer, struct hrtimer_clock_base *base, bool rest
 		debug_deactivate(timer);
 		reprogram = base->cpu_base == this_cpu_ptr(&hrtimer_bases);
 
+		/*
+		 * A local timer which is requeued right away is reprogrammed
+		 * once after the enqueue by the caller, not here as well.
+		 */
 		if (!restart)
 			state = HRTIMER_STATE_INACTIVE;
+		else
+			reprogram &= !keep_local;
 
 		__remove_hrtimer(timer, base, state, reprogram);
 		return 1;
@@ -916,6 +970,24 @@ remove_hrtimer(struct hrtimer *timer, struct hrtimer_clock_base *base, bool rest
 	return 0;
 }
 
+/*
+ * Is @timer the first expiring timer of this CPU? Called with the base
+ * lock held.
+ */
+static inline bool hrtimer_is_local_next(struct hrtimer *timer,
+					 struct hrtimer_clock_base *base)
+{
+#ifdef CONFIG_HIGH_RES_TIMERS
+	struct hrtimer_cpu_base *cpu_base = base->cpu_base;
+
+	return cpu_base == this_cpu_ptr(&hrtimer_bases) &&
+	       cpu_base->hres_active && hrtimer_is_queued(timer) &&
+	       cpu_base->next_timer == timer;
+#else
+	return false;
+#endif
+}
+
 static inline ktime_t hrtimer_update_lowres(struct hrtimer *timer, ktime_t tim,
 					    const enum hrtimer_mode mode)
 {
@@ -945,12 +1017,20 @@ void hrtimer_start_range_ns(struct hrtimer *timer, ktime_t tim,
 {
 	struct hrtimer_clock_base *base, *new_base;
 	unsigned long flags;
+	bool keep_local;
 	int leftmost;
 
 	base = lock_hrtimer_base(timer, &flags);
 
-	/* Remove an active timer from the queue: */
-	remove_hrtimer(timer, base, true);
+	/*
+	 * Remove an active timer from the queue. If it is the first
+	 * expiring timer of this CPU, keep it here and skip the
+	 * reprogramming on removal: the device is then programmed at most
+	 * once after the enqueue, instead of once for the removal and once
+	 * more for the enqueue.
+	 */
+	keep_local = hrtimer_is_local_next(timer, base);
+	remove_hrtimer(timer, base, true, keep_local);
 
 	if (mode & HRTIMER_MODE_REL)
 		tim = ktime_add_safe(tim, base->get_time());
@@ -960,9 +1040,18 @@ void hrtimer_start_range_ns(struct hrtimer *timer, ktime_t tim,
 	hrtimer_set_expires_range_ns(timer, tim, delta_ns);
 
 	/* Switch the timer base, if necessary: */
-	new_base = switch_hrtimer_base(timer, base, mode & HRTIMER_MODE_PINNED);
+	if (keep_local)
+		new_base = base;
+	else
+		new_base = switch_hrtimer_base(timer, base,
+					       mode & HRTIMER_MODE_PINNED);
 
 	leftmost = enqueue_hrtimer(timer, new_base);
+	if (keep_local) {
+		/* Evaluate the new first timer, the removal did not */
+		hrtimer_force_reprogram(new_base->cpu_base, 1);
+		goto unlock;
+	}
 	if (!leftmost)
 		goto unlock;
 
@@ -1009,7 +1098,7 @@ int hrtimer_try_to_cancel(struct hrtimer *timer)
 	base = lock_hrtimer_base(timer, &flags);
 
 	if (!hrtimer_callback_running(timer))
-		ret = remove_hrtimer(timer, base, false);
+		ret = remove_hrtimer(timer, base, false, false);
 
 	unlock_hrtimer_base(timer, &flags);
 
@@ -1321,7 +1410,7 @@ retry:
 	raw_spin_unlock(&cpu_base->lock);
 
 	/* Reprogramming necessary ? */
-	if (!tick_program_event(expires_next, 0)) {
+	if (!hrtimer_program_event(cpu_base, expires_next, 0)) {
 		cpu_base->hang_detected = 0;
 		return;
 	}
@@ -1364,7 +1453,7 @@ retry:
 		expires_next = ktime_add_ns(now, 100 * NSEC_PER_MSEC);
 	else
 		expires_next = ktime_add(now, delta);
-	tick_program_event(expires_next, 1);
+	hrtimer_program_event(cpu_base, expires_next, 1);
 	printk_once(KERN_WARNING "hrtimer: interrupt took %llu ns\n",
 		    ktime_to_ns(delta));
 }
@@ -674,20 +674,36 @@ static void tick_nohz_restart(struct tick_sched *ts, ktime_t now)
 	ts->next_tick = 0;
 }
 
-static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
-					 ktime_t now, int cpu)
+/**
+ * get_jiffies_update - read jiffies and the time they were last updated
+ * @basej:	returns the jiffies value
+ *
+ * Returns the clock monotonic time of the jiffies update matching @basej.
+ */
+u64 get_jiffies_update(unsigned long *basej)
 {
-	struct clock_event_device *dev = __this_cpu_read(tick_cpu_device.evtdev);
-	u64 basemono, next_tick, next_tmr, next_rcu, delta, expires;
 	unsigned long seq, basejiff;
-	ktime_t	tick;
+	u64 basemono;
 
-	/* Read jiffies and the time when jiffies were updated last */
 	do {
 		seq = read_seqbegin(&jiffies_lock);
 		basemono = last_jiffies_update;
 		basejiff = jiffies;
 	} while (read_seqretry(&jiffies_lock, seq));
+	*basej = basejiff;
+	return basemono;
+}
+
+static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
+					 ktime_t now, int cpu)
+{
+	struct clock_event_device *dev = __this_cpu_read(tick_cpu_device.evtdev);
+	u64 basemono, next_tick, next_tmr, next_rcu, delta, expires;
+	unsigned long basejiff;
+	ktime_t	tick;
+
+	/* Read jiffies and the time when jiffies were updated last */
+	basemono = get_jiffies_update(&basejiff);
 	ts->last_jiffies = basejiff;
 
 	if (rcu_needs_cpu(basemono, &next_rcu) ||
@@ -919,18 +935,50 @@ static bool can_stop_idle_tick(int cpu, struct tick_sched *ts)
 	return true;
 }
 
+/*
+ * Ask the irq timings for the next device interrupt on this CPU. Must be
+ * called once per idle entry with interrupts disabled, as it consumes
+ * the recorded timings.
+ */
+static ktime_t tick_nohz_predict_irq(void)
+{
+#ifdef CONFIG_IRQ_TIMINGS
+	u64 now = local_clock();
+	u64 next = irq_timings_next_event(now);
+
+	if (next != U64_MAX)
+		return next > now ? next - now : 0;
+#endif
+	return KTIME_MAX;
+}
+
 static void __tick_nohz_idle_enter(struct tick_sched *ts)
 {
 	ktime_t now, expires;
 	int cpu = smp_processor_id();
 
 	now = tick_nohz_start_idle(ts);
+	ts->irq_predicted = tick_nohz_predict_irq();
 
 	if (can_stop_idle_tick(cpu, ts)) {
 		int was_stopped = ts->tick_stopped;
 
 		ts->idle_calls++;
 
+		/*
+		 * A device interrupt is expected before the next tick: it
+		 * ends the idle period anyway, and stopping the tick now
+		 * only to restart it on that interrupt costs more than
+		 * keeping it.
+		 */
+		if (!was_stopped && ts->irq_predicted < TICK_NSEC) {
+			struct clock_event_device *dev;
+
+			dev = __this_cpu_read(tick_cpu_device.evtdev);
+			ts->sleep_length = ktime_sub(dev->next_event, now);
+			return;
+		}
+
 		expires = tick_nohz_stop_sched_tick(ts, now, cpu);
 		if (expires > 0LL) {
 			ts->idle_sleeps++;
@@ -1009,6 +1057,19 @@ ktime_t tick_nohz_get_sleep_length(void)
 	return ts->sleep_length;
 }
 
+/**
+ * tick_nohz_get_next_irq - return the time until the next predicted interrupt
+ *
+ * Called from power state control code with interrupts disabled. Returns
+ * KTIME_MAX when no device interrupt is predicted.
+ */
+ktime_t tick_nohz_get_next_irq(void)
+{
+	struct tick_sched *ts = this_cpu_ptr(&tick_cpu_sched);
+
+	return ts->irq_predicted;
+}
+
 /**
  * tick_nohz_get_idle_calls - return the current idle calls counter value
  *
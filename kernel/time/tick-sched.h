@@ -38,6 +38,8 @@ enum tick_nohz_mode {
  * @idle_sleeptime:	Sum of the time slept in idle with sched tick stopped
  * @iowait_sleeptime:	Sum of the time slept in idle with sched tick stopped, with IO outstanding
  * @sleep_length:	Duration of the current idle sleep
+ * @irq_predicted:	Time from idle entry to the next predicted device
+ *			interrupt, KTIME_MAX if none is predicted
  * @do_timer_lst:	CPU was the last one doing do_timer before going idle
  */
 struct tick_sched {
@@ -58,6 +60,7 @@ struct tick_sched {
 	ktime_t				idle_sleeptime;
 	ktime_t				iowait_sleeptime;
 	ktime_t				sleep_length;
+	ktime_t				irq_predicted;
 	unsigned long			last_jiffies;
 	u64				next_timer;
 	ktime_t				idle_expires;
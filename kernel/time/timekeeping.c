@@ -415,6 +415,20 @@ static void update_fast_timekeeper(struct tk_read_base *tkr, struct tk_fast *tkf
  * of the following timestamps. Callers need to be aware of that and
  * deal with it.
  */
+/*
+ * When the clocksource is the architected counter, read it inline rather
+ * than through the read() callback. The flag is tested on the copy of the
+ * fast timekeeper, which uses the dummy clock while suspended.
+ */
+static __always_inline u64 tk_clock_read_fast(struct tk_read_base *tkr)
+{
+#ifdef ARCH_HAS_CLOCKSOURCE_COUNTER
+	if (likely(tkr->clock->flags & CLOCK_SOURCE_ARCH_COUNTER))
+		return arch_clocksource_counter_read();
+#endif
+	return tk_clock_read(tkr);
+}
+
 static __always_inline u64 __ktime_get_fast_ns(struct tk_fast *tkf)
 {
 	struct tk_read_base *tkr;
@@ -428,7 +442,7 @@ static __always_inline u64 __ktime_get_fast_ns(struct tk_fast *tkf)
 
 		now += timekeeping_delta_to_ns(tkr,
 				clocksource_delta(
-					tk_clock_read(tkr),
+					tk_clock_read_fast(tkr),
 					tkr->cycle_last,
 					tkr->mask));
 	} while (read_seqcount_retry(&tkf->seq, seq));
@@ -442,6 +456,30 @@ u64 ktime_get_mono_fast_ns(void)
 }
 EXPORT_SYMBOL_GPL(ktime_get_mono_fast_ns);
 
+/**
+ * ktime_get_mono_fast_coarse_ns - Fast NMI safe access to coarse clock monotonic
+ *
+ * Returns clock monotonic as of the last timekeeping update, i.e. with
+ * tick granularity, without reading the clocksource. Same NMI caveats as
+ * ktime_get_mono_fast_ns().
+ */
+u64 ktime_get_mono_fast_coarse_ns(void)
+{
+	struct tk_fast *tkf = &tk_fast_mono;
+	struct tk_read_base *tkr;
+	unsigned int seq;
+	u64 now;
+
+	do {
+		seq = raw_read_seqcount_latch(&tkf->seq);
+		tkr = tkf->base + (seq & 0x01);
+		now = ktime_to_ns(tkr->base) + (tkr->xtime_nsec >> tkr->shift);
+	} while (read_seqcount_retry(&tkf->seq, seq));
+
+	return now;
+}
+EXPORT_SYMBOL_GPL(ktime_get_mono_fast_coarse_ns);
+
 u64 ktime_get_raw_fast_ns(void)
 {
 	return __ktime_get_fast_ns(&tk_fast_raw);
@@ -52,6 +52,7 @@
 #include <asm/io.h>
 
 #include "tick-internal.h"
+#include "timer_migration.h"
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/timer.h>
@@ -179,18 +180,22 @@ EXPORT_SYMBOL(jiffies_64);
 #define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
 
 /*
- * The resulting wheel size. If NOHZ is configured we allocate two
- * wheels so we have a separate storage for the deferrable timers.
+ * The resulting wheel size. If NOHZ is configured we allocate three
+ * wheels: pinned timers go to the local one, the others to the global
+ * one, which an idle CPU hands over to the timer migration hierarchy (see
+ * timer_migration.c), and deferrable timers have a separate storage.
  */
 #define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
 
 #ifdef CONFIG_NO_HZ_COMMON
-# define NR_BASES	2
-# define BASE_STD	0
-# define BASE_DEF	1
+# define NR_BASES	3
+# define BASE_LOCAL	0
+# define BASE_GLOBAL	1
+# define BASE_DEF	2
 #else
 # define NR_BASES	1
-# define BASE_STD	0
+# define BASE_LOCAL	0
+# define BASE_GLOBAL	0
 # define BASE_DEF	0
 #endif
 
@@ -216,19 +221,20 @@ void timers_update_migration(bool update_nohz)
 {
 	bool on = sysctl_timer_migration && tick_nohz_active;
 	unsigned int cpu;
+	int b;
 
 	/* Avoid the loop, if nothing to update */
-	if (this_cpu_read(timer_bases[BASE_STD].migration_enabled) == on)
+	if (this_cpu_read(timer_bases[BASE_GLOBAL].migration_enabled) == on)
 		return;
 
 	for_each_possible_cpu(cpu) {
-		per_cpu(timer_bases[BASE_STD].migration_enabled, cpu) = on;
-		per_cpu(timer_bases[BASE_DEF].migration_enabled, cpu) = on;
+		for (b = 0; b < NR_BASES; b++)
+			per_cpu(timer_bases[b].migration_enabled, cpu) = on;
 		per_cpu(hrtimer_bases.migration_enabled, cpu) = on;
 		if (!update_nohz)
 			continue;
-		per_cpu(timer_bases[BASE_STD].nohz_active, cpu) = true;
-		per_cpu(timer_bases[BASE_DEF].nohz_active, cpu) = true;
+		for (b = 0; b < NR_BASES; b++)
+			per_cpu(timer_bases[b].nohz_active, cpu) = true;
 		per_cpu(hrtimer_bases.nohz_active, cpu) = true;
 	}
 }
@@ -560,10 +566,14 @@ trigger_dyntick_cpu(struct timer_base *base, struct timer_list *timer)
 
 	/*
 	 * Set the next expiry time and kick the CPU so it can reevaluate the
-	 * wheel:
+	 * wheel. A timer rearmed from its callback while the migration
+	 * hierarchy expires an idle CPU's global base stays there, and the
+	 * remote expiry reports the new event without waking the CPU:
 	 */
 	base->next_expiry = timer->expires;
-		wake_up_nohz_cpu(base->cpu);
+	if (!(timer->flags & TIMER_PINNED) && base->running_timer)
+		return;
+	wake_up_nohz_cpu(base->cpu);
 }
 
 static void
@@ -808,32 +818,28 @@ static int detach_if_pending(struct timer_list *timer, struct timer_base *base,
 	return 1;
 }
 
-static inline struct timer_base *get_timer_cpu_base(u32 tflags, u32 cpu)
+/*
+ * Deferrable timers have their own base, pinned timers stay in the local
+ * one and all the others are global. The choice only depends on the
+ * timer flags, so lock_timer_base() always finds the base back.
+ */
+static inline int get_timer_base_index(u32 tflags)
 {
-	struct timer_base *base = per_cpu_ptr(&timer_bases[BASE_STD], cpu);
+	if (tflags & TIMER_DEFERRABLE)
+		return BASE_DEF;
+	if (tflags & TIMER_PINNED)
+		return BASE_LOCAL;
+	return BASE_GLOBAL;
+}
 
-	/*
-	 * If the timer is deferrable and nohz is active then we need to use
-	 * the deferrable base.
-	 */
-	if (IS_ENABLED(CONFIG_NO_HZ_COMMON) && base->nohz_active &&
-	    (tflags & TIMER_DEFERRABLE))
-		base = per_cpu_ptr(&timer_bases[BASE_DEF], cpu);
-	return base;
+static inline struct timer_base *get_timer_cpu_base(u32 tflags, u32 cpu)
+{
+	return per_cpu_ptr(&timer_bases[get_timer_base_index(tflags)], cpu);
 }
 
 static inline struct timer_base *get_timer_this_cpu_base(u32 tflags)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
-
-	/*
-	 * If the timer is deferrable and nohz is active then we need to use
-	 * the deferrable base.
-	 */
-	if (IS_ENABLED(CONFIG_NO_HZ_COMMON) && base->nohz_active &&
-	    (tflags & TIMER_DEFERRABLE))
-		base = this_cpu_ptr(&timer_bases[BASE_DEF]);
-	return base;
+	return this_cpu_ptr(&timer_bases[get_timer_base_index(tflags)]);
 }
 
 static inline struct timer_base *get_timer_base(u32 tflags)
@@ -841,19 +847,17 @@ static inline struct timer_base *get_timer_base(u32 tflags)
 	return get_timer_cpu_base(tflags, tflags & TIMER_CPUMASK);
 }
 
-#ifdef CONFIG_NO_HZ_COMMON
+/*
+ * Timers are always queued on the local CPU. When it goes idle, the timer
+ * migration hierarchy takes care of its global timers.
+ */
 static inline struct timer_base *
 get_target_base(struct timer_base *base, unsigned tflags)
 {
-#ifdef CONFIG_SMP
-	if ((tflags & TIMER_PINNED) || !base->migration_enabled)
-		return get_timer_this_cpu_base(tflags);
-	return get_timer_cpu_base(tflags, get_nohz_timer_target());
-#else
 	return get_timer_this_cpu_base(tflags);
-#endif
 }
 
+#ifdef CONFIG_NO_HZ_COMMON
 static inline void forward_timer_base(struct timer_base *base)
 {
 	unsigned long jnow = READ_ONCE(jiffies);
@@ -875,12 +879,6 @@ static inline void forward_timer_base(struct timer_base *base)
 		base->clk = base->next_expiry;
 }
 #else
-static inline struct timer_base *
-get_target_base(struct timer_base *base, unsigned tflags)
-{
-	return get_timer_this_cpu_base(tflags);
-}
-
 static inline void forward_timer_base(struct timer_base *base) { }
 #endif
 
@@ -1452,29 +1450,17 @@ static u64 cmp_next_hrtimer_event(u64 basem, u64 expires)
 	return DIV_ROUND_UP_ULL(nextevt, TICK_NSEC) * TICK_NSEC;
 }
 
-/**
- * get_next_timer_interrupt - return the time (clock mono) of the next timer
- * @basej:	base time jiffies
- * @basem:	base time clock monotonic
- *
- * Returns the tick aligned clock monotonic time of the next pending
- * timer or KTIME_MAX if no timer is pending.
+/*
+ * Return the tick aligned clock monotonic time of the first event of
+ * @base. Caller must hold base->lock.
  */
-u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
+static u64 next_timer_base_event(struct timer_base *base, unsigned long basej,
+				 u64 basem)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
 	u64 expires = KTIME_MAX;
 	unsigned long nextevt;
 	bool is_max_delta;
 
-	/*
-	 * Pretend that there is no timer pending if the cpu is offline.
-	 * Possible pending timers will be migrated later to an active cpu.
-	 */
-	if (cpu_is_offline(smp_processor_id()))
-		return expires;
-
-	raw_spin_lock(&base->lock);
 	nextevt = __next_timer_interrupt(base);
 	is_max_delta = (nextevt == base->clk + NEXT_TIMER_MAX_DELTA);
 	base->next_expiry = nextevt;
@@ -1502,9 +1488,51 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
 		if ((expires - basem) > TICK_NSEC)
 			base->is_idle = true;
 	}
-	raw_spin_unlock(&base->lock);
+	return expires;
+}
+
+/**
+ * get_next_timer_interrupt - return the time (clock mono) of the next timer
+ * @basej:	base time jiffies
+ * @basem:	base time clock monotonic
+ *
+ * Returns the tick aligned clock monotonic time of the next pending
+ * timer or KTIME_MAX if no timer is pending.
+ */
+u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
+{
+	struct timer_base *base_local = this_cpu_ptr(&timer_bases[BASE_LOCAL]);
+	struct timer_base *base_global = this_cpu_ptr(&timer_bases[BASE_GLOBAL]);
+	u64 expires, global;
+
+	/*
+	 * Pretend that there is no timer pending if the cpu is offline.
+	 * Possible pending timers will be migrated later to an active cpu.
+	 */
+	if (cpu_is_offline(smp_processor_id()))
+		return KTIME_MAX;
+
+	raw_spin_lock(&base_local->lock);
+	expires = next_timer_base_event(base_local, basej, basem);
+	raw_spin_unlock(&base_local->lock);
+
+	raw_spin_lock(&base_global->lock);
+	global = next_timer_base_event(base_global, basej, basem);
+	raw_spin_unlock(&base_global->lock);
 
-	return cmp_next_hrtimer_event(basem, expires);
+	/*
+	 * An idle CPU which is going to sleep for more than a tick hands its
+	 * global timers to the migration hierarchy, and only has to wake up
+	 * for them when it is the last active CPU. An active CPU has to wake
+	 * up for the idle CPUs it expires the global timers of.
+	 */
+	if (base_global->migration_enabled && is_idle_task(current) &&
+	    base_local->is_idle && base_global->is_idle)
+		global = tmigr_cpu_deactivate(global);
+	else
+		global = min(global, tmigr_cpu_next_remote());
+
+	return cmp_next_hrtimer_event(basem, min(expires, global));
 }
 
 /**
@@ -1514,15 +1542,17 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
  */
 void timer_clear_idle(void)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
-
 	/*
 	 * We do this unlocked. The worst outcome is a remote enqueue sending
 	 * a pointless IPI, but taking the lock would just make the window for
 	 * sending the IPI a few instructions smaller for the cost of taking
 	 * the lock in the exit from idle path.
 	 */
-	base->is_idle = false;
+	__this_cpu_write(timer_bases[BASE_LOCAL].is_idle, false);
+	__this_cpu_write(timer_bases[BASE_GLOBAL].is_idle, false);
+
+	/* Take the global timers back from the migration hierarchy */
+	tmigr_cpu_activate();
 }
 
 static int collect_expired_timers(struct timer_base *base,
@@ -1592,6 +1622,15 @@ static inline void __run_timers(struct timer_base *base)
 
 	raw_spin_lock_irq(&base->lock);
 
+	/*
+	 * The global base of an idle CPU is expired remotely. Don't run it
+	 * twice when the CPU wakes up meanwhile.
+	 */
+	if (base->running_timer) {
+		raw_spin_unlock_irq(&base->lock);
+		return;
+	}
+
 	while (time_after_eq(jiffies, base->clk)) {
 
 		levels = collect_expired_timers(base, heads);
@@ -1609,11 +1648,11 @@ static inline void __run_timers(struct timer_base *base)
  */
 static __latent_entropy void run_timer_softirq(struct softirq_action *h)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	int b;
 
-	__run_timers(base);
-	if (IS_ENABLED(CONFIG_NO_HZ_COMMON) && base->nohz_active)
-		__run_timers(this_cpu_ptr(&timer_bases[BASE_DEF]));
+	for (b = 0; b < NR_BASES; b++)
+		__run_timers(this_cpu_ptr(&timer_bases[b]));
+	tmigr_handle_remote();
 }
 
 /*
@@ -1621,21 +1660,64 @@ static __latent_entropy void run_timer_softirq(struct softirq_action *h)
  */
 void run_local_timers(void)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_LOCAL]);
+	int b;
 
 	hrtimer_run_queues();
 	/* Raise the softirq only if required. */
-	if (time_before(jiffies, base->clk)) {
-		if (!IS_ENABLED(CONFIG_NO_HZ_COMMON) || !base->nohz_active)
-			return;
-		/* CPU is awake, so check the deferrable base. */
-		base++;
-		if (time_before(jiffies, base->clk))
+	for (b = 0; b < NR_BASES; b++, base++) {
+		if (time_after_eq(jiffies, base->clk)) {
+			raise_softirq(TIMER_SOFTIRQ);
 			return;
+		}
 	}
-	raise_softirq(TIMER_SOFTIRQ);
+	/* Global timers of idle CPUs this CPU is the migrator for */
+	if (tmigr_requires_handle_remote())
+		raise_softirq(TIMER_SOFTIRQ);
 }
 
+#if defined(CONFIG_SMP) && defined(CONFIG_NO_HZ_COMMON)
+/**
+ * timer_expire_remote - expire the global timers of an idle CPU
+ * @cpu:	The idle CPU
+ *
+ * Called by the timer migration hierarchy.
+ */
+void timer_expire_remote(unsigned int cpu)
+{
+	__run_timers(per_cpu_ptr(&timer_bases[BASE_GLOBAL], cpu));
+}
+
+/**
+ * timer_global_next_event - first event of the global timers of a CPU
+ * @cpu:	The idle CPU
+ *
+ * Returns the tick aligned clock monotonic time of the first global timer
+ * of @cpu, or KTIME_MAX. Called with interrupts disabled.
+ */
+u64 timer_global_next_event(unsigned int cpu)
+{
+	struct timer_base *base = per_cpu_ptr(&timer_bases[BASE_GLOBAL], cpu);
+	unsigned long basej, nextevt;
+	bool is_max_delta;
+	u64 basem;
+
+	basem = get_jiffies_update(&basej);
+
+	raw_spin_lock(&base->lock);
+	nextevt = __next_timer_interrupt(base);
+	is_max_delta = (nextevt == base->clk + NEXT_TIMER_MAX_DELTA);
+	base->next_expiry = nextevt;
+	raw_spin_unlock(&base->lock);
+
+	if (is_max_delta)
+		return KTIME_MAX;
+	if (time_before_eq(nextevt, basej))
+		return basem;
+	return basem + (u64)(nextevt - basej) * TICK_NSEC;
+}
+#endif
+
 static void process_timeout(unsigned long __data)
 {
 	wake_up_process((struct task_struct *)__data);
@@ -0,0 +1,430 @@
+/*
+ * Hierarchical timer migration for NOHZ idle CPUs
+ *
+ * Timers which are not pinned to a CPU are queued in the global timer
+ * wheel base of the CPU which arms them. When a CPU goes idle, it does not
+ * push them to another CPU. It hands the first expiry of its global base
+ * to the migration hierarchy instead and only keeps the pinned ones for
+ * itself.
+ *
+ * The hierarchy groups up to TMIGR_CHILDREN_PER_GROUP CPUs in a level 0
+ * group, up to TMIGR_CHILDREN_PER_GROUP level 0 groups in a level 1 group
+ * and so on, until a single top level group is left. Siblings are
+ * neighbouring CPU numbers, which usually share a cluster.
+ *
+ * A group is active as long as one of its children is active. One active
+ * child of each group is its migrator: it expires the global timers of the
+ * idle children when they are due. When the migrator goes idle, another
+ * active child takes over. When the last active child goes idle, the group
+ * goes idle in its parent, handing over the first event of its idle
+ * children, and the migrator of the parent takes care of it.
+ *
+ * So the global timers of an idle CPU are expired by an active CPU which is
+ * as close as possible, and no single CPU collects all of them. Only when
+ * the whole hierarchy is idle, the last CPU going idle has to wake up for
+ * the first global event of the system.
+ *
+ * Updates walk up the hierarchy with lock coupling: the lock of a parent
+ * is taken before the lock of the child is dropped. So a parent sees the
+ * state changes of a child in the order they happened in the child.
+ */
+#include <linux/cpuhotplug.h>
+#include <linux/cpumask.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/sched/nohz.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/tick.h>
+
+#include "tick-internal.h"
+#include "timer_migration.h"
+
+static DEFINE_PER_CPU(struct tmigr_cpu, tmigr_cpu);
+
+static unsigned int tmigr_hierarchy_levels __read_mostly;
+
+static void tmigr_update_next_expiry(struct tmigr_group *group)
+{
+	u64 next = KTIME_MAX;
+	unsigned int i;
+
+	for (i = 0; i < group->num_children; i++)
+		next = min(next, group->child_expiry[i]);
+	WRITE_ONCE(group->next_expiry, next);
+}
+
+/*
+ * Mark the child @childmask of @group active and propagate it upwards as
+ * long as groups become active. Called with the lock of @group held, which
+ * is dropped.
+ */
+static void tmigr_active_up(struct tmigr_group *group, u8 childmask)
+{
+	struct tmigr_group *parent;
+	bool was_active;
+
+	for (;;) {
+		was_active = group->active;
+		group->active |= childmask;
+		group->child_expiry[__ffs(childmask)] = KTIME_MAX;
+		tmigr_update_next_expiry(group);
+		if (!group->migrator)
+			WRITE_ONCE(group->migrator, childmask);
+
+		parent = group->parent;
+		if (was_active || !parent)
+			break;
+
+		raw_spin_lock_nested(&parent->lock, parent->level);
+		raw_spin_unlock(&group->lock);
+		childmask = group->childmask;
+		group = parent;
+	}
+	raw_spin_unlock(&group->lock);
+}
+
+/*
+ * Mark the child @childmask of @group idle with @expires as the first
+ * event of its global timers, and propagate it upwards as long as groups
+ * become idle. Also used to update the event of a child which is idle
+ * already. Called with the lock of @group held, which is dropped.
+ *
+ * Returns KTIME_MAX when an active CPU takes care of the event, or the
+ * first event of the hierarchy when it went idle as a whole.
+ */
+static u64 tmigr_idle_up(struct tmigr_group *group, u8 childmask, u64 expires)
+{
+	struct tmigr_group *parent;
+
+	for (;;) {
+		group->active &= ~childmask;
+		group->child_expiry[__ffs(childmask)] = expires;
+		tmigr_update_next_expiry(group);
+		/* Hand the migrator duty to the lowest active child */
+		if (group->migrator == childmask)
+			WRITE_ONCE(group->migrator,
+				   (u8)(group->active & -group->active));
+
+		if (group->active) {
+			expires = KTIME_MAX;
+			break;
+		}
+
+		expires = group->next_expiry;
+		parent = group->parent;
+		if (!parent)
+			break;
+
+		raw_spin_lock_nested(&parent->lock, parent->level);
+		raw_spin_unlock(&group->lock);
+		childmask = group->childmask;
+		group = parent;
+	}
+	raw_spin_unlock(&group->lock);
+	return expires;
+}
+
+/**
+ * tmigr_cpu_activate - take the global timers of this CPU back
+ *
+ * Called with interrupts disabled when the CPU leaves idle.
+ */
+void tmigr_cpu_activate(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+
+	/* Only this CPU changes tmc->idle, no need for the lock to check */
+	if (!tmc->online || !tmc->idle)
+		return;
+
+	raw_spin_lock(&tmc->lock);
+	tmc->idle = false;
+	raw_spin_lock(&tmc->group->lock);
+	tmigr_active_up(tmc->group, tmc->childmask);
+	raw_spin_unlock(&tmc->lock);
+}
+
+/**
+ * tmigr_cpu_deactivate - hand the global timers of this CPU over
+ * @nextexp:	First event of the global timers of this CPU
+ *
+ * Called with interrupts disabled when the CPU goes idle, and again when
+ * the first global event changed while it is idle.
+ *
+ * Returns the global event this CPU still has to wake up for: KTIME_MAX if
+ * an active CPU takes care of it, the first event of the hierarchy if this
+ * is the last active CPU.
+ */
+u64 tmigr_cpu_deactivate(u64 nextexp)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	u64 ret;
+
+	if (!tmc->online)
+		return nextexp;
+
+	raw_spin_lock(&tmc->lock);
+	tmc->idle = true;
+	raw_spin_lock(&tmc->group->lock);
+	ret = tmigr_idle_up(tmc->group, tmc->childmask, nextexp);
+	raw_spin_unlock(&tmc->lock);
+
+	return ret;
+}
+
+/*
+ * Walk up the groups this CPU is the migrator of and return the first event
+ * of their idle children.
+ */
+static u64 tmigr_migrator_next_expiry(struct tmigr_cpu *tmc)
+{
+	struct tmigr_group *group = tmc->group;
+	u8 childmask = tmc->childmask;
+	u64 next = KTIME_MAX;
+
+	for (; group; childmask = group->childmask, group = group->parent) {
+		if (READ_ONCE(group->migrator) != childmask)
+			break;
+		next = min(next, READ_ONCE(group->next_expiry));
+	}
+	return next;
+}
+
+/**
+ * tmigr_cpu_next_remote - first remote event this CPU is responsible for
+ *
+ * Used when an active CPU stops its tick, so it does not sleep past the
+ * global timers of the idle CPUs it is the migrator for.
+ */
+u64 tmigr_cpu_next_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+
+	if (!tmc->online || tmc->idle)
+		return KTIME_MAX;
+	return tmigr_migrator_next_expiry(tmc);
+}
+
+/**
+ * tmigr_requires_handle_remote - check for due timers of idle CPUs
+ *
+ * Called from the tick to decide whether the timer softirq has to expire
+ * global timers of idle CPUs.
+ */
+bool tmigr_requires_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	unsigned long basej;
+	u64 next;
+
+	if (!tmc->online || tmc->idle)
+		return false;
+
+	next = tmigr_migrator_next_expiry(tmc);
+	if (next == KTIME_MAX)
+		return false;
+	return next <= get_jiffies_update(&basej);
+}
+
+static void tmigr_handle_remote_cpu(struct tmigr_cpu *tmc)
+{
+	u64 next;
+
+	raw_spin_lock_irq(&tmc->lock);
+	if (!tmc->online || !tmc->idle || tmc->remote) {
+		raw_spin_unlock_irq(&tmc->lock);
+		return;
+	}
+	tmc->remote = true;
+	raw_spin_unlock_irq(&tmc->lock);
+
+	timer_expire_remote(tmc->cpu);
+
+	raw_spin_lock_irq(&tmc->lock);
+	tmc->remote = false;
+	/*
+	 * If the CPU woke up meanwhile, it takes care of its timers itself.
+	 * Otherwise report its new first event, which ends at the active
+	 * group of this CPU at the latest.
+	 */
+	if (tmc->idle) {
+		next = timer_global_next_event(tmc->cpu);
+		raw_spin_lock(&tmc->group->lock);
+		tmigr_idle_up(tmc->group, tmc->childmask, next);
+	}
+	raw_spin_unlock_irq(&tmc->lock);
+}
+
+static void tmigr_handle_group(struct tmigr_group *group, u64 now)
+{
+	unsigned long expired = 0;
+	unsigned int i;
+
+	raw_spin_lock_irq(&group->lock);
+	for (i = 0; i < group->num_children; i++) {
+		if (group->child_expiry[i] <= now)
+			__set_bit(i, &expired);
+	}
+	raw_spin_unlock_irq(&group->lock);
+
+	for_each_set_bit(i, &expired, TMIGR_CHILDREN_PER_GROUP) {
+		if (group->level)
+			tmigr_handle_group(group->groups[i], now);
+		else
+			tmigr_handle_remote_cpu(group->cpus[i]);
+	}
+}
+
+/**
+ * tmigr_handle_remote - expire the due global timers of idle CPUs
+ *
+ * Called from the timer softirq. Handles the groups this CPU is the
+ * migrator of.
+ */
+void tmigr_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	struct tmigr_group *group = tmc->group;
+	u8 childmask = tmc->childmask;
+	unsigned long basej;
+	u64 now;
+
+	if (!tmc->online || tmc->idle)
+		return;
+
+	now = get_jiffies_update(&basej);
+	for (; group; childmask = group->childmask, group = group->parent) {
+		if (READ_ONCE(group->migrator) != childmask)
+			break;
+		if (READ_ONCE(group->next_expiry) <= now)
+			tmigr_handle_group(group, now);
+	}
+}
+
+static int tmigr_cpu_online(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+
+	/* nohz_full CPUs keep their timers and never expire remote ones */
+	if (tick_nohz_full_cpu(cpu))
+		return 0;
+
+	raw_spin_lock_irq(&tmc->lock);
+	tmc->online = true;
+	tmc->idle = false;
+	raw_spin_lock(&tmc->group->lock);
+	tmigr_active_up(tmc->group, tmc->childmask);
+	raw_spin_unlock_irq(&tmc->lock);
+	return 0;
+}
+
+static int tmigr_cpu_offline(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	u64 next;
+
+	if (!tmc->online)
+		return 0;
+
+	/* The remaining global timers are migrated by timers_dead_cpu() */
+	raw_spin_lock_irq(&tmc->lock);
+	tmc->online = false;
+	tmc->idle = true;
+	raw_spin_lock(&tmc->group->lock);
+	next = tmigr_idle_up(tmc->group, tmc->childmask, KTIME_MAX);
+	raw_spin_unlock_irq(&tmc->lock);
+
+	/*
+	 * If this was the last active CPU, nobody waits for the events of
+	 * the idle ones. Kick one, it takes over when it goes idle again.
+	 */
+	if (next != KTIME_MAX)
+		wake_up_nohz_cpu(cpumask_any_but(cpu_online_mask, cpu));
+
+	/* Wait for a remote expiry which started before this CPU woke up */
+	while (READ_ONCE(tmc->remote))
+		cpu_relax();
+	return 0;
+}
+
+static struct tmigr_group * __init tmigr_alloc_level(unsigned int nr,
+						     unsigned int level)
+{
+	struct tmigr_group *groups;
+	unsigned int i, j;
+
+	groups = kcalloc(nr, sizeof(*groups), GFP_KERNEL);
+	if (!groups)
+		return NULL;
+
+	for (i = 0; i < nr; i++) {
+		raw_spin_lock_init(&groups[i].lock);
+		groups[i].level = level;
+		groups[i].next_expiry = KTIME_MAX;
+		for (j = 0; j < TMIGR_CHILDREN_PER_GROUP; j++)
+			groups[i].child_expiry[j] = KTIME_MAX;
+	}
+	return groups;
+}
+
+static int __init tmigr_init(void)
+{
+	struct tmigr_group *child, *groups;
+	unsigned int cpu, i, nr, level = 0;
+	int ret;
+
+	/* Level 0: CPUs */
+	nr = DIV_ROUND_UP(nr_cpu_ids, TMIGR_CHILDREN_PER_GROUP);
+	groups = tmigr_alloc_level(nr, level);
+	if (!groups)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+		struct tmigr_group *group;
+
+		i = cpu % TMIGR_CHILDREN_PER_GROUP;
+		group = &groups[cpu / TMIGR_CHILDREN_PER_GROUP];
+		raw_spin_lock_init(&tmc->lock);
+		tmc->cpu = cpu;
+		tmc->idle = true;
+		tmc->childmask = BIT(i);
+		tmc->group = group;
+		group->cpus[i] = tmc;
+		group->num_children = max(group->num_children, i + 1);
+	}
+
+	/* Upper levels, until a single group is left */
+	while (nr > 1) {
+		unsigned int nr_children = nr;
+
+		child = groups;
+		nr = DIV_ROUND_UP(nr_children, TMIGR_CHILDREN_PER_GROUP);
+		groups = tmigr_alloc_level(nr, ++level);
+		if (!groups)
+			return -ENOMEM;
+
+		for (i = 0; i < nr_children; i++) {
+			struct tmigr_group *parent;
+			unsigned int idx = i % TMIGR_CHILDREN_PER_GROUP;
+
+			parent = &groups[i / TMIGR_CHILDREN_PER_GROUP];
+			child[i].parent = parent;
+			child[i].childmask = BIT(idx);
+			parent->groups[idx] = &child[i];
+			parent->num_children = idx + 1;
+		}
+	}
+	tmigr_hierarchy_levels = level + 1;
+
+	ret = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "timers/migration:online",
+				tmigr_cpu_online, tmigr_cpu_offline);
+	if (ret < 0)
+		return ret;
+
+	pr_info("Timer migration: %u hierarchy levels, %u children per group\n",
+		tmigr_hierarchy_levels, TMIGR_CHILDREN_PER_GROUP);
+	return 0;
+}
+early_initcall(tmigr_init);
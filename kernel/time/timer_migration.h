@@ -0,0 +1,80 @@
+#ifndef _KERNEL_TIME_MIGRATION_H
+#define _KERNEL_TIME_MIGRATION_H
+
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+
+/* Per group capacity. Must be a power of 2! */
+#define TMIGR_CHILDREN_PER_GROUP	8
+
+/**
+ * struct tmigr_group - timer migration hierarchy group
+ * @lock:		Lock protecting the group state
+ * @parent:		Pointer to the parent group, NULL for the top level
+ * @level:		Hierarchy level of the group, 0 groups CPUs
+ * @num_children:	Number of children which are in use
+ * @childmask:		Bit of this group in the parent's masks
+ * @active:		Mask of the children which are active
+ * @migrator:		Bit of the active child which expires the timers of
+ *			the idle children, 0 when the group is idle
+ * @next_expiry:	First global timer event of the idle children, or
+ *			KTIME_MAX
+ * @child_expiry:	First global timer event per idle child
+ * @cpus:		Children of a level 0 group
+ * @groups:		Children of the upper level groups
+ */
+struct tmigr_group {
+	raw_spinlock_t		lock;
+	struct tmigr_group	*parent;
+	unsigned int		level;
+	unsigned int		num_children;
+	u8			childmask;
+	u8			active;
+	u8			migrator;
+	u64			next_expiry;
+	u64			child_expiry[TMIGR_CHILDREN_PER_GROUP];
+	union {
+		struct tmigr_cpu	*cpus[TMIGR_CHILDREN_PER_GROUP];
+		struct tmigr_group	*groups[TMIGR_CHILDREN_PER_GROUP];
+	};
+};
+
+/**
+ * struct tmigr_cpu - timer migration per CPU state
+ * @lock:		Lock protecting the state against remote expiry
+ * @cpu:		The CPU number
+ * @online:		The CPU takes part in the hierarchy
+ * @idle:		The CPU handed its global timers to the hierarchy
+ * @remote:		The global timers are expired by another CPU right now
+ * @childmask:		Bit of the CPU in the level 0 group masks
+ * @group:		The level 0 group of the CPU
+ */
+struct tmigr_cpu {
+	raw_spinlock_t		lock;
+	unsigned int		cpu;
+	bool			online;
+	bool			idle;
+	bool			remote;
+	u8			childmask;
+	struct tmigr_group	*group;
+};
+
+/* Provided by timer.c for the expiry of idle CPUs' global timers */
+extern void timer_expire_remote(unsigned int cpu);
+extern u64 timer_global_next_event(unsigned int cpu);
+
+#if defined(CONFIG_SMP) && defined(CONFIG_NO_HZ_COMMON)
+extern void tmigr_cpu_activate(void);
+extern u64 tmigr_cpu_deactivate(u64 nextexp);
+extern u64 tmigr_cpu_next_remote(void);
+extern bool tmigr_requires_handle_remote(void);
+extern void tmigr_handle_remote(void);
+#else
+static inline void tmigr_cpu_activate(void) { }
+static inline u64 tmigr_cpu_deactivate(u64 nextexp) { return nextexp; }
+static inline u64 tmigr_cpu_next_remote(void) { return KTIME_MAX; }
+static inline bool tmigr_requires_handle_remote(void) { return false; }
+static inline void tmigr_handle_remote(void) { }
+#endif
+
+#endif
@@ -274,6 +274,14 @@ static FORCE_INLINE int LZ4_decompress_generic(
 		/* copy match within block */
 		cpy = op + length;
 
+#ifdef LZ4_ARCH_MATCH_COPY
+		if (length >= LZ4_ARCH_MATCH_COPY_MIN && cpy <= oend - 12 &&
+		    lz4_match_copy_vector(op, match, length)) {
+			op = cpy;
+			continue;
+		}
+#endif
+
 		if (unlikely(offset < 8)) {
 			const int dec64 = dec64table[offset];
 
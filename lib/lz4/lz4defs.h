@@ -67,6 +67,16 @@ typedef uintptr_t uptrval;
 #define LZ4_LITTLE_ENDIAN 0
 #endif
 
+/*
+ * Long matches are handed to the vector unit, which copies them in
+ * chunks bounded by the match distance (arch/riscv/lib/lz4.c).
+ */
+#if defined(CONFIG_RISCV) && defined(CONFIG_64BIT)
+#define LZ4_ARCH_MATCH_COPY 1
+#define LZ4_ARCH_MATCH_COPY_MIN 512
+extern bool lz4_match_copy_vector(u8 *dst, const u8 *src, size_t len);
+#endif
+
 /*-************************************
  *	Constants
  **************************************/
@@ -151,6 +161,7 @@ static FORCE_INLINE void LZ4_copy8(void *dst, const void *src)
  * customized variant of memcpy,
  * which can overwrite up to 7 bytes beyond dstEnd
  */
+#ifdef CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS
 static FORCE_INLINE void LZ4_wildCopy(void *dstPtr,
 	const void *srcPtr, void *dstEnd)
 {
@@ -164,6 +175,52 @@ static FORCE_INLINE void LZ4_wildCopy(void *dstPtr,
 		s += 8;
 	} while (d < e);
 }
+#else
+/*
+ * Without efficient unaligned accesses, get_unaligned() is a byte at a
+ * time. Align the destination, then store whole words: loaded directly
+ * when the source is aligned too, or merged from the two aligned source
+ * words which hold them. The loads never cross an aligned word the copy
+ * doesn't use, so they stay within the source pages.
+ *
+ * Matches may overlap their destination when they are at least 8 bytes
+ * back: every word loaded is then below the next store, or is only used
+ * for the bytes below it.
+ */
+static FORCE_INLINE void LZ4_wildCopy(void *dstPtr,
+	const void *srcPtr, void *dstEnd)
+{
+	BYTE *d = (BYTE *)dstPtr;
+	const BYTE *s = (const BYTE *)srcPtr;
+	BYTE *const e = (BYTE *)dstEnd;
+	const size_t *sw;
+	size_t lo, hi;
+	unsigned int shift;
+
+	while (((uptrval)d & (STEPSIZE - 1)) && d < e)
+		*d++ = *s++;
+
+	shift = ((uptrval)s & (STEPSIZE - 1)) * 8;
+	sw = (const size_t *)((uptrval)s & ~(uptrval)(STEPSIZE - 1));
+
+	if (!shift) {
+		for (; d < e; d += STEPSIZE)
+			*(size_t *)d = *sw++;
+		return;
+	}
+
+	lo = *sw++;
+	for (; d < e; d += STEPSIZE) {
+		hi = *sw++;
+#if LZ4_LITTLE_ENDIAN
+		*(size_t *)d = (lo >> shift) | (hi << (BITS_PER_LONG - shift));
+#else
+		*(size_t *)d = (lo << shift) | (hi >> (BITS_PER_LONG - shift));
+#endif
+		lo = hi;
+	}
+}
+#endif
 
 static FORCE_INLINE unsigned int LZ4_NbCommonBytes(register size_t val)
 {
@@ -135,6 +135,58 @@ next:
 #  else
 #    error "missing endian definition"
 #  endif
+#elif !defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS)
+		/*
+		 * Unaligned loads are a byte at a time here, so compare bytes
+		 * until the input is aligned, then whole words. The match
+		 * words are merged from the two aligned words which hold them.
+		 * Aligned loads of a word holding input bytes stay within the
+		 * input pages.
+		 */
+		if (unlikely(ip[m_len] == m_pos[m_len])) {
+			const unsigned long *iw, *mw;
+			unsigned long v, w, lo, hi;
+			unsigned int shift;
+
+			do {
+				m_len += 1;
+				if (ip[m_len] != m_pos[m_len])
+					goto m_len_done;
+			} while ((unsigned long)(ip + m_len) &
+				 (sizeof(unsigned long) - 1));
+
+			iw = (const unsigned long *)(ip + m_len);
+			shift = (unsigned long)(m_pos + m_len) &
+				(sizeof(unsigned long) - 1);
+			mw = (const unsigned long *)(m_pos + m_len - shift);
+			shift *= 8;
+
+			lo = *mw;
+			for (;;) {
+				hi = *++mw;
+#  if defined(__LITTLE_ENDIAN)
+				w = shift ? (lo >> shift) |
+					    (hi << (BITS_PER_LONG - shift)) : lo;
+#  elif defined(__BIG_ENDIAN)
+				w = shift ? (lo << shift) |
+					    (hi >> (BITS_PER_LONG - shift)) : lo;
+#  else
+#    error "missing endian definition"
+#  endif
+				v = *iw++ ^ w;
+				if (v != 0)
+					break;
+				m_len += sizeof(unsigned long);
+				if (unlikely(ip + m_len >= ip_end))
+					goto m_len_done;
+				lo = hi;
+			}
+#  if defined(__LITTLE_ENDIAN)
+			m_len += __ffs(v) / 8;
+#  else
+			m_len += (BITS_PER_LONG - 1 - __fls(v)) / 8;
+#  endif
+		}
 #else
 		if (unlikely(ip[m_len] == m_pos[m_len])) {
 			do {
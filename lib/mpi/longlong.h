@@ -885,6 +885,48 @@ do { \
 	(w1) = __xx.__i.__h; (w0) = __xx.__i.__l; })
 #endif /* __pyr__ */
 
+/***************************************
+	**************  RISC-V  ***************
+	***************************************/
+#if defined(__riscv) && defined(__riscv_mul) && W_TYPE_SIZE == __riscv_xlen
+#define add_ssaaaa(sh, sl, ah, al, bh, bl) \
+do { \
+	UWtype __sl, __c; \
+	__asm__ ("add %0,%2,%3\n" \
+	"sltu %1,%0,%2" \
+	: "=&r" (__sl), \
+	"=r" (__c) \
+	: "r" ((UWtype)(al)), \
+	"r" ((UWtype)(bl))); \
+	(sh) = (UWtype)(ah) + (UWtype)(bh) + __c; \
+	(sl) = __sl; \
+} while (0)
+#define sub_ddmmss(sh, sl, ah, al, bh, bl) \
+do { \
+	UWtype __sl, __b; \
+	__asm__ ("sub %0,%2,%3\n" \
+	"sltu %1,%2,%3" \
+	: "=&r" (__sl), \
+	"=&r" (__b) \
+	: "r" ((UWtype)(al)), \
+	"r" ((UWtype)(bl))); \
+	(sh) = (UWtype)(ah) - (UWtype)(bh) - __b; \
+	(sl) = __sl; \
+} while (0)
+#define umul_ppmm(ph, pl, m0, m1) \
+do { \
+	UWtype __m0 = (m0), __m1 = (m1), __ph; \
+	__asm__ ("mulhu %0,%1,%2" \
+	: "=r" (__ph) \
+	: "r" (__m0), \
+	"r" (__m1)); \
+	(ph) = __ph; \
+	(pl) = __m0 * __m1; \
+} while (0)
+#define UMUL_TIME 5
+#define UDIV_TIME 40
+#endif /* __riscv */
+
 /***************************************
 	**************  RT/ROMP  **************
 	***************************************/
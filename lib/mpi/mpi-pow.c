@@ -30,6 +30,171 @@
 #include "mpi-internal.h"
 #include "longlong.h"
 
+/* Odd moduli of at least this many limbs are exponentiated in Montgomery
+ * form, which replaces the division after every product with cheaper
+ * multiply-and-add passes.  */
+#define MONT_THRESHOLD 4
+
+/****************
+ * Return -1/M0 mod 2^BITS_PER_MPI_LIMB for an odd M0.  Every Newton step
+ * doubles the number of correct low bits, and M0 is its own inverse to
+ * three bits.
+ */
+static mpi_limb_t mont_inverse(mpi_limb_t m0)
+{
+	mpi_limb_t inv = m0;
+	int bits;
+
+	for (bits = 3; bits < BITS_PER_MPI_LIMB; bits *= 2)
+		inv *= 2 - m0 * inv;
+	return -inv;
+}
+
+/****************
+ * RP = TP / R mod MP, where R = 2^(N * BITS_PER_MPI_LIMB) and TP < MP * R.
+ * TP has 2 * N limbs and is clobbered.  The result is fully reduced.
+ */
+static void mont_redc(mpi_ptr_t rp, mpi_ptr_t tp, mpi_ptr_t mp, mpi_size_t n,
+		      mpi_limb_t minv)
+{
+	mpi_limb_t cy = 0, c;
+	mpi_size_t i;
+
+	for (i = 0; i < n; i++) {
+		c = mpihelp_addmul_1(tp + i, mp, n, tp[i] * minv);
+		cy += mpihelp_add_1(tp + i + n, tp + i + n, n - i, c);
+	}
+
+	if (cy || mpihelp_cmp(tp + n, mp, n) >= 0)
+		mpihelp_sub_n(rp, tp + n, mp, n);
+	else
+		MPN_COPY(rp, tp + n, n);
+}
+
+/****************
+ * RES = BASE ^ EXP mod MOD for an odd MOD and a positive BASE, using
+ * Montgomery multiplication.
+ */
+static int mpi_powm_mont(MPI res, MPI base, MPI exp, MPI mod)
+{
+	mpi_ptr_t mp = NULL, bp, rp, tp = NULL, tspace = NULL;
+	mpi_ptr_t ep = exp->d;
+	mpi_size_t n = mod->nlimbs;
+	mpi_size_t esize = exp->nlimbs;
+	mpi_size_t bsize = base->nlimbs;
+	mpi_size_t xsize, rsize, i;
+	struct karatsuba_ctx karactx;
+	mpi_limb_t minv, e, tmp;
+	int shift, c;
+	int rc = -ENOMEM;
+
+	memset(&karactx, 0, sizeof karactx);
+
+	/* MP holds MOD, its normalized copy, the Montgomery form of BASE
+	 * and the running result, so that RES may alias any argument.  */
+	mp = mpi_alloc_limb_space(4 * n);
+	if (!mp)
+		goto enomem;
+	bp = mp + 2 * n;
+	rp = mp + 3 * n;
+	MPN_COPY(mp, mod->d, n);
+	minv = mont_inverse(mp[0]);
+
+	xsize = max(n + bsize + 1, 2 * n);
+	tp = mpi_alloc_limb_space(xsize);
+	if (!tp)
+		goto enomem;
+	if (n >= KARATSUBA_THRESHOLD) {
+		tspace = mpi_alloc_limb_space(2 * n);
+		if (!tspace)
+			goto enomem;
+	}
+
+	/* BP = BASE * R mod MOD.  mpihelp_divrem wants the divisor
+	 * normalized, so shift both operands and the remainder back.  */
+	shift = count_leading_zeros(mp[n - 1]);
+	MPN_ZERO(tp, n);
+	xsize = n + bsize;
+	if (shift) {
+		mpihelp_lshift(mp + n, mp, n, shift);
+		tmp = mpihelp_lshift(tp + n, base->d, bsize, shift);
+		if (tmp)
+			tp[xsize++] = tmp;
+	} else {
+		MPN_COPY(mp + n, mp, n);
+		MPN_COPY(tp + n, base->d, bsize);
+	}
+	/* We don't care about the quotient, store it above the remainder.  */
+	mpihelp_divrem(tp + n, 0, tp, xsize, mp + n, n);
+	if (shift)
+		mpihelp_rshift(bp, tp, n, shift);
+	else
+		MPN_COPY(bp, tp, n);
+
+	MPN_COPY(rp, bp, n);
+
+	i = esize - 1;
+	e = ep[i];
+	c = count_leading_zeros(e);
+	e = (e << c) << 1;	/* shift the exp bits to the left, lose msb */
+	c = BITS_PER_MPI_LIMB - 1 - c;
+
+	for (;;) {
+		while (c) {
+			if (n < KARATSUBA_THRESHOLD)
+				mpih_sqr_n_basecase(tp, rp, n);
+			else
+				mpih_sqr_n(tp, rp, n, tspace);
+			mont_redc(rp, tp, mp, n, minv);
+
+			if ((mpi_limb_signed_t) e < 0) {
+				if (n < KARATSUBA_THRESHOLD) {
+					if (mpihelp_mul(tp, rp, n, bp, n,
+							&tmp) < 0)
+						goto enomem;
+				} else {
+					if (mpihelp_mul_karatsuba_case
+					    (tp, rp, n, bp, n, &karactx) < 0)
+						goto enomem;
+				}
+				mont_redc(rp, tp, mp, n, minv);
+			}
+			e <<= 1;
+			c--;
+		}
+
+		i--;
+		if (i < 0)
+			break;
+		e = ep[i];
+		c = BITS_PER_MPI_LIMB;
+	}
+
+	/* Leave Montgomery form.  */
+	MPN_COPY(tp, rp, n);
+	MPN_ZERO(tp + n, n);
+	mont_redc(rp, tp, mp, n, minv);
+
+	rsize = n;
+	MPN_NORMALIZE(rp, rsize);
+	if (mpi_resize(res, n) < 0)
+		goto enomem;
+	MPN_COPY(res->d, rp, rsize);
+	res->nlimbs = rsize;
+	res->sign = 0;
+	rc = 0;
+
+enomem:
+	mpihelp_release_karatsuba_ctx(&karactx);
+	if (mp)
+		mpi_free_limb_space(mp);
+	if (tp)
+		mpi_free_limb_space(tp);
+	if (tspace)
+		mpi_free_limb_space(tspace);
+	return rc;
+}
+
 /****************
  * RES = BASE ^ EXP mod MOD
  */
@@ -75,6 +240,10 @@ int mpi_powm(MPI res, MPI base, MPI exp, MPI mod)
 		goto leave;
 	}
 
+	if ((mod->d[0] & 1) && msize >= MONT_THRESHOLD &&
+	    base->nlimbs && !base->sign)
+		return mpi_powm_mont(res, base, exp, mod);
+
 	/* Normalize MOD (i.e. make its most significant bit set) as required by
 	 * mpn_divrem.  This will make the intermediate values in the calculation
 	 * slightly larger, but the correct result is obtained after a final
@@ -80,6 +80,12 @@ const struct raid6_calls * const raid6_algos[] = {
 #endif
 #if defined(CONFIG_S390)
 	&raid6_s390vx8,
+#endif
+#ifdef CONFIG_RISCV
+	&raid6_rvvx1,
+	&raid6_rvvx2,
+	&raid6_rvvx4,
+	&raid6_rvvx8,
 #endif
 	&raid6_intx1,
 	&raid6_intx2,
@@ -112,6 +118,9 @@ const struct raid6_recov_calls *const raid6_recov_algos[] = {
 #endif
 #ifdef CONFIG_S390
 	&raid6_recov_s390xc,
+#endif
+#ifdef CONFIG_RISCV
+	&raid6_recov_rvv,
 #endif
 	&raid6_recov_intx1,
 	NULL
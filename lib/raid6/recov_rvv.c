@@ -0,0 +1,203 @@
+/*
+ * RAID-6 data recovery using the RISC-V vector extension
+ *
+ * Based on lib/raid6/recov_ssse3.c
+ *
+ * Copyright (C) 2012 Intel Corporation
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/raid/pq.h>
+
+#include "rvv.h"
+
+/*
+ * Multiplication by a constant uses the split tables in raid6_vgfmul: the
+ * low and high nibbles of each byte index a 16-entry table with vrgather,
+ * the same trick as pshufb in recov_ssse3.c.  The tables live in the first
+ * 16 elements of v0-v3, which is why this needs VLEN >= 128, as the V
+ * extension guarantees.
+ *
+ *   v0/v1  pbmul lo/hi		v2/v3  qmul lo/hi
+ *   v4-v7  data		v8-v12 scratch
+ */
+
+/* vd = table(lo, hi) * vs, clobbering v8, v9 and v12 */
+#define RVV_GFMUL(vd, vs, lo, hi)					\
+	RVV(RVV_VAND_VI(8, vs, 0xf))					\
+	RVV(RVV_VSRL_VI(9, vs, 4))					\
+	RVV(RVV_VRGATHER_VV(vd, lo, 8))					\
+	RVV(RVV_VRGATHER_VV(12, hi, 9))					\
+	RVV(RVV_VXOR_VV(vd, vd, 12))
+
+static int raid6_has_rvv(void)
+{
+	return has_vector();
+}
+
+static void raid6_2data_recov_rvv(int disks, size_t bytes, int faila,
+		int failb, void **ptrs)
+{
+	u8 *p, *q, *dp, *dq;
+	const u8 *pbmul;	/* P multiplier table for B data */
+	const u8 *qmul;		/* Q multiplier table (for both) */
+	unsigned long d;
+	register unsigned long ptr asm("a0");
+	register unsigned long vl asm("a1");
+	register unsigned long vt asm("a2") = RVV_VTYPE_E8(0);
+
+	p = (u8 *)ptrs[disks-2];
+	q = (u8 *)ptrs[disks-1];
+
+	/* Compute syndrome with zero for the missing data pages
+	   Use the dead data pages as temporary storage for
+	   delta p and delta q */
+	dp = (u8 *)ptrs[faila];
+	ptrs[faila] = (void *)raid6_empty_zero_page;
+	ptrs[disks-2] = dp;
+	dq = (u8 *)ptrs[failb];
+	ptrs[failb] = (void *)raid6_empty_zero_page;
+	ptrs[disks-1] = dq;
+
+	raid6_call.gen_syndrome(disks, bytes, ptrs);
+
+	/* Restore pointer table */
+	ptrs[faila]   = dp;
+	ptrs[failb]   = dq;
+	ptrs[disks-2] = p;
+	ptrs[disks-1] = q;
+
+	/* Now, pick the proper data tables */
+	pbmul = raid6_vgfmul[raid6_gfexi[failb-faila]];
+	qmul  = raid6_vgfmul[raid6_gfinv[raid6_gfexp[faila] ^
+		raid6_gfexp[failb]]];
+
+	kernel_vector_begin();
+
+	ptr = (unsigned long)pbmul;
+	asm volatile(RVV(RVV_VSETIVLI_16_E8M1)
+		     RVV(RVV_VLE8(0, 10))
+		     "addi a0, a0, 16\n"
+		     RVV(RVV_VLE8(1, 10))
+		     : "+r" (ptr) : : "memory");
+	ptr = (unsigned long)qmul;
+	asm volatile(RVV(RVV_VLE8(2, 10))
+		     "addi a0, a0, 16\n"
+		     RVV(RVV_VLE8(3, 10))
+		     : "+r" (ptr) : : "memory");
+
+	for (d = 0; d < bytes; d += vl) {
+		vl = bytes - d;
+		asm volatile(RVV(RVV_VSETVL(11, 11, 12))
+			     : "+r" (vl) : "r" (vt));
+
+		/* v4 = px = *p ^ *dp */
+		ptr = (unsigned long)&p[d];
+		asm volatile(RVV(RVV_VLE8(4, 10)) : : "r" (ptr) : "memory");
+		ptr = (unsigned long)&dp[d];
+		asm volatile(RVV(RVV_VLE8(5, 10))
+			     RVV(RVV_VXOR_VV(4, 4, 5))
+			     : : "r" (ptr) : "memory");
+
+		/* v10 = qx = qmul[*q ^ *dq] */
+		ptr = (unsigned long)&q[d];
+		asm volatile(RVV(RVV_VLE8(6, 10)) : : "r" (ptr) : "memory");
+		ptr = (unsigned long)&dq[d];
+		asm volatile(RVV(RVV_VLE8(7, 10))
+			     RVV(RVV_VXOR_VV(6, 6, 7))
+			     RVV_GFMUL(10, 6, 2, 3)
+			     /* v11 = db = pbmul[px] ^ qx */
+			     RVV_GFMUL(11, 4, 0, 1)
+			     RVV(RVV_VXOR_VV(11, 11, 10))
+			     RVV(RVV_VSE8(11, 10))
+			     : : "r" (ptr) : "memory");
+
+		/* Reconstructed A */
+		ptr = (unsigned long)&dp[d];
+		asm volatile(RVV(RVV_VXOR_VV(4, 4, 11))
+			     RVV(RVV_VSE8(4, 10))
+			     : : "r" (ptr) : "memory");
+	}
+
+	kernel_vector_end();
+}
+
+static void raid6_datap_recov_rvv(int disks, size_t bytes, int faila,
+		void **ptrs)
+{
+	u8 *p, *q, *dq;
+	const u8 *qmul;		/* Q multiplier table */
+	unsigned long d;
+	register unsigned long ptr asm("a0");
+	register unsigned long vl asm("a1");
+	register unsigned long vt asm("a2") = RVV_VTYPE_E8(0);
+
+	p = (u8 *)ptrs[disks-2];
+	q = (u8 *)ptrs[disks-1];
+
+	/* Compute syndrome with zero for the missing data page
+	   Use the dead data page as temporary storage for delta q */
+	dq = (u8 *)ptrs[faila];
+	ptrs[faila] = (void *)raid6_empty_zero_page;
+	ptrs[disks-1] = dq;
+
+	raid6_call.gen_syndrome(disks, bytes, ptrs);
+
+	/* Restore pointer table */
+	ptrs[faila]   = dq;
+	ptrs[disks-1] = q;
+
+	/* Now, pick the proper data tables */
+	qmul  = raid6_vgfmul[raid6_gfinv[raid6_gfexp[faila]]];
+
+	kernel_vector_begin();
+
+	ptr = (unsigned long)qmul;
+	asm volatile(RVV(RVV_VSETIVLI_16_E8M1)
+		     RVV(RVV_VLE8(2, 10))
+		     "addi a0, a0, 16\n"
+		     RVV(RVV_VLE8(3, 10))
+		     : "+r" (ptr) : : "memory");
+
+	for (d = 0; d < bytes; d += vl) {
+		vl = bytes - d;
+		asm volatile(RVV(RVV_VSETVL(11, 11, 12))
+			     : "+r" (vl) : "r" (vt));
+
+		/* v10 = *dq = qmul[*q ^ *dq] */
+		ptr = (unsigned long)&q[d];
+		asm volatile(RVV(RVV_VLE8(6, 10)) : : "r" (ptr) : "memory");
+		ptr = (unsigned long)&dq[d];
+		asm volatile(RVV(RVV_VLE8(7, 10))
+			     RVV(RVV_VXOR_VV(6, 6, 7))
+			     RVV_GFMUL(10, 6, 2, 3)
+			     RVV(RVV_VSE8(10, 10))
+			     : : "r" (ptr) : "memory");
+
+		/* *p ^= *dq */
+		ptr = (unsigned long)&p[d];
+		asm volatile(RVV(RVV_VLE8(4, 10))
+			     RVV(RVV_VXOR_VV(4, 4, 10))
+			     RVV(RVV_VSE8(4, 10))
+			     : : "r" (ptr) : "memory");
+	}
+
+	kernel_vector_end();
+}
+
+const struct raid6_recov_calls raid6_recov_rvv = {
+	.data2 = raid6_2data_recov_rvv,
+	.datap = raid6_datap_recov_rvv,
+	.valid = raid6_has_rvv,
+	.name = "rvv",
+	.priority = 1,
+};
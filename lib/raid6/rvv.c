@@ -0,0 +1,172 @@
+/*
+ * RAID-6 syndrome calculation using the RISC-V vector extension
+ *
+ * Based on lib/raid6/neon.c and lib/raid6/int.uc
+ *
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <linux/raid/pq.h>
+
+#include "rvv.h"
+
+/*
+ * The vector unit is strip-mined over the whole block, so rather than
+ * unrolling like int.uc the variants differ in LMUL: rvvxN works on groups
+ * of N registers at a time.  Register use is the same for every LMUL:
+ *
+ *   v0  wp (P)		v8  wq (Q)
+ *   v16 wd (data)	v24 scratch
+ *
+ * The scalar operands are pinned to a0-a3 so that they can be named in the
+ * encoded instructions.
+ */
+
+/* wq = wq * {02} in GF(2^8): shift each byte, reduce with 0x1d */
+#define RVV_MUL2							\
+	RVV(RVV_VSRA_VI(24, 8, 7))					\
+	RVV(RVV_VAND_VX(24, 24, 13))					\
+	RVV(RVV_VSLL_VI(8, 8, 1))					\
+	RVV(RVV_VXOR_VV(8, 8, 24))
+
+static void raid6_rvv_gen_syndrome_real(int disks, unsigned long bytes,
+					void **ptrs, unsigned long vtype)
+{
+	u8 **dptr = (u8 **)ptrs;
+	u8 *p, *q;
+	unsigned long d;
+	int z, z0;
+	register unsigned long ptr asm("a0");
+	register unsigned long vl asm("a1");
+	register unsigned long vt asm("a2") = vtype;
+	register unsigned long poly asm("a3") = 0x1d;
+
+	z0 = disks - 3;		/* Highest data disk */
+	p = dptr[z0+1];		/* XOR parity */
+	q = dptr[z0+2];		/* RS syndrome */
+
+	for (d = 0; d < bytes; d += vl) {
+		vl = bytes - d;
+		asm volatile(RVV(RVV_VSETVL(11, 11, 12))
+			     : "+r" (vl) : "r" (vt));
+
+		ptr = (unsigned long)&dptr[z0][d];
+		asm volatile(RVV(RVV_VLE8(0, 10))
+			     RVV(RVV_VMV_V_V(8, 0))
+			     : : "r" (ptr) : "memory");
+
+		for (z = z0-1; z >= 0; z--) {
+			ptr = (unsigned long)&dptr[z][d];
+			asm volatile(RVV(RVV_VLE8(16, 10))
+				     RVV(RVV_VXOR_VV(0, 0, 16))
+				     RVV_MUL2
+				     RVV(RVV_VXOR_VV(8, 8, 16))
+				     : : "r" (ptr), "r" (poly) : "memory");
+		}
+
+		ptr = (unsigned long)&p[d];
+		asm volatile(RVV(RVV_VSE8(0, 10)) : : "r" (ptr) : "memory");
+		ptr = (unsigned long)&q[d];
+		asm volatile(RVV(RVV_VSE8(8, 10)) : : "r" (ptr) : "memory");
+	}
+}
+
+static void raid6_rvv_xor_syndrome_real(int disks, int start, int stop,
+					unsigned long bytes, void **ptrs,
+					unsigned long vtype)
+{
+	u8 **dptr = (u8 **)ptrs;
+	u8 *p, *q;
+	unsigned long d;
+	int z, z0;
+	register unsigned long ptr asm("a0");
+	register unsigned long vl asm("a1");
+	register unsigned long vt asm("a2") = vtype;
+	register unsigned long poly asm("a3") = 0x1d;
+
+	z0 = stop;		/* P/Q right side optimization */
+	p = dptr[disks-2];	/* XOR parity */
+	q = dptr[disks-1];	/* RS syndrome */
+
+	for (d = 0; d < bytes; d += vl) {
+		vl = bytes - d;
+		asm volatile(RVV(RVV_VSETVL(11, 11, 12))
+			     : "+r" (vl) : "r" (vt));
+
+		/* P/Q data pages */
+		ptr = (unsigned long)&dptr[z0][d];
+		asm volatile(RVV(RVV_VLE8(0, 10))
+			     RVV(RVV_VMV_V_V(8, 0))
+			     : : "r" (ptr) : "memory");
+
+		for (z = z0-1; z >= start; z--) {
+			ptr = (unsigned long)&dptr[z][d];
+			asm volatile(RVV(RVV_VLE8(16, 10))
+				     RVV(RVV_VXOR_VV(0, 0, 16))
+				     RVV_MUL2
+				     RVV(RVV_VXOR_VV(8, 8, 16))
+				     : : "r" (ptr), "r" (poly) : "memory");
+		}
+
+		/* P/Q left side optimization */
+		for (z = start-1; z >= 0; z--)
+			asm volatile(RVV_MUL2 : : "r" (poly));
+
+		ptr = (unsigned long)&p[d];
+		asm volatile(RVV(RVV_VLE8(16, 10))
+			     RVV(RVV_VXOR_VV(0, 0, 16))
+			     RVV(RVV_VSE8(0, 10))
+			     : : "r" (ptr) : "memory");
+		ptr = (unsigned long)&q[d];
+		asm volatile(RVV(RVV_VLE8(16, 10))
+			     RVV(RVV_VXOR_VV(8, 8, 16))
+			     RVV(RVV_VSE8(8, 10))
+			     : : "r" (ptr) : "memory");
+	}
+}
+
+#define RAID6_RVV_WRAPPER(_n, _lg)					\
+	static void raid6_rvv ## _n ## _gen_syndrome(int disks,		\
+					size_t bytes, void **ptrs)	\
+	{								\
+		kernel_vector_begin();					\
+		raid6_rvv_gen_syndrome_real(disks, (unsigned long)bytes,\
+					    ptrs, RVV_VTYPE_E8(_lg));	\
+		kernel_vector_end();					\
+	}								\
+	static void raid6_rvv ## _n ## _xor_syndrome(int disks,		\
+					int start, int stop,		\
+					size_t bytes, void **ptrs)	\
+	{								\
+		kernel_vector_begin();					\
+		raid6_rvv_xor_syndrome_real(disks, start, stop,		\
+					    (unsigned long)bytes, ptrs,	\
+					    RVV_VTYPE_E8(_lg));		\
+		kernel_vector_end();					\
+	}								\
+	struct raid6_calls const raid6_rvvx ## _n = {			\
+		raid6_rvv ## _n ## _gen_syndrome,			\
+		raid6_rvv ## _n ## _xor_syndrome,			\
+		raid6_have_rvv,						\
+		"rvvx" #_n,						\
+		0							\
+	}
+
+static int raid6_have_rvv(void)
+{
+	return has_vector();
+}
+
+RAID6_RVV_WRAPPER(1, 0);
+RAID6_RVV_WRAPPER(2, 1);
+RAID6_RVV_WRAPPER(4, 2);
+RAID6_RVV_WRAPPER(8, 3);
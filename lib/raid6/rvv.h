@@ -0,0 +1,70 @@
+/*
+ * RAID-6 helpers for the RISC-V vector extension
+ *
+ * Copyright (C) 2017 SiFive
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation, version 2.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#ifndef _RAID6_RVV_H
+#define _RAID6_RVV_H
+
+#include <linux/stringify.h>
+
+#ifdef __KERNEL__
+#include <asm/vector.h>
+#else
+#define kernel_vector_begin()
+#define kernel_vector_end()
+#define has_vector()		(1)
+#endif
+
+/*
+ * The assembler doesn't know the V extension, so the instructions are
+ * spelled out here for use in inline asm.  Vector operands are register
+ * numbers; scalar operands are the numbers of the GPRs that the callers
+ * pin their variables to.
+ */
+#define RVV(insn)		__stringify(insn) "\n"
+
+/* vtype for SEW=8 with the given log2(LMUL), tail and mask agnostic */
+#define RVV_VTYPE_E8(lg)	(0xc0 | (lg))
+
+/* vsetvl rd, rs1, rs2 */
+#define RVV_VSETVL(rd, rs1, rs2)	.word (0x40 << 25) | ((rs2) << 20) | \
+					      ((rs1) << 15) | (7 << 12) | \
+					      ((rd) << 7) | 0x57
+/* vsetivli x0, 16, e8, m1, ta, ma */
+#define RVV_VSETIVLI_16_E8M1	.word (0xcc0 << 20) | (16 << 15) | (7 << 12) | 0x57
+/* vle8.v vd, (rs1) */
+#define RVV_VLE8(vd, rs1)	.word (1 << 25) | ((rs1) << 15) | ((vd) << 7) | 0x07
+/* vse8.v vs3, (rs1) */
+#define RVV_VSE8(vs3, rs1)	.word (1 << 25) | ((rs1) << 15) | ((vs3) << 7) | 0x27
+
+#define RVV_OPIVV(f6, vd, vs2, vs1)	.word ((f6) << 26) | (1 << 25) | \
+					      ((vs2) << 20) | ((vs1) << 15) | \
+					      ((vd) << 7) | 0x57
+#define RVV_OPIVX(f6, vd, vs2, rs1)	.word ((f6) << 26) | (1 << 25) | \
+					      ((vs2) << 20) | ((rs1) << 15) | \
+					      (4 << 12) | ((vd) << 7) | 0x57
+#define RVV_OPIVI(f6, vd, vs2, imm)	.word ((f6) << 26) | (1 << 25) | \
+					      ((vs2) << 20) | ((imm) << 15) | \
+					      (3 << 12) | ((vd) << 7) | 0x57
+
+#define RVV_VXOR_VV(vd, vs2, vs1)	RVV_OPIVV(0x0b, vd, vs2, vs1)
+#define RVV_VMV_V_V(vd, vs1)		RVV_OPIVV(0x17, vd, 0, vs1)
+#define RVV_VRGATHER_VV(vd, vs2, vs1)	RVV_OPIVV(0x0c, vd, vs2, vs1)
+#define RVV_VAND_VX(vd, vs2, rs1)	RVV_OPIVX(0x09, vd, vs2, rs1)
+#define RVV_VAND_VI(vd, vs2, imm)	RVV_OPIVI(0x09, vd, vs2, imm)
+#define RVV_VSLL_VI(vd, vs2, imm)	RVV_OPIVI(0x25, vd, vs2, imm)
+#define RVV_VSRL_VI(vd, vs2, imm)	RVV_OPIVI(0x28, vd, vs2, imm)
+#define RVV_VSRA_VI(vd, vs2, imm)	RVV_OPIVI(0x29, vd, vs2, imm)
+
+#endif /* _RAID6_RVV_H */
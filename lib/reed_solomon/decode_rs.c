@@ -26,6 +26,8 @@
 	int iprim = rs->iprim;
 	uint16_t *alpha_to = rs->alpha_to;
 	uint16_t *index_of = rs->index_of;
+	uint16_t *syn_tab = rs->syn_tab;
+	uint16_t *row;
 	uint16_t u, q, tmp, num1, num2, den, discr_r, syn_error;
 	/* Err+Eras Locator poly and syndrome poly The maximum value
 	 * of nroots is 8. So the necessary stack size will be about
@@ -50,6 +52,21 @@
 	for (i = 0; i < nroots; i++)
 		syn[i] = (((uint16_t) data[0]) ^ invmsk) & msk;
 
+	if (syn_tab) {
+		/* One root at a time keeps its multiply table in cache */
+		for (i = 0; i < nroots; i++) {
+			row = syn_tab + i * (nn + 1);
+			tmp = syn[i];
+			for (j = 1; j < len; j++)
+				tmp = ((((uint16_t) data[j]) ^ invmsk) & msk) ^
+					row[tmp];
+			for (j = 0; j < nroots; j++)
+				tmp = (((uint16_t) par[j]) & msk) ^ row[tmp];
+			syn[i] = tmp;
+		}
+		goto syndrome;
+	}
+
 	for (j = 1; j < len; j++) {
 		for (i = 0; i < nroots; i++) {
 			if (syn[i] == 0) {
@@ -75,6 +92,8 @@
 			}
 		}
 	}
+
+ syndrome:
 	s = syn;
 
 	/* Convert syndromes to index form, checking for nonzero condition */
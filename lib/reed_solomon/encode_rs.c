@@ -24,6 +24,8 @@
 	uint16_t *alpha_to = rs->alpha_to;
 	uint16_t *index_of = rs->index_of;
 	uint16_t *genpoly = rs->genpoly;
+	uint16_t *enc_tab = rs->enc_tab;
+	uint16_t *row;
 	uint16_t fb;
 	uint16_t msk = (uint16_t) rs->nn;
 
@@ -32,6 +34,19 @@
 	if (pad < 0 || pad >= nn)
 		return -ERANGE;
 
+	if (enc_tab) {
+		for (i = 0; i < len; i++) {
+			/* The row of the feedback symbol is the whole parity
+			 * update, shift included */
+			row = enc_tab + (((((uint16_t) data[i])^invmsk) & msk)
+					 ^ par[0]) * nroots;
+			for (j = 0; j < nroots - 1; j++)
+				par[j] = par[j + 1] ^ row[j];
+			par[nroots - 1] = row[nroots - 1];
+		}
+		return 0;
+	}
+
 	for (i = 0; i < len; i++) {
 		fb = index_of[((((uint16_t) data[i])^invmsk) & msk) ^ par[0]];
 		/* feedback term is non-zero */
@@ -46,11 +46,63 @@
 #include <linux/slab.h>
 #include <linux/mutex.h>
 
+/* Largest encoder / syndrome lookup table we build, in bytes */
+#define RS_TABLE_MAX	(32 * 1024)
+
 /* This list holds all currently allocated rs control structures */
 static LIST_HEAD (rslist);
 /* Protection for the list */
 static DEFINE_MUTEX(rslistlock);
 
+/**
+ * rs_init_tables - Build the lookup tables for table driven en/decoding
+ * @rs:		the rs control structure, with genpoly in index form
+ *
+ * enc_tab holds, for every value of the encoder feedback symbol, the
+ * shifted parity update, so that encoding costs one row lookup per data
+ * symbol instead of a log/antilog lookup per parity symbol.  syn_tab
+ * holds one multiply-by-root table per syndrome.  Codecs whose tables
+ * would be too large, or which can't be allocated, keep using the log
+ * tables.
+ */
+static void rs_init_tables(struct rs_control *rs)
+{
+	int nroots = rs->nroots;
+	int i, k, fb;
+	size_t size;
+
+	rs->enc_tab = NULL;
+	rs->syn_tab = NULL;
+
+	size = sizeof(uint16_t) * (rs->nn + 1) * nroots;
+	if (!nroots || size > RS_TABLE_MAX)
+		return;
+
+	rs->enc_tab = kmalloc(size, GFP_KERNEL);
+	if (rs->enc_tab) {
+		for (i = 0; i <= rs->nn; i++) {
+			fb = rs->index_of[i];
+			for (k = 0; k < nroots; k++) {
+				rs->enc_tab[i * nroots + k] = fb == rs->nn ? 0 :
+					rs->alpha_to[rs_modnn(rs, fb +
+						rs->genpoly[nroots - 1 - k])];
+			}
+		}
+	}
+
+	rs->syn_tab = kmalloc(size, GFP_KERNEL);
+	if (rs->syn_tab) {
+		for (k = 0; k < nroots; k++) {
+			for (i = 0; i <= rs->nn; i++) {
+				rs->syn_tab[k * (rs->nn + 1) + i] = !i ? 0 :
+					rs->alpha_to[rs_modnn(rs,
+						rs->index_of[i] +
+						(rs->fcr + k) * rs->prim)];
+			}
+		}
+	}
+}
+
 /**
  * rs_init - Initialize a Reed-Solomon codec
  * @symsize:	symbol size, bits (1-8)
@@ -148,6 +200,8 @@ static struct rs_control *rs_init(int symsize, int gfpoly, int (*gffunc)(int),
 	/* convert rs->genpoly[] to index form for quicker encoding */
 	for (i = 0; i <= nroots; i++)
 		rs->genpoly[i] = rs->index_of[rs->genpoly[i]];
+
+	rs_init_tables(rs);
 	return rs;
 
 	/* Error exit */
@@ -177,6 +231,8 @@ void free_rs(struct rs_control *rs)
 		kfree(rs->alpha_to);
 		kfree(rs->index_of);
 		kfree(rs->genpoly);
+		kfree(rs->enc_tab);
+		kfree(rs->syn_tab);
 		kfree(rs);
 	}
 	mutex_unlock(&rslistlock);
@@ -0,0 +1,307 @@
+/*
+ * Block-parallel .xz Stream decoder
+ *
+ * Multi-threaded encoders (xz -T) split the input into Blocks that are
+ * compressed independently and store the compressed and uncompressed
+ * sizes in every Block Header. That is enough to find all Blocks and
+ * their place in the output without decoding anything, so each Block
+ * can be given to its own single-call decoder on another CPU.
+ *
+ * This file has been put into the public domain.
+ * You can do whatever you want with this file.
+ */
+
+#include <linux/atomic.h>
+#include <linux/cpumask.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
+
+#include "xz_private.h"
+#include "xz_stream.h"
+
+/* Block Header Flags that must be set for a Block to be located */
+#define BLOCK_SIZES_PRESENT 0xC0
+
+struct xz_mt_block {
+	/* Offset and size of the whole Block, Padding and Check included */
+	size_t in_pos;
+	size_t in_size;
+
+	/* Block Header + Compressed Data + Check, as stored in the Index */
+	vli_type unpadded;
+
+	/* Where the uncompressed data goes */
+	size_t out_pos;
+	size_t out_size;
+};
+
+struct xz_mt {
+	const uint8_t *in;
+	uint8_t *out;
+	enum xz_check check;
+
+	struct xz_mt_block *blocks;
+	unsigned int nr_blocks;
+
+	/* Index of the next Block to decode */
+	atomic_t next;
+
+	/* XZ_STREAM_END, or the first error seen by any worker */
+	atomic_t ret;
+};
+
+struct xz_mt_worker {
+	struct work_struct work;
+	struct xz_mt *mt;
+};
+
+static bool xz_mt_vli(const uint8_t *in, size_t end, size_t *pos,
+		      vli_type *vli)
+{
+	uint32_t i;
+
+	*vli = 0;
+	for (i = 0; i < VLI_BYTES_MAX && *pos < end; ++i) {
+		uint8_t byte = in[(*pos)++];
+
+		*vli |= (vli_type)(byte & 0x7F) << (i * 7);
+		if (!(byte & 0x80))
+			return byte != 0 || i == 0;
+	}
+
+	return false;
+}
+
+static bool xz_mt_add_block(struct xz_mt *mt, unsigned int *alloc,
+			    const struct xz_mt_block *block)
+{
+	struct xz_mt_block *blocks;
+
+	if (mt->nr_blocks == *alloc) {
+		*alloc = *alloc ? *alloc * 2 : 16;
+		blocks = krealloc(mt->blocks, *alloc * sizeof(*blocks),
+				  GFP_KERNEL);
+		if (blocks == NULL)
+			return false;
+
+		mt->blocks = blocks;
+	}
+
+	mt->blocks[mt->nr_blocks++] = *block;
+	return true;
+}
+
+/*
+ * Walk the Block Headers, then check them against the Index and find the
+ * Stream Footer. Anything unexpected makes the Stream unsplittable; the
+ * regular decoder is left to diagnose real format errors.
+ */
+static enum xz_ret xz_mt_scan(struct xz_mt *mt, size_t in_size,
+			      size_t *in_used, size_t *out_size)
+{
+	const uint8_t *in = mt->in;
+	struct xz_mt_block block;
+	unsigned int alloc = 0;
+	unsigned int i;
+	size_t check_size;
+	size_t pos, end, index;
+	vli_type compressed, count, vli;
+	uint32_t header_size;
+	size_t total = 0;
+
+	if (in_size < 2 * STREAM_HEADER_SIZE
+			|| !memeq(in, HEADER_MAGIC, HEADER_MAGIC_SIZE)
+			|| xz_crc32(in + HEADER_MAGIC_SIZE, 2, 0)
+				!= get_unaligned_le32(in + HEADER_MAGIC_SIZE + 2)
+			|| in[HEADER_MAGIC_SIZE] != 0)
+		return XZ_OPTIONS_ERROR;
+
+	mt->check = in[HEADER_MAGIC_SIZE + 1];
+	if (mt->check == XZ_CHECK_NONE)
+		check_size = 0;
+	else if (mt->check == XZ_CHECK_CRC32)
+		check_size = 4;
+	else
+		return XZ_OPTIONS_ERROR;
+
+	pos = STREAM_HEADER_SIZE;
+	while (pos < in_size && in[pos] != 0) {
+		header_size = ((uint32_t)in[pos] + 1) * 4;
+		if (in_size - pos < header_size
+				|| xz_crc32(in + pos, header_size - 4, 0)
+				!= get_unaligned_le32(in + pos + header_size - 4))
+			return XZ_OPTIONS_ERROR;
+
+		if ((in[pos + 1] & BLOCK_SIZES_PRESENT) != BLOCK_SIZES_PRESENT)
+			return XZ_OPTIONS_ERROR;
+
+		end = pos + header_size - 4;
+		index = pos + 2;
+		if (!xz_mt_vli(in, end, &index, &compressed)
+				|| !xz_mt_vli(in, end, &index, &vli))
+			return XZ_OPTIONS_ERROR;
+
+		if (compressed == 0 || compressed > in_size
+				|| vli > SIZE_MAX - total)
+			return XZ_OPTIONS_ERROR;
+
+		block.in_pos = pos;
+		block.in_size = header_size + ALIGN(compressed, 4) + check_size;
+		block.unpadded = header_size + compressed + check_size;
+		block.out_pos = total;
+		block.out_size = vli;
+		if (in_size - pos < block.in_size)
+			return XZ_OPTIONS_ERROR;
+
+		if (!xz_mt_add_block(mt, &alloc, &block))
+			return XZ_MEM_ERROR;
+
+		pos += block.in_size;
+		total += vli;
+	}
+
+	if (pos >= in_size || mt->nr_blocks < 2)
+		return XZ_OPTIONS_ERROR;
+
+	/* Index: Indicator, Number of Records, Records, Padding, CRC32 */
+	index = pos++;
+	if (!xz_mt_vli(in, in_size, &pos, &count) || count != mt->nr_blocks)
+		return XZ_OPTIONS_ERROR;
+
+	for (i = 0; i < mt->nr_blocks; ++i) {
+		if (!xz_mt_vli(in, in_size, &pos, &vli)
+				|| vli != mt->blocks[i].unpadded
+				|| !xz_mt_vli(in, in_size, &pos, &vli)
+				|| vli != mt->blocks[i].out_size)
+			return XZ_OPTIONS_ERROR;
+	}
+
+	while ((pos - index) & 3) {
+		if (pos == in_size || in[pos++] != 0)
+			return XZ_OPTIONS_ERROR;
+	}
+
+	if (in_size - pos < 4 + STREAM_HEADER_SIZE
+			|| xz_crc32(in + index, pos - index, 0)
+				!= get_unaligned_le32(in + pos))
+		return XZ_OPTIONS_ERROR;
+
+	/* Stream Footer: CRC32, Backward Size, Stream Flags, magic */
+	pos += 4;
+	if (!memeq(in + pos + 10, FOOTER_MAGIC, FOOTER_MAGIC_SIZE)
+			|| xz_crc32(in + pos + 4, 6, 0)
+				!= get_unaligned_le32(in + pos)
+			|| ((size_t)get_unaligned_le32(in + pos + 4) + 1) * 4
+				!= pos - index
+			|| !memeq(in + pos + 8, in + HEADER_MAGIC_SIZE, 2))
+		return XZ_OPTIONS_ERROR;
+
+	*in_used = pos + STREAM_HEADER_SIZE;
+	*out_size = total;
+	return XZ_STREAM_END;
+}
+
+static void xz_mt_decode(struct xz_mt *mt)
+{
+	struct xz_mt_block *block;
+	struct xz_dec *s;
+	struct xz_buf b;
+	enum xz_ret ret;
+	unsigned int i;
+
+	s = xz_dec_init(XZ_SINGLE, 0);
+	if (s == NULL) {
+		atomic_cmpxchg(&mt->ret, XZ_STREAM_END, XZ_MEM_ERROR);
+		return;
+	}
+
+	while ((i = atomic_inc_return(&mt->next) - 1) < mt->nr_blocks) {
+		if (atomic_read(&mt->ret) != XZ_STREAM_END)
+			break;
+
+		block = &mt->blocks[i];
+		b.in = mt->in + block->in_pos;
+		b.in_pos = 0;
+		b.in_size = block->in_size;
+		b.out = mt->out + block->out_pos;
+		b.out_pos = 0;
+		b.out_size = block->out_size;
+
+		ret = xz_dec_block_run(s, &b, mt->check);
+		if (ret == XZ_STREAM_END && (b.in_pos != b.in_size
+				|| b.out_pos != b.out_size))
+			ret = XZ_DATA_ERROR;
+
+		if (ret != XZ_STREAM_END) {
+			atomic_cmpxchg(&mt->ret, XZ_STREAM_END, ret);
+			break;
+		}
+
+		cond_resched();
+	}
+
+	xz_dec_end(s);
+}
+
+static void xz_mt_work(struct work_struct *work)
+{
+	struct xz_mt_worker *w = container_of(work, struct xz_mt_worker, work);
+
+	xz_mt_decode(w->mt);
+}
+
+enum xz_ret xz_dec_mt(const uint8_t *in, size_t in_size, uint8_t *out,
+		      size_t *in_used, size_t *out_size)
+{
+	struct xz_mt_worker *workers = NULL;
+	unsigned int nr_workers, i;
+	struct xz_mt mt = {
+		.in = in,
+		.out = out,
+		.next = ATOMIC_INIT(0),
+		.ret = ATOMIC_INIT(XZ_STREAM_END),
+	};
+	size_t used, total;
+	enum xz_ret ret;
+
+	ret = xz_mt_scan(&mt, in_size, &used, &total);
+	if (ret != XZ_STREAM_END)
+		goto out;
+
+	if (out == NULL || *out_size < total) {
+		*out_size = total;
+		ret = XZ_BUF_ERROR;
+		goto out;
+	}
+
+	/* The caller decodes too, so one CPU needs no worker */
+	nr_workers = min(num_online_cpus(), mt.nr_blocks) - 1;
+	if (nr_workers > 0)
+		workers = kmalloc_array(nr_workers, sizeof(*workers),
+					GFP_KERNEL);
+	if (workers == NULL)
+		nr_workers = 0;
+
+	for (i = 0; i < nr_workers; ++i) {
+		workers[i].mt = &mt;
+		INIT_WORK(&workers[i].work, xz_mt_work);
+		queue_work(system_unbound_wq, &workers[i].work);
+	}
+
+	xz_mt_decode(&mt);
+
+	for (i = 0; i < nr_workers; ++i)
+		flush_work(&workers[i].work);
+
+	kfree(workers);
+
+	ret = atomic_read(&mt.ret);
+	if (ret == XZ_STREAM_END) {
+		*in_used = used;
+		*out_size = total;
+	}
+
+out:
+	kfree(mt.blocks);
+	return ret;
+}
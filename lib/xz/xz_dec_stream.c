@@ -57,6 +57,9 @@ struct xz_dec {
 	 */
 	bool allow_buf_error;
 
+	/* True if only one Block is decoded, see xz_dec_block_run() */
+	bool single_block;
+
 	/* Information stored in Block Header */
 	struct {
 		/*
@@ -590,6 +593,9 @@ static enum xz_ret dec_main(struct xz_dec *s, struct xz_buf *b)
 
 			/* See if this is the beginning of the Index field. */
 			if (b->in[b->in_pos] == 0) {
+				if (s->single_block)
+					return XZ_DATA_ERROR;
+
 				s->in_start = b->in_pos++;
 				s->sequence = SEQ_INDEX;
 				break;
@@ -655,6 +661,9 @@ static enum xz_ret dec_main(struct xz_dec *s, struct xz_buf *b)
 			}
 #endif
 
+			if (s->single_block)
+				return XZ_STREAM_END;
+
 			s->sequence = SEQ_BLOCK_START;
 			break;
 
@@ -767,6 +776,45 @@ XZ_EXTERN enum xz_ret xz_dec_run(struct xz_dec *s, struct xz_buf *b)
 	return ret;
 }
 
+#ifndef XZ_PREBOOT
+/*
+ * Decode a single Block in single-call mode. b->in must start at the Block
+ * Header and b->out receives only this Block's uncompressed data, so the
+ * Blocks of a Stream can be handed to different decoders (see xz_dec_mt.c).
+ * The Stream Header has been validated by the caller, which passes the
+ * Check ID from its Stream Flags.
+ */
+XZ_EXTERN enum xz_ret xz_dec_block_run(struct xz_dec *s, struct xz_buf *b,
+				       enum xz_check check)
+{
+	size_t in_start;
+	size_t out_start;
+	enum xz_ret ret;
+
+	if (!DEC_IS_SINGLE(s->mode))
+		return XZ_OPTIONS_ERROR;
+
+	xz_dec_reset(s);
+	s->sequence = SEQ_BLOCK_START;
+	s->check_type = check;
+	s->single_block = true;
+
+	in_start = b->in_pos;
+	out_start = b->out_pos;
+	ret = dec_main(s, b);
+
+	if (ret == XZ_OK)
+		ret = b->in_pos == b->in_size ? XZ_DATA_ERROR : XZ_BUF_ERROR;
+
+	if (ret != XZ_STREAM_END) {
+		b->in_pos = in_start;
+		b->out_pos = out_start;
+	}
+
+	return ret;
+}
+#endif
+
 XZ_EXTERN struct xz_dec *xz_dec_init(enum xz_mode mode, uint32_t dict_max)
 {
 	struct xz_dec *s = kmalloc(sizeof(*s), GFP_KERNEL);
@@ -801,6 +849,7 @@ XZ_EXTERN void xz_dec_reset(struct xz_dec *s)
 {
 	s->sequence = SEQ_STREAM_HEADER;
 	s->allow_buf_error = false;
+	s->single_block = false;
 	s->pos = 0;
 	s->crc32 = 0;
 	memzero(&s->block, sizeof(s->block));
@@ -14,6 +14,7 @@ EXPORT_SYMBOL(xz_dec_init);
 EXPORT_SYMBOL(xz_dec_reset);
 EXPORT_SYMBOL(xz_dec_run);
 EXPORT_SYMBOL(xz_dec_end);
+EXPORT_SYMBOL(xz_dec_mt);
 
 MODULE_DESCRIPTION("XZ decompressor");
 MODULE_VERSION("1.0");
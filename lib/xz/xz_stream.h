@@ -59,4 +59,10 @@ enum xz_check {
 /* Maximum possible Check ID */
 #define XZ_CHECK_MAX 15
 
+#ifndef XZ_PREBOOT
+/* Decode one Block in single-call mode; used by the multi-threaded decoder */
+XZ_EXTERN enum xz_ret xz_dec_block_run(struct xz_dec *s, struct xz_buf *b,
+				       enum xz_check check);
+#endif
+
 #endif
@@ -23,11 +23,14 @@
 #include <linux/mm.h>
 #include <linux/percpu.h>
 #include <linux/printk.h>
+#include <linux/sched.h>
+#include <linux/sched/clock.h>
 #include <linux/shrinker.h>
 #include <linux/slab.h>
 #include <linux/srcu.h>
 #include <linux/string.h>
 #include <linux/types.h>
+#include <linux/workqueue.h>
 
 #include "../slab.h"
 #include "kasan.h"
@@ -122,6 +125,18 @@ static unsigned long quarantine_batch_size;
  */
 #define QUARANTINE_FRACTION 32
 
+/*
+ * Objects are freed from the global queue QUARANTINE_REDUCE_CHUNK at a
+ * time, so neither quarantine_lock nor the srcu read section is held for
+ * long.  A single run of the reduce worker spends at most
+ * QUARANTINE_REDUCE_NSEC freeing before it requeues itself.
+ */
+#define QUARANTINE_REDUCE_CHUNK 64
+#define QUARANTINE_REDUCE_NSEC (200 * NSEC_PER_USEC)
+
+static void quarantine_reduce_workfn(struct work_struct *work);
+static DECLARE_WORK(quarantine_reduce_work, quarantine_reduce_workfn);
+
 static struct kmem_cache *qlink_to_cache(struct qlist_node *qlink)
 {
 	return virt_to_head_page(qlink)->slab_cache;
@@ -169,6 +184,23 @@ static void qlist_free_all(struct qlist_head *q, struct kmem_cache *cache)
 	qlist_init(q);
 }
 
+/* Move up to @nr objects from the front of @from to @to. */
+static void qlist_move_chunk(struct qlist_head *from, struct qlist_head *to,
+		int nr)
+{
+	while (!qlist_empty(from) && nr--) {
+		struct qlist_node *qlink = from->head;
+		size_t size = qlink_to_cache(qlink)->size;
+
+		from->head = qlink->next;
+		from->bytes -= size;
+		qlist_put(to, qlink, size);
+	}
+
+	if (qlist_empty(from))
+		qlist_init(from);
+}
+
 void quarantine_put(struct kasan_free_meta *info, struct kmem_cache *cache)
 {
 	unsigned long flags;
@@ -209,16 +241,17 @@ void quarantine_put(struct kasan_free_meta *info, struct kmem_cache *cache)
 	local_irq_restore(flags);
 }
 
-void quarantine_reduce(void)
+/*
+ * Free one chunk from the oldest batch.  Returns false if the global
+ * quarantine had nothing left to free.
+ */
+static bool quarantine_reduce_chunk(void)
 {
-	size_t total_size, new_quarantine_size, percpu_quarantines;
+	struct qlist_head to_free = QLIST_INIT;
+	struct qlist_head *q;
 	unsigned long flags;
+	bool progress;
 	int srcu_idx;
-	struct qlist_head to_free = QLIST_INIT;
-
-	if (likely(READ_ONCE(quarantine_size) <=
-		   READ_ONCE(quarantine_max_size)))
-		return;
 
 	/*
 	 * srcu critical section ensures that quarantine_remove_cache()
@@ -232,10 +265,34 @@ void quarantine_reduce(void)
 	srcu_idx = srcu_read_lock(&remove_cache_srcu);
 	spin_lock_irqsave(&quarantine_lock, flags);
 
-	/*
-	 * Update quarantine size in case of hotplug. Allocate a fraction of
-	 * the installed memory to quarantine minus per-cpu queue limits.
-	 */
+	q = &global_quarantine[quarantine_head];
+	qlist_move_chunk(q, &to_free, QUARANTINE_REDUCE_CHUNK);
+	WRITE_ONCE(quarantine_size, quarantine_size - to_free.bytes);
+	progress = !qlist_empty(&to_free);
+
+	if (qlist_empty(q) && quarantine_head != quarantine_tail) {
+		quarantine_head++;
+		if (quarantine_head == QUARANTINE_BATCHES)
+			quarantine_head = 0;
+		progress = true;
+	}
+
+	spin_unlock_irqrestore(&quarantine_lock, flags);
+
+	qlist_free_all(&to_free, NULL);
+	srcu_read_unlock(&remove_cache_srcu, srcu_idx);
+
+	return progress;
+}
+
+/*
+ * Update quarantine size in case of hotplug. Allocate a fraction of
+ * the installed memory to quarantine minus per-cpu queue limits.
+ */
+static void quarantine_update_limits(void)
+{
+	size_t total_size, new_quarantine_size, percpu_quarantines;
+
 	total_size = (READ_ONCE(totalram_pages) << PAGE_SHIFT) /
 		QUARANTINE_FRACTION;
 	percpu_quarantines = QUARANTINE_PERCPU_SIZE * num_online_cpus();
@@ -245,19 +302,69 @@ void quarantine_reduce(void)
 	/* Aim at consuming at most 1/2 of slots in quarantine. */
 	WRITE_ONCE(quarantine_batch_size, max((size_t)QUARANTINE_PERCPU_SIZE,
 		2 * total_size / QUARANTINE_BATCHES));
+}
 
-	if (likely(quarantine_size > quarantine_max_size)) {
-		qlist_move_all(&global_quarantine[quarantine_head], &to_free);
-		WRITE_ONCE(quarantine_size, quarantine_size - to_free.bytes);
-		quarantine_head++;
-		if (quarantine_head == QUARANTINE_BATCHES)
-			quarantine_head = 0;
+static void quarantine_reduce_workfn(struct work_struct *work)
+{
+	u64 deadline = local_clock() + QUARANTINE_REDUCE_NSEC;
+	unsigned long max_size, batch_size, target;
+
+	quarantine_update_limits();
+	max_size = READ_ONCE(quarantine_max_size);
+	batch_size = READ_ONCE(quarantine_batch_size);
+
+	/*
+	 * Go a batch below the limit so that the worker isn't kicked again
+	 * by the very next allocation.
+	 */
+	target = max_size > batch_size ? max_size - batch_size : 0;
+
+	while (READ_ONCE(quarantine_size) > target) {
+		if (!quarantine_reduce_chunk())
+			return;
+
+		if (local_clock() > deadline) {
+			/* let other work items run, then carry on */
+			queue_work(system_wq, work);
+			return;
+		}
+		cond_resched();
 	}
+}
 
-	spin_unlock_irqrestore(&quarantine_lock, flags);
+/*
+ * Called from allocations that may block.  The actual freeing is done by
+ * quarantine_reduce_work on this CPU, in bounded steps, so the allocating
+ * task doesn't stall behind a whole batch of frees.
+ */
+void quarantine_reduce(void)
+{
+	unsigned long size = READ_ONCE(quarantine_size);
+	unsigned long max_size = READ_ONCE(quarantine_max_size);
 
-	qlist_free_all(&to_free, NULL);
-	srcu_read_unlock(&remove_cache_srcu, srcu_idx);
+	if (likely(size <= max_size))
+		return;
+
+	/* limits are first set up here, before the worker ever ran */
+	if (unlikely(!max_size)) {
+		quarantine_update_limits();
+		max_size = READ_ONCE(quarantine_max_size);
+		if (size <= max_size)
+			return;
+	}
+
+	/* system_wq doesn't exist yet during early boot */
+	if (likely(system_wq))
+		queue_work(system_wq, &quarantine_reduce_work);
+
+	/*
+	 * Once the worker has fallen more than a batch behind, help with a
+	 * single chunk so the quarantine cannot grow without bound.
+	 */
+	if (unlikely(!system_wq || size - max_size >
+		     max(READ_ONCE(quarantine_batch_size),
+			 (unsigned long)QUARANTINE_PERCPU_SIZE)))
+		quarantine_reduce_chunk();
 }
 
 static void qlist_move_cache(struct qlist_head *from,
@@ -188,7 +188,8 @@ static void kcm_rfree(struct sk_buff *skb)
 	}
 }
 
-static int kcm_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
+/* Queue a message without waking the reader */
+static int __kcm_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 {
 	struct sk_buff_head *list = &sk->sk_receive_queue;
 
@@ -208,10 +209,17 @@ static int kcm_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 
 	skb_queue_tail(list, skb);
 
-	if (!sock_flag(sk, SOCK_DEAD))
+	return 0;
+}
+
+static int kcm_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
+{
+	int err = __kcm_queue_rcv_skb(sk, skb);
+
+	if (!err && !sock_flag(sk, SOCK_DEAD))
 		sk->sk_data_ready(sk);
 
-	return 0;
+	return err;
 }
 
 /* Requeue received messages for a kcm socket to other kcm sockets. This is
@@ -309,6 +317,13 @@ static void unreserve_rx_kcm(struct kcm_psock *psock,
 	if (!kcm)
 		return;
 
+	/* One wakeup for all the messages queued while reserved */
+	if (psock->rx_wake) {
+		psock->rx_wake = false;
+		if (!sock_flag(&kcm->sk, SOCK_DEAD))
+			kcm->sk.sk_data_ready(&kcm->sk);
+	}
+
 	spin_lock_bh(&mux->rx_lock);
 
 	psock->rx_kcm = NULL;
@@ -370,11 +385,16 @@ try_queue:
 		return;
 	}
 
-	if (kcm_queue_rcv_skb(&kcm->sk, skb)) {
+	/* The reader is woken when the reservation is dropped, at the
+	 * latest once strparser has consumed the whole read_sock batch.
+	 */
+	if (__kcm_queue_rcv_skb(&kcm->sk, skb)) {
 		/* Should mean socket buffer full */
 		unreserve_rx_kcm(psock, false);
 		goto try_queue;
 	}
+
+	psock->rx_wake = true;
 }
 
 static int kcm_parse_func_strparser(struct strparser *strp, struct sk_buff *skb)
@@ -173,7 +173,8 @@ struct sw_flow_key_range {
 struct sw_flow_mask {
 	int ref_count;
 	struct rcu_head rcu;
-	struct list_head list;
+	u64 __percpu *usage;	/* Packets that hit this mask. */
+	u64 usage_last;		/* 'usage' at the last rebalance. */
 	struct sw_flow_key_range range;
 	struct sw_flow_key key;
 };
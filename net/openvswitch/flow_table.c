@@ -42,11 +42,13 @@
 #include <linux/icmp.h>
 #include <linux/icmpv6.h>
 #include <linux/rculist.h>
+#include <linux/sort.h>
 #include <net/ip.h>
 #include <net/ipv6.h>
 #include <net/ndisc.h>
 
 #define TBL_MIN_BUCKETS		1024
+#define MASK_ARRAY_SIZE_MIN	16
 #define REHASH_INTERVAL		(10 * 60 * HZ)
 
 static struct kmem_cache *flow_cache;
@@ -201,14 +203,67 @@ static struct table_instance *table_instance_alloc(int new_size)
 	return ti;
 }
 
+static struct mask_array *tbl_mask_array_alloc(int size)
+{
+	struct mask_array *new;
+
+	size = max(MASK_ARRAY_SIZE_MIN, size);
+	new = kzalloc(sizeof(struct mask_array) +
+		      sizeof(struct sw_flow_mask *) * size, GFP_KERNEL);
+	if (!new)
+		return NULL;
+
+	new->count = 0;
+	new->max = size;
+
+	return new;
+}
+
+static int tbl_mask_array_realloc(struct flow_table *tbl, int size)
+{
+	struct mask_array *old;
+	struct mask_array *new;
+
+	new = tbl_mask_array_alloc(size);
+	if (!new)
+		return -ENOMEM;
+
+	old = ovsl_dereference(tbl->mask_array);
+	if (old) {
+		int i;
+
+		for (i = 0; i < old->count; i++)
+			RCU_INIT_POINTER(new->masks[i],
+					 ovsl_dereference(old->masks[i]));
+		new->count = old->count;
+	}
+
+	rcu_assign_pointer(tbl->mask_array, new);
+	if (old)
+		kfree_rcu(old, rcu);
+
+	return 0;
+}
+
 int ovs_flow_tbl_init(struct flow_table *table)
 {
 	struct table_instance *ti, *ufid_ti;
+	struct mask_array *ma;
+
+	table->mask_cache = __alloc_percpu(sizeof(struct mask_cache_entry) *
+					   MC_HASH_ENTRIES,
+					   __alignof__(struct mask_cache_entry));
+	if (!table->mask_cache)
+		return -ENOMEM;
+
+	ma = tbl_mask_array_alloc(MASK_ARRAY_SIZE_MIN);
+	if (!ma)
+		goto free_mask_cache;
 
 	ti = table_instance_alloc(TBL_MIN_BUCKETS);
 
 	if (!ti)
-		return -ENOMEM;
+		goto free_mask_array;
 
 	ufid_ti = table_instance_alloc(TBL_MIN_BUCKETS);
 	if (!ufid_ti)
@@ -216,7 +271,7 @@ int ovs_flow_tbl_init(struct flow_table *table)
 
 	rcu_assign_pointer(table->ti, ti);
 	rcu_assign_pointer(table->ufid_ti, ufid_ti);
-	INIT_LIST_HEAD(&table->mask_list);
+	rcu_assign_pointer(table->mask_array, ma);
 	table->last_rehash = jiffies;
 	table->count = 0;
 	table->ufid_count = 0;
@@ -224,6 +279,10 @@ int ovs_flow_tbl_init(struct flow_table *table)
 
 free_ti:
 	__table_instance_destroy(ti);
+free_mask_array:
+	kfree(ma);
+free_mask_cache:
+	free_percpu(table->mask_cache);
 	return -ENOMEM;
 }
 
@@ -279,8 +338,19 @@ void ovs_flow_tbl_destroy(struct flow_table *table)
 {
 	struct table_instance *ti = rcu_dereference_raw(table->ti);
 	struct table_instance *ufid_ti = rcu_dereference_raw(table->ufid_ti);
+	struct mask_array *ma = rcu_dereference_raw(table->mask_array);
+	struct sw_flow_mask *mask;
+	int i;
 
 	table_instance_destroy(ti, ufid_ti, false);
+
+	for (i = 0; i < ma->count; i++) {
+		mask = rcu_dereference_raw(ma->masks[i]);
+		free_percpu(mask->usage);
+		kfree(mask);
+	}
+	kfree(ma);
+	free_percpu(table->mask_cache);
 }
 
 struct sw_flow *ovs_flow_tbl_dump_next(struct table_instance *ti,
@@ -465,13 +535,15 @@ static bool ovs_flow_cmp_unmasked_key(const struct sw_flow *flow,
 
 static struct sw_flow *masked_flow_lookup(struct table_instance *ti,
 					  const struct sw_flow_key *unmasked,
-					  const struct sw_flow_mask *mask)
+					  const struct sw_flow_mask *mask,
+					  u32 *n_mask_hit)
 {
 	struct sw_flow *flow;
 	struct hlist_head *head;
 	u32 hash;
 	struct sw_flow_key masked_key;
 
+	(*n_mask_hit)++;
 	ovs_flow_mask_key(&masked_key, unmasked, false, mask);
 	hash = flow_hash(&masked_key, &mask->range);
 	head = find_bucket(ti, hash);
@@ -483,42 +555,136 @@ static struct sw_flow *masked_flow_lookup(struct table_instance *ti,
 	return NULL;
 }
 
+/* Try the mask at '*index' first, then all the others in array order.
+ * On a hit '*index' is updated to the mask that matched.
+ */
+static struct sw_flow *flow_lookup(struct table_instance *ti,
+				   const struct mask_array *ma,
+				   const struct sw_flow_key *key,
+				   u32 *n_mask_hit, u32 *index)
+{
+	struct sw_flow_mask *mask;
+	struct sw_flow *flow;
+	int i;
+
+	if (likely(*index < ma->max)) {
+		mask = rcu_dereference_ovsl(ma->masks[*index]);
+		if (mask) {
+			flow = masked_flow_lookup(ti, key, mask, n_mask_hit);
+			if (flow)
+				return flow;
+		}
+	}
+
+	for (i = 0; i < ma->max; i++) {
+		if (i == *index)
+			continue;
+
+		mask = rcu_dereference_ovsl(ma->masks[i]);
+		if (unlikely(!mask))
+			break;
+
+		flow = masked_flow_lookup(ti, key, mask, n_mask_hit);
+		if (flow) { /* Found */
+			*index = i;
+			return flow;
+		}
+	}
+
+	return NULL;
+}
+
+/* A packet usually hits the same mask as the previous packet of its
+ * connection, so the per-CPU mask cache remembers the mask index of
+ * recently seen skb hashes and that mask is tried first.  A hash may live
+ * in any of MC_HASH_SEGS slots; on a miss the slot with the smallest hash
+ * is replaced.  A zero skb_hash means there is no hash to go by.
+ */
 struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
 				    const struct sw_flow_key *key,
+				    u32 skb_hash,
 				    u32 *n_mask_hit)
 {
+	struct mask_array *ma = rcu_dereference_ovsl(tbl->mask_array);
 	struct table_instance *ti = rcu_dereference_ovsl(tbl->ti);
-	struct sw_flow_mask *mask;
+	struct mask_cache_entry *entries, *ce;
 	struct sw_flow *flow;
+	u32 hash, mask_index = 0;
+	int seg;
 
 	*n_mask_hit = 0;
-	list_for_each_entry_rcu(mask, &tbl->mask_list, list) {
-		(*n_mask_hit)++;
-		flow = masked_flow_lookup(ti, key, mask);
-		if (flow)  /* Found */
-			return flow;
+	if (unlikely(!skb_hash)) {
+		flow = flow_lookup(ti, ma, key, n_mask_hit, &mask_index);
+		goto out;
 	}
-	return NULL;
+
+	/* Pre and post recirculation flows usually have the same skb_hash
+	 * value.  To avoid hash collisions, rehash the 'skb_hash' with
+	 * 'recirc_id'.
+	 */
+	if (key->recirc_id)
+		skb_hash = jhash_1word(skb_hash, key->recirc_id);
+
+	ce = NULL;
+	hash = skb_hash;
+	entries = this_cpu_ptr(tbl->mask_cache);
+
+	/* Find the cache entry 'ce' to operate on. */
+	for (seg = 0; seg < MC_HASH_SEGS; seg++) {
+		int index = hash & (MC_HASH_ENTRIES - 1);
+		struct mask_cache_entry *e;
+
+		e = &entries[index];
+		if (e->skb_hash == skb_hash) {
+			flow = flow_lookup(ti, ma, key, n_mask_hit,
+					   &e->mask_index);
+			if (!flow)
+				e->skb_hash = 0;
+			goto out;
+		}
+
+		if (!ce || e->skb_hash < ce->skb_hash)
+			ce = e;  /* A better replacement cache candidate. */
+
+		hash >>= MC_HASH_SHIFT;
+	}
+
+	/* Cache miss, do full lookup. */
+	flow = flow_lookup(ti, ma, key, n_mask_hit, &ce->mask_index);
+	if (flow)
+		ce->skb_hash = skb_hash;
+
+out:
+	if (flow)
+		this_cpu_inc(*flow->mask->usage);
+	return flow;
 }
 
 struct sw_flow *ovs_flow_tbl_lookup(struct flow_table *tbl,
 				    const struct sw_flow_key *key)
 {
-	u32 __always_unused n_mask_hit;
+	struct table_instance *ti = rcu_dereference_ovsl(tbl->ti);
+	struct mask_array *ma = rcu_dereference_ovsl(tbl->mask_array);
+	u32 n_mask_hit = 0;
+	u32 index = 0;
 
-	return ovs_flow_tbl_lookup_stats(tbl, key, &n_mask_hit);
+	return flow_lookup(ti, ma, key, &n_mask_hit, &index);
 }
 
 struct sw_flow *ovs_flow_tbl_lookup_exact(struct flow_table *tbl,
 					  const struct sw_flow_match *match)
 {
 	struct table_instance *ti = rcu_dereference_ovsl(tbl->ti);
+	struct mask_array *ma = ovsl_dereference(tbl->mask_array);
+	u32 n_mask_hit = 0;
 	struct sw_flow_mask *mask;
 	struct sw_flow *flow;
+	int i;
 
 	/* Always called under ovs-mutex. */
-	list_for_each_entry(mask, &tbl->mask_list, list) {
-		flow = masked_flow_lookup(ti, match->key, mask);
+	for (i = 0; i < ma->count; i++) {
+		mask = ovsl_dereference(ma->masks[i]);
+		flow = masked_flow_lookup(ti, match->key, mask, &n_mask_hit);
 		if (flow && ovs_identifier_is_key(&flow->id) &&
 		    ovs_flow_cmp_unmasked_key(flow, match))
 			return flow;
@@ -568,13 +734,9 @@ struct sw_flow *ovs_flow_tbl_lookup_ufid(struct flow_table *tbl,
 
 int ovs_flow_tbl_num_masks(const struct flow_table *table)
 {
-	struct sw_flow_mask *mask;
-	int num = 0;
+	struct mask_array *ma = rcu_dereference_ovsl(table->mask_array);
 
-	list_for_each_entry(mask, &table->mask_list, list)
-		num++;
-
-	return num;
+	return READ_ONCE(ma->count);
 }
 
 static struct table_instance *table_instance_expand(struct table_instance *ti,
@@ -583,21 +745,55 @@ static struct table_instance *table_instance_expand(struct table_instance *ti,
 	return table_instance_rehash(ti, ti->n_buckets * 2, ufid);
 }
 
-/* Remove 'mask' from the mask list, if it is not needed any more. */
+static void mask_free_rcu(struct rcu_head *rcu)
+{
+	struct sw_flow_mask *mask = container_of(rcu, struct sw_flow_mask, rcu);
+
+	free_percpu(mask->usage);
+	kfree(mask);
+}
+
+/* Take 'mask' out of the mask array, filling its slot with the last mask
+ * so that the array stays dense.  Lookups that race with the move may
+ * miss the moved mask once, which just costs them an upcall.
+ */
+static void tbl_mask_array_del_mask(struct flow_table *tbl,
+				    struct sw_flow_mask *mask)
+{
+	struct mask_array *ma = ovsl_dereference(tbl->mask_array);
+	int i, last;
+
+	for (i = 0; i < ma->count; i++)
+		if (mask == ovsl_dereference(ma->masks[i]))
+			break;
+	BUG_ON(i == ma->count);
+
+	last = ma->count - 1;
+	rcu_assign_pointer(ma->masks[i], ovsl_dereference(ma->masks[last]));
+	RCU_INIT_POINTER(ma->masks[last], NULL);
+	WRITE_ONCE(ma->count, last);
+
+	call_rcu(&mask->rcu, mask_free_rcu);
+
+	/* Shrink the mask array if necessary. */
+	if (ma->max >= (MASK_ARRAY_SIZE_MIN * 2) &&
+	    ma->count <= (ma->max / 3))
+		tbl_mask_array_realloc(tbl, ma->max / 2);
+}
+
+/* Remove 'mask' from the mask array, if it is not needed any more. */
 static void flow_mask_remove(struct flow_table *tbl, struct sw_flow_mask *mask)
 {
 	if (mask) {
 		/* ovs-lock is required to protect mask-refcount and
-		 * mask list.
+		 * mask array.
 		 */
 		ASSERT_OVSL();
 		BUG_ON(!mask->ref_count);
 		mask->ref_count--;
 
-		if (!mask->ref_count) {
-			list_del_rcu(&mask->list);
-			kfree_rcu(mask, rcu);
-		}
+		if (!mask->ref_count)
+			tbl_mask_array_del_mask(tbl, mask);
 	}
 }
 
@@ -626,8 +822,16 @@ static struct sw_flow_mask *mask_alloc(void)
 	struct sw_flow_mask *mask;
 
 	mask = kmalloc(sizeof(*mask), GFP_KERNEL);
-	if (mask)
-		mask->ref_count = 1;
+	if (!mask)
+		return NULL;
+
+	mask->usage = alloc_percpu(u64);
+	if (!mask->usage) {
+		kfree(mask);
+		return NULL;
+	}
+	mask->usage_last = 0;
+	mask->ref_count = 1;
 
 	return mask;
 }
@@ -646,11 +850,12 @@ static bool mask_equal(const struct sw_flow_mask *a,
 static struct sw_flow_mask *flow_mask_find(const struct flow_table *tbl,
 					   const struct sw_flow_mask *mask)
 {
-	struct list_head *ml;
+	struct mask_array *ma = ovsl_dereference(tbl->mask_array);
+	struct sw_flow_mask *m;
+	int i;
 
-	list_for_each(ml, &tbl->mask_list) {
-		struct sw_flow_mask *m;
-		m = container_of(ml, struct sw_flow_mask, list);
+	for (i = 0; i < ma->count; i++) {
+		m = ovsl_dereference(ma->masks[i]);
 		if (mask_equal(mask, m))
 			return m;
 	}
@@ -658,11 +863,13 @@ static struct sw_flow_mask *flow_mask_find(const struct flow_table *tbl,
 	return NULL;
 }
 
-/* Add 'mask' into the mask list, if it is not already there. */
+/* Add 'mask' into the mask array, if it is not already there. */
 static int flow_mask_insert(struct flow_table *tbl, struct sw_flow *flow,
 			    const struct sw_flow_mask *new)
 {
 	struct sw_flow_mask *mask;
+	struct mask_array *ma;
+
 	mask = flow_mask_find(tbl, new);
 	if (!mask) {
 		/* Allocate a new mask if none exsits. */
@@ -671,7 +878,20 @@ static int flow_mask_insert(struct flow_table *tbl, struct sw_flow *flow,
 			return -ENOMEM;
 		mask->key = new->key;
 		mask->range = new->range;
-		list_add_rcu(&mask->list, &tbl->mask_list);
+
+		/* Add mask to mask-array. */
+		ma = ovsl_dereference(tbl->mask_array);
+		if (ma->count >= ma->max) {
+			if (tbl_mask_array_realloc(tbl, ma->max * 2)) {
+				free_percpu(mask->usage);
+				kfree(mask);
+				return -ENOMEM;
+			}
+			ma = ovsl_dereference(tbl->mask_array);
+		}
+
+		rcu_assign_pointer(ma->masks[ma->count], mask);
+		WRITE_ONCE(ma->count, ma->count + 1);
 	} else {
 		BUG_ON(!mask->ref_count);
 		mask->ref_count++;
@@ -743,6 +963,86 @@ int ovs_flow_tbl_insert(struct flow_table *table, struct sw_flow *flow,
 	return 0;
 }
 
+struct mask_count {
+	int index;
+	u64 counter;
+};
+
+static int compare_mask_and_count(const void *a, const void *b)
+{
+	const struct mask_count *mc_a = a;
+	const struct mask_count *mc_b = b;
+
+	if (mc_a->counter != mc_b->counter)
+		return mc_a->counter < mc_b->counter ? 1 : -1;
+
+	/* Keep the current order between equally used masks. */
+	return mc_a->index - mc_b->index;
+}
+
+/* Must be called with OVS mutex held.
+ *
+ * Reorder the mask array so that the masks that matched the most packets
+ * since the last call are probed first.  A new array is published, so
+ * concurrent lookups see either the old order or the new one.
+ */
+void ovs_flow_masks_rebalance(struct flow_table *table)
+{
+	struct mask_array *ma = ovsl_dereference(table->mask_array);
+	struct mask_count *masks_and_count;
+	struct sw_flow_mask *mask;
+	struct mask_array *new;
+	bool sorted = true;
+	int i, cpu;
+	u64 total;
+
+	if (ma->count < 2)
+		return;
+
+	masks_and_count = kmalloc_array(ma->count, sizeof(*masks_and_count),
+					GFP_KERNEL);
+	if (!masks_and_count)
+		return;
+
+	for (i = 0; i < ma->count; i++) {
+		mask = ovsl_dereference(ma->masks[i]);
+
+		total = 0;
+		for_each_possible_cpu(cpu)
+			total += *per_cpu_ptr(mask->usage, cpu);
+
+		masks_and_count[i].index = i;
+		masks_and_count[i].counter = total - mask->usage_last;
+		mask->usage_last = total;
+
+		if (i && masks_and_count[i].counter >
+			 masks_and_count[i - 1].counter)
+			sorted = false;
+	}
+
+	if (sorted)
+		goto free_mask_entries;
+
+	sort(masks_and_count, ma->count, sizeof(*masks_and_count),
+	     compare_mask_and_count, NULL);
+
+	new = tbl_mask_array_alloc(ma->max);
+	if (!new)
+		goto free_mask_entries;
+
+	for (i = 0; i < ma->count; i++) {
+		mask = ovsl_dereference(ma->masks[masks_and_count[i].index]);
+		RCU_INIT_POINTER(new->masks[i], mask);
+	}
+	new->count = ma->count;
+
+	rcu_assign_pointer(table->mask_array, new);
+	kfree_rcu(ma, rcu);
+
+free_mask_entries:
+	kfree(masks_and_count);
+}
+
 /* Initializes the flow module.
  * Returns zero if successful or a negative error code. */
 int ovs_flow_init(void)
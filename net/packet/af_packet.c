@@ -281,6 +281,63 @@ drop:
 	return NET_XMIT_DROP;
 }
 
+/*
+ * Transmit a list of ring frames on one tx queue, telling the driver that
+ * more are coming for all but the last so it can defer its doorbell.
+ * Whatever the driver does not take is freed, which hands the frames back
+ * to user space through tpacket_destruct_skb().
+ */
+static int packet_direct_xmit_list(struct sk_buff *skb)
+{
+	struct net_device *dev = skb->dev;
+	struct netdev_queue *txq;
+	struct sk_buff *next;
+	int ret = NETDEV_TX_BUSY;
+	u16 queue_index;
+
+	if (unlikely(!netif_running(dev) ||
+		     !netif_carrier_ok(dev)))
+		goto drop;
+
+	skb = validate_xmit_skb_list(skb, dev);
+	if (unlikely(!skb))
+		goto drop;
+
+	packet_pick_tx_queue(dev, skb);
+	queue_index = skb_get_queue_mapping(skb);
+	txq = netdev_get_tx_queue(dev, queue_index);
+
+	local_bh_disable();
+
+	HARD_TX_LOCK(dev, txq, smp_processor_id());
+	while (skb && !netif_xmit_frozen_or_drv_stopped(txq)) {
+		next = skb->next;
+		skb->next = NULL;
+		skb_set_queue_mapping(skb, queue_index);
+		ret = netdev_start_xmit(skb, dev, txq, next != NULL);
+		if (unlikely(!dev_xmit_complete(ret))) {
+			skb->next = next;
+			break;
+		}
+		skb = next;
+	}
+	HARD_TX_UNLOCK(dev, txq);
+
+	local_bh_enable();
+
+	if (unlikely(skb)) {
+		if (dev_xmit_complete(ret))
+			ret = NETDEV_TX_BUSY;
+		kfree_skb_list(skb);
+	}
+
+	return ret;
+drop:
+	atomic_long_inc(&dev->tx_dropped);
+	kfree_skb_list(skb);
+	return NET_XMIT_DROP;
+}
+
 static struct net_device *packet_cached_dev_get(struct packet_sock *po)
 {
 	struct net_device *dev;
@@ -1361,7 +1418,15 @@ static unsigned int fanout_demux_cpu(struct packet_fanout *f,
 				     struct sk_buff *skb,
 				     unsigned int num)
 {
-	return smp_processor_id() % num;
+	int cpu = smp_processor_id();
+	unsigned int i;
+
+	/* A member pinned to this CPU with SO_INCOMING_CPU owns its traffic */
+	for (i = 0; i < num; i++)
+		if (READ_ONCE(f->arr[i]->sk_incoming_cpu) == cpu)
+			return i;
+
+	return cpu % num;
 }
 
 static unsigned int fanout_demux_rnd(struct packet_fanout *f,
@@ -2618,6 +2683,23 @@ static int tpacket_parse_header(struct packet_sock *po, void *frame,
 	return tp_len;
 }
 
+/* Most frames handed to packet_direct_xmit_list() in one go */
+#define TPACKET_TX_BATCH	64
+
+static int tpacket_xmit_batch(struct sk_buff **batch, struct sk_buff ***tail)
+{
+	int ret;
+
+	if (!*batch)
+		return 0;
+
+	ret = packet_direct_xmit_list(*batch);
+	*batch = NULL;
+	*tail = batch;
+
+	return ret ? net_xmit_errno(ret) : 0;
+}
+
 static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 {
 	struct sk_buff *skb;
@@ -2635,6 +2717,9 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 	int len_sum = 0;
 	int status = TP_STATUS_AVAILABLE;
 	int hlen, tlen, copylen = 0;
+	bool batch_xmit = packet_use_direct_xmit(po);
+	struct sk_buff *batch = NULL, **batch_tail = &batch;
+	int batched = 0;
 
 	mutex_lock(&po->pg_vec_lock);
 
@@ -2681,6 +2766,11 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 		ph = packet_current_frame(po, &po->tx_ring,
 					  TP_STATUS_SEND_REQUEST);
 		if (unlikely(ph == NULL)) {
+			/* Ring drained: the frames queued so far are the batch */
+			batched = 0;
+			err = tpacket_xmit_batch(&batch, &batch_tail);
+			if (unlikely(err))
+				goto out_put;
 			if (need_wait && need_resched())
 				schedule();
 			continue;
@@ -2752,6 +2842,26 @@ tpacket_error:
 		packet_inc_pending(&po->tx_ring);
 
 		status = TP_STATUS_SEND_REQUEST;
+		if (batch_xmit) {
+			/*
+			 * With the qdisc bypassed, hold frames back until the
+			 * ring runs dry or the batch fills, then hand them to
+			 * the driver with xmit_more set.  Frames the driver
+			 * refuses are dropped like under tp_loss rather than
+			 * left for a retry.
+			 */
+			*batch_tail = skb;
+			batch_tail = &skb->next;
+			packet_increment_head(&po->tx_ring);
+			len_sum += tp_len;
+			if (++batched == TPACKET_TX_BATCH) {
+				batched = 0;
+				err = tpacket_xmit_batch(&batch, &batch_tail);
+				if (unlikely(err))
+					goto out_put;
+			}
+			continue;
+		}
 		err = po->xmit(skb);
 		if (unlikely(err > 0)) {
 			err = net_xmit_errno(err);
@@ -2785,6 +2895,7 @@ out_status:
 	__packet_set_status(po, ph, status);
 	kfree_skb(skb);
 out_put:
+	tpacket_xmit_batch(&batch, &batch_tail);
 	dev_put(dev);
 out:
 	mutex_unlock(&po->pg_vec_lock);
@@ -205,14 +205,18 @@ static int strp_recv(read_descriptor_t *desc, struct sk_buff *orig_skb,
 			memset(rxm, 0, sizeof(*rxm));
 			rxm->strp.offset = orig_offset + eaten;
 		} else {
-			/* Unclone since we may be appending to an skb that we
-			 * already share a frag_list with.
+			/* Unclone if we are appending to an skb that we
+			 * already share a frag_list with. Otherwise the
+			 * clone's shared data is never written, and copying
+			 * its head for every segment of a message is wasted.
 			 */
-			err = skb_unclone(skb, GFP_ATOMIC);
-			if (err) {
-				STRP_STATS_INCR(strp->stats.rx_mem_fail);
-				desc->error = err;
-				break;
+			if (skb_has_frag_list(skb)) {
+				err = skb_unclone(skb, GFP_ATOMIC);
+				if (err) {
+					STRP_STATS_INCR(strp->stats.rx_mem_fail);
+					desc->error = err;
+					break;
+				}
 			}
 
 			rxm = _strp_rx_msg(head);
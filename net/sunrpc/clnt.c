@@ -511,6 +511,7 @@ static struct rpc_clnt *rpc_create_xprt(struct rpc_create_args *args,
  */
 struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 {
+	struct rpc_clnt *clnt;
 	struct rpc_xprt *xprt;
 	struct xprt_create xprtargs = {
 		.net = args->net,
@@ -522,6 +523,7 @@ struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 		.bc_xprt = args->bc_xprt,
 	};
 	char servername[48];
+	unsigned int i;
 
 	if (args->bc_xprt) {
 		WARN_ON_ONCE(!(args->protocol & XPRT_TRANSPORT_BC));
@@ -584,7 +586,23 @@ struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 	if (args->flags & RPC_CLNT_CREATE_NONPRIVPORT)
 		xprt->resvport = 0;
 
-	return rpc_create_xprt(args, xprt);
+	clnt = rpc_create_xprt(args, xprt);
+	if (IS_ERR(clnt) || args->nconnect <= 1)
+		return clnt;
+
+	/*
+	 * Open the extra connections to the same server; one stream caps
+	 * throughput well below what fast links can carry. Tasks are
+	 * spread over them by CPU.
+	 */
+	for (i = 1; i < min_t(unsigned int, args->nconnect, RPC_MAX_NCONNECT);
+	     i++)
+		if (rpc_clnt_add_xprt(clnt, &xprtargs, NULL, NULL) < 0)
+			break;
+	rcu_read_lock();
+	rpc_xprt_switch_set_cpulocal(rcu_dereference(clnt->cl_xpi.xpi_xpswitch));
+	rcu_read_unlock();
+	return clnt;
 }
 EXPORT_SYMBOL_GPL(rpc_create);
 
@@ -983,6 +1001,8 @@ void rpc_task_release_client(struct rpc_task *task)
 	if (xprt != NULL) {
 		task->tk_xprt = NULL;
 
+		if (clnt != NULL)
+			atomic_long_dec(&xprt->queuelen);
 		xprt_put(xprt);
 	}
 }
@@ -994,6 +1014,8 @@ void rpc_task_set_client(struct rpc_task *task, struct rpc_clnt *clnt)
 	if (clnt != NULL) {
 		if (task->tk_xprt == NULL)
 			task->tk_xprt = xprt_iter_get_next(&clnt->cl_xpi);
+		if (task->tk_xprt != NULL)
+			atomic_long_inc(&task->tk_xprt->queuelen);
 		task->tk_client = clnt;
 		atomic_inc(&clnt->cl_count);
 		if (clnt->cl_softrtry)
@@ -2767,9 +2789,12 @@ EXPORT_SYMBOL_GPL(rpc_clnt_xprt_switch_put);
 
 void rpc_clnt_xprt_switch_add_xprt(struct rpc_clnt *clnt, struct rpc_xprt *xprt)
 {
+	struct rpc_xprt_switch *xps;
+
 	rcu_read_lock();
-	rpc_xprt_switch_add_xprt(rcu_dereference(clnt->cl_xpi.xpi_xpswitch),
-				 xprt);
+	xps = rcu_dereference(clnt->cl_xpi.xpi_xpswitch);
+	if (!rpc_xprt_switch_has_addr(xps, (struct sockaddr *)&xprt->addr))
+		rpc_xprt_switch_add_xprt(xps, xprt);
 	rcu_read_unlock();
 }
 EXPORT_SYMBOL_GPL(rpc_clnt_xprt_switch_add_xprt);
@@ -36,7 +36,7 @@ static void svc_unregister(const struct svc_serv *serv, struct net *net);
 
 #define svc_serv_is_pooled(serv)    ((serv)->sv_ops->svo_function)
 
-#define SVC_POOL_DEFAULT	SVC_POOL_GLOBAL
+#define SVC_POOL_DEFAULT	SVC_POOL_AUTO
 
 /*
  * Structure for mapping cpus to pools and vice versa.
@@ -109,8 +109,6 @@ module_param_call(pool_mode, param_set_pool_mode, param_get_pool_mode,
 static int
 svc_pool_map_choose_mode(void)
 {
-	unsigned int node;
-
 	if (nr_online_nodes > 1) {
 		/*
 		 * Actually have multiple NUMA nodes,
@@ -119,18 +117,13 @@ svc_pool_map_choose_mode(void)
 		return SVC_POOL_PERNODE;
 	}
 
-	node = first_online_node;
-	if (nr_cpus_node(node) > 2) {
-		/*
-		 * Non-trivial SMP, or CONFIG_NUMA on
-		 * non-NUMA hardware, e.g. with a generic
-		 * x86_64 kernel on Xeons.  In this case we
-		 * want to divide the pools on cpu boundaries.
-		 */
-		return SVC_POOL_PERCPU;
-	}
-
-	/* default: one global pool */
+	/*
+	 * Per-cpu pools pin one thread to each cpu and leave a cpu without
+	 * a thread to pool 0, which only pays off when the admin runs at
+	 * least one thread per cpu; ask for "percpu" explicitly then.  A
+	 * single global pool queues and wakes without taking its lock, so
+	 * it scales well enough across the cpus of one node.
+	 */
 	return SVC_POOL_GLOBAL;
 }
 
@@ -352,7 +345,15 @@ svc_pool_for_cpu(struct svc_serv *serv, int cpu)
 			break;
 		}
 	}
-	return &serv->sv_pools[pidx % serv->sv_nrpools];
+	pidx %= serv->sv_nrpools;
+
+	/*
+	 * Threads are started round-robin from pool 0, so with fewer threads
+	 * than pools the later ones have none to ever dequeue a transport.
+	 */
+	if (pidx && unlikely(!READ_ONCE(serv->sv_pools[pidx].sp_nrthreads)))
+		pidx = 0;
+	return &serv->sv_pools[pidx];
 }
 
 int svc_rpcb_setup(struct svc_serv *serv, struct net *net)
@@ -416,6 +417,18 @@ __svc_init_bc(struct svc_serv *serv)
 }
 #endif
 
+static void
+svc_free_pools(struct svc_serv *serv)
+{
+	unsigned int i;
+
+	for (i = 0; i < serv->sv_nrpools; i++) {
+		idr_destroy(&serv->sv_pools[i].sp_thread_idr);
+		kfree(serv->sv_pools[i].sp_idle_map);
+	}
+	kfree(serv->sv_pools);
+}
+
 /*
  * Create an RPC service
  */
@@ -476,9 +489,19 @@ __svc_create(struct svc_program *prog, unsigned int bufsize, int npools,
 				i, serv->sv_name);
 
 		pool->sp_id = i;
-		INIT_LIST_HEAD(&pool->sp_sockets);
+		init_llist_head(&pool->sp_xprts);
 		INIT_LIST_HEAD(&pool->sp_all_threads);
+		idr_init(&pool->sp_thread_idr);
 		spin_lock_init(&pool->sp_lock);
+
+		pool->sp_idle_map =
+			kcalloc(BITS_TO_LONGS(RPCSVC_MAXPOOLTHREADS),
+				sizeof(unsigned long), GFP_KERNEL);
+		if (!pool->sp_idle_map) {
+			svc_free_pools(serv);
+			kfree(serv);
+			return NULL;
+		}
 	}
 
 	return serv;
@@ -551,7 +574,7 @@ svc_destroy(struct svc_serv *serv)
 	if (svc_serv_is_pooled(serv))
 		svc_pool_map_put();
 
-	kfree(serv->sv_pools);
+	svc_free_pools(serv);
 	kfree(serv);
 }
 EXPORT_SYMBOL_GPL(svc_destroy);
@@ -636,15 +659,30 @@ svc_prepare_thread(struct svc_serv *serv, struct svc_pool *pool, int node)
 {
 	struct svc_rqst	*rqstp;
 
+	int id;
+
 	rqstp = svc_rqst_alloc(serv, pool, node);
 	if (!rqstp)
 		return ERR_PTR(-ENOMEM);
 
-	serv->sv_nrthreads++;
+	idr_preload(GFP_KERNEL);
 	spin_lock_bh(&pool->sp_lock);
-	pool->sp_nrthreads++;
-	list_add_rcu(&rqstp->rq_all, &pool->sp_all_threads);
+	id = idr_alloc(&pool->sp_thread_idr, rqstp, 0, RPCSVC_MAXPOOLTHREADS,
+		       GFP_NOWAIT);
+	if (id >= 0) {
+		rqstp->rq_thread_id = id;
+		pool->sp_nrthreads++;
+		list_add_rcu(&rqstp->rq_all, &pool->sp_all_threads);
+	}
 	spin_unlock_bh(&pool->sp_lock);
+	idr_preload_end();
+
+	if (id < 0) {
+		svc_rqst_free(rqstp);
+		return ERR_PTR(id);
+	}
+
+	serv->sv_nrthreads++;
 	return rqstp;
 }
 EXPORT_SYMBOL_GPL(svc_prepare_thread);
@@ -858,6 +896,8 @@ svc_exit_thread(struct svc_rqst *rqstp)
 	pool->sp_nrthreads--;
 	if (!test_and_set_bit(RQ_VICTIM, &rqstp->rq_flags))
 		list_del_rcu(&rqstp->rq_all);
+	clear_bit(rqstp->rq_thread_id, pool->sp_idle_map);
+	idr_remove(&pool->sp_thread_idr, rqstp->rq_thread_id);
 	spin_unlock_bh(&pool->sp_lock);
 
 	svc_rqst_free(rqstp);
@@ -45,6 +45,8 @@ static LIST_HEAD(svc_xprt_class_list);
 /* SMP locking strategy:
  *
  *	svc_pool->sp_lock protects most of the fields of that pool.
+ *	Transports are added to svc_pool->sp_xprts without it, and idle
+ *	threads flip their svc_pool->sp_idle_map bit without it.
  *	svc_serv->sv_lock protects sv_tempsocks, sv_permsocks, sv_tmpcnt.
  *	when both need to be taken (rare), svc_serv->sv_lock is first.
  *	The "service mutex" protects svc_serv->sv_nrthread.
@@ -152,6 +154,17 @@ void svc_xprt_put(struct svc_xprt *xprt)
 }
 EXPORT_SYMBOL_GPL(svc_xprt_put);
 
+/* A transport that is not queued on a pool points xpt_ready at itself */
+static inline void svc_xprt_ready_init(struct svc_xprt *xprt)
+{
+	xprt->xpt_ready.next = &xprt->xpt_ready;
+}
+
+static inline bool svc_xprt_queued(struct svc_xprt *xprt)
+{
+	return xprt->xpt_ready.next != &xprt->xpt_ready;
+}
+
 /*
  * Called by transport drivers to initialize the transport independent
  * portion of the transport instance.
@@ -165,7 +178,7 @@ void svc_xprt_init(struct net *net, struct svc_xprt_class *xcl,
 	kref_init(&xprt->xpt_ref);
 	xprt->xpt_server = serv;
 	INIT_LIST_HEAD(&xprt->xpt_list);
-	INIT_LIST_HEAD(&xprt->xpt_ready);
+	svc_xprt_ready_init(xprt);
 	INIT_LIST_HEAD(&xprt->xpt_deferred);
 	INIT_LIST_HEAD(&xprt->xpt_users);
 	mutex_init(&xprt->xpt_mutex);
@@ -379,6 +392,7 @@ void svc_xprt_do_enqueue(struct svc_xprt *xprt)
 {
 	struct svc_pool *pool;
 	struct svc_rqst	*rqstp = NULL;
+	unsigned int id;
 	int cpu;
 	bool queued = false;
 
@@ -404,9 +418,11 @@ void svc_xprt_do_enqueue(struct svc_xprt *xprt)
 redo_search:
 	/* find a thread for this xprt */
 	rcu_read_lock();
-	list_for_each_entry_rcu(rqstp, &pool->sp_all_threads, rq_all) {
+	for_each_set_bit(id, pool->sp_idle_map, RPCSVC_MAXPOOLTHREADS) {
+		rqstp = idr_find(&pool->sp_thread_idr, id);
+
 		/* Do a lockless check first */
-		if (test_bit(RQ_BUSY, &rqstp->rq_flags))
+		if (!rqstp || test_bit(RQ_BUSY, &rqstp->rq_flags))
 			continue;
 
 		/*
@@ -424,6 +440,7 @@ redo_search:
 			}
 
 			/* this one will do */
+			clear_bit(id, pool->sp_idle_map);
 			rqstp->rq_xprt = xprt;
 			svc_xprt_get(xprt);
 			spin_unlock_bh(&rqstp->rq_lock);
@@ -446,10 +463,9 @@ redo_search:
 	if (!queued) {
 		queued = true;
 		dprintk("svc: transport %p put into queue\n", xprt);
-		spin_lock_bh(&pool->sp_lock);
-		list_add_tail(&xprt->xpt_ready, &pool->sp_sockets);
-		pool->sp_stats.sockets_queued++;
-		spin_unlock_bh(&pool->sp_lock);
+		/* Fully ordered, pairs with the smp_mb in svc_get_next_xprt */
+		llist_add(&xprt->xpt_ready, &pool->sp_xprts);
+		atomic_long_inc(&pool->sp_stats.sockets_queued);
 		goto redo_search;
 	}
 	rqstp = NULL;
@@ -472,21 +488,48 @@ void svc_xprt_enqueue(struct svc_xprt *xprt)
 }
 EXPORT_SYMBOL_GPL(svc_xprt_enqueue);
 
+static bool svc_pool_has_xprts(struct svc_pool *pool)
+{
+	return READ_ONCE(pool->sp_ready) || !llist_empty(&pool->sp_xprts);
+}
+
+/*
+ * Move the transports queued since the last call behind those already
+ * on sp_ready.  llist_add pushes at the head, so they come off sp_xprts
+ * newest first.  sp_lock held.
+ */
+static void svc_pool_splice_xprts(struct svc_pool *pool)
+{
+	struct llist_node *first, **tail = &pool->sp_ready;
+
+	first = llist_del_all(&pool->sp_xprts);
+	if (!first)
+		return;
+
+	while (*tail)
+		tail = &(*tail)->next;
+	*tail = llist_reverse_order(first);
+}
+
 /*
  * Dequeue the first transport, if there is one.
  */
 static struct svc_xprt *svc_xprt_dequeue(struct svc_pool *pool)
 {
 	struct svc_xprt	*xprt = NULL;
+	struct llist_node *node;
 
-	if (list_empty(&pool->sp_sockets))
+	if (!svc_pool_has_xprts(pool))
 		goto out;
 
 	spin_lock_bh(&pool->sp_lock);
-	if (likely(!list_empty(&pool->sp_sockets))) {
-		xprt = list_first_entry(&pool->sp_sockets,
-					struct svc_xprt, xpt_ready);
-		list_del_init(&xprt->xpt_ready);
+	if (!pool->sp_ready)
+		svc_pool_splice_xprts(pool);
+	node = pool->sp_ready;
+	if (likely(node)) {
+		xprt = llist_entry(node, struct svc_xprt, xpt_ready);
+		pool->sp_ready = node->next;
+		svc_xprt_ready_init(xprt);
 		svc_xprt_get(xprt);
 
 		dprintk("svc: transport %p dequeued, inuse=%d\n",
@@ -563,13 +606,16 @@ void svc_wake_up(struct svc_serv *serv)
 {
 	struct svc_rqst	*rqstp;
 	struct svc_pool *pool;
+	unsigned int id;
 
 	pool = &serv->sv_pools[0];
 
 	rcu_read_lock();
-	list_for_each_entry_rcu(rqstp, &pool->sp_all_threads, rq_all) {
+	for_each_set_bit(id, pool->sp_idle_map, RPCSVC_MAXPOOLTHREADS) {
+		rqstp = idr_find(&pool->sp_thread_idr, id);
+
 		/* skip any that aren't queued */
-		if (test_bit(RQ_BUSY, &rqstp->rq_flags))
+		if (!rqstp || test_bit(RQ_BUSY, &rqstp->rq_flags))
 			continue;
 		rcu_read_unlock();
 		dprintk("svc: daemon %p woken up.\n", rqstp);
@@ -705,7 +751,7 @@ rqst_should_sleep(struct svc_rqst *rqstp)
 		return false;
 
 	/* was a socket queued? */
-	if (!list_empty(&pool->sp_sockets))
+	if (svc_pool_has_xprts(pool))
 		return false;
 
 	/* are we shutting down? */
@@ -752,6 +798,7 @@ static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 	 */
 	set_current_state(TASK_INTERRUPTIBLE);
 	clear_bit(RQ_BUSY, &rqstp->rq_flags);
+	set_bit(rqstp->rq_thread_id, pool->sp_idle_map);
 	smp_mb();
 
 	if (likely(rqst_should_sleep(rqstp)))
@@ -764,6 +811,7 @@ static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 	spin_lock_bh(&rqstp->rq_lock);
 	set_bit(RQ_BUSY, &rqstp->rq_flags);
 	spin_unlock_bh(&rqstp->rq_lock);
+	clear_bit(rqstp->rq_thread_id, pool->sp_idle_map);
 
 	xprt = rqstp->rq_xprt;
 	if (xprt != NULL)
@@ -1063,7 +1111,7 @@ static void svc_delete_xprt(struct svc_xprt *xprt)
 
 	spin_lock_bh(&serv->sv_lock);
 	list_del_init(&xprt->xpt_list);
-	WARN_ON_ONCE(!list_empty(&xprt->xpt_ready));
+	WARN_ON_ONCE(svc_xprt_queued(xprt));
 	if (test_bit(XPT_TEMP, &xprt->xpt_flags))
 		serv->sv_tmpcnt--;
 	spin_unlock_bh(&serv->sv_lock);
@@ -1112,17 +1160,20 @@ static struct svc_xprt *svc_dequeue_net(struct svc_serv *serv, struct net *net)
 {
 	struct svc_pool *pool;
 	struct svc_xprt *xprt;
-	struct svc_xprt *tmp;
+	struct llist_node **pp;
 	int i;
 
 	for (i = 0; i < serv->sv_nrpools; i++) {
 		pool = &serv->sv_pools[i];
 
 		spin_lock_bh(&pool->sp_lock);
-		list_for_each_entry_safe(xprt, tmp, &pool->sp_sockets, xpt_ready) {
+		svc_pool_splice_xprts(pool);
+		for (pp = &pool->sp_ready; *pp; pp = &(*pp)->next) {
+			xprt = llist_entry(*pp, struct svc_xprt, xpt_ready);
 			if (xprt->xpt_net != net)
 				continue;
-			list_del_init(&xprt->xpt_ready);
+			*pp = xprt->xpt_ready.next;
+			svc_xprt_ready_init(xprt);
 			spin_unlock_bh(&pool->sp_lock);
 			return xprt;
 		}
@@ -1441,7 +1492,7 @@ static int svc_pool_stats_show(struct seq_file *m, void *p)
 	seq_printf(m, "%u %lu %lu %lu %lu\n",
 		pool->sp_id,
 		(unsigned long)atomic_long_read(&pool->sp_stats.packets),
-		pool->sp_stats.sockets_queued,
+		(unsigned long)atomic_long_read(&pool->sp_stats.sockets_queued),
 		(unsigned long)atomic_long_read(&pool->sp_stats.threads_woken),
 		(unsigned long)atomic_long_read(&pool->sp_stats.threads_timedout));
 
@@ -23,6 +23,7 @@ typedef struct rpc_xprt *(*xprt_switch_find_xprt_t)(struct list_head *head,
 
 static const struct rpc_xprt_iter_ops rpc_xprt_iter_singular;
 static const struct rpc_xprt_iter_ops rpc_xprt_iter_roundrobin;
+static const struct rpc_xprt_iter_ops rpc_xprt_iter_cpulocal;
 static const struct rpc_xprt_iter_ops rpc_xprt_iter_listall;
 
 static void xprt_switch_add_xprt_locked(struct rpc_xprt_switch *xps,
@@ -43,6 +44,8 @@ static void xprt_switch_add_xprt_locked(struct rpc_xprt_switch *xps,
  * @xprt: pointer to struct rpc_xprt
  *
  * Adds xprt to the end of the list of struct rpc_xprt in xps.
+ * Several transports may share a server address; callers that want
+ * one transport per address check rpc_xprt_switch_has_addr() first.
  */
 void rpc_xprt_switch_add_xprt(struct rpc_xprt_switch *xps,
 		struct rpc_xprt *xprt)
@@ -50,8 +53,7 @@ void rpc_xprt_switch_add_xprt(struct rpc_xprt_switch *xps,
 	if (xprt == NULL)
 		return;
 	spin_lock(&xps->xps_lock);
-	if ((xps->xps_net == xprt->xprt_net || xps->xps_net == NULL) &&
-	    !rpc_xprt_switch_has_addr(xps, (struct sockaddr *)&xprt->addr))
+	if (xps->xps_net == xprt->xprt_net || xps->xps_net == NULL)
 		xprt_switch_add_xprt_locked(xps, xprt);
 	spin_unlock(&xps->xps_lock);
 }
@@ -172,6 +174,19 @@ void rpc_xprt_switch_set_roundrobin(struct rpc_xprt_switch *xps)
 		WRITE_ONCE(xps->xps_iter_ops, &rpc_xprt_iter_roundrobin);
 }
 
+/**
+ * rpc_xprt_switch_set_cpulocal - Set a CPU-local policy on rpc_xprt_switch
+ * @xps: pointer to struct rpc_xprt_switch
+ *
+ * Sets a policy that gives each CPU its own transport out of xps, so
+ * tasks issued on one CPU share a connection and its socket state.
+ */
+void rpc_xprt_switch_set_cpulocal(struct rpc_xprt_switch *xps)
+{
+	if (READ_ONCE(xps->xps_iter_ops) != &rpc_xprt_iter_cpulocal)
+		WRITE_ONCE(xps->xps_iter_ops, &rpc_xprt_iter_cpulocal);
+}
+
 static
 const struct rpc_xprt_iter_ops *xprt_iter_ops(const struct rpc_xprt_iter *xpi)
 {
@@ -326,6 +341,38 @@ struct rpc_xprt *xprt_iter_next_entry_all(struct rpc_xprt_iter *xpi)
 	return xprt_iter_next_entry_multiple(xpi, xprt_switch_find_next_entry);
 }
 
+/*
+ * The CPU's own transport, unless it has a queue more than twice as long
+ * as the least loaded one; then spill over to that one instead.
+ */
+static
+struct rpc_xprt *xprt_iter_next_entry_cpulocal(struct rpc_xprt_iter *xpi)
+{
+	struct rpc_xprt_switch *xps = rcu_dereference(xpi->xpi_xpswitch);
+	struct rpc_xprt *pos, *home = NULL, *idlest = NULL;
+	unsigned int n;
+
+	if (xps == NULL)
+		return NULL;
+	n = READ_ONCE(xps->xps_nxprts);
+	if (n < 2)
+		return xprt_switch_find_first_entry(&xps->xps_xprt_list);
+	n = raw_smp_processor_id() % n;
+
+	list_for_each_entry_rcu(pos, &xps->xps_xprt_list, xprt_switch) {
+		if (home == NULL && n-- == 0)
+			home = pos;
+		if (idlest == NULL || atomic_long_read(&pos->queuelen) <
+				      atomic_long_read(&idlest->queuelen))
+			idlest = pos;
+	}
+	if (home == NULL ||
+	    atomic_long_read(&idlest->queuelen) * 2 <
+	    atomic_long_read(&home->queuelen))
+		return idlest;
+	return home;
+}
+
 /*
  * xprt_iter_rewind - Resets the xprt iterator
  * @xpi: pointer to rpc_xprt_iter
@@ -486,6 +533,14 @@ const struct rpc_xprt_iter_ops rpc_xprt_iter_roundrobin = {
 	.xpi_next = xprt_iter_next_entry_roundrobin,
 };
 
+/* Policy for picking the transport of the current CPU */
+static
+const struct rpc_xprt_iter_ops rpc_xprt_iter_cpulocal = {
+	.xpi_rewind = xprt_iter_no_rewind,
+	.xpi_xprt = xprt_iter_first_entry,
+	.xpi_next = xprt_iter_next_entry_cpulocal,
+};
+
 /* Policy for once-through iteration of entries in the rpc_xprt_switch */
 static
 const struct rpc_xprt_iter_ops rpc_xprt_iter_listall = {
@@ -210,32 +210,57 @@ static void tls_free_both_sg(struct sock *sk)
 		&ctx->sg_plaintext_size);
 }
 
+static void tls_encrypt_done(struct crypto_async_request *req, int err)
+{
+	struct tls_sw_context *ctx = req->data;
+
+	/* Moved off the backlog, the real completion is still to come */
+	if (err == -EINPROGRESS)
+		return;
+
+	ctx->async_err = err;
+	complete(&ctx->async_done);
+}
+
 static int tls_do_encryption(struct tls_context *tls_ctx,
 			     struct tls_sw_context *ctx, size_t data_len,
 			     gfp_t flags)
 {
-	unsigned int req_size = sizeof(struct aead_request) +
-		crypto_aead_reqsize(ctx->aead_send);
-	struct aead_request *aead_req;
+	struct aead_request *aead_req = ctx->aead_req;
 	int rc;
 
-	aead_req = kmalloc(req_size, flags);
-	if (!aead_req)
-		return -ENOMEM;
-
-	ctx->sg_encrypted_data[0].offset += tls_ctx->prepend_size;
-	ctx->sg_encrypted_data[0].length -= tls_ctx->prepend_size;
+	/*
+	 * An asynchronous cipher may still own the request and the
+	 * scatterlists of a record started from atomic context; the
+	 * record is closed, so its result stands for this call too.
+	 */
+	if (!ctx->async_pending) {
+		ctx->sg_encrypted_data[0].offset += tls_ctx->prepend_size;
+		ctx->sg_encrypted_data[0].length -= tls_ctx->prepend_size;
+
+		aead_request_set_ad(aead_req, TLS_AAD_SPACE_SIZE);
+		aead_request_set_crypt(aead_req, ctx->sg_aead_in,
+				       ctx->sg_aead_out, data_len,
+				       tls_ctx->iv);
+		reinit_completion(&ctx->async_done);
+		rc = crypto_aead_encrypt(aead_req);
+		if (rc != -EINPROGRESS && rc != -EBUSY)
+			goto out;
+		ctx->async_pending = true;
+	}
 
-	aead_request_set_tfm(aead_req, ctx->aead_send);
-	aead_request_set_ad(aead_req, TLS_AAD_SPACE_SIZE);
-	aead_request_set_crypt(aead_req, ctx->sg_aead_in, ctx->sg_aead_out,
-			       data_len, tls_ctx->iv);
-	rc = crypto_aead_encrypt(aead_req);
+	/* write_space can't sleep; it gets called again as space frees up */
+	if (!gfpflags_allow_blocking(flags) &&
+	    !completion_done(&ctx->async_done))
+		return -EAGAIN;
 
+	wait_for_completion(&ctx->async_done);
+	ctx->async_pending = false;
+	rc = ctx->async_err;
+out:
 	ctx->sg_encrypted_data[0].offset -= tls_ctx->prepend_size;
 	ctx->sg_encrypted_data[0].length += tls_ctx->prepend_size;
 
-	kfree(aead_req);
 	return rc;
 }
 
@@ -644,6 +669,9 @@ void tls_sw_free_resources(struct sock *sk)
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_sw_context *ctx = tls_sw_ctx(tls_ctx);
 
+	if (ctx->async_pending)
+		wait_for_completion(&ctx->async_done);
+	aead_request_free(ctx->aead_req);
 	if (ctx->aead_send)
 		crypto_free_aead(ctx->aead_send);
 
@@ -745,6 +773,20 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx)
 		}
 	}
 
+	/* One request per socket, reused for every record */
+	if (!sw_ctx->aead_req) {
+		sw_ctx->aead_req = aead_request_alloc(sw_ctx->aead_send,
+						      GFP_KERNEL);
+		if (!sw_ctx->aead_req) {
+			rc = -ENOMEM;
+			goto free_aead;
+		}
+		init_completion(&sw_ctx->async_done);
+		aead_request_set_callback(sw_ctx->aead_req,
+					  CRYPTO_TFM_REQ_MAY_BACKLOG,
+					  tls_encrypt_done, sw_ctx);
+	}
+
 	ctx->push_pending_record = tls_sw_push_pending_record;
 
 	memcpy(keyval, gcm_128_info->key, TLS_CIPHER_AES_GCM_128_KEY_SIZE);
@@ -759,6 +801,8 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx)
 		goto out;
 
 free_aead:
+	aead_request_free(sw_ctx->aead_req);
+	sw_ctx->aead_req = NULL;
 	crypto_free_aead(sw_ctx->aead_send);
 	sw_ctx->aead_send = NULL;
 free_rec_seq:
@@ -1828,6 +1828,65 @@ out:
  */
 #define UNIX_SKB_FRAGS_SZ (PAGE_SIZE << get_order(32768))
 
+/* Small writes get this much linear room, so later ones can join them */
+#define UNIX_SKB_COALESCE_SZ SKB_WITH_OVERHEAD(2048)
+
+/*
+ * Copy a small write into the tailroom of the last skb in the peer's
+ * receive queue, provided we queued it, it carries no fds and the same
+ * credentials, and nobody is reading right now.  Returns the number of
+ * bytes appended, or 0 if a new skb has to be queued instead.
+ */
+static int unix_stream_coalesce(struct sock *sk, struct sock *other,
+				struct msghdr *msg, int size,
+				struct scm_cookie *scm)
+{
+	struct unix_sock *ou = unix_sk(other);
+	struct sk_buff *skb;
+	int err = 0;
+
+	if (scm->fp || size > UNIX_SKB_COALESCE_SZ)
+		return 0;
+
+	/* iolock keeps readers and other coalescers away from the tail */
+	if (!mutex_trylock(&ou->iolock))
+		return 0;
+
+	unix_state_lock(other);
+	skb = skb_peek_tail(&other->sk_receive_queue);
+	if (!skb || skb->sk != sk || skb_is_nonlinear(skb) ||
+	    UNIXCB(skb).fp || skb_tailroom(skb) < size ||
+	    !unix_skb_scm_eq(skb, scm) || sock_flag(other, SOCK_DEAD) ||
+	    (other->sk_shutdown & RCV_SHUTDOWN)) {
+		unix_state_unlock(other);
+		goto out;
+	}
+	skb_get(skb);
+	unix_state_unlock(other);
+
+	/* The bytes past skb->len are invisible until skb_put() below */
+	if (!copy_from_iter_full(skb_tail_pointer(skb), size,
+				 &msg->msg_iter)) {
+		err = -EFAULT;
+		goto out_put;
+	}
+
+	/* A plain sender may have queued behind it while we copied */
+	unix_state_lock(other);
+	if (skb_peek_tail(&other->sk_receive_queue) == skb) {
+		skb_put(skb, size);
+		err = size;
+	} else {
+		iov_iter_revert(&msg->msg_iter, size);
+	}
+	unix_state_unlock(other);
+out_put:
+	consume_skb(skb);
+out:
+	mutex_unlock(&ou->iolock);
+	return err;
+}
+
 static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 			       size_t len)
 {
@@ -1871,11 +1930,22 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 		/* allow fallback to order-0 allocations */
 		size = min_t(int, size, SKB_MAX_HEAD(0) + UNIX_SKB_FRAGS_SZ);
 
+		err = unix_stream_coalesce(sk, other, msg, size, &scm);
+		if (err < 0)
+			goto out_err;
+		if (err) {
+			other->sk_data_ready(other);
+			sent += size;
+			continue;
+		}
+
 		data_len = max_t(int, 0, size - SKB_MAX_HEAD(0));
 
 		data_len = min_t(size_t, size, PAGE_ALIGN(data_len));
 
-		skb = sock_alloc_send_pskb(sk, size - data_len, data_len,
+		skb = sock_alloc_send_pskb(sk, data_len ? size - data_len :
+					   max_t(int, size, UNIX_SKB_COALESCE_SZ),
+					   data_len,
 					   msg->msg_flags & MSG_DONTWAIT, &err,
 					   get_order(UNIX_SKB_FRAGS_SZ));
 		if (!skb)
@@ -594,6 +594,20 @@ void __xfrm_state_destroy(struct xfrm_state *x)
 }
 EXPORT_SYMBOL(__xfrm_state_destroy);
 
+/* Drop the references the per-CPU input caches hold on a dying SA */
+static void xfrm_state_cache_input_drop(struct xfrm_state *x)
+{
+	struct net *net = xs_net(x);
+	struct xfrm_state **slot;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		slot = per_cpu_ptr(net->xfrm.state_cache_input, cpu);
+		if (cmpxchg(slot, x, NULL) == x)
+			xfrm_state_put(x);
+	}
+}
+
 int __xfrm_state_delete(struct xfrm_state *x)
 {
 	struct net *net = xs_net(x);
@@ -610,6 +624,9 @@ int __xfrm_state_delete(struct xfrm_state *x)
 		net->xfrm.state_num--;
 		spin_unlock(&net->xfrm.xfrm_state_lock);
 
+		if (x->id.spi)
+			xfrm_state_cache_input_drop(x);
+
 		xfrm_dev_state_delete(x);
 
 		/* All xfrm_state objects are created by xfrm_state_alloc.
@@ -1587,6 +1604,56 @@ xfrm_state_lookup(struct net *net, u32 mark, const xfrm_address_t *daddr, __be32
 }
 EXPORT_SYMBOL(xfrm_state_lookup);
 
+/*
+ * xfrm_state_lookup() for the receive path.  Consecutive packets on a CPU
+ * mostly belong to the same SA, so the last SA found is kept in a per-CPU
+ * slot, holding a reference, and checked before the SPI hash.  Slots are
+ * only changed with xchg/cmpxchg, so a preempted caller at worst uses
+ * another CPU's slot.
+ */
+struct xfrm_state *
+xfrm_input_state_lookup(struct net *net, u32 mark, const xfrm_address_t *daddr,
+			__be32 spi, u8 proto, unsigned short family)
+{
+	struct xfrm_state **slot, *x, *old;
+
+	rcu_read_lock();
+	slot = raw_cpu_ptr(net->xfrm.state_cache_input);
+
+	/* The SA can't be freed before a grace period even if its slot
+	 * reference is dropped under us, which the hold would notice.
+	 */
+	x = READ_ONCE(*slot);
+	if (x &&
+	    x->id.spi == spi &&
+	    x->id.proto == proto &&
+	    x->props.family == family &&
+	    xfrm_addr_equal(&x->id.daddr, daddr, family) &&
+	    (mark & x->mark.m) == x->mark.v &&
+	    xfrm_state_hold_rcu(x))
+		goto out;
+
+	x = __xfrm_state_lookup(net, mark, daddr, spi, proto, family);
+	if (x) {
+		xfrm_state_hold(x);
+		old = xchg(slot, x);
+		if (old)
+			xfrm_state_put(old);
+
+		/* Pairs with the DEAD store and the cmpxchg in
+		 * __xfrm_state_delete(): either it sees the new slot or we
+		 * see the state and back the slot out again.
+		 */
+		if (unlikely(READ_ONCE(x->km.state) == XFRM_STATE_DEAD) &&
+		    cmpxchg(slot, x, NULL) == x)
+			xfrm_state_put(x);
+	}
+out:
+	rcu_read_unlock();
+	return x;
+}
+EXPORT_SYMBOL(xfrm_input_state_lookup);
+
 struct xfrm_state *
 xfrm_state_lookup_byaddr(struct net *net, u32 mark,
 			 const xfrm_address_t *daddr, const xfrm_address_t *saddr,
@@ -2282,11 +2349,17 @@ int __net_init xfrm_state_init(struct net *net)
 		goto out_byspi;
 	net->xfrm.state_hmask = ((sz / sizeof(struct hlist_head)) - 1);
 
+	net->xfrm.state_cache_input = alloc_percpu(struct xfrm_state *);
+	if (!net->xfrm.state_cache_input)
+		goto out_cache_input;
+
 	net->xfrm.state_num = 0;
 	INIT_WORK(&net->xfrm.state_hash_work, xfrm_hash_resize);
 	spin_lock_init(&net->xfrm.xfrm_state_lock);
 	return 0;
 
+out_cache_input:
+	xfrm_hash_free(net->xfrm.state_byspi, sz);
 out_byspi:
 	xfrm_hash_free(net->xfrm.state_bysrc, sz);
 out_bysrc:
@@ -2304,6 +2377,7 @@ void xfrm_state_fini(struct net *net)
 	flush_work(&xfrm_state_gc_work);
 
 	WARN_ON(!list_empty(&net->xfrm.state_all));
+	free_percpu(net->xfrm.state_cache_input);
 
 	sz = (net->xfrm.state_hmask + 1) * sizeof(struct hlist_head);
 	WARN_ON(!hlist_empty(net->xfrm.state_byspi));
@@ -90,6 +90,31 @@ DEFINE_PER_CPU(struct avc_cache_stats, avc_cache_stats) = { 0 };
 #endif
 
 static struct avc_cache avc_cache;
+
+/*
+ * Small per-CPU direct-mapped copy of recent decisions in front of the
+ * shared hash, so that hot permission checks touch only local cache
+ * lines.  An entry is valid while its generation matches avc_pcpu_gen,
+ * which is bumped whenever any decision in the AVC changes or the AVC is
+ * flushed.  Only task context uses it, with preemption disabled, so a CPU
+ * never sees its own entries half written.
+ */
+#define AVC_PCPU_SLOTS			64
+
+struct avc_pcpu_entry {
+	u32			ssid;
+	u32			tsid;
+	u16			tclass;
+	u32			gen;
+	struct av_decision	avd;
+};
+
+struct avc_pcpu_cache {
+	struct avc_pcpu_entry	slots[AVC_PCPU_SLOTS];
+};
+
+static DEFINE_PER_CPU(struct avc_pcpu_cache, avc_pcpu_cache);
+static atomic_t avc_pcpu_gen = ATOMIC_INIT(1);
 static struct avc_callback_node *avc_callbacks;
 static struct kmem_cache *avc_node_cachep;
 static struct kmem_cache *avc_xperms_data_cachep;
@@ -101,6 +126,59 @@ static inline int avc_hash(u32 ssid, u32 tsid, u16 tclass)
 	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_CACHE_SLOTS - 1);
 }
 
+static inline void avc_pcpu_invalidate(void)
+{
+	/* Order the AVC update before the generation, see avc_pcpu_gen_read() */
+	smp_wmb();
+	atomic_inc(&avc_pcpu_gen);
+}
+
+static inline u32 avc_pcpu_gen_read(void)
+{
+	u32 gen = atomic_read(&avc_pcpu_gen);
+
+	/*
+	 * A decision looked up in the AVC after this is at least as new as
+	 * the generation it gets cached under.
+	 */
+	smp_rmb();
+	return gen;
+}
+
+static bool avc_pcpu_lookup(u32 ssid, u32 tsid, u16 tclass, u32 gen,
+			    struct av_decision *avd)
+{
+	struct avc_pcpu_cache *c;
+	struct avc_pcpu_entry *e;
+	bool hit;
+
+	c = get_cpu_ptr(&avc_pcpu_cache);
+	e = &c->slots[avc_hash(ssid, tsid, tclass) & (AVC_PCPU_SLOTS - 1)];
+	hit = e->gen == gen && e->ssid == ssid && e->tsid == tsid &&
+	      e->tclass == tclass;
+	if (hit)
+		memcpy(avd, &e->avd, sizeof(*avd));
+	put_cpu_ptr(&avc_pcpu_cache);
+
+	return hit;
+}
+
+static void avc_pcpu_insert(u32 ssid, u32 tsid, u16 tclass, u32 gen,
+			    struct av_decision *avd)
+{
+	struct avc_pcpu_cache *c;
+	struct avc_pcpu_entry *e;
+
+	c = get_cpu_ptr(&avc_pcpu_cache);
+	e = &c->slots[avc_hash(ssid, tsid, tclass) & (AVC_PCPU_SLOTS - 1)];
+	e->ssid = ssid;
+	e->tsid = tsid;
+	e->tclass = tclass;
+	e->gen = gen;
+	memcpy(&e->avd, avd, sizeof(*avd));
+	put_cpu_ptr(&avc_pcpu_cache);
+}
+
 /**
  * avc_dump_av - Display an access vector in human-readable form.
  * @tclass: target security class
@@ -508,6 +586,7 @@ static void avc_node_replace(struct avc_node *new, struct avc_node *old)
 	hlist_replace_rcu(&old->list, &new->list);
 	call_rcu(&old->rhead, avc_node_free);
 	atomic_dec(&avc_cache.active_nodes);
+	avc_pcpu_invalidate();
 }
 
 static inline int avc_reclaim_node(void)
@@ -929,6 +1008,8 @@ static void avc_flush(void)
 		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flag);
 	}
+
+	avc_pcpu_invalidate();
 }
 
 /**
@@ -1100,11 +1181,21 @@ inline int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 {
 	struct avc_node *node;
 	struct avc_xperms_node xp_node;
+	bool pcpu = in_task();
 	int rc = 0;
 	u32 denied;
+	u32 gen = 0;
 
 	BUG_ON(!requested);
 
+	if (pcpu) {
+		gen = avc_pcpu_gen_read();
+		if (avc_pcpu_lookup(ssid, tsid, tclass, gen, avd)) {
+			avc_cache_stats_incr(lookups);
+			goto check;
+		}
+	}
+
 	rcu_read_lock();
 
 	node = avc_lookup(ssid, tsid, tclass);
@@ -1113,11 +1204,17 @@ inline int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 	else
 		memcpy(avd, &node->ae.avd, sizeof(*avd));
 
+	/* A NULL node means the decision was too stale to be cached */
+	if (pcpu && node)
+		avc_pcpu_insert(ssid, tsid, tclass, gen, avd);
+
+	rcu_read_unlock();
+
+check:
 	denied = requested & ~(avd->allowed);
 	if (unlikely(denied))
 		rc = avc_denied(ssid, tsid, tclass, requested, 0, 0, flags, avd);
 
-	rcu_read_unlock();
 	return rc;
 }
 
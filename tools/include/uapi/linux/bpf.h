@@ -87,6 +87,10 @@ enum bpf_cmd {
 	BPF_PROG_GET_FD_BY_ID,
 	BPF_MAP_GET_FD_BY_ID,
 	BPF_OBJ_GET_INFO_BY_FD,
+	BPF_MAP_LOOKUP_BATCH,
+	BPF_MAP_LOOKUP_AND_DELETE_BATCH,
+	BPF_MAP_UPDATE_BATCH,
+	BPF_MAP_DELETE_BATCH,
 };
 
 enum bpf_map_type {
@@ -105,6 +109,7 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_ARRAY_OF_MAPS,
 	BPF_MAP_TYPE_HASH_OF_MAPS,
 	BPF_MAP_TYPE_DEVMAP,
+	BPF_MAP_TYPE_RINGBUF,
 };
 
 enum bpf_prog_type {
@@ -134,11 +139,47 @@ enum bpf_attach_type {
 
 #define MAX_BPF_ATTACH_TYPE __MAX_BPF_ATTACH_TYPE
 
-/* If BPF_F_ALLOW_OVERRIDE flag is used in BPF_PROG_ATTACH command
- * to the given target_fd cgroup the descendent cgroup will be able to
- * override effective bpf program that was inherited from this cgroup
+/* cgroup-bpf attach flags used in BPF_PROG_ATTACH command
+ *
+ * NONE(default): No further bpf programs allowed in the subtree.
+ *
+ * BPF_F_ALLOW_OVERRIDE: If a sub-cgroup installs some bpf program,
+ * the program in this cgroup yields to sub-cgroup program.
+ *
+ * BPF_F_ALLOW_MULTI: If a sub-cgroup installs some bpf program,
+ * that cgroup program gets run in addition to the program in this cgroup.
+ *
+ * Only one program is allowed to be attached to a cgroup with
+ * NONE or BPF_F_ALLOW_OVERRIDE flag.
+ * Attaching another program on top of NONE or BPF_F_ALLOW_OVERRIDE will
+ * release old program and attach the new one. Attach flags has to match.
+ *
+ * Multiple programs are allowed to be attached to a cgroup with
+ * BPF_F_ALLOW_MULTI flag. They are executed in FIFO order
+ * (those that were attached first, run first)
+ * The programs of sub-cgroup are executed first, then programs of
+ * this cgroup and then programs of parent cgroup.
+ * When children program makes decision (like picking TCP CA or sock bind)
+ * parent program has a chance to override it.
+ *
+ * A cgroup with MULTI or OVERRIDE flag allows any attach flags in sub-cgroups.
+ * A cgroup with NONE doesn't allow any programs in sub-cgroups.
+ * Ex1:
+ * cgrp1 (MULTI progs A, B) ->
+ *    cgrp2 (OVERRIDE prog C) ->
+ *      cgrp3 (MULTI prog D) ->
+ *        cgrp4 (OVERRIDE prog E) ->
+ *          cgrp5 (NONE prog F)
+ * the event in cgrp5 triggers execution of F,D,A,B in that order.
+ * if prog F is detached, the execution is E,D,A,B
+ * if prog F and D are detached, the execution is E,A,B
+ * if prog F, E and D are detached, the execution is C,A,B
+ *
+ * All eligible programs are executed regardless of return code from
+ * earlier programs.
  */
 #define BPF_F_ALLOW_OVERRIDE	(1U << 0)
+#define BPF_F_ALLOW_MULTI	(1U << 1)
 
 /* If BPF_F_STRICT_ALIGNMENT is used in BPF_PROG_LOAD command, the
  * verifier will perform strict alignment checking as if the kernel
@@ -162,6 +203,42 @@ enum bpf_attach_type {
  * across different LRU lists.
  */
 #define BPF_F_NO_COMMON_LRU	(1U << 1)
+/* Start with a small hash table and let it grow and shrink with the
+ * number of elements, up to the size max_entries would give it.
+ * Needs BPF_F_NO_PREALLOC; not for LRU maps.
+ */
+#define BPF_F_RESIZABLE		(1U << 2)
+/* A stack trace map that keeps each distinct stack once, in as little
+ * room as it needs, instead of one max-depth bucket per stackid.
+ */
+#define BPF_F_STACK_DEDUP	(1U << 3)
+/* With BPF_F_STACK_DEDUP, store frames as struct bpf_stack_build_id */
+#define BPF_F_STACK_BUILD_ID	(1U << 4)
+/* Let BPF_MAP_TYPE_[PERCPU_]ARRAY be mmap()ed by userspace.  Elements
+ * start at offset 0, round_up(value_size, 8) bytes apart.  A per-CPU
+ * array lays out all elements of CPU n after those of CPU n - 1, each
+ * CPU starting on a page boundary.
+ */
+#define BPF_F_MMAPABLE		(1U << 5)
+
+#define BPF_BUILD_ID_SIZE 20
+enum bpf_stack_build_id_status {
+	/* user space needs an empty entry to identify the end of a trace */
+	BPF_STACK_BUILD_ID_EMPTY = 0,
+	/* with valid build_id and offset */
+	BPF_STACK_BUILD_ID_VALID = 1,
+	/* couldn't get build_id, fallback to ip */
+	BPF_STACK_BUILD_ID_IP = 2,
+};
+
+struct bpf_stack_build_id {
+	__s32		status;
+	unsigned char	build_id[BPF_BUILD_ID_SIZE];
+	union {
+		__u64	offset;
+		__u64	ip;
+	};
+};
 
 union bpf_attr {
 	struct { /* anonymous struct used by BPF_MAP_CREATE command */
@@ -183,6 +260,23 @@ union bpf_attr {
 		__u64		flags;
 	};
 
+	struct { /* struct used by BPF_MAP_*_BATCH commands */
+		__aligned_u64	in_batch;	/* start batch,
+						 * NULL to start from beginning
+						 */
+		__aligned_u64	out_batch;	/* output: next start batch */
+		__aligned_u64	keys;
+		__aligned_u64	values;
+		__u32		count;		/* input/output:
+						 * input: # of key/value
+						 * elements
+						 * output: # of filled elements
+						 */
+		__u32		map_fd;
+		__u64		elem_flags;
+		__u64		flags;
+	} batch;
+
 	struct { /* anonymous struct used by BPF_PROG_LOAD command */
 		__u32		prog_type;	/* one of enum bpf_prog_type */
 		__u32		insn_cnt;
@@ -371,7 +465,8 @@ union bpf_attr {
  *             bit 8 - collect user stack instead of kernel
  *             bit 9 - compare stacks by hash only
  *             bit 10 - if two different stacks hash into the same stackid
- *                      discard old
+ *                      discard old (no effect with BPF_F_STACK_DEDUP,
+ *                      which keeps both)
  *             other bits - reserved
  *     Return: >= 0 stackid on success or negative error
  *
@@ -540,6 +635,40 @@ union bpf_attr {
  *     @mode: operation mode (enum bpf_adj_room_mode)
  *     @flags: reserved for future use
  *     Return: 0 on success or negative error code
+ *
+ * int bpf_ringbuf_output(map, data, size, flags)
+ *     Copy data into a BPF_MAP_TYPE_RINGBUF map as a new record.
+ *     @map: pointer to ringbuf map
+ *     @data: pointer to the data
+ *     @size: size of the data
+ *     @flags: BPF_RB_NO_WAKEUP or BPF_RB_FORCE_WAKEUP
+ *     Return: 0 on success or -EAGAIN if the ring is full
+ *
+ * void *bpf_ringbuf_reserve(map, flags)
+ *     Reserve a record of the map's value_size in a ringbuf map, for
+ *     the program to fill in place. The program must pass the record
+ *     to bpf_ringbuf_submit() or bpf_ringbuf_discard() before it exits.
+ *     @map: pointer to ringbuf map
+ *     @flags: reserved for future use
+ *     Return: pointer to the record or NULL if the ring is full
+ *
+ * void bpf_ringbuf_submit(data, flags)
+ *     Make a reserved record visible to the consumer.
+ *     @data: pointer returned by bpf_ringbuf_reserve()
+ *     @flags: BPF_RB_NO_WAKEUP or BPF_RB_FORCE_WAKEUP
+ *
+ * void bpf_ringbuf_discard(data, flags)
+ *     Release a reserved record; the consumer skips it.
+ *     @data: pointer returned by bpf_ringbuf_reserve()
+ *     @flags: BPF_RB_NO_WAKEUP or BPF_RB_FORCE_WAKEUP
+ *
+ * u64 bpf_ringbuf_query(map, flags)
+ *     Read a property of a ringbuf map; the value may be stale by the
+ *     time the program uses it.
+ *     @map: pointer to ringbuf map
+ *     @flags: BPF_RB_AVAIL_DATA, BPF_RB_RING_SIZE, BPF_RB_CONS_POS or
+ *     BPF_RB_PROD_POS
+ *     Return: the requested value, or 0 for unknown flags
  */
 #define __BPF_FUNC_MAPPER(FN)		\
 	FN(unspec),			\
@@ -592,7 +721,13 @@ union bpf_attr {
 	FN(get_socket_uid),		\
 	FN(set_hash),			\
 	FN(setsockopt),			\
-	FN(skb_adjust_room),
+	FN(skb_adjust_room),		\
+	FN(redirect_map),		\
+	FN(ringbuf_output),		\
+	FN(ringbuf_reserve),		\
+	FN(ringbuf_submit),		\
+	FN(ringbuf_discard),		\
+	FN(ringbuf_query),
 
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
  * function eBPF program intends to call
@@ -647,6 +782,29 @@ enum bpf_adj_room_mode {
 	BPF_ADJ_ROOM_NET_OPTS,
 };
 
+/* BPF_FUNC_ringbuf_output, BPF_FUNC_ringbuf_submit and
+ * BPF_FUNC_ringbuf_discard flags.
+ */
+#define BPF_RB_NO_WAKEUP		(1ULL << 0)
+#define BPF_RB_FORCE_WAKEUP		(1ULL << 1)
+
+/* BPF_FUNC_ringbuf_query flags. */
+enum {
+	BPF_RB_AVAIL_DATA = 0,
+	BPF_RB_RING_SIZE = 1,
+	BPF_RB_CONS_POS = 2,
+	BPF_RB_PROD_POS = 3,
+};
+
+/* Each BPF_MAP_TYPE_RINGBUF record starts with an 8-byte header: the
+ * length of the data in a __u32, with BPF_RINGBUF_BUSY_BIT set while
+ * the record is reserved and BPF_RINGBUF_DISCARD_BIT if it was
+ * discarded, then a __u32 for the kernel. Records are 8-byte aligned.
+ */
+#define BPF_RINGBUF_BUSY_BIT		(1U << 31)
+#define BPF_RINGBUF_DISCARD_BIT		(1U << 30)
+#define BPF_RINGBUF_HDR_SZ		8
+
 /* user accessible mirror of in-kernel sk_buff.
  * new fields can only be added to the end of this structure
  */
@@ -738,6 +896,11 @@ struct bpf_prog_info {
 	__u32 xlated_prog_len;
 	__aligned_u64 jited_prog_insns;
 	__aligned_u64 xlated_prog_insns;
+	/* what verifying the program took */
+	__u32 verified_insns;
+	__u32 verifier_states;
+	__u32 verifier_peak_states;
+	__u32 verifier_peak_mem;
 } __attribute__((aligned(8)));
 
 struct bpf_map_info {
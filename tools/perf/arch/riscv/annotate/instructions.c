@@ -0,0 +1,45 @@
+/*
+ * riscv instruction classification for perf annotate.
+ *
+ * Copyright (C) 2017 SiFive
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * objdump prints the link-register forms as "jal <target>", "call" and
+ * "tail" for the auipc pairs, and the branch pseudo-instructions ("beqz",
+ * "bgtu", ...) with the target last.
+ */
+static struct ins_ops *riscv__associate_instruction_ops(struct arch *arch, const char *name)
+{
+	struct ins_ops *ops = NULL;
+
+	if (!strcmp(name, "ret") || !strcmp(name, "sret") || !strcmp(name, "mret"))
+		ops = &ret_ops;
+	else if (!strcmp(name, "jal") || !strcmp(name, "jalr") || !strcmp(name, "call"))
+		ops = &call_ops;
+	else if (!strcmp(name, "j") || !strcmp(name, "jr") || !strcmp(name, "tail") ||
+		 (name[0] == 'b' && strcmp(name, "break")))
+		ops = &jump_ops;
+	else if (!strcmp(name, "nop"))
+		ops = &nop_ops;
+	else
+		return NULL;
+
+	arch__associate_ins_ops(arch, name, ops);
+	return ops;
+}
+
+static int riscv__annotate_init(struct arch *arch)
+{
+	if (!arch->initialized) {
+		arch->initialized = true;
+		arch->associate_instruction_ops = riscv__associate_instruction_ops;
+		arch->objdump.comment_char	= '#';
+	}
+
+	return 0;
+}
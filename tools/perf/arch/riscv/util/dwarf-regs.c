@@ -0,0 +1,34 @@
+/*
+ * Mapping of DWARF debug register numbers into register names.
+ *
+ * Copyright (C) 2017 SiFive
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <stddef.h>
+#include <dwarf-regs.h>
+
+/*
+ * DWARF numbers 0-31 are x0-x31; the kprobe tracer wants the names used
+ * by struct pt_regs in arch/riscv/include/asm/ptrace.h, where x0 (which
+ * is always zero) is replaced by the saved pc.
+ */
+#define RISCV_MAX_REGS 32
+static const char * const riscv_regs_table[RISCV_MAX_REGS] = {
+	"%sepc", "%ra", "%sp", "%gp", "%tp", "%t0", "%t1", "%t2",
+	"%s0", "%s1", "%a0", "%a1", "%a2", "%a3", "%a4", "%a5",
+	"%a6", "%a7", "%s2", "%s3", "%s4", "%s5", "%s6", "%s7",
+	"%s8", "%s9", "%s10", "%s11", "%t3", "%t4", "%t5", "%t6",
+};
+
+/* Return architecture dependent register string (for kprobe-tracer) */
+const char *get_arch_regstr(unsigned int n)
+{
+	/* x0 is hardwired to zero and never holds a variable */
+	if (n == 0 || n >= RISCV_MAX_REGS)
+		return NULL;
+	return riscv_regs_table[n];
+}
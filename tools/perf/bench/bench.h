@@ -36,6 +36,10 @@ int bench_futex_wake_parallel(int argc, const char **argv);
 int bench_futex_requeue(int argc, const char **argv);
 /* pi futexes */
 int bench_futex_lock_pi(int argc, const char **argv);
+int bench_riscv_syscall(int argc, const char **argv);
+int bench_riscv_ipi(int argc, const char **argv);
+int bench_riscv_sfence_vma(int argc, const char **argv);
+int bench_riscv_fence_i(int argc, const char **argv);
 
 #define BENCH_FORMAT_DEFAULT_STR	"default"
 #define BENCH_FORMAT_DEFAULT		0
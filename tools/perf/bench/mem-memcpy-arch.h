@@ -10,3 +10,14 @@
 
 #endif
 
+#ifdef HAVE_ARCH_RISCV_SUPPORT
+
+#define MEMCPY_FN(fn, name, desc)		\
+	void *fn(void *, const void *, size_t);
+
+#include "mem-memcpy-riscv-asm-def.h"
+
+#undef MEMCPY_FN
+
+#endif
+
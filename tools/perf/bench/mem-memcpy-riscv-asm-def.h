@@ -0,0 +1,4 @@
+
+MEMCPY_FN(memcpy_riscv,
+	"riscv",
+	"memcpy() in arch/riscv/lib/memcpy.S")
@@ -10,3 +10,14 @@
 
 #endif
 
+#ifdef HAVE_ARCH_RISCV_SUPPORT
+
+#define MEMSET_FN(fn, name, desc)		\
+	void *fn(void *, int, size_t);
+
+#include "mem-memset-riscv-asm-def.h"
+
+#undef MEMSET_FN
+
+#endif
+
@@ -0,0 +1,4 @@
+
+MEMSET_FN(memset_riscv,
+	"riscv",
+	"memset() in arch/riscv/lib/memset.S")
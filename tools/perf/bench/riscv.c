@@ -0,0 +1,232 @@
+/*
+ * riscv.c
+ *
+ * riscv: Benchmarks for the RISC-V kernel paths that are on every system
+ * call, or that have to reach other harts: null system calls, IPIs,
+ * remote sfence.vma and fence.i broadcasts.
+ *
+ * Copyright (C) 2017 SiFive
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include <subcmd/parse-options.h>
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <linux/time64.h>
+
+#include <pthread.h>
+
+/* Older C libraries don't know about these yet */
+#ifndef __NR_membarrier
+#define __NR_membarrier		283
+#endif
+#ifndef __NR_riscv_flush_icache
+#define __NR_riscv_flush_icache	(244 + 15)
+#endif
+#define MEMBARRIER_PRIVATE_EXPEDITED	(1 << 3)
+
+#define LOOPS_DEFAULT 100000
+static	int			loops = LOOPS_DEFAULT;
+
+/* By default one thread spins on every other online CPU */
+static	int			nr_threads = -1;
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop",	&loops,		"Specify number of loops"),
+	OPT_INTEGER('t', "threads",	&nr_threads,	"Specify number of threads spinning on other CPUs"),
+	OPT_END()
+};
+
+/*
+ * The spinning threads run in userspace on the other CPUs, so that the
+ * process' mm is live there and IPIs, TLB shootdowns and icache flushes
+ * for it really have to reach them.  They keep reading the page, so that
+ * its translation stays in their TLBs.
+ */
+static volatile bool		done;
+static volatile char		*page;
+static long			page_size;
+
+static void *spin_thread(void *arg __maybe_unused)
+{
+	while (!done)
+		(void)page[0];
+
+	return NULL;
+}
+
+static void bind_to_cpu(pthread_t thread, int cpu)
+{
+	cpu_set_t mask;
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	pthread_setaffinity_np(thread, sizeof(mask), &mask);
+}
+
+static int do_syscall(void)
+{
+	return syscall(__NR_getppid) < 0 ? -1 : 0;
+}
+
+static int do_ipi(void)
+{
+	return syscall(__NR_membarrier, MEMBARRIER_PRIVATE_EXPEDITED, 0);
+}
+
+static int do_sfence_vma(void)
+{
+	static bool writable;
+
+	/* Every change of protection on a mapped page is a shootdown */
+	writable = !writable;
+	return mprotect((void *)page, page_size,
+			writable ? PROT_READ | PROT_WRITE : PROT_READ);
+}
+
+static int do_fence_i(void)
+{
+	return syscall(__NR_riscv_flush_icache, page, page + page_size, 0);
+}
+
+static int run_bench(int argc, const char **argv, const char * const *usage,
+		     const char *what, int (*op)(void), bool spin)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec;
+	pthread_t *threads = NULL;
+	int nr_cpus, t, i;
+
+	argc = parse_options(argc, argv, options, usage, 0);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	page = mmap(NULL, page_size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	BUG_ON(page == MAP_FAILED);
+	page[0] = 0;
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!spin)
+		nr_threads = 0;
+	else if (nr_threads < 0 || nr_threads > nr_cpus - 1)
+		nr_threads = nr_cpus - 1;
+
+	bind_to_cpu(pthread_self(), 0);
+	if (nr_threads) {
+		threads = calloc(nr_threads, sizeof(*threads));
+		BUG_ON(!threads);
+	}
+	for (t = 0; t < nr_threads; t++) {
+		BUG_ON(pthread_create(&threads[t], NULL, spin_thread, NULL));
+		bind_to_cpu(threads[t], t + 1);
+	}
+
+	if (op()) {
+		fprintf(stderr, "%s: not supported by this kernel: %s\n",
+			what, strerror(errno));
+		done = true;
+		goto out;
+	}
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < loops; i++)
+		op();
+	gettimeofday(&stop, NULL);
+	done = true;
+
+	timersub(&stop, &start, &diff);
+	result_usec = diff.tv_sec * USEC_PER_SEC + diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Executed %d %s with %d other CPUs busy\n\n",
+		       loops, what, nr_threads);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / USEC_PER_MSEC));
+
+		printf(" %14lf usecs/op\n",
+		       (double)result_usec / (double)loops);
+		printf(" %14d ops/sec\n",
+		       (int)((double)loops /
+			     ((double)result_usec / (double)USEC_PER_SEC)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / USEC_PER_MSEC));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+out:
+	for (t = 0; t < nr_threads; t++)
+		pthread_join(threads[t], NULL);
+	free(threads);
+	munmap((void *)page, page_size);
+	done = false;
+
+	return 0;
+}
+
+static const char * const bench_riscv_syscall_usage[] = {
+	"perf bench riscv syscall <options>",
+	NULL
+};
+
+int bench_riscv_syscall(int argc, const char **argv)
+{
+	return run_bench(argc, argv, bench_riscv_syscall_usage,
+			 "getppid() system calls", do_syscall, false);
+}
+
+static const char * const bench_riscv_ipi_usage[] = {
+	"perf bench riscv ipi <options>",
+	NULL
+};
+
+int bench_riscv_ipi(int argc, const char **argv)
+{
+	return run_bench(argc, argv, bench_riscv_ipi_usage,
+			 "expedited membarrier() IPI rounds", do_ipi, true);
+}
+
+static const char * const bench_riscv_sfence_vma_usage[] = {
+	"perf bench riscv sfence-vma <options>",
+	NULL
+};
+
+int bench_riscv_sfence_vma(int argc, const char **argv)
+{
+	return run_bench(argc, argv, bench_riscv_sfence_vma_usage,
+			 "mprotect() TLB shootdowns", do_sfence_vma, true);
+}
+
+static const char * const bench_riscv_fence_i_usage[] = {
+	"perf bench riscv fence-i <options>",
+	NULL
+};
+
+int bench_riscv_fence_i(int argc, const char **argv)
+{
+	return run_bench(argc, argv, bench_riscv_fence_i_usage,
+			 "riscv_flush_icache() broadcasts", do_fence_i, true);
+}
@@ -13,6 +13,7 @@
  *  mem   ... memory access performance
  *  numa  ... NUMA scheduling and MM performance
  *  futex ... Futex performance
+ *  riscv ... RISC-V system call and cross-hart performance
  */
 #include "perf.h"
 #include "util/util.h"
@@ -66,6 +67,17 @@ static struct bench futex_benchmarks[] = {
 	{ NULL,		NULL,						NULL			}
 };
 
+#ifdef HAVE_ARCH_RISCV_SUPPORT
+static struct bench riscv_benchmarks[] = {
+	{ "syscall",	"Benchmark for null system calls",		bench_riscv_syscall	},
+	{ "ipi",	"Benchmark for IPIs to the other harts",	bench_riscv_ipi		},
+	{ "sfence-vma",	"Benchmark for remote TLB shootdowns",		bench_riscv_sfence_vma	},
+	{ "fence-i",	"Benchmark for icache flush broadcasts",	bench_riscv_fence_i	},
+	{ "all",	"Run all RISC-V benchmarks",			NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+#endif
+
 struct collection {
 	const char	*name;
 	const char	*summary;
@@ -79,6 +91,9 @@ static struct collection collections[] = {
 	{ "numa",	"NUMA scheduling and MM benchmarks",		numa_benchmarks		},
 #endif
 	{"futex",       "Futex stressing benchmarks",                   futex_benchmarks        },
+#ifdef HAVE_ARCH_RISCV_SUPPORT
+	{ "riscv",	"RISC-V system call and cross-hart benchmarks",	riscv_benchmarks	},
+#endif
 	{ "all",	"All benchmarks",				NULL			},
 	{ NULL,		NULL,						NULL			}
 };
@@ -595,6 +595,7 @@ static size_t syscall_arg__scnprintf_getrandom_flags(char *bf, size_t size,
 #include "trace/beauty/open_flags.c"
 #include "trace/beauty/perf_event_open.c"
 #include "trace/beauty/pid.c"
+#include "trace/beauty/riscv_flush_icache.c"
 #include "trace/beauty/sched_policy.c"
 #include "trace/beauty/seccomp.c"
 #include "trace/beauty/signum.c"
@@ -752,6 +753,11 @@ static struct syscall_fmt {
 	  .arg = { [2] = { .scnprintf = SCA_MSG_FLAGS, /* flags */ }, }, },
 	{ .name	    = "renameat",
 	  .arg = { [0] = { .scnprintf = SCA_FDAT, /* dfd */ }, }, },
+	{ .name	    = "riscv_flush_icache",
+	  .arg = { [0] = { .scnprintf = SCA_HEX, /* start */ },
+		   [1] = { .scnprintf = SCA_HEX, /* end */ },
+		   [2] = { .scnprintf = SCA_RISCV_FLUSH_ICACHE_FLAGS, /* flags */
+			   .show_zero = true, }, }, },
 	{ .name	    = "rt_sigaction",
 	  .arg = { [0] = { .scnprintf = SCA_SIGNUM, /* sig */ }, }, },
 	{ .name	    = "rt_sigprocmask",
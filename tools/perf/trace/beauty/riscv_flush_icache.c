@@ -0,0 +1,26 @@
+#ifndef SYS_RISCV_FLUSH_ICACHE_LOCAL
+#define SYS_RISCV_FLUSH_ICACHE_LOCAL	1
+#endif
+
+static size_t syscall_arg__scnprintf_riscv_flush_icache_flags(char *bf, size_t size, struct syscall_arg *arg)
+{
+	int printed = 0, flags = arg->val;
+
+	if (flags == 0)
+		return scnprintf(bf, size, "ALL");
+#define	P_FLAG(n) \
+	if (flags & SYS_RISCV_FLUSH_ICACHE_##n) { \
+		printed += scnprintf(bf + printed, size - printed, "%s%s", printed ? "|" : "", #n); \
+		flags &= ~SYS_RISCV_FLUSH_ICACHE_##n; \
+	}
+
+	P_FLAG(LOCAL);
+#undef P_FLAG
+
+	if (flags)
+		printed += scnprintf(bf + printed, size - printed, "%s%#x", printed ? "|" : "", flags);
+
+	return printed;
+}
+
+#define SCA_RISCV_FLUSH_ICACHE_FLAGS syscall_arg__scnprintf_riscv_flush_icache_flags
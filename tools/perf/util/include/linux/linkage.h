@@ -10,4 +10,10 @@
 
 #define ENDPROC(name)
 
+#define END(name)
+
+#define WEAK(name)				\
+	.weak name;				\
+	name:
+
 #endif	/* PERF_LINUX_LINKAGE_H_ */
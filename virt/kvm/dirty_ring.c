@@ -0,0 +1,129 @@
+/*
+ * KVM dirty ring
+ *
+ * Each vcpu logs the guest frames it dirties into a ring that userspace
+ * maps from the vcpu fd.  Only the vcpu thread produces entries; userspace
+ * consumes them and KVM_RESET_DIRTY_RINGS recycles what it has collected.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/kvm_host.h>
+#include <linux/vmalloc.h>
+#include <linux/kvm.h>
+
+#include "dirty_ring.h"
+
+int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, u32 size)
+{
+	ring->gfns = vmalloc_user(size);
+	if (!ring->gfns)
+		return -ENOMEM;
+
+	ring->size = size / sizeof(struct kvm_dirty_gfn);
+	ring->dirty_index = 0;
+	ring->reset_index = 0;
+
+	return 0;
+}
+
+void kvm_dirty_ring_free(struct kvm_dirty_ring *ring)
+{
+	vfree(ring->gfns);
+	ring->gfns = NULL;
+}
+
+struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring, u32 offset)
+{
+	return vmalloc_to_page((void *)ring->gfns + offset * PAGE_SIZE);
+}
+
+/*
+ * Log a dirtied frame.  Returns false when the ring is full, in which case
+ * the caller falls back to the memslot dirty bitmap so nothing is lost.
+ */
+bool kvm_dirty_ring_push(struct kvm_dirty_ring *ring, u32 slot, u64 offset)
+{
+	struct kvm_dirty_gfn *entry;
+
+	/* Pairs with the release in kvm_dirty_ring_reset() */
+	if (ring->dirty_index - smp_load_acquire(&ring->reset_index) >=
+	    ring->size)
+		return false;
+
+	entry = &ring->gfns[ring->dirty_index & (ring->size - 1)];
+	entry->slot = slot;
+	entry->offset = offset;
+	/* Userspace may read the entry as soon as it sees it flagged */
+	smp_wmb();
+	WRITE_ONCE(entry->flags, KVM_DIRTY_GFN_F_DIRTY);
+	ring->dirty_index++;
+
+	return true;
+}
+
+static void kvm_reset_dirty_gfn(struct kvm *kvm, u32 slot, u64 offset,
+				unsigned long mask)
+{
+	struct kvm_memory_slot *memslot;
+	int as_id = slot >> 16;
+	int id = (u16)slot;
+
+	if (as_id >= KVM_ADDRESS_SPACE_NUM || id >= KVM_USER_MEM_SLOTS)
+		return;
+
+	memslot = id_to_memslot(__kvm_memslots(kvm, as_id), id);
+	if (!memslot->dirty_bitmap ||
+	    offset + __fls(mask) >= memslot->npages)
+		return;
+
+	spin_lock(&kvm->mmu_lock);
+	kvm_arch_mmu_enable_log_dirty_pt_masked(kvm, memslot, offset, mask);
+	spin_unlock(&kvm->mmu_lock);
+}
+
+/*
+ * Write-protect again the frames of all entries userspace has flagged
+ * RESET, in order, and hand the entries back to the vcpu.  Nearby frames
+ * of a slot are folded into one mask.  Caller holds kvm->slots_lock and
+ * flushes the TLBs when anything was reset.  Returns the entry count.
+ */
+int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring)
+{
+	u32 cur_slot = 0, next_slot;
+	u64 cur_offset = 0, next_offset;
+	unsigned long mask = 0;
+	struct kvm_dirty_gfn *entry;
+	int count = 0;
+
+	for (;;) {
+		entry = &ring->gfns[ring->reset_index & (ring->size - 1)];
+		if (READ_ONCE(entry->flags) != KVM_DIRTY_GFN_F_RESET)
+			break;
+		smp_rmb();
+		next_slot = READ_ONCE(entry->slot);
+		next_offset = READ_ONCE(entry->offset);
+
+		WRITE_ONCE(entry->flags, 0);
+		smp_store_release(&ring->reset_index, ring->reset_index + 1);
+		count++;
+
+		if (mask && next_slot == cur_slot &&
+		    next_offset >= cur_offset &&
+		    next_offset - cur_offset < BITS_PER_LONG) {
+			mask |= 1UL << (next_offset - cur_offset);
+			continue;
+		}
+		if (mask)
+			kvm_reset_dirty_gfn(kvm, cur_slot, cur_offset, mask);
+		cur_slot = next_slot;
+		cur_offset = next_offset;
+		mask = 1;
+	}
+
+	if (mask)
+		kvm_reset_dirty_gfn(kvm, cur_slot, cur_offset, mask);
+
+	return count;
+}
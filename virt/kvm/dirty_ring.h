@@ -0,0 +1,61 @@
+#ifndef __KVM_DIRTY_RING_H__
+#define __KVM_DIRTY_RING_H__
+
+/*
+ * KVM dirty ring
+ *
+ * Per-vcpu rings of dirtied guest frames shared with userspace, so that
+ * a migration round costs the number of dirtied pages rather than a scan
+ * of every memslot bitmap.
+ */
+
+#ifdef CONFIG_KVM_GENERIC_DIRTYLOG_READ_PROTECT
+
+/* 64K entries, 1MB per vcpu */
+#define KVM_DIRTY_RING_MAX_SIZE	(65536 * sizeof(struct kvm_dirty_gfn))
+
+int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, u32 size);
+void kvm_dirty_ring_free(struct kvm_dirty_ring *ring);
+bool kvm_dirty_ring_push(struct kvm_dirty_ring *ring, u32 slot, u64 offset);
+int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring);
+struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring, u32 offset);
+
+static inline bool kvm_page_in_dirty_ring(struct kvm *kvm, unsigned long pgoff)
+{
+	return pgoff >= KVM_DIRTY_LOG_PAGE_OFFSET &&
+	       pgoff < KVM_DIRTY_LOG_PAGE_OFFSET +
+		       kvm->dirty_ring_size / PAGE_SIZE;
+}
+
+#else
+
+#define KVM_DIRTY_RING_MAX_SIZE	0
+
+static inline int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, u32 size)
+{
+	return 0;
+}
+static inline void kvm_dirty_ring_free(struct kvm_dirty_ring *ring) { }
+static inline bool kvm_dirty_ring_push(struct kvm_dirty_ring *ring, u32 slot,
+				       u64 offset)
+{
+	return false;
+}
+static inline int kvm_dirty_ring_reset(struct kvm *kvm,
+				       struct kvm_dirty_ring *ring)
+{
+	return 0;
+}
+static inline struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring,
+						   u32 offset)
+{
+	return NULL;
+}
+static inline bool kvm_page_in_dirty_ring(struct kvm *kvm, unsigned long pgoff)
+{
+	return false;
+}
+
+#endif
+
+#endif
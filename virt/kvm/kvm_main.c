@@ -28,6 +28,7 @@
 #include <linux/vmalloc.h>
 #include <linux/reboot.h>
 #include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/highmem.h>
 #include <linux/file.h>
 #include <linux/syscore_ops.h>
@@ -61,6 +62,7 @@
 #include "coalesced_mmio.h"
 #include "async_pf.h"
 #include "vfio.h"
+#include "dirty_ring.h"
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/kvm.h>
@@ -86,6 +88,11 @@ unsigned int halt_poll_ns_shrink;
 module_param(halt_poll_ns_shrink, uint, 0644);
 EXPORT_SYMBOL_GPL(halt_poll_ns_shrink);
 
+/* Don't poll, and back off polling, while other tasks wait for the CPU. */
+bool halt_poll_load_aware = true;
+module_param(halt_poll_load_aware, bool, 0644);
+EXPORT_SYMBOL_GPL(halt_poll_load_aware);
+
 /*
  * Ordering of locks:
  *
@@ -97,6 +104,8 @@ static DEFINE_RAW_SPINLOCK(kvm_count_lock);
 LIST_HEAD(vm_list);
 
 static cpumask_var_t cpus_hardware_enabled;
+/* The vcpu loaded on each cpu, if any, for logging to its dirty ring */
+static DEFINE_PER_CPU(struct kvm_vcpu *, kvm_running_vcpu);
 static int kvm_usage_count;
 static atomic_t hardware_enable_failed;
 
@@ -154,6 +163,7 @@ int vcpu_load(struct kvm_vcpu *vcpu)
 	if (mutex_lock_killable(&vcpu->mutex))
 		return -EINTR;
 	cpu = get_cpu();
+	__this_cpu_write(kvm_running_vcpu, vcpu);
 	preempt_notifier_register(&vcpu->preempt_notifier);
 	kvm_arch_vcpu_load(vcpu, cpu);
 	put_cpu();
@@ -166,11 +176,28 @@ void vcpu_put(struct kvm_vcpu *vcpu)
 	preempt_disable();
 	kvm_arch_vcpu_put(vcpu);
 	preempt_notifier_unregister(&vcpu->preempt_notifier);
+	__this_cpu_write(kvm_running_vcpu, NULL);
 	preempt_enable();
 	mutex_unlock(&vcpu->mutex);
 }
 EXPORT_SYMBOL_GPL(vcpu_put);
 
+/*
+ * The vcpu the current task has loaded, or NULL.  Stable for the caller
+ * since the preempt notifiers carry it across reschedules.
+ */
+struct kvm_vcpu *kvm_get_running_vcpu(void)
+{
+	struct kvm_vcpu *vcpu;
+
+	preempt_disable();
+	vcpu = __this_cpu_read(kvm_running_vcpu);
+	preempt_enable();
+
+	return vcpu;
+}
+EXPORT_SYMBOL_GPL(kvm_get_running_vcpu);
+
 /* TODO: merge with kvm_arch_vcpu_should_kick */
 static bool kvm_request_needs_ipi(struct kvm_vcpu *vcpu, unsigned req)
 {
@@ -205,29 +232,47 @@ static inline bool kvm_kick_many_cpus(const struct cpumask *cpus, bool wait)
 	return true;
 }
 
-bool kvm_make_all_cpus_request(struct kvm *kvm, unsigned int req)
+bool kvm_make_vcpus_request_mask(struct kvm *kvm, unsigned int req,
+				 unsigned long *vcpu_bitmap, cpumask_var_t tmp)
 {
 	int i, cpu, me;
-	cpumask_var_t cpus;
-	bool called;
 	struct kvm_vcpu *vcpu;
-
-	zalloc_cpumask_var(&cpus, GFP_ATOMIC);
+	bool called;
 
 	me = get_cpu();
+
 	kvm_for_each_vcpu(i, vcpu, kvm) {
+		if (!test_bit(i, vcpu_bitmap))
+			continue;
+
 		kvm_make_request(req, vcpu);
 		cpu = vcpu->cpu;
 
 		if (!(req & KVM_REQUEST_NO_WAKEUP) && kvm_vcpu_wake_up(vcpu))
 			continue;
 
-		if (cpus != NULL && cpu != -1 && cpu != me &&
+		if (tmp != NULL && cpu != -1 && cpu != me &&
 		    kvm_request_needs_ipi(vcpu, req))
-			__cpumask_set_cpu(cpu, cpus);
+			__cpumask_set_cpu(cpu, tmp);
 	}
-	called = kvm_kick_many_cpus(cpus, !!(req & KVM_REQUEST_WAIT));
+
+	called = kvm_kick_many_cpus(tmp, !!(req & KVM_REQUEST_WAIT));
 	put_cpu();
+
+	return called;
+}
+
+bool kvm_make_all_cpus_request(struct kvm *kvm, unsigned int req)
+{
+	cpumask_var_t cpus;
+	bool called;
+	static unsigned long vcpu_bitmap[BITS_TO_LONGS(KVM_MAX_VCPUS)]
+		= {[0 ... BITS_TO_LONGS(KVM_MAX_VCPUS)-1] = ULONG_MAX};
+
+	zalloc_cpumask_var(&cpus, GFP_ATOMIC);
+
+	called = kvm_make_vcpus_request_mask(kvm, req, vcpu_bitmap, cpus);
+
 	free_cpumask_var(cpus);
 	return called;
 }
@@ -291,11 +336,20 @@ int kvm_vcpu_init(struct kvm_vcpu *vcpu, struct kvm *kvm, unsigned id)
 	kvm_vcpu_set_dy_eligible(vcpu, false);
 	vcpu->preempted = false;
 
+	if (kvm->dirty_ring_size) {
+		r = kvm_dirty_ring_alloc(&vcpu->dirty_ring,
+					 kvm->dirty_ring_size);
+		if (r)
+			goto fail_free_run;
+	}
+
 	r = kvm_arch_vcpu_init(vcpu);
 	if (r < 0)
-		goto fail_free_run;
+		goto fail_free_ring;
 	return 0;
 
+fail_free_ring:
+	kvm_dirty_ring_free(&vcpu->dirty_ring);
 fail_free_run:
 	free_page((unsigned long)vcpu->run);
 fail:
@@ -312,6 +366,7 @@ void kvm_vcpu_uninit(struct kvm_vcpu *vcpu)
 	 */
 	put_pid(rcu_dereference_protected(vcpu->pid, 1));
 	kvm_arch_vcpu_uninit(vcpu);
+	kvm_dirty_ring_free(&vcpu->dirty_ring);
 	free_page((unsigned long)vcpu->run);
 }
 EXPORT_SYMBOL_GPL(kvm_vcpu_uninit);
@@ -2080,12 +2135,40 @@ int kvm_clear_guest(struct kvm *kvm, gpa_t gpa, unsigned long len)
 }
 EXPORT_SYMBOL_GPL(kvm_clear_guest);
 
+/*
+ * Log to the dirty ring of the vcpu running on behalf of the slot's VM.
+ * Returns false to fall back to the bitmap: no vcpu context (a VM ioctl),
+ * a slot from an older memslots generation, or a full ring.
+ */
+static bool kvm_dirty_ring_log(struct kvm_memory_slot *memslot,
+			       unsigned long rel_gfn)
+{
+	struct kvm_vcpu *vcpu = kvm_get_running_vcpu();
+	int as_id;
+
+	if (!vcpu || !vcpu->kvm->dirty_ring_size)
+		return false;
+
+	for (as_id = 0; as_id < KVM_ADDRESS_SPACE_NUM; as_id++) {
+		struct kvm_memslots *slots = __kvm_memslots(vcpu->kvm, as_id);
+
+		if (id_to_memslot(slots, memslot->id) == memslot)
+			return kvm_dirty_ring_push(&vcpu->dirty_ring,
+						   (as_id << 16) | memslot->id,
+						   rel_gfn);
+	}
+
+	return false;
+}
+
 static void mark_page_dirty_in_slot(struct kvm_memory_slot *memslot,
 				    gfn_t gfn)
 {
 	if (memslot && memslot->dirty_bitmap) {
 		unsigned long rel_gfn = gfn - memslot->base_gfn;
 
+		if (kvm_dirty_ring_log(memslot, rel_gfn))
+			return;
 		set_bit_le(rel_gfn, memslot->dirty_bitmap);
 	}
 }
@@ -2142,6 +2225,18 @@ static void shrink_halt_poll_ns(struct kvm_vcpu *vcpu)
 	trace_kvm_halt_poll_ns_shrink(vcpu->vcpu_id, val, old);
 }
 
+/* Bucket 0 is below 1us, bucket n covers [2^(n-1), 2^n) us. */
+static void halt_poll_hist_add(u64 *hist, u64 ns)
+{
+	u64 us = div_u64(ns, NSEC_PER_USEC);
+	unsigned int b = 0;
+
+	if (us)
+		b = min_t(unsigned int, ilog2(us) + 1,
+			  KVM_HALT_POLL_HIST_BUCKETS - 1);
+	hist[b]++;
+}
+
 static int kvm_vcpu_check_block(struct kvm_vcpu *vcpu)
 {
 	if (kvm_arch_vcpu_runnable(vcpu)) {
@@ -2161,14 +2256,22 @@ static int kvm_vcpu_check_block(struct kvm_vcpu *vcpu)
  */
 void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 {
+	struct kvm_halt_poll_hist *hist = &vcpu->halt_poll_hist;
 	ktime_t start, cur;
 	DECLARE_SWAITQUEUE(wait);
 	bool waited = false;
+	bool contended = false;
 	u64 block_ns;
 
 	start = cur = ktime_get();
-	if (vcpu->halt_poll_ns) {
+	if (vcpu->halt_poll_ns && halt_poll_load_aware &&
+	    !single_task_running()) {
+		/* Polling would only delay the tasks queued behind us */
+		++hist->skipped;
+		contended = true;
+	} else if (vcpu->halt_poll_ns) {
 		ktime_t stop = ktime_add_ns(ktime_get(), vcpu->halt_poll_ns);
+		u64 poll_ns;
 
 		++vcpu->stat.halt_attempted_poll;
 		do {
@@ -2180,10 +2283,20 @@ void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 				++vcpu->stat.halt_successful_poll;
 				if (!vcpu_valid_wakeup(vcpu))
 					++vcpu->stat.halt_poll_invalid;
+				poll_ns = ktime_to_ns(ktime_sub(ktime_get(),
+								start));
+				halt_poll_hist_add(hist->success, poll_ns);
+				hist->success_ns += poll_ns;
 				goto out;
 			}
 			cur = ktime_get();
 		} while (single_task_running() && ktime_before(cur, stop));
+
+		/* Cut short because another task became runnable here */
+		contended = ktime_before(cur, stop);
+		poll_ns = ktime_to_ns(ktime_sub(cur, start));
+		halt_poll_hist_add(hist->wasted, poll_ns);
+		hist->wasted_ns += poll_ns;
 	}
 
 	kvm_arch_vcpu_blocking(vcpu);
@@ -2208,7 +2321,10 @@ out:
 	if (!vcpu_valid_wakeup(vcpu))
 		shrink_halt_poll_ns(vcpu);
 	else if (halt_poll_ns) {
-		if (block_ns <= vcpu->halt_poll_ns)
+		/* the host is overcommitted, give the CPU away instead */
+		if (contended && halt_poll_load_aware)
+			shrink_halt_poll_ns(vcpu);
+		else if (block_ns <= vcpu->halt_poll_ns)
 			;
 		/* we had a long block, shrink polling */
 		else if (vcpu->halt_poll_ns && block_ns > halt_poll_ns)
@@ -2387,6 +2503,9 @@ static int kvm_vcpu_fault(struct vm_fault *vmf)
 	else if (vmf->pgoff == KVM_COALESCED_MMIO_PAGE_OFFSET)
 		page = virt_to_page(vcpu->kvm->coalesced_mmio_ring);
 #endif
+	else if (kvm_page_in_dirty_ring(vcpu->kvm, vmf->pgoff))
+		page = kvm_dirty_ring_get_page(&vcpu->dirty_ring,
+				vmf->pgoff - KVM_DIRTY_LOG_PAGE_OFFSET);
 	else
 		return kvm_arch_vcpu_fault(vcpu, vmf);
 	get_page(page);
@@ -2431,15 +2550,48 @@ static int create_vcpu_fd(struct kvm_vcpu *vcpu)
 	return anon_inode_getfd("kvm-vcpu", &kvm_vcpu_fops, vcpu, O_RDWR | O_CLOEXEC);
 }
 
+static int halt_poll_hist_show(struct seq_file *m, void *v)
+{
+	struct kvm_vcpu *vcpu = m->private;
+	struct kvm_halt_poll_hist *hist = &vcpu->halt_poll_hist;
+	int i;
+
+	seq_printf(m, "%-10s %20s %20s\n", "us", "success", "wasted");
+	for (i = 0; i < KVM_HALT_POLL_HIST_BUCKETS; i++) {
+		char bucket[ITOA_MAX_LEN + 2];
+
+		if (i == KVM_HALT_POLL_HIST_BUCKETS - 1)
+			snprintf(bucket, sizeof(bucket), ">=%u", 1U << (i - 1));
+		else
+			snprintf(bucket, sizeof(bucket), "<%u", 1U << i);
+		seq_printf(m, "%-10s %20llu %20llu\n", bucket,
+			   hist->success[i], hist->wasted[i]);
+	}
+	seq_printf(m, "%-10s %20llu %20llu\n", "total_ns",
+		   hist->success_ns, hist->wasted_ns);
+	seq_printf(m, "%-10s %20llu\n", "skipped", hist->skipped);
+
+	return 0;
+}
+
+static int halt_poll_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, halt_poll_hist_show, inode->i_private);
+}
+
+static const struct file_operations halt_poll_hist_fops = {
+	.open		= halt_poll_hist_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int kvm_create_vcpu_debugfs(struct kvm_vcpu *vcpu)
 {
 	char dir_name[ITOA_MAX_LEN * 2];
 	int ret;
 
-	if (!kvm_arch_has_vcpu_debugfs())
-		return 0;
-
-	if (!debugfs_initialized())
+	if (!debugfs_initialized() || !vcpu->kvm->debugfs_dentry)
 		return 0;
 
 	snprintf(dir_name, sizeof(dir_name), "vcpu%d", vcpu->vcpu_id);
@@ -2448,13 +2600,25 @@ static int kvm_create_vcpu_debugfs(struct kvm_vcpu *vcpu)
 	if (!vcpu->debugfs_dentry)
 		return -ENOMEM;
 
-	ret = kvm_arch_create_vcpu_debugfs(vcpu);
-	if (ret < 0) {
-		debugfs_remove_recursive(vcpu->debugfs_dentry);
-		return ret;
+	if (!debugfs_create_file("halt_poll_hist", 0444, vcpu->debugfs_dentry,
+				 vcpu, &halt_poll_hist_fops)) {
+		ret = -ENOMEM;
+		goto out_remove;
 	}
 
+	if (!kvm_arch_has_vcpu_debugfs())
+		return 0;
+
+	ret = kvm_arch_create_vcpu_debugfs(vcpu);
+	if (ret < 0)
+		goto out_remove;
+
 	return 0;
+
+out_remove:
+	debugfs_remove_recursive(vcpu->debugfs_dentry);
+	vcpu->debugfs_dentry = NULL;
+	return ret;
 }
 
 /*
@@ -2560,7 +2724,8 @@ static long kvm_vcpu_ioctl(struct file *filp,
 	if (unlikely(_IOC_TYPE(ioctl) != KVMIO))
 		return -EINVAL;
 
-#if defined(CONFIG_S390) || defined(CONFIG_PPC) || defined(CONFIG_MIPS)
+#if defined(CONFIG_S390) || defined(CONFIG_PPC) || defined(CONFIG_MIPS) || \
+    defined(CONFIG_RISCV)
 	/*
 	 * Special cases: vcpu ioctls that are asynchronous to vcpu execution,
 	 * so vcpu_load() would break it.
@@ -2964,12 +3129,54 @@ static long kvm_vm_ioctl_check_extension_generic(struct kvm *kvm, long arg)
 #endif
 	case KVM_CAP_MAX_VCPU_ID:
 		return KVM_MAX_VCPU_ID;
+	case KVM_CAP_DIRTY_LOG_RING:
+		return KVM_DIRTY_RING_MAX_SIZE;
 	default:
 		break;
 	}
 	return kvm_vm_ioctl_check_extension(kvm, arg);
 }
 
+static int kvm_vm_ioctl_enable_dirty_log_ring(struct kvm *kvm, u32 size)
+{
+	int r;
+
+	/* A power of two of whole pages, so the ring indexes wrap cleanly */
+	if (!KVM_DIRTY_RING_MAX_SIZE || size < PAGE_SIZE ||
+	    !is_power_of_2(size) || size > KVM_DIRTY_RING_MAX_SIZE)
+		return -EINVAL;
+
+	mutex_lock(&kvm->lock);
+	if (kvm->created_vcpus || kvm->dirty_ring_size) {
+		r = -EBUSY;
+	} else {
+		kvm->dirty_ring_size = size;
+		r = 0;
+	}
+	mutex_unlock(&kvm->lock);
+
+	return r;
+}
+
+static int kvm_vm_ioctl_reset_dirty_pages(struct kvm *kvm)
+{
+	struct kvm_vcpu *vcpu;
+	int i, cleared = 0;
+
+	if (!kvm->dirty_ring_size)
+		return -EINVAL;
+
+	mutex_lock(&kvm->slots_lock);
+	kvm_for_each_vcpu(i, vcpu, kvm)
+		cleared += kvm_dirty_ring_reset(kvm, &vcpu->dirty_ring);
+	mutex_unlock(&kvm->slots_lock);
+
+	if (cleared)
+		kvm_flush_remote_tlbs(kvm);
+
+	return cleared;
+}
+
 static long kvm_vm_ioctl(struct file *filp,
 			   unsigned int ioctl, unsigned long arg)
 {
@@ -3131,6 +3338,26 @@ out_free_irq_routing:
 	case KVM_CHECK_EXTENSION:
 		r = kvm_vm_ioctl_check_extension_generic(kvm, arg);
 		break;
+	case KVM_ENABLE_CAP: {
+		struct kvm_enable_cap cap;
+
+		r = -EFAULT;
+		if (copy_from_user(&cap, argp, sizeof(cap)))
+			goto out;
+		/* Everything else is up to the architecture */
+		if (cap.cap != KVM_CAP_DIRTY_LOG_RING) {
+			r = kvm_arch_vm_ioctl(filp, ioctl, arg);
+			break;
+		}
+		r = -EINVAL;
+		if (cap.flags || cap.args[0] > U32_MAX)
+			goto out;
+		r = kvm_vm_ioctl_enable_dirty_log_ring(kvm, cap.args[0]);
+		break;
+	}
+	case KVM_RESET_DIRTY_RINGS:
+		r = kvm_vm_ioctl_reset_dirty_pages(kvm);
+		break;
 	default:
 		r = kvm_arch_vm_ioctl(filp, ioctl, arg);
 	}
@@ -3988,6 +4215,7 @@ static void kvm_sched_in(struct preempt_notifier *pn, int cpu)
 	if (vcpu->preempted)
 		vcpu->preempted = false;
 
+	__this_cpu_write(kvm_running_vcpu, vcpu);
 	kvm_arch_sched_in(vcpu, cpu);
 
 	kvm_arch_vcpu_load(vcpu, cpu);
@@ -4001,6 +4229,7 @@ static void kvm_sched_out(struct preempt_notifier *pn,
 	if (current->state == TASK_RUNNING)
 		vcpu->preempted = true;
 	kvm_arch_vcpu_put(vcpu);
+	__this_cpu_write(kvm_running_vcpu, NULL);
 }
 
 int kvm_init(void *opaque, unsigned vcpu_size, unsigned vcpu_align,